@@ -0,0 +1,275 @@
+//
+//  AnimationClip.cpp
+//  MyMetalCPP
+//
+
+#include "AnimationClip.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+using Maths::Float4;
+
+static constexpr float kSmallestThreeRange = 0.70710678f;     // no component but the largest is bigger than 1/sqrt2
+static constexpr float kRotationScale = 32767.f;
+
+static uint16_t quantize( float value, float minimum, float step )
+{
+    if ( step <= 0.f )
+    {
+        return 0;
+    }
+    const float q = ( value - minimum ) / step + 0.5f;
+    return (uint16_t)std::min( std::max( q, 0.f ), 65535.f );
+}
+
+static void encodeRotation( Float4 q, uint16_t out[3] )
+{
+    q *= Maths::splat( 1.f / sqrtf( Pose::dot( q, q ) ) );
+    uint32_t largest = 0;
+    for ( uint32_t i = 1; i < 4; ++i )
+    {
+        if ( fabsf( q[i] ) > fabsf( q[ largest ] ) )
+        {
+            largest = i;
+        }
+    }
+    if ( q[ largest ] < 0.f )
+    {
+        q = -q;
+    }
+    uint32_t j = 0;
+    for ( uint32_t i = 0; i < 4; ++i )
+    {
+        if ( i != largest )
+        {
+            const float unit = std::min( std::max( q[i] / kSmallestThreeRange * 0.5f + 0.5f, 0.f ), 1.f );
+            out[ j++ ] = (uint16_t)( unit * kRotationScale + 0.5f );
+        }
+    }
+    out[0] |= (uint16_t)( ( largest >> 1 ) << 15 );
+    out[1] |= (uint16_t)( ( largest & 1 ) << 15 );
+}
+
+static Float4 decodeRotation( const uint16_t in[3] )
+{
+    const int32_t largest = ( in[0] >> 15 ) << 1 | in[1] >> 15;
+    const Maths::Int4 bits = { in[0] & 0x7fff, in[1] & 0x7fff, in[2] & 0x7fff, 0 };
+    const Float4 c = ( __builtin_convertvector( bits, Float4 ) * Maths::splat( 2.f / kRotationScale ) - Maths::splat( 1.f ) ) * Maths::splat( kSmallestThreeRange );
+    const float w = sqrtf( std::max( 0.f, 1.f - c[0] * c[0] - c[1] * c[1] - c[2] * c[2] ) );
+    // w goes in at lane largest and the lanes from there on move up one - selects rather than a
+    // switch, which mispredicts on every other track
+    const Maths::Int4 lane = { 0, 1, 2, 3 };
+    const Maths::Int4 at = { largest, largest, largest, largest };
+    const Float4 shifted = { c[0], c[0], c[1], c[2] };
+    return Maths::select( lane < at, c, Maths::select( lane == at, Maths::splat( w ), shifted ) );
+}
+
+AnimationClip::AnimationClip()
+: _framesPerSecond( 30.f )
+, _duration( 0.f )
+, _frameCount( 0 )
+{
+}
+
+size_t AnimationClip::sizeInBytes() const
+{
+    return _tracks.size() * sizeof( Track ) + ( _keyFrames.size() + _keyValues.size() ) * sizeof( uint16_t );
+}
+
+inline Float4 AnimationClip::decode( const Track& track, TrackType type, const uint16_t in[3] )
+{
+    if ( type == kRotation )
+    {
+        return decodeRotation( in );
+    }
+    return Float4{ track.minimum[0] + track.step[0] * in[0], track.minimum[1] + track.step[1] * in[1],
+                   track.minimum[2] + track.step[2] * in[2], 0.f };
+}
+
+void AnimationClip::fitTrack( Track& track, TrackType type, const Float4* pValues, float tolerance )
+{
+    track.firstKey = (uint32_t)_keyFrames.size();
+    for ( int c = 0; c < 3; ++c )
+    {
+        track.minimum[c] = 0.f;
+        track.step[c] = 0.f;
+    }
+    if ( type != kRotation )
+    {
+        for ( int c = 0; c < 3; ++c )
+        {
+            float minimum = pValues[0][c];
+            float maximum = pValues[0][c];
+            for ( uint32_t frame = 1; frame < _frameCount; ++frame )
+            {
+                minimum = std::min( minimum, pValues[ frame ][c] );
+                maximum = std::max( maximum, pValues[ frame ][c] );
+            }
+            track.minimum[c] = minimum;
+            track.step[c] = ( maximum - minimum ) / 65535.f;
+        }
+    }
+
+    auto encode = [&]( Float4 value, uint16_t out[3] )
+    {
+        if ( type == kRotation )
+        {
+            encodeRotation( value, out );
+        }
+        else
+        {
+            for ( int c = 0; c < 3; ++c )
+            {
+                out[c] = quantize( value[c], track.minimum[c], track.step[c] );
+            }
+        }
+    };
+    auto roundTrip = [&]( Float4 value )
+    {
+        uint16_t quantized[3];
+        encode( value, quantized );
+        return decode( track, type, quantized );
+    };
+    auto interpolate = [&]( Float4 a, Float4 b, float t )
+    {
+        return type == kRotation ? Pose::nlerp( a, b, t ) : a + ( b - a ) * Maths::splat( t );
+    };
+    // rotations by the angle between them, translations by distance, scales per component. Two
+    // unit quaternions an angle apart are 2 sin( angle / 4 ) apart as 4 vectors - the cosine of
+    // a small angle is too close to 1 for a float to tell them apart
+    const float rotationDistance = 2.f * sinf( tolerance * 0.25f );
+    auto fits = [&]( Float4 value, Float4 expected )
+    {
+        if ( type == kRotation )
+        {
+            expected *= Maths::splat( ( Pose::dot( value, expected ) < 0.f ? -1.f : 1.f ) / sqrtf( Pose::dot( expected, expected ) ) );
+            const Float4 difference = value - expected;
+            return Pose::dot( difference, difference ) <= rotationDistance * rotationDistance;
+        }
+        const Float4 difference = value - expected;
+        if ( type == kTranslation )
+        {
+            return difference[0] * difference[0] + difference[1] * difference[1] + difference[2] * difference[2] <= tolerance * tolerance;
+        }
+        return fabsf( difference[0] ) <= tolerance && fabsf( difference[1] ) <= tolerance && fabsf( difference[2] ) <= tolerance;
+    };
+    auto addKey = [&]( uint32_t frame )
+    {
+        uint16_t quantized[3];
+        encode( pValues[ frame ], quantized );
+        _keyFrames.push_back( (uint16_t)frame );
+        _keyValues.insert( _keyValues.end(), quantized, quantized + 3 );
+        return decode( track, type, quantized );
+    };
+
+    const Float4 first = addKey( 0 );
+    bool constant = true;
+    for ( uint32_t frame = 1; frame < _frameCount && constant; ++frame )
+    {
+        constant = fits( first, pValues[ frame ] );
+    }
+    if ( !constant )
+    {
+        // grow the span from the last key while a key at its end reproduces every frame inside it
+        uint32_t last = 0;
+        Float4 lastValue = first;
+        for ( uint32_t end = last + 2; end < _frameCount; ++end )
+        {
+            const Float4 endValue = roundTrip( pValues[ end ] );
+            bool spanFits = true;
+            for ( uint32_t frame = last + 1; frame < end && spanFits; ++frame )
+            {
+                const float t = (float)( frame - last ) / (float)( end - last );
+                spanFits = fits( interpolate( lastValue, endValue, t ), pValues[ frame ] );
+            }
+            if ( !spanFits )
+            {
+                last = end - 1;
+                lastValue = addKey( last );
+            }
+        }
+        if ( last != _frameCount - 1 )
+        {
+            addKey( _frameCount - 1 );
+        }
+    }
+    track.keyCount = (uint32_t)_keyFrames.size() - track.firstKey;
+}
+
+void AnimationClip::build( const BonePose* pFrames, uint32_t frameCount, uint32_t boneCount, float framesPerSecond, const Options& options )
+{
+    assert( frameCount > 0 && frameCount <= 65536 && framesPerSecond > 0.f );
+    _framesPerSecond = framesPerSecond;
+    _frameCount = frameCount;
+    _duration = (float)( frameCount - 1 ) / framesPerSecond;
+    _tracks.assign( boneCount * 3, Track() );
+    _keyFrames.clear();
+    _keyValues.clear();
+
+    std::vector<Float4> values( frameCount );
+    for ( uint32_t bone = 0; bone < boneCount; ++bone )
+    {
+        for ( TrackType type : { kRotation, kTranslation, kScale } )
+        {
+            for ( uint32_t frame = 0; frame < frameCount; ++frame )
+            {
+                const BonePose& pose = pFrames[ frame * boneCount + bone ];
+                values[ frame ] = type == kRotation ? pose.rotation : type == kTranslation ? pose.translation : pose.scale;
+            }
+            const float tolerance = type == kRotation ? options.rotationTolerance
+                                  : type == kTranslation ? options.translationTolerance : options.scaleTolerance;
+            fitTrack( _tracks[ bone * 3 + type ], type, values.data(), tolerance );
+        }
+    }
+    _keyFrames.shrink_to_fit();
+    _keyValues.shrink_to_fit();
+}
+
+inline Float4 AnimationClip::sampleTrack( const Track& track, TrackType type, float frame ) const
+{
+    if ( track.keyCount == 1 )
+    {
+        return decode( track, type, &_keyValues[ track.firstKey * 3 ] );
+    }
+    // the first key after the frame - guessed as if the keys were evenly spread, which the fit
+    // leaves them close to, then walked to, so it's a step or two where a binary search is a
+    // mispredicted branch per halving
+    const uint16_t* pFrames = &_keyFrames[ track.firstKey ];
+    const uint32_t lastKey = track.keyCount - 1;
+    uint32_t next = std::min( 1 + (uint32_t)( frame * lastKey / (float)( _frameCount - 1 ) ), lastKey );
+    while ( next > 1 && pFrames[ next - 1 ] > frame )
+    {
+        --next;
+    }
+    while ( next < lastKey && pFrames[ next ] <= frame )
+    {
+        ++next;
+    }
+    const float from = pFrames[ next - 1 ];
+    const float t = std::min( std::max( ( frame - from ) / ( pFrames[ next ] - from ), 0.f ), 1.f );
+    const Float4 a = decode( track, type, &_keyValues[ ( track.firstKey + next - 1 ) * 3 ] );
+    const Float4 b = decode( track, type, &_keyValues[ ( track.firstKey + next ) * 3 ] );
+    return type == kRotation ? Pose::nlerp( a, b, t ) : a + ( b - a ) * Maths::splat( t );
+}
+
+void AnimationClip::sample( float time, BonePose* pPose ) const
+{
+    const float length = (float)( _frameCount - 1 );
+    float frame = 0.f;
+    if ( length > 0.f )
+    {
+        frame = fmodf( time * _framesPerSecond, length );
+        if ( frame < 0.f )
+        {
+            frame += length;
+        }
+    }
+    for ( uint32_t bone = 0; bone < boneCount(); ++bone )
+    {
+        const Track* pTracks = &_tracks[ bone * 3 ];
+        pPose[ bone ].rotation = sampleTrack( pTracks[ kRotation ], kRotation, frame );
+        pPose[ bone ].translation = sampleTrack( pTracks[ kTranslation ], kTranslation, frame );
+        pPose[ bone ].scale = sampleTrack( pTracks[ kScale ], kScale, frame );
+    }
+}
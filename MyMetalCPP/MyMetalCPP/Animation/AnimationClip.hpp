@@ -0,0 +1,87 @@
+//
+//  AnimationClip.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Skeleton.hpp"
+
+// A looping keyframe clip for one skeleton, compressed, sampled at any time.
+//
+// build() takes every bone's local pose at every frame and fits each track - one bone's
+// rotation, translation or scale - with as few keys as it can: it extends the span from the last
+// kept key while interpolating to the frame at its end (nlerp for rotations, lerp otherwise)
+// stays within tolerance of every raw frame in between, and keeps the frame before the first
+// one that doesn't. A constant track ends up with one key, a smooth one with a handful. The
+// keys are quantized as they are fitted, so the tolerances bound the error of what is stored:
+//
+//   rotations      smallest three - the largest component is dropped (the quaternion negated so
+//                  it's positive, and rebuilt from the other three), the rest are 15 bits each
+//                  over [-1/sqrt2, 1/sqrt2] and the dropped one's 2 bit index is in the top bits
+//                  of the first two. 6 bytes a key
+//   translation,   16 bits a component over the track's own range, kept as a minimum and step
+//   scale          per track. 6 bytes a key
+//   key frames     16 bit frame numbers, so a clip is at most 65536 frames
+//
+// sample() finds each track's keys around the time - a guess from where the time is in the clip,
+// walked a key or two to the right place - decodes the two and interpolates. Tolerances are in
+// the bone's local space, and errors add up down a chain - keep them a few times tighter than
+// what should be visible at the end of the longest one.
+
+class AnimationClip
+{
+public:
+    struct Options
+    {
+        float rotationTolerance = 1e-3f;        // radians
+        float translationTolerance = 1e-4f;     // distance, as the poses have it
+        float scaleTolerance = 1e-4f;           // per component
+    };
+
+    AnimationClip();
+
+    // pFrames[ frame * boneCount + bone ], frameCount of them at framesPerSecond. The last frame
+    // should be the same as the first - it's where the clip wraps around
+    void build( const BonePose* pFrames, uint32_t frameCount, uint32_t boneCount, float framesPerSecond, const Options& options );
+
+    // The pose at time seconds, wrapped into the clip, boneCount() bones into pPose
+    void sample( float time, BonePose* pPose ) const;
+
+    float duration() const { return _duration; }
+    uint32_t boneCount() const { return (uint32_t)_tracks.size() / 3; }
+    uint32_t frameCount() const { return _frameCount; }
+    size_t keyCount() const { return _keyFrames.size(); }
+    size_t sizeInBytes() const;
+
+private:
+    enum TrackType
+    {
+        kRotation = 0,
+        kTranslation = 1,
+        kScale = 2,
+    };
+
+    struct Track
+    {
+        uint32_t firstKey;
+        uint32_t keyCount;
+        float minimum[3];           // translation and scale - value = minimum + step * quantized
+        float step[3];
+    };
+
+    void fitTrack( Track& track, TrackType type, const Maths::Float4* pValues, float tolerance );
+    static Maths::Float4 decode( const Track& track, TrackType type, const uint16_t in[3] );
+    Maths::Float4 sampleTrack( const Track& track, TrackType type, float frame ) const;
+
+    float _framesPerSecond;
+    float _duration;
+    uint32_t _frameCount;
+    std::vector<Track> _tracks;             // rotation, translation, scale of each bone
+    std::vector<uint16_t> _keyFrames;
+    std::vector<uint16_t> _keyValues;       // 3 a key
+};
@@ -0,0 +1,73 @@
+//
+//  Animator.cpp
+//  MyMetalCPP
+//
+
+#include "Animator.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+static constexpr size_t kGroupsPerJob = 16;         // of 4 characters
+
+static float wrapTime( float time, float duration )
+{
+    if ( duration <= 0.f )
+    {
+        return 0.f;
+    }
+    time = fmodf( time, duration );
+    return time < 0.f ? time + duration : time;
+}
+
+Animator::Animator( const Skeleton& skeleton )
+: _skeleton( skeleton )
+{
+}
+
+Animator::CharacterId Animator::addCharacter( const Character& character )
+{
+    assert( character.pClipA && character.pClipA->boneCount() == _skeleton.boneCount() );
+    assert( !character.pClipB || character.pClipB->boneCount() == _skeleton.boneCount() );
+    _characters.push_back( character );
+    _skin.resize( _characters.size() * _skeleton.boneCount() );
+    return (CharacterId)_characters.size() - 1;
+}
+
+void Animator::update( float deltaTime )
+{
+    const uint32_t boneCount = _skeleton.boneCount();
+    const size_t groupCount = ( _characters.size() + 3 ) / 4;
+    JobSystem::Instance()->parallelFor( groupCount, kGroupsPerJob, [&]( size_t begin, size_t end )
+    {
+        std::vector<BonePose> poses( 4 * boneCount );
+        std::vector<BonePose> blendPose( boneCount );
+        for ( size_t group = begin; group < end; ++group )
+        {
+            const size_t first = group * 4;
+            const uint32_t count = (uint32_t)std::min<size_t>( 4, _characters.size() - first );
+            const BonePose* ppPoses[4];
+            Matrix44f* ppSkin[4];
+            for ( uint32_t k = 0; k < count; ++k )
+            {
+                Character& character = _characters[ first + k ];
+                BonePose* pPose = &poses[ k * boneCount ];
+                character.timeA = wrapTime( character.timeA + deltaTime, character.pClipA->duration() );
+                character.pClipA->sample( character.timeA, pPose );
+                if ( character.pClipB )
+                {
+                    character.timeB = wrapTime( character.timeB + deltaTime, character.pClipB->duration() );
+                    if ( character.weight > 0.f )
+                    {
+                        character.pClipB->sample( character.timeB, blendPose.data() );
+                        _skeleton.blend( pPose, blendPose.data(), character.weight, pPose );
+                    }
+                }
+                ppPoses[k] = pPose;
+                ppSkin[k] = &_skin[ ( first + k ) * boneCount ];
+            }
+            _skeleton.skinMatrices( ppPoses, ppSkin, count );
+        }
+    } );
+}
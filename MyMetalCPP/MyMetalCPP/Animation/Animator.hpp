@@ -0,0 +1,55 @@
+//
+//  Animator.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "AnimationClip.hpp"
+#include "Skeleton.hpp"
+
+// Characters sharing one skeleton, each playing a blend of two clips, updated together.
+//
+// update() moves every character's clip times on, then works in groups of 4 characters: sample
+// both clips of each, blend them, and compute the 4 sets of skin matrices in one
+// Skeleton::skinMatrices() pass. The groups are spread over the JobSystem kGroupsPerJob at a
+// time, with the poses in scratch belonging to the job, so the only writes to shared memory are
+// each character's own time and skin matrices. Those are boneCount() Matrix44f a character, one
+// after another - a bone buffer for a skinning shader as they are, or input to Skinning::skin().
+
+class Animator
+{
+public:
+    typedef uint32_t CharacterId;
+
+    struct Character
+    {
+        const AnimationClip* pClipA;
+        const AnimationClip* pClipB;        // nullptr plays A alone
+        float timeA;                        // seconds
+        float timeB;
+        float weight;                       // of B
+    };
+
+    // The skeleton and clips have to outlive the animator
+    explicit Animator( const Skeleton& skeleton );
+
+    CharacterId addCharacter( const Character& character );
+    Character& character( CharacterId id ) { return _characters[ id ]; }
+    size_t characterCount() const { return _characters.size(); }
+
+    // Advances every character by deltaTime seconds and recomputes all the skin matrices
+    void update( float deltaTime );
+
+    const Matrix44f* skinMatrices( CharacterId id ) const { return &_skin[ (size_t)id * _skeleton.boneCount() ]; }
+    const Matrix44f* skinMatrices() const { return _skin.data(); }
+
+private:
+    const Skeleton& _skeleton;
+    std::vector<Character> _characters;
+    std::vector<Matrix44f> _skin;
+};
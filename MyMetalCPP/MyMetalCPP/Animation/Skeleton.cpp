@@ -0,0 +1,204 @@
+//
+//  Skeleton.cpp
+//  MyMetalCPP
+//
+
+#include "Skeleton.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+using Maths::Float4;
+
+// Affine 4x3 from a pose, column major
+static void localMatrix( const BonePose& pose, float m[12] )
+{
+    const float x = pose.rotation[0], y = pose.rotation[1], z = pose.rotation[2], w = pose.rotation[3];
+    const float sx = pose.scale[0], sy = pose.scale[1], sz = pose.scale[2];
+    m[0] = ( 1.f - 2.f * ( y * y + z * z ) ) * sx;
+    m[1] = 2.f * ( x * y + w * z ) * sx;
+    m[2] = 2.f * ( x * z - w * y ) * sx;
+    m[3] = 2.f * ( x * y - w * z ) * sy;
+    m[4] = ( 1.f - 2.f * ( x * x + z * z ) ) * sy;
+    m[5] = 2.f * ( y * z + w * x ) * sy;
+    m[6] = 2.f * ( x * z + w * y ) * sz;
+    m[7] = 2.f * ( y * z - w * x ) * sz;
+    m[8] = ( 1.f - 2.f * ( x * x + y * y ) ) * sz;
+    m[9] = pose.translation[0];
+    m[10] = pose.translation[1];
+    m[11] = pose.translation[2];
+}
+
+static void multiplyAffine( const float a[12], const float b[12], float out[12] )
+{
+    for ( int column = 0; column < 4; ++column )
+    {
+        for ( int row = 0; row < 3; ++row )
+        {
+            out[ column * 3 + row ] = a[ row ] * b[ column * 3 ] + a[ 3 + row ] * b[ column * 3 + 1 ] + a[ 6 + row ] * b[ column * 3 + 2 ]
+                                    + ( column == 3 ? a[ 9 + row ] : 0.f );
+        }
+    }
+}
+
+// The 3x3 part inverted by cross products of its columns, then the translation taken back through it
+static void invertAffine( const float m[12], float out[12] )
+{
+    const float* a = m;
+    const float* b = m + 3;
+    const float* c = m + 6;
+    const float bc[3] = { b[1] * c[2] - b[2] * c[1], b[2] * c[0] - b[0] * c[2], b[0] * c[1] - b[1] * c[0] };
+    const float ca[3] = { c[1] * a[2] - c[2] * a[1], c[2] * a[0] - c[0] * a[2], c[0] * a[1] - c[1] * a[0] };
+    const float ab[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+    const float determinant = a[0] * bc[0] + a[1] * bc[1] + a[2] * bc[2];
+    assert( determinant != 0.f );
+    const float invDeterminant = 1.f / determinant;
+    // rows of the inverse are bc, ca and ab
+    for ( int column = 0; column < 3; ++column )
+    {
+        out[ column * 3 ] = bc[ column ] * invDeterminant;
+        out[ column * 3 + 1 ] = ca[ column ] * invDeterminant;
+        out[ column * 3 + 2 ] = ab[ column ] * invDeterminant;
+    }
+    for ( int row = 0; row < 3; ++row )
+    {
+        out[ 9 + row ] = -( out[ row ] * m[9] + out[ 3 + row ] * m[10] + out[ 6 + row ] * m[11] );
+    }
+}
+
+uint32_t Skeleton::addBone( uint32_t parent, const BonePose& bindPose )
+{
+    assert( parent == kNoParent || parent < _parent.size() );
+    assert( _parent.size() < kMaxBones );
+    const uint32_t bone = (uint32_t)_parent.size();
+    _parent.push_back( parent );
+    _bindPose.push_back( bindPose );
+
+    float local[12];
+    float model[12];
+    localMatrix( bindPose, local );
+    if ( parent == kNoParent )
+    {
+        std::copy( local, local + 12, model );
+    }
+    else
+    {
+        multiplyAffine( &_bindModel[ parent * 12 ], local, model );
+    }
+    float inverse[12];
+    invertAffine( model, inverse );
+    _bindModel.insert( _bindModel.end(), model, model + 12 );
+    _inverseBind.insert( _inverseBind.end(), inverse, inverse + 12 );
+    return bone;
+}
+
+Matrix44f Skeleton::bindMatrix( uint32_t bone ) const
+{
+    const float* m = &_bindModel[ bone * 12 ];
+    return simd_matrix( (Vector4f){ m[0], m[1], m[2], 0.f },
+                        (Vector4f){ m[3], m[4], m[5], 0.f },
+                        (Vector4f){ m[6], m[7], m[8], 0.f },
+                        (Vector4f){ m[9], m[10], m[11], 1.f } );
+}
+
+void Skeleton::blend( const BonePose* pA, const BonePose* pB, float weight, BonePose* pOut ) const
+{
+    const Float4 t = Maths::splat( weight );
+    for ( size_t bone = 0; bone < _parent.size(); ++bone )
+    {
+        const BonePose& a = pA[ bone ];
+        const BonePose& b = pB[ bone ];
+        pOut[ bone ].rotation = Pose::nlerp( a.rotation, b.rotation, weight );
+        pOut[ bone ].translation = a.translation + ( b.translation - a.translation ) * t;
+        pOut[ bone ].scale = a.scale + ( b.scale - a.scale ) * t;
+    }
+}
+
+void Skeleton::skinMatrices( const BonePose* const* ppPoses, Matrix44f* const* ppSkin, uint32_t count ) const
+{
+    assert( count >= 1 && count <= 4 );
+    // model matrices of the 4 lanes, 12 registers a bone - parents are read back from here
+    static thread_local std::vector<Float4> model;
+    model.resize( _parent.size() * 12 );
+
+    const Float4 two = Maths::splat( 2.f );
+    const Float4 one = Maths::splat( 1.f );
+    for ( size_t bone = 0; bone < _parent.size(); ++bone )
+    {
+        // lane k is pose k, lanes past count repeat the last - computed and ignored
+        Float4 qx, qy, qz, qw, sx, sy, sz, tx, ty, tz;
+        for ( uint32_t k = 0; k < 4; ++k )
+        {
+            const BonePose& pose = ppPoses[ std::min( k, count - 1 ) ][ bone ];
+            qx[k] = pose.rotation[0];
+            qy[k] = pose.rotation[1];
+            qz[k] = pose.rotation[2];
+            qw[k] = pose.rotation[3];
+            tx[k] = pose.translation[0];
+            ty[k] = pose.translation[1];
+            tz[k] = pose.translation[2];
+            sx[k] = pose.scale[0];
+            sy[k] = pose.scale[1];
+            sz[k] = pose.scale[2];
+        }
+        const Float4 xx = qx * qx, yy = qy * qy, zz = qz * qz;
+        const Float4 xy = qx * qy, xz = qx * qz, yz = qy * qz;
+        const Float4 wx = qw * qx, wy = qw * qy, wz = qw * qz;
+        const Float4 local[12] = {
+            ( one - two * ( yy + zz ) ) * sx, two * ( xy + wz ) * sx, two * ( xz - wy ) * sx,
+            two * ( xy - wz ) * sy, ( one - two * ( xx + zz ) ) * sy, two * ( yz + wx ) * sy,
+            two * ( xz + wy ) * sz, two * ( yz - wx ) * sz, ( one - two * ( xx + yy ) ) * sz,
+            tx, ty, tz,
+        };
+
+        // model = parent * local, the parent the same bone in every lane
+        Float4* m = &model[ bone * 12 ];
+        const uint32_t parent = _parent[ bone ];
+        if ( parent == kNoParent )
+        {
+            std::copy( local, local + 12, m );
+        }
+        else
+        {
+            const Float4* p = &model[ parent * 12 ];
+            for ( int column = 0; column < 4; ++column )
+            {
+                const Float4* l = &local[ column * 3 ];
+                for ( int row = 0; row < 3; ++row )
+                {
+                    m[ column * 3 + row ] = p[ row ] * l[0] + p[ 3 + row ] * l[1] + p[ 6 + row ] * l[2];
+                }
+            }
+            for ( int row = 0; row < 3; ++row )
+            {
+                m[ 9 + row ] += p[ 9 + row ];
+            }
+        }
+
+        // skin = model * inverse bind, the inverse bind the same in every lane
+        const float* inverse = &_inverseBind[ bone * 12 ];
+        Float4 skin[12];
+        for ( int column = 0; column < 4; ++column )
+        {
+            const Float4 i0 = Maths::splat( inverse[ column * 3 ] );
+            const Float4 i1 = Maths::splat( inverse[ column * 3 + 1 ] );
+            const Float4 i2 = Maths::splat( inverse[ column * 3 + 2 ] );
+            for ( int row = 0; row < 3; ++row )
+            {
+                skin[ column * 3 + row ] = m[ row ] * i0 + m[ 3 + row ] * i1 + m[ 6 + row ] * i2;
+            }
+        }
+        for ( int row = 0; row < 3; ++row )
+        {
+            skin[ 9 + row ] += m[ 9 + row ];
+        }
+
+        for ( uint32_t k = 0; k < count; ++k )
+        {
+            ppSkin[k][ bone ] = simd_matrix( (Vector4f){ skin[0][k], skin[1][k], skin[2][k], 0.f },
+                                             (Vector4f){ skin[3][k], skin[4][k], skin[5][k], 0.f },
+                                             (Vector4f){ skin[6][k], skin[7][k], skin[8][k], 0.f },
+                                             (Vector4f){ skin[9][k], skin[10][k], skin[11][k], 1.f } );
+        }
+    }
+}
@@ -0,0 +1,87 @@
+//
+//  Skeleton.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <math.h>
+#include <vector>
+
+#include "../Maths/MathsTypes.h"
+#include "../Maths/VectorExt.hpp"
+
+// A bone's local transform - quaternion rotation (see Maths::makeQuaternion), translation and
+// scale, a Float4 each so poses load, blend and store as whole registers. The w of translation
+// and scale is unused.
+struct BonePose
+{
+    Maths::Float4 rotation;
+    Maths::Float4 translation;
+    Maths::Float4 scale;
+};
+
+namespace Pose
+{
+    inline float dot( Maths::Float4 a, Maths::Float4 b )
+    {
+        const Maths::Float4 p = a * b;
+        return p[0] + p[1] + p[2] + p[3];
+    }
+
+    // Normalized lerp from a to b along the shorter arc - not constant speed like slerp, but
+    // within a fraction of a degree of it between keys a few degrees apart, and no trig
+    inline Maths::Float4 nlerp( Maths::Float4 a, Maths::Float4 b, float t )
+    {
+        if ( dot( a, b ) < 0.f )
+        {
+            b = -b;
+        }
+        const Maths::Float4 q = a + ( b - a ) * Maths::splat( t );
+        return q * Maths::splat( 1.f / sqrtf( dot( q, q ) ) );
+    }
+}
+
+// Bone hierarchy of a skinned character, with its bind pose.
+//
+// Bones are stored parents first - addBone() takes a parent that already exists - so one pass
+// in index order gets every model space transform right after its parent's. Each bone keeps the
+// inverse of its bind pose model matrix; a skin matrix is model * inverse bind, and takes a
+// vertex from where the bind pose has it to where the pose puts it.
+//
+// skinMatrices() does 4 poses of the skeleton at once, one per Float4 lane. Every lane shares
+// the parent indices, so the walk down the bones needs no gathers - the parent's matrix is the
+// 12 registers stored a few bones back - and the matrix maths of SceneGraph::update() runs 4
+// characters per instruction. Within one character the hierarchy is narrow and deep (a
+// humanoid is 60-odd bones, a dozen levels down to the fingertips), too little work per level
+// to split across threads, so the parallelism is across characters: Animator hands groups of 4
+// to the JobSystem.
+
+class Skeleton
+{
+public:
+    static constexpr uint32_t kNoParent = ~0u;
+    static constexpr uint32_t kMaxBones = 256;      // skinning takes 8 bit bone indices
+
+    // The parent has to be added already. Returns the bone index
+    uint32_t addBone( uint32_t parent, const BonePose& bindPose );
+
+    uint32_t boneCount() const { return (uint32_t)_parent.size(); }
+    uint32_t parent( uint32_t bone ) const { return _parent[ bone ]; }
+    const BonePose* bindPose() const { return _bindPose.data(); }
+    Matrix44f bindMatrix( uint32_t bone ) const;        // model space
+
+    // boneCount() poses, weight 0 all a, 1 all b. pOut can be a or b
+    void blend( const BonePose* pA, const BonePose* pB, float weight, BonePose* pOut ) const;
+
+    // Skin matrices of ppPoses[k] into ppSkin[k], boneCount() each, for count (1 to 4) poses
+    void skinMatrices( const BonePose* const* ppPoses, Matrix44f* const* ppSkin, uint32_t count ) const;
+
+private:
+    std::vector<uint32_t> _parent;
+    std::vector<BonePose> _bindPose;
+    std::vector<float> _bindModel;          // affine 4x3, column major, 12 a bone
+    std::vector<float> _inverseBind;
+};
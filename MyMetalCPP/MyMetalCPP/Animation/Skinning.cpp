@@ -0,0 +1,114 @@
+//
+//  Skinning.cpp
+//  MyMetalCPP
+//
+
+#include "Skinning.hpp"
+#include "../Maths/VectorExt.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <math.h>
+
+using Maths::Float4;
+
+static_assert( sizeof( Vector3f ) == sizeof( Float4 ) && sizeof( Vector4f ) == sizeof( Float4 ), "positions, normals and matrix columns load as a Float4" );
+
+static inline Float4 load( const void* p )
+{
+    Float4 v;
+    memcpy( &v, p, sizeof( v ) );
+    return v;
+}
+
+namespace Skinning
+{
+    void skin( const Matrix44f* pSkin, const VertexData* pIn, const BoneWeights* pWeights, size_t count, VertexData* pOut )
+    {
+        const Float4 kWeightScale = Maths::splat( 1.f / 255.f );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            // written out rather than looped over slots, so the blended columns stay in registers
+            // instead of going through memory on every add
+            const BoneWeights& weights = pWeights[i];
+            const Float4 w0 = Maths::splat( (float)weights.weights[0] ) * kWeightScale;
+            const Float4 w1 = Maths::splat( (float)weights.weights[1] ) * kWeightScale;
+            const Float4 w2 = Maths::splat( (float)weights.weights[2] ) * kWeightScale;
+            const Float4 w3 = Maths::splat( (float)weights.weights[3] ) * kWeightScale;
+            const Vector4f* m0 = pSkin[ weights.bones[0] ].columns;
+            const Vector4f* m1 = pSkin[ weights.bones[1] ].columns;
+            const Vector4f* m2 = pSkin[ weights.bones[2] ].columns;
+            const Vector4f* m3 = pSkin[ weights.bones[3] ].columns;
+            const Float4 c0 = load( &m0[0] ) * w0 + load( &m1[0] ) * w1 + load( &m2[0] ) * w2 + load( &m3[0] ) * w3;
+            const Float4 c1 = load( &m0[1] ) * w0 + load( &m1[1] ) * w1 + load( &m2[1] ) * w2 + load( &m3[1] ) * w3;
+            const Float4 c2 = load( &m0[2] ) * w0 + load( &m1[2] ) * w1 + load( &m2[2] ) * w2 + load( &m3[2] ) * w3;
+            const Float4 c3 = load( &m0[3] ) * w0 + load( &m1[3] ) * w1 + load( &m2[3] ) * w2 + load( &m3[3] ) * w3;
+
+            const VertexData& in = pIn[i];
+            const Float4 p = load( &in.position );
+            const Float4 n = load( &in.normal );
+            const Float4 position = c0 * Maths::splat( p[0] ) + c1 * Maths::splat( p[1] ) + c2 * Maths::splat( p[2] ) + c3;
+            Float4 normal = c0 * Maths::splat( n[0] ) + c1 * Maths::splat( n[1] ) + c2 * Maths::splat( n[2] );
+            const Float4 squared = normal * normal;         // w is 0 - the columns' w are
+            const float lengthSquared = squared[0] + squared[1] + squared[2];
+            if ( lengthSquared > 0.f )
+            {
+                normal *= Maths::splat( 1.f / sqrtf( lengthSquared ) );
+            }
+
+            VertexData& out = pOut[i];
+            memcpy( (void*)&out.position, &position, sizeof( position ) );
+            memcpy( (void*)&out.normal, &normal, sizeof( normal ) );
+            out.texcoord = in.texcoord;
+        }
+    }
+
+    void skinReference( const Matrix44f* pSkin, const VertexData* pIn, const BoneWeights* pWeights, size_t count, VertexData* pOut )
+    {
+        for ( size_t i = 0; i < count; ++i )
+        {
+            const VertexData& in = pIn[i];
+            Vector4f position = { 0.f, 0.f, 0.f, 0.f };
+            Vector4f normal = { 0.f, 0.f, 0.f, 0.f };
+            for ( int slot = 0; slot < 4; ++slot )
+            {
+                if ( pWeights[i].weights[ slot ] == 0 )
+                {
+                    continue;
+                }
+                const float weight = pWeights[i].weights[ slot ] / 255.f;
+                const Matrix44f& matrix = pSkin[ pWeights[i].bones[ slot ] ];
+                position = position + ( matrix * (Vector4f){ in.position.x, in.position.y, in.position.z, 1.f } ) * weight;
+                normal = normal + ( matrix * (Vector4f){ in.normal.x, in.normal.y, in.normal.z, 0.f } ) * weight;
+            }
+            const float length = sqrtf( normal.x * normal.x + normal.y * normal.y + normal.z * normal.z );
+            if ( length > 0.f )
+            {
+                normal = normal * ( 1.f / length );
+            }
+            pOut[i].position = simd_make_float3( position );
+            pOut[i].normal = simd_make_float3( normal );
+            pOut[i].texcoord = in.texcoord;
+        }
+    }
+
+    BoneWeights makeWeights( const uint32_t bones[4], const float weights[4] )
+    {
+        BoneWeights result;
+        const float total = weights[0] + weights[1] + weights[2] + weights[3];
+        assert( total > 0.f );
+        int sum = 0;
+        int largest = 0;
+        for ( int slot = 0; slot < 4; ++slot )
+        {
+            assert( bones[ slot ] < 256 );
+            result.bones[ slot ] = (uint8_t)bones[ slot ];
+            result.weights[ slot ] = (uint8_t)( weights[ slot ] / total * 255.f + 0.5f );
+            sum += result.weights[ slot ];
+            largest = weights[ slot ] > weights[ largest ] ? slot : largest;
+        }
+        // the rounding error goes to the biggest, so it stays within a step of its own rounding
+        result.weights[ largest ] = (uint8_t)( result.weights[ largest ] + 255 - sum );
+        return result;
+    }
+}
@@ -0,0 +1,41 @@
+//
+//  Skinning.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../Shaders/ShaderStructs.h"
+
+// Up to 4 bones moving a vertex - 8 bit indices into the skin matrices and unorm weights that
+// add up to 255. A stream of its own next to the bind pose vertices, 8 bytes a vertex.
+struct BoneWeights
+{
+    uint8_t bones[4];
+    uint8_t weights[4];
+};
+
+// Linear blend skinning on the CPU, for vertex buffers the renderer draws as they are.
+//
+// skin() takes the bind pose VertexData and moves each vertex by the weighted sum of its bones'
+// skin matrices (Skeleton::skinMatrices()). A vertex at a time with the matrix columns in
+// Float4 registers: the 4 matrices' columns are blended with splatted weights - unused slots
+// have weight 0 and go through the same multiplies, cheaper than a branch per slot - the
+// position is c0 x + c1 y + c2 z + c3, the normal c0 x + c1 y + c2 z renormalized, and the
+// texcoord is copied. That normal is right for rotations and uniform scale, which is what
+// skeletons animate; non-uniform scale would want the inverse transpose. Vertices are
+// independent, so callers split a big buffer, or many characters' buffers, over the JobSystem.
+
+namespace Skinning
+{
+    void skin( const Matrix44f* pSkin, const VertexData* pIn, const BoneWeights* pWeights, size_t count, VertexData* pOut );
+
+    // A bone at a time through Matrix44f, what skin() is checked against
+    void skinReference( const Matrix44f* pSkin, const VertexData* pIn, const BoneWeights* pWeights, size_t count, VertexData* pOut );
+
+    // bones[i] with weights[i], normalized and rounded so the 8 bit weights add up to 255
+    BoneWeights makeWeights( const uint32_t bones[4], const float weights[4] );
+}
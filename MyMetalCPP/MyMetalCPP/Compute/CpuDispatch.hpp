@@ -0,0 +1,49 @@
+//
+//  CpuDispatch.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include "CpuShaderTypes.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+// CPU equivalent of dispatchThreads for kernels written against KernelShim.h.
+// The grid is cut into tiles that are handed out to the JobSystem; inside a tile x runs
+// fastest so consecutive invocations touch consecutive texels and the compiler can
+// vectorise kernels simple enough to allow it.
+
+namespace CpuDispatch
+{
+    static constexpr metal::uint kTileWidth = 64;
+    static constexpr metal::uint kTileHeight = 4;
+
+    // kernel( uint2 index, uint2 gridSize )
+    template<typename Kernel>
+    void dispatchThreads( metal::uint2 gridSize, const Kernel& kernel )
+    {
+        using metal::uint;
+        using metal::uint2;
+
+        const uint tilesX = ( gridSize.x + kTileWidth - 1 ) / kTileWidth;
+        const uint tilesY = ( gridSize.y + kTileHeight - 1 ) / kTileHeight;
+
+        JobSystem::Instance()->parallelFor( (size_t)tilesX * tilesY, 1, [&]( size_t begin, size_t end )
+        {
+            for ( size_t tile = begin; tile < end; ++tile )
+            {
+                const uint x0 = (uint)( tile % tilesX ) * kTileWidth;
+                const uint y0 = (uint)( tile / tilesX ) * kTileHeight;
+                const uint x1 = std::min( x0 + kTileWidth, gridSize.x );
+                const uint y1 = std::min( y0 + kTileHeight, gridSize.y );
+                for ( uint y = y0; y < y1; ++y )
+                {
+                    for ( uint x = x0; x < x1; ++x )
+                    {
+                        kernel( uint2( x, y ), gridSize );
+                    }
+                }
+            }
+        } );
+    }
+}
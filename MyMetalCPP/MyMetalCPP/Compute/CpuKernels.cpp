@@ -0,0 +1,57 @@
+//
+//  CpuKernels.cpp
+//  MyMetalCPP
+//
+
+#include "CpuKernels.hpp"
+#include "CpuDispatch.hpp"
+
+#include "../Shaders/MandelbrotKernel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <math.h>
+
+namespace CpuKernels
+{
+    void mandelbrotSet( CpuTexture& texture, uint frame )
+    {
+        texture2d< half, access::write > tex( texture );
+        CpuDispatch::dispatchThreads( uint2( texture.width, texture.height ), [&]( uint2 index, uint2 gridSize )
+        {
+            mandelbrot_set( tex, index, gridSize, &frame );
+        } );
+    }
+
+    void mandelbrotSetReference( CpuTexture& texture, uint frame )
+    {
+        assert( texture.format == CpuTexture::Format::RGBA8Unorm );
+        const float zoom = powf( 0.62f + 0.38f * cosf( 0.01f * frame ), 4.f );
+        for ( uint y = 0; y < texture.height; ++y )
+        {
+            uint8_t* pRow = static_cast<uint8_t*>( texture.pData ) + y * texture.rowPitch;
+            for ( uint x = 0; x < texture.width; ++x )
+            {
+                const float x0 = zoom * 2.2f * ( (float)x / texture.width - 0.2f ) - 1.2f;
+                const float y0 = zoom * 2.f * ( (float)y / texture.height - 0.35f ) - 0.32f;
+                float zx = 0.f;
+                float zy = 0.f;
+                uint iteration = 0;
+                while ( zx * zx + zy * zy <= 4.f && iteration < 1000 )
+                {
+                    const float next = zx * zx - zy * zy + x0;
+                    zy = 2.f * zx * zy + y0;
+                    zx = next;
+                    ++iteration;
+                }
+                const float shade = (float)( 0.5 + 0.5 * cos( 3.0 + iteration * 0.15 ) );
+                const uint8_t value = (uint8_t)( std::min( std::max( shade, 0.f ), 1.f ) * 255.f + 0.5f );
+                uint8_t* p = pRow + x * 4;
+                p[0] = value;
+                p[1] = value;
+                p[2] = value;
+                p[3] = 255;
+            }
+        }
+    }
+}
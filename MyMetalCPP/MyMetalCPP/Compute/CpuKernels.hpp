@@ -0,0 +1,19 @@
+//
+//  CpuKernels.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include "CpuShaderTypes.hpp"
+
+// CPU entry points for the shared kernels - same arguments the GPU versions get bound
+
+namespace CpuKernels
+{
+    void mandelbrotSet( metal::CpuTexture& texture, metal::uint frame );
+
+    // Plain loops on this thread, without the shim or the dispatcher - what mandelbrotSet is
+    // checked against. RGBA8Unorm only
+    void mandelbrotSetReference( metal::CpuTexture& texture, metal::uint frame );
+}
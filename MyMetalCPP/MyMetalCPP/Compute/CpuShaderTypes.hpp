@@ -0,0 +1,316 @@
+//
+//  CpuShaderTypes.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+// Just enough of the Metal shading language for the shared shaders in Shaders/*.h to
+// compile as C++. Sizes and alignments match simd/simd.h (float3 is 16 bytes) so the
+// ShaderStructs.h layouts are the same on both sides - MathsTypes.h uses these types when
+// USE_SIMD is off.
+// half is emulated with float, so CPU results can differ from the GPU in the last bits.
+// On Apple platforms ShaderStructs.h keeps the real simd types, so they convert implicitly
+// into these when shared shader code reads them.
+
+#include <math.h>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined( __APPLE__ )
+#include <simd/simd.h>
+#define MM_FROM_SIMD( ... ) __VA_ARGS__
+#else
+#define MM_FROM_SIMD( ... )
+#endif
+
+namespace metal
+{
+    using uint = unsigned int;
+    using half = float;
+
+    template<typename T>
+    struct alignas( 2 * sizeof( T ) ) vec2
+    {
+        T x, y;
+        constexpr vec2() : x( 0 ), y( 0 ) {}
+        constexpr vec2( T s ) : x( s ), y( s ) {}
+        constexpr vec2( T x_, T y_ ) : x( x_ ), y( y_ ) {}
+        template<typename U> constexpr explicit vec2( const vec2<U>& v ) : x( (T)v.x ), y( (T)v.y ) {}
+        MM_FROM_SIMD( vec2( simd_float2 v ) : x( (T)v.x ), y( (T)v.y ) {} )
+    };
+
+    template<typename T>
+    struct alignas( 4 * sizeof( T ) ) vec3
+    {
+        T x, y, z;
+        constexpr vec3() : x( 0 ), y( 0 ), z( 0 ) {}
+        constexpr vec3( T s ) : x( s ), y( s ), z( s ) {}
+        constexpr vec3( T x_, T y_, T z_ ) : x( x_ ), y( y_ ), z( z_ ) {}
+        template<typename U> constexpr explicit vec3( const vec3<U>& v ) : x( (T)v.x ), y( (T)v.y ), z( (T)v.z ) {}
+        MM_FROM_SIMD( vec3( simd_float3 v ) : x( (T)v.x ), y( (T)v.y ), z( (T)v.z ) {} )
+    };
+
+    template<typename T>
+    struct alignas( 4 * sizeof( T ) ) vec4
+    {
+        T x, y, z, w;
+        constexpr vec4() : x( 0 ), y( 0 ), z( 0 ), w( 0 ) {}
+        constexpr vec4( T s ) : x( s ), y( s ), z( s ), w( s ) {}
+        constexpr vec4( T x_, T y_, T z_, T w_ ) : x( x_ ), y( y_ ), z( z_ ), w( w_ ) {}
+        constexpr vec4( const vec3<T>& v, T w_ ) : x( v.x ), y( v.y ), z( v.z ), w( w_ ) {}
+        template<typename U> constexpr explicit vec4( const vec4<U>& v ) : x( (T)v.x ), y( (T)v.y ), z( (T)v.z ), w( (T)v.w ) {}
+        MM_FROM_SIMD( vec4( simd_float4 v ) : x( (T)v.x ), y( (T)v.y ), z( (T)v.z ), w( (T)v.w ) {} )
+    };
+
+    template<typename S> using ScalarOnly = typename std::enable_if<std::is_arithmetic<S>::value>::type;
+
+    template<typename T> constexpr vec2<T> operator+( vec2<T> a, vec2<T> b ) { return { a.x + b.x, a.y + b.y }; }
+    template<typename T> constexpr vec2<T> operator-( vec2<T> a, vec2<T> b ) { return { a.x - b.x, a.y - b.y }; }
+    template<typename T> constexpr vec2<T> operator*( vec2<T> a, vec2<T> b ) { return { a.x * b.x, a.y * b.y }; }
+    template<typename T> constexpr vec2<T> operator/( vec2<T> a, vec2<T> b ) { return { a.x / b.x, a.y / b.y }; }
+    template<typename T, typename S, typename = ScalarOnly<S>> constexpr vec2<T> operator*( vec2<T> a, S s ) { return { a.x * (T)s, a.y * (T)s }; }
+    template<typename T, typename S, typename = ScalarOnly<S>> constexpr vec2<T> operator*( S s, vec2<T> a ) { return { a.x * (T)s, a.y * (T)s }; }
+    template<typename T, typename S, typename = ScalarOnly<S>> constexpr vec2<T> operator/( vec2<T> a, S s ) { return { a.x / (T)s, a.y / (T)s }; }
+    template<typename T> constexpr T dot( vec2<T> a, vec2<T> b ) { return a.x * b.x + a.y * b.y; }
+
+    template<typename T> constexpr vec3<T> operator+( vec3<T> a, vec3<T> b ) { return { a.x + b.x, a.y + b.y, a.z + b.z }; }
+    template<typename T> constexpr vec3<T> operator-( vec3<T> a, vec3<T> b ) { return { a.x - b.x, a.y - b.y, a.z - b.z }; }
+    template<typename T> constexpr vec3<T> operator-( vec3<T> a ) { return { -a.x, -a.y, -a.z }; }
+    template<typename T> constexpr vec3<T> operator*( vec3<T> a, vec3<T> b ) { return { a.x * b.x, a.y * b.y, a.z * b.z }; }
+    template<typename T, typename S, typename = ScalarOnly<S>> constexpr vec3<T> operator*( vec3<T> a, S s ) { return { a.x * (T)s, a.y * (T)s, a.z * (T)s }; }
+    template<typename T, typename S, typename = ScalarOnly<S>> constexpr vec3<T> operator*( S s, vec3<T> a ) { return { a.x * (T)s, a.y * (T)s, a.z * (T)s }; }
+    template<typename T, typename S, typename = ScalarOnly<S>> constexpr vec3<T> operator/( vec3<T> a, S s ) { return { a.x / (T)s, a.y / (T)s, a.z / (T)s }; }
+    template<typename T> constexpr T dot( vec3<T> a, vec3<T> b ) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    template<typename T> constexpr vec3<T> cross( vec3<T> a, vec3<T> b ) { return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x }; }
+    template<typename T> inline T length( vec3<T> a ) { return sqrt( dot( a, a ) ); }
+    template<typename T> inline vec3<T> normalize( vec3<T> a ) { return a * ( T( 1 ) / length( a ) ); }
+
+    template<typename T> constexpr vec4<T> operator+( vec4<T> a, vec4<T> b ) { return { a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w }; }
+    template<typename T> constexpr vec4<T> operator-( vec4<T> a, vec4<T> b ) { return { a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w }; }
+    template<typename T> constexpr vec4<T> operator*( vec4<T> a, vec4<T> b ) { return { a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w }; }
+    template<typename T, typename S, typename = ScalarOnly<S>> constexpr vec4<T> operator*( vec4<T> a, S s ) { return { a.x * (T)s, a.y * (T)s, a.z * (T)s, a.w * (T)s }; }
+    template<typename T, typename S, typename = ScalarOnly<S>> constexpr vec4<T> operator*( S s, vec4<T> a ) { return { a.x * (T)s, a.y * (T)s, a.z * (T)s, a.w * (T)s }; }
+    template<typename T> constexpr T dot( vec4<T> a, vec4<T> b ) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+
+    using float2 = vec2<float>;
+    using float3 = vec3<float>;
+    using float4 = vec4<float>;
+    using uint2 = vec2<uint>;
+    using int2 = vec2<int>;
+    using half2 = vec2<half>;
+    using half3 = vec3<half>;
+    using half4 = vec4<half>;
+
+    // Column major, same as simd and MSL
+    struct float3x3
+    {
+        float3 columns[3];
+
+        float3x3() = default;
+        float3x3( float3 c0, float3 c1, float3 c2 ) : columns{ c0, c1, c2 } {}
+        MM_FROM_SIMD( float3x3( simd_float3x3 m ) : columns{ m.columns[0], m.columns[1], m.columns[2] } {} )
+
+        float3& operator[]( int i ) { return columns[i]; }
+        const float3& operator[]( int i ) const { return columns[i]; }
+    };
+
+    struct float4x4
+    {
+        float4 columns[4];
+
+        float4x4() = default;
+        float4x4( float4 c0, float4 c1, float4 c2, float4 c3 ) : columns{ c0, c1, c2, c3 } {}
+        MM_FROM_SIMD( float4x4( simd_float4x4 m ) : columns{ m.columns[0], m.columns[1], m.columns[2], m.columns[3] } {} )
+
+        float4& operator[]( int i ) { return columns[i]; }
+        const float4& operator[]( int i ) const { return columns[i]; }
+    };
+
+    inline float3 operator*( const float3x3& m, float3 v )
+    {
+        return m.columns[0] * v.x + m.columns[1] * v.y + m.columns[2] * v.z;
+    }
+
+    inline float4 operator*( const float4x4& m, float4 v )
+    {
+        return m.columns[0] * v.x + m.columns[1] * v.y + m.columns[2] * v.z + m.columns[3] * v.w;
+    }
+
+    inline float3x3 operator*( const float3x3& a, const float3x3& b )
+    {
+        return float3x3( a * b.columns[0], a * b.columns[1], a * b.columns[2] );
+    }
+
+    inline float4x4 operator*( const float4x4& a, const float4x4& b )
+    {
+        return float4x4( a * b.columns[0], a * b.columns[1], a * b.columns[2], a * b.columns[3] );
+    }
+
+    template<typename T> constexpr T min( T a, T b ) { return std::min( a, b ); }
+    template<typename T> constexpr T max( T a, T b ) { return std::max( a, b ); }
+    template<typename T> constexpr T saturate( T v ) { return std::min( std::max( v, T( 0 ) ), T( 1 ) ); }
+    template<typename T> constexpr T clamp( T v, T lo, T hi ) { return std::min( std::max( v, lo ), hi ); }
+    template<typename T> constexpr T mix( T a, T b, T t ) { return a + ( b - a ) * t; }
+
+    enum class access
+    {
+        sample,
+        read,
+        write,
+        read_write
+    };
+
+    enum class address
+    {
+        clamp_to_edge,
+        repeat
+    };
+
+    enum class filter
+    {
+        nearest,
+        linear
+    };
+
+    enum class mip_filter
+    {
+        none,
+        nearest,
+        linear
+    };
+
+    // Arguments in any order, like MSL constexpr samplers. CpuTexture is a single level, so
+    // mipFilterMode is only recorded - Texture/MipSampler.hpp filters whole mip chains
+    struct sampler
+    {
+        address addressMode = address::clamp_to_edge;
+        filter filterMode = filter::nearest;
+        mip_filter mipFilterMode = mip_filter::none;
+
+        template<typename... Args>
+        constexpr sampler( Args... args ) { ( set( args ), ... ); }
+
+    private:
+        constexpr void set( address a ) { addressMode = a; }
+        constexpr void set( filter f ) { filterMode = f; }
+        constexpr void set( mip_filter m ) { mipFilterMode = m; }
+    };
+
+    // Memory behind a texture2d - the CPU side equivalent of an MTL::Texture
+    struct CpuTexture
+    {
+        enum class Format
+        {
+            RGBA8Unorm,
+            RGBA32Float
+        };
+
+        void* pData;
+        uint width;
+        uint height;
+        size_t rowPitch;
+        Format format;
+    };
+
+    template<typename T, access A = access::sample>
+    class texture2d
+    {
+    public:
+        texture2d( CpuTexture& texture ) : _pTexture( &texture ) {}
+
+        uint get_width( uint lod = 0 ) const { return _pTexture->width; }
+        uint get_height( uint lod = 0 ) const { return _pTexture->height; }
+
+        void write( vec4<T> value, uint2 coord, uint lod = 0 ) const
+        {
+            static_assert( A == access::write || A == access::read_write, "texture is not writable" );
+            uint8_t* pRow = static_cast<uint8_t*>( _pTexture->pData ) + coord.y * _pTexture->rowPitch;
+            if ( _pTexture->format == CpuTexture::Format::RGBA8Unorm )
+            {
+                uint8_t* p = pRow + coord.x * 4;
+                p[0] = toUnorm8( value.x );
+                p[1] = toUnorm8( value.y );
+                p[2] = toUnorm8( value.z );
+                p[3] = toUnorm8( value.w );
+            }
+            else
+            {
+                float* p = reinterpret_cast<float*>( pRow ) + coord.x * 4;
+                p[0] = (float)value.x;
+                p[1] = (float)value.y;
+                p[2] = (float)value.z;
+                p[3] = (float)value.w;
+            }
+        }
+
+        vec4<T> read( uint2 coord, uint lod = 0 ) const
+        {
+            static_assert( A == access::read || A == access::read_write, "texture is not readable" );
+            return fetch( coord.x, coord.y );
+        }
+
+        vec4<T> sample( sampler s, float2 coord ) const
+        {
+            static_assert( A == access::sample, "texture is not sampleable" );
+            const int w = (int)_pTexture->width;
+            const int h = (int)_pTexture->height;
+            const float u = coord.x * w;
+            const float v = coord.y * h;
+
+            if ( s.filterMode == filter::nearest )
+            {
+                return fetch( wrap( (int)floorf( u ), w, s.addressMode ), wrap( (int)floorf( v ), h, s.addressMode ) );
+            }
+
+            // texel centers are at +0.5
+            const float fu = u - 0.5f;
+            const float fv = v - 0.5f;
+            const int x0 = (int)floorf( fu );
+            const int y0 = (int)floorf( fv );
+            const T tx = T( fu - x0 );
+            const T ty = T( fv - y0 );
+            const uint ux0 = wrap( x0, w, s.addressMode );
+            const uint ux1 = wrap( x0 + 1, w, s.addressMode );
+            const uint uy0 = wrap( y0, h, s.addressMode );
+            const uint uy1 = wrap( y0 + 1, h, s.addressMode );
+
+            vec4<T> top = fetch( ux0, uy0 ) * ( T( 1 ) - tx ) + fetch( ux1, uy0 ) * tx;
+            vec4<T> bottom = fetch( ux0, uy1 ) * ( T( 1 ) - tx ) + fetch( ux1, uy1 ) * tx;
+            return top * ( T( 1 ) - ty ) + bottom * ty;
+        }
+
+    private:
+        static uint8_t toUnorm8( float v )
+        {
+            return (uint8_t)( saturate( v ) * 255.f + 0.5f );
+        }
+
+        static uint wrap( int i, int size, address mode )
+        {
+            if ( mode == address::repeat )
+            {
+                i %= size;
+                return (uint)( i < 0 ? i + size : i );
+            }
+            return (uint)clamp( i, 0, size - 1 );
+        }
+
+        vec4<T> fetch( uint x, uint y ) const
+        {
+            const uint8_t* pRow = static_cast<const uint8_t*>( _pTexture->pData ) + y * _pTexture->rowPitch;
+            if ( _pTexture->format == CpuTexture::Format::RGBA8Unorm )
+            {
+                const uint8_t* p = pRow + x * 4;
+                const T scale = T( 1.f / 255.f );
+                return vec4<T>( p[0] * scale, p[1] * scale, p[2] * scale, p[3] * scale );
+            }
+            const float* p = reinterpret_cast<const float*>( pRow ) + x * 4;
+            return vec4<T>( T( p[0] ), T( p[1] ), T( p[2] ), T( p[3] ) );
+        }
+
+        CpuTexture* _pTexture;
+    };
+}
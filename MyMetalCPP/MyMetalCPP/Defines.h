@@ -9,4 +9,10 @@
 
 #define ENABLE_RENDERING 1
 //#define ENABLE_IMGUI 1
+
+// simd/simd.h only exists on Apple platforms - elsewhere the Maths types fall back to Compute/CpuShaderTypes.hpp
+#if defined( __APPLE__ ) || defined( __METAL_VERSION__ )
 #define USE_SIMD 1
+#else
+#define USE_SIMD 0
+#endif
@@ -0,0 +1,300 @@
+//
+//  DeepZoom.cpp
+//  MyMetalCPP
+//
+
+#include "DeepZoom.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+using Maths::DoubleDouble;
+
+static constexpr double kEscapeRadiusSq = 4.0;
+static constexpr double kSeriesTolerance = 1e-3;    // |C| vs |B| term before we stop skipping
+static constexpr double kProbeTolerance = 0.1;      // fraction of a pixel the skip may be off by
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+DeepZoom::DeepZoom()
+: _centerX( -0.75 )
+, _centerY( 0.0 )
+, _scale( 1.5 )
+, _maxIterations( 1000 )
+, _width( 0 )
+, _height( 0 )
+, _pixelStep( 0.0 )
+, _radius( 0.0 )
+, _params()
+, _stats()
+{
+}
+
+void DeepZoom::setCenter( const DoubleDouble& x, const DoubleDouble& y )
+{
+    _centerX = x;
+    _centerY = y;
+}
+
+void DeepZoom::setScale( double scale )
+{
+    _scale = scale;
+}
+
+void DeepZoom::setMaxIterations( unsigned int maxIterations )
+{
+    _maxIterations = std::max( 1u, maxIterations );
+}
+
+void DeepZoom::prepare( unsigned int width, unsigned int height )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    _width = width;
+    _height = height;
+    _pixelStep = 2.0 * _scale / (double)width;
+    double halfW = 0.5 * width * _pixelStep;
+    double halfH = 0.5 * height * _pixelStep;
+    _radius = sqrt( halfW * halfW + halfH * halfH );
+
+    computeOrbit();
+    computeSeries();
+
+    // Largest skip the coefficients allow, then checked against real orbits at the image edges
+    unsigned int skip = 0;
+    const unsigned int lastSkip = _orbit.size() > 2 ? (unsigned int)_orbit.size() - 2 : 0;
+    for ( unsigned int n = 1; n <= lastSkip; ++n )
+    {
+        double b = hypot( _seriesB[n].x, _seriesB[n].y );
+        double c = hypot( _seriesC[n].x, _seriesC[n].y );
+        if ( c > kSeriesTolerance * b )
+        {
+            break;
+        }
+        skip = n;
+    }
+    skip = validateSkip( skip );
+
+    _params.pixelStep = (float)_pixelStep;
+    _params.radius = (float)_radius;
+    _params.seriesA[0] = (float)_seriesA[skip].x;
+    _params.seriesA[1] = (float)_seriesA[skip].y;
+    _params.seriesB[0] = (float)_seriesB[skip].x;
+    _params.seriesB[1] = (float)_seriesB[skip].y;
+    _params.seriesC[0] = (float)_seriesC[skip].x;
+    _params.seriesC[1] = (float)_seriesC[skip].y;
+    _params.orbitLength = (unsigned int)_orbit.size();
+    _params.skipIterations = skip;
+    _params.maxIterations = _maxIterations;
+    _params.width = width;
+    _params.height = height;
+
+    _stats.orbitLength = _params.orbitLength;
+    _stats.skipIterations = skip;
+    _stats.orbitMs = elapsedMs( start );
+}
+
+void DeepZoom::computeOrbit()
+{
+    _orbit.clear();
+    _orbitFloat.clear();
+    _orbit.reserve( _maxIterations + 1 );
+    _orbitFloat.reserve( 2 * ( _maxIterations + 1 ) );
+
+    DoubleDouble zx( 0.0 );
+    DoubleDouble zy( 0.0 );
+    for ( unsigned int n = 0; n <= _maxIterations; ++n )
+    {
+        Complex z = { zx.toDouble(), zy.toDouble() };
+        _orbit.push_back( z );
+        _orbitFloat.push_back( (float)z.x );
+        _orbitFloat.push_back( (float)z.y );
+
+        // keep the first escaped value, pixels rebase before they step past it
+        if ( z.x * z.x + z.y * z.y > kEscapeRadiusSq )
+        {
+            break;
+        }
+
+        DoubleDouble xx = zx * zx;
+        DoubleDouble yy = zy * zy;
+        DoubleDouble xy = zx * zy;
+        zx = xx - yy + _centerX;
+        zy = xy * 2.0 + _centerY;
+    }
+}
+
+void DeepZoom::computeSeries()
+{
+    // d[n] ~= A[n] dc + B[n] dc^2 + C[n] dc^3, stored pre-multiplied by radius^k so they stay
+    // in float range at any zoom; evaluate with u = dc / radius
+    const size_t count = _orbit.size();
+    _seriesA.assign( count, { 0.0, 0.0 } );
+    _seriesB.assign( count, { 0.0, 0.0 } );
+    _seriesC.assign( count, { 0.0, 0.0 } );
+
+    for ( size_t n = 0; n + 1 < count; ++n )
+    {
+        const Complex z2 = { 2.0 * _orbit[n].x, 2.0 * _orbit[n].y };
+        const Complex a = _seriesA[n];
+        const Complex b = _seriesB[n];
+        const Complex c = _seriesC[n];
+
+        _seriesA[n + 1] = { z2.x * a.x - z2.y * a.y + _radius,
+                            z2.x * a.y + z2.y * a.x };
+        _seriesB[n + 1] = { z2.x * b.x - z2.y * b.y + ( a.x * a.x - a.y * a.y ),
+                            z2.x * b.y + z2.y * b.x + ( 2.0 * a.x * a.y ) };
+        _seriesC[n + 1] = { z2.x * c.x - z2.y * c.y + 2.0 * ( a.x * b.x - a.y * b.y ),
+                            z2.x * c.y + z2.y * c.x + 2.0 * ( a.x * b.y + a.y * b.x ) };
+    }
+}
+
+DeepZoom::Complex DeepZoom::seriesDelta( unsigned int n, Complex u ) const
+{
+    const Complex u2 = { u.x * u.x - u.y * u.y, 2.0 * u.x * u.y };
+    const Complex u3 = { u2.x * u.x - u2.y * u.y, u2.x * u.y + u2.y * u.x };
+    const Complex& a = _seriesA[n];
+    const Complex& b = _seriesB[n];
+    const Complex& c = _seriesC[n];
+    return { a.x * u.x - a.y * u.y + b.x * u2.x - b.y * u2.y + c.x * u3.x - c.y * u3.y,
+             a.x * u.y + a.y * u.x + b.x * u2.y + b.y * u2.x + c.x * u3.y + c.y * u3.x };
+}
+
+unsigned int DeepZoom::validateSkip( unsigned int skip ) const
+{
+    if ( skip == 0 )
+    {
+        return 0;
+    }
+
+    // corners and edge midpoints of the view
+    const double hx = 0.5 * _width * _pixelStep;
+    const double hy = 0.5 * _height * _pixelStep;
+    const Complex probes[] = {
+        { -hx, -hy }, { hx, -hy }, { -hx, hy }, { hx, hy },
+        { 0.0, -hy }, { 0.0, hy }, { -hx, 0.0 }, { hx, 0.0 }
+    };
+
+    std::vector<Complex> exact( skip + 1 );
+    for ( const Complex& dc : probes )
+    {
+        const Complex u = { dc.x / _radius, dc.y / _radius };
+
+        Complex d = { 0.0, 0.0 };
+        exact[0] = d;
+        for ( unsigned int n = 0; n < skip; ++n )
+        {
+            const Complex& z = _orbit[n];
+            // would need a rebase before the skip point - series can't cover that
+            double zx = z.x + d.x;
+            double zy = z.y + d.y;
+            if ( n > 0 && zx * zx + zy * zy < d.x * d.x + d.y * d.y )
+            {
+                skip = n;
+                break;
+            }
+            Complex next = { 2.0 * ( z.x * d.x - z.y * d.y ) + ( d.x * d.x - d.y * d.y ) + dc.x,
+                             2.0 * ( z.x * d.y + z.y * d.x ) + 2.0 * d.x * d.y + dc.y };
+            d = next;
+            exact[n + 1] = d;
+        }
+
+        // walk back until the series matches the real delta to within a fraction of a pixel
+        while ( skip > 0 )
+        {
+            Complex approx = seriesDelta( skip, u );
+            double err = hypot( approx.x - exact[skip].x, approx.y - exact[skip].y );
+            double pixel = hypot( _seriesA[skip].x, _seriesA[skip].y ) * _pixelStep / _radius;
+            if ( err <= kProbeTolerance * pixel )
+            {
+                break;
+            }
+            --skip;
+        }
+    }
+    return skip;
+}
+
+unsigned int DeepZoom::iteratePixel( unsigned int x, unsigned int y, uint64_t& rebases ) const
+{
+    const Complex dc = { ( (double)x - 0.5 * _width + 0.5 ) * _pixelStep,
+                         ( (double)y - 0.5 * _height + 0.5 ) * _pixelStep };
+    const Complex u = { dc.x / _radius, dc.y / _radius };
+
+    const unsigned int skip = _params.skipIterations;
+    const size_t last = _orbit.size() - 1;
+    Complex d = seriesDelta( skip, u );
+    size_t m = skip;
+    unsigned int n = skip;
+
+    while ( n < _maxIterations )
+    {
+        const Complex& z = _orbit[m];
+        const double zx = z.x + d.x;
+        const double zy = z.y + d.y;
+        const double zMag = zx * zx + zy * zy;
+        if ( zMag > kEscapeRadiusSq )
+        {
+            break;
+        }
+
+        // glitch (or end of reference) - continue from the orbit start with the full value
+        if ( zMag < d.x * d.x + d.y * d.y || m == last )
+        {
+            d = { zx, zy };
+            m = 0;
+            ++rebases;
+        }
+
+        const Complex& zr = _orbit[m];
+        Complex next = { 2.0 * ( zr.x * d.x - zr.y * d.y ) + ( d.x * d.x - d.y * d.y ) + dc.x,
+                         2.0 * ( zr.x * d.y + zr.y * d.x ) + 2.0 * d.x * d.y + dc.y };
+        d = next;
+        ++m;
+        ++n;
+    }
+    return n;
+}
+
+void DeepZoom::render( uint8_t* pRGBA, size_t rowPitch )
+{
+    auto start = std::chrono::steady_clock::now();
+
+    std::atomic<uint64_t> totalIterations { 0 };
+    std::atomic<uint64_t> totalRebases { 0 };
+
+    JobSystem::Instance()->parallelFor( _height, 4, [&]( size_t begin, size_t end )
+    {
+        uint64_t iterations = 0;
+        uint64_t rebases = 0;
+        for ( size_t y = begin; y < end; ++y )
+        {
+            uint8_t* pRow = pRGBA + y * rowPitch;
+            for ( unsigned int x = 0; x < _width; ++x )
+            {
+                unsigned int n = iteratePixel( x, (unsigned int)y, rebases );
+                iterations += n - _params.skipIterations;
+
+                // same palette as mandelbrot_set
+                float color = 0.5f + 0.5f * cosf( 3.0f + n * 0.15f );
+                uint8_t c = (uint8_t)( color * 255.0f + 0.5f );
+                pRow[ x * 4 + 0 ] = c;
+                pRow[ x * 4 + 1 ] = c;
+                pRow[ x * 4 + 2 ] = c;
+                pRow[ x * 4 + 3 ] = 255;
+            }
+        }
+        totalIterations += iterations;
+        totalRebases += rebases;
+    } );
+
+    _stats.iterations = totalIterations;
+    _stats.rebases = totalRebases;
+    _stats.renderMs = elapsedMs( start );
+}
@@ -0,0 +1,100 @@
+//
+//  DeepZoom.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Maths/DoubleDouble.hpp"
+#include "../Shaders/DeepZoomTypes.h"
+
+// Perturbation theory Mandelbrot renderer.
+// One reference orbit is iterated in double-double at the view center, every pixel then only
+// iterates its (small) delta from that orbit in float/double precision:
+//
+//   d[n+1] = 2 Z[n] d[n] + d[n]^2 + dc
+//
+// The first iterations are skipped with a cubic series approximation in dc and glitches are
+// fixed by rebasing onto the start of the orbit whenever |Z + d| < |d| (Zhuoran's method),
+// so a single reference is enough for the whole image.
+
+class DeepZoom
+{
+public:
+    struct Stats
+    {
+        double orbitMs;
+        double renderMs;
+        unsigned int orbitLength;
+        unsigned int skipIterations;
+        uint64_t iterations;    // total per-pixel iterations of the last CPU render
+        uint64_t rebases;       // glitch detections fixed by rebasing
+    };
+
+    // The Misiurewicz point M(23,2) - the critical orbit lands on a repelling 2 cycle after 23
+    // steps - so it is on the boundary at every scale and a zoom into it keeps finding detail,
+    // where one inside the set reaches the iteration limit everywhere. The demo and the benchmark
+    // zoom here, to parseDoubleDouble
+    static constexpr const char* kDemoCenterX = "-0.77661059259970185656403950255299474932";
+    static constexpr const char* kDemoCenterY = "0.13460896167502816605673727023305780954";
+
+    DeepZoom();
+
+    void setCenter( const Maths::DoubleDouble& x, const Maths::DoubleDouble& y );
+    void setScale( double scale );          // half the view width in the complex plane
+    void setMaxIterations( unsigned int maxIterations );
+
+    double scale() const { return _scale; }
+    unsigned int maxIterations() const { return _maxIterations; }
+
+    // Iterates the reference orbit and picks the series approximation skip for a width x height view
+    void prepare( unsigned int width, unsigned int height );
+
+    // Valid after prepare - what the GPU kernel needs
+    const DeepZoomParams& params() const { return _params; }
+    const float* orbitData() const { return _orbitFloat.data(); }   // orbitLength float2s
+    size_t orbitDataSize() const { return _orbitFloat.size() * sizeof( float ); }
+
+    // Multithreaded CPU path, writes RGBA8 with the same palette as the GPU kernel
+    void render( uint8_t* pRGBA, size_t rowPitch );
+
+    // Iteration count for a single pixel (CPU path)
+    unsigned int iteratePixel( unsigned int x, unsigned int y, uint64_t& rebases ) const;
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    struct Complex
+    {
+        double x;
+        double y;
+    };
+
+    void computeOrbit();
+    void computeSeries();
+    unsigned int validateSkip( unsigned int skip ) const;
+    Complex seriesDelta( unsigned int n, Complex u ) const;
+
+    Maths::DoubleDouble _centerX;
+    Maths::DoubleDouble _centerY;
+    double _scale;
+    unsigned int _maxIterations;
+
+    unsigned int _width;
+    unsigned int _height;
+    double _pixelStep;
+    double _radius;
+
+    std::vector<Complex> _orbit;        // Z[n] rounded to double
+    std::vector<float> _orbitFloat;     // interleaved float2 for the GPU
+    std::vector<Complex> _seriesA;      // scaled by radius^1, radius^2, radius^3
+    std::vector<Complex> _seriesB;
+    std::vector<Complex> _seriesC;
+
+    DeepZoomParams _params;
+    Stats _stats;
+};
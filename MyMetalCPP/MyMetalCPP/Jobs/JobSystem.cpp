@@ -0,0 +1,153 @@
+//
+//  JobSystem.cpp
+//  MyMetalCPP
+//
+
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <memory>
+
+JobSystem* JobSystem::pInstance = nullptr;
+
+JobSystem* JobSystem::Instance()
+{
+    if( !pInstance )
+    {
+        pInstance = new JobSystem();
+    }
+    return pInstance;
+}
+
+JobSystem::JobSystem( unsigned int numThreads )
+: _busy( 0 )
+, _quit( false )
+{
+    if ( numThreads == 0 )
+    {
+        numThreads = std::max( 1u, std::thread::hardware_concurrency() );
+    }
+
+    // the caller of parallelFor is the last 'worker'
+    for ( unsigned int i = 1; i < numThreads; ++i )
+    {
+        _workers.emplace_back( &JobSystem::workerMain, this );
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _quit = true;
+    }
+    _wake.notify_all();
+    for ( std::thread& t : _workers )
+    {
+        t.join();
+    }
+}
+
+void JobSystem::workerMain()
+{
+    for ( ;; )
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock( _mutex );
+            _wake.wait( lock, [this]{ return _quit || !_queue.empty(); } );
+            if ( _quit && _queue.empty() )
+            {
+                return;
+            }
+            job = std::move( _queue.front() );
+            _queue.pop_front();
+            ++_busy;
+        }
+
+        job();
+
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            --_busy;
+            if ( _busy == 0 && _queue.empty() )
+            {
+                _idle.notify_all();
+            }
+        }
+    }
+}
+
+void JobSystem::submit( std::function<void()> job )
+{
+    if ( _workers.empty() )
+    {
+        job();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _queue.push_back( std::move( job ) );
+    }
+    _wake.notify_one();
+}
+
+void JobSystem::waitIdle()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    _idle.wait( lock, [this]{ return _busy == 0 && _queue.empty(); } );
+}
+
+void JobSystem::parallelFor( size_t count, size_t grainSize, const std::function<void( size_t begin, size_t end )>& fn )
+{
+    if ( count == 0 )
+    {
+        return;
+    }
+    grainSize = std::max<size_t>( grainSize, 1 );
+    const size_t numChunks = ( count + grainSize - 1 ) / grainSize;
+
+    if ( numChunks == 1 || _workers.empty() )
+    {
+        fn( 0, count );
+        return;
+    }
+
+    // Shared with the helpers - a helper that starts after the loop is finished just finds no work
+    struct Batch
+    {
+        std::atomic<size_t> next { 0 };
+        std::atomic<size_t> done { 0 };
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    std::shared_ptr<Batch> pBatch = std::make_shared<Batch>();
+    const std::function<void( size_t, size_t )>* pFn = &fn;
+
+    auto drain = [pBatch, pFn, count, grainSize, numChunks]()
+    {
+        size_t chunk;
+        while ( ( chunk = pBatch->next.fetch_add( 1 ) ) < numChunks )
+        {
+            size_t begin = chunk * grainSize;
+            size_t end = std::min( begin + grainSize, count );
+            (*pFn)( begin, end );
+            if ( pBatch->done.fetch_add( 1 ) + 1 == numChunks )
+            {
+                std::lock_guard<std::mutex> lock( pBatch->mutex );
+                pBatch->finished.notify_all();
+            }
+        }
+    };
+
+    const size_t numHelpers = std::min<size_t>( _workers.size(), numChunks - 1 );
+    for ( size_t i = 0; i < numHelpers; ++i )
+    {
+        submit( drain );
+    }
+
+    drain();
+
+    std::unique_lock<std::mutex> lock( pBatch->mutex );
+    pBatch->finished.wait( lock, [&]{ return pBatch->done.load() == numChunks; } );
+}
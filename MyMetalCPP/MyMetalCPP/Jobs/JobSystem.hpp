@@ -0,0 +1,55 @@
+//
+//  JobSystem.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Simple worker pool shared by all the CPU side systems.
+// The calling thread always takes part in parallelFor so nested calls can't deadlock.
+
+class JobSystem
+{
+public:
+    static JobSystem* Instance();
+
+    explicit JobSystem( unsigned int numThreads = 0 );   // 0 = hardware concurrency
+    ~JobSystem();
+
+    JobSystem( const JobSystem& ) = delete;
+    JobSystem& operator=( const JobSystem& ) = delete;
+
+    // Worker threads plus the calling thread
+    unsigned int numThreads() const { return (unsigned int)_workers.size() + 1; }
+
+    // Calls fn( begin, end ) over [0, count) in chunks of grainSize and returns when all chunks are done
+    void parallelFor( size_t count, size_t grainSize, const std::function<void( size_t begin, size_t end )>& fn );
+
+    // Fire and forget
+    void submit( std::function<void()> job );
+
+    // Blocks until every submitted job has finished
+    void waitIdle();
+
+private:
+    void workerMain();
+
+    static JobSystem* pInstance;
+
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _queue;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _idle;
+    size_t _busy;
+    bool _quit;
+};
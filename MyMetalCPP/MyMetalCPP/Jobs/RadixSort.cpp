@@ -0,0 +1,133 @@
+//
+//  RadixSort.cpp
+//  MyMetalCPP
+//
+
+#include "RadixSort.hpp"
+#include "JobSystem.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+static constexpr uint32_t kDigitBits = 8;
+static constexpr uint32_t kBuckets = 1u << kDigitBits;
+static constexpr uint32_t kDigits = 64 / kDigitBits;
+static constexpr size_t kMinChunkSize = 16384;      // below this a job costs more than it sorts
+
+namespace RadixSort
+{
+
+uint32_t sort( uint64_t* pKeys, uint32_t* pValues, size_t count, uint64_t* pScratchKeys, uint32_t* pScratchValues )
+{
+    assert( count <= UINT32_MAX );
+    if ( count < 2 )
+    {
+        return 0;
+    }
+
+    JobSystem* pJobs = JobSystem::Instance();
+    const size_t maxChunks = std::max<size_t>( 1, count / kMinChunkSize );
+    const size_t chunkCount = std::min<size_t>( maxChunks, pJobs->numThreads() * 2 );
+    const size_t chunkSize = ( count + chunkCount - 1 ) / chunkCount;
+
+    // which bits vary at all
+    std::vector<uint64_t> chunkVarying( chunkCount, 0 );
+    pJobs->parallelFor( chunkCount, 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t c = begin; c < end; ++c )
+        {
+            const size_t first = c * chunkSize;
+            const size_t last = std::min( count, first + chunkSize );
+            uint64_t varying = 0;
+            for ( size_t i = first; i < last; ++i )
+            {
+                varying |= pKeys[i] ^ pKeys[0];
+            }
+            chunkVarying[c] = varying;
+        }
+    } );
+    uint64_t varying = 0;
+    for ( uint64_t v : chunkVarying )
+    {
+        varying |= v;
+    }
+
+    std::vector<uint32_t> offsets( chunkCount * kBuckets );
+    uint64_t* pSrcKeys = pKeys;
+    uint32_t* pSrcValues = pValues;
+    uint64_t* pDstKeys = pScratchKeys;
+    uint32_t* pDstValues = pScratchValues;
+    uint32_t passes = 0;
+    for ( uint32_t digit = 0; digit < kDigits; ++digit )
+    {
+        const uint32_t shift = digit * kDigitBits;
+        if ( ( ( varying >> shift ) & ( kBuckets - 1 ) ) == 0 )
+        {
+            continue;
+        }
+
+        pJobs->parallelFor( chunkCount, 1, [&]( size_t begin, size_t end )
+        {
+            for ( size_t c = begin; c < end; ++c )
+            {
+                uint32_t counts[ kBuckets ] = {};
+                const uint64_t* pChunkKeys = pSrcKeys;
+                const size_t last = std::min( count, ( c + 1 ) * chunkSize );
+                for ( size_t i = c * chunkSize; i < last; ++i )
+                {
+                    ++counts[ ( pChunkKeys[i] >> shift ) & ( kBuckets - 1 ) ];
+                }
+                memcpy( offsets.data() + c * kBuckets, counts, sizeof( counts ) );
+            }
+        } );
+
+        // bucket 0 of every chunk, then bucket 1 of every chunk...
+        uint32_t offset = 0;
+        for ( uint32_t b = 0; b < kBuckets; ++b )
+        {
+            for ( size_t c = 0; c < chunkCount; ++c )
+            {
+                const uint32_t bucketCount = offsets[ c * kBuckets + b ];
+                offsets[ c * kBuckets + b ] = offset;
+                offset += bucketCount;
+            }
+        }
+
+        pJobs->parallelFor( chunkCount, 1, [&]( size_t begin, size_t end )
+        {
+            for ( size_t c = begin; c < end; ++c )
+            {
+                uint32_t slots[ kBuckets ];
+                memcpy( slots, offsets.data() + c * kBuckets, sizeof( slots ) );
+                const uint64_t* pChunkKeys = pSrcKeys;
+                const uint32_t* pChunkValues = pSrcValues;
+                uint64_t* pOutKeys = pDstKeys;
+                uint32_t* pOutValues = pDstValues;
+                const size_t last = std::min( count, ( c + 1 ) * chunkSize );
+                for ( size_t i = c * chunkSize; i < last; ++i )
+                {
+                    const uint64_t key = pChunkKeys[i];
+                    const uint32_t slot = slots[ ( key >> shift ) & ( kBuckets - 1 ) ]++;
+                    pOutKeys[ slot ] = key;
+                    pOutValues[ slot ] = pChunkValues[i];
+                }
+            }
+        } );
+
+        std::swap( pSrcKeys, pDstKeys );
+        std::swap( pSrcValues, pDstValues );
+        ++passes;
+    }
+
+    if ( pSrcKeys != pKeys )
+    {
+        memcpy( pKeys, pSrcKeys, count * sizeof( uint64_t ) );
+        memcpy( pValues, pSrcValues, count * sizeof( uint32_t ) );
+    }
+    return passes;
+}
+
+}
@@ -0,0 +1,27 @@
+//
+//  RadixSort.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Parallel least significant digit radix sort of 64 bit keys, each carrying a 32 bit value.
+//
+// Keys go through 8 bit digits lowest first, each digit a counting pass and a scatter into the
+// other buffer. The input is split into one chunk per job: every chunk counts its digits, the
+// counts are prefix summed digit major, chunk minor, and every chunk then scatters its keys in
+// order from its own offsets - so chunks write disjoint slots and the sort stays stable.
+//
+// A first pass ORs every key against the first one, and digits no key differs in are skipped.
+// Sort keys mostly leave their top fields in a handful of values, so fewer than 8 passes run.
+
+namespace RadixSort
+{
+    // Sorts pKeys ascending, moving pValues with them. Equal keys keep their order. The scratch
+    // arrays hold count entries each; the result is always in pKeys / pValues.
+    // Returns the number of digit passes that ran
+    uint32_t sort( uint64_t* pKeys, uint32_t* pValues, size_t count, uint64_t* pScratchKeys, uint32_t* pScratchValues );
+}
@@ -0,0 +1,139 @@
+//
+//  DoubleDouble.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+
+// Unevaluated sum of two doubles - about 106 bits of mantissa, which is enough
+// for Mandelbrot reference orbits down to roughly 1e-30 zoom.
+// Relies on IEEE rounding, so don't build this with -ffast-math.
+
+namespace Maths
+{
+    struct DoubleDouble
+    {
+        double hi;
+        double lo;
+
+        DoubleDouble() : hi( 0.0 ), lo( 0.0 ) {}
+        DoubleDouble( double h ) : hi( h ), lo( 0.0 ) {}
+        DoubleDouble( double h, double l ) : hi( h ), lo( l ) {}
+
+        double toDouble() const { return hi + lo; }
+    };
+
+    inline DoubleDouble quickTwoSum( double a, double b )
+    {
+        double s = a + b;
+        double e = b - ( s - a );
+        return { s, e };
+    }
+
+    inline DoubleDouble twoSum( double a, double b )
+    {
+        double s = a + b;
+        double bb = s - a;
+        double e = ( a - ( s - bb ) ) + ( b - bb );
+        return { s, e };
+    }
+
+    inline DoubleDouble twoProd( double a, double b )
+    {
+        double p = a * b;
+        double e = std::fma( a, b, -p );
+        return { p, e };
+    }
+
+    inline DoubleDouble operator+( const DoubleDouble& a, const DoubleDouble& b )
+    {
+        DoubleDouble s = twoSum( a.hi, b.hi );
+        DoubleDouble t = twoSum( a.lo, b.lo );
+        s.lo += t.hi;
+        s = quickTwoSum( s.hi, s.lo );
+        s.lo += t.lo;
+        return quickTwoSum( s.hi, s.lo );
+    }
+
+    inline DoubleDouble operator-( const DoubleDouble& a )
+    {
+        return { -a.hi, -a.lo };
+    }
+
+    inline DoubleDouble operator-( const DoubleDouble& a, const DoubleDouble& b )
+    {
+        return a + ( -b );
+    }
+
+    inline DoubleDouble operator*( const DoubleDouble& a, const DoubleDouble& b )
+    {
+        DoubleDouble p = twoProd( a.hi, b.hi );
+        p.lo += a.hi * b.lo + a.lo * b.hi;
+        return quickTwoSum( p.hi, p.lo );
+    }
+
+    inline DoubleDouble operator*( const DoubleDouble& a, double b )
+    {
+        DoubleDouble p = twoProd( a.hi, b );
+        p.lo += a.lo * b;
+        return quickTwoSum( p.hi, p.lo );
+    }
+
+    // Parses a decimal string ("-0.74364388703715870475219150611477") without losing the low digits
+    inline DoubleDouble parseDoubleDouble( const char* str )
+    {
+        DoubleDouble result;
+        bool negative = false;
+        int fractionDigits = -1;
+
+        const char* p = str;
+        while ( *p == ' ' ) ++p;
+        if ( *p == '-' || *p == '+' )
+        {
+            negative = ( *p == '-' );
+            ++p;
+        }
+        for ( ; *p; ++p )
+        {
+            if ( *p == '.' )
+            {
+                fractionDigits = 0;
+                continue;
+            }
+            if ( *p < '0' || *p > '9' )
+            {
+                break;
+            }
+            result = result * 10.0 + DoubleDouble( (double)( *p - '0' ) );
+            if ( fractionDigits >= 0 )
+            {
+                ++fractionDigits;
+            }
+        }
+
+        int exponent = ( fractionDigits > 0 ) ? -fractionDigits : 0;
+        if ( *p == 'e' || *p == 'E' )
+        {
+            exponent += atoi( p + 1 );
+        }
+
+        // scale by powers of ten one step at a time - each step is exact to DD precision
+        for ( ; exponent < 0; ++exponent )
+        {
+            // divide by ten: x / 10 = x * 0.1 with a correction for 0.1 not being representable
+            DoubleDouble q( result.hi / 10.0 );
+            DoubleDouble r = result - q * 10.0;
+            q.lo = r.hi / 10.0;
+            result = quickTwoSum( q.hi, q.lo );
+        }
+        for ( ; exponent > 0; --exponent )
+        {
+            result = result * 10.0;
+        }
+
+        return negative ? -result : result;
+    }
+}
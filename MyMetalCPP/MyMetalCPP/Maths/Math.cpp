@@ -86,6 +86,55 @@ namespace Maths
 
     Matrix33f discardTranslation( const Matrix44f& m )
     {
-        return simd_matrix( m.columns[0].xyz, m.columns[1].xyz, m.columns[2].xyz );
+        return simd_matrix( simd_make_float3( m.columns[0] ), simd_make_float3( m.columns[1] ), simd_make_float3( m.columns[2] ) );
+    }
+
+    Vector4f makeQuaternion( const Vector3f& axis, float angleRadians )
+    {
+        const float invLength = 1.f / sqrtf( axis.x * axis.x + axis.y * axis.y + axis.z * axis.z );
+        const float s = sinf( angleRadians * 0.5f ) * invLength;
+        return (simd::float4){ axis.x * s, axis.y * s, axis.z * s, cosf( angleRadians * 0.5f ) };
+    }
+
+    Vector4f multiplyQuaternions( const Vector4f& a, const Vector4f& b )
+    {
+        return (simd::float4){ a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                               a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                               a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+                               a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z };
+    }
+
+    Matrix44f makeTransform( const Vector3f& t, const Vector4f& q, const Vector3f& s )
+    {
+        using simd::float4;
+        const float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        const float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        const float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+        return simd_matrix((float4){ ( 1.f - 2.f * ( yy + zz ) ) * s.x, 2.f * ( xy + wz ) * s.x, 2.f * ( xz - wy ) * s.x, 0.f },
+                           (float4){ 2.f * ( xy - wz ) * s.y, ( 1.f - 2.f * ( xx + zz ) ) * s.y, 2.f * ( yz + wx ) * s.y, 0.f },
+                           (float4){ 2.f * ( xz + wy ) * s.z, 2.f * ( yz - wx ) * s.z, ( 1.f - 2.f * ( xx + yy ) ) * s.z, 0.f },
+                           (float4){ t.x, t.y, t.z, 1.f });
+    }
+
+    void extractFrustumPlanes( const Matrix44f& m, Vector4f planes[6] )
+    {
+        using simd::float4;
+        const float4 row0 = { m.columns[0].x, m.columns[1].x, m.columns[2].x, m.columns[3].x };
+        const float4 row1 = { m.columns[0].y, m.columns[1].y, m.columns[2].y, m.columns[3].y };
+        const float4 row2 = { m.columns[0].z, m.columns[1].z, m.columns[2].z, m.columns[3].z };
+        const float4 row3 = { m.columns[0].w, m.columns[1].w, m.columns[2].w, m.columns[3].w };
+
+        planes[0] = row3 + row0;
+        planes[1] = row3 - row0;
+        planes[2] = row3 + row1;
+        planes[3] = row3 - row1;
+        planes[4] = row2;
+        planes[5] = row3 - row2;
+        for ( int i = 0; i < 6; ++i )
+        {
+            const float4 p = planes[i];
+            const float invLength = 1.f / sqrtf( p.x * p.x + p.y * p.y + p.z * p.z );
+            planes[i] = (float4){ p.x * invLength, p.y * invLength, p.z * invLength, p.w * invLength };
+        }
     }
 }
@@ -8,7 +8,6 @@
 #pragma once
 
 #include <stdio.h>
-#include <simd/simd.h>
 #include "MathsTypes.h"
 
 namespace Maths
@@ -23,4 +22,15 @@ namespace Maths
     Matrix44f makeTranslate( const Vector3f& v );
     Matrix44f makeScale( const Vector3f& v );
     Matrix33f discardTranslation( const Matrix44f& m );
+
+    // Quaternions are xyz = axis * sin( angle / 2 ), w = cos( angle / 2 ), rotating counter clockwise
+    // looking down the axis. Note makeXRotate and makeZRotate turn the other way
+    Vector4f makeQuaternion( const Vector3f& axis, float angleRadians );
+    Vector4f multiplyQuaternions( const Vector4f& a, const Vector4f& b );     // rotates by b, then a
+    Matrix44f makeTransform( const Vector3f& translation, const Vector4f& rotation, const Vector3f& scale );
+
+    // Left, right, bottom, top, near, far planes of a Metal clip space (z in [0, 1]) transform,
+    // normalized and facing inwards - a point p is inside when dot( plane.xyz, p ) + plane.w >= 0.
+    // Pass projection * view * model to get the planes in model space.
+    void extractFrustumPlanes( const Matrix44f& clipFromSpace, Vector4f planes[6] );
 }
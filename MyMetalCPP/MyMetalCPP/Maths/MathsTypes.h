@@ -19,4 +19,46 @@ typedef simd::float2 Vector2f;
 typedef simd::float4x4 Matrix44f;
 typedef simd::float3x3 Matrix33f;
 #else
+#include "../Compute/CpuShaderTypes.hpp"
+
+// Same layout as the simd types, plus the handful of simd_ functions Maths uses
+
+namespace simd
+{
+    using float2 = metal::float2;
+    using float3 = metal::float3;
+    using float4 = metal::float4;
+    using float3x3 = metal::float3x3;
+    using float4x4 = metal::float4x4;
+}
+
+typedef simd::float4 Vector4f;
+typedef simd::float3 Vector3f;
+typedef simd::float2 Vector2f;
+
+typedef simd::float4x4 Matrix44f;
+typedef simd::float3x3 Matrix33f;
+
+inline Matrix44f simd_matrix( Vector4f c0, Vector4f c1, Vector4f c2, Vector4f c3 )
+{
+    return Matrix44f( c0, c1, c2, c3 );
+}
+
+inline Matrix33f simd_matrix( Vector3f c0, Vector3f c1, Vector3f c2 )
+{
+    return Matrix33f( c0, c1, c2 );
+}
+
+inline Matrix44f simd_matrix_from_rows( Vector4f r0, Vector4f r1, Vector4f r2, Vector4f r3 )
+{
+    return Matrix44f( { r0.x, r1.x, r2.x, r3.x },
+                      { r0.y, r1.y, r2.y, r3.y },
+                      { r0.z, r1.z, r2.z, r3.z },
+                      { r0.w, r1.w, r2.w, r3.w } );
+}
+
+inline Vector3f simd_make_float3( Vector4f v )
+{
+    return { v.x, v.y, v.z };
+}
 #endif // USE_SIMD
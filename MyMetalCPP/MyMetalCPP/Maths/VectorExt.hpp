@@ -0,0 +1,52 @@
+//
+//  VectorExt.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstdint>
+
+// 4-wide types on the GCC/clang vector extensions - the compiler maps them onto SSE/NEON, so
+// the CPU paths get SIMD without intrinsics per platform. Arithmetic, comparisons (giving
+// Int4 masks of 0 / -1) and [] lane access all work on them directly.
+
+namespace Maths
+{
+    typedef float Float4 __attribute__(( vector_size( 16 ) ));
+    typedef int32_t Int4 __attribute__(( vector_size( 16 ) ));
+
+    // two registers on SSE/NEON, one on AVX - keep them to inline code, passing them to and from
+    // out of line functions changes with the target
+    typedef float Float8 __attribute__(( vector_size( 32 ) ));
+    typedef int32_t Int8 __attribute__(( vector_size( 32 ) ));
+
+    inline bool any( Int4 mask )
+    {
+        return ( mask[0] | mask[1] | mask[2] | mask[3] ) != 0;
+    }
+
+    inline Float4 splat( float s )
+    {
+        return Float4{ s, s, s, s };
+    }
+
+    // mask lanes from a, the rest from b
+    inline Float4 select( Int4 mask, Float4 a, Float4 b )
+    {
+        return (Float4)( ( (Int4)a & mask ) | ( (Int4)b & ~mask ) );
+    }
+
+    inline Float4 abs( Float4 v )
+    {
+        return (Float4)( (Int4)v & 0x7fffffff );
+    }
+
+    inline Float4 clamp01( Float4 v )
+    {
+        const Float4 zero = splat( 0.f );
+        const Float4 one = splat( 1.f );
+        v = select( v > zero, v, zero );     // also flushes NaN to 0
+        return select( v < one, v, one );
+    }
+}
@@ -0,0 +1,139 @@
+//
+//  Lod.cpp
+//  MyMetalCPP
+//
+
+#include "Lod.hpp"
+#include "MeshOptimizer.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <math.h>
+#include <mutex>
+
+static constexpr size_t kInstancesPerJob = 256;
+static constexpr float kMinDistance = 1e-3f;        // view depth an instance is treated as at least, avoids dividing by 0
+
+namespace Lod
+{
+
+Chain buildChain( const uint32_t* pIndices, size_t indexCount, const VertexData* pVertices, size_t vertexCount, const ChainOptions& options )
+{
+    Chain chain;
+    chain.indices.assign( pIndices, pIndices + indexCount );
+    chain.levels.push_back( { 0, (uint32_t)indexCount, 0.f } );
+
+    // bounding sphere - box centre and the furthest vertex from it
+    float lo[3] = { INFINITY, INFINITY, INFINITY };
+    float hi[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for ( size_t i = 0; i < indexCount; ++i )
+    {
+        const VertexData& v = pVertices[ pIndices[i] ];
+        const float p[3] = { v.position.x, v.position.y, v.position.z };
+        for ( int k = 0; k < 3; ++k )
+        {
+            lo[k] = std::min( lo[k], p[k] );
+            hi[k] = std::max( hi[k], p[k] );
+        }
+    }
+    float radiusSq = 0.f;
+    for ( int k = 0; k < 3; ++k )
+    {
+        chain.center[k] = indexCount ? ( lo[k] + hi[k] ) * 0.5f : 0.f;
+    }
+    for ( size_t i = 0; i < indexCount; ++i )
+    {
+        const VertexData& v = pVertices[ pIndices[i] ];
+        const float d[3] = { v.position.x - chain.center[0], v.position.y - chain.center[1], v.position.z - chain.center[2] };
+        radiusSq = std::max( radiusSq, d[0] * d[0] + d[1] * d[1] + d[2] * d[2] );
+    }
+    chain.radius = sqrtf( radiusSq );
+
+    const float meshExtent = Simplifier::extent( pIndices, indexCount, pVertices );
+    std::vector<uint32_t> source( pIndices, pIndices + indexCount );
+    std::vector<uint32_t> simplified( indexCount );
+    float error = 0.f;
+    while ( chain.levels.size() < options.maxLevels && source.size() / 3 > options.minTriangles )
+    {
+        Simplifier::Options simplifierOptions = options.simplifier;
+        simplifierOptions.targetIndexCount = std::max<size_t>( (size_t)( source.size() / 3 * options.reduction ), options.minTriangles ) * 3;
+        simplifierOptions.targetError = options.maxError;
+        float levelError = 0.f;
+        const size_t count = Simplifier::simplify( simplified.data(), source.data(), source.size(), pVertices, vertexCount,
+                                                   simplifierOptions, &levelError );
+
+        // not worth a level of its own if it barely shrank
+        if ( count == 0 || count > source.size() * 0.85f )
+        {
+            break;
+        }
+
+        MeshOptimizer::optimizeVertexCache( simplified.data(), count, vertexCount );
+        error = std::max( error, levelError * meshExtent );
+        chain.levels.push_back( { (uint32_t)chain.indices.size(), (uint32_t)count, error } );
+        chain.indices.insert( chain.indices.end(), simplified.begin(), simplified.begin() + count );
+        source.assign( simplified.begin(), simplified.begin() + count );
+    }
+    return chain;
+}
+
+SelectionStats selectLevels( const Chain& chain, const InstanceData* pInstances, size_t instanceCount, const CameraData& camera,
+                             float viewportHeight, float pixelError, uint8_t* pLevels )
+{
+    assert( !chain.levels.empty() );
+    SelectionStats total = {};
+    std::mutex mutex;
+
+    // pixels per mesh unit at view depth 1
+    const float pixelsPerUnit = camera.perspectiveTransform.columns[1].y * viewportHeight * 0.5f;
+    const Matrix44f world = camera.worldTransform;
+    const uint32_t levelCount = (uint32_t)chain.levels.size();
+
+    JobSystem::Instance()->parallelFor( instanceCount, kInstancesPerJob, [&]( size_t begin, size_t end )
+    {
+        SelectionStats stats = {};
+        for ( size_t i = begin; i < end; ++i )
+        {
+            const Matrix44f& m = pInstances[i].instanceTransform;
+
+            // largest axis scale of the instance, the camera transform is rigid
+            float scaleSq = 0.f;
+            for ( int c = 0; c < 3; ++c )
+            {
+                const Vector4f column = m.columns[c];
+                scaleSq = std::max( scaleSq, column.x * column.x + column.y * column.y + column.z * column.z );
+            }
+            const float scale = sqrtf( scaleSq );
+
+            // depth of the nearest point of the bounding sphere
+            const Vector4f center = { chain.center[0], chain.center[1], chain.center[2], 1.f };
+            const Vector4f worldCenter = m.columns[0] * center.x + m.columns[1] * center.y + m.columns[2] * center.z + m.columns[3];
+            const Vector4f viewCenter = world.columns[0] * worldCenter.x + world.columns[1] * worldCenter.y +
+                                        world.columns[2] * worldCenter.z + world.columns[3] * worldCenter.w;
+            const float depth = std::max( -viewCenter.z - chain.radius * scale, kMinDistance );
+            const float pixelsPerError = scale * pixelsPerUnit / depth;
+
+            uint32_t level = 0;
+            while ( level + 1 < levelCount && chain.levels[ level + 1 ].error * pixelsPerError <= pixelError )
+            {
+                ++level;
+            }
+            pLevels[i] = (uint8_t)level;
+            stats.triangles += chain.levels[ level ].indexCount / 3;
+            stats.fullTriangles += chain.levels[0].indexCount / 3;
+            ++stats.instancesPerLevel[ level ];
+        }
+
+        std::lock_guard<std::mutex> lock( mutex );
+        total.triangles += stats.triangles;
+        total.fullTriangles += stats.fullTriangles;
+        for ( uint32_t l = 0; l < kMaxLevels; ++l )
+        {
+            total.instancesPerLevel[l] += stats.instancesPerLevel[l];
+        }
+    } );
+    return total;
+}
+
+}
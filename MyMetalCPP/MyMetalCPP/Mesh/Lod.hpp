@@ -0,0 +1,67 @@
+//
+//  Lod.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Shaders/ShaderStructs.h"
+#include "Simplifier.hpp"
+
+// Level of detail chains built with the Simplifier, and per instance selection.
+//
+// Every level is simplified from the one before it to about half the triangles, then vertex
+// cache optimized, and they all share the mesh's vertex buffer - one index buffer holds the
+// whole chain. Each level records its error in mesh units (the largest so far, so errors only
+// grow down the chain).
+//
+// selectLevels projects each level's error to pixels at the instance's distance from the
+// camera, using the CameraData projection, and picks the coarsest level under the threshold.
+
+namespace Lod
+{
+    static constexpr uint32_t kMaxLevels = 8;
+
+    struct Level
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float error;            // mesh units
+    };
+
+    struct Chain
+    {
+        std::vector<uint32_t> indices;
+        std::vector<Level> levels;
+        float center[3];        // bounding sphere of level 0
+        float radius;
+    };
+
+    struct ChainOptions
+    {
+        float reduction = 0.5f;             // triangles kept per level
+        size_t minTriangles = 32;
+        float maxError = 0.05f;             // relative to the mesh extent
+        uint32_t maxLevels = kMaxLevels;
+        Simplifier::Options simplifier;     // weights and border handling, the targets are set per level
+    };
+
+    struct SelectionStats
+    {
+        size_t triangles;                   // with the selected levels
+        size_t fullTriangles;               // everything at level 0
+        size_t instancesPerLevel[ kMaxLevels ];
+    };
+
+    // Level 0 is the input as given
+    Chain buildChain( const uint32_t* pIndices, size_t indexCount, const VertexData* pVertices, size_t vertexCount,
+                      const ChainOptions& options = ChainOptions() );
+
+    // pixelError is the largest error allowed on screen, in pixels of a viewportHeight high view
+    SelectionStats selectLevels( const Chain& chain, const InstanceData* pInstances, size_t instanceCount, const CameraData& camera,
+                                 float viewportHeight, float pixelError, uint8_t* pLevels );
+}
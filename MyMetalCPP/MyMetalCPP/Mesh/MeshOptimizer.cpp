@@ -0,0 +1,754 @@
+//
+//  MeshOptimizer.cpp
+//  MyMetalCPP
+//
+
+#include "MeshOptimizer.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <math.h>
+
+static constexpr uint32_t kInvalidIndex = ~0u;
+static constexpr size_t kTrianglesPerChunk = 1 << 16;   // triangles cache optimized per job
+static constexpr int kForsythCacheSize = 32;            // LRU size the scoring assumes
+static constexpr uint32_t kMaxValenceTable = 32;
+static constexpr size_t kCacheLineSize = 64;
+static constexpr size_t kFetchCacheLines = 256;         // 16KB vertex fetch cache
+static constexpr int kOverdrawViewSize = 256;
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// FIFO cache: an entry is resident while fewer than size misses happened since it was loaded
+class FifoCache
+{
+public:
+    FifoCache( size_t entries, unsigned int size ) : _stamps( entries, 0 ), _time( size + 1 ), _size( size ) {}
+
+    bool miss( uint32_t entry )
+    {
+        if ( _time - _stamps[ entry ] > _size )
+        {
+            _stamps[ entry ] = _time++;
+            return true;
+        }
+        return false;
+    }
+
+    void flush() { _time += _size + 1; }
+
+private:
+    std::vector<uint32_t> _stamps;
+    uint32_t _time;
+    unsigned int _size;
+};
+
+struct Float3
+{
+    float x, y, z;
+};
+
+static inline Float3 positionOf( const VertexData& v )
+{
+    return { v.position.x, v.position.y, v.position.z };
+}
+
+// The 8 floats that make up a vertex - padding in the struct doesn't take part in comparisons
+static inline void vertexKey( const VertexData& v, uint32_t* pKey )
+{
+    const float values[8] = { v.position.x, v.position.y, v.position.z, v.normal.x, v.normal.y, v.normal.z, v.texcoord.x, v.texcoord.y };
+    memcpy( pKey, values, sizeof( values ) );
+}
+
+static inline uint32_t hashKey( const uint32_t* pKey )
+{
+    // murmur style mixing
+    uint32_t h = 0x9747b28c;
+    for ( int i = 0; i < 8; ++i )
+    {
+        uint32_t k = pKey[i] * 0xcc9e2d51;
+        k = ( k << 15 ) | ( k >> 17 );
+        h ^= k * 0x1b873593;
+        h = ( ( h << 13 ) | ( h >> 19 ) ) * 5 + 0xe6546b64;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    return h;
+}
+
+namespace MeshOptimizer
+{
+
+size_t deduplicateVertices( std::vector<VertexData>& vertices, std::vector<uint32_t>& indices )
+{
+    const size_t vertexCount = vertices.size();
+    JobSystem* pJobs = JobSystem::Instance();
+
+    std::vector<uint32_t> keys( vertexCount * 8 );
+    std::vector<uint32_t> hashes( vertexCount );
+    pJobs->parallelFor( vertexCount, 4096, [&]( size_t begin, size_t end )
+    {
+        for ( size_t i = begin; i < end; ++i )
+        {
+            vertexKey( vertices[i], &keys[ i * 8 ] );
+            hashes[i] = hashKey( &keys[ i * 8 ] );
+        }
+    } );
+
+    // open addressing, first occurrence of each key wins
+    size_t tableSize = 1;
+    while ( tableSize < vertexCount * 2 )
+    {
+        tableSize <<= 1;
+    }
+    std::vector<uint32_t> table( tableSize, kInvalidIndex );
+    std::vector<uint32_t> remap( vertexCount );
+    size_t uniqueCount = 0;
+    for ( size_t i = 0; i < vertexCount; ++i )
+    {
+        size_t slot = hashes[i] & ( tableSize - 1 );
+        for ( ;; )
+        {
+            const uint32_t entry = table[ slot ];
+            if ( entry == kInvalidIndex )
+            {
+                table[ slot ] = (uint32_t)i;
+                remap[i] = (uint32_t)uniqueCount;
+                vertices[ uniqueCount++ ] = vertices[i];
+                break;
+            }
+            if ( hashes[ entry ] == hashes[i] && memcmp( &keys[ entry * 8 ], &keys[ i * 8 ], 8 * sizeof( uint32_t ) ) == 0 )
+            {
+                remap[i] = remap[ entry ];
+                break;
+            }
+            slot = ( slot + 1 ) & ( tableSize - 1 );
+        }
+    }
+    vertices.resize( uniqueCount );
+
+    pJobs->parallelFor( indices.size(), 65536, [&]( size_t begin, size_t end )
+    {
+        for ( size_t i = begin; i < end; ++i )
+        {
+            indices[i] = remap[ indices[i] ];
+        }
+    } );
+    return uniqueCount;
+}
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation"
+static float vertexScore( int cachePosition, uint32_t remaining )
+{
+    static const std::vector<float> cacheScores = []()
+    {
+        std::vector<float> scores( kForsythCacheSize );
+        for ( int i = 0; i < kForsythCacheSize; ++i )
+        {
+            // the last triangle's vertices score the same so the next one isn't biased towards either
+            scores[i] = ( i < 3 ) ? 0.75f : powf( 1.f - ( i - 3 ) / (float)( kForsythCacheSize - 3 ), 1.5f );
+        }
+        return scores;
+    }();
+    static const std::vector<float> valenceScores = []()
+    {
+        // favour vertices with few triangles left so they leave the cache for good
+        std::vector<float> scores( kMaxValenceTable + 1 );
+        for ( uint32_t i = 1; i <= kMaxValenceTable; ++i )
+        {
+            scores[i] = 2.f / sqrtf( (float)i );
+        }
+        return scores;
+    }();
+
+    if ( remaining == 0 )
+    {
+        return -1.f;
+    }
+    float score = ( cachePosition >= 0 ) ? cacheScores[ cachePosition ] : 0.f;
+    score += ( remaining <= kMaxValenceTable ) ? valenceScores[ remaining ] : 2.f / sqrtf( (float)remaining );
+    return score;
+}
+
+static void optimizeVertexCacheRange( uint32_t* pIndices, size_t triangleCount, std::vector<uint32_t>& toLocal )
+{
+    const size_t indexCount = triangleCount * 3;
+
+    // compact vertex ids for this range - toLocal is all kInvalidIndex on entry and exit
+    std::vector<uint32_t> localToGlobal;
+    std::vector<uint32_t> local( indexCount );
+    for ( size_t i = 0; i < indexCount; ++i )
+    {
+        uint32_t& id = toLocal[ pIndices[i] ];
+        if ( id == kInvalidIndex )
+        {
+            id = (uint32_t)localToGlobal.size();
+            localToGlobal.push_back( pIndices[i] );
+        }
+        local[i] = id;
+    }
+    for ( uint32_t global : localToGlobal )
+    {
+        toLocal[ global ] = kInvalidIndex;
+    }
+    const size_t vertexCount = localToGlobal.size();
+
+    // vertex -> live triangles, the first remaining[v] entries of each list are still to emit
+    std::vector<uint32_t> remaining( vertexCount, 0 );
+    for ( uint32_t v : local )
+    {
+        ++remaining[v];
+    }
+    std::vector<uint32_t> offsets( vertexCount + 1, 0 );
+    for ( size_t v = 0; v < vertexCount; ++v )
+    {
+        offsets[ v + 1 ] = offsets[v] + remaining[v];
+    }
+    std::vector<uint32_t> triangles( indexCount );
+    {
+        std::vector<uint32_t> fill( offsets.begin(), offsets.end() - 1 );
+        for ( size_t i = 0; i < indexCount; ++i )
+        {
+            triangles[ fill[ local[i] ]++ ] = (uint32_t)( i / 3 );
+        }
+    }
+
+    std::vector<int> cachePosition( vertexCount, -1 );
+    std::vector<float> score( vertexCount );
+    for ( size_t v = 0; v < vertexCount; ++v )
+    {
+        score[v] = vertexScore( -1, remaining[v] );
+    }
+    std::vector<uint8_t> emitted( triangleCount, 0 );
+
+    int cache[ kForsythCacheSize + 3 ];
+    int cacheCount = 0;
+    size_t cursor = 0;
+    int64_t best = -1;
+    std::vector<uint32_t> deadEndStack;     // recently used vertices, as in Tipsify
+
+    for ( size_t out = 0; out < triangleCount; ++out )
+    {
+        // dead end - restart next to something recently emitted, else carry on in input order
+        while ( best < 0 && !deadEndStack.empty() )
+        {
+            const uint32_t v = deadEndStack.back();
+            deadEndStack.pop_back();
+            if ( remaining[v] > 0 )
+            {
+                best = triangles[ offsets[v] ];
+            }
+        }
+        if ( best < 0 )
+        {
+            while ( emitted[ cursor ] )
+            {
+                ++cursor;
+            }
+            best = (int64_t)cursor;
+        }
+
+        const uint32_t* pTri = &local[ best * 3 ];
+        for ( int k = 0; k < 3; ++k )
+        {
+            pIndices[ out * 3 + k ] = localToGlobal[ pTri[k] ];
+        }
+        emitted[ best ] = 1;
+        deadEndStack.insert( deadEndStack.end(), pTri, pTri + 3 );
+
+        for ( int k = 0; k < 3; ++k )
+        {
+            const uint32_t v = pTri[k];
+            uint32_t* pList = &triangles[ offsets[v] ];
+            for ( uint32_t i = 0; i < remaining[v]; ++i )
+            {
+                if ( pList[i] == (uint32_t)best )
+                {
+                    pList[i] = pList[ remaining[v] - 1 ];
+                    --remaining[v];
+                    break;
+                }
+            }
+        }
+
+        // most recent first, the triangle's vertices move to the front
+        int newCache[ kForsythCacheSize + 3 ];
+        int newCount = 0;
+        for ( int k = 0; k < 3; ++k )
+        {
+            const int v = (int)pTri[k];
+            if ( std::find( newCache, newCache + newCount, v ) == newCache + newCount )
+            {
+                newCache[ newCount++ ] = v;
+            }
+        }
+        for ( int i = 0; i < cacheCount; ++i )
+        {
+            const int v = cache[i];
+            if ( v != (int)pTri[0] && v != (int)pTri[1] && v != (int)pTri[2] )
+            {
+                newCache[ newCount++ ] = v;
+            }
+        }
+
+        for ( int i = 0; i < newCount; ++i )
+        {
+            const int v = newCache[i];
+            cachePosition[v] = ( i < kForsythCacheSize ) ? i : -1;
+            score[v] = vertexScore( cachePosition[v], remaining[v] );
+        }
+
+        // rescore everything touching the cache, including what just fell out of it
+        best = -1;
+        float bestScore = -1.f;
+        for ( int i = 0; i < newCount; ++i )
+        {
+            const int v = newCache[i];
+            const uint32_t* pList = &triangles[ offsets[v] ];
+            for ( uint32_t j = 0; j < remaining[v]; ++j )
+            {
+                const uint32_t t = pList[j];
+                const float s = score[ local[ t * 3 ] ] + score[ local[ t * 3 + 1 ] ] + score[ local[ t * 3 + 2 ] ];
+                if ( i < kForsythCacheSize && s > bestScore )
+                {
+                    bestScore = s;
+                    best = t;
+                }
+            }
+        }
+
+        cacheCount = std::min( newCount, kForsythCacheSize );
+        std::copy( newCache, newCache + cacheCount, cache );
+    }
+}
+
+static inline uint32_t spreadBits10( uint32_t v )
+{
+    v = ( v | ( v << 16 ) ) & 0x030000ff;
+    v = ( v | ( v << 8 ) ) & 0x0300f00f;
+    v = ( v | ( v << 4 ) ) & 0x030c30c3;
+    v = ( v | ( v << 2 ) ) & 0x09249249;
+    return v;
+}
+
+// Triangles in Morton order of their centroids, so every range is a compact patch of surface
+static void sortTrianglesSpatially( uint32_t* pIndices, size_t triangleCount, const VertexData* pVertices, size_t vertexCount )
+{
+    Float3 lo = positionOf( pVertices[0] );
+    Float3 hi = lo;
+    for ( size_t i = 1; i < vertexCount; ++i )
+    {
+        const Float3 p = positionOf( pVertices[i] );
+        lo = { std::min( lo.x, p.x ), std::min( lo.y, p.y ), std::min( lo.z, p.z ) };
+        hi = { std::max( hi.x, p.x ), std::max( hi.y, p.y ), std::max( hi.z, p.z ) };
+    }
+    const float extent = std::max( { hi.x - lo.x, hi.y - lo.y, hi.z - lo.z, 1e-20f } );
+    const float scale = 1023.f / ( extent * 3.f );
+
+    std::vector<uint64_t> keys( triangleCount );     // morton code << 32 | triangle
+    JobSystem::Instance()->parallelFor( triangleCount, 16384, [&]( size_t begin, size_t end )
+    {
+        for ( size_t t = begin; t < end; ++t )
+        {
+            const Float3 a = positionOf( pVertices[ pIndices[ t * 3 ] ] );
+            const Float3 b = positionOf( pVertices[ pIndices[ t * 3 + 1 ] ] );
+            const Float3 c = positionOf( pVertices[ pIndices[ t * 3 + 2 ] ] );
+            const uint32_t x = (uint32_t)( ( a.x + b.x + c.x - 3.f * lo.x ) * scale );
+            const uint32_t y = (uint32_t)( ( a.y + b.y + c.y - 3.f * lo.y ) * scale );
+            const uint32_t z = (uint32_t)( ( a.z + b.z + c.z - 3.f * lo.z ) * scale );
+            const uint32_t code = spreadBits10( x ) | ( spreadBits10( y ) << 1 ) | ( spreadBits10( z ) << 2 );
+            keys[t] = ( (uint64_t)code << 32 ) | t;
+        }
+    } );
+    std::sort( keys.begin(), keys.end() );
+
+    std::vector<uint32_t> sorted( triangleCount * 3 );
+    JobSystem::Instance()->parallelFor( triangleCount, 16384, [&]( size_t begin, size_t end )
+    {
+        for ( size_t t = begin; t < end; ++t )
+        {
+            const uint32_t source = (uint32_t)keys[t];
+            sorted[ t * 3 ] = pIndices[ source * 3 ];
+            sorted[ t * 3 + 1 ] = pIndices[ source * 3 + 1 ];
+            sorted[ t * 3 + 2 ] = pIndices[ source * 3 + 2 ];
+        }
+    } );
+    std::copy( sorted.begin(), sorted.end(), pIndices );
+}
+
+void optimizeVertexCache( uint32_t* pIndices, size_t indexCount, size_t vertexCount, const VertexData* pVertices )
+{
+    assert( indexCount % 3 == 0 );
+    const size_t triangleCount = indexCount / 3;
+    const size_t chunkCount = ( triangleCount + kTrianglesPerChunk - 1 ) / kTrianglesPerChunk;
+    if ( chunkCount > 1 && pVertices != nullptr )
+    {
+        sortTrianglesSpatially( pIndices, triangleCount, pVertices, vertexCount );
+    }
+
+    JobSystem::Instance()->parallelFor( chunkCount, 1, [&]( size_t begin, size_t end )
+    {
+        // per thread scratch, sized for the whole mesh once and left all invalid after each range
+        static thread_local std::vector<uint32_t> toLocal;
+        if ( toLocal.size() < vertexCount )
+        {
+            toLocal.assign( vertexCount, kInvalidIndex );
+        }
+        for ( size_t chunk = begin; chunk < end; ++chunk )
+        {
+            const size_t first = chunk * kTrianglesPerChunk;
+            const size_t count = std::min( kTrianglesPerChunk, triangleCount - first );
+            optimizeVertexCacheRange( pIndices + first * 3, count, toLocal );
+        }
+    } );
+}
+
+void optimizeOverdraw( uint32_t* pIndices, size_t indexCount, const VertexData* pVertices, size_t vertexCount, float threshold )
+{
+    assert( indexCount % 3 == 0 );
+    const size_t triangleCount = indexCount / 3;
+    if ( triangleCount == 0 )
+    {
+        return;
+    }
+
+    // Hard boundaries - where the cache optimizer jumped and every vertex missed
+    std::vector<uint32_t> hard;
+    {
+        FifoCache cache( vertexCount, kDefaultCacheSize );
+        for ( size_t t = 0; t < triangleCount; ++t )
+        {
+            int misses = 0;
+            for ( int k = 0; k < 3; ++k )
+            {
+                misses += cache.miss( pIndices[ t * 3 + k ] );
+            }
+            if ( t == 0 || misses == 3 )
+            {
+                hard.push_back( (uint32_t)t );
+            }
+        }
+        hard.push_back( (uint32_t)triangleCount );
+    }
+
+    // Soft boundaries - cut each hard cluster as soon as a prefix gets within threshold of its ACMR
+    std::vector<uint32_t> clusters;
+    {
+        FifoCache cache( vertexCount, kDefaultCacheSize );
+        for ( size_t c = 0; c + 1 < hard.size(); ++c )
+        {
+            const size_t start = hard[c];
+            const size_t end = hard[ c + 1 ];
+
+            cache.flush();
+            size_t clusterMisses = 0;
+            for ( size_t i = start * 3; i < end * 3; ++i )
+            {
+                clusterMisses += cache.miss( pIndices[i] );
+            }
+            const float limit = threshold * clusterMisses / (float)( end - start );
+
+            cache.flush();
+            clusters.push_back( (uint32_t)start );
+            size_t subStart = start;
+            size_t misses = 0;
+            for ( size_t t = start; t < end; ++t )
+            {
+                for ( int k = 0; k < 3; ++k )
+                {
+                    misses += cache.miss( pIndices[ t * 3 + k ] );
+                }
+                if ( t + 1 < end && misses <= limit * ( t + 1 - subStart ) )
+                {
+                    clusters.push_back( (uint32_t)( t + 1 ) );
+                    subStart = t + 1;
+                    misses = 0;
+                    cache.flush();
+                }
+            }
+        }
+        clusters.push_back( (uint32_t)triangleCount );
+    }
+
+    // Area weighted centroid and normal per cluster
+    const size_t clusterCount = clusters.size() - 1;
+    std::vector<float> clusterData( clusterCount * 7 );     // centroid * area, normal, area
+    JobSystem::Instance()->parallelFor( clusterCount, 256, [&]( size_t begin, size_t end )
+    {
+        for ( size_t c = begin; c < end; ++c )
+        {
+            float sum[7] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+            for ( size_t t = clusters[c]; t < clusters[ c + 1 ]; ++t )
+            {
+                const Float3 a = positionOf( pVertices[ pIndices[ t * 3 ] ] );
+                const Float3 b = positionOf( pVertices[ pIndices[ t * 3 + 1 ] ] );
+                const Float3 d = positionOf( pVertices[ pIndices[ t * 3 + 2 ] ] );
+                const Float3 e1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+                const Float3 e2 = { d.x - a.x, d.y - a.y, d.z - a.z };
+                const Float3 n = { e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x };
+                const float area = sqrtf( n.x * n.x + n.y * n.y + n.z * n.z );
+                sum[0] += area * ( a.x + b.x + d.x ) / 3.f;
+                sum[1] += area * ( a.y + b.y + d.y ) / 3.f;
+                sum[2] += area * ( a.z + b.z + d.z ) / 3.f;
+                sum[3] += n.x;
+                sum[4] += n.y;
+                sum[5] += n.z;
+                sum[6] += area;
+            }
+            std::copy( sum, sum + 7, &clusterData[ c * 7 ] );
+        }
+    } );
+
+    double meshCentroid[3] = { 0.0, 0.0, 0.0 };
+    double meshArea = 0.0;
+    for ( size_t c = 0; c < clusterCount; ++c )
+    {
+        meshCentroid[0] += clusterData[ c * 7 ];
+        meshCentroid[1] += clusterData[ c * 7 + 1 ];
+        meshCentroid[2] += clusterData[ c * 7 + 2 ];
+        meshArea += clusterData[ c * 7 + 6 ];
+    }
+    const double invMeshArea = meshArea > 0.0 ? 1.0 / meshArea : 0.0;
+
+    // Clusters facing away from the middle of the mesh are likely occluders - draw them first
+    std::vector<float> sortKey( clusterCount );
+    for ( size_t c = 0; c < clusterCount; ++c )
+    {
+        const float* pData = &clusterData[ c * 7 ];
+        const float invArea = pData[6] > 0.f ? 1.f / pData[6] : 0.f;
+        const float nLength = sqrtf( pData[3] * pData[3] + pData[4] * pData[4] + pData[5] * pData[5] );
+        const float invN = nLength > 0.f ? 1.f / nLength : 0.f;
+        float key = 0.f;
+        for ( int k = 0; k < 3; ++k )
+        {
+            key += ( pData[k] * invArea - (float)( meshCentroid[k] * invMeshArea ) ) * pData[ 3 + k ] * invN;
+        }
+        sortKey[c] = key;
+    }
+
+    std::vector<uint32_t> order( clusterCount );
+    for ( size_t c = 0; c < clusterCount; ++c )
+    {
+        order[c] = (uint32_t)c;
+    }
+    std::stable_sort( order.begin(), order.end(), [&]( uint32_t a, uint32_t b ) { return sortKey[a] > sortKey[b]; } );
+
+    std::vector<uint32_t> source( pIndices, pIndices + indexCount );
+    size_t out = 0;
+    for ( uint32_t c : order )
+    {
+        const size_t first = (size_t)clusters[c] * 3;
+        const size_t last = (size_t)clusters[ c + 1 ] * 3;
+        std::copy( source.begin() + first, source.begin() + last, pIndices + out );
+        out += last - first;
+    }
+}
+
+size_t optimizeVertexFetch( VertexData* pDestination, uint32_t* pIndices, size_t indexCount, const VertexData* pVertices, size_t vertexCount )
+{
+    assert( pDestination != pVertices );
+    std::vector<uint32_t> remap( vertexCount, kInvalidIndex );
+    uint32_t next = 0;
+    for ( size_t i = 0; i < indexCount; ++i )
+    {
+        uint32_t& id = remap[ pIndices[i] ];
+        if ( id == kInvalidIndex )
+        {
+            pDestination[ next ] = pVertices[ pIndices[i] ];
+            id = next++;
+        }
+        pIndices[i] = id;
+    }
+    return next;
+}
+
+VertexCacheStats analyzeVertexCache( const uint32_t* pIndices, size_t indexCount, size_t vertexCount, unsigned int cacheSize )
+{
+    FifoCache cache( vertexCount, cacheSize );
+    size_t transformed = 0;
+    for ( size_t i = 0; i < indexCount; ++i )
+    {
+        transformed += cache.miss( pIndices[i] );
+    }
+
+    VertexCacheStats stats;
+    stats.verticesTransformed = transformed;
+    stats.acmr = indexCount ? transformed / (float)( indexCount / 3 ) : 0.f;
+    stats.atvr = vertexCount ? transformed / (float)vertexCount : 0.f;
+    return stats;
+}
+
+VertexFetchStats analyzeVertexFetch( const uint32_t* pIndices, size_t indexCount, size_t vertexCount, size_t vertexSize )
+{
+    const size_t lineCount = ( vertexCount * vertexSize + kCacheLineSize - 1 ) / kCacheLineSize;
+    FifoCache cache( lineCount, kFetchCacheLines );
+    size_t lines = 0;
+    for ( size_t i = 0; i < indexCount; ++i )
+    {
+        const size_t first = pIndices[i] * vertexSize / kCacheLineSize;
+        const size_t last = ( ( pIndices[i] + 1 ) * vertexSize - 1 ) / kCacheLineSize;
+        for ( size_t line = first; line <= last; ++line )
+        {
+            lines += cache.miss( (uint32_t)line );
+        }
+    }
+
+    VertexFetchStats stats;
+    stats.bytesFetched = lines * kCacheLineSize;
+    stats.overfetch = vertexCount ? stats.bytesFetched / (float)( vertexCount * vertexSize ) : 0.f;
+    return stats;
+}
+
+OverdrawStats analyzeOverdraw( const uint32_t* pIndices, size_t indexCount, const VertexData* pVertices, size_t vertexCount )
+{
+    Float3 lo = { INFINITY, INFINITY, INFINITY };
+    Float3 hi = { -INFINITY, -INFINITY, -INFINITY };
+    for ( size_t i = 0; i < vertexCount; ++i )
+    {
+        const Float3 p = positionOf( pVertices[i] );
+        lo = { std::min( lo.x, p.x ), std::min( lo.y, p.y ), std::min( lo.z, p.z ) };
+        hi = { std::max( hi.x, p.x ), std::max( hi.y, p.y ), std::max( hi.z, p.z ) };
+    }
+    const float extent = std::max( { hi.x - lo.x, hi.y - lo.y, hi.z - lo.z, 1e-20f } );
+    const float scale = ( kOverdrawViewSize - 1 ) / extent;
+
+    // Orthographic views down +-X, +-Y and +-Z with back face culling and a Less depth test
+    std::atomic<size_t> covered { 0 };
+    std::atomic<size_t> shaded { 0 };
+    JobSystem::Instance()->parallelFor( 6, 1, [&]( size_t begin, size_t end )
+    {
+        std::vector<float> depth( kOverdrawViewSize * kOverdrawViewSize );
+        for ( size_t view = begin; view < end; ++view )
+        {
+            const int axis = (int)view / 2;
+            const float sign = ( view & 1 ) ? -1.f : 1.f;
+            std::fill( depth.begin(), depth.end(), INFINITY );
+            size_t viewShaded = 0;
+
+            auto project = [&]( uint32_t index, float* pOut )
+            {
+                const Float3 p = positionOf( pVertices[ index ] );
+                const float c[3] = { ( p.x - lo.x ) * scale, ( p.y - lo.y ) * scale, ( p.z - lo.z ) * scale };
+                pOut[0] = c[ ( axis + 1 ) % 3 ];
+                pOut[1] = c[ ( axis + 2 ) % 3 ];
+                pOut[2] = -sign * c[ axis ];
+            };
+
+            for ( size_t t = 0; t < indexCount / 3; ++t )
+            {
+                float a[3], b[3], c[3];
+                project( pIndices[ t * 3 ], a );
+                project( pIndices[ t * 3 + 1 ], b );
+                project( pIndices[ t * 3 + 2 ], c );
+
+                // (u, v, axis) is right handed, so a triangle faces the viewer when its area is positive
+                float area = ( b[0] - a[0] ) * ( c[1] - a[1] ) - ( b[1] - a[1] ) * ( c[0] - a[0] );
+                if ( area * sign <= 0.f )
+                {
+                    continue;
+                }
+                if ( area < 0.f )
+                {
+                    std::swap( b, c );
+                    area = -area;
+                }
+
+                const int x0 = std::max( 0, (int)ceilf( std::min( { a[0], b[0], c[0] } ) - 0.5f ) );
+                const int y0 = std::max( 0, (int)ceilf( std::min( { a[1], b[1], c[1] } ) - 0.5f ) );
+                const int x1 = std::min( kOverdrawViewSize - 1, (int)floorf( std::max( { a[0], b[0], c[0] } ) - 0.5f ) );
+                const int y1 = std::min( kOverdrawViewSize - 1, (int)floorf( std::max( { a[1], b[1], c[1] } ) - 0.5f ) );
+                const float invArea = 1.f / area;
+                for ( int y = y0; y <= y1; ++y )
+                {
+                    const float py = y + 0.5f;
+                    for ( int x = x0; x <= x1; ++x )
+                    {
+                        const float px = x + 0.5f;
+                        const float w0 = ( c[0] - b[0] ) * ( py - b[1] ) - ( c[1] - b[1] ) * ( px - b[0] );
+                        const float w1 = ( a[0] - c[0] ) * ( py - c[1] ) - ( a[1] - c[1] ) * ( px - c[0] );
+                        const float w2 = ( b[0] - a[0] ) * ( py - a[1] ) - ( b[1] - a[1] ) * ( px - a[0] );
+                        if ( w0 < 0.f || w1 < 0.f || w2 < 0.f )
+                        {
+                            continue;
+                        }
+                        const float z = ( w0 * a[2] + w1 * b[2] + w2 * c[2] ) * invArea;
+                        float& stored = depth[ y * kOverdrawViewSize + x ];
+                        if ( z < stored )
+                        {
+                            stored = z;
+                            ++viewShaded;
+                        }
+                    }
+                }
+            }
+
+            size_t viewCovered = 0;
+            for ( float d : depth )
+            {
+                viewCovered += ( d != INFINITY );
+            }
+            covered += viewCovered;
+            shaded += viewShaded;
+        }
+    } );
+
+    OverdrawStats stats;
+    stats.pixelsCovered = covered;
+    stats.pixelsShaded = shaded;
+    stats.overdraw = stats.pixelsCovered ? stats.pixelsShaded / (float)stats.pixelsCovered : 0.f;
+    return stats;
+}
+
+Report optimize( std::vector<VertexData>& vertices, std::vector<uint32_t>& indices, bool withOverdrawStats )
+{
+    Report report = {};
+    report.verticesBefore = vertices.size();
+    report.verticesAfter = vertices.size();
+    if ( indices.empty() || vertices.empty() )
+    {
+        return report;
+    }
+    report.cacheBefore = analyzeVertexCache( indices.data(), indices.size(), vertices.size() );
+    report.fetchBefore = analyzeVertexFetch( indices.data(), indices.size(), vertices.size(), sizeof( VertexData ) );
+    if ( withOverdrawStats )
+    {
+        report.overdrawBefore = analyzeOverdraw( indices.data(), indices.size(), vertices.data(), vertices.size() );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    deduplicateVertices( vertices, indices );
+    report.dedupMs = elapsedMs( start );
+
+    start = std::chrono::steady_clock::now();
+    optimizeVertexCache( indices.data(), indices.size(), vertices.size(), vertices.data() );
+    report.vertexCacheMs = elapsedMs( start );
+
+    start = std::chrono::steady_clock::now();
+    optimizeOverdraw( indices.data(), indices.size(), vertices.data(), vertices.size() );
+    report.overdrawMs = elapsedMs( start );
+
+    start = std::chrono::steady_clock::now();
+    std::vector<VertexData> reordered( vertices.size() );
+    reordered.resize( optimizeVertexFetch( reordered.data(), indices.data(), indices.size(), vertices.data(), vertices.size() ) );
+    vertices.swap( reordered );
+    report.vertexFetchMs = elapsedMs( start );
+
+    report.verticesAfter = vertices.size();
+    report.cacheAfter = analyzeVertexCache( indices.data(), indices.size(), vertices.size() );
+    report.fetchAfter = analyzeVertexFetch( indices.data(), indices.size(), vertices.size(), sizeof( VertexData ) );
+    if ( withOverdrawStats )
+    {
+        report.overdrawAfter = analyzeOverdraw( indices.data(), indices.size(), vertices.data(), vertices.size() );
+    }
+    return report;
+}
+
+}
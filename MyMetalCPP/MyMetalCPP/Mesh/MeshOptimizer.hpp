@@ -0,0 +1,92 @@
+//
+//  MeshOptimizer.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Shaders/ShaderStructs.h"
+
+// Reorders VertexData meshes for the GPU. Run the steps in this order, each one keeps the
+// work of the ones before it:
+//
+//   deduplicateVertices   merge bitwise identical vertices (position, normal, texcoord)
+//   optimizeVertexCache   triangle order for post-transform cache hits (Forsyth's scoring)
+//   optimizeOverdraw      cluster order for early depth rejection without undoing the above
+//                         by more than a threshold (Sander, Nehab and Barczak 2007)
+//   optimizeVertexFetch   vertex order = first use, so vertex fetch streams through memory
+//
+// Large meshes are cut into fixed size triangle ranges that are cache optimized in parallel on
+// the JobSystem, and the cost is a handful of extra cache misses at range boundaries. Pass the
+// vertices to optimizeVertexCache and the triangles are put in Morton order of their centroids
+// first, so each range is a compact patch even when the input is a shuffled soup - without
+// them the ranges keep whatever locality the input order has.
+// Indices are 32 bit here, narrow to uint16_t afterwards when the vertex count allows it.
+
+namespace MeshOptimizer
+{
+    struct VertexCacheStats
+    {
+        size_t verticesTransformed;
+        float acmr;     // vertices transformed per triangle, 0.5 is ideal for big regular grids, 3 is worst
+        float atvr;     // vertices transformed per vertex, 1 is ideal
+    };
+
+    struct VertexFetchStats
+    {
+        size_t bytesFetched;
+        float overfetch;    // bytes fetched / vertex buffer size, 1 is ideal
+    };
+
+    struct OverdrawStats
+    {
+        size_t pixelsCovered;
+        size_t pixelsShaded;
+        float overdraw;     // shaded / covered, averaged over 6 axis aligned views, 1 is ideal
+    };
+
+    struct Report
+    {
+        VertexCacheStats cacheBefore;
+        VertexCacheStats cacheAfter;
+        VertexFetchStats fetchBefore;
+        VertexFetchStats fetchAfter;
+        OverdrawStats overdrawBefore;
+        OverdrawStats overdrawAfter;
+        size_t verticesBefore;
+        size_t verticesAfter;
+        double dedupMs;
+        double vertexCacheMs;
+        double overdrawMs;
+        double vertexFetchMs;
+    };
+
+    static constexpr unsigned int kDefaultCacheSize = 16;     // FIFO entries, typical of post-transform caches
+    static constexpr float kDefaultOverdrawThreshold = 1.05f; // ACMR the overdraw pass may give up
+
+    // Returns the number of unique vertices, which are moved to the front of vertices (resized)
+    size_t deduplicateVertices( std::vector<VertexData>& vertices, std::vector<uint32_t>& indices );
+
+    void optimizeVertexCache( uint32_t* pIndices, size_t indexCount, size_t vertexCount, const VertexData* pVertices = nullptr );
+
+    void optimizeOverdraw( uint32_t* pIndices, size_t indexCount, const VertexData* pVertices, size_t vertexCount,
+                           float threshold = kDefaultOverdrawThreshold );
+
+    // Writes the reordered vertices to pDestination (vertexCount entries, unreferenced vertices
+    // dropped) and remaps the indices. Returns the number of vertices written
+    size_t optimizeVertexFetch( VertexData* pDestination, uint32_t* pIndices, size_t indexCount,
+                                const VertexData* pVertices, size_t vertexCount );
+
+    VertexCacheStats analyzeVertexCache( const uint32_t* pIndices, size_t indexCount, size_t vertexCount,
+                                         unsigned int cacheSize = kDefaultCacheSize );
+    VertexFetchStats analyzeVertexFetch( const uint32_t* pIndices, size_t indexCount, size_t vertexCount, size_t vertexSize );
+    OverdrawStats analyzeOverdraw( const uint32_t* pIndices, size_t indexCount, const VertexData* pVertices, size_t vertexCount );
+
+    // All four steps with stats and timings. Overdraw analysis rasterizes the mesh 6 times,
+    // so skip it for quick runs
+    Report optimize( std::vector<VertexData>& vertices, std::vector<uint32_t>& indices, bool withOverdrawStats = true );
+}
@@ -0,0 +1,541 @@
+//
+//  Meshlets.cpp
+//  MyMetalCPP
+//
+
+#include "Meshlets.hpp"
+#include "../Jobs/JobSystem.hpp"
+#include "../Maths/Math.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <math.h>
+
+static constexpr uint8_t kNotInMeshlet = 0xff;
+static constexpr size_t kMeshletsPerJob = 1024;
+static constexpr float kMinConeSpread = 0.1f;      // cos of the widest normal cone still worth testing
+static constexpr float kNeighbourBias = 6.f;        // how much distance outweighs closing off cut off triangles
+
+struct Float3
+{
+    float x, y, z;
+};
+
+static inline Float3 positionOf( const VertexData& v )
+{
+    return { v.position.x, v.position.y, v.position.z };
+}
+
+static inline Float3 sub( Float3 a, Float3 b )
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+static inline float dot( Float3 a, Float3 b )
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline Float3 cross( Float3 a, Float3 b )
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+static inline float component( Float3 p, int axis )
+{
+    return ( axis == 0 ) ? p.x : ( ( axis == 1 ) ? p.y : p.z );
+}
+
+// Ritter's sphere - start from the most separated pair of axis extremes, then grow to fit
+static void boundingSphere( const Float3* pPoints, size_t count, float* pCenter, float& radius )
+{
+    size_t minIndex[3] = { 0, 0, 0 };
+    size_t maxIndex[3] = { 0, 0, 0 };
+    for ( size_t i = 1; i < count; ++i )
+    {
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            const float p = component( pPoints[i], axis );
+            minIndex[axis] = ( p < component( pPoints[ minIndex[axis] ], axis ) ) ? i : minIndex[axis];
+            maxIndex[axis] = ( p > component( pPoints[ maxIndex[axis] ], axis ) ) ? i : maxIndex[axis];
+        }
+    }
+
+    int widest = 0;
+    float widestDistance = -1.f;
+    for ( int axis = 0; axis < 3; ++axis )
+    {
+        const Float3 d = sub( pPoints[ maxIndex[axis] ], pPoints[ minIndex[axis] ] );
+        if ( dot( d, d ) > widestDistance )
+        {
+            widestDistance = dot( d, d );
+            widest = axis;
+        }
+    }
+
+    const Float3 a = pPoints[ minIndex[widest] ];
+    const Float3 b = pPoints[ maxIndex[widest] ];
+    Float3 center = { ( a.x + b.x ) * 0.5f, ( a.y + b.y ) * 0.5f, ( a.z + b.z ) * 0.5f };
+    radius = sqrtf( widestDistance ) * 0.5f;
+
+    for ( size_t i = 0; i < count; ++i )
+    {
+        const Float3 d = sub( pPoints[i], center );
+        const float distanceSq = dot( d, d );
+        if ( distanceSq > radius * radius )
+        {
+            const float distance = sqrtf( distanceSq );
+            const float grow = ( distance - radius ) * 0.5f;
+            radius += grow;
+            const float t = grow / distance;
+            center = { center.x + d.x * t, center.y + d.y * t, center.z + d.z * t };
+        }
+    }
+
+    pCenter[0] = center.x;
+    pCenter[1] = center.y;
+    pCenter[2] = center.z;
+}
+
+static Meshlets::MeshletBounds computeBounds( const Meshlets::MeshletMesh& result, const Meshlets::Meshlet& meshlet, const VertexData* pVertices )
+{
+    Meshlets::MeshletBounds bounds = {};
+
+    std::array<Float3, Meshlets::kMaxVertices> points;
+    for ( uint32_t i = 0; i < meshlet.vertexCount; ++i )
+    {
+        points[i] = positionOf( pVertices[ result.vertices[ meshlet.vertexOffset + i ] ] );
+    }
+    boundingSphere( points.data(), meshlet.vertexCount, bounds.center, bounds.radius );
+
+    // cone around the average face normal, as wide as the furthest normal from it
+    std::array<Float3, Meshlets::kMaxTriangles> normals;
+    size_t normalCount = 0;
+    Float3 axis = { 0.f, 0.f, 0.f };
+    for ( uint32_t t = 0; t < meshlet.triangleCount; ++t )
+    {
+        const uint8_t* pTri = &result.triangles[ ( meshlet.triangleOffset + t ) * 3 ];
+        const Float3 n = cross( sub( points[ pTri[1] ], points[ pTri[0] ] ), sub( points[ pTri[2] ], points[ pTri[0] ] ) );
+        const float lengthSq = dot( n, n );
+        if ( lengthSq > 0.f )
+        {
+            const float invLength = 1.f / sqrtf( lengthSq );
+            normals[ normalCount++ ] = { n.x * invLength, n.y * invLength, n.z * invLength };
+            axis = { axis.x + n.x * invLength, axis.y + n.y * invLength, axis.z + n.z * invLength };
+        }
+    }
+
+    bounds.coneCutoff = 1.f;
+    const float axisLengthSq = dot( axis, axis );
+    if ( axisLengthSq > 0.f )
+    {
+        const float invLength = 1.f / sqrtf( axisLengthSq );
+        axis = { axis.x * invLength, axis.y * invLength, axis.z * invLength };
+        float minDot = 1.f;
+        for ( size_t i = 0; i < normalCount; ++i )
+        {
+            minDot = std::min( minDot, dot( axis, normals[i] ) );
+        }
+        if ( minDot > kMinConeSpread )
+        {
+            bounds.coneCutoff = sqrtf( 1.f - minDot * minDot );
+        }
+    }
+    bounds.coneAxis[0] = axis.x;
+    bounds.coneAxis[1] = axis.y;
+    bounds.coneAxis[2] = axis.z;
+    return bounds;
+}
+
+namespace Meshlets
+{
+
+static MeshletMesh buildMeshlets( const MeshInput& mesh )
+{
+    assert( mesh.indexCount % 3 == 0 );
+    const uint32_t* pIndices = mesh.pIndices;
+    const size_t triangleCount = mesh.indexCount / 3;
+    MeshletMesh result;
+    if ( triangleCount == 0 )
+    {
+        return result;
+    }
+
+    // vertex -> triangles
+    std::vector<uint32_t> offsets( mesh.vertexCount + 1, 0 );
+    for ( size_t i = 0; i < mesh.indexCount; ++i )
+    {
+        ++offsets[ pIndices[i] + 1 ];
+    }
+    for ( size_t v = 0; v < mesh.vertexCount; ++v )
+    {
+        offsets[ v + 1 ] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency( mesh.indexCount );
+    {
+        std::vector<uint32_t> fill( offsets.begin(), offsets.end() - 1 );
+        for ( size_t i = 0; i < mesh.indexCount; ++i )
+        {
+            adjacency[ fill[ pIndices[i] ]++ ] = (uint32_t)( i / 3 );
+        }
+    }
+
+    std::vector<Float3> centroids( triangleCount );
+    for ( size_t t = 0; t < triangleCount; ++t )
+    {
+        const Float3 a = positionOf( mesh.pVertices[ pIndices[ t * 3 ] ] );
+        const Float3 b = positionOf( mesh.pVertices[ pIndices[ t * 3 + 1 ] ] );
+        const Float3 c = positionOf( mesh.pVertices[ pIndices[ t * 3 + 2 ] ] );
+        centroids[t] = { ( a.x + b.x + c.x ) / 3.f, ( a.y + b.y + c.y ) / 3.f, ( a.z + b.z + c.z ) / 3.f };
+    }
+
+    result.meshlets.reserve( triangleCount / kMaxTriangles * 2 + 1 );
+    result.vertices.reserve( triangleCount );
+    result.triangles.reserve( triangleCount * 3 );
+
+    std::vector<uint8_t> emitted( triangleCount, 0 );
+    std::vector<uint32_t> live( offsets.size() - 1 );     // triangles left per vertex
+    for ( size_t v = 0; v < live.size(); ++v )
+    {
+        live[v] = offsets[ v + 1 ] - offsets[v];
+    }
+    std::vector<uint8_t> local( mesh.vertexCount, kNotInMeshlet );
+    std::vector<uint32_t> candidates;       // triangles touching the meshlet, may hold emitted ones and repeats
+    Meshlet current = {};
+    Float3 positionSum = { 0.f, 0.f, 0.f };
+    size_t cursor = 0;
+
+    // Fewest new vertices first. Among those, close to the centre and with few triangles left
+    // around it - picking off the cut off ones stops slivers being left for later meshlets
+    auto bestCandidate = [&]() -> int64_t
+    {
+        const float invCount = 1.f / current.vertexCount;
+        const Float3 center = { positionSum.x * invCount, positionSum.y * invCount, positionSum.z * invCount };
+        int64_t best = -1;
+        int bestNew = 4;
+        float bestCost = INFINITY;
+        for ( size_t i = 0; i < candidates.size(); )
+        {
+            const uint32_t t = candidates[i];
+            if ( emitted[t] )
+            {
+                candidates[i] = candidates.back();
+                candidates.pop_back();
+                continue;
+            }
+            ++i;
+            const int newVertices = ( local[ pIndices[ t * 3 ] ] == kNotInMeshlet ) + ( local[ pIndices[ t * 3 + 1 ] ] == kNotInMeshlet ) +
+                                    ( local[ pIndices[ t * 3 + 2 ] ] == kNotInMeshlet );
+            if ( current.vertexCount + newVertices > kMaxVertices )
+            {
+                continue;
+            }
+            if ( newVertices == 0 )
+            {
+                return t;   // free - nothing better than that
+            }
+            const uint32_t neighbours = live[ pIndices[ t * 3 ] ] + live[ pIndices[ t * 3 + 1 ] ] + live[ pIndices[ t * 3 + 2 ] ];
+            const Float3 d = sub( centroids[t], center );
+            const float cost = dot( d, d ) * ( (float)neighbours + kNeighbourBias );
+            if ( newVertices < bestNew || ( newVertices == bestNew && cost < bestCost ) )
+            {
+                best = t;
+                bestNew = newVertices;
+                bestCost = cost;
+            }
+        }
+        return best;
+    };
+
+    auto finishMeshlet = [&]()
+    {
+        for ( uint32_t i = 0; i < current.vertexCount; ++i )
+        {
+            local[ result.vertices[ current.vertexOffset + i ] ] = kNotInMeshlet;
+        }
+        result.meshlets.push_back( current );
+        current = { (uint32_t)result.vertices.size(), (uint32_t)( result.triangles.size() / 3 ), 0, 0 };
+        positionSum = { 0.f, 0.f, 0.f };
+        candidates.clear();
+    };
+
+    // The next meshlet starts next to the last one, so neighbouring meshlets stay neighbours in
+    // memory, at its most cut off triangle - starting in the open leaves slivers behind that end
+    // up as tiny meshlets of their own
+    auto seedTriangle = [&]() -> int64_t
+    {
+        int64_t best = -1;
+        uint32_t bestLive = ~0u;
+        if ( !result.meshlets.empty() )
+        {
+            const Meshlet& last = result.meshlets.back();
+            for ( uint32_t i = 0; i < last.vertexCount; ++i )
+            {
+                const uint32_t v = result.vertices[ last.vertexOffset + i ];
+                for ( uint32_t j = offsets[v]; j < offsets[ v + 1 ]; ++j )
+                {
+                    const uint32_t t = adjacency[j];
+                    const uint32_t neighbours = live[ pIndices[ t * 3 ] ] + live[ pIndices[ t * 3 + 1 ] ] + live[ pIndices[ t * 3 + 2 ] ];
+                    if ( !emitted[t] && neighbours < bestLive )
+                    {
+                        best = t;
+                        bestLive = neighbours;
+                    }
+                }
+            }
+        }
+        if ( best >= 0 )
+        {
+            return best;
+        }
+        while ( emitted[ cursor ] )
+        {
+            ++cursor;
+        }
+        return (int64_t)cursor;
+    };
+
+    for ( size_t count = 0; count < triangleCount; ++count )
+    {
+        int64_t best = ( current.triangleCount > 0 ) ? bestCandidate() : -1;
+        if ( best < 0 )
+        {
+            if ( current.triangleCount > 0 )
+            {
+                finishMeshlet();
+            }
+            best = seedTriangle();
+        }
+
+        emitted[ best ] = 1;
+        for ( int k = 0; k < 3; ++k )
+        {
+            const uint32_t v = pIndices[ best * 3 + k ];
+            --live[v];
+            if ( local[v] == kNotInMeshlet )
+            {
+                local[v] = (uint8_t)current.vertexCount++;
+                result.vertices.push_back( v );
+                const Float3 p = positionOf( mesh.pVertices[v] );
+                positionSum = { positionSum.x + p.x, positionSum.y + p.y, positionSum.z + p.z };
+                for ( uint32_t j = offsets[v]; j < offsets[ v + 1 ]; ++j )
+                {
+                    if ( !emitted[ adjacency[j] ] )
+                    {
+                        candidates.push_back( adjacency[j] );
+                    }
+                }
+            }
+            result.triangles.push_back( local[v] );
+        }
+        if ( ++current.triangleCount == kMaxTriangles )
+        {
+            finishMeshlet();
+        }
+    }
+    if ( current.triangleCount > 0 )
+    {
+        finishMeshlet();
+    }
+    return result;
+}
+
+MeshletMesh build( const MeshInput& mesh )
+{
+    MeshletMesh result = buildMeshlets( mesh );
+    result.bounds.resize( result.meshlets.size() );
+    JobSystem::Instance()->parallelFor( result.meshlets.size(), kMeshletsPerJob, [&]( size_t begin, size_t end )
+    {
+        for ( size_t m = begin; m < end; ++m )
+        {
+            result.bounds[m] = computeBounds( result, result.meshlets[m], mesh.pVertices );
+        }
+    } );
+    return result;
+}
+
+std::vector<MeshletMesh> buildMany( const std::vector<MeshInput>& meshes )
+{
+    std::vector<MeshletMesh> results( meshes.size() );
+    JobSystem::Instance()->parallelFor( meshes.size(), 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t i = begin; i < end; ++i )
+        {
+            results[i] = build( meshes[i] );
+        }
+    } );
+    return results;
+}
+
+void flattenIndices( const MeshletMesh& meshlets, std::vector<uint32_t>& indices )
+{
+    indices.resize( meshlets.triangles.size() );
+    for ( const Meshlet& meshlet : meshlets.meshlets )
+    {
+        for ( uint32_t i = 0; i < meshlet.triangleCount * 3; ++i )
+        {
+            const size_t index = meshlet.triangleOffset * 3 + i;
+            indices[ index ] = meshlets.vertices[ meshlet.vertexOffset + meshlets.triangles[ index ] ];
+        }
+    }
+}
+
+// Rotated so the smallest index comes first - same triangle, same winding, same key
+static std::array<uint32_t, 3> triangleKey( uint32_t a, uint32_t b, uint32_t c )
+{
+    if ( b < a && b < c )
+    {
+        return { b, c, a };
+    }
+    if ( c < a && c < b )
+    {
+        return { c, a, b };
+    }
+    return { a, b, c };
+}
+
+bool validate( const MeshletMesh& meshlets, const MeshInput& mesh )
+{
+    std::vector<std::array<uint32_t, 3>> expected( mesh.indexCount / 3 );
+    for ( size_t t = 0; t < expected.size(); ++t )
+    {
+        expected[t] = triangleKey( mesh.pIndices[ t * 3 ], mesh.pIndices[ t * 3 + 1 ], mesh.pIndices[ t * 3 + 2 ] );
+    }
+
+    std::vector<std::array<uint32_t, 3>> found;
+    found.reserve( expected.size() );
+    uint32_t nextTriangle = 0;
+    for ( const Meshlet& meshlet : meshlets.meshlets )
+    {
+        if ( meshlet.vertexCount > kMaxVertices || meshlet.triangleCount > kMaxTriangles || meshlet.triangleCount == 0 ||
+             meshlet.triangleOffset != nextTriangle || meshlet.vertexOffset + meshlet.vertexCount > meshlets.vertices.size() )
+        {
+            return false;
+        }
+        nextTriangle += meshlet.triangleCount;
+
+        uint64_t used = 0;
+        for ( uint32_t t = 0; t < meshlet.triangleCount; ++t )
+        {
+            uint32_t v[3];
+            for ( int k = 0; k < 3; ++k )
+            {
+                const uint8_t index = meshlets.triangles[ ( meshlet.triangleOffset + t ) * 3 + k ];
+                if ( index >= meshlet.vertexCount )
+                {
+                    return false;
+                }
+                used |= 1ull << index;
+                v[k] = meshlets.vertices[ meshlet.vertexOffset + index ];
+            }
+            found.push_back( triangleKey( v[0], v[1], v[2] ) );
+        }
+        if ( used != ( meshlet.vertexCount == 64 ? ~0ull : ( 1ull << meshlet.vertexCount ) - 1 ) )
+        {
+            return false;
+        }
+    }
+    if ( nextTriangle * 3 != meshlets.triangles.size() || meshlets.bounds.size() != meshlets.meshlets.size() )
+    {
+        return false;
+    }
+
+    std::sort( expected.begin(), expected.end() );
+    std::sort( found.begin(), found.end() );
+    return expected == found;
+}
+
+CullParams makeCullParams( const Matrix44f& clipFromMesh, const Vector3f& cameraPosition )
+{
+    CullParams params;
+    Maths::extractFrustumPlanes( clipFromMesh, params.planes );
+    params.cameraPosition = cameraPosition;
+    return params;
+}
+
+CullStats cull( const MeshletMesh& meshlets, const CullParams& params, std::vector<DrawRange>& ranges )
+{
+    const size_t meshletCount = meshlets.meshlets.size();
+    const size_t jobCount = ( meshletCount + kMeshletsPerJob - 1 ) / kMeshletsPerJob;
+    std::vector<std::vector<DrawRange>> jobRanges( jobCount );
+    std::vector<CullStats> jobStats( jobCount, CullStats{} );
+
+    float planes[6][4];
+    for ( int i = 0; i < 6; ++i )
+    {
+        planes[i][0] = params.planes[i].x;
+        planes[i][1] = params.planes[i].y;
+        planes[i][2] = params.planes[i].z;
+        planes[i][3] = params.planes[i].w;
+    }
+    const Float3 camera = { params.cameraPosition.x, params.cameraPosition.y, params.cameraPosition.z };
+
+    JobSystem::Instance()->parallelFor( meshletCount, kMeshletsPerJob, [&]( size_t begin, size_t end )
+    {
+        std::vector<DrawRange>& out = jobRanges[ begin / kMeshletsPerJob ];
+        CullStats& stats = jobStats[ begin / kMeshletsPerJob ];
+        for ( size_t m = begin; m < end; ++m )
+        {
+            const MeshletBounds& b = meshlets.bounds[m];
+            const Float3 center = { b.center[0], b.center[1], b.center[2] };
+
+            bool outside = false;
+            for ( int i = 0; i < 6 && !outside; ++i )
+            {
+                outside = center.x * planes[i][0] + center.y * planes[i][1] + center.z * planes[i][2] + planes[i][3] < -b.radius;
+            }
+            if ( outside )
+            {
+                ++stats.frustumCulled;
+                continue;
+            }
+
+            // every normal in the cone faces away from anywhere the camera could see the sphere from
+            const Float3 view = sub( center, camera );
+            const Float3 axis = { b.coneAxis[0], b.coneAxis[1], b.coneAxis[2] };
+            if ( dot( view, axis ) >= b.coneCutoff * sqrtf( dot( view, view ) ) + b.radius )
+            {
+                ++stats.backfaceCulled;
+                continue;
+            }
+
+            const Meshlet& meshlet = meshlets.meshlets[m];
+            ++stats.visible;
+            stats.trianglesVisible += meshlet.triangleCount;
+            const uint32_t firstIndex = meshlet.triangleOffset * 3;
+            if ( !out.empty() && out.back().firstIndex + out.back().indexCount == firstIndex )
+            {
+                out.back().indexCount += meshlet.triangleCount * 3;
+            }
+            else
+            {
+                out.push_back( { firstIndex, meshlet.triangleCount * 3 } );
+            }
+        }
+    } );
+
+    ranges.clear();
+    CullStats total = {};
+    for ( size_t j = 0; j < jobCount; ++j )
+    {
+        for ( const DrawRange& range : jobRanges[j] )
+        {
+            if ( !ranges.empty() && ranges.back().firstIndex + ranges.back().indexCount == range.firstIndex )
+            {
+                ranges.back().indexCount += range.indexCount;
+            }
+            else
+            {
+                ranges.push_back( range );
+            }
+        }
+        total.frustumCulled += jobStats[j].frustumCulled;
+        total.backfaceCulled += jobStats[j].backfaceCulled;
+        total.visible += jobStats[j].visible;
+        total.trianglesVisible += jobStats[j].trianglesVisible;
+    }
+    return total;
+}
+
+}
@@ -0,0 +1,99 @@
+//
+//  Meshlets.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Shaders/ShaderStructs.h"
+
+// Splits an indexed triangle mesh into meshlets - clusters of up to kMaxVertices vertices and
+// kMaxTriangles triangles - so culling can work below whole instance granularity.
+//
+// Meshlets are grown greedily: the next triangle is the one adjacent to the current meshlet
+// that adds the fewest new vertices, then the nearest the meshlet's centre with the fewest
+// triangles left around it. That keeps them compact (small bounding spheres), connected (tight
+// normal cones) and full - about 60 vertices and 90 triangles on regular meshes.
+//
+// Each meshlet gets a bounding sphere and a normal cone. cull() tests them against the view
+// frustum and the camera position and emits the surviving meshlets as index ranges into the
+// flattened index buffer, with neighbouring survivors merged into one draw.
+
+namespace Meshlets
+{
+    static constexpr uint32_t kMaxVertices = 64;
+    static constexpr uint32_t kMaxTriangles = 124;
+
+    struct Meshlet
+    {
+        uint32_t vertexOffset;      // into MeshletMesh::vertices
+        uint32_t triangleOffset;    // into MeshletMesh::triangles, in triangles - also the first index / 3 in flattenIndices
+        uint32_t vertexCount;
+        uint32_t triangleCount;
+    };
+
+    struct MeshletBounds
+    {
+        float center[3];
+        float radius;
+        float coneAxis[3];
+        float coneCutoff;           // sin of the cone's half angle, 1 = the meshlet can't be backface culled
+    };
+
+    struct MeshletMesh
+    {
+        std::vector<Meshlet> meshlets;
+        std::vector<MeshletBounds> bounds;
+        std::vector<uint32_t> vertices;     // mesh vertex index per meshlet vertex
+        std::vector<uint8_t> triangles;     // 3 meshlet local vertex indices per triangle
+    };
+
+    struct MeshInput
+    {
+        const uint32_t* pIndices;
+        size_t indexCount;
+        const VertexData* pVertices;
+        size_t vertexCount;
+    };
+
+    // Meshlets follow the input order where it has locality, so vertex cache optimize first
+    MeshletMesh build( const MeshInput& mesh );
+
+    // One job per mesh
+    std::vector<MeshletMesh> buildMany( const std::vector<MeshInput>& meshes );
+
+    // Index buffer in meshlet order - meshlet m is indices [ triangleOffset * 3, ( triangleOffset + triangleCount ) * 3 )
+    void flattenIndices( const MeshletMesh& meshlets, std::vector<uint32_t>& indices );
+
+    // Every input triangle in exactly one meshlet, limits respected and every meshlet vertex used
+    bool validate( const MeshletMesh& meshlets, const MeshInput& mesh );
+
+    struct CullParams
+    {
+        Vector4f planes[6];         // in mesh space, see Maths::extractFrustumPlanes
+        Vector3f cameraPosition;    // in mesh space
+    };
+
+    struct DrawRange
+    {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+    };
+
+    struct CullStats
+    {
+        size_t frustumCulled;
+        size_t backfaceCulled;
+        size_t visible;
+        size_t trianglesVisible;
+    };
+
+    CullParams makeCullParams( const Matrix44f& clipFromMesh, const Vector3f& cameraPosition );
+
+    // Clears ranges and fills it with the surviving meshlets, in meshlet order
+    CullStats cull( const MeshletMesh& meshlets, const CullParams& params, std::vector<DrawRange>& ranges );
+}
@@ -0,0 +1,450 @@
+//
+//  Simplifier.cpp
+//  MyMetalCPP
+//
+
+#include "Simplifier.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <math.h>
+#include <vector>
+
+static constexpr uint32_t kInvalidIndex = ~0u;
+static constexpr float kBorderWeight = 10.f;        // border plane quadrics against the face quadrics
+static constexpr float kMinFlipCos = 0.25f;         // a collapse may turn a triangle's normal by up to ~75 degrees
+static constexpr size_t kTrianglesPerJob = 16384;
+
+struct Float3
+{
+    float x, y, z;
+};
+
+static inline Float3 sub( Float3 a, Float3 b )
+{
+    return { a.x - b.x, a.y - b.y, a.z - b.z };
+}
+
+static inline float dot( Float3 a, Float3 b )
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline Float3 cross( Float3 a, Float3 b )
+{
+    return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+}
+
+// Symmetric 4x4 error matrix plus the total weight (area) folded into it
+struct Quadric
+{
+    float a00, a11, a22, a01, a02, a12;
+    float b0, b1, b2;
+    float c;
+    float w;
+};
+
+static void addPlane( Quadric& q, Float3 n, float d, float weight )
+{
+    q.a00 += weight * n.x * n.x;
+    q.a11 += weight * n.y * n.y;
+    q.a22 += weight * n.z * n.z;
+    q.a01 += weight * n.x * n.y;
+    q.a02 += weight * n.x * n.z;
+    q.a12 += weight * n.y * n.z;
+    q.b0 += weight * n.x * d;
+    q.b1 += weight * n.y * d;
+    q.b2 += weight * n.z * d;
+    q.c += weight * d * d;
+    q.w += weight;
+}
+
+static void accumulate( Quadric& q, const Quadric& other )
+{
+    q.a00 += other.a00;
+    q.a11 += other.a11;
+    q.a22 += other.a22;
+    q.a01 += other.a01;
+    q.a02 += other.a02;
+    q.a12 += other.a12;
+    q.b0 += other.b0;
+    q.b1 += other.b1;
+    q.b2 += other.b2;
+    q.c += other.c;
+    q.w += other.w;
+}
+
+// Squared distance to the planes, weighted average
+static float evaluate( const Quadric& q, const Quadric& r, Float3 p )
+{
+    const float a00 = q.a00 + r.a00, a11 = q.a11 + r.a11, a22 = q.a22 + r.a22;
+    const float a01 = q.a01 + r.a01, a02 = q.a02 + r.a02, a12 = q.a12 + r.a12;
+    const float error = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+                        2.f * ( a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z ) +
+                        2.f * ( ( q.b0 + r.b0 ) * p.x + ( q.b1 + r.b1 ) * p.y + ( q.b2 + r.b2 ) * p.z ) + q.c + r.c;
+    const float weight = q.w + r.w;
+    return weight > 0.f ? fabsf( error ) / weight : 0.f;
+}
+
+enum class VertexKind : uint8_t
+{
+    Manifold,   // collapses onto any neighbour
+    Border,     // collapses along its border edges
+    Locked      // stays - seams, non manifold and locked borders
+};
+
+static inline uint64_t edgeKey( uint32_t a, uint32_t b )
+{
+    return ( (uint64_t)a << 32 ) | b;
+}
+
+// Same position -> same id, so seams (open edges whose twin exists between other vertices
+// at the same positions) can be told apart from real borders
+static std::vector<uint32_t> weldPositions( const VertexData* pVertices, size_t vertexCount )
+{
+    size_t tableSize = 1;
+    while ( tableSize < vertexCount * 2 )
+    {
+        tableSize <<= 1;
+    }
+    std::vector<uint32_t> table( tableSize, kInvalidIndex );
+    std::vector<uint32_t> positionId( vertexCount );
+    for ( size_t i = 0; i < vertexCount; ++i )
+    {
+        uint32_t key[3];
+        const float p[3] = { pVertices[i].position.x, pVertices[i].position.y, pVertices[i].position.z };
+        memcpy( key, p, sizeof( key ) );
+        size_t slot = ( ( key[0] * 73856093u ) ^ ( key[1] * 19349663u ) ^ ( key[2] * 83492791u ) ) & ( tableSize - 1 );
+        for ( ;; )
+        {
+            const uint32_t entry = table[ slot ];
+            if ( entry == kInvalidIndex )
+            {
+                table[ slot ] = (uint32_t)i;
+                positionId[i] = (uint32_t)i;
+                break;
+            }
+            const float q[3] = { pVertices[ entry ].position.x, pVertices[ entry ].position.y, pVertices[ entry ].position.z };
+            if ( memcmp( p, q, sizeof( p ) ) == 0 )
+            {
+                positionId[i] = entry;
+                break;
+            }
+            slot = ( slot + 1 ) & ( tableSize - 1 );
+        }
+    }
+    return positionId;
+}
+
+namespace Simplifier
+{
+
+float extent( const uint32_t* pIndices, size_t indexCount, const VertexData* pVertices )
+{
+    if ( indexCount == 0 )
+    {
+        return 0.f;
+    }
+    Float3 lo = { INFINITY, INFINITY, INFINITY };
+    Float3 hi = { -INFINITY, -INFINITY, -INFINITY };
+    for ( size_t i = 0; i < indexCount; ++i )
+    {
+        const VertexData& v = pVertices[ pIndices[i] ];
+        lo = { std::min( lo.x, v.position.x ), std::min( lo.y, v.position.y ), std::min( lo.z, v.position.z ) };
+        hi = { std::max( hi.x, v.position.x ), std::max( hi.y, v.position.y ), std::max( hi.z, v.position.z ) };
+    }
+    return std::max( { hi.x - lo.x, hi.y - lo.y, hi.z - lo.z } );
+}
+
+size_t simplify( uint32_t* pDestination, const uint32_t* pIndices, size_t indexCount,
+                 const VertexData* pVertices, size_t vertexCount, const Options& options, float* pResultError )
+{
+    assert( indexCount % 3 == 0 );
+    JobSystem* pJobs = JobSystem::Instance();
+    std::copy( pIndices, pIndices + indexCount, pDestination );
+    if ( pResultError )
+    {
+        *pResultError = 0.f;
+    }
+    if ( indexCount <= options.targetIndexCount )
+    {
+        return indexCount;
+    }
+
+    // positions scaled to a unit box, so errors are relative to the extent
+    const float meshExtent = extent( pIndices, indexCount, pVertices );
+    const float invExtent = meshExtent > 0.f ? 1.f / meshExtent : 0.f;
+    std::vector<Float3> positions( vertexCount );
+    for ( size_t i = 0; i < vertexCount; ++i )
+    {
+        positions[i] = { pVertices[i].position.x * invExtent, pVertices[i].position.y * invExtent, pVertices[i].position.z * invExtent };
+    }
+
+    // Classify vertices by their open edges - an edge with no twin going the other way
+    std::vector<VertexKind> kind( vertexCount, VertexKind::Manifold );
+    std::vector<uint32_t> borderNext( vertexCount, kInvalidIndex );
+    std::vector<uint32_t> borderPrev( vertexCount, kInvalidIndex );
+    std::vector<Quadric> quadrics( vertexCount, Quadric{} );
+    {
+        const std::vector<uint32_t> positionId = weldPositions( pVertices, vertexCount );
+        std::vector<uint64_t> edges( indexCount );
+        std::vector<uint64_t> positionEdges( indexCount );
+        for ( size_t t = 0; t < indexCount; t += 3 )
+        {
+            for ( int k = 0; k < 3; ++k )
+            {
+                const uint32_t a = pIndices[ t + k ];
+                const uint32_t b = pIndices[ t + ( k + 1 ) % 3 ];
+                edges[ t + k ] = edgeKey( a, b );
+                positionEdges[ t + k ] = edgeKey( positionId[a], positionId[b] );
+            }
+        }
+        std::sort( edges.begin(), edges.end() );
+        std::sort( positionEdges.begin(), positionEdges.end() );
+
+        std::vector<uint8_t> openIn( vertexCount, 0 );
+        std::vector<uint8_t> openOut( vertexCount, 0 );
+        std::vector<uint8_t> seam( vertexCount, 0 );
+        for ( size_t t = 0; t < indexCount; t += 3 )
+        {
+            const Float3 p0 = positions[ pIndices[t] ];
+            const Float3 p1 = positions[ pIndices[ t + 1 ] ];
+            const Float3 p2 = positions[ pIndices[ t + 2 ] ];
+            Float3 normal = cross( sub( p1, p0 ), sub( p2, p0 ) );
+            const float length = sqrtf( dot( normal, normal ) );
+            if ( length > 0.f )
+            {
+                normal = { normal.x / length, normal.y / length, normal.z / length };
+                for ( int k = 0; k < 3; ++k )
+                {
+                    addPlane( quadrics[ pIndices[ t + k ] ], normal, -dot( normal, p0 ), length * 0.5f );
+                }
+            }
+
+            for ( int k = 0; k < 3; ++k )
+            {
+                const uint32_t a = pIndices[ t + k ];
+                const uint32_t b = pIndices[ t + ( k + 1 ) % 3 ];
+                if ( a == b || std::binary_search( edges.begin(), edges.end(), edgeKey( b, a ) ) )
+                {
+                    continue;
+                }
+                if ( std::binary_search( positionEdges.begin(), positionEdges.end(), edgeKey( positionId[b], positionId[a] ) ) )
+                {
+                    seam[a] = seam[b] = 1;
+                    continue;
+                }
+                openOut[a] = (uint8_t)std::min( openOut[a] + 1, 2 );
+                openIn[b] = (uint8_t)std::min( openIn[b] + 1, 2 );
+                borderNext[a] = b;
+                borderPrev[b] = a;
+
+                // plane through the border edge at right angles to the face keeps the outline in place
+                if ( length > 0.f )
+                {
+                    const Float3 edge = sub( positions[b], positions[a] );
+                    Float3 perpendicular = cross( edge, normal );
+                    const float perpendicularLength = sqrtf( dot( perpendicular, perpendicular ) );
+                    if ( perpendicularLength > 0.f )
+                    {
+                        perpendicular = { perpendicular.x / perpendicularLength, perpendicular.y / perpendicularLength,
+                                          perpendicular.z / perpendicularLength };
+                        const float weight = dot( edge, edge ) * kBorderWeight;
+                        addPlane( quadrics[a], perpendicular, -dot( perpendicular, positions[a] ), weight );
+                        addPlane( quadrics[b], perpendicular, -dot( perpendicular, positions[a] ), weight );
+                    }
+                }
+            }
+        }
+
+        for ( size_t v = 0; v < vertexCount; ++v )
+        {
+            if ( seam[v] || openIn[v] != openOut[v] || openIn[v] > 1 || ( openIn[v] == 1 && options.lockBorder ) )
+            {
+                kind[v] = VertexKind::Locked;
+            }
+            else if ( openIn[v] == 1 )
+            {
+                kind[v] = VertexKind::Border;
+            }
+        }
+    }
+
+    auto attributeCost = [&]( uint32_t s, uint32_t t ) -> float
+    {
+        const VertexData& a = pVertices[s];
+        const VertexData& b = pVertices[t];
+        const Float3 dn = { a.normal.x - b.normal.x, a.normal.y - b.normal.y, a.normal.z - b.normal.z };
+        const float du = a.texcoord.x - b.texcoord.x;
+        const float dv = a.texcoord.y - b.texcoord.y;
+        return options.normalWeight * dot( dn, dn ) + options.texcoordWeight * ( du * du + dv * dv );
+    };
+
+    auto collapseCost = [&]( uint32_t s, uint32_t t ) -> float
+    {
+        if ( kind[s] == VertexKind::Locked || ( kind[s] == VertexKind::Border && borderNext[s] != t && borderPrev[s] != t ) )
+        {
+            return INFINITY;
+        }
+        return evaluate( quadrics[s], quadrics[t], positions[t] ) + attributeCost( s, t );
+    };
+
+    struct Collapse
+    {
+        uint32_t source;
+        uint32_t target;
+        float cost;
+    };
+
+    const float errorLimit = options.targetError * options.targetError;
+    float maxError = 0.f;
+    size_t currentCount = indexCount;
+    std::vector<uint32_t> remap( vertexCount );
+    std::vector<uint8_t> touched( vertexCount );
+    std::vector<uint32_t> offsets( vertexCount + 1 );
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<uint64_t> order;
+
+    while ( currentCount > options.targetIndexCount )
+    {
+        const size_t triangleCount = currentCount / 3;
+
+        // vertex -> triangles for the flip test
+        std::fill( offsets.begin(), offsets.end(), 0 );
+        for ( size_t i = 0; i < currentCount; ++i )
+        {
+            ++offsets[ pDestination[i] + 1 ];
+        }
+        for ( size_t v = 0; v < vertexCount; ++v )
+        {
+            offsets[ v + 1 ] += offsets[v];
+        }
+        adjacency.resize( currentCount );
+        {
+            std::vector<uint32_t> fill( offsets.begin(), offsets.end() - 1 );
+            for ( size_t i = 0; i < currentCount; ++i )
+            {
+                adjacency[ fill[ pDestination[i] ]++ ] = (uint32_t)( i / 3 );
+            }
+        }
+
+        // cheaper direction of every triangle edge - shared edges turn up twice, the second is skipped below
+        collapses.resize( currentCount );
+        pJobs->parallelFor( triangleCount, kTrianglesPerJob, [&]( size_t begin, size_t end )
+        {
+            for ( size_t t = begin; t < end; ++t )
+            {
+                for ( int k = 0; k < 3; ++k )
+                {
+                    const uint32_t a = pDestination[ t * 3 + k ];
+                    const uint32_t b = pDestination[ t * 3 + ( k + 1 ) % 3 ];
+                    const float ab = collapseCost( a, b );
+                    const float ba = collapseCost( b, a );
+                    collapses[ t * 3 + k ] = ( ab <= ba ) ? Collapse{ a, b, ab } : Collapse{ b, a, ba };
+                }
+            }
+        } );
+
+        // costs are positive so their bits sort like the floats
+        order.clear();
+        for ( size_t i = 0; i < currentCount; ++i )
+        {
+            if ( collapses[i].cost <= errorLimit )
+            {
+                uint32_t bits;
+                memcpy( &bits, &collapses[i].cost, sizeof( bits ) );
+                order.push_back( ( (uint64_t)bits << 32 ) | i );
+            }
+        }
+        std::sort( order.begin(), order.end() );
+
+        for ( size_t v = 0; v < vertexCount; ++v )
+        {
+            remap[v] = (uint32_t)v;
+        }
+        std::fill( touched.begin(), touched.end(), 0 );
+
+        size_t removed = 0;
+        size_t collapseCount = 0;
+        for ( uint64_t key : order )
+        {
+            const Collapse& c = collapses[ (uint32_t)key ];
+            if ( touched[ c.source ] || touched[ c.target ] )
+            {
+                continue;
+            }
+
+            // no triangle around the source may flip or collapse to a sliver facing the other way
+            bool flips = false;
+            size_t dying = 0;
+            for ( uint32_t j = offsets[ c.source ]; j < offsets[ c.source + 1 ] && !flips; ++j )
+            {
+                const uint32_t t = adjacency[j];
+                uint32_t v[3] = { remap[ pDestination[ t * 3 ] ], remap[ pDestination[ t * 3 + 1 ] ], remap[ pDestination[ t * 3 + 2 ] ] };
+                if ( v[0] == v[1] || v[1] == v[2] || v[2] == v[0] )
+                {
+                    continue;
+                }
+                if ( v[0] == c.target || v[1] == c.target || v[2] == c.target )
+                {
+                    ++dying;
+                    continue;
+                }
+                const Float3 before = cross( sub( positions[ v[1] ], positions[ v[0] ] ), sub( positions[ v[2] ], positions[ v[0] ] ) );
+                for ( int k = 0; k < 3; ++k )
+                {
+                    v[k] = ( v[k] == c.source ) ? c.target : v[k];
+                }
+                const Float3 after = cross( sub( positions[ v[1] ], positions[ v[0] ] ), sub( positions[ v[2] ], positions[ v[0] ] ) );
+                flips = dot( before, after ) < kMinFlipCos * sqrtf( dot( before, before ) * dot( after, after ) );
+            }
+            if ( flips )
+            {
+                continue;
+            }
+
+            remap[ c.source ] = c.target;
+            touched[ c.source ] = 1;
+            touched[ c.target ] = 1;
+            accumulate( quadrics[ c.target ], quadrics[ c.source ] );
+            maxError = std::max( maxError, c.cost );
+            removed += dying * 3;
+            ++collapseCount;
+            if ( currentCount - removed <= options.targetIndexCount )
+            {
+                break;
+            }
+        }
+        if ( collapseCount == 0 )
+        {
+            break;
+        }
+
+        // apply and drop the triangles that lost an edge
+        size_t write = 0;
+        for ( size_t t = 0; t < triangleCount; ++t )
+        {
+            const uint32_t a = remap[ pDestination[ t * 3 ] ];
+            const uint32_t b = remap[ pDestination[ t * 3 + 1 ] ];
+            const uint32_t c = remap[ pDestination[ t * 3 + 2 ] ];
+            if ( a != b && b != c && c != a )
+            {
+                pDestination[ write++ ] = a;
+                pDestination[ write++ ] = b;
+                pDestination[ write++ ] = c;
+            }
+        }
+        currentCount = write;
+    }
+
+    if ( pResultError )
+    {
+        *pResultError = sqrtf( maxError );
+    }
+    return currentCount;
+}
+
+}
@@ -0,0 +1,45 @@
+//
+//  Simplifier.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../Shaders/ShaderStructs.h"
+
+// Edge collapse simplification with quadric error metrics (Garland and Heckbert 1997).
+//
+// Every collapse moves one vertex onto a neighbour, so the output indexes the same vertex
+// buffer and keeps its normals and texcoords as they are. The cost of a collapse is the
+// area weighted quadric distance plus the weighted squared change in normal and texcoord the
+// triangles around the moved vertex see, so flat areas go first and attribute gradients last.
+//
+//   border vertices    only slide along the border, edges get a perpendicular plane quadric
+//   attribute seams    vertices split by normal or texcoord (same position, different vertex)
+//                      are locked, as are non manifold ones
+//
+// Work is done in passes: cost every edge (in parallel on the JobSystem), sort, then collapse
+// the cheapest that don't touch a vertex already moved this pass and don't flip a triangle.
+
+namespace Simplifier
+{
+    struct Options
+    {
+        size_t targetIndexCount = 0;
+        float targetError = 1e-2f;      // relative to the mesh extent, stop before going past it
+        float normalWeight = 0.05f;     // squared normal change counted as this much squared distance
+        float texcoordWeight = 0.05f;
+        bool lockBorder = false;
+    };
+
+    // Writes at most indexCount indices to pDestination and returns how many. pResultError gets
+    // the largest collapse error used, relative to the mesh extent - multiply by extent() for mesh units
+    size_t simplify( uint32_t* pDestination, const uint32_t* pIndices, size_t indexCount,
+                     const VertexData* pVertices, size_t vertexCount, const Options& options, float* pResultError = nullptr );
+
+    // Largest side of the bounding box of the referenced vertices
+    float extent( const uint32_t* pIndices, size_t indexCount, const VertexData* pVertices );
+}
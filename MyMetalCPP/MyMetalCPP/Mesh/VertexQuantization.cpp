@@ -0,0 +1,258 @@
+//
+//  VertexQuantization.cpp
+//  MyMetalCPP
+//
+
+#include "VertexQuantization.hpp"
+#include "../Jobs/JobSystem.hpp"
+#include "../Maths/VectorExt.hpp"
+#include "../Shaders/VertexQuantization.h"
+
+#include <algorithm>
+#include <cassert>
+#include <math.h>
+#include <mutex>
+
+using Maths::Float4;
+using Maths::Int4;
+using Maths::splat;
+
+static constexpr size_t kVerticesPerJob = 16384;    // multiple of 4, so only the last batch has a partial block
+static constexpr float kUnorm16Max = 65535.f;
+static constexpr float kSnorm16Max = 32767.f;
+
+static inline Int4 roundToInt( Float4 v )
+{
+    return __builtin_convertvector( v + Maths::select( v >= splat( 0.f ), splat( 0.5f ), splat( -0.5f ) ), Int4 );
+}
+
+static inline Float4 signNotZero( Float4 v )
+{
+    return Maths::select( v >= splat( 0.f ), splat( 1.f ), splat( -1.f ) );
+}
+
+// [0, 1] -> unorm16, clamped
+static inline Int4 toUnorm16( Float4 v )
+{
+    return __builtin_convertvector( Maths::clamp01( v ) * kUnorm16Max + 0.5f, Int4 );
+}
+
+static inline float inverseOrZero( float extent )
+{
+    return extent > 0.f ? 1.f / extent : 0.f;
+}
+
+namespace VertexQuantization
+{
+
+MeshQuantization computeQuantization( const VertexData* pVertices, size_t count )
+{
+    MeshQuantization quantization = {};
+    if ( count == 0 )
+    {
+        return quantization;
+    }
+
+    float lo[5] = { pVertices[0].position.x, pVertices[0].position.y, pVertices[0].position.z, pVertices[0].texcoord.x, pVertices[0].texcoord.y };
+    float hi[5] = { lo[0], lo[1], lo[2], lo[3], lo[4] };
+    for ( size_t i = 1; i < count; ++i )
+    {
+        const VertexData& v = pVertices[i];
+        const float values[5] = { v.position.x, v.position.y, v.position.z, v.texcoord.x, v.texcoord.y };
+        for ( int k = 0; k < 5; ++k )
+        {
+            lo[k] = std::min( lo[k], values[k] );
+            hi[k] = std::max( hi[k], values[k] );
+        }
+    }
+
+    quantization.positionOffset = { lo[0], lo[1], lo[2] };
+    quantization.positionScale = { ( hi[0] - lo[0] ) / kUnorm16Max, ( hi[1] - lo[1] ) / kUnorm16Max, ( hi[2] - lo[2] ) / kUnorm16Max };
+    quantization.texcoordOffset = { lo[3], lo[4] };
+    quantization.texcoordScale = { ( hi[3] - lo[3] ) / kUnorm16Max, ( hi[4] - lo[4] ) / kUnorm16Max };
+    return quantization;
+}
+
+void encode( QuantizedVertexData* pDestination, const VertexData* pVertices, size_t count, const MeshQuantization& q )
+{
+    const Float4 offset[5] = { splat( q.positionOffset.x ), splat( q.positionOffset.y ), splat( q.positionOffset.z ),
+                               splat( q.texcoordOffset.x ), splat( q.texcoordOffset.y ) };
+    const Float4 invExtent[5] = { splat( inverseOrZero( q.positionScale.x * kUnorm16Max ) ),
+                                  splat( inverseOrZero( q.positionScale.y * kUnorm16Max ) ),
+                                  splat( inverseOrZero( q.positionScale.z * kUnorm16Max ) ),
+                                  splat( inverseOrZero( q.texcoordScale.x * kUnorm16Max ) ),
+                                  splat( inverseOrZero( q.texcoordScale.y * kUnorm16Max ) ) };
+
+    JobSystem::Instance()->parallelFor( count, kVerticesPerJob, [&]( size_t begin, size_t end )
+    {
+        for ( size_t base = begin; base < end; base += 4 )
+        {
+            // gather 4 vertices into lanes, a partial block repeats its last vertex
+            const size_t valid = std::min<size_t>( 4, end - base );
+            Float4 attribute[5];
+            Float4 nx, ny, nz;
+            for ( size_t k = 0; k < 4; ++k )
+            {
+                const VertexData& v = pVertices[ base + std::min( k, valid - 1 ) ];
+                attribute[0][k] = v.position.x;
+                attribute[1][k] = v.position.y;
+                attribute[2][k] = v.position.z;
+                attribute[3][k] = v.texcoord.x;
+                attribute[4][k] = v.texcoord.y;
+                nx[k] = v.normal.x;
+                ny[k] = v.normal.y;
+                nz[k] = v.normal.z;
+            }
+
+            Int4 unorm[5];
+            for ( int a = 0; a < 5; ++a )
+            {
+                unorm[a] = toUnorm16( ( attribute[a] - offset[a] ) * invExtent[a] );
+            }
+
+            // onto the octahedron, then fold the lower half out over the diagonals
+            const Float4 l1 = Maths::abs( nx ) + Maths::abs( ny ) + Maths::abs( nz );
+            const Float4 invL1 = Maths::select( l1 > splat( 0.f ), 1.f / l1, splat( 0.f ) );
+            Float4 ox = nx * invL1;
+            Float4 oy = ny * invL1;
+            const Int4 lower = nz < splat( 0.f );
+            const Float4 fx = ( 1.f - Maths::abs( oy ) ) * signNotZero( ox );
+            const Float4 fy = ( 1.f - Maths::abs( ox ) ) * signNotZero( oy );
+            ox = Maths::select( lower, fx, ox );
+            oy = Maths::select( lower, fy, oy );
+            const Int4 octahedral = ( roundToInt( ox * kSnorm16Max ) & 0xffff ) | ( roundToInt( oy * kSnorm16Max ) << 16 );
+
+            for ( size_t k = 0; k < valid; ++k )
+            {
+                QuantizedVertexData& out = pDestination[ base + k ];
+                out.position[0] = (uint16_t)unorm[0][k];
+                out.position[1] = (uint16_t)unorm[1][k];
+                out.position[2] = (uint16_t)unorm[2][k];
+                out.position[3] = 0;
+                out.normal = (uint32_t)octahedral[k];
+                out.texcoord[0] = (uint16_t)unorm[3][k];
+                out.texcoord[1] = (uint16_t)unorm[4][k];
+            }
+        }
+    } );
+}
+
+void decode( VertexData* pDestination, const QuantizedVertexData* pVertices, size_t count, const MeshQuantization& q )
+{
+    const Float4 offset[5] = { splat( q.positionOffset.x ), splat( q.positionOffset.y ), splat( q.positionOffset.z ),
+                               splat( q.texcoordOffset.x ), splat( q.texcoordOffset.y ) };
+    const Float4 scale[5] = { splat( q.positionScale.x ), splat( q.positionScale.y ), splat( q.positionScale.z ),
+                              splat( q.texcoordScale.x ), splat( q.texcoordScale.y ) };
+
+    JobSystem::Instance()->parallelFor( count, kVerticesPerJob, [&]( size_t begin, size_t end )
+    {
+        for ( size_t base = begin; base < end; base += 4 )
+        {
+            const size_t valid = std::min<size_t>( 4, end - base );
+            Int4 unorm[5];
+            Int4 octahedral;
+            for ( size_t k = 0; k < 4; ++k )
+            {
+                const QuantizedVertexData& v = pVertices[ base + std::min( k, valid - 1 ) ];
+                unorm[0][k] = v.position[0];
+                unorm[1][k] = v.position[1];
+                unorm[2][k] = v.position[2];
+                unorm[3][k] = v.texcoord[0];
+                unorm[4][k] = v.texcoord[1];
+                octahedral[k] = (int32_t)v.normal;
+            }
+
+            Float4 attribute[5];
+            for ( int a = 0; a < 5; ++a )
+            {
+                attribute[a] = offset[a] + __builtin_convertvector( unorm[a], Float4 ) * scale[a];
+            }
+
+            // same steps as decodeOctahedral, sign extending shifts pull out the two snorm16s
+            const Float4 minusOne = splat( -1.f );
+            Float4 nx = __builtin_convertvector( ( octahedral << 16 ) >> 16, Float4 ) * ( 1.f / kSnorm16Max );
+            Float4 ny = __builtin_convertvector( octahedral >> 16, Float4 ) * ( 1.f / kSnorm16Max );
+            nx = Maths::select( nx > minusOne, nx, minusOne );
+            ny = Maths::select( ny > minusOne, ny, minusOne );
+            Float4 nz = 1.f - Maths::abs( nx ) - Maths::abs( ny );
+            const Float4 t = Maths::clamp01( -nz );
+            nx += Maths::select( nx >= splat( 0.f ), -t, t );
+            ny += Maths::select( ny >= splat( 0.f ), -t, t );
+            const Float4 lengthSq = nx * nx + ny * ny + nz * nz;
+            const Float4 invLength = 1.f / Float4{ sqrtf( lengthSq[0] ), sqrtf( lengthSq[1] ), sqrtf( lengthSq[2] ), sqrtf( lengthSq[3] ) };
+            nx *= invLength;
+            ny *= invLength;
+            nz *= invLength;
+
+            for ( size_t k = 0; k < valid; ++k )
+            {
+                VertexData& out = pDestination[ base + k ];
+                out.position = { attribute[0][k], attribute[1][k], attribute[2][k] };
+                out.normal = { nx[k], ny[k], nz[k] };
+                out.texcoord = { attribute[3][k], attribute[4][k] };
+            }
+        }
+    } );
+}
+
+ErrorReport measureError( const VertexData* pOriginal, const QuantizedVertexData* pQuantized, size_t count, const MeshQuantization& q )
+{
+    ErrorReport report = {};
+    report.bytesBefore = count * sizeof( VertexData );
+    report.bytesAfter = count * sizeof( QuantizedVertexData );
+    double positionSum = 0.0;
+    double normalSum = 0.0;
+    std::mutex mutex;
+
+    const float3 positionOffset = q.positionOffset;
+    const float3 positionScale = q.positionScale;
+    const float2 texcoordOffset = q.texcoordOffset;
+    const float2 texcoordScale = q.texcoordScale;
+
+    JobSystem::Instance()->parallelFor( count, kVerticesPerJob, [&]( size_t begin, size_t end )
+    {
+        float maxPosition = 0.f;
+        float maxNormal = 0.f;
+        float maxTexcoord = 0.f;
+        double sumPosition = 0.0;
+        double sumNormal = 0.0;
+        for ( size_t i = begin; i < end; ++i )
+        {
+            const VertexData& original = pOriginal[i];
+            const QuantizedVertexData& v = pQuantized[i];
+
+            const float3 position = dequantizePosition( v.position[0], v.position[1], v.position[2], positionOffset, positionScale );
+            const float3 delta = position - float3( original.position );
+            const float positionError = length( delta );
+            maxPosition = std::max( maxPosition, positionError );
+            sumPosition += positionError;
+
+            const float3 normal = decodeOctahedral( v.normal );
+            const float cosAngle = dot( normal, normalize( float3( original.normal ) ) );
+            const float degrees = acosf( std::min( 1.f, std::max( -1.f, cosAngle ) ) ) * ( 180.f / (float)M_PI );
+            maxNormal = std::max( maxNormal, degrees );
+            sumNormal += degrees;
+
+            const float2 texcoord = dequantizeTexcoord( v.texcoord[0], v.texcoord[1], texcoordOffset, texcoordScale );
+            maxTexcoord = std::max( { maxTexcoord, fabsf( texcoord.x - original.texcoord.x ), fabsf( texcoord.y - original.texcoord.y ) } );
+        }
+
+        std::lock_guard<std::mutex> lock( mutex );
+        report.maxPositionError = std::max( report.maxPositionError, maxPosition );
+        report.maxNormalErrorDegrees = std::max( report.maxNormalErrorDegrees, maxNormal );
+        report.maxTexcoordError = std::max( report.maxTexcoordError, maxTexcoord );
+        positionSum += sumPosition;
+        normalSum += sumNormal;
+    } );
+
+    if ( count > 0 )
+    {
+        report.meanPositionError = (float)( positionSum / count );
+        report.meanNormalErrorDegrees = (float)( normalSum / count );
+        const float extent = std::max( { positionScale.x, positionScale.y, positionScale.z } ) * kUnorm16Max;
+        report.relativePositionError = extent > 0.f ? report.maxPositionError / extent : 0.f;
+    }
+    return report;
+}
+
+}
@@ -0,0 +1,44 @@
+//
+//  VertexQuantization.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "../Shaders/ShaderStructs.h"
+
+// VertexData (48 bytes) <-> QuantizedVertexData (16 bytes)
+//
+//   position   unorm16 per axis over the mesh bounds - error is at most half a step, extent / 131070
+//   normal     octahedral, two snorm16 in 32 bits - a few hundredths of a degree at worst
+//   texcoord   unorm16 over the mesh texcoord bounds, so tiling UVs outside [0, 1] still work
+//
+// encode and decode run 4 vertices at a time in Maths::Float4 lanes, in batches over the
+// JobSystem. vertexMainQuantized in Shaders/MyShaderStages.h is the GPU decoder.
+
+namespace VertexQuantization
+{
+    struct ErrorReport
+    {
+        float maxPositionError;         // mesh units
+        float meanPositionError;
+        float relativePositionError;    // max / largest bounds extent
+        float maxNormalErrorDegrees;
+        float meanNormalErrorDegrees;
+        float maxTexcoordError;
+        size_t bytesBefore;
+        size_t bytesAfter;
+    };
+
+    MeshQuantization computeQuantization( const VertexData* pVertices, size_t count );
+
+    void encode( QuantizedVertexData* pDestination, const VertexData* pVertices, size_t count, const MeshQuantization& quantization );
+    void decode( VertexData* pDestination, const QuantizedVertexData* pVertices, size_t count, const MeshQuantization& quantization );
+
+    // Compares against the shader decoder in Shaders/VertexQuantization.h
+    ErrorReport measureError( const VertexData* pOriginal, const QuantizedVertexData* pQuantized, size_t count,
+                              const MeshQuantization& quantization );
+}
@@ -0,0 +1,246 @@
+//
+//  Lz4.cpp
+//  MyMetalCPP
+//
+
+#include "Lz4.hpp"
+
+#include <cstring>
+
+static constexpr size_t kMinMatch = 4;
+static constexpr size_t kLastLiterals = 5;          // the block ends with at least this many literals
+static constexpr size_t kMatchStartLimit = 12;      // and no match starts in its last 12 bytes
+static constexpr size_t kMaxOffset = 65535;
+static constexpr uint32_t kHashBits = 14;
+
+static uint32_t read32( const uint8_t* p )
+{
+    uint32_t value;
+    memcpy( &value, p, sizeof( value ) );
+    return value;
+}
+
+static uint64_t read64( const uint8_t* p )
+{
+    uint64_t value;
+    memcpy( &value, p, sizeof( value ) );
+    return value;
+}
+
+static uint32_t hashOf( uint32_t sequence )
+{
+    return ( sequence * 2654435761u ) >> ( 32 - kHashBits );
+}
+
+// The bytes after a nibble of 15
+static uint8_t* writeLength( uint8_t* pOut, size_t length )
+{
+    for ( ; length >= 255; length -= 255 )
+    {
+        *pOut++ = 255;
+    }
+    *pOut++ = (uint8_t)length;
+    return pOut;
+}
+
+static bool readLength( const uint8_t*& pIn, const uint8_t* pEnd, size_t limit, size_t& length )
+{
+    uint8_t byte = 255;
+    while ( byte == 255 )
+    {
+        if ( pIn == pEnd || length > limit )
+        {
+            return false;
+        }
+        byte = *pIn++;
+        length += byte;
+    }
+    return true;
+}
+
+// Literals, then the match unless matchLength is 0 for the last sequence. False if it won't fit
+static bool writeSequence( uint8_t*& pOut, const uint8_t* pEnd, const uint8_t* pLiterals, size_t literalCount, size_t offset, size_t matchLength )
+{
+    const size_t worstCase = 1 + literalCount / 255 + 1 + literalCount + 2 + matchLength / 255 + 1;
+    if ( (size_t)( pEnd - pOut ) < worstCase )
+    {
+        return false;
+    }
+    uint8_t* pToken = pOut++;
+    uint8_t token = (uint8_t)( ( literalCount >= 15 ? 15 : literalCount ) << 4 );
+    if ( literalCount >= 15 )
+    {
+        pOut = writeLength( pOut, literalCount - 15 );
+    }
+    memcpy( pOut, pLiterals, literalCount );
+    pOut += literalCount;
+    if ( matchLength > 0 )
+    {
+        *pOut++ = (uint8_t)offset;
+        *pOut++ = (uint8_t)( offset >> 8 );
+        const size_t length = matchLength - kMinMatch;
+        token |= (uint8_t)( length >= 15 ? 15 : length );
+        if ( length >= 15 )
+        {
+            pOut = writeLength( pOut, length - 15 );
+        }
+    }
+    *pToken = token;
+    return true;
+}
+
+namespace Lz4
+{
+    size_t compressBound( size_t size )
+    {
+        return size + size / 255 + 16;
+    }
+
+    size_t compress( const uint8_t* pSrc, size_t srcSize, uint8_t* pDst, size_t dstCapacity )
+    {
+        uint8_t* pOut = pDst;
+        const uint8_t* pEnd = pDst + dstCapacity;
+        size_t anchor = 0;
+        if ( srcSize > kMatchStartLimit )
+        {
+            // positions by hash of the 4 bytes there - stale or colliding ones fail the compare
+            uint32_t table[ 1 << kHashBits ];
+            memset( table, 0, sizeof( table ) );
+            const size_t matchEnd = srcSize - kLastLiterals;
+            const size_t searchEnd = srcSize - kMatchStartLimit;
+            size_t ip = 0;
+            while ( ip < searchEnd )
+            {
+                const uint32_t sequence = read32( pSrc + ip );
+                const uint32_t hash = hashOf( sequence );
+                const size_t ref = table[ hash ];
+                table[ hash ] = (uint32_t)ip;
+                if ( ref >= ip || ip - ref > kMaxOffset || read32( pSrc + ref ) != sequence )
+                {
+                    // the longer since the last match, the bigger the step
+                    ip += 1 + ( ( ip - anchor ) >> 6 );
+                    continue;
+                }
+
+                // back over literals that match too, then forward 8 bytes at a time
+                size_t start = ip, from = ref;
+                while ( start > anchor && from > 0 && pSrc[ start - 1 ] == pSrc[ from - 1 ] )
+                {
+                    --start;
+                    --from;
+                }
+                size_t end = ip + kMinMatch;
+                size_t r = ref + kMinMatch;
+                while ( end + 8 <= matchEnd )
+                {
+                    const uint64_t difference = read64( pSrc + end ) ^ read64( pSrc + r );
+                    if ( difference )
+                    {
+                        end += (size_t)__builtin_ctzll( difference ) >> 3;
+                        break;
+                    }
+                    end += 8;
+                    r += 8;
+                }
+                if ( end + 8 > matchEnd )
+                {
+                    while ( end < matchEnd && pSrc[ end ] == pSrc[ end - ( ip - ref ) ] )
+                    {
+                        ++end;
+                    }
+                }
+
+                if ( !writeSequence( pOut, pEnd, pSrc + anchor, start - anchor, ip - ref, end - start ) )
+                {
+                    return 0;
+                }
+                table[ hashOf( read32( pSrc + end - 2 ) ) ] = (uint32_t)( end - 2 );
+                anchor = ip = end;
+            }
+        }
+        if ( !writeSequence( pOut, pEnd, pSrc + anchor, srcSize - anchor, 0, 0 ) )
+        {
+            return 0;
+        }
+        return (size_t)( pOut - pDst );
+    }
+
+    bool decompress( const uint8_t* pSrc, size_t srcSize, uint8_t* pDst, size_t dstSize )
+    {
+        const uint8_t* pIn = pSrc;
+        const uint8_t* pInEnd = pSrc + srcSize;
+        uint8_t* pOut = pDst;
+        uint8_t* pOutEnd = pDst + dstSize;
+        while ( pIn < pInEnd )
+        {
+            const uint8_t token = *pIn++;
+            size_t literals = token >> 4;
+            if ( literals == 15 && !readLength( pIn, pInEnd, dstSize, literals ) )
+            {
+                return false;
+            }
+            if ( (size_t)( pInEnd - pIn ) < literals || (size_t)( pOutEnd - pOut ) < literals )
+            {
+                return false;
+            }
+            // short runs as one 16 byte copy where both sides have room for it
+            if ( literals <= 16 && pInEnd - pIn >= 16 && pOutEnd - pOut >= 16 )
+            {
+                memcpy( pOut, pIn, 16 );
+            }
+            else
+            {
+                memcpy( pOut, pIn, literals );
+            }
+            pIn += literals;
+            pOut += literals;
+            if ( pIn == pInEnd )
+            {
+                break;
+            }
+
+            if ( pInEnd - pIn < 2 )
+            {
+                return false;
+            }
+            const size_t offset = (size_t)pIn[0] | (size_t)pIn[1] << 8;
+            pIn += 2;
+            size_t length = token & 15;
+            if ( length == 15 && !readLength( pIn, pInEnd, dstSize, length ) )
+            {
+                return false;
+            }
+            length += kMinMatch;
+            if ( offset == 0 || offset > (size_t)( pOut - pDst ) || (size_t)( pOutEnd - pOut ) < length )
+            {
+                return false;
+            }
+            // 16 or 8 bytes at a time when the match is at least that far back, writing past the
+            // end of the match where there's room since the next sequence overwrites it
+            const uint8_t* pMatch = pOut - offset;
+            if ( offset >= 16 && (size_t)( pOutEnd - pOut ) >= length + 16 )
+            {
+                for ( size_t i = 0; i < length; i += 16 )
+                {
+                    memcpy( pOut + i, pMatch + i, 16 );
+                }
+            }
+            else if ( offset >= 8 && (size_t)( pOutEnd - pOut ) >= length + 8 )
+            {
+                for ( size_t i = 0; i < length; i += 8 )
+                {
+                    memcpy( pOut + i, pMatch + i, 8 );
+                }
+            }
+            else
+            {
+                for ( size_t i = 0; i < length; ++i )
+                {
+                    pOut[i] = pMatch[i];
+                }
+            }
+            pOut += length;
+        }
+        return pOut == pOutEnd && pIn == pInEnd;
+    }
+}
@@ -0,0 +1,33 @@
+//
+//  Lz4.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// LZ4 block format - no frame, no checksum, the sizes are kept by whoever stores the block.
+//
+// A block is a run of sequences: a token byte (literal count in the high nibble, match length
+// minus 4 in the low, 15 meaning more bytes follow, each adding up to 255), the literals, then
+// a 2 byte little endian offset back into the output and the match. The last sequence is
+// literals only, and the last 5 bytes are always literals.
+//
+// compress() is the greedy single-probe matcher: one hash table of recent positions, matches
+// extended 8 bytes at a time, and a step that grows over incompressible data so it isn't
+// slower than a copy there. decompress() checks every length and offset against both buffers,
+// so a corrupt block fails rather than reading or writing outside them.
+
+namespace Lz4
+{
+    // Worst case compressed size
+    size_t compressBound( size_t size );
+
+    // The compressed size, 0 if it doesn't fit in dstCapacity
+    size_t compress( const uint8_t* pSrc, size_t srcSize, uint8_t* pDst, size_t dstCapacity );
+
+    // False unless the block decodes to exactly dstSize bytes
+    bool decompress( const uint8_t* pSrc, size_t srcSize, uint8_t* pDst, size_t dstSize );
+}
@@ -0,0 +1,526 @@
+//
+//  PackFile.cpp
+//  MyMetalCPP
+//
+
+#include "PackFile.hpp"
+#include "Lz4.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef MM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using PackFormat::ChunkRecord;
+using PackFormat::Codec;
+using PackFormat::EntryRecord;
+using PackFormat::Header;
+
+static_assert( sizeof( Header ) == 72, "pack header is 72 bytes" );
+static_assert( sizeof( EntryRecord ) == 32, "pack entries are 32 bytes" );
+static_assert( sizeof( ChunkRecord ) == 24, "pack chunks are 24 bytes" );
+
+static size_t alignUp( size_t value, size_t alignment )
+{
+    return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+namespace PackFormat
+{
+    uint64_t hashPath( const char* path, size_t length )
+    {
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for ( size_t i = 0; i < length; ++i )
+        {
+            hash = ( hash ^ (uint8_t)path[i] ) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    bool supports( Codec codec )
+    {
+        switch ( codec )
+        {
+            case Codec::None:
+            case Codec::Lz4:
+            case Codec::Zlib:
+                return true;
+            case Codec::Zstd:
+#ifdef MM_HAVE_ZSTD
+                return true;
+#else
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    const char* codecName( Codec codec )
+    {
+        switch ( codec )
+        {
+            case Codec::None: return "none";
+            case Codec::Lz4: return "lz4";
+            case Codec::Zlib: return "zlib";
+            case Codec::Zstd: return "zstd";
+        }
+        return "unknown";
+    }
+}
+
+// One chunk into exactly dstSize bytes
+static bool decompressChunk( Codec codec, const uint8_t* pSrc, size_t srcSize, uint8_t* pDst, size_t dstSize )
+{
+    switch ( codec )
+    {
+        case Codec::None:
+            memcpy( pDst, pSrc, dstSize );
+            return srcSize == dstSize;
+        case Codec::Lz4:
+            return Lz4::decompress( pSrc, srcSize, pDst, dstSize );
+        case Codec::Zlib:
+        {
+            uLongf size = (uLongf)dstSize;
+            return uncompress( pDst, &size, pSrc, (uLong)srcSize ) == Z_OK && size == dstSize;
+        }
+        case Codec::Zstd:
+#ifdef MM_HAVE_ZSTD
+        {
+            const size_t size = ZSTD_decompress( pDst, dstSize, pSrc, srcSize );
+            return !ZSTD_isError( size ) && size == dstSize;
+        }
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+// Empty when it fails
+static void compressChunk( Codec codec, int compressionLevel, const uint8_t* pSrc, size_t srcSize, std::vector<uint8_t>& dst )
+{
+    if ( codec == Codec::Lz4 )
+    {
+        dst.resize( Lz4::compressBound( srcSize ) );
+        dst.resize( Lz4::compress( pSrc, srcSize, dst.data(), dst.size() ) );
+    }
+    else if ( codec == Codec::Zlib )
+    {
+        uLongf size = compressBound( (uLong)srcSize );
+        dst.resize( size );
+        const bool ok = compress2( dst.data(), &size, pSrc, (uLong)srcSize, compressionLevel ? compressionLevel : Z_DEFAULT_COMPRESSION ) == Z_OK;
+        dst.resize( ok ? size : 0 );
+    }
+#ifdef MM_HAVE_ZSTD
+    else if ( codec == Codec::Zstd )
+    {
+        dst.resize( ZSTD_compressBound( srcSize ) );
+        const size_t size = ZSTD_compress( dst.data(), dst.size(), pSrc, srcSize, compressionLevel );
+        dst.resize( ZSTD_isError( size ) ? 0 : size );
+    }
+#endif
+}
+
+PackFile::PackFile()
+: _pData( nullptr )
+, _size( 0 )
+, _mappedSize( 0 )
+, _header{}
+, _pEntries( nullptr )
+, _pChunks( nullptr )
+, _pSlots( nullptr )
+, _pNames( nullptr )
+{
+}
+
+PackFile::~PackFile()
+{
+    close();
+}
+
+bool PackFile::fail( const char* reason )
+{
+    __builtin_printf( "PackFile: %s\n", reason );
+    close();
+    return false;
+}
+
+void PackFile::close()
+{
+    if ( _pData )
+    {
+        munmap( _pData, _mappedSize );
+    }
+    _pData = nullptr;
+    _size = _mappedSize = 0;
+    _header = {};
+    _pEntries = nullptr;
+    _pChunks = nullptr;
+    _pSlots = nullptr;
+    _pNames = nullptr;
+}
+
+bool PackFile::open( const char* path )
+{
+    close();
+
+    const int fd = ::open( path, O_RDONLY );
+    if ( fd < 0 )
+    {
+        __builtin_printf( "PackFile: can't open %s\n", path );
+        return false;
+    }
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 || (size_t)info.st_size < sizeof( Header ) )
+    {
+        ::close( fd );
+        return fail( "too small for the header" );
+    }
+    _size = (size_t)info.st_size;
+    _mappedSize = alignUp( _size, (size_t)sysconf( _SC_PAGESIZE ) );
+    void* pMapping = mmap( nullptr, _mappedSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+    if ( pMapping == MAP_FAILED )
+    {
+        _size = _mappedSize = 0;
+        return fail( "mmap failed" );
+    }
+    _pData = reinterpret_cast<uint8_t*>( pMapping );
+
+    memcpy( &_header, _pData, sizeof( _header ) );
+    if ( _header.magic != PackFormat::kMagic )
+    {
+        return fail( "not a pack file" );
+    }
+    if ( _header.version != PackFormat::kVersion )
+    {
+        return fail( "unsupported version" );
+    }
+    if ( _header.fileSize != _size )
+    {
+        return fail( "file size doesn't match the header" );
+    }
+    if ( _header.chunkSize == 0 || _header.slotCount == 0 || ( _header.slotCount & ( _header.slotCount - 1 ) ) != 0 ||
+         _header.slotCount < 2 * (uint64_t)_header.entryCount )
+    {
+        return fail( "bad chunk size or slot count" );
+    }
+    auto inFile = [&]( uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t alignment )
+    {
+        return offset >= sizeof( Header ) && offset <= _size && offset % alignment == 0 && count <= ( _size - offset ) / elementSize;
+    };
+    if ( !inFile( _header.entriesOffset, _header.entryCount, sizeof( EntryRecord ), 8 ) ||
+         !inFile( _header.chunksOffset, _header.chunkCount, sizeof( ChunkRecord ), 8 ) ||
+         !inFile( _header.slotsOffset, _header.slotCount, sizeof( uint32_t ), 4 ) || !inFile( _header.namesOffset, _header.namesSize, 1, 1 ) )
+    {
+        return fail( "table outside the file or misaligned" );
+    }
+    _pEntries = reinterpret_cast<const EntryRecord*>( _pData + _header.entriesOffset );
+    _pChunks = reinterpret_cast<const ChunkRecord*>( _pData + _header.chunksOffset );
+    _pSlots = reinterpret_cast<const uint32_t*>( _pData + _header.slotsOffset );
+    _pNames = reinterpret_cast<const char*>( _pData + _header.namesOffset );
+
+    for ( uint32_t e = 0; e < _header.entryCount; ++e )
+    {
+        const EntryRecord& entry = _pEntries[e];
+        if ( (uint64_t)entry.nameOffset + entry.nameLength > _header.namesSize ||
+             entry.pathHash != PackFormat::hashPath( _pNames + entry.nameOffset, entry.nameLength ) )
+        {
+            return fail( "bad entry name" );
+        }
+        if ( (uint64_t)entry.firstChunk + entry.chunkCount > _header.chunkCount ||
+             entry.chunkCount != ( entry.size + _header.chunkSize - 1 ) / _header.chunkSize )
+        {
+            return fail( "entry chunks don't match its size" );
+        }
+        uint64_t remaining = entry.size;
+        for ( uint32_t c = entry.firstChunk; c < entry.firstChunk + entry.chunkCount; ++c )
+        {
+            const ChunkRecord& chunk = _pChunks[c];
+            if ( chunk.size != std::min<uint64_t>( remaining, _header.chunkSize ) || !inFile( chunk.offset, chunk.storedSize, 1, 1 ) )
+            {
+                return fail( "chunk outside the file or the wrong size" );
+            }
+            if ( !PackFormat::supports( (Codec)chunk.codec ) )
+            {
+                return fail( chunk.codec == (uint8_t)Codec::Zstd ? "zstd chunks need a build with MM_HAVE_ZSTD" : "unsupported codec" );
+            }
+            if ( chunk.codec == (uint8_t)Codec::None && chunk.storedSize != chunk.size )
+            {
+                return fail( "uncompressed chunk of the wrong size" );
+            }
+            remaining -= chunk.size;
+        }
+    }
+    // every entry in one slot, so probes always reach an empty one
+    uint32_t used = 0;
+    for ( uint32_t s = 0; s < _header.slotCount; ++s )
+    {
+        if ( _pSlots[s] > _header.entryCount )
+        {
+            return fail( "hash slot past the entries" );
+        }
+        used += _pSlots[s] != 0 ? 1 : 0;
+    }
+    if ( used != _header.entryCount )
+    {
+        return fail( "hash slots don't match the entries" );
+    }
+    return true;
+}
+
+PackFile::Entry PackFile::find( const char* path ) const
+{
+    const size_t length = strlen( path );
+    const uint64_t hash = PackFormat::hashPath( path, length );
+    const uint32_t mask = _header.slotCount - 1;
+    // at most half full, so an empty slot ends every probe
+    for ( uint32_t s = (uint32_t)hash & mask;; s = ( s + 1 ) & mask )
+    {
+        const uint32_t slot = _pSlots[s];
+        if ( slot == 0 )
+        {
+            return kInvalidEntry;
+        }
+        const EntryRecord& entry = _pEntries[ slot - 1 ];
+        if ( entry.pathHash == hash && entry.nameLength == length && memcmp( _pNames + entry.nameOffset, path, length ) == 0 )
+        {
+            return slot - 1;
+        }
+    }
+}
+
+std::string PackFile::path( Entry entry ) const
+{
+    return std::string( _pNames + _pEntries[ entry ].nameOffset, _pEntries[ entry ].nameLength );
+}
+
+uint64_t PackFile::storedSize( Entry entry ) const
+{
+    uint64_t size = 0;
+    for ( uint32_t c = 0; c < _pEntries[ entry ].chunkCount; ++c )
+    {
+        size += _pChunks[ _pEntries[ entry ].firstChunk + c ].storedSize;
+    }
+    return size;
+}
+
+const uint8_t* PackFile::mapped( Entry entry ) const
+{
+    const EntryRecord& record = _pEntries[ entry ];
+    if ( record.chunkCount == 0 )
+    {
+        return _pData;
+    }
+    const ChunkRecord* pChunks = _pChunks + record.firstChunk;
+    for ( uint32_t c = 0; c < record.chunkCount; ++c )
+    {
+        if ( pChunks[c].codec != (uint8_t)Codec::None || pChunks[c].offset != pChunks[0].offset + (uint64_t)c * _header.chunkSize )
+        {
+            return nullptr;
+        }
+    }
+    return _pData + pChunks[0].offset;
+}
+
+bool PackFile::read( const Entry* pEntries, uint8_t* const* ppDest, size_t count ) const
+{
+    struct Job
+    {
+        uint32_t chunk;
+        uint8_t* pDest;
+    };
+    std::vector<Job> jobs;
+    uint64_t bytes = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        const EntryRecord& entry = _pEntries[ pEntries[i] ];
+        for ( uint32_t c = 0; c < entry.chunkCount; ++c )
+        {
+            jobs.push_back( { entry.firstChunk + c, ppDest[i] + (uint64_t)c * _header.chunkSize } );
+        }
+        bytes += entry.size;
+    }
+
+    // small entries several chunks to a job, so a job is about a full chunk's work
+    const size_t grain = std::max<size_t>( 1, (size_t)( (uint64_t)_header.chunkSize * jobs.size() / std::max<uint64_t>( bytes, 1 ) ) );
+    std::atomic<bool> ok( true );
+    JobSystem::Instance()->parallelFor( jobs.size(), grain, [&]( size_t begin, size_t end )
+    {
+        for ( size_t j = begin; j < end; ++j )
+        {
+            const ChunkRecord& chunk = _pChunks[ jobs[j].chunk ];
+            if ( !decompressChunk( (Codec)chunk.codec, _pData + chunk.offset, chunk.storedSize, jobs[j].pDest, chunk.size ) )
+            {
+                ok = false;
+            }
+        }
+    } );
+    if ( !ok )
+    {
+        __builtin_printf( "PackFile: a chunk doesn't decompress to its size\n" );
+    }
+    return ok;
+}
+
+PackWriter::PackWriter( uint32_t chunkSize )
+: _chunkSize( chunkSize )
+{
+    assert( chunkSize > 0 );
+}
+
+bool PackWriter::add( const std::string& path, const uint8_t* pData, size_t size, Codec codec )
+{
+    if ( !_paths.insert( path ).second )
+    {
+        return false;
+    }
+    _entries.push_back( { path, PackFormat::hashPath( path.data(), path.size() ), std::vector<uint8_t>( pData, pData + size ), codec } );
+    return true;
+}
+
+bool PackWriter::write( const char* path, int compressionLevel ) const
+{
+    for ( const Pending& entry : _entries )
+    {
+        if ( !PackFormat::supports( entry.codec ) )
+        {
+            __builtin_printf( "PackWriter: this build can't write %s chunks\n", PackFormat::codecName( entry.codec ) );
+            return false;
+        }
+    }
+
+    // every chunk compressed on its own, a chunk per job
+    std::vector<EntryRecord> entries( _entries.size() );
+    std::vector<ChunkRecord> chunks;
+    std::vector<const uint8_t*> chunkData;
+    uint64_t namesSize = 0;
+    for ( size_t e = 0; e < _entries.size(); ++e )
+    {
+        const Pending& pending = _entries[e];
+        EntryRecord& entry = entries[e];
+        entry.pathHash = pending.hash;
+        entry.nameOffset = (uint32_t)namesSize;
+        entry.nameLength = (uint32_t)pending.path.size();
+        entry.size = pending.data.size();
+        entry.firstChunk = (uint32_t)chunks.size();
+        entry.chunkCount = (uint32_t)( ( pending.data.size() + _chunkSize - 1 ) / _chunkSize );
+        for ( uint64_t offset = 0; offset < pending.data.size(); offset += _chunkSize )
+        {
+            ChunkRecord chunk = {};
+            chunk.size = (uint32_t)std::min<uint64_t>( _chunkSize, pending.data.size() - offset );
+            chunk.codec = (uint8_t)pending.codec;
+            chunks.push_back( chunk );
+            chunkData.push_back( pending.data.data() + offset );
+        }
+        namesSize += pending.path.size();
+    }
+    std::vector<std::vector<uint8_t>> compressed( chunks.size() );
+    JobSystem::Instance()->parallelFor( chunks.size(), 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t c = begin; c < end; ++c )
+        {
+            ChunkRecord& chunk = chunks[c];
+            if ( chunk.codec != (uint8_t)Codec::None )
+            {
+                compressChunk( (Codec)chunk.codec, compressionLevel, chunkData[c], chunk.size, compressed[c] );
+            }
+            // stored as it is unless it saves at least 1/32
+            if ( compressed[c].empty() || compressed[c].size() > chunk.size - chunk.size / 32 )
+            {
+                chunk.codec = (uint8_t)Codec::None;
+                std::vector<uint8_t>().swap( compressed[c] );
+            }
+            chunk.storedSize = chunk.codec == (uint8_t)Codec::None ? chunk.size : (uint32_t)compressed[c].size();
+        }
+    } );
+
+    // open addressing by path hash, at most half full
+    uint32_t slotCount = 2;
+    while ( slotCount < 2 * entries.size() )
+    {
+        slotCount *= 2;
+    }
+    std::vector<uint32_t> slots( slotCount, 0 );
+    for ( size_t e = 0; e < entries.size(); ++e )
+    {
+        uint32_t s = (uint32_t)entries[e].pathHash & ( slotCount - 1 );
+        while ( slots[s] != 0 )
+        {
+            s = ( s + 1 ) & ( slotCount - 1 );
+        }
+        slots[s] = (uint32_t)e + 1;
+    }
+
+    Header header = {};
+    header.magic = PackFormat::kMagic;
+    header.version = PackFormat::kVersion;
+    header.entryCount = (uint32_t)entries.size();
+    header.chunkCount = (uint32_t)chunks.size();
+    header.chunkSize = _chunkSize;
+    header.slotCount = slotCount;
+    header.entriesOffset = sizeof( Header );
+    header.chunksOffset = header.entriesOffset + entries.size() * sizeof( EntryRecord );
+    header.slotsOffset = header.chunksOffset + chunks.size() * sizeof( ChunkRecord );
+    header.namesOffset = header.slotsOffset + slots.size() * sizeof( uint32_t );
+    header.namesSize = namesSize;
+
+    // entries stored uncompressed start aligned so they can be used from the mapping
+    uint64_t offset = header.namesOffset + namesSize;
+    for ( const EntryRecord& entry : entries )
+    {
+        bool raw = true;
+        for ( uint32_t c = entry.firstChunk; c < entry.firstChunk + entry.chunkCount; ++c )
+        {
+            raw = raw && chunks[c].codec == (uint8_t)Codec::None;
+        }
+        offset = raw ? alignUp( offset, PackFormat::kRawAlignment ) : offset;
+        for ( uint32_t c = entry.firstChunk; c < entry.firstChunk + entry.chunkCount; ++c )
+        {
+            chunks[c].offset = offset;
+            offset += chunks[c].storedSize;
+        }
+    }
+    header.fileSize = offset;
+
+    FILE* pFile = fopen( path, "wb" );
+    if ( !pFile )
+    {
+        __builtin_printf( "PackWriter: can't create %s\n", path );
+        return false;
+    }
+    static const uint8_t kPadding[ PackFormat::kRawAlignment ] = {};
+    bool written = fwrite( &header, sizeof( header ), 1, pFile ) == 1;
+    written = written && fwrite( entries.data(), sizeof( EntryRecord ), entries.size(), pFile ) == entries.size();
+    written = written && fwrite( chunks.data(), sizeof( ChunkRecord ), chunks.size(), pFile ) == chunks.size();
+    written = written && fwrite( slots.data(), sizeof( uint32_t ), slots.size(), pFile ) == slots.size();
+    for ( size_t e = 0; written && e < _entries.size(); ++e )
+    {
+        written = fwrite( _entries[e].path.data(), 1, _entries[e].path.size(), pFile ) == _entries[e].path.size();
+    }
+    uint64_t position = header.namesOffset + namesSize;
+    for ( size_t c = 0; written && c < chunks.size(); ++c )
+    {
+        const size_t padding = (size_t)( chunks[c].offset - position );
+        const uint8_t* pStored = chunks[c].codec == (uint8_t)Codec::None ? chunkData[c] : compressed[c].data();
+        written = fwrite( kPadding, 1, padding, pFile ) == padding;
+        written = written && fwrite( pStored, 1, chunks[c].storedSize, pFile ) == chunks[c].storedSize;
+        position = chunks[c].offset + chunks[c].storedSize;
+    }
+    written = ( fclose( pFile ) == 0 ) && written;
+    if ( !written )
+    {
+        __builtin_printf( "PackWriter: write to %s failed\n", path );
+    }
+    return written;
+}
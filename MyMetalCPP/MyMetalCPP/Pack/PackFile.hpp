@@ -0,0 +1,169 @@
+//
+//  PackFile.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// Many assets in one file, each found by path in constant time and stored in independently
+// compressed chunks. Read in place like SceneFile - the file is mmap'd and the tables are used
+// where they lie.
+//
+//   Header         magic, version, counts, chunk size, where the tables are
+//   entries        path hash, name, size and chunk range of each asset, in packing order
+//   chunks         offset, stored and uncompressed size and codec of each chunk
+//   hash slots     open addressing table of entry index + 1 by path hash, at most half full
+//   names          the paths, not terminated
+//   data           the chunks, an entry's in order
+//
+// An entry's data is cut into chunkSize pieces and each is compressed on its own - LZ4 to load
+// fast, zlib or zstd (with MM_HAVE_ZSTD) to ship small - so reading a big entry, or a batch of
+// small ones, is a job per chunk over the JobSystem. A chunk that compression wouldn't shrink by
+// at least 1/32 is stored as it is. When every chunk of an entry is, the entry starts on a
+// kRawAlignment boundary and mapped() hands out the bytes in the mapping with no copy at all.
+//
+// find() hashes the path (64 bit FNV-1a) and probes the slots from hash & mask; the hash is
+// compared before the name, so a lookup is one or two cache misses whatever the entry count.
+
+namespace PackFormat
+{
+    static constexpr uint32_t kMagic = 0x4b50'4d4d;     // "MMPK"
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kDefaultChunkSize = 256 << 10;
+    static constexpr size_t kRawAlignment = 64;
+
+    enum class Codec : uint8_t
+    {
+        None = 0,
+        Lz4 = 1,
+        Zlib = 2,
+        Zstd = 3,
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t chunkCount;
+        uint32_t chunkSize;
+        uint32_t slotCount;         // a power of 2
+        uint64_t fileSize;
+        uint64_t entriesOffset;
+        uint64_t chunksOffset;
+        uint64_t slotsOffset;
+        uint64_t namesOffset;
+        uint64_t namesSize;
+    };
+
+    struct EntryRecord
+    {
+        uint64_t pathHash;
+        uint32_t nameOffset;        // into the names
+        uint32_t nameLength;
+        uint64_t size;
+        uint32_t firstChunk;
+        uint32_t chunkCount;
+    };
+
+    struct ChunkRecord
+    {
+        uint64_t offset;
+        uint32_t storedSize;
+        uint32_t size;
+        uint8_t codec;              // Codec
+        uint8_t reserved[7];
+    };
+
+    uint64_t hashPath( const char* path, size_t length );
+
+    // Whether this build can compress and decompress it
+    bool supports( Codec codec );
+    const char* codecName( Codec codec );
+}
+
+class PackFile
+{
+public:
+    typedef uint32_t Entry;
+    static constexpr Entry kInvalidEntry = ~0u;
+
+    PackFile();
+    ~PackFile();
+
+    PackFile( const PackFile& ) = delete;
+    PackFile& operator=( const PackFile& ) = delete;
+
+    // Maps the file and checks the header and every table, prints the reason and returns false if it can't be used
+    bool open( const char* path );
+    void close();
+    bool isOpen() const { return _pData != nullptr; }
+
+    Entry find( const char* path ) const;
+    Entry find( const std::string& path ) const { return find( path.c_str() ); }
+
+    uint32_t entryCount() const { return _header.entryCount; }
+    std::string path( Entry entry ) const;
+    uint64_t size( Entry entry ) const { return _pEntries[ entry ].size; }
+    uint32_t chunkCount( Entry entry ) const { return _pEntries[ entry ].chunkCount; }
+    // All of it in the file, not counting the tables
+    uint64_t storedSize( Entry entry ) const;
+
+    // The entry's bytes in the mapping when every chunk is stored uncompressed, otherwise nullptr
+    const uint8_t* mapped( Entry entry ) const;
+
+    // Decompresses into ppDest[i], size( pEntries[i] ) bytes each, a chunk per job across the
+    // whole batch. False if any chunk doesn't decompress to its size
+    bool read( const Entry* pEntries, uint8_t* const* ppDest, size_t count ) const;
+    bool read( Entry entry, uint8_t* pDest ) const { return read( &entry, &pDest, 1 ); }
+
+    const uint8_t* data() const { return _pData; }
+    size_t fileSize() const { return _size; }
+
+private:
+    bool fail( const char* reason );
+
+    uint8_t* _pData;
+    size_t _size;
+    size_t _mappedSize;
+    PackFormat::Header _header;
+    const PackFormat::EntryRecord* _pEntries;
+    const PackFormat::ChunkRecord* _pChunks;
+    const uint32_t* _pSlots;
+    const char* _pNames;
+};
+
+// Collects entries in memory and writes the pack, compressing a chunk per job
+class PackWriter
+{
+public:
+    explicit PackWriter( uint32_t chunkSize = PackFormat::kDefaultChunkSize );
+
+    // The data is copied. codec None for data that's compressed already. False for a path
+    // that's already in
+    bool add( const std::string& path, const uint8_t* pData, size_t size, PackFormat::Codec codec );
+
+    // compressionLevel as the codec takes it, 0 for its default. LZ4 has just the one
+    bool write( const char* path, int compressionLevel = 0 ) const;
+
+    size_t entryCount() const { return _entries.size(); }
+
+private:
+    struct Pending
+    {
+        std::string path;
+        uint64_t hash;
+        std::vector<uint8_t> data;
+        PackFormat::Codec codec;
+    };
+
+    uint32_t _chunkSize;
+    std::vector<Pending> _entries;
+    std::unordered_set<std::string> _paths;
+};
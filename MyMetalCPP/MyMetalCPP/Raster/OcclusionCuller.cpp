@@ -0,0 +1,565 @@
+//
+//  OcclusionCuller.cpp
+//  MyMetalCPP
+//
+
+#include "OcclusionCuller.hpp"
+#include "../Jobs/JobSystem.hpp"
+#include "../Maths/VectorExt.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <math.h>
+
+static constexpr size_t kInstancesPerJob = 64;
+static constexpr size_t kPyramidRowsPerJob = 8;
+static constexpr float kCoverageSlack = 1.f / 64.f;   // pixels, covers the rounding in the edge functions
+static constexpr float kDepthSlack = 1e-6f;           // an occluder's depth can round to just in front of its own box
+
+using Maths::Float4;
+using Maths::Int4;
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static Vector4f transformPoint( const Matrix44f& m, float x, float y, float z )
+{
+    return m.columns[0] * x + m.columns[1] * y + m.columns[2] * z + m.columns[3];
+}
+
+// Cohen-Sutherland style bits against Metal's clip volume, -w <= x, y <= w and 0 <= z <= w
+static uint32_t outcode( const Vector4f& c )
+{
+    return ( c.x < -c.w ? 1u : 0u ) | ( c.x > c.w ? 2u : 0u ) | ( c.y < -c.w ? 4u : 0u ) |
+           ( c.y > c.w ? 8u : 0u ) | ( c.z < 0.f ? 16u : 0u ) | ( c.z > c.w ? 32u : 0u );
+}
+
+OcclusionCuller::OcclusionCuller( uint32_t width, uint32_t height )
+: _width( width )
+, _height( height )
+, _tilesX( ( width + kTileWidth - 1 ) / kTileWidth )
+, _tilesY( ( height + kTileHeight - 1 ) / kTileHeight )
+, _stats()
+{
+    assert( width > 0 && height > 0 && width % 4 == 0 );
+
+    // halve down to 1x1, odd sizes round up so every level 0 pixel has a parent
+    size_t offset = 0;
+    uint32_t levelWidth = width;
+    uint32_t levelHeight = height;
+    for ( ;; )
+    {
+        _levels.push_back( { levelWidth, levelHeight, offset } );
+        offset += (size_t)levelWidth * levelHeight;
+        if ( levelWidth == 1 && levelHeight == 1 )
+        {
+            break;
+        }
+        levelWidth = ( levelWidth + 1 ) / 2;
+        levelHeight = ( levelHeight + 1 ) / 2;
+    }
+    _pyramid.assign( offset, 1.f );
+    _bins.resize( (size_t)_tilesX * _tilesY );
+    _clipFromWorld = Matrix44f();
+}
+
+void OcclusionCuller::begin( const Matrix44f& clipFromWorld )
+{
+    _clipFromWorld = clipFromWorld;
+    _occluders.clear();
+    _triangles.clear();
+    _edges.clear();
+    for ( std::vector<uint32_t>& bin : _bins )
+    {
+        bin.clear();
+    }
+}
+
+// The pixels whose squares touch [minX, maxX] x [minY, maxY], a little wider so rounding can't
+// leave one out
+static void touchedPixels( float minX, float minY, float maxX, float maxY, uint32_t width, uint32_t height,
+                           int& x0, int& y0, int& x1, int& y1 )
+{
+    x0 = std::max( 0, (int)floorf( minX - kCoverageSlack ) );
+    y0 = std::max( 0, (int)floorf( minY - kCoverageSlack ) );
+    x1 = std::min( (int)width - 1, (int)floorf( maxX + kCoverageSlack ) );
+    y1 = std::min( (int)height - 1, (int)floorf( maxY + kCoverageSlack ) );
+}
+
+static bool lessPosition( const float* a, const float* b )
+{
+    return std::lexicographical_compare( a, a + 3, b, b + 3 );
+}
+
+void OcclusionCuller::addOccluder( const Matrix44f& worldTransform, const VertexData* pVertices, size_t vertexCount,
+                                   const uint16_t* pIndices, size_t indexCount )
+{
+    const Matrix44f clipFromObject = _clipFromWorld * worldTransform;
+    _clipPositions.resize( vertexCount );
+    for ( size_t i = 0; i < vertexCount; ++i )
+    {
+        const Vector3f& p = pVertices[i].position;
+        _clipPositions[i] = transformPoint( clipFromObject, p.x, p.y, p.z );
+        if ( _clipPositions[i].z < 0.f )
+        {
+            return;         // in front of the near plane
+        }
+    }
+
+    Occluder occluder = { (uint32_t)_triangles.size(), 0, (uint32_t)_edges.size(), 0, (int)_width, (int)_height, -1, -1 };
+    _edgeKeys.clear();
+    for ( size_t t = 0; t + 2 < indexCount; t += 3 )
+    {
+        const uint16_t* pTri = pIndices + t;
+        float x[3], y[3], z[3];
+        for ( int i = 0; i < 3; ++i )
+        {
+            const Vector4f& c = _clipPositions[ pTri[i] ];
+            const float invW = 1.f / c.w;
+            x[i] = ( c.x * invW * 0.5f + 0.5f ) * _width;
+            y[i] = ( 0.5f - c.y * invW * 0.5f ) * _height;
+            z[i] = c.z * invW;
+        }
+
+        // counter clockwise in NDC is clockwise once y is flipped, so front faces have negative area here
+        const float area = ( x[1] - x[0] ) * ( y[2] - y[0] ) - ( y[1] - y[0] ) * ( x[2] - x[0] );
+        if ( area >= 0.f )
+        {
+            continue;
+        }
+
+        for ( int i = 0; i < 3; ++i )
+        {
+            const int a = i;
+            const int b = ( i + 1 ) % 3;
+            const bool swap = lessPosition( &pVertices[ pTri[b] ].position.x, &pVertices[ pTri[a] ].position.x );
+            const int first = swap ? b : a;
+            const int second = swap ? a : b;
+            const Vector3f& p0 = pVertices[ pTri[ first ] ].position;
+            const Vector3f& p1 = pVertices[ pTri[ second ] ].position;
+            _edgeKeys.push_back( { { p0.x, p0.y, p0.z, p1.x, p1.y, p1.z }, { x[ first ], y[ first ], x[ second ], y[ second ] } } );
+        }
+
+        const uint32_t codes[3] = { outcode( _clipPositions[ pTri[0] ] ), outcode( _clipPositions[ pTri[1] ] ), outcode( _clipPositions[ pTri[2] ] ) };
+        if ( codes[0] & codes[1] & codes[2] )
+        {
+            continue;       // off screen, though its edges still count
+        }
+
+        // swap to positive area so every edge function is >= 0 inside
+        const int order[3] = { 0, 2, 1 };
+        Triangle tri;
+        float minX = x[0], minY = y[0], maxX = x[0], maxY = y[0];
+        for ( int i = 0; i < 3; ++i )
+        {
+            minX = std::min( minX, x[i] );
+            minY = std::min( minY, y[i] );
+            maxX = std::max( maxX, x[i] );
+            maxY = std::max( maxY, y[i] );
+
+            // measured from one end, so E keeps its precision across the triangle
+            const int a = order[ ( i + 1 ) % 3 ];
+            const int b = order[ ( i + 2 ) % 3 ];
+            tri.edgeA[i] = y[a] - y[b];
+            tri.edgeB[i] = x[b] - x[a];
+            tri.edgeX[i] = x[a];
+            tri.edgeY[i] = y[a];
+            tri.edgeExtent[i] = ( 0.5f + kCoverageSlack ) * ( fabsf( tri.edgeA[i] ) + fabsf( tri.edgeB[i] ) );
+        }
+        touchedPixels( minX, minY, maxX, maxY, _width, _height, tri.minX, tri.minY, tri.maxX, tri.maxY );
+        if ( tri.minX > tri.maxX || tri.minY > tri.maxY )
+        {
+            continue;
+        }
+
+        const float invDet = 1.f / -area;
+        const float dx1 = x[1] - x[0], dy1 = y[1] - y[0], dz1 = z[1] - z[0];
+        const float dx2 = x[2] - x[0], dy2 = y[2] - y[0], dz2 = z[2] - z[0];
+        tri.depthA = ( dz2 * dy1 - dz1 * dy2 ) * invDet;
+        tri.depthB = ( dz1 * dx2 - dz2 * dx1 ) * invDet;
+        tri.depthC = z[0] - tri.depthA * x[0] - tri.depthB * y[0];
+        tri.depthMax = std::max( std::max( z[0], z[1] ), z[2] );
+
+        occluder.minX = std::min( occluder.minX, tri.minX );
+        occluder.minY = std::min( occluder.minY, tri.minY );
+        occluder.maxX = std::max( occluder.maxX, tri.maxX );
+        occluder.maxY = std::max( occluder.maxY, tri.maxY );
+        _triangles.push_back( tri );
+    }
+    occluder.triangleCount = (uint32_t)_triangles.size() - occluder.firstTriangle;
+    if ( occluder.triangleCount == 0 )
+    {
+        return;
+    }
+
+    // an edge only one front face has is on the silhouette - unless both sides are front faces
+    // the occluder ends there
+    std::sort( _edgeKeys.begin(), _edgeKeys.end(), []( const EdgeKey& a, const EdgeKey& b )
+    {
+        return std::lexicographical_compare( a.position, a.position + 6, b.position, b.position + 6 );
+    } );
+    for ( size_t first = 0, last = 0; first < _edgeKeys.size(); first = last )
+    {
+        while ( last < _edgeKeys.size() && memcmp( _edgeKeys[ last ].position, _edgeKeys[ first ].position, sizeof( EdgeKey::position ) ) == 0 )
+        {
+            ++last;
+        }
+        if ( last - first == 2 )
+        {
+            continue;
+        }
+        for ( size_t k = first; k < last; ++k )
+        {
+            const float* pScreen = _edgeKeys[k].screen;
+            Edge edge;
+            edge.A = pScreen[1] - pScreen[3];
+            edge.B = pScreen[2] - pScreen[0];
+            edge.X = pScreen[0];
+            edge.Y = pScreen[1];
+            edge.extent = ( 0.5f + kCoverageSlack ) * ( fabsf( edge.A ) + fabsf( edge.B ) );
+            touchedPixels( std::min( pScreen[0], pScreen[2] ), std::min( pScreen[1], pScreen[3] ),
+                           std::max( pScreen[0], pScreen[2] ), std::max( pScreen[1], pScreen[3] ), _width, _height,
+                           edge.minX, edge.minY, edge.maxX, edge.maxY );
+            if ( edge.minX <= edge.maxX && edge.minY <= edge.maxY )
+            {
+                _edges.push_back( edge );
+            }
+        }
+    }
+    occluder.edgeCount = (uint32_t)_edges.size() - occluder.firstEdge;
+
+    const uint32_t index = (uint32_t)_occluders.size();
+    _occluders.push_back( occluder );
+    for ( uint32_t ty = (uint32_t)occluder.minY / kTileHeight; ty <= (uint32_t)occluder.maxY / kTileHeight; ++ty )
+    {
+        for ( uint32_t tx = (uint32_t)occluder.minX / kTileWidth; tx <= (uint32_t)occluder.maxX / kTileWidth; ++tx )
+        {
+            _bins[ ty * _tilesX + tx ].push_back( index );
+        }
+    }
+}
+
+void OcclusionCuller::rasterizeTile( uint32_t tile )
+{
+    const int tileX0 = (int)( ( tile % _tilesX ) * kTileWidth );
+    const int tileY0 = (int)( ( tile / _tilesX ) * kTileHeight );
+    const int tileX1 = std::min( tileX0 + (int)kTileWidth, (int)_width ) - 1;
+    const int tileY1 = std::min( tileY0 + (int)kTileHeight, (int)_height ) - 1;
+    float* pDepth = _pyramid.data();
+
+    for ( int y = tileY0; y <= tileY1; ++y )
+    {
+        std::fill( pDepth + (size_t)y * _width + tileX0, pDepth + (size_t)y * _width + tileX1 + 1, 1.f );
+    }
+
+    // one occluder at a time: which pixels it covers and the furthest it gets in each, tile relative
+    alignas( 16 ) int32_t covered[ kTileWidth * kTileHeight ];
+    alignas( 16 ) float furthest[ kTileWidth * kTileHeight ];
+
+    const Float4 laneOffset = { 0.5f, 1.5f, 2.5f, 3.5f };
+    const Float4 zero = Maths::splat( 0.f );
+    for ( uint32_t occluderIndex : _bins[ tile ] )
+    {
+        const Occluder& occluder = _occluders[ occluderIndex ];
+        // widened to whole groups of 4 - tiles and the buffer are whole groups
+        const int ox0 = std::max( occluder.minX, tileX0 ) & ~3;
+        const int oy0 = std::max( occluder.minY, tileY0 );
+        const int ox1 = std::min( occluder.maxX, tileX1 ) | 3;
+        const int oy1 = std::min( occluder.maxY, tileY1 );
+        if ( ox0 > ox1 || oy0 > oy1 )
+        {
+            continue;
+        }
+        for ( int y = oy0; y <= oy1; ++y )
+        {
+            const size_t row = (size_t)( y - tileY0 ) * kTileWidth;
+            std::fill( covered + row + ( ox0 - tileX0 ), covered + row + ( ox1 - tileX0 ) + 1, 0 );
+            std::fill( furthest + row + ( ox0 - tileX0 ), furthest + row + ( ox1 - tileX0 ) + 1, 0.f );
+        }
+
+        // whole aligned groups of 4, lanes outside [x0, x1] masked off
+        for ( uint32_t t = 0; t < occluder.triangleCount; ++t )
+        {
+            const Triangle& tri = _triangles[ occluder.firstTriangle + t ];
+            const int x0 = std::max( tri.minX, tileX0 );
+            const int y0 = std::max( tri.minY, tileY0 );
+            const int x1 = std::min( tri.maxX, tileX1 );
+            const int y1 = std::min( tri.maxY, tileY1 );
+            for ( int y = y0; y <= y1; ++y )
+            {
+                const float py = y + 0.5f;
+                float rowE[3];
+                for ( int e = 0; e < 3; ++e )
+                {
+                    rowE[e] = tri.edgeB[e] * ( py - tri.edgeY[e] );
+                }
+                const float rowDepth = tri.depthB * py + tri.depthC + 0.5f * ( fabsf( tri.depthA ) + fabsf( tri.depthB ) );
+                const size_t row = (size_t)( y - tileY0 ) * kTileWidth - tileX0;
+                for ( int x = x0 & ~3; x <= x1; x += 4 )
+                {
+                    const Float4 px = (float)x + laneOffset;
+                    const Float4 e0 = tri.edgeA[0] * ( px - tri.edgeX[0] ) + rowE[0];
+                    const Float4 e1 = tri.edgeA[1] * ( px - tri.edgeX[1] ) + rowE[1];
+                    const Float4 e2 = tri.edgeA[2] * ( px - tri.edgeX[2] ) + rowE[2];
+                    const Int4 inRange = ( px > (float)x0 ) & ( px < (float)( x1 + 1 ) );
+                    const Int4 centre = ( e0 >= zero ) & ( e1 >= zero ) & ( e2 >= zero ) & inRange;
+                    const Int4 touch = ( e0 >= -tri.edgeExtent[0] ) & ( e1 >= -tri.edgeExtent[1] ) & ( e2 >= -tri.edgeExtent[2] ) & inRange;
+                    if ( !Maths::any( touch ) )
+                    {
+                        continue;
+                    }
+
+                    Float4 z = tri.depthA * px + rowDepth;
+                    z = Maths::select( z < tri.depthMax, z, Maths::splat( tri.depthMax ) );
+                    Int4 coveredLanes;
+                    Float4 furthestLanes;
+                    memcpy( &coveredLanes, covered + row + x, sizeof( coveredLanes ) );
+                    memcpy( &furthestLanes, furthest + row + x, sizeof( furthestLanes ) );
+                    coveredLanes |= centre;
+                    furthestLanes = Maths::select( touch & ( z > furthestLanes ), z, furthestLanes );
+                    memcpy( covered + row + x, &coveredLanes, sizeof( coveredLanes ) );
+                    memcpy( furthest + row + x, &furthestLanes, sizeof( furthestLanes ) );
+                }
+            }
+        }
+
+        // pixels a silhouette edge passes through are only partly covered
+        for ( uint32_t e = 0; e < occluder.edgeCount; ++e )
+        {
+            const Edge& edge = _edges[ occluder.firstEdge + e ];
+            const int x0 = std::max( edge.minX, ox0 );
+            const int y0 = std::max( edge.minY, oy0 );
+            const int x1 = std::min( edge.maxX, ox1 );
+            const int y1 = std::min( edge.maxY, oy1 );
+            for ( int y = y0; y <= y1; ++y )
+            {
+                const float rowE = edge.B * ( y + 0.5f - edge.Y );
+                const size_t row = (size_t)( y - tileY0 ) * kTileWidth - tileX0;
+                for ( int x = x0 & ~3; x <= x1; x += 4 )
+                {
+                    const Float4 px = (float)x + laneOffset;
+                    const Float4 distance = Maths::abs( edge.A * ( px - edge.X ) + rowE );
+                    const Int4 on = ( distance <= edge.extent ) & ( px > (float)x0 ) & ( px < (float)( x1 + 1 ) );
+                    Int4 coveredLanes;
+                    memcpy( &coveredLanes, covered + row + x, sizeof( coveredLanes ) );
+                    coveredLanes &= ~on;
+                    memcpy( covered + row + x, &coveredLanes, sizeof( coveredLanes ) );
+                }
+            }
+        }
+
+        for ( int y = oy0; y <= oy1; ++y )
+        {
+            const size_t row = (size_t)( y - tileY0 ) * kTileWidth - tileX0;
+            float* pRow = pDepth + (size_t)y * _width;
+            for ( int x = ox0; x <= ox1; x += 4 )
+            {
+                Int4 coveredLanes;
+                Float4 furthestLanes;
+                Float4 stored;
+                memcpy( &coveredLanes, covered + row + x, sizeof( coveredLanes ) );
+                memcpy( &furthestLanes, furthest + row + x, sizeof( furthestLanes ) );
+                memcpy( &stored, pRow + x, sizeof( stored ) );
+                stored = Maths::select( coveredLanes & ( furthestLanes < stored ), furthestLanes, stored );
+                memcpy( pRow + x, &stored, sizeof( stored ) );
+            }
+        }
+    }
+}
+
+void OcclusionCuller::buildPyramid()
+{
+    for ( size_t level = 1; level < _levels.size(); ++level )
+    {
+        const Level& source = _levels[ level - 1 ];
+        const Level& target = _levels[ level ];
+        const float* pSource = _pyramid.data() + source.offset;
+        float* pTarget = _pyramid.data() + target.offset;
+        JobSystem::Instance()->parallelFor( target.height, kPyramidRowsPerJob, [&]( size_t begin, size_t end )
+        {
+            for ( size_t y = begin; y < end; ++y )
+            {
+                const float* pRow0 = pSource + y * 2 * source.width;
+                const float* pRow1 = pSource + std::min<size_t>( y * 2 + 1, source.height - 1 ) * source.width;
+                for ( uint32_t x = 0; x < target.width; ++x )
+                {
+                    const uint32_t x0 = x * 2;
+                    const uint32_t x1 = std::min( x0 + 1, source.width - 1 );
+                    pTarget[ y * target.width + x ] = std::max( std::max( pRow0[ x0 ], pRow0[ x1 ] ), std::max( pRow1[ x0 ], pRow1[ x1 ] ) );
+                }
+            }
+        } );
+    }
+}
+
+void OcclusionCuller::rasterize()
+{
+    auto start = std::chrono::steady_clock::now();
+    JobSystem::Instance()->parallelFor( _bins.size(), 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t tile = begin; tile < end; ++tile )
+        {
+            rasterizeTile( (uint32_t)tile );
+        }
+    } );
+    _stats.rasterMs = elapsedMs( start );
+    _stats.occluderTriangles = _triangles.size();
+
+    start = std::chrono::steady_clock::now();
+    buildPyramid();
+    _stats.pyramidMs = elapsedMs( start );
+}
+
+OcclusionCuller::Result OcclusionCuller::testBox( const Matrix44f& worldTransform, const float boxMin[3], const float boxMax[3] ) const
+{
+    const Matrix44f clipFromObject = _clipFromWorld * worldTransform;
+    uint32_t allOutside = ~0u;
+    bool crossesNear = false;
+    float minX = INFINITY, minY = INFINITY, minZ = INFINITY;
+    float maxX = -INFINITY, maxY = -INFINITY;
+    for ( int corner = 0; corner < 8; ++corner )
+    {
+        const Vector4f c = transformPoint( clipFromObject, ( corner & 1 ) ? boxMax[0] : boxMin[0],
+                                                           ( corner & 2 ) ? boxMax[1] : boxMin[1],
+                                                           ( corner & 4 ) ? boxMax[2] : boxMin[2] );
+        const uint32_t code = outcode( c );
+        allOutside &= code;
+        if ( code & 16u )
+        {
+            crossesNear = true;
+            continue;
+        }
+        const float invW = 1.f / c.w;
+        minX = std::min( minX, c.x * invW );
+        maxX = std::max( maxX, c.x * invW );
+        minY = std::min( minY, c.y * invW );
+        maxY = std::max( maxY, c.y * invW );
+        minZ = std::min( minZ, c.z * invW );
+    }
+    if ( allOutside )
+    {
+        return Result::OutsideFrustum;
+    }
+    if ( crossesNear )
+    {
+        return Result::Visible;
+    }
+
+    // every pixel the screen rectangle touches, then up the pyramid until that is at most 8x8 texels
+    int x0 = std::max( 0, (int)floorf( ( minX * 0.5f + 0.5f ) * _width ) );
+    int x1 = std::min( (int)_width - 1, (int)floorf( ( maxX * 0.5f + 0.5f ) * _width ) );
+    int y0 = std::max( 0, (int)floorf( ( 0.5f - maxY * 0.5f ) * _height ) );
+    int y1 = std::min( (int)_height - 1, (int)floorf( ( 0.5f - minY * 0.5f ) * _height ) );
+    if ( x0 > x1 || y0 > y1 )
+    {
+        return Result::Visible;
+    }
+    uint32_t level = 0;
+    while ( level + 1 < _levels.size() && ( x1 - x0 > 7 || y1 - y0 > 7 ) )
+    {
+        x0 >>= 1;
+        x1 >>= 1;
+        y0 >>= 1;
+        y1 >>= 1;
+        ++level;
+    }
+
+    const Level& texels = _levels[ level ];
+    const float* pLevel = _pyramid.data() + texels.offset;
+    float maxDepth = 0.f;
+    for ( int y = y0; y <= y1; ++y )
+    {
+        for ( int x = x0; x <= x1; ++x )
+        {
+            maxDepth = std::max( maxDepth, pLevel[ (size_t)y * texels.width + x ] );
+        }
+    }
+    return minZ > maxDepth + kDepthSlack ? Result::Occluded : Result::Visible;
+}
+
+size_t OcclusionCuller::cullInstances( const Matrix44f& clipFromWorld, const InstanceData* pInstances, size_t count,
+                                       const VertexData* pVertices, size_t vertexCount, const uint16_t* pIndices, size_t indexCount,
+                                       uint32_t maxOccluders, InstanceData* pVisible )
+{
+    _stats = Stats();
+    _stats.instances = count;
+
+    auto start = std::chrono::steady_clock::now();
+    float boxMin[3] = { INFINITY, INFINITY, INFINITY };
+    float boxMax[3] = { -INFINITY, -INFINITY, -INFINITY };
+    for ( size_t i = 0; i < vertexCount; ++i )
+    {
+        const Vector3f& p = pVertices[i].position;
+        boxMin[0] = std::min( boxMin[0], p.x );
+        boxMin[1] = std::min( boxMin[1], p.y );
+        boxMin[2] = std::min( boxMin[2], p.z );
+        boxMax[0] = std::max( boxMax[0], p.x );
+        boxMax[1] = std::max( boxMax[1], p.y );
+        boxMax[2] = std::max( boxMax[2], p.z );
+    }
+
+    // occluders are the instances in view covering the most screen - biggest scale over distance
+    begin( clipFromWorld );
+    _candidates.clear();
+    for ( size_t i = 0; maxOccluders > 0 && i < count; ++i )
+    {
+        const Matrix44f& m = pInstances[i].instanceTransform;
+        const Vector4f centre = transformPoint( _clipFromWorld * m, ( boxMin[0] + boxMax[0] ) * 0.5f,
+                                                ( boxMin[1] + boxMax[1] ) * 0.5f, ( boxMin[2] + boxMax[2] ) * 0.5f );
+        if ( outcode( centre ) != 0 )
+        {
+            continue;
+        }
+        float scale = 0.f;
+        for ( int c = 0; c < 3; ++c )
+        {
+            const Vector4f axis = m.columns[c];
+            scale = std::max( scale, axis.x * axis.x + axis.y * axis.y + axis.z * axis.z );
+        }
+        _candidates.push_back( { -sqrtf( scale ) / centre.w, (uint32_t)i } );
+    }
+    const size_t occluderCount = std::min<size_t>( maxOccluders, _candidates.size() );
+    std::partial_sort( _candidates.begin(), _candidates.begin() + occluderCount, _candidates.end() );
+    for ( size_t i = 0; i < occluderCount; ++i )
+    {
+        addOccluder( pInstances[ _candidates[i].second ].instanceTransform, pVertices, vertexCount, pIndices, indexCount );
+    }
+    _stats.occluders = occluderCount;
+    _stats.setupMs = elapsedMs( start );
+
+    rasterize();
+
+    start = std::chrono::steady_clock::now();
+    _results.resize( count );
+    JobSystem::Instance()->parallelFor( count, kInstancesPerJob, [&]( size_t begin, size_t end )
+    {
+        for ( size_t i = begin; i < end; ++i )
+        {
+            _results[i] = testBox( pInstances[i].instanceTransform, boxMin, boxMax );
+        }
+    } );
+
+
+    size_t visibleCount = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        switch ( _results[i] )
+        {
+            case Result::Visible:
+                memcpy( &pVisible[ visibleCount++ ], &pInstances[i], sizeof( InstanceData ) );
+                break;
+            case Result::OutsideFrustum:
+                ++_stats.outsideFrustum;
+                break;
+            case Result::Occluded:
+                ++_stats.occluded;
+                break;
+        }
+    }
+    _stats.testMs = elapsedMs( start );
+    return visibleCount;
+}
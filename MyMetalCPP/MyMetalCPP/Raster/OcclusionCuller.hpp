@@ -0,0 +1,174 @@
+//
+//  OcclusionCuller.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "../Shaders/ShaderStructs.h"
+
+// CPU occlusion culling against a small software depth buffer.
+//
+// A few big occluders are rasterized depth only into a low resolution float buffer - near 0,
+// far 1 like the Renderer's depth target. Setup and binning follow SoftwareRasterizer: each
+// occluder's triangles are culled and set up with edge functions and a depth plane, the
+// occluder is binned to the tiles its bounds touch, then each tile is cleared and rasterized as
+// its own job, 4 pixels at a time with Maths::Float4, keeping the nearest depth. An occluder
+// with a triangle crossing the near plane is dropped rather than clipped - leaving an occluder
+// out only makes the culling less effective, never wrong.
+//
+// Over that goes a max depth pyramid, each texel the furthest depth of the 2x2 below it. A box
+// is tested by projecting its 8 corners: its screen rectangle picks the level where it covers
+// at most 8x8 texels - coarser levels take in the gaps round a small box - and it is occluded
+// when its nearest corner is behind all of them.
+//
+// Occluders under-estimate, so nothing seen past one can be culled. A pixel is only written
+// where the occluder covers all of it: its centre is inside one of the front faces and none of
+// the occluder's silhouette edges - an edge with a front face on one side only, matched by
+// vertex position so split normals don't count - passes through it. The front faces tile the
+// inside of the silhouette, so their shared edges leave no cracks the way shrinking every
+// triangle by half a pixel would. What it writes is the furthest depth of every front face
+// touching the pixel, each the furthest its plane reaches over the pixel and no further than
+// its furthest corner, so it is never nearer than any of the occluder inside it. That costs
+// about a pixel all round, so occluders want to be several pixels across at this resolution.
+//
+// cullInstances() is the whole pass for the instanced draw: take the instances covering the most
+// screen as occluders, test every instance's box and copy the visible ones to the buffer the
+// GPU draws from, so culled instances are never written.
+
+class OcclusionCuller
+{
+public:
+    static constexpr uint32_t kTileWidth = 32;      // a multiple of 16 floats so tiles never share a cache line
+    static constexpr uint32_t kTileHeight = 16;
+
+    enum class Result : uint8_t
+    {
+        Visible,
+        OutsideFrustum,
+        Occluded,
+    };
+
+    struct Stats
+    {
+        size_t instances;
+        size_t occluders;
+        size_t occluderTriangles;       // binned, after culling
+        size_t outsideFrustum;
+        size_t occluded;
+        double setupMs;                 // occluder selection, transform and binning
+        double rasterMs;
+        double pyramidMs;
+        double testMs;                  // box tests and copying the visible instances
+    };
+
+    // width a multiple of 4, so rows are whole Float4s
+    OcclusionCuller( uint32_t width = 256, uint32_t height = 128 );
+
+    uint32_t width() const { return _width; }
+    uint32_t height() const { return _height; }
+
+    // Starts a frame, dropping the previous occluders
+    void begin( const Matrix44f& clipFromWorld );
+
+    void addOccluder( const Matrix44f& worldTransform, const VertexData* pVertices, size_t vertexCount,
+                      const uint16_t* pIndices, size_t indexCount );
+
+    // Clears and rasterizes every tile, then builds the pyramid
+    void rasterize();
+
+    // Object space box through worldTransform, against the frustum and then the pyramid
+    Result testBox( const Matrix44f& worldTransform, const float boxMin[3], const float boxMax[3] ) const;
+
+    // begin / addOccluder / rasterize / testBox over a set of instances sharing one mesh. The
+    // maxOccluders instances biggest on screen - scale over distance - go in as occluders - which can be occluded
+    // themselves - visible instances are copied to pVisible in their original order. Returns
+    // how many were copied
+    size_t cullInstances( const Matrix44f& clipFromWorld, const InstanceData* pInstances, size_t count,
+                          const VertexData* pVertices, size_t vertexCount, const uint16_t* pIndices, size_t indexCount,
+                          uint32_t maxOccluders, InstanceData* pVisible );
+
+    // Per instance results of the last cullInstances()
+    const std::vector<Result>& results() const { return _results; }
+
+    const Stats& stats() const { return _stats; }
+
+    // Level 0 is the rasterized depth, rows levelWidth( level ) floats apart
+    uint32_t levelCount() const { return (uint32_t)_levels.size(); }
+    uint32_t levelWidth( uint32_t level ) const { return _levels[ level ].width; }
+    uint32_t levelHeight( uint32_t level ) const { return _levels[ level ].height; }
+    const float* levelData( uint32_t level ) const { return _pyramid.data() + _levels[ level ].offset; }
+
+private:
+    struct Triangle
+    {
+        float edgeA[3];             // E(x,y) = A (x - X) + B (y - Y), >= 0 inside
+        float edgeB[3];
+        float edgeX[3];
+        float edgeY[3];
+        float edgeExtent[3];        // how far below 0 E goes at a pixel the edge's line touches
+        float depthA;               // z = A x + B y + C, affine in screen space
+        float depthB;
+        float depthC;
+        float depthMax;             // the furthest corner
+        int minX, minY, maxX, maxY; // inclusive bounds of the pixels it touches, clamped to the buffer
+    };
+
+    // A silhouette edge, E(x,y) = A (x - X) + B (y - Y) along it
+    struct Edge
+    {
+        float A, B, X, Y;
+        float extent;               // a pixel the line passes through has |E| <= extent at its centre
+        int minX, minY, maxX, maxY;
+    };
+
+    struct Occluder
+    {
+        uint32_t firstTriangle;
+        uint32_t triangleCount;
+        uint32_t firstEdge;
+        uint32_t edgeCount;
+        int minX, minY, maxX, maxY;
+    };
+
+    // A front face's edge by its ends' positions, smaller first, and where they are on screen
+    struct EdgeKey
+    {
+        float position[6];
+        float screen[4];
+    };
+
+    struct Level
+    {
+        uint32_t width;
+        uint32_t height;
+        size_t offset;
+    };
+
+    void rasterizeTile( uint32_t tile );
+    void buildPyramid();
+
+    uint32_t _width;
+    uint32_t _height;
+    uint32_t _tilesX;
+    uint32_t _tilesY;
+    Matrix44f _clipFromWorld;
+
+    std::vector<float> _pyramid;                    // every level, one after another
+    std::vector<Level> _levels;
+    std::vector<Occluder> _occluders;
+    std::vector<Triangle> _triangles;
+    std::vector<Edge> _edges;
+    std::vector<std::vector<uint32_t>> _bins;       // per tile, indices into _occluders
+    std::vector<Vector4f> _clipPositions;           // scratch for addOccluder
+    std::vector<EdgeKey> _edgeKeys;
+    std::vector<Result> _results;
+    std::vector<std::pair<float, uint32_t>> _candidates;
+
+    Stats _stats;
+};
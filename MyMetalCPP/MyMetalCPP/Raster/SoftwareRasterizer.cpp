@@ -0,0 +1,544 @@
+//
+//  SoftwareRasterizer.cpp
+//  MyMetalCPP
+//
+
+#include "SoftwareRasterizer.hpp"
+#include "../Jobs/JobSystem.hpp"
+#include "../Maths/VectorExt.hpp"
+#include "../Shaders/MyShaderStages.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <math.h>
+
+static constexpr size_t kBinChunkTriangles = 512;   // input triangles per binning job
+static constexpr float kSubPixelScale = 256.f;      // vertices snap to 1/256 pixel like the GPU
+static constexpr uint32_t kSRGBTableSize = 4096;
+
+// 4 pixels of a row at once
+using Maths::Float4;
+using Maths::Int4;
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static const uint8_t* srgbTable()
+{
+    static const std::vector<uint8_t> table = []()
+    {
+        std::vector<uint8_t> t( kSRGBTableSize );
+        for ( uint32_t i = 0; i < kSRGBTableSize; ++i )
+        {
+            float c = i / (float)( kSRGBTableSize - 1 );
+            float s = ( c <= 0.0031308f ) ? c * 12.92f : 1.055f * powf( c, 1.f / 2.4f ) - 0.055f;
+            t[i] = (uint8_t)( s * 255.f + 0.5f );
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+static inline uint8_t encodeSRGB( float c )
+{
+    return srgbTable()[ (uint32_t)( metal::saturate( c ) * ( kSRGBTableSize - 1 ) + 0.5f ) ];
+}
+
+static v2f lerpVertex( const v2f& a, const v2f& b, float t )
+{
+    v2f o;
+    o.position = a.position + ( b.position - a.position ) * t;
+    o.normal = a.normal + ( b.normal - a.normal ) * t;
+    o.color = a.color + ( b.color - a.color ) * t;
+    o.texcoord = a.texcoord + ( b.texcoord - a.texcoord ) * t;
+    return o;
+}
+
+// Sutherland-Hodgman against one plane, inside is dist >= 0
+template<typename Dist>
+static int clipPolygon( const v2f* pIn, int count, v2f* pOut, const Dist& dist )
+{
+    int outCount = 0;
+    for ( int i = 0; i < count; ++i )
+    {
+        const v2f& a = pIn[i];
+        const v2f& b = pIn[ ( i + 1 ) % count ];
+        const float da = dist( a );
+        const float db = dist( b );
+        if ( da >= 0.f )
+        {
+            pOut[ outCount++ ] = a;
+        }
+        if ( ( da >= 0.f ) != ( db >= 0.f ) )
+        {
+            pOut[ outCount++ ] = lerpVertex( a, b, da / ( da - db ) );
+        }
+    }
+    return outCount;
+}
+
+SoftwareRasterizer::SoftwareRasterizer( uint32_t width, uint32_t height )
+: _width( width )
+, _height( height )
+, _tilesX( ( width + kTileSize - 1 ) / kTileSize )
+, _tilesY( ( height + kTileSize - 1 ) / kTileSize )
+, _stats()
+{
+    assert( width > 0 && height > 0 );
+    _color.resize( (size_t)width * height * 4 );
+    _depth.resize( (size_t)_tilesX * _tilesY * kTileSize * kTileSize );
+}
+
+SoftwareRasterizer::~SoftwareRasterizer()
+{
+}
+
+void SoftwareRasterizer::clear( metal::float4 color )
+{
+    const uint8_t rgba[4] = { encodeSRGB( color.x ), encodeSRGB( color.y ), encodeSRGB( color.z ),
+                              (uint8_t)( metal::saturate( color.w ) * 255.f + 0.5f ) };
+    JobSystem::Instance()->parallelFor( _height, 16, [&]( size_t begin, size_t end )
+    {
+        for ( size_t y = begin; y < end; ++y )
+        {
+            uint8_t* pRow = _color.data() + y * colorRowPitch();
+            for ( uint32_t x = 0; x < _width; ++x )
+            {
+                memcpy( pRow + x * 4, rgba, 4 );
+            }
+        }
+    } );
+    std::fill( _depth.begin(), _depth.end(), 0xFFFF );
+}
+
+void SoftwareRasterizer::setupTriangle( const v2f& v0, const v2f& v1, const v2f& v2, std::vector<Triangle>& triangles ) const
+{
+    // screen space, y down, snapped to the sub pixel grid
+    metal::float2 p[3];
+    const v2f* pVerts[3] = { &v0, &v1, &v2 };
+    float invW[3];
+    for ( int i = 0; i < 3; ++i )
+    {
+        const metal::float4& pos = pVerts[i]->position;
+        invW[i] = 1.f / pos.w;
+        float sx = ( pos.x * invW[i] * 0.5f + 0.5f ) * _width;
+        float sy = ( 0.5f - pos.y * invW[i] * 0.5f ) * _height;
+        p[i] = metal::float2( roundf( sx * kSubPixelScale ) / kSubPixelScale, roundf( sy * kSubPixelScale ) / kSubPixelScale );
+    }
+
+    // counter clockwise in NDC is clockwise once y is flipped, so front faces have negative area here
+    const float area = ( p[1].x - p[0].x ) * ( p[2].y - p[0].y ) - ( p[1].y - p[0].y ) * ( p[2].x - p[0].x );
+    if ( area >= 0.f )
+    {
+        return;
+    }
+
+    // swap to positive area so every edge function is > 0 inside
+    int order[3] = { 0, 2, 1 };
+
+    Triangle tri;
+    float minX = (float)_width, minY = (float)_height, maxX = 0.f, maxY = 0.f;
+    for ( int i = 0; i < 3; ++i )
+    {
+        const int vi = order[i];
+        const v2f& v = *pVerts[ vi ];
+        tri.z[i] = v.position.z * invW[ vi ];
+        tri.invW[i] = invW[ vi ];
+        tri.normal[i] = v.normal * invW[ vi ];
+        tri.color[i] = v.color * invW[ vi ];
+        tri.texcoord[i] = v.texcoord * invW[ vi ];
+        minX = std::min( minX, p[ vi ].x );
+        minY = std::min( minY, p[ vi ].y );
+        maxX = std::max( maxX, p[ vi ].x );
+        maxY = std::max( maxY, p[ vi ].y );
+    }
+
+    // pixel centers are at +0.5, so a pixel x is a candidate when x + 0.5 lies inside [minX, maxX]
+    tri.minX = std::max( 0, (int)ceilf( minX - 0.5f ) );
+    tri.minY = std::max( 0, (int)ceilf( minY - 0.5f ) );
+    tri.maxX = std::min( (int)_width - 1, (int)floorf( maxX - 0.5f ) );
+    tri.maxY = std::min( (int)_height - 1, (int)floorf( maxY - 0.5f ) );
+    if ( tri.minX > tri.maxX || tri.minY > tri.maxY )
+    {
+        return;
+    }
+
+    for ( int i = 0; i < 3; ++i )
+    {
+        // edge opposite vertex i, always evaluated from the same end so the two triangles
+        // sharing an edge get exactly negated values and the top-left rule keeps it watertight
+        metal::float2 a = p[ order[ ( i + 1 ) % 3 ] ];
+        metal::float2 b = p[ order[ ( i + 2 ) % 3 ] ];
+        float sign = 1.f;
+        if ( b.x < a.x || ( b.x == a.x && b.y < a.y ) )
+        {
+            std::swap( a, b );
+            sign = -1.f;
+        }
+        tri.edgeA[i] = sign * ( a.y - b.y );
+        tri.edgeB[i] = sign * ( b.x - a.x );
+        tri.edgeX[i] = a.x;
+        tri.edgeY[i] = a.y;
+
+        // (A, B) points inside: left edges have A > 0, top edges (y down) are horizontal with B > 0
+        tri.topLeft[i] = tri.edgeA[i] > 0.f || ( tri.edgeA[i] == 0.f && tri.edgeB[i] > 0.f );
+    }
+    tri.invArea = 1.f / -area;
+
+    triangles.push_back( tri );
+}
+
+void SoftwareRasterizer::drawIndexedInstanced( const VertexData* pVertices, size_t numVertices,
+                                               const uint16_t* pIndices, size_t numIndices,
+                                               const InstanceData* pInstances, size_t numInstances,
+                                               const CameraData& camera,
+                                               metal::CpuTexture& texture )
+{
+    JobSystem* pJobs = JobSystem::Instance();
+
+    // Vertex stage
+    auto start = std::chrono::steady_clock::now();
+    _vertexOutput.resize( numVertices * numInstances );
+    pJobs->parallelFor( numInstances, 16, [&]( size_t begin, size_t end )
+    {
+        for ( size_t instance = begin; instance < end; ++instance )
+        {
+            v2f* pOut = _vertexOutput.data() + instance * numVertices;
+            for ( size_t vertex = 0; vertex < numVertices; ++vertex )
+            {
+                pOut[ vertex ] = vertexMain( pVertices, pInstances, camera, (uint)vertex, (uint)instance );
+            }
+        }
+    } );
+    _stats.vertexMs = elapsedMs( start );
+
+    // Clip, cull, set up and bin
+    start = std::chrono::steady_clock::now();
+    const size_t trianglesPerInstance = numIndices / 3;
+    const size_t numTriangles = trianglesPerInstance * numInstances;
+    const size_t numChunks = ( numTriangles + kBinChunkTriangles - 1 ) / kBinChunkTriangles;
+    const size_t numTiles = (size_t)_tilesX * _tilesY;
+    _chunkTriangles.resize( numChunks );
+    _bins.resize( numChunks * numTiles );
+
+    std::atomic<uint64_t> trianglesBinned { 0 };
+    pJobs->parallelFor( numChunks, 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t chunk = begin; chunk < end; ++chunk )
+        {
+            std::vector<Triangle>& triangles = _chunkTriangles[ chunk ];
+            triangles.clear();
+            std::vector<uint32_t>* pBins = _bins.data() + chunk * numTiles;
+            for ( size_t tile = 0; tile < numTiles; ++tile )
+            {
+                pBins[ tile ].clear();
+            }
+
+            const size_t first = chunk * kBinChunkTriangles;
+            const size_t last = std::min( first + kBinChunkTriangles, numTriangles );
+            for ( size_t t = first; t < last; ++t )
+            {
+                const size_t instance = t / trianglesPerInstance;
+                const uint16_t* pTri = pIndices + ( t % trianglesPerInstance ) * 3;
+                const v2f* pInstanceVerts = _vertexOutput.data() + instance * numVertices;
+                const v2f& v0 = pInstanceVerts[ pTri[0] ];
+                const v2f& v1 = pInstanceVerts[ pTri[1] ];
+                const v2f& v2 = pInstanceVerts[ pTri[2] ];
+
+                const size_t firstNew = triangles.size();
+                auto outsideNear = []( const v2f& v ) { return v.position.z < 0.f; };
+                auto outsideFar = []( const v2f& v ) { return v.position.z > v.position.w; };
+                if ( outsideNear( v0 ) && outsideNear( v1 ) && outsideNear( v2 ) )
+                {
+                    continue;
+                }
+                if ( outsideFar( v0 ) && outsideFar( v1 ) && outsideFar( v2 ) )
+                {
+                    continue;
+                }
+                if ( !outsideNear( v0 ) && !outsideNear( v1 ) && !outsideNear( v2 ) &&
+                     !outsideFar( v0 ) && !outsideFar( v1 ) && !outsideFar( v2 ) )
+                {
+                    setupTriangle( v0, v1, v2, triangles );
+                }
+                else
+                {
+                    // Metal's clip volume is 0 <= z <= w, x and y are left to the guard band
+                    v2f polygon[5] = { v0, v1, v2 };
+                    v2f clipped[5];
+                    int count = clipPolygon( polygon, 3, clipped, []( const v2f& v ) { return v.position.z; } );
+                    count = clipPolygon( clipped, count, polygon, []( const v2f& v ) { return v.position.w - v.position.z; } );
+                    for ( int i = 2; i < count; ++i )
+                    {
+                        setupTriangle( polygon[0], polygon[ i - 1 ], polygon[i], triangles );
+                    }
+                }
+
+                for ( size_t i = firstNew; i < triangles.size(); ++i )
+                {
+                    const Triangle& tri = triangles[i];
+                    const uint32_t tx0 = (uint32_t)tri.minX / kTileSize;
+                    const uint32_t ty0 = (uint32_t)tri.minY / kTileSize;
+                    const uint32_t tx1 = (uint32_t)tri.maxX / kTileSize;
+                    const uint32_t ty1 = (uint32_t)tri.maxY / kTileSize;
+                    for ( uint32_t ty = ty0; ty <= ty1; ++ty )
+                    {
+                        for ( uint32_t tx = tx0; tx <= tx1; ++tx )
+                        {
+                            pBins[ ty * _tilesX + tx ].push_back( (uint32_t)i );
+                        }
+                    }
+                }
+            }
+            trianglesBinned += triangles.size();
+        }
+    } );
+    _stats.binMs = elapsedMs( start );
+
+    // Raster and fragment stage, one tile per job
+    start = std::chrono::steady_clock::now();
+    std::atomic<uint64_t> pixelsShaded { 0 };
+    pJobs->parallelFor( numTiles, 1, [&]( size_t begin, size_t end )
+    {
+        uint64_t shaded = 0;
+        for ( size_t tile = begin; tile < end; ++tile )
+        {
+            rasterizeTile( (uint32_t)tile, texture, shaded );
+        }
+        pixelsShaded += shaded;
+    } );
+    _stats.rasterMs = elapsedMs( start );
+
+    _stats.trianglesIn = numTriangles;
+    _stats.trianglesBinned = trianglesBinned;
+    _stats.pixelsShaded = pixelsShaded;
+}
+
+void SoftwareRasterizer::rasterizeTile( uint32_t tile, metal::CpuTexture& texture, uint64_t& pixelsShaded )
+{
+    const int tileX0 = (int)( ( tile % _tilesX ) * kTileSize );
+    const int tileY0 = (int)( ( tile / _tilesX ) * kTileSize );
+    const int tileX1 = std::min( tileX0 + (int)kTileSize, (int)_width ) - 1;
+    const int tileY1 = std::min( tileY0 + (int)kTileSize, (int)_height ) - 1;
+    const size_t numTiles = (size_t)_tilesX * _tilesY;
+    uint16_t* pDepth = _depth.data() + (size_t)tile * kTileSize * kTileSize;
+
+    const texture2d<half, access::sample> tex( texture );
+    const Float4 laneOffset = { 0.5f, 1.5f, 2.5f, 3.5f };
+    const Float4 zero = { 0.f, 0.f, 0.f, 0.f };
+
+    for ( size_t chunk = 0; chunk < _chunkTriangles.size(); ++chunk )
+    {
+        const std::vector<Triangle>& triangles = _chunkTriangles[ chunk ];
+        for ( uint32_t index : _bins[ chunk * numTiles + tile ] )
+        {
+            const Triangle& tri = triangles[ index ];
+            const int x0 = std::max( tri.minX, tileX0 );
+            const int y0 = std::max( tri.minY, tileY0 );
+            const int x1 = std::min( tri.maxX, tileX1 );
+            const int y1 = std::min( tri.maxY, tileY1 );
+            if ( x0 > x1 || y0 > y1 )
+            {
+                continue;
+            }
+
+            Int4 topLeft[3];
+            for ( int e = 0; e < 3; ++e )
+            {
+                const int32_t m = tri.topLeft[e] ? -1 : 0;
+                topLeft[e] = Int4{ m, m, m, m };
+            }
+
+            for ( int y = y0; y <= y1; ++y )
+            {
+                const float py = y + 0.5f;
+                float rowC[3];
+                for ( int e = 0; e < 3; ++e )
+                {
+                    rowC[e] = tri.edgeB[e] * ( py - tri.edgeY[e] );
+                }
+
+                for ( int x = x0; x <= x1; x += 4 )
+                {
+                    const Float4 px = (float)x + laneOffset;
+                    const Float4 e0 = tri.edgeA[0] * ( px - tri.edgeX[0] ) + rowC[0];
+                    const Float4 e1 = tri.edgeA[1] * ( px - tri.edgeX[1] ) + rowC[1];
+                    const Float4 e2 = tri.edgeA[2] * ( px - tri.edgeX[2] ) + rowC[2];
+                    const Int4 inX = px < (float)( x1 + 1 );
+                    Int4 mask = ( ( e0 > zero ) | ( ( e0 == zero ) & topLeft[0] ) ) &
+                                ( ( e1 > zero ) | ( ( e1 == zero ) & topLeft[1] ) ) &
+                                ( ( e2 > zero ) | ( ( e2 == zero ) & topLeft[2] ) ) & inX;
+                    if ( !Maths::any( mask ) )
+                    {
+                        continue;
+                    }
+
+                    // Depth16Unorm: z quantised to 16 bits before the Less test
+                    const Float4 b0 = e0 * tri.invArea;
+                    const Float4 b1 = e1 * tri.invArea;
+                    const Float4 b2 = e2 * tri.invArea;
+                    const Float4 z = b0 * tri.z[0] + b1 * tri.z[1] + b2 * tri.z[2];
+
+                    for ( int lane = 0; lane < 4; ++lane )
+                    {
+                        if ( !mask[ lane ] )
+                        {
+                            continue;
+                        }
+                        const uint16_t depth = (uint16_t)( metal::saturate( z[ lane ] ) * 65535.f + 0.5f );
+                        uint16_t& stored = pDepth[ ( y - tileY0 ) * kTileSize + ( x + lane - tileX0 ) ];
+                        if ( depth >= stored )
+                        {
+                            continue;
+                        }
+                        stored = depth;
+
+                        // perspective correct varyings - attribute / w and 1 / w are affine in screen space
+                        const float l0 = b0[ lane ];
+                        const float l1 = b1[ lane ];
+                        const float l2 = b2[ lane ];
+                        const float invW = l0 * tri.invW[0] + l1 * tri.invW[1] + l2 * tri.invW[2];
+                        const float w = 1.f / invW;
+                        v2f in;
+                        in.position = metal::float4( x + lane + 0.5f, py, z[ lane ], invW );
+                        in.normal = ( tri.normal[0] * l0 + tri.normal[1] * l1 + tri.normal[2] * l2 ) * w;
+                        in.color = ( tri.color[0] * l0 + tri.color[1] * l1 + tri.color[2] * l2 ) * w;
+                        in.texcoord = ( tri.texcoord[0] * l0 + tri.texcoord[1] * l1 + tri.texcoord[2] * l2 ) * w;
+
+                        const half4 color = fragmentMain( in, tex );
+                        uint8_t* p = _color.data() + (size_t)y * colorRowPitch() + (size_t)( x + lane ) * 4;
+                        p[0] = encodeSRGB( color.x );
+                        p[1] = encodeSRGB( color.y );
+                        p[2] = encodeSRGB( color.z );
+                        p[3] = (uint8_t)( metal::saturate( color.w ) * 255.f + 0.5f );
+                        ++pixelsShaded;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SoftwareRasterizer::drawReference( const VertexData* pVertices, const uint16_t* pIndices, size_t numIndices,
+                                        const InstanceData* pInstances, size_t numInstances,
+                                        const CameraData& camera, metal::CpuTexture& texture )
+{
+    const texture2d<half, access::sample> tex( texture );
+    for ( size_t instance = 0; instance < numInstances; ++instance )
+    {
+        for ( size_t t = 0; t + 2 < numIndices; t += 3 )
+        {
+            v2f polygon[5];
+            v2f clipped[5];
+            for ( int i = 0; i < 3; ++i )
+            {
+                polygon[i] = vertexMain( pVertices, pInstances, camera, pIndices[ t + i ], (uint)instance );
+            }
+            int count = clipPolygon( polygon, 3, clipped, []( const v2f& v ) { return v.position.z; } );
+            count = clipPolygon( clipped, count, polygon, []( const v2f& v ) { return v.position.w - v.position.z; } );
+
+            for ( int fan = 2; fan < count; ++fan )
+            {
+                // clockwise on screen once y is flipped is front facing - taken in the order 0 2 1
+                // so the area and every edge function are positive inside
+                const v2f* pVerts[3] = { &polygon[0], &polygon[ fan ], &polygon[ fan - 1 ] };
+                double x[3], y[3];
+                for ( int i = 0; i < 3; ++i )
+                {
+                    const metal::float4& pos = pVerts[i]->position;
+                    const float invW = 1.f / pos.w;
+                    x[i] = roundf( ( pos.x * invW * 0.5f + 0.5f ) * _width * kSubPixelScale ) / kSubPixelScale;
+                    y[i] = roundf( ( 0.5f - pos.y * invW * 0.5f ) * _height * kSubPixelScale ) / kSubPixelScale;
+                }
+                const double area = ( x[1] - x[0] ) * ( y[2] - y[0] ) - ( y[1] - y[0] ) * ( x[2] - x[0] );
+                if ( area <= 0.0 )
+                {
+                    continue;
+                }
+
+                const int minX = std::max( 0, (int)ceil( std::min( { x[0], x[1], x[2] } ) - 0.5 ) );
+                const int minY = std::max( 0, (int)ceil( std::min( { y[0], y[1], y[2] } ) - 0.5 ) );
+                const int maxX = std::min( (int)_width - 1, (int)floor( std::max( { x[0], x[1], x[2] } ) - 0.5 ) );
+                const int maxY = std::min( (int)_height - 1, (int)floor( std::max( { y[0], y[1], y[2] } ) - 0.5 ) );
+                for ( int py = minY; py <= maxY; ++py )
+                {
+                    for ( int px = minX; px <= maxX; ++px )
+                    {
+                        double l[3];
+                        bool inside = true;
+                        for ( int i = 0; i < 3 && inside; ++i )
+                        {
+                            // edge opposite vertex i, inside on its left; a pixel centre exactly
+                            // on it belongs to this triangle when it's a top or left edge
+                            const int a = ( i + 1 ) % 3;
+                            const int b = ( i + 2 ) % 3;
+                            const double dx = x[b] - x[a];
+                            const double dy = y[b] - y[a];
+                            const double e = dx * ( py + 0.5 - y[a] ) - dy * ( px + 0.5 - x[a] );
+                            const bool topLeft = dy < 0.0 || ( dy == 0.0 && dx > 0.0 );
+                            inside = e > 0.0 || ( e == 0.0 && topLeft );
+                            l[i] = e / area;
+                        }
+                        if ( !inside )
+                        {
+                            continue;
+                        }
+
+                        // perspective correct - attribute / w and 1 / w are affine in screen space
+                        float z = 0.f, invW = 0.f;
+                        metal::float3 normal( 0.f ), color( 0.f );
+                        metal::float2 texcoord( 0.f );
+                        for ( int i = 0; i < 3; ++i )
+                        {
+                            const float li = (float)l[i];
+                            const float vInvW = 1.f / pVerts[i]->position.w;
+                            z += li * pVerts[i]->position.z * vInvW;
+                            invW += li * vInvW;
+                            normal = normal + pVerts[i]->normal * vInvW * li;
+                            color = color + pVerts[i]->color * vInvW * li;
+                            texcoord = texcoord + pVerts[i]->texcoord * vInvW * li;
+                        }
+                        const uint16_t depth = (uint16_t)( metal::saturate( z ) * 65535.f + 0.5f );
+                        const uint32_t tile = ( (uint32_t)py / kTileSize ) * _tilesX + (uint32_t)px / kTileSize;
+                        uint16_t& stored = _depth[ (size_t)tile * kTileSize * kTileSize + ( (uint32_t)py % kTileSize ) * kTileSize + (uint32_t)px % kTileSize ];
+                        if ( depth >= stored )
+                        {
+                            continue;
+                        }
+                        stored = depth;
+
+                        v2f in;
+                        in.position = metal::float4( px + 0.5f, py + 0.5f, z, invW );
+                        in.normal = normal * ( 1.f / invW );
+                        in.color = color * ( 1.f / invW );
+                        in.texcoord = texcoord * ( 1.f / invW );
+                        const half4 shaded = fragmentMain( in, tex );
+                        uint8_t* p = _color.data() + (size_t)py * colorRowPitch() + (size_t)px * 4;
+                        p[0] = encodeSRGB( shaded.x );
+                        p[1] = encodeSRGB( shaded.y );
+                        p[2] = encodeSRGB( shaded.z );
+                        p[3] = (uint8_t)( metal::saturate( shaded.w ) * 255.f + 0.5f );
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SoftwareRasterizer::resolveDepth( std::vector<uint16_t>& depth ) const
+{
+    depth.resize( (size_t)_width * _height );
+    for ( uint32_t y = 0; y < _height; ++y )
+    {
+        for ( uint32_t x = 0; x < _width; ++x )
+        {
+            const uint32_t tile = ( y / kTileSize ) * _tilesX + x / kTileSize;
+            depth[ (size_t)y * _width + x ] = _depth[ (size_t)tile * kTileSize * kTileSize + ( y % kTileSize ) * kTileSize + x % kTileSize ];
+        }
+    }
+}
@@ -0,0 +1,109 @@
+//
+//  SoftwareRasterizer.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Compute/CpuShaderTypes.hpp"
+#include "../Shaders/ShaderStructs.h"
+
+struct v2f;     // Shaders/MyShaderStages.h
+
+// CPU implementation of the MyShader.metal pipeline - runs the shared vertexMain/fragmentMain
+// from Shaders/MyShaderStages.h with the same fixed function state the Renderer sets up:
+// back face culling with counter clockwise front faces, Depth16Unorm with a Less test and an
+// sRGB colour target.
+//
+// A frame goes through three parallel passes on the JobSystem:
+//   vertex  - vertexMain for every (instance, vertex) pair
+//   bin     - clip against the near/far planes, cull, set up edge functions and append each
+//             triangle to the screen tiles its bounds touch. Triangles are binned in fixed
+//             chunks so every tile sees them in submission order whatever the thread count.
+//   raster  - each tile walks its bins with 4-wide edge functions and its own depth tile,
+//             so tiles never share memory and need no locking.
+
+class SoftwareRasterizer
+{
+public:
+    static constexpr uint32_t kTileSize = 64;
+
+    struct Stats
+    {
+        double vertexMs;
+        double binMs;
+        double rasterMs;
+        uint64_t trianglesIn;       // submitted triangles
+        uint64_t trianglesBinned;   // after clipping and culling
+        uint64_t pixelsShaded;      // fragmentMain invocations
+    };
+
+    SoftwareRasterizer( uint32_t width, uint32_t height );
+    ~SoftwareRasterizer();
+
+    uint32_t width() const { return _width; }
+    uint32_t height() const { return _height; }
+
+    // Linear colour, written to the target sRGB encoded. Depth is cleared to 1.0
+    void clear( metal::float4 color );
+
+    void drawIndexedInstanced( const VertexData* pVertices, size_t numVertices,
+                               const uint16_t* pIndices, size_t numIndices,
+                               const InstanceData* pInstances, size_t numInstances,
+                               const CameraData& camera,
+                               metal::CpuTexture& texture );
+
+    // The same draw a triangle at a time and a pixel at a time on this thread, with the edge
+    // functions in double so the inside test is exact - what drawIndexedInstanced is checked
+    // against. Leaves the stats alone
+    void drawReference( const VertexData* pVertices, const uint16_t* pIndices, size_t numIndices,
+                        const InstanceData* pInstances, size_t numInstances,
+                        const CameraData& camera, metal::CpuTexture& texture );
+
+    // RGBA8 in sRGB, rows are width * 4 bytes
+    const uint8_t* colorData() const { return _color.data(); }
+    size_t colorRowPitch() const { return (size_t)_width * 4; }
+
+    // Linear rows of Depth16Unorm values, untiled from the per tile buffers
+    void resolveDepth( std::vector<uint16_t>& depth ) const;
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    struct Triangle
+    {
+        float edgeA[3];             // E(x,y) = A (x - X) + B (y - Y), > 0 inside, edge i is opposite vertex i
+        float edgeB[3];
+        float edgeX[3];             // X, Y - an end of the edge, so E is small near the triangle and
+        float edgeY[3];             // keeps its precision where a single C term would cancel
+        bool topLeft[3];
+        float invArea;
+        float z[3];                 // NDC depth, affine in screen space
+        float invW[3];
+        metal::float3 normal[3];    // varyings pre-divided by w for perspective correction
+        metal::float3 color[3];
+        metal::float2 texcoord[3];
+        int minX, minY, maxX, maxY; // inclusive pixel bounds, clamped to the target
+    };
+
+    void setupTriangle( const v2f& v0, const v2f& v1, const v2f& v2, std::vector<Triangle>& triangles ) const;
+    void rasterizeTile( uint32_t tile, metal::CpuTexture& texture, uint64_t& pixelsShaded );
+
+    uint32_t _width;
+    uint32_t _height;
+    uint32_t _tilesX;
+    uint32_t _tilesY;
+
+    std::vector<uint8_t> _color;
+    std::vector<uint16_t> _depth;                   // kTileSize * kTileSize per tile, tile after tile
+
+    std::vector<v2f> _vertexOutput;                 // per (instance, vertex)
+    std::vector<std::vector<Triangle>> _chunkTriangles;
+    std::vector<std::vector<uint32_t>> _bins;       // [chunk * numTiles + tile] -> index into the chunk's triangles
+
+    Stats _stats;
+};
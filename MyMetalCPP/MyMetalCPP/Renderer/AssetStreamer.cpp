@@ -0,0 +1,228 @@
+//
+//  AssetStreamer.cpp
+//  MyMetalCPP
+//
+
+#include "AssetStreamer.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+AssetStreamer::AssetStreamer( uint32_t threadCount, uint64_t budget, LoadFn loadFn, ResidentFn residentFn, EvictFn evictFn, void* pUser )
+: _loadFn( loadFn )
+, _residentFn( residentFn )
+, _evictFn( evictFn )
+, _pUser( pUser )
+, _budget( budget )
+, _frame( 1 )
+, _stats{}
+, _bytesInFlight( 0 )
+, _loading( 0 )
+, _quit( false )
+{
+    for ( uint32_t i = 0; i < std::max( threadCount, 1u ); ++i )
+    {
+        _threads.emplace_back( &AssetStreamer::threadMain, this );
+    }
+}
+
+AssetStreamer::~AssetStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _quit = true;
+        _queue.clear();
+    }
+    _wake.notify_all();
+    for ( std::thread& thread : _threads )
+    {
+        thread.join();
+    }
+    for ( const Loaded& loaded : _loaded )
+    {
+        if ( loaded.pPayload )
+        {
+            _evictFn( _pUser, loaded.asset, loaded.pPayload );
+        }
+    }
+    for ( AssetId asset : _lru )
+    {
+        _evictFn( _pUser, asset, _assets[ asset ].pPayload );
+    }
+}
+
+void AssetStreamer::threadMain()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    for ( ;; )
+    {
+        _wake.wait( lock, [this]() { return _quit || !_queue.empty(); } );
+        if ( _quit )
+        {
+            return;
+        }
+        const Queued queued = _queue.back();
+        _queue.pop_back();
+        _bytesInFlight += queued.size;
+        _loading++;
+
+        lock.unlock();
+        size_t size = 0;
+        void* pPayload = _loadFn( _pUser, queued.asset, &size );
+        lock.lock();
+        _loaded.push_back( { queued.asset, pPayload, size } );
+        _loading--;
+    }
+}
+
+AssetStreamer::AssetId AssetStreamer::add( uint64_t size )
+{
+    Asset asset = {};
+    asset.size = size;
+    asset.state = State::Unloaded;
+    _assets.push_back( asset );
+    _stats.assets = _assets.size();
+    return (AssetId)( _assets.size() - 1 );
+}
+
+bool AssetStreamer::request( AssetId asset, float priority )
+{
+    Asset& a = _assets[ asset ];
+    const bool resident = a.state == State::Resident;
+    if ( a.requestedFrame != _frame )
+    {
+        a.requestedFrame = _frame;
+        a.priority = priority;
+        _requested.push_back( asset );
+        _stats.requests++;
+        _stats.hits += resident ? 1 : 0;
+    }
+    else
+    {
+        a.priority = std::max( a.priority, priority );
+    }
+    if ( resident )
+    {
+        _lru.splice( _lru.end(), _lru, a.lru );
+    }
+    return resident;
+}
+
+void AssetStreamer::evict( AssetId asset )
+{
+    Asset& a = _assets[ asset ];
+    assert( a.state == State::Resident );
+    _lru.erase( a.lru );
+    _stats.resident--;
+    _stats.residentBytes -= a.size;
+    _stats.evictions++;
+    void* pPayload = a.pPayload;
+    a.pPayload = nullptr;
+    a.state = State::Unloaded;
+    _evictFn( _pUser, asset, pPayload );
+}
+
+void AssetStreamer::update()
+{
+    // what finished, and the loads that never started go back to unloaded - the queue starts over
+    std::vector<Loaded> loaded;
+    uint64_t bytesInFlight = 0;
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        loaded.swap( _loaded );
+        for ( const Loaded& done : loaded )
+        {
+            _bytesInFlight -= _assets[ done.asset ].size;
+        }
+        for ( const Queued& queued : _queue )
+        {
+            _assets[ queued.asset ].state = State::Unloaded;
+        }
+        _queue.clear();
+        bytesInFlight = _bytesInFlight;
+    }
+    for ( const Loaded& done : loaded )
+    {
+        Asset& a = _assets[ done.asset ];
+        if ( !done.pPayload )
+        {
+            a.state = State::Unloaded;
+            _stats.failures++;
+            continue;
+        }
+        a.state = State::Resident;
+        a.size = done.size;
+        a.pPayload = done.pPayload;
+        a.lru = _lru.insert( _lru.end(), done.asset );
+        _stats.resident++;
+        _stats.residentBytes += done.size;
+        _stats.loads++;
+        _residentFn( _pUser, done.asset, done.pPayload );
+    }
+
+    // this frame's misses, highest priority first, as far as the budget goes
+    std::vector<AssetId> misses;
+    for ( AssetId asset : _requested )
+    {
+        if ( _assets[ asset ].state == State::Unloaded )
+        {
+            misses.push_back( asset );
+        }
+    }
+    std::stable_sort( misses.begin(), misses.end(), [this]( AssetId a, AssetId b ) { return _assets[a].priority > _assets[b].priority; } );
+    std::vector<Queued> queue;
+    uint64_t committed = _stats.residentBytes + bytesInFlight;
+    for ( AssetId asset : misses )
+    {
+        Asset& a = _assets[ asset ];
+        if ( a.size > _budget )
+        {
+            a.state = State::Oversized;
+            _stats.oversized++;
+            continue;
+        }
+        while ( committed + a.size > _budget && !_lru.empty() && _assets[ _lru.front() ].requestedFrame < _frame )
+        {
+            committed -= _assets[ _lru.front() ].size;
+            evict( _lru.front() );
+        }
+        if ( committed + a.size > _budget )
+        {
+            break;
+        }
+        committed += a.size;
+        a.state = State::Queued;
+        queue.push_back( { asset, a.size } );
+    }
+    std::reverse( queue.begin(), queue.end() );
+
+    _stats.queued = queue.size();
+    _stats.bytesQueued = 0;
+    for ( const Queued& queued : queue )
+    {
+        _stats.bytesQueued += queued.size;
+    }
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _queue.swap( queue );
+    }
+    _wake.notify_all();
+
+    _stats.maxResidentBytes = std::max( _stats.maxResidentBytes, _stats.residentBytes );
+    _requested.clear();
+    _frame++;
+}
+
+void* AssetStreamer::payload( AssetId asset ) const
+{
+    return _assets[ asset ].state == State::Resident ? _assets[ asset ].pPayload : nullptr;
+}
+
+AssetStreamer::Stats AssetStreamer::stats() const
+{
+    Stats stats = _stats;
+    std::lock_guard<std::mutex> lock( _mutex );
+    stats.loading = _loading + _loaded.size();
+    stats.bytesInFlight = _bytesInFlight;
+    return stats;
+}
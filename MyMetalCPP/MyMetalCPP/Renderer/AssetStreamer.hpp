@@ -0,0 +1,147 @@
+//
+//  AssetStreamer.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Assets loaded in the background as they're wanted, kept under a memory budget.
+//
+// Each frame the caller request()s what it wants with a priority - nearer or bigger on screen is
+// higher - then calls update() once. update() hands finished loads to ResidentFn on its own
+// thread, so integrating them (uploads, swapping them in) needs no locking, and queues this
+// frame's misses highest priority first. The queue is rebuilt every frame: anything no longer
+// requested drops out before it starts, and priorities are always this frame's.
+//
+// A fixed pool of streaming threads - not the JobSystem, they block on I/O - takes the highest
+// priority load left each time and runs LoadFn, which reads and decodes and returns the payload
+// to keep.
+//
+// The budget covers resident payloads plus loads in flight, at the size given to add() until a
+// load reports its real size. To fit a load in, update() evicts the least recently requested
+// assets through EvictFn, never one requested this frame. When that isn't enough the rest of
+// the queue waits, so the budget is always spent on the highest priorities. An asset bigger
+// than the whole budget never loads - the first update() it's missed in marks it oversized and
+// it's skipped from then on, rather than evicting everything else and holding up the queue.
+
+class AssetStreamer
+{
+public:
+    typedef uint32_t AssetId;
+    static constexpr AssetId kInvalidAsset = ~0u;
+
+    // On a streaming thread: the asset's payload and its size in pSize, nullptr if it can't be loaded
+    typedef void* ( *LoadFn )( void* pUser, AssetId asset, size_t* pSize );
+    // On the update() thread: a load finished, the payload is resident
+    typedef void ( *ResidentFn )( void* pUser, AssetId asset, void* pPayload );
+    // On the update() thread: the asset is dropped, free its payload
+    typedef void ( *EvictFn )( void* pUser, AssetId asset, void* pPayload );
+
+    struct Stats
+    {
+        size_t assets;
+        size_t resident;
+        uint64_t residentBytes;
+        uint64_t maxResidentBytes;  // after any update()
+        size_t loading;
+        uint64_t bytesInFlight;     // loads started and not yet integrated
+        size_t queued;              // by the last update()
+        uint64_t bytesQueued;
+        uint64_t requests;          // ever, once per asset per frame
+        uint64_t hits;              // requests finding the asset resident
+        uint64_t loads;
+        uint64_t failures;
+        uint64_t evictions;
+        size_t oversized;           // bigger than the budget, never loaded
+
+        double hitRate() const { return requests ? (double)hits / requests : 0.0; }
+    };
+
+    AssetStreamer( uint32_t threadCount, uint64_t budget, LoadFn loadFn, ResidentFn residentFn, EvictFn evictFn, void* pUser );
+    // Waits for loads in flight, then gives every payload to EvictFn
+    ~AssetStreamer();
+
+    AssetStreamer( const AssetStreamer& ) = delete;
+    AssetStreamer& operator=( const AssetStreamer& ) = delete;
+
+    // size is what the budget plans with until the asset is loaded
+    AssetId add( uint64_t size );
+
+    // Wanted this frame, the highest priority it's requested at counts. True when it's resident
+    bool request( AssetId asset, float priority );
+
+    // Once a frame after its requests - integrates finished loads and queues the misses
+    void update();
+
+    // nullptr unless resident
+    void* payload( AssetId asset ) const;
+    bool isResident( AssetId asset ) const { return _assets[ asset ].state == State::Resident; }
+
+    uint64_t budget() const { return _budget; }
+    Stats stats() const;
+
+private:
+    enum class State : uint8_t
+    {
+        Unloaded,
+        Queued,         // or loading - only the queue knows which
+        Resident,
+        Oversized       // won't fit the budget even alone
+    };
+
+    struct Asset
+    {
+        uint64_t size;                  // expected, then actual
+        void* pPayload;
+        State state;
+        float priority;                 // this frame's
+        uint64_t requestedFrame;
+        std::list<AssetId>::iterator lru;
+    };
+
+    struct Queued
+    {
+        AssetId asset;
+        uint64_t size;
+    };
+
+    struct Loaded
+    {
+        AssetId asset;
+        void* pPayload;
+        size_t size;
+    };
+
+    void threadMain();
+    void evict( AssetId asset );
+
+    LoadFn _loadFn;
+    ResidentFn _residentFn;
+    EvictFn _evictFn;
+    void* _pUser;
+    uint64_t _budget;
+
+    // the update() thread's
+    std::vector<Asset> _assets;
+    std::list<AssetId> _lru;            // resident, least recently requested first
+    std::vector<AssetId> _requested;    // this frame
+    uint64_t _frame;
+    Stats _stats;
+
+    mutable std::mutex _mutex;          // everything below
+    std::condition_variable _wake;
+    std::vector<Queued> _queue;         // highest priority last, taken from the back
+    std::vector<Loaded> _loaded;
+    uint64_t _bytesInFlight;
+    size_t _loading;
+    bool _quit;
+    std::vector<std::thread> _threads;
+};
@@ -0,0 +1,487 @@
+//
+//  AsyncFileIO.cpp
+//  MyMetalCPP
+//
+
+#include "AsyncFileIO.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#if defined( __linux__ ) && __has_include( <linux/io_uring.h> )
+#define MM_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+// The rings as mapped from the kernel. Only this thread writes the SQ tail and CQ head, the
+// kernel the others
+struct AsyncFileIO::Ring
+{
+#if defined( MM_IO_URING )
+    int fd;
+    void* pSqMap;
+    size_t sqMapSize;
+    void* pCqMap;               // pSqMap again with IORING_FEAT_SINGLE_MMAP
+    size_t cqMapSize;
+    io_uring_sqe* pSqes;
+    size_t sqesSize;
+    uint32_t* pSqTail;
+    uint32_t sqMask;
+    uint32_t* pSqArray;
+    uint32_t* pCqHead;
+    uint32_t* pCqTail;
+    uint32_t cqMask;
+    io_uring_cqe* pCqes;
+    uint32_t toSubmit;          // SQEs written since the last enter
+#endif
+};
+
+AsyncFileIO::AsyncFileIO( uint32_t queueDepth, Backend backend, uint32_t threadCount )
+: _queueDepth( std::max( queueDepth, 1u ) )
+, _buffersRegistered( false )
+, _nextRequest( 1 )
+, _stats{}
+, _pRing( nullptr )
+, _submitted( 0 )
+, _quit( false )
+{
+    if ( backend == Backend::IoUring && setupRing( _queueDepth ) )
+    {
+        _slots.resize( _queueDepth );
+        for ( uint32_t i = _queueDepth; i > 0; --i )
+        {
+            _freeSlots.push_back( i - 1 );
+        }
+        return;
+    }
+    for ( uint32_t i = 0; i < std::max( threadCount, 1u ); ++i )
+    {
+        _threads.emplace_back( &AsyncFileIO::threadMain, this );
+    }
+}
+
+AsyncFileIO::~AsyncFileIO()
+{
+    _pending.clear();
+    if ( _pRing )
+    {
+        // the kernel is still writing into the callers' memory until these complete
+        Completion completions[ 64 ];
+        while ( outstanding() > 0 )
+        {
+            wait( completions, 64 );
+        }
+        destroyRing();
+    }
+    else
+    {
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _quit = true;
+            _queue.clear();
+        }
+        _wake.notify_all();
+        for ( std::thread& thread : _threads )
+        {
+            thread.join();
+        }
+    }
+    for ( const FileInfo& file : _files )
+    {
+        if ( file.fd >= 0 )
+        {
+            ::close( file.fd );
+        }
+    }
+}
+
+const char* AsyncFileIO::backendName() const
+{
+    return _pRing ? "io_uring" : "threads";
+}
+
+AsyncFileIO::File AsyncFileIO::open( const char* path, bool direct )
+{
+    int fd = -1;
+    bool isDirect = false;
+#if defined( O_DIRECT )
+    if ( direct )
+    {
+        fd = ::open( path, O_RDONLY | O_CLOEXEC | O_DIRECT );
+        isDirect = fd >= 0;
+    }
+#endif
+    if ( fd < 0 )
+    {
+        fd = ::open( path, O_RDONLY | O_CLOEXEC );
+    }
+    if ( fd < 0 )
+    {
+        return kInvalidFile;
+    }
+#if defined( F_NOCACHE )
+    if ( direct )
+    {
+        isDirect = fcntl( fd, F_NOCACHE, 1 ) == 0;
+    }
+#endif
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 )
+    {
+        ::close( fd );
+        return kInvalidFile;
+    }
+    _files.push_back( { fd, (uint64_t)info.st_size, isDirect } );
+    return (File)( _files.size() - 1 );
+}
+
+void AsyncFileIO::close( File file )
+{
+    FileInfo& info = _files[ file ];
+    if ( info.fd >= 0 )
+    {
+        ::close( info.fd );
+        info.fd = -1;
+    }
+}
+
+bool AsyncFileIO::registerBuffers( const std::vector<Buffer>& buffers )
+{
+    assert( _buffers.empty() && outstanding() == 0 );
+    _buffers = buffers;
+#if defined( MM_IO_URING )
+    if ( _pRing && !buffers.empty() )
+    {
+        std::vector<iovec> iovecs;
+        for ( const Buffer& buffer : buffers )
+        {
+            iovecs.push_back( { buffer.pData, buffer.size } );
+        }
+        _buffersRegistered = syscall( __NR_io_uring_register, _pRing->fd, IORING_REGISTER_BUFFERS, iovecs.data(), (unsigned)iovecs.size() ) == 0;
+        if ( !_buffersRegistered )
+        {
+            __builtin_printf( "io_uring can't register %zu buffers (%s), reading into them unregistered\n", buffers.size(), strerror( errno ) );
+        }
+    }
+#endif
+    return _buffersRegistered;
+}
+
+int32_t AsyncFileIO::bufferIndex( const void* pDest, uint32_t size ) const
+{
+    if ( _buffersRegistered )
+    {
+        const uint8_t* p = static_cast<const uint8_t*>( pDest );
+        for ( size_t i = 0; i < _buffers.size(); ++i )
+        {
+            const uint8_t* pBuffer = static_cast<const uint8_t*>( _buffers[i].pData );
+            if ( p >= pBuffer && p + size <= pBuffer + _buffers[i].size )
+            {
+                return (int32_t)i;
+            }
+        }
+    }
+    return -1;
+}
+
+AsyncFileIO::Request AsyncFileIO::read( File file, uint64_t offset, uint32_t size, void* pDest, void* pUser )
+{
+    const FileInfo& info = _files[ file ];
+    assert( info.fd >= 0 );
+    assert( !info.direct || ( (uintptr_t)pDest % kDirectAlignment == 0 && offset % kDirectAlignment == 0 && size % kDirectAlignment == 0 ) );
+    Read read = { _nextRequest++, info.fd, info.size, offset, static_cast<uint8_t*>( pDest ), size, 0, bufferIndex( pDest, size ), pUser };
+    _pending.push_back( read );
+    _stats.reads++;
+    _stats.fixedReads += read.buffer >= 0 ? 1 : 0;
+    return read.request;
+}
+
+void AsyncFileIO::submit()
+{
+    if ( _pRing )
+    {
+        fillRing();
+        enter( 0 );
+        return;
+    }
+    if ( _pending.empty() )
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _queue.insert( _queue.end(), _pending.begin(), _pending.end() );
+        _submitted += _pending.size();
+    }
+    _pending.clear();
+    _stats.systemCalls++;
+    _wake.notify_all();
+}
+
+size_t AsyncFileIO::poll( Completion* pCompletions, size_t maxCompletions )
+{
+    size_t count = 0;
+    if ( _pRing )
+    {
+        count = reapRing( pCompletions, maxCompletions );
+        submit();
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        count = std::min( maxCompletions, _completed.size() );
+        std::copy( _completed.begin(), _completed.begin() + count, pCompletions );
+        _completed.erase( _completed.begin(), _completed.begin() + count );
+        _submitted -= count;
+    }
+    for ( size_t i = 0; i < count; ++i )
+    {
+        _stats.completed++;
+        _stats.bytes += pCompletions[i].result > 0 ? (uint64_t)pCompletions[i].result : 0;
+    }
+    return count;
+}
+
+size_t AsyncFileIO::wait( Completion* pCompletions, size_t maxCompletions )
+{
+    submit();
+    size_t count = poll( pCompletions, maxCompletions );
+    while ( count == 0 && outstanding() > 0 )
+    {
+        if ( _pRing )
+        {
+            enter( 1 );
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock( _mutex );
+            _finished.wait( lock, [this]() { return !_completed.empty(); } );
+        }
+        count = poll( pCompletions, maxCompletions );
+    }
+    return count;
+}
+
+size_t AsyncFileIO::outstanding() const
+{
+    if ( _pRing )
+    {
+        return _pending.size() + _queueDepth - _freeSlots.size();
+    }
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _pending.size() + _submitted;
+}
+
+// Blocking reads, one at a time per thread
+void AsyncFileIO::threadMain()
+{
+    std::unique_lock<std::mutex> lock( _mutex );
+    for ( ;; )
+    {
+        _wake.wait( lock, [this]() { return _quit || !_queue.empty(); } );
+        if ( _quit )
+        {
+            return;
+        }
+        Read read = _queue.front();
+        _queue.pop_front();
+
+        lock.unlock();
+        int64_t result = 0;
+        while ( read.done < read.size && read.offset + read.done < read.fileSize )
+        {
+            const ssize_t bytes = pread( read.fd, read.pDest + read.done, read.size - read.done, (off_t)( read.offset + read.done ) );
+            if ( bytes < 0 && errno == EINTR )
+            {
+                continue;
+            }
+            if ( bytes <= 0 )
+            {
+                result = bytes < 0 ? -errno : 0;
+                break;
+            }
+            read.done += (uint32_t)bytes;
+        }
+        lock.lock();
+        _completed.push_back( { read.request, read.pUser, result < 0 ? result : (int64_t)read.done } );
+        _finished.notify_one();
+    }
+}
+
+#if defined( MM_IO_URING )
+
+bool AsyncFileIO::setupRing( uint32_t entries )
+{
+    io_uring_params params;
+    memset( &params, 0, sizeof( params ) );
+    const int fd = (int)syscall( __NR_io_uring_setup, entries, &params );
+    if ( fd < 0 )
+    {
+        return false;
+    }
+
+    Ring* pRing = new Ring();
+    pRing->fd = fd;
+    pRing->sqMapSize = params.sq_off.array + params.sq_entries * sizeof( uint32_t );
+    pRing->cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+    const bool singleMap = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+    if ( singleMap )
+    {
+        pRing->sqMapSize = pRing->cqMapSize = std::max( pRing->sqMapSize, pRing->cqMapSize );
+    }
+    pRing->pSqMap = mmap( nullptr, pRing->sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING );
+    pRing->pCqMap = singleMap ? pRing->pSqMap
+                              : mmap( nullptr, pRing->cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING );
+    pRing->sqesSize = params.sq_entries * sizeof( io_uring_sqe );
+    pRing->pSqes = static_cast<io_uring_sqe*>( mmap( nullptr, pRing->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES ) );
+    if ( pRing->pSqMap == MAP_FAILED || pRing->pCqMap == MAP_FAILED || pRing->pSqes == MAP_FAILED )
+    {
+        __builtin_printf( "Can't map the io_uring rings (%s), using threads\n", strerror( errno ) );
+        _pRing = pRing;
+        destroyRing();
+        return false;
+    }
+
+    uint8_t* pSq = static_cast<uint8_t*>( pRing->pSqMap );
+    uint8_t* pCq = static_cast<uint8_t*>( pRing->pCqMap );
+    pRing->pSqTail = reinterpret_cast<uint32_t*>( pSq + params.sq_off.tail );
+    pRing->sqMask = *reinterpret_cast<uint32_t*>( pSq + params.sq_off.ring_mask );
+    pRing->pSqArray = reinterpret_cast<uint32_t*>( pSq + params.sq_off.array );
+    pRing->pCqHead = reinterpret_cast<uint32_t*>( pCq + params.cq_off.head );
+    pRing->pCqTail = reinterpret_cast<uint32_t*>( pCq + params.cq_off.tail );
+    pRing->cqMask = *reinterpret_cast<uint32_t*>( pCq + params.cq_off.ring_mask );
+    pRing->pCqes = reinterpret_cast<io_uring_cqe*>( pCq + params.cq_off.cqes );
+    pRing->toSubmit = 0;
+    _pRing = pRing;
+    return true;
+}
+
+void AsyncFileIO::destroyRing()
+{
+    if ( _pRing->pSqes && _pRing->pSqes != MAP_FAILED )
+    {
+        munmap( _pRing->pSqes, _pRing->sqesSize );
+    }
+    if ( _pRing->pCqMap && _pRing->pCqMap != MAP_FAILED && _pRing->pCqMap != _pRing->pSqMap )
+    {
+        munmap( _pRing->pCqMap, _pRing->cqMapSize );
+    }
+    if ( _pRing->pSqMap && _pRing->pSqMap != MAP_FAILED )
+    {
+        munmap( _pRing->pSqMap, _pRing->sqMapSize );
+    }
+    ::close( _pRing->fd );
+    delete _pRing;
+    _pRing = nullptr;
+}
+
+// Queued reads into free slots. There are as many slots as SQ entries, so the SQ can't overflow
+// and the CQ - twice the size - never drops a completion
+void AsyncFileIO::fillRing()
+{
+    while ( !_pending.empty() && !_freeSlots.empty() )
+    {
+        const uint32_t slot = _freeSlots.back();
+        _freeSlots.pop_back();
+        _slots[ slot ] = _pending.front();
+        _pending.pop_front();
+        pushSqe( slot );
+    }
+}
+
+// The rest of the slot's read
+void AsyncFileIO::pushSqe( uint32_t slot )
+{
+    const Read& read = _slots[ slot ];
+    const uint32_t tail = *_pRing->pSqTail;
+    const uint32_t index = tail & _pRing->sqMask;
+    io_uring_sqe& sqe = _pRing->pSqes[ index ];
+    memset( &sqe, 0, sizeof( sqe ) );
+    sqe.opcode = read.buffer >= 0 ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe.fd = read.fd;
+    sqe.off = read.offset + read.done;
+    sqe.addr = (uint64_t)(uintptr_t)( read.pDest + read.done );
+    sqe.len = read.size - read.done;
+    sqe.buf_index = read.buffer >= 0 ? (uint16_t)read.buffer : 0;
+    sqe.user_data = slot;
+    _pRing->pSqArray[ index ] = index;
+    __atomic_store_n( _pRing->pSqTail, tail + 1, __ATOMIC_RELEASE );
+    _pRing->toSubmit++;
+}
+
+void AsyncFileIO::enter( uint32_t minComplete )
+{
+    while ( _pRing->toSubmit > 0 || minComplete > 0 )
+    {
+        const int submitted = (int)syscall( __NR_io_uring_enter, _pRing->fd, _pRing->toSubmit, minComplete, minComplete > 0 ? IORING_ENTER_GETEVENTS : 0,
+                                            nullptr, 0 );
+        _stats.systemCalls++;
+        if ( submitted < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+            __builtin_printf( "io_uring_enter failed: %s\n", strerror( errno ) );
+            assert( false );
+            return;
+        }
+        _pRing->toSubmit -= (uint32_t)submitted;
+        minComplete = 0;
+    }
+}
+
+size_t AsyncFileIO::reapRing( Completion* pCompletions, size_t maxCompletions )
+{
+    size_t count = 0;
+    uint32_t head = *_pRing->pCqHead;
+    const uint32_t tail = __atomic_load_n( _pRing->pCqTail, __ATOMIC_ACQUIRE );
+    for ( ; head != tail && count < maxCompletions; ++head )
+    {
+        const io_uring_cqe& cqe = _pRing->pCqes[ head & _pRing->cqMask ];
+        const uint32_t slot = (uint32_t)cqe.user_data;
+        Read& read = _slots[ slot ];
+        if ( cqe.res > 0 )
+        {
+            read.done += (uint32_t)cqe.res;
+            if ( read.done < read.size && read.offset + read.done < read.fileSize )
+            {
+                pushSqe( slot );
+                _stats.continued++;
+                continue;
+            }
+        }
+        pCompletions[ count++ ] = { read.request, read.pUser, cqe.res < 0 ? (int64_t)cqe.res : (int64_t)read.done };
+        _freeSlots.push_back( slot );
+    }
+    __atomic_store_n( _pRing->pCqHead, head, __ATOMIC_RELEASE );
+    return count;
+}
+
+#else
+
+bool AsyncFileIO::setupRing( uint32_t entries )
+{
+    return false;
+}
+
+void AsyncFileIO::destroyRing() {}
+void AsyncFileIO::fillRing() {}
+void AsyncFileIO::pushSqe( uint32_t slot ) {}
+void AsyncFileIO::enter( uint32_t minComplete ) {}
+
+size_t AsyncFileIO::reapRing( Completion* pCompletions, size_t maxCompletions )
+{
+    return 0;
+}
+
+#endif
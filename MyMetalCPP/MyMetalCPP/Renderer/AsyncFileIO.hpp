@@ -0,0 +1,164 @@
+//
+//  AsyncFileIO.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Batched asynchronous file reads, collected by polling from the frame loop.
+//
+// read() queues a read and returns straight away. submit() hands everything queued to the
+// backend at once, and poll() collects what has finished without blocking, so a frame loop can
+// keep hundreds of reads in flight for a couple of calls a frame. wait() blocks for at least one
+// when there's nothing else to do.
+//
+// On Linux the backend is io_uring, driven through its system calls directly: a batch is one
+// io_uring_enter, and poll() reads the completion ring from user space without entering the
+// kernel at all. Buffers given to registerBuffers() are pinned once, and reads landing in them
+// go as READ_FIXED, skipping the per-read page mapping. Elsewhere, or where io_uring isn't
+// allowed, a pool of threads doing blocking pread()s stands in behind the same interface.
+//
+// A file opened direct bypasses the page cache - O_DIRECT on Linux, F_NOCACHE on macOS - for
+// big pack files read once, where caching would only evict something useful. Direct reads need
+// the destination, offset and size aligned to kDirectAlignment. Where the filesystem refuses,
+// the file opens buffered and isDirect() says so.
+//
+// Short reads carry on from where they stopped until the size is read or the file ends, so a
+// completion's result is the whole read's byte count, or a negative errno.
+
+class AsyncFileIO
+{
+public:
+    typedef uint64_t Request;
+    typedef uint32_t File;
+    static constexpr Request kInvalidRequest = 0;
+    static constexpr File kInvalidFile = ~0u;
+    static constexpr size_t kDirectAlignment = 4096;
+
+    enum class Backend
+    {
+        IoUring,
+        Threads
+    };
+
+    struct Buffer
+    {
+        void* pData;
+        size_t size;
+    };
+
+    struct Completion
+    {
+        Request request;
+        void* pUser;
+        int64_t result;             // bytes read, or -errno
+    };
+
+    struct Stats
+    {
+        uint64_t reads;
+        uint64_t completed;
+        uint64_t bytes;
+        uint64_t fixedReads;        // into registered buffers
+        uint64_t systemCalls;       // io_uring_enter, or batches handed to the threads
+        uint64_t continued;         // short reads picked up again
+    };
+
+    // queueDepth reads in flight at once, the rest wait in order. Falls back to threadCount
+    // threads when io_uring isn't there
+    AsyncFileIO( uint32_t queueDepth, Backend backend, uint32_t threadCount );
+    // Waits for reads in flight, drops the queued ones and closes every file
+    ~AsyncFileIO();
+
+    AsyncFileIO( const AsyncFileIO& ) = delete;
+    AsyncFileIO& operator=( const AsyncFileIO& ) = delete;
+
+    // kInvalidFile if it can't be opened
+    File open( const char* path, bool direct );
+    void close( File file );
+    uint64_t fileSize( File file ) const { return _files[ file ].size; }
+    bool isDirect( File file ) const { return _files[ file ].direct; }
+
+    // Once, before any reads. True if the kernel pinned them; reads still work either way
+    bool registerBuffers( const std::vector<Buffer>& buffers );
+
+    // Queued until submit(). pDest stays untouched by the caller until its completion
+    Request read( File file, uint64_t offset, uint32_t size, void* pDest, void* pUser );
+    void submit();
+
+    // Up to maxCompletions finished reads, never blocking. Also keeps the queue moving
+    size_t poll( Completion* pCompletions, size_t maxCompletions );
+    // Submits, then blocks until there's at least one unless nothing is outstanding
+    size_t wait( Completion* pCompletions, size_t maxCompletions );
+
+    // Queued or in flight, not yet returned by poll()
+    size_t outstanding() const;
+
+    Backend backend() const { return _pRing ? Backend::IoUring : Backend::Threads; }
+    // "io_uring" or "threads"
+    const char* backendName() const;
+    const Stats& stats() const { return _stats; }
+
+private:
+    struct Ring;
+
+    struct FileInfo
+    {
+        int fd;
+        uint64_t size;
+        bool direct;
+    };
+
+    struct Read
+    {
+        Request request;
+        int fd;
+        uint64_t fileSize;
+        uint64_t offset;
+        uint8_t* pDest;
+        uint32_t size;
+        uint32_t done;
+        int32_t buffer;             // registered buffer index, -1 for none
+        void* pUser;
+    };
+
+    bool setupRing( uint32_t entries );
+    void destroyRing();
+    void fillRing();
+    void pushSqe( uint32_t slot );
+    void enter( uint32_t minComplete );
+    size_t reapRing( Completion* pCompletions, size_t maxCompletions );
+    int32_t bufferIndex( const void* pDest, uint32_t size ) const;
+    void threadMain();
+
+    uint32_t _queueDepth;
+    std::vector<FileInfo> _files;
+    std::vector<Buffer> _buffers;
+    bool _buffersRegistered;
+    Request _nextRequest;
+    std::deque<Read> _pending;          // read() but not yet with the backend
+    Stats _stats;
+
+    // io_uring, nullptr for threads
+    Ring* _pRing;
+    std::vector<Read> _slots;           // in flight, indexed by user_data
+    std::vector<uint32_t> _freeSlots;
+
+    // threads
+    mutable std::mutex _mutex;          // everything below
+    std::condition_variable _wake;
+    std::condition_variable _finished;
+    std::deque<Read> _queue;
+    std::deque<Completion> _completed;
+    size_t _submitted;                  // handed to the threads, not yet polled
+    bool _quit;
+    std::vector<std::thread> _threads;
+};
@@ -0,0 +1,185 @@
+//
+//  BindlessTable.cpp
+//  MyMetalCPP
+//
+
+#include "BindlessTable.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+BindlessTable::BindlessTable( MTL::Device* pDevice, MTL::Function* pFragmentFn, NS::UInteger bufferIndex, uint32_t capacity )
+: _slots( capacity )
+, _pEncoder( pFragmentFn->newArgumentEncoder( bufferIndex ) )
+, _bufferIndex( bufferIndex )
+, _textures( capacity, nullptr )
+, _buffers( capacity, nullptr )
+, _residentDirty( false )
+{
+    // array elements are encodedLength apart, rounded up to the encoder's alignment
+    const NS::UInteger alignment = std::max<NS::UInteger>( _pEncoder->alignment(), 1 );
+    _stride = ( _pEncoder->encodedLength() + alignment - 1 ) / alignment * alignment;
+    _pBuffer = pDevice->newBuffer( _stride * capacity, MTL::ResourceStorageModeShared );
+    memset( _pBuffer->contents(), 0, _pBuffer->length() );
+}
+
+BindlessTable::~BindlessTable()
+{
+    for ( MTL::Texture* pTexture : _textures )
+    {
+        if ( pTexture )
+        {
+            pTexture->release();
+        }
+    }
+    for ( MTL::Buffer* pBuffer : _buffers )
+    {
+        if ( pBuffer )
+        {
+            pBuffer->release();
+        }
+    }
+    for ( const PendingTexture& pending : _pendingReplaces )
+    {
+        pending.pTexture->release();
+    }
+    for ( const PendingTexture& pending : _pendingReleases )
+    {
+        pending.pTexture->release();
+    }
+    _pBuffer->release();
+    _pEncoder->release();
+}
+
+BindlessTable::Handle BindlessTable::add( MTL::Texture* pTexture, MTL::Buffer* pData, NS::UInteger dataOffset )
+{
+    const Handle handle = _slots.allocate();
+    if ( handle == SlotAllocator::kInvalidHandle )
+    {
+        __builtin_printf( "BindlessTable: all %u slots in use\n", _slots.capacity() );
+        return handle;
+    }
+
+    const uint32_t slot = SlotAllocator::index( handle );
+    std::lock_guard<std::mutex> lock( _mutex );
+    _pEncoder->setArgumentBuffer( _pBuffer, slot * _stride );
+    _pEncoder->setTexture( pTexture, 0 );
+    _pEncoder->setBuffer( pData, dataOffset, 1 );
+
+    _textures[ slot ] = pTexture->retain();
+    _residentDirty |= _textureSlots[ pTexture ]++ == 0;
+    _buffers[ slot ] = pData->retain();
+    _residentDirty |= _bufferSlots[ pData ]++ == 0;
+    return handle;
+}
+
+void BindlessTable::remove( Handle handle, uint64_t frame )
+{
+    assert( _slots.isValid( handle ) );
+    std::lock_guard<std::mutex> lock( _mutex );
+    assert( _pendingRemoves.empty() || _pendingRemoves.back().frame <= frame );
+    _pendingRemoves.push_back( { frame, handle } );
+}
+
+void BindlessTable::replace( Handle handle, MTL::Texture* pTexture, uint64_t frame )
+{
+    assert( _slots.isValid( handle ) );
+    std::lock_guard<std::mutex> lock( _mutex );
+    assert( _pendingReplaces.empty() || _pendingReplaces.back().frame <= frame );
+    _pendingReplaces.push_back( { frame, handle, pTexture->retain() } );
+    _residentDirty |= _textureSlots[ pTexture ]++ == 0;
+}
+
+void BindlessTable::dropTexture( MTL::Texture* pTexture )
+{
+    if ( --_textureSlots[ pTexture ] == 0 )
+    {
+        _textureSlots.erase( pTexture );
+        _residentDirty = true;
+    }
+    pTexture->release();
+}
+
+void BindlessTable::dropBuffer( MTL::Buffer* pBuffer )
+{
+    if ( --_bufferSlots[ pBuffer ] == 0 )
+    {
+        _bufferSlots.erase( pBuffer );
+        _residentDirty = true;
+    }
+    pBuffer->release();
+}
+
+uint32_t BindlessTable::index( Handle handle ) const
+{
+    assert( _slots.isValid( handle ) );
+    return SlotAllocator::index( handle );
+}
+
+void BindlessTable::beginFrame( uint64_t frame, uint64_t retiredFrame )
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    while ( !_pendingReleases.empty() && _pendingReleases.front().frame <= retiredFrame )
+    {
+        dropTexture( _pendingReleases.front().pTexture );
+        _pendingReleases.pop_front();
+    }
+
+    // every frame in flight has the new texture resident by now
+    while ( !_pendingReplaces.empty() && _pendingReplaces.front().frame <= retiredFrame )
+    {
+        const PendingTexture replace = _pendingReplaces.front();
+        _pendingReplaces.pop_front();
+        if ( !_slots.isValid( replace.handle ) )
+        {
+            dropTexture( replace.pTexture );    // removed meanwhile
+            continue;
+        }
+        const uint32_t slot = SlotAllocator::index( replace.handle );
+        _pEncoder->setArgumentBuffer( _pBuffer, slot * _stride );
+        _pEncoder->setTexture( replace.pTexture, 0 );
+        _pendingReleases.push_back( { frame, SlotAllocator::kInvalidHandle, _textures[ slot ] } );
+        _textures[ slot ] = replace.pTexture;
+    }
+
+    while ( !_pendingRemoves.empty() && _pendingRemoves.front().frame <= retiredFrame )
+    {
+        const Handle handle = _pendingRemoves.front().handle;
+        _pendingRemoves.pop_front();
+        const uint32_t slot = SlotAllocator::index( handle );
+        dropTexture( _textures[ slot ] );
+        _textures[ slot ] = nullptr;
+        dropBuffer( _buffers[ slot ] );
+        _buffers[ slot ] = nullptr;
+        _slots.free( handle );
+    }
+
+    if ( _residentDirty )
+    {
+        _resident.clear();
+        for ( const auto& textureSlots : _textureSlots )
+        {
+            _resident.push_back( textureSlots.first );
+        }
+        _residentBuffers.clear();
+        for ( const auto& bufferSlots : _bufferSlots )
+        {
+            _residentBuffers.push_back( bufferSlots.first );
+        }
+        _residentDirty = false;
+    }
+}
+
+void BindlessTable::bind( MTL::RenderCommandEncoder* pEnc ) const
+{
+    pEnc->setFragmentBuffer( _pBuffer, /* offset */ 0, _bufferIndex );
+    if ( !_resident.empty() )
+    {
+        pEnc->useResources( const_cast< MTL::Resource** >( _resident.data() ), _resident.size(), MTL::ResourceUsageSample );
+    }
+    if ( !_residentBuffers.empty() )
+    {
+        pEnc->useResources( const_cast< MTL::Resource** >( _residentBuffers.data() ), _residentBuffers.size(), MTL::ResourceUsageRead );
+    }
+}
@@ -0,0 +1,101 @@
+//
+//  BindlessTable.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include "Common.h"
+#include "SlotAllocator.hpp"
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// Every material in one argument buffer, indexed by the shader - the Material array of
+// fragmentMainBindless. Draws bind the table once per encoder and each instance carries its
+// material's index, so nothing is bound per draw.
+//
+// Slots come from a SlotAllocator, lock free and generation checked. Writing a slot goes
+// through the ArgumentEncoder, which is stateful, so that part takes a lock. remove() keeps the
+// slot and its texture until the frame it was removed in retires, as numbered by ReleaseQueue -
+// frames in flight may still read it.
+//
+// A material is a texture and a buffer - its MaterialData, at an offset so many materials can
+// share one buffer. Residency is declared per encoder in one useResources call over every
+// distinct texture in the table and one over every distinct buffer. beginFrame() rebuilds that list when materials have come or gone, after which bind()
+// only reads, so parallel encoders can call it from their own jobs. A material added mid-frame
+// is resident from the next beginFrame().
+//
+// replace() points a slot at another texture without moving it, so instances keep their index.
+// Frames in flight read the slot as the GPU gets to it, so the new texture is made resident
+// first and the slot is only written once every frame encoded without it has retired. The old
+// texture stays resident until the frame the slot was written in retires.
+
+class BindlessTable
+{
+public:
+    typedef SlotAllocator::Handle Handle;
+
+    // pFragmentFn's argument at bufferIndex is the material array
+    BindlessTable( MTL::Device* pDevice, MTL::Function* pFragmentFn, NS::UInteger bufferIndex, uint32_t capacity );
+    ~BindlessTable();
+
+    // SlotAllocator::kInvalidHandle when the table is full
+    Handle add( MTL::Texture* pTexture, MTL::Buffer* pData, NS::UInteger dataOffset );
+    void remove( Handle handle, uint64_t frame );
+
+    // The material's texture from the first beginFrame() after frame retires
+    void replace( Handle handle, MTL::Texture* pTexture, uint64_t frame );
+
+    // What the shader indexes with - InstanceData::materialIndex
+    uint32_t index( Handle handle ) const;
+
+    // Frees the slots of frames up to retiredFrame, writes the replacements they were waiting
+    // on and refreshes the resident list. frame is the one about to be encoded
+    void beginFrame( uint64_t frame, uint64_t retiredFrame );
+
+    // Binds the table to the fragment stage and makes its textures and buffers resident
+    void bind( MTL::RenderCommandEncoder* pEnc ) const;
+
+    uint32_t materialCount() const { return _slots.used(); }
+    size_t residentCount() const { return _resident.size(); }
+    size_t residentBufferCount() const { return _residentBuffers.size(); }
+
+private:
+    struct PendingRemove
+    {
+        uint64_t frame;
+        Handle handle;
+    };
+
+    struct PendingTexture
+    {
+        uint64_t frame;
+        Handle handle;              // replacing, or kInvalidHandle to release
+        MTL::Texture* pTexture;
+    };
+
+    // one fewer slot using pTexture
+    void dropTexture( MTL::Texture* pTexture );
+    void dropBuffer( MTL::Buffer* pBuffer );
+
+    SlotAllocator _slots;
+    MTL::ArgumentEncoder* _pEncoder;
+    MTL::Buffer* _pBuffer;
+    NS::UInteger _bufferIndex;
+    NS::UInteger _stride;
+
+    std::mutex _mutex;                                          // the encoder and everything below
+    std::vector<MTL::Texture*> _textures;                       // per slot, retained while it's in use
+    std::unordered_map<MTL::Texture*, uint32_t> _textureSlots;  // slots using each texture
+    std::vector<MTL::Buffer*> _buffers;                         // per slot, the same
+    std::unordered_map<MTL::Buffer*, uint32_t> _bufferSlots;
+    std::deque<PendingRemove> _pendingRemoves;
+    std::deque<PendingTexture> _pendingReplaces;
+    std::deque<PendingTexture> _pendingReleases;    // textures replaced out of their slots
+    std::vector<MTL::Resource*> _resident;
+    std::vector<MTL::Resource*> _residentBuffers;
+    bool _residentDirty;
+};
@@ -0,0 +1,94 @@
+//
+//  CommandRecorder.cpp
+//  MyMetalCPP
+//
+
+#include "CommandRecorder.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+CommandRecorder::CommandRecorder()
+: _listCount( 0 )
+, _stats()
+{
+}
+
+void CommandRecorder::begin()
+{
+    _listCount = 0;
+    _packets.clear();
+    _stats = Stats();
+}
+
+void CommandRecorder::record( size_t count, size_t grainSize, const RecordFn& fn )
+{
+    if ( count == 0 )
+    {
+        return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    grainSize = std::max<size_t>( grainSize, 1 );
+    const size_t first = _listCount;
+    _listCount += ( count + grainSize - 1 ) / grainSize;
+    if ( _lists.size() < _listCount )
+    {
+        _lists.resize( _listCount );
+    }
+
+    // a call can cover several pieces, each still gets its own list
+    JobSystem::Instance()->parallelFor( count, grainSize, [&]( size_t begin, size_t end )
+    {
+        for ( size_t piece = begin / grainSize; piece * grainSize < end; ++piece )
+        {
+            CommandList& list = _lists[ first + piece ];
+            list.clear();
+            fn( piece * grainSize, std::min( end, ( piece + 1 ) * grainSize ), list );
+        }
+    } );
+    _stats.lists = _listCount;
+    _stats.recordMs += elapsedMs( start );
+}
+
+const std::vector<DrawPacket>& CommandRecorder::merge()
+{
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<size_t> offsets( _listCount + 1, 0 );
+    for ( size_t l = 0; l < _listCount; ++l )
+    {
+        offsets[ l + 1 ] = offsets[l] + _lists[l].size();
+    }
+    _packets.resize( offsets[ _listCount ] );
+    JobSystem::Instance()->parallelFor( _listCount, 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t l = begin; l < end; ++l )
+        {
+            if ( _lists[l].size() > 0 )
+            {
+                memcpy( _packets.data() + offsets[l], _lists[l].data(), _lists[l].size() * sizeof( DrawPacket ) );
+            }
+        }
+    } );
+    _stats.packets = _packets.size();
+    _stats.mergeMs = elapsedMs( start );
+    return _packets;
+}
+
+uint32_t CommandRecorder::split( uint32_t maxSegments, size_t minPackets, Segment* pSegments ) const
+{
+    const size_t count = _packets.size();
+    const size_t segmentCount = std::max<size_t>( 1, std::min<size_t>( maxSegments, count / std::max<size_t>( minPackets, 1 ) ) );
+    for ( size_t s = 0; s < segmentCount; ++s )
+    {
+        const size_t first = count * s / segmentCount;
+        pSegments[s] = { first, count * ( s + 1 ) / segmentCount - first };
+    }
+    return (uint32_t)segmentCount;
+}
@@ -0,0 +1,129 @@
+//
+//  CommandRecorder.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Draws recorded on the JobSystem as plain packets, merged in a fixed order and replayed into
+// encoders - no Metal in here, so recording, merging and replay all run and check on the CPU.
+//
+// record() splits the work into grainSize pieces and every piece records into its own
+// CommandList, whichever thread it lands on. The lists are numbered by piece, so merge()
+// concatenates them into one stream that is the same draw for draw however many threads ran
+// and however the pieces were shared out - the same as recording serially.
+//
+// A packet carries its whole state, pipeline, view, mesh and texture as indices into the
+// caller's tables. replay() walks a run of packets calling the encoder only when the state
+// changes. split() cuts the stream into contiguous segments for a ParallelRenderCommandEncoder
+// - one sub-encoder per segment, created in stream order so the GPU executes them in that
+// order, each replayed on its own job starting from no state.
+
+struct DrawPacket
+{
+    uint32_t pipeline;
+    uint32_t view;
+    uint32_t mesh;
+    uint32_t texture;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+class CommandList
+{
+public:
+    void draw( const DrawPacket& packet ) { _packets.push_back( packet ); }
+    void clear() { _packets.clear(); }
+
+    size_t size() const { return _packets.size(); }
+    const DrawPacket* data() const { return _packets.data(); }
+
+private:
+    std::vector<DrawPacket> _packets;
+};
+
+class CommandRecorder
+{
+public:
+    struct Segment
+    {
+        size_t first;
+        size_t count;
+    };
+
+    struct Stats
+    {
+        size_t packets;
+        size_t lists;
+        double recordMs;
+        double mergeMs;
+    };
+
+    typedef std::function<void( size_t begin, size_t end, CommandList& list )> RecordFn;
+
+    CommandRecorder();
+
+    // Starts a frame, dropping everything recorded
+    void begin();
+
+    // Calls fn over [0, count) one grainSize piece at a time, each with its own list. Several
+    // calls in a frame merge one after another
+    void record( size_t count, size_t grainSize, const RecordFn& fn );
+
+    // The lists of this frame, in order
+    const std::vector<DrawPacket>& merge();
+    const std::vector<DrawPacket>& packets() const { return _packets; }
+
+    // Up to maxSegments runs of the merged packets, none under minPackets unless there's only
+    // one. Returns how many
+    uint32_t split( uint32_t maxSegments, size_t minPackets, Segment* pSegments ) const;
+
+    const Stats& stats() const { return _stats; }
+
+    // Encoder has setPipeline, setView, setMesh and setTexture taking the packet's index, and
+    // draw( const DrawPacket& ). Returns the number of state changes made
+    template<typename Encoder>
+    static size_t replay( const DrawPacket* pPackets, size_t count, Encoder& encoder )
+    {
+        static constexpr uint32_t kNone = ~0u;
+        uint32_t pipeline = kNone, view = kNone, mesh = kNone, texture = kNone;
+        size_t changes = 0;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            const DrawPacket& packet = pPackets[i];
+            if ( packet.pipeline != pipeline )
+            {
+                encoder.setPipeline( pipeline = packet.pipeline );
+                ++changes;
+            }
+            if ( packet.view != view )
+            {
+                encoder.setView( view = packet.view );
+                ++changes;
+            }
+            if ( packet.mesh != mesh )
+            {
+                encoder.setMesh( mesh = packet.mesh );
+                ++changes;
+            }
+            if ( packet.texture != texture )
+            {
+                encoder.setTexture( texture = packet.texture );
+                ++changes;
+            }
+            encoder.draw( packet );
+        }
+        return changes;
+    }
+
+private:
+    std::vector<CommandList> _lists;    // grown as needed, kept between frames for their capacity
+    size_t _listCount;                  // in use this frame
+    std::vector<DrawPacket> _packets;
+    Stats _stats;
+};
@@ -0,0 +1,108 @@
+//
+//  DrawQueue.cpp
+//  MyMetalCPP
+//
+
+#include "DrawQueue.hpp"
+#include "../Jobs/JobSystem.hpp"
+#include "../Jobs/RadixSort.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+
+static constexpr size_t kInstancesPerJob = 4096;
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static void countChange( DrawQueue::StateChanges& changes, uint64_t key, uint64_t previous, bool first )
+{
+    changes.pipelines += first || DrawQueue::keyPipeline( key ) != DrawQueue::keyPipeline( previous ) ? 1 : 0;
+    changes.textures += first || DrawQueue::keyTexture( key ) != DrawQueue::keyTexture( previous ) ? 1 : 0;
+    changes.meshes += first || DrawQueue::keyMesh( key ) != DrawQueue::keyMesh( previous ) ? 1 : 0;
+}
+
+uint64_t DrawQueue::makeKey( uint32_t pipeline, uint32_t texture, float depth, uint32_t mesh, uint32_t depthLevels )
+{
+    assert( pipeline < ( 1u << kPipelineBits ) && texture < ( 1u << kTextureBits ) && mesh < ( 1u << kMeshBits ) );
+    assert( depthLevels >= 1 && depthLevels <= ( 1u << kDepthBits ) );
+    const float clamped = std::min( std::max( depth, 0.f ), 1.f );
+    const uint64_t quantized = std::min( (uint64_t)( clamped * (float)depthLevels ), (uint64_t)depthLevels - 1 );
+    return ( (uint64_t)pipeline << kPipelineShift ) | ( (uint64_t)texture << kTextureShift ) | ( quantized << kDepthShift ) |
+           ( (uint64_t)mesh << kMeshShift );
+}
+
+DrawQueue::DrawQueue()
+: _stats()
+{
+}
+
+void DrawQueue::clear()
+{
+    _keys.clear();
+    _payloads.clear();
+    _batches.clear();
+}
+
+void DrawQueue::reserve( size_t drawCount )
+{
+    _keys.reserve( drawCount );
+    _payloads.reserve( drawCount );
+}
+
+const std::vector<DrawQueue::Batch>& DrawQueue::build()
+{
+    const size_t count = _keys.size();
+    _stats = Stats();
+    _stats.draws = count;
+    _batches.clear();
+
+    auto start = std::chrono::steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        countChange( _stats.submitted, _keys[i], i > 0 ? _keys[ i - 1 ] : 0, i == 0 );
+    }
+    double countMs = elapsedMs( start );
+
+    start = std::chrono::steady_clock::now();
+    _scratchKeys.resize( count );
+    _scratchPayloads.resize( count );
+    _stats.sortPasses = RadixSort::sort( _keys.data(), _payloads.data(), count, _scratchKeys.data(), _scratchPayloads.data() );
+    _stats.sortMs = elapsedMs( start );
+
+    // merge runs that differ only in depth
+    start = std::chrono::steady_clock::now();
+    for ( size_t i = 0; i < count; ++i )
+    {
+        const uint64_t key = _keys[i];
+        if ( i > 0 && ( ( key ^ _keys[ i - 1 ] ) & ~kDepthMask ) == 0 )
+        {
+            ++_batches.back().instanceCount;
+            continue;
+        }
+        _batches.push_back( { keyPipeline( key ), keyTexture( key ), keyMesh( key ), (uint32_t)i, 1 } );
+    }
+    for ( size_t b = 0; b < _batches.size(); ++b )
+    {
+        const uint64_t key = _keys[ _batches[b].firstInstance ];
+        countChange( _stats.batched, key, b > 0 ? _keys[ _batches[ b - 1 ].firstInstance ] : 0, b == 0 );
+    }
+    _stats.batches = _batches.size();
+    _stats.batchMs = countMs + elapsedMs( start );
+    return _batches;
+}
+
+void DrawQueue::gather( const InstanceData* pSource, InstanceData* pDest ) const
+{
+    JobSystem::Instance()->parallelFor( _payloads.size(), kInstancesPerJob, [&]( size_t begin, size_t end )
+    {
+        for ( size_t i = begin; i < end; ++i )
+        {
+            memcpy( pDest + i, pSource + _payloads[i], sizeof( InstanceData ) );
+        }
+    } );
+}
@@ -0,0 +1,119 @@
+//
+//  DrawQueue.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Shaders/ShaderStructs.h"
+
+// Draw submission for a frame, sorted by state and merged into instanced draws.
+//
+// Every draw is one instance with a 64 bit key, most expensive state change in the top bits:
+//
+//   63      56 55          40 39          24 23                 0
+//   | pipeline |   texture    |    depth     |        mesh         |
+//
+// and a payload handed back in sorted order - usually the index of its InstanceData. Keys are
+// sorted with RadixSort, so draws end up grouped by pipeline, then texture, then front to back
+// within each (depth is the 0 to 1 clip depth). Neighbours that differ only in depth are then
+// merged into one Batch - an instanced draw over a contiguous range of the sorted order - so
+// gather() the instance data into that order before drawing the batches.
+//
+// Depth comes before the mesh so opaque draws still go roughly front to back, which means
+// draws of the same mesh only merge while no other mesh lands between them. The depth levels
+// makeKey() quantizes to trade the two off - all 65536 sorts strictly, a few dozen is enough
+// for early depth rejection and leaves far fewer, bigger batches.
+//
+// Stats count binds - pipeline, texture and mesh changes, the first draw included - issuing the
+// draws as submitted and issuing the batches.
+
+class DrawQueue
+{
+public:
+    static constexpr uint32_t kPipelineBits = 8;
+    static constexpr uint32_t kTextureBits = 16;
+    static constexpr uint32_t kDepthBits = 16;
+    static constexpr uint32_t kMeshBits = 24;
+    static_assert( kPipelineBits + kTextureBits + kDepthBits + kMeshBits == 64, "sort keys are 64 bits" );
+
+    static constexpr uint32_t kMeshShift = 0;
+    static constexpr uint32_t kDepthShift = kMeshBits;
+    static constexpr uint32_t kTextureShift = kDepthShift + kDepthBits;
+    static constexpr uint32_t kPipelineShift = kTextureShift + kTextureBits;
+    static constexpr uint64_t kDepthMask = ( ( 1ull << kDepthBits ) - 1 ) << kDepthShift;
+
+    struct Batch
+    {
+        uint32_t pipeline;
+        uint32_t texture;
+        uint32_t mesh;
+        uint32_t firstInstance;     // into the sorted order
+        uint32_t instanceCount;
+    };
+
+    struct StateChanges
+    {
+        size_t pipelines;
+        size_t textures;
+        size_t meshes;
+    };
+
+    struct Stats
+    {
+        size_t draws;
+        size_t batches;
+        StateChanges submitted;     // issuing every draw in submission order
+        StateChanges batched;       // issuing the batches
+        uint32_t sortPasses;        // radix digits that weren't the same in every key
+        double sortMs;
+        double batchMs;             // merging and counting
+    };
+
+    static constexpr uint32_t kDefaultDepthLevels = 64;
+
+    // depthLevels up to 1 << kDepthBits
+    static uint64_t makeKey( uint32_t pipeline, uint32_t texture, float depth, uint32_t mesh,
+                             uint32_t depthLevels = kDefaultDepthLevels );
+    static uint32_t keyPipeline( uint64_t key ) { return (uint32_t)( key >> kPipelineShift ); }
+    static uint32_t keyTexture( uint64_t key ) { return (uint32_t)( key >> kTextureShift ) & ( ( 1u << kTextureBits ) - 1 ); }
+    static uint32_t keyMesh( uint64_t key ) { return (uint32_t)( key >> kMeshShift ) & ( ( 1u << kMeshBits ) - 1 ); }
+
+    DrawQueue();
+
+    void clear();
+    void reserve( size_t drawCount );
+
+    void submit( uint64_t key, uint32_t payload )
+    {
+        _keys.push_back( key );
+        _payloads.push_back( payload );
+    }
+
+    size_t size() const { return _keys.size(); }
+
+    // Sorts the submitted draws and merges them into batches. The queue then holds the draws in
+    // sorted order until the next clear()
+    const std::vector<Batch>& build();
+
+    const std::vector<Batch>& batches() const { return _batches; }
+    const uint64_t* keys() const { return _keys.data(); }
+    const uint32_t* payloads() const { return _payloads.data(); }
+
+    // pDest[i] = pSource[ payloads()[i] ], so batches index pDest directly
+    void gather( const InstanceData* pSource, InstanceData* pDest ) const;
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    std::vector<uint64_t> _keys;
+    std::vector<uint32_t> _payloads;
+    std::vector<uint64_t> _scratchKeys;
+    std::vector<uint32_t> _scratchPayloads;
+    std::vector<Batch> _batches;
+    Stats _stats;
+};
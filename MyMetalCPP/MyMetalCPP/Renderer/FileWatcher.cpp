@@ -0,0 +1,227 @@
+//
+//  FileWatcher.cpp
+//  MyMetalCPP
+//
+
+#include "FileWatcher.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#if defined( __linux__ )
+#include <poll.h>
+#include <sys/inotify.h>
+#elif defined( __APPLE__ )
+#include <sys/event.h>
+#endif
+
+static int64_t modifiedNs( const struct stat& info )
+{
+#if defined( __APPLE__ )
+    return (int64_t)info.st_mtimespec.tv_sec * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    return (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+}
+
+FileWatcher::FileWatcher()
+{
+#if defined( __linux__ )
+    _fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+#elif defined( __APPLE__ )
+    _fd = kqueue();
+#else
+    _fd = -1;
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+    for ( const auto& file : _files )
+    {
+        if ( file.second.fd >= 0 )
+        {
+            close( file.second.fd );
+        }
+    }
+    for ( int fd : _directoryFds )
+    {
+        close( fd );
+    }
+    if ( _fd >= 0 )
+    {
+        close( _fd );
+    }
+}
+
+const char* FileWatcher::backend()
+{
+#if defined( __linux__ )
+    return "inotify";
+#elif defined( __APPLE__ )
+    return "kqueue";
+#else
+    return "polling";
+#endif
+}
+
+bool FileWatcher::addDirectory( const std::string& directory )
+{
+#if defined( __linux__ )
+    // writes closed and files renamed in cover both ways of saving
+    if ( _fd < 0 || inotify_add_watch( _fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE ) < 0 )
+    {
+        return false;
+    }
+#elif defined( __APPLE__ )
+    // a directory's vnode sees entries come and go, its files' writes need their own
+    const int fd = open( directory.c_str(), O_EVTONLY );
+    if ( _fd < 0 || fd < 0 )
+    {
+        return false;
+    }
+    struct kevent change;
+    EV_SET( &change, fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE, 0, nullptr );
+    kevent( _fd, &change, 1, nullptr, 0, nullptr );
+    _directoryFds.push_back( fd );
+#else
+    DIR* pDir = opendir( directory.c_str() );
+    if ( !pDir )
+    {
+        return false;
+    }
+    closedir( pDir );
+#endif
+    _directories.push_back( directory );
+    scan( directory, nullptr );
+    return true;
+}
+
+bool FileWatcher::waitForEvent( uint32_t timeoutMs )
+{
+#if defined( __linux__ )
+    pollfd pfd = { _fd, POLLIN, 0 };
+    if ( poll( &pfd, 1, (int)timeoutMs ) <= 0 )
+    {
+        return false;
+    }
+    // what the events were doesn't matter, scan() works that out
+    alignas( inotify_event ) char buffer[ 4096 ];
+    while ( read( _fd, buffer, sizeof( buffer ) ) > 0 )
+    {
+    }
+    return true;
+#elif defined( __APPLE__ )
+    struct kevent events[ 16 ];
+    const timespec timeout = { timeoutMs / 1000, ( timeoutMs % 1000 ) * 1000000 };
+    const timespec drain = { 0, 0 };
+    bool woken = false;
+    while ( kevent( _fd, nullptr, 0, events, 16, woken ? &drain : &timeout ) > 0 )
+    {
+        woken = true;
+    }
+    return woken;
+#else
+    std::this_thread::sleep_for( std::chrono::milliseconds( timeoutMs ) );
+    return true;
+#endif
+}
+
+std::vector<std::string> FileWatcher::wait( uint32_t timeoutMs )
+{
+    std::vector<std::string> changed;
+#if defined( __linux__ ) || defined( __APPLE__ )
+    if ( !waitForEvent( timeoutMs ) )
+    {
+        return changed;
+    }
+    while ( waitForEvent( kSettleMs ) )
+    {
+    }
+    for ( const std::string& directory : _directories )
+    {
+        scan( directory, &changed );
+    }
+#else
+    // nothing to wake on, so a change is only settled once a scan after it finds no more
+    waitForEvent( timeoutMs );
+    for ( const std::string& directory : _directories )
+    {
+        scan( directory, &changed );
+    }
+    for ( size_t found = changed.size(); found > 0; )
+    {
+        waitForEvent( kSettleMs );
+        const size_t before = changed.size();
+        for ( const std::string& directory : _directories )
+        {
+            scan( directory, &changed );
+        }
+        found = changed.size() - before;
+    }
+    std::sort( changed.begin(), changed.end() );
+    changed.erase( std::unique( changed.begin(), changed.end() ), changed.end() );
+#endif
+    return changed;
+}
+
+void FileWatcher::scan( const std::string& directory, std::vector<std::string>* pChanged )
+{
+    DIR* pDir = opendir( directory.c_str() );
+    if ( !pDir )
+    {
+        return;
+    }
+    while ( dirent* pEntry = readdir( pDir ) )
+    {
+        const std::string path = directory + "/" + pEntry->d_name;
+        struct stat info;
+        if ( pEntry->d_name[0] == '.' || stat( path.c_str(), &info ) != 0 || !S_ISREG( info.st_mode ) )
+        {
+            continue;
+        }
+
+        auto found = _files.find( path );
+        if ( found == _files.end() )
+        {
+            found = _files.insert( { path, { 0, 0, 0, -1 } } ).first;
+        }
+        else if ( found->second.modified == modifiedNs( info ) && found->second.size == (uint64_t)info.st_size &&
+                  found->second.inode == (uint64_t)info.st_ino )
+        {
+            continue;
+        }
+        if ( pChanged )
+        {
+            pChanged->push_back( path );
+        }
+
+        FileState& state = found->second;
+#if defined( __APPLE__ )
+        if ( state.fd < 0 || state.inode != (uint64_t)info.st_ino )
+        {
+            if ( state.fd >= 0 )
+            {
+                close( state.fd );
+            }
+            state.fd = open( path.c_str(), O_EVTONLY );
+            if ( state.fd >= 0 )
+            {
+                struct kevent change;
+                EV_SET( &change, state.fd, EVFILT_VNODE, EV_ADD | EV_CLEAR, NOTE_WRITE | NOTE_EXTEND | NOTE_DELETE | NOTE_RENAME, 0, nullptr );
+                kevent( _fd, &change, 1, nullptr, 0, nullptr );
+            }
+        }
+#endif
+        state.modified = modifiedNs( info );
+        state.size = (uint64_t)info.st_size;
+        state.inode = (uint64_t)info.st_ino;
+    }
+    closedir( pDir );
+}
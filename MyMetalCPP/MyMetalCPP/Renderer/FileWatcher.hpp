@@ -0,0 +1,60 @@
+//
+//  FileWatcher.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Reports files that change in a set of directories, for a thread that wants to sleep until
+// one does.
+//
+// The kernel wakes wait() - inotify on Linux, kqueue on macOS, a plain sleep elsewhere. Which
+// files changed comes from comparing modification time, size and inode against what the last
+// scan saw, so it doesn't matter how the save was done: written in place, or written elsewhere
+// and renamed over the top the way most editors do it. Once woken, wait() keeps waiting until
+// nothing has happened for kSettleMs, so the burst of events one save makes is reported once
+// and never half written.
+//
+// kqueue watches file descriptors rather than names, so on macOS each file has one open and a
+// file replaced by a rename gets its descriptor reopened on the scan that notices.
+
+class FileWatcher
+{
+public:
+    static constexpr uint32_t kSettleMs = 20;
+
+    FileWatcher();
+    ~FileWatcher();
+
+    // Not recursive. False if it can't be opened
+    bool addDirectory( const std::string& directory );
+
+    // Up to timeoutMs for a change, then the full paths of the files that changed, if any
+    std::vector<std::string> wait( uint32_t timeoutMs );
+
+    // "inotify", "kqueue" or "polling"
+    static const char* backend();
+
+private:
+    struct FileState
+    {
+        int64_t modified;       // ns
+        uint64_t size;
+        uint64_t inode;
+        int fd;                 // kqueue only
+    };
+
+    // True once something happened within timeoutMs, draining what did
+    bool waitForEvent( uint32_t timeoutMs );
+    void scan( const std::string& directory, std::vector<std::string>* pChanged );
+
+    int _fd;                                    // the inotify instance or the kqueue
+    std::vector<std::string> _directories;
+    std::vector<int> _directoryFds;             // kqueue only
+    std::unordered_map<std::string, FileState> _files;
+};
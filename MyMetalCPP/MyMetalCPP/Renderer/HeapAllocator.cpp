@@ -0,0 +1,95 @@
+//
+//  HeapAllocator.cpp
+//  MyMetalCPP
+//
+
+#include "HeapAllocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+HeapAllocator::HeapAllocator( uint64_t blockSize, uint64_t granularity )
+: _blockSize( blockSize )
+, _granularity( granularity )
+, _pendingBytes( 0 )
+{
+    assert( blockSize >= granularity );
+}
+
+HeapAllocator::Allocation HeapAllocator::allocate( uint64_t size, uint64_t alignment )
+{
+    for ( uint32_t block = 0; block < _blocks.size(); ++block )
+    {
+        const TlsfAllocator::Allocation allocation = _blocks[ block ]->allocate( size, alignment );
+        if ( allocation.node != TlsfAllocator::kNoNode )
+        {
+            return { block, allocation.offset, allocation.size, allocation.node };
+        }
+    }
+
+    // room for the worst case alignment padding too, a block's start is aligned to anything
+    const uint64_t needed = size + std::max( alignment, _granularity );
+    const uint64_t capacity = std::max( _blockSize, ( needed + _granularity - 1 ) / _granularity * _granularity );
+    _blocks.emplace_back( new TlsfAllocator( capacity, _granularity ) );
+    const TlsfAllocator::Allocation allocation = _blocks.back()->allocate( size, alignment );
+    assert( allocation.node != TlsfAllocator::kNoNode );
+    return { (uint32_t)_blocks.size() - 1, allocation.offset, allocation.size, allocation.node };
+}
+
+void HeapAllocator::free( const Allocation& allocation, uint64_t frame )
+{
+    assert( allocation.node != TlsfAllocator::kNoNode && allocation.block < _blocks.size() );
+    if ( frame == 0 )
+    {
+        _blocks[ allocation.block ]->free( { allocation.offset, allocation.size, allocation.node } );
+        return;
+    }
+    assert( _pending.empty() || _pending.back().frame <= frame );
+    _pending.push_back( { frame, allocation } );
+    _pendingBytes += allocation.size;
+}
+
+size_t HeapAllocator::collect( uint64_t retiredFrame )
+{
+    size_t freed = 0;
+    while ( !_pending.empty() && _pending.front().frame <= retiredFrame )
+    {
+        const Allocation& allocation = _pending.front().allocation;
+        _blocks[ allocation.block ]->free( { allocation.offset, allocation.size, allocation.node } );
+        _pendingBytes -= allocation.size;
+        _pending.pop_front();
+        ++freed;
+    }
+    return freed;
+}
+
+HeapAllocator::Stats HeapAllocator::stats() const
+{
+    Stats stats = {};
+    stats.blocks = _blocks.size();
+    stats.pendingFree = _pendingBytes;
+    for ( const std::unique_ptr<TlsfAllocator>& pBlock : _blocks )
+    {
+        const TlsfAllocator::Stats blockStats = pBlock->stats();
+        stats.capacity += blockStats.capacity;
+        stats.used += blockStats.used;
+        stats.largestFree = std::max( stats.largestFree, blockStats.largestFree );
+        stats.allocations += blockStats.allocations;
+        stats.freeBlocks += blockStats.freeBlocks;
+    }
+    const uint64_t freeBytes = stats.capacity - stats.used;
+    stats.fragmentation = freeBytes > 0 ? 1.f - (float)( (double)stats.largestFree / (double)freeBytes ) : 0.f;
+    return stats;
+}
+
+bool HeapAllocator::validate() const
+{
+    for ( const std::unique_ptr<TlsfAllocator>& pBlock : _blocks )
+    {
+        if ( !pBlock->validate() )
+        {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+//
+//  HeapAllocator.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include "TlsfAllocator.hpp"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+// Sub-allocations out of a growing set of fixed size blocks, each block a TlsfAllocator - the
+// CPU half of ResourceHeap, with nothing Metal in it.
+//
+// allocate() tries the blocks in order and adds one when none has room, blockSize or, for
+// anything bigger, a block of its own. The owner backs each new block (an MTL::Heap) the first
+// time an Allocation names it.
+//
+// free() takes the frame being recorded, as numbered by ReleaseQueue. The range only goes back
+// to its block once collect() is told that frame has retired - until then a frame in flight
+// may still be reading it, and a new resource placed over it would alias.
+
+class HeapAllocator
+{
+public:
+    struct Allocation
+    {
+        uint32_t block;
+        uint64_t offset;
+        uint64_t size;
+        uint32_t node;      // TlsfAllocator::kNoNode when allocate() failed
+    };
+
+    struct Stats
+    {
+        size_t blocks;
+        uint64_t capacity;
+        uint64_t used;
+        uint64_t pendingFree;       // freed, waiting for its frame to retire
+        uint64_t largestFree;
+        size_t allocations;
+        size_t freeBlocks;          // free ranges across every block
+        float fragmentation;        // 1 - largestFree / free bytes, over every block
+    };
+
+    HeapAllocator( uint64_t blockSize, uint64_t granularity = 256 );
+
+    Allocation allocate( uint64_t size, uint64_t alignment = 0 );
+
+    // Back to the block once frame has retired - 0 for right away
+    void free( const Allocation& allocation, uint64_t frame );
+
+    // Frees everything waiting on frames up to retiredFrame, returns how many
+    size_t collect( uint64_t retiredFrame );
+
+    size_t blockCount() const { return _blocks.size(); }
+    uint64_t blockCapacity( uint32_t block ) const { return _blocks[ block ]->capacity(); }
+    Stats stats() const;
+    bool validate() const;
+
+private:
+    struct PendingFree
+    {
+        uint64_t frame;
+        Allocation allocation;
+    };
+
+    uint64_t _blockSize;
+    uint64_t _granularity;
+    std::vector<std::unique_ptr<TlsfAllocator>> _blocks;
+    std::deque<PendingFree> _pending;       // frames never decrease front to back
+    uint64_t _pendingBytes;
+};
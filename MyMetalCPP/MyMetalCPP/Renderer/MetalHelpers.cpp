@@ -6,3 +6,31 @@
 //
 
 #include "MetalHelpers.hpp"
+#include "../Scene/SceneFile.hpp"
+
+#include <cassert>
+#include <cstring>
+
+namespace MetalHelpers
+{
+    MTL::Buffer* newSceneBuffer( MTL::Device* pDevice, const SceneFile& file )
+    {
+        // the mapping is page aligned and mappedSize() whole pages, as bytesNoCopy needs
+        assert( file.isOpen() );
+        return pDevice->newBuffer( file.data(), file.mappedSize(), MTL::ResourceStorageModeShared, nullptr );
+    }
+
+    void copySectionRange( MTL::Buffer* pBuffer, size_t bufferOffset, const SceneFile& file, const SceneFormat::SectionEntry& section,
+                           size_t firstElement, size_t count )
+    {
+        assert( firstElement + count <= section.elementCount );
+        const size_t size = section.elementSize * count;
+        assert( bufferOffset + size <= pBuffer->length() );
+        memcpy( reinterpret_cast<uint8_t*>( pBuffer->contents() ) + bufferOffset,
+                file.data() + section.offset + section.elementSize * firstElement, size );
+        if ( pBuffer->storageMode() == MTL::StorageModeManaged )
+        {
+            pBuffer->didModifyRange( NS::Range::Make( bufferOffset, size ) );
+        }
+    }
+}
@@ -9,3 +9,20 @@
 
 #include "Common.h"
 
+class SceneFile;
+
+namespace SceneFormat
+{
+    struct SectionEntry;
+}
+
+namespace MetalHelpers
+{
+    // One shared buffer over the whole scene file mapping, no copy - bind sections at their
+    // SectionEntry offset. The SceneFile has to stay open for as long as the buffer is alive
+    MTL::Buffer* newSceneBuffer( MTL::Device* pDevice, const SceneFile& file );
+
+    // Streams elements [ firstElement, firstElement + count ) of a section into a CPU accessible buffer
+    void copySectionRange( MTL::Buffer* pBuffer, size_t bufferOffset, const SceneFile& file, const SceneFormat::SectionEntry& section,
+                           size_t firstElement, size_t count );
+}
@@ -0,0 +1,116 @@
+//
+//  ReleaseQueue.cpp
+//  MyMetalCPP
+//
+
+#include "ReleaseQueue.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+ReleaseQueue::ReleaseQueue( ReleaseFn releaseFn )
+: _releaseFn( releaseFn )
+, _frame( 1 )
+, _retired( 0 )
+, _stats()
+{
+    assert( releaseFn );
+}
+
+ReleaseQueue::~ReleaseQueue()
+{
+    // the owner waits for the GPU and collects first, anything left here would leak
+    assert( _entries.empty() );
+}
+
+uint64_t ReleaseQueue::frame() const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _frame;
+}
+
+void ReleaseQueue::endFrame()
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    ++_frame;
+}
+
+void ReleaseQueue::retire( uint64_t frame )
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    assert( frame > _retired && frame <= _frame );
+    if ( frame != _retired + 1 )
+    {
+        _retiredEarly.push_back( frame );
+        return;
+    }
+
+    // this one and any run of early ones after it
+    _retired = frame;
+    for ( bool advanced = true; advanced; )
+    {
+        const auto next = std::find( _retiredEarly.begin(), _retiredEarly.end(), _retired + 1 );
+        advanced = next != _retiredEarly.end();
+        if ( advanced )
+        {
+            _retired = *next;
+            *next = _retiredEarly.back();
+            _retiredEarly.pop_back();
+        }
+    }
+}
+
+uint64_t ReleaseQueue::retired() const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _retired;
+}
+
+void ReleaseQueue::release( void* pObject )
+{
+    if ( pObject == nullptr )
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock( _mutex );
+    _entries.push_back( { _frame, pObject } );
+    ++_stats.queued;
+    _stats.maxPending = std::max( _stats.maxPending, _entries.size() );
+}
+
+size_t ReleaseQueue::collect()
+{
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _releasing.clear();
+        while ( !_entries.empty() && _entries.front().frame <= _retired )
+        {
+            _releasing.push_back( _entries.front().pObject );
+            _entries.pop_front();
+        }
+        _stats.released += _releasing.size();
+    }
+
+    // only the owner's thread collects, so _releasing is ours until the next call
+    for ( void* pObject : _releasing )
+    {
+        _releaseFn( pObject );
+    }
+    return _releasing.size();
+}
+
+size_t ReleaseQueue::pending() const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _entries.size();
+}
+
+ReleaseQueue::Stats ReleaseQueue::stats() const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    Stats stats = _stats;
+    stats.pending = _entries.size();
+    stats.frame = _frame;
+    stats.retired = _retired;
+    return stats;
+}
@@ -0,0 +1,81 @@
+//
+//  ReleaseQueue.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Objects released once the GPU can no longer be using them, without waiting on it.
+//
+// Frames are numbered from 1. Everything encoded while frame() is N is in frame N's command
+// buffer, whose completion handler calls retire( N ) - from whatever thread Metal calls it on.
+// release() tags the object with the frame being recorded, since this frame or any before it
+// may still draw with it, and collect() hands every object whose frame has retired to the
+// release function, oldest first.
+//
+// A frame is only counted as retired once every frame before it has too, so retire() calls
+// may come in any order. Nothing Metal in here - the release function does the releasing - so
+// the queue runs against simulated completions as well as command buffers.
+
+class ReleaseQueue
+{
+public:
+    typedef void ( *ReleaseFn )( void* pObject );
+
+    struct Stats
+    {
+        size_t queued;          // ever
+        size_t released;        // ever
+        size_t pending;
+        size_t maxPending;
+        uint64_t frame;
+        uint64_t retired;
+    };
+
+    explicit ReleaseQueue( ReleaseFn releaseFn );
+    ~ReleaseQueue();
+
+    // The frame being recorded
+    uint64_t frame() const;
+
+    // After committing the frame's command buffer, starts the next
+    void endFrame();
+
+    // Frame has finished on the GPU. Any thread, any order
+    void retire( uint64_t frame );
+
+    // Every frame up to and including this has finished
+    uint64_t retired() const;
+
+    // Releases pObject once the frame being recorded has retired. Any thread
+    void release( void* pObject );
+
+    // Releases everything whose frame has retired, returns how many. Outside the lock, so the
+    // release function may queue more
+    size_t collect();
+
+    size_t pending() const;
+    Stats stats() const;
+
+private:
+    struct Entry
+    {
+        uint64_t frame;
+        void* pObject;
+    };
+
+    ReleaseFn _releaseFn;
+    mutable std::mutex _mutex;
+    std::deque<Entry> _entries;             // frames never decrease front to back
+    std::vector<void*> _releasing;          // collect()'s batch, kept for its capacity
+    std::vector<uint64_t> _retiredEarly;    // retired ahead of a frame still running
+    uint64_t _frame;
+    uint64_t _retired;
+    Stats _stats;
+};
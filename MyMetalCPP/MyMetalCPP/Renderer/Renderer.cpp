@@ -11,25 +11,123 @@
 #include "../Shaders/ShaderStructs.h"
 #include "Math.hpp"
 #include "Common.h"
+#include "../Fractal/DeepZoom.hpp"
+#include "../Compute/CpuKernels.hpp"
+#include "../Texture/MipChain.hpp"
+#include "../Texture/MipGen.hpp"
+#include "../Texture/Ktx2File.hpp"
+#include "../Mesh/VertexQuantization.hpp"
+#include "../Scene/SceneFile.hpp"
+#include "../Raster/OcclusionCuller.hpp"
+#include "../Spatial/MultiViewCuller.hpp"
+#include "../Jobs/JobSystem.hpp"
+#include "CommandRecorder.hpp"
+#include "ReleaseQueue.hpp"
+#include "ResourceHeap.hpp"
+#include "BindlessTable.hpp"
+#include "ShaderReloader.hpp"
+#include "TextureUploader.hpp"
+#include "AssetStreamer.hpp"
 
 #include "imgui.h"
 
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <sys/stat.h>
+
 #include "ui.hpp"
 
 const int Renderer::kMaxFramesInFlight = 3;
 
+// one CameraData per view - constant buffer offsets are 256 byte aligned on macOS
+static constexpr size_t kCameraDataStride = ( sizeof( CameraData ) + 255 ) & ~(size_t)255;
+
+// 1 view fills the drawable, 2 side by side, 3 or 4 in quarters
+static MTL::Viewport viewportFor( uint32_t view, uint32_t viewCount, CGSize size )
+{
+    const double columns = viewCount > 1 ? 2.0 : 1.0;
+    const double rows = viewCount > 2 ? 2.0 : 1.0;
+    const double width = size.width / columns;
+    const double height = size.height / rows;
+    return { ( view % 2 ) * ( columns > 1.0 ? width : 0.0 ), ( view / 2 ) * height, width, height, 0.0, 1.0 };
+}
+
+static void releaseMetalObject( void* pObject )
+{
+    static_cast< NS::Object* >( pObject )->release();
+}
+
+// Nothing draws without these, so running out at startup is as fatal as a shader that won't build
+template< typename T >
+static T* checkAllocation( T* pResource, const char* pName )
+{
+    if ( !pResource )
+    {
+        __builtin_printf( "Can't allocate %s\n", pName );
+        assert( false );
+    }
+    return pResource;
+}
+
+static constexpr uint64_t kResourceHeapBlockSize = 16 << 20;
+static constexpr uint64_t kTextureHeapBlockSize = 1 << 20;     // the fractal - a file texture gets a block of its own
+static constexpr uint32_t kMaxMaterials = 4096;
+static constexpr size_t kStagingBufferSize = 4 << 20;
+static constexpr uint64_t kUploadBytesPerFrame = 8 << 20;
+static constexpr size_t kMaxStagingBuffers = 8;
+static constexpr uint32_t kStreamingThreads = 2;
+static constexpr uint64_t kStreamingBudget = 256 << 20;
+static constexpr NS::UInteger kMaterialTableIndex = 0;  // fragment buffer of fragmentMainBindless
+static constexpr size_t kBatchesPerList = 256;
+static constexpr uint32_t kMaxSceneEncoders = 8;
+static constexpr size_t kMinPacketsPerEncoder = 256;   // below this a sub-encoder costs more than it saves
+
 Renderer::Renderer( MTL::Device* pDevice )
 : _pDevice( pDevice->retain() )
 , _angle ( 0.f )
 , _frame( 0 )
 , _animationIndex( 0 )
+, _pDeepZoom( new DeepZoom() )
+, _pMipChain( new MipChain( kTextureWidth, kTextureHeight ) )
+, _pSceneFile( new SceneFile() )
+, _pSceneGraph( new SceneGraph() )
+, _pOcclusionCuller( new OcclusionCuller() )
+, _pDrawQueue( new DrawQueue() )
+, _pMultiViewCuller( new MultiViewCuller() )
+, _pCommandRecorder( new CommandRecorder() )
+, _pReleaseQueue( new ReleaseQueue( releaseMetalObject ) )
+, _pResourceHeap( new ResourceHeap( pDevice, MTL::StorageModeShared, kResourceHeapBlockSize ) )
+, _pTextureHeap( new ResourceHeap( pDevice, MTL::StorageModePrivate, kTextureHeapBlockSize ) )
+, _pShaderReloader( nullptr )
+, _pTextureUploader( new TextureUploader( pDevice, kStagingBufferSize, kUploadBytesPerFrame, kMaxStagingBuffers ) )
+, _pAssetStreamer( new AssetStreamer( kStreamingThreads, kStreamingBudget, loadAsset, assetResident, evictAsset, this ) )
+, _textureAsset( AssetStreamer::kInvalidAsset )
+, _textureFileUploads( 0 )
+, _textureFileReady( false )
+, _cpuInstanceVersion( 0 )
+, _drawInstanceCount( kNumInstances )
+, _deepZoomEnabled( false )
+, _computeOnCPU( false )
+, _kaiserMips( false )
+, _quantizedVertices( false )
+, _occlusionCulling( false )
+, _sortDraws( false )
+, _viewCount( 1 )
+, _parallelEncoding( false )
+, _encoderCount( 1 )
 {
     _pCommandQueue = _pDevice->newCommandQueue();   // already retained as 'new'
     buildShaders();
     buildComputePipeline();
+    if ( _pShaderReloader && !_pShaderReloader->start() )
+    {
+        __builtin_printf( "Can't watch the shader sources, not reloading them\n" );
+    }
     buildDepthStencilStates();
     buildTextures();
     buildBuffers();
+    buildMaterials();
     
     _semaphore = dispatch_semaphore_create( Renderer::kMaxFramesInFlight );
     
@@ -38,25 +136,66 @@ Renderer::Renderer( MTL::Device* pDevice )
 
 Renderer::~Renderer()
 {
-    _pTextureAnimationBuffer->release();
-    _pTexture->release();
+    delete _pShaderReloader;
+
+    // every frame in flight finishes, then nothing is in use and the queue empties
+    for ( int i = 0; i < kMaxFramesInFlight; ++i )
+    {
+        dispatch_semaphore_wait( _semaphore, DISPATCH_TIME_FOREVER );
+    }
+    _pReleaseQueue->collect();
+    delete _pReleaseQueue;
+    for ( int i = 0; i < kMaxFramesInFlight; ++i )
+    {
+        dispatch_semaphore_signal( _semaphore );
+    }
+    delete _pTextureUploader;
+    delete _pAssetStreamer;     // after the uploads reading its payloads
+
+    // nothing in flight, so heap memory goes back right away
+    _pResourceHeap->free( _pTextureAnimationBuffer, 0 );
+    _pResourceHeap->free( _pMaterialDataBuffer, 0 );
+    for ( int i = 0; i < kMaxFramesInFlight; ++i )
+    {
+        _pResourceHeap->free( _pDeepZoomOrbitBuffer[i], 0 );
+    }
+    delete _pDeepZoom;
+    delete _pMipChain;
+    _pTextureHeap->free( _pTexture, 0 );
+    if ( _pFileTexture )
+    {
+        _pTextureHeap->free( _pFileTexture, 0 );
+    }
     _pShaderLibrary->release();
     _pDepthStencilState->release();
     _pVertexDataBuffer->release();
+    _pResourceHeap->free( _pQuantizedVertexBuffer, 0 );
+    _pResourceHeap->free( _pMeshQuantizationBuffer, 0 );
     
     for ( int i = 0; i < kMaxFramesInFlight; ++i )
     {
-        _pInstanceDataBuffer[i]->release();
+        _pResourceHeap->free( _pInstanceDataBuffer[i], 0 );
     }
     
     for ( int i = 0; i < kMaxFramesInFlight; ++i )
     {
-        _pCameraDataBuffer[i]->release();
+        _pResourceHeap->free( _pCameraDataBuffer[i], 0 );
     }
+    delete _pResourceHeap;
+    delete _pTextureHeap;
+    delete _pBindlessTable;
     
     _pIndexBuffer->release();
+    delete _pSceneFile;     // after the buffers that wrap its mapping
+    delete _pSceneGraph;
+    delete _pOcclusionCuller;
+    delete _pDrawQueue;
+    delete _pMultiViewCuller;
+    delete _pCommandRecorder;
     _pPSO->release();
+    _pQuantizedPSO->release();
     _pComputePSO->release();
+    _pDeepZoomPSO->release();
     _pCommandQueue->release();
     _pDevice->release();
 }
@@ -67,6 +206,16 @@ void Renderer::buildShaders()
 
     NS::Error* pError = nullptr;
     MTL::Library* pLibrary = _pDevice->newDefaultLibrary();
+
+    // MM_SHADER_DIR names the Shaders source directory. The pipelines start from the built
+    // library as usual, then are rebuilt from source whenever a file they use there is saved
+    const char* pShaderDir = getenv( "MM_SHADER_DIR" );
+    uint32_t shaderLibrary = 0;
+    if ( pShaderDir )
+    {
+        _pShaderReloader = new ShaderReloader( _pDevice, _pReleaseQueue );
+        shaderLibrary = _pShaderReloader->addLibrary( std::string( pShaderDir ) + "/MyShader.metal" );
+    }
     
     MetalDebug::Dump(pLibrary);
     
@@ -76,7 +225,7 @@ void Renderer::buildShaders()
     }
 
     MTL::Function* pVertexFn = pLibrary->newFunction( NS::String::string("vertexMain", UTF8StringEncoding) );
-    MTL::Function* pFragFn = pLibrary->newFunction( NS::String::string("fragmentMain", UTF8StringEncoding) );
+    MTL::Function* pFragFn = pLibrary->newFunction( NS::String::string("fragmentMainBindless", UTF8StringEncoding) );
 
     MTL::RenderPipelineDescriptor* pDesc = MTL::RenderPipelineDescriptor::alloc()->init();
     pDesc->setVertexFunction( pVertexFn );
@@ -90,8 +239,29 @@ void Renderer::buildShaders()
         __builtin_printf( "%s", pError->localizedDescription()->utf8String() );
         assert( false );
     }
+    if ( _pShaderReloader )
+    {
+        _pShaderReloader->addRenderPipeline( shaderLibrary, pDesc, &_pPSO );
+    }
+
+    // same fragment stage, vertices read as QuantizedVertexData
+    MTL::Function* pQuantizedVertexFn = pLibrary->newFunction( NS::String::string("vertexMainQuantized", UTF8StringEncoding) );
+    pDesc->setVertexFunction( pQuantizedVertexFn );
+    _pQuantizedPSO = _pDevice->newRenderPipelineState( pDesc, &pError );
+    if ( !_pQuantizedPSO )
+    {
+        __builtin_printf( "%s", pError->localizedDescription()->utf8String() );
+        assert( false );
+    }
+    if ( _pShaderReloader )
+    {
+        _pShaderReloader->addRenderPipeline( shaderLibrary, pDesc, &_pQuantizedPSO );
+    }
+
+    _pBindlessTable = new BindlessTable( _pDevice, pFragFn, kMaterialTableIndex, kMaxMaterials );
 
     pVertexFn->release();
+    pQuantizedVertexFn->release();
     pFragFn->release();
     pDesc->release();
    _pShaderLibrary = pLibrary;
@@ -110,6 +280,23 @@ void Renderer::buildComputePipeline()
     }
 
     pMandelbrotFn->release();
+
+    MTL::Function* pPerturbationFn = _pShaderLibrary->newFunction( NS::String::string("mandelbrot_perturbation", NS::UTF8StringEncoding) );
+    _pDeepZoomPSO = _pDevice->newComputePipelineState( pPerturbationFn, &pError );
+    if ( !_pDeepZoomPSO )
+    {
+        __builtin_printf( "%s", pError->localizedDescription()->utf8String() );
+        assert(false);
+    }
+
+    pPerturbationFn->release();
+
+    if ( _pShaderReloader )
+    {
+        const uint32_t library = _pShaderReloader->addLibrary( std::string( getenv( "MM_SHADER_DIR" ) ) + "/Mandelbrot.metal" );
+        _pShaderReloader->addComputePipeline( library, "mandelbrot_set", &_pComputePSO );
+        _pShaderReloader->addComputePipeline( library, "mandelbrot_perturbation", &_pDeepZoomPSO );
+    }
 }
 
 void Renderer::generateMandelbrotTexture()
@@ -117,9 +304,30 @@ void Renderer::generateMandelbrotTexture()
     MTL::CommandBuffer* pCommandBuffer = _pCommandQueue->commandBuffer();
     assert(pCommandBuffer);
 
+    if ( _deepZoomEnabled )
+    {
+        generateDeepZoomTexture( pCommandBuffer );
+        pCommandBuffer->commit();
+        return;
+    }
+
     uint* ptr = reinterpret_cast<uint*>(_pTextureAnimationBuffer->contents());
     *ptr = (_animationIndex++) % 5000;
-    _pTextureAnimationBuffer->didModifyRange(NS::Range::Make(0, sizeof(uint)));
+
+    if ( _computeOnCPU )
+    {
+        if ( mipChainUploading() )
+        {
+            pCommandBuffer->commit();
+            return;
+        }
+        // same kernel source, run through the CPU backend
+        metal::CpuTexture cpuTexture = _pMipChain->level( 0 );
+        CpuKernels::mandelbrotSet( cpuTexture, *ptr );
+        uploadMipChain();
+        pCommandBuffer->commit();
+        return;
+    }
     
     MTL::ComputeCommandEncoder* pComputeEncoder = pCommandBuffer->computeCommandEncoder();
 
@@ -136,9 +344,105 @@ void Renderer::generateMandelbrotTexture()
 
     pComputeEncoder->endEncoding();
 
+    encodeMipmaps( pCommandBuffer );
+
     pCommandBuffer->commit();
 }
 
+void Renderer::generateDeepZoomTexture( MTL::CommandBuffer* pCommandBuffer )
+{
+    // Zoom into a point on the boundary from 1 down to 1e-28 and back out, past where float breaks down
+    static const Maths::DoubleDouble kCenterX = Maths::parseDoubleDouble( DeepZoom::kDemoCenterX );
+    static const Maths::DoubleDouble kCenterY = Maths::parseDoubleDouble( DeepZoom::kDemoCenterY );
+    constexpr uint kDeepZoomFrames = 6000;
+
+    uint frame = (_animationIndex++) % kDeepZoomFrames;
+    float t = 1.f - fabsf( 2.f * frame / (float)kDeepZoomFrames - 1.f );
+    _pDeepZoom->setCenter( kCenterX, kCenterY );
+    _pDeepZoom->setScale( 2.0 * pow( 10.0, -28.0 * t ) );
+    _pDeepZoom->prepare( kTextureWidth, kTextureHeight );
+
+    if ( _computeOnCPU )
+    {
+        if ( mipChainUploading() )
+        {
+            return;
+        }
+        _pDeepZoom->render( _pMipChain->levelData( 0 ), _pMipChain->rowPitch( 0 ) );
+        uploadMipChain();
+        return;
+    }
+
+    // Reference orbit for this frame - the buffer may still be read by the frame before last
+    MTL::Buffer* pOrbitBuffer = _pDeepZoomOrbitBuffer[ _frame ];
+    size_t orbitSize = _pDeepZoom->orbitDataSize();
+    memcpy( pOrbitBuffer->contents(), _pDeepZoom->orbitData(), orbitSize );
+
+    MTL::ComputeCommandEncoder* pComputeEncoder = pCommandBuffer->computeCommandEncoder();
+
+    pComputeEncoder->setComputePipelineState( _pDeepZoomPSO );
+    pComputeEncoder->setTexture( _pTexture, 0 );
+    pComputeEncoder->setBytes( &_pDeepZoom->params(), sizeof( DeepZoomParams ), 0 );
+    pComputeEncoder->setBuffer( pOrbitBuffer, 0, 1 );
+
+    MTL::Size gridSize = MTL::Size( kTextureWidth, kTextureHeight, 1 );
+
+    NS::UInteger threadGroupSize = _pDeepZoomPSO->maxTotalThreadsPerThreadgroup();
+    MTL::Size threadgroupSize( threadGroupSize, 1, 1 );
+
+    pComputeEncoder->dispatchThreads( gridSize, threadgroupSize );
+
+    pComputeEncoder->endEncoding();
+
+    encodeMipmaps( pCommandBuffer );
+}
+
+void Renderer::encodeMipmaps( MTL::CommandBuffer* pCommandBuffer )
+{
+    // GPU paths only write level 0 - minified cubes sample the rest
+    MTL::BlitCommandEncoder* pBlitEncoder = pCommandBuffer->blitCommandEncoder();
+    pBlitEncoder->generateMipmaps( _pTexture );
+    pBlitEncoder->endEncoding();
+}
+
+void Renderer::uploadMipChain()
+{
+    // Level 0 of _pMipChain has just been written on the CPU
+    MipGen::Options options;
+    options.filter = _kaiserMips ? MipGen::Filter::Kaiser : MipGen::Filter::Box;
+    options.colorSpace = MipGen::ColorSpace::Linear;    // the texture is RGBA8Unorm
+    options.addressMode = metal::address::repeat;       // matches the sampler in fragmentMain
+    MipGen::generate( *_pMipChain, options );
+
+    // queued behind whatever else is uploading (MM_TEXTURE_FILE's levels can take a few frames),
+    // so the chain isn't written again until mipChainUploading() says these have all gone
+    _mipChainTickets.clear();
+    for ( uint32_t level = 0; level < std::min( (uint32_t)_pTexture->mipmapLevelCount(), _pMipChain->levelCount() ); ++level )
+    {
+        const UploadQueue::Ticket ticket = _pTextureUploader->upload( _pTexture, level, MTL::Region( 0, 0, _pMipChain->width( level ), _pMipChain->height( level ) ),
+                                   _pMipChain->levelData( level ), _pMipChain->rowPitch( level ),
+                                   { PixelConvert::Format::RGBA8, MipGen::ColorSpace::Linear } );
+        if ( ticket != UploadQueue::kInvalidTicket )
+        {
+            _mipChainTickets.push_back( ticket );
+        }
+    }
+}
+
+// The CPU paths skip a frame - the texture keeps the last one - rather than overwrite a chain
+// that's still being read
+bool Renderer::mipChainUploading() const
+{
+    for ( UploadQueue::Ticket ticket : _mipChainTickets )
+    {
+        if ( !_pTextureUploader->isComplete( ticket ) )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Renderer::buildDepthStencilStates()
 {
     MTL::DepthStencilDescriptor* pDsDesc = MTL::DepthStencilDescriptor::alloc()->init();
@@ -152,78 +456,119 @@ void Renderer::buildDepthStencilStates()
 
 void Renderer::buildBuffers()
 {
-    const float s = 0.5f;
-
-    VertexData verts[] = {
-        //                                         Texture
-        //   Positions           Normals         Coordinates
-        { { -s, -s, +s }, {  0.f,  0.f,  1.f }, { 0.f, 1.f } },
-        { { +s, -s, +s }, {  0.f,  0.f,  1.f }, { 1.f, 1.f } },
-        { { +s, +s, +s }, {  0.f,  0.f,  1.f }, { 1.f, 0.f } },
-        { { -s, +s, +s }, {  0.f,  0.f,  1.f }, { 0.f, 0.f } },
-
-        { { +s, -s, +s }, {  1.f,  0.f,  0.f }, { 0.f, 1.f } },
-        { { +s, -s, -s }, {  1.f,  0.f,  0.f }, { 1.f, 1.f } },
-        { { +s, +s, -s }, {  1.f,  0.f,  0.f }, { 1.f, 0.f } },
-        { { +s, +s, +s }, {  1.f,  0.f,  0.f }, { 0.f, 0.f } },
-
-        { { +s, -s, -s }, {  0.f,  0.f, -1.f }, { 0.f, 1.f } },
-        { { -s, -s, -s }, {  0.f,  0.f, -1.f }, { 1.f, 1.f } },
-        { { -s, +s, -s }, {  0.f,  0.f, -1.f }, { 1.f, 0.f } },
-        { { +s, +s, -s }, {  0.f,  0.f, -1.f }, { 0.f, 0.f } },
-
-        { { -s, -s, -s }, { -1.f,  0.f,  0.f }, { 0.f, 1.f } },
-        { { -s, -s, +s }, { -1.f,  0.f,  0.f }, { 1.f, 1.f } },
-        { { -s, +s, +s }, { -1.f,  0.f,  0.f }, { 1.f, 0.f } },
-        { { -s, +s, -s }, { -1.f,  0.f,  0.f }, { 0.f, 0.f } },
-
-        { { -s, +s, +s }, {  0.f,  1.f,  0.f }, { 0.f, 1.f } },
-        { { +s, +s, +s }, {  0.f,  1.f,  0.f }, { 1.f, 1.f } },
-        { { +s, +s, -s }, {  0.f,  1.f,  0.f }, { 1.f, 0.f } },
-        { { -s, +s, -s }, {  0.f,  1.f,  0.f }, { 0.f, 0.f } },
-
-        { { -s, -s, -s }, {  0.f, -1.f,  0.f }, { 0.f, 1.f } },
-        { { +s, -s, -s }, {  0.f, -1.f,  0.f }, { 1.f, 1.f } },
-        { { +s, -s, +s }, {  0.f, -1.f,  0.f }, { 1.f, 0.f } },
-        { { -s, -s, +s }, {  0.f, -1.f,  0.f }, { 0.f, 0.f } }
-    };
-
-    uint16_t indices[] = {
-         0,  1,  2,  2,  3,  0, /* front */
-         4,  5,  6,  6,  7,  4, /* right */
-         8,  9, 10, 10, 11,  8, /* back */
-        12, 13, 14, 14, 15, 12, /* left */
-        16, 17, 18, 18, 19, 16, /* top */
-        20, 21, 22, 22, 23, 20, /* bottom */
-    };
-
-    const size_t vertexDataSize = sizeof( verts );
-    const size_t indexDataSize = sizeof( indices );
-
-    MTL::Buffer* pVertexBuffer = _pDevice->newBuffer( vertexDataSize, MTL::ResourceStorageModeManaged );
-    MTL::Buffer* pIndexBuffer = _pDevice->newBuffer( indexDataSize, MTL::ResourceStorageModeManaged );
-
-    _pVertexDataBuffer = pVertexBuffer;
-    _pIndexBuffer = pIndexBuffer;
-
-    memcpy( _pVertexDataBuffer->contents(), verts, vertexDataSize );
-    memcpy( _pIndexBuffer->contents(), indices, indexDataSize );
-
-    _pVertexDataBuffer->didModifyRange( NS::Range::Make( 0, _pVertexDataBuffer->length() ) );
-    _pIndexBuffer->didModifyRange( NS::Range::Make( 0, _pIndexBuffer->length() ) );
+    std::vector<VertexData> verts;
+    std::vector<uint16_t> indices;
+    const VertexData* pVerts = nullptr;
+    size_t vertexCount = 0;
+
+    // MM_SCENE_FILE names a scene file (mmtool scene write) to draw the first mesh of instead of the cube.
+    // The vertices are used in place - one no copy buffer over the mapping, bound at the mesh's offset - and
+    // just the mesh's range of the index section is streamed into a buffer of its own
+    const char* pScenePath = getenv( "MM_SCENE_FILE" );
+    if ( pScenePath && _pSceneFile->open( pScenePath ) )
+    {
+        size_t meshCount = 0;
+        const SceneFormat::MeshRecord* pMeshes = _pSceneFile->sectionData<SceneFormat::MeshRecord>( SceneFormat::SectionType::Meshes, &meshCount );
+        const SceneFormat::SectionEntry* pVertexSection = _pSceneFile->find( SceneFormat::SectionType::Vertices );
+        const SceneFormat::SectionEntry* pIndexSection = _pSceneFile->find( SceneFormat::SectionType::Indices16 );
+        if ( meshCount > 0 && pVertexSection && pIndexSection )
+        {
+            _pVertexDataBuffer = MetalHelpers::newSceneBuffer( _pDevice, *_pSceneFile );
+            _vertexDataOffset = pVertexSection->offset + pMeshes[0].firstVertex * sizeof( VertexData );
+            _indexCount = pMeshes[0].indexCount;
+            _pIndexBuffer = _pDevice->newBuffer( _indexCount * sizeof( uint16_t ), MTL::ResourceStorageModeManaged );
+            MetalHelpers::copySectionRange( _pIndexBuffer, 0, *_pSceneFile, *pIndexSection, pMeshes[0].firstIndex, _indexCount );
+            _indexDataOffset = 0;
+            pVerts = reinterpret_cast<const VertexData*>( _pSceneFile->data() + _vertexDataOffset );
+            vertexCount = pMeshes[0].vertexCount;
+            const uint16_t* pIndices = reinterpret_cast<const uint16_t*>( _pIndexBuffer->contents() );
+            _cpuIndices.assign( pIndices, pIndices + _indexCount );
+        }
+        else
+        {
+            __builtin_printf( "%s has no 16 bit indexed mesh, using the cube\n", pScenePath );
+            _pSceneFile->close();
+        }
+    }
+
+    if ( !pVerts )
+    {
+        CubeScene::buildCube( verts, indices );
+        _indexCount = indices.size();
+        _vertexDataOffset = 0;
+        _indexDataOffset = 0;
+
+        const size_t vertexDataSize = verts.size() * sizeof( VertexData );
+        const size_t indexDataSize = indices.size() * sizeof( uint16_t );
+
+        MTL::Buffer* pVertexBuffer = _pDevice->newBuffer( vertexDataSize, MTL::ResourceStorageModeManaged );
+        MTL::Buffer* pIndexBuffer = _pDevice->newBuffer( indexDataSize, MTL::ResourceStorageModeManaged );
+
+        _pVertexDataBuffer = pVertexBuffer;
+        _pIndexBuffer = pIndexBuffer;
+
+        memcpy( _pVertexDataBuffer->contents(), verts.data(), vertexDataSize );
+        memcpy( _pIndexBuffer->contents(), indices.data(), indexDataSize );
+
+        _pVertexDataBuffer->didModifyRange( NS::Range::Make( 0, _pVertexDataBuffer->length() ) );
+        _pIndexBuffer->didModifyRange( NS::Range::Make( 0, _pIndexBuffer->length() ) );
+        pVerts = verts.data();
+        vertexCount = verts.size();
+        _cpuIndices = indices;
+    }
+    _cpuVertices.assign( pVerts, pVerts + vertexCount );
+    for ( int a = 0; a < 3; ++a )
+    {
+        _meshBoxMin[a] = INFINITY;
+        _meshBoxMax[a] = -INFINITY;
+    }
+    for ( const VertexData& vertex : _cpuVertices )
+    {
+        const float position[3] = { vertex.position.x, vertex.position.y, vertex.position.z };
+        for ( int a = 0; a < 3; ++a )
+        {
+            _meshBoxMin[a] = std::min( _meshBoxMin[a], position[a] );
+            _meshBoxMax[a] = std::max( _meshBoxMax[a], position[a] );
+        }
+    }
+
+    // quantized copy of the same vertices for vertexMainQuantized
+    const MeshQuantization quantization = VertexQuantization::computeQuantization( pVerts, vertexCount );
+    const size_t quantizedDataSize = vertexCount * sizeof( QuantizedVertexData );
+    _pQuantizedVertexBuffer = checkAllocation( _pResourceHeap->newBuffer( quantizedDataSize ), "the quantized vertices" );
+    _pMeshQuantizationBuffer = checkAllocation( _pResourceHeap->newBuffer( sizeof( MeshQuantization ) ), "the mesh quantization" );
+    QuantizedVertexData* pQuantized = reinterpret_cast< QuantizedVertexData* >( _pQuantizedVertexBuffer->contents() );
+    VertexQuantization::encode( pQuantized, pVerts, vertexCount, quantization );
+    memcpy( _pMeshQuantizationBuffer->contents(), &quantization, sizeof( MeshQuantization ) );
+    _quantizationError = VertexQuantization::measureError( pVerts, pQuantized, vertexCount, quantization );
 
     const size_t instanceDataSize = kNumInstances * sizeof( InstanceData );
+    CubeScene::buildGraph( *_pSceneGraph );
     for ( size_t i = 0; i < kMaxFramesInFlight; ++i )
     {
-        _pInstanceDataBuffer[ i ] = _pDevice->newBuffer( instanceDataSize, MTL::ResourceStorageModeManaged );
+        _pInstanceDataBuffer[ i ] = checkAllocation( _pResourceHeap->newBuffer( instanceDataSize ), "the instance data" );
+        CubeScene::setInstanceColors( reinterpret_cast< InstanceData *>( _pInstanceDataBuffer[ i ]->contents() ) );
+        _instanceVersion[ i ] = 0;
+        _instancesReordered[ i ] = false;
     }
+    _cpuInstances.resize( kNumInstances );
+    _cpuVisible.resize( kNumInstances );
+    _pDrawQueue->reserve( kNumInstances );
+    CubeScene::setInstanceColors( _cpuInstances.data() );
     
-    const size_t cameraDataSize = kMaxFramesInFlight * sizeof( CameraData );
+    const size_t cameraDataSize = MultiViewCuller::kMaxViews * kCameraDataStride;
     for ( size_t i = 0; i < kMaxFramesInFlight; ++i )
     {
-        _pCameraDataBuffer[ i ] = _pDevice->newBuffer( cameraDataSize, MTL::ResourceStorageModeManaged );
+        _pCameraDataBuffer[ i ] = checkAllocation( _pResourceHeap->newBuffer( cameraDataSize ), "the camera data" );
+    }
+    _pTextureAnimationBuffer = checkAllocation( _pResourceHeap->newBuffer( sizeof(uint) ), "the texture animation" );
+
+    _pDeepZoom->setMaxIterations( kDeepZoomMaxIterations );
+    const size_t orbitDataSize = ( kDeepZoomMaxIterations + 1 ) * 2 * sizeof( float );
+    for ( size_t i = 0; i < kMaxFramesInFlight; ++i )
+    {
+        _pDeepZoomOrbitBuffer[ i ] = checkAllocation( _pResourceHeap->newBuffer( orbitDataSize ), "the deep zoom orbit" );
     }
-    _pTextureAnimationBuffer = _pDevice->newBuffer( sizeof(uint), MTL::ResourceStorageModeManaged);
 }
 
 void Renderer::buildTextures()
@@ -233,20 +578,130 @@ void Renderer::buildTextures()
     pTextureDesc->setHeight( kTextureHeight );
     pTextureDesc->setPixelFormat( MTL::PixelFormatRGBA8Unorm );
     pTextureDesc->setTextureType( MTL::TextureType2D );
-    pTextureDesc->setStorageMode( MTL::StorageModeManaged );
+    pTextureDesc->setMipmapLevelCount( MipChain::levelCountFor( kTextureWidth, kTextureHeight ) );
     pTextureDesc->setUsage( MTL::ResourceUsageSample | MTL::ResourceUsageRead | MTL::ResourceUsageWrite );
 
-    MTL::Texture *pTexture = _pDevice->newTexture( pTextureDesc );
-    _pTexture = pTexture;
+    // private - the kernels draw it, uploadMipChain goes through TextureUploader's blits and
+    // encodeMipmaps is a blit too, so the CPU never touches it
+    _pTexture = checkAllocation( _pTextureHeap->newTexture( pTextureDesc ), "the texture" );
     pTextureDesc->release();
+
+    // MM_TEXTURE_FILE names a KTX2 file (mmtool ktx2 pack) for every other material, streamed in
+    // the background and swapped in for the fractal once it's uploaded
+    _pFileTexture = nullptr;
+    const char* pTexturePath = getenv( "MM_TEXTURE_FILE" );
+    struct stat info;
+    if ( pTexturePath && stat( pTexturePath, &info ) == 0 )
+    {
+        _textureFilePath = pTexturePath;
+        _textureAsset = _pAssetStreamer->add( (uint64_t)info.st_size );
+    }
+}
+
+// On a streaming thread - mapped, checked and decoded
+void* Renderer::loadAsset( void* pUser, uint32_t asset, size_t* pSize )
+{
+    Renderer* pRenderer = static_cast<Renderer*>( pUser );
+    Ktx2File* pFile = new Ktx2File();
+    if ( !pFile->open( pRenderer->_textureFilePath.c_str() ) || !pFile->decode() )
+    {
+        __builtin_printf( "Can't load %s, using the fractal\n", pRenderer->_textureFilePath.c_str() );
+        delete pFile;
+        return nullptr;
+    }
+    *pSize = pFile->size();
+    for ( uint32_t level = 0; pFile->supercompression() != Ktx2Format::Supercompression::None && level < pFile->levelCount(); ++level )
+    {
+        *pSize += pFile->levelSize( level );
+    }
+    return pFile;
+}
+
+void Renderer::assetResident( void* pUser, uint32_t asset, void* pPayload )
+{
+    Renderer* pRenderer = static_cast<Renderer*>( pUser );
+    const Ktx2File& file = *static_cast<Ktx2File*>( pPayload );
+    if ( !pRenderer->_pFileTexture )
+    {
+        pRenderer->_pFileTexture = pRenderer->newFileTexture( file );
+        if ( !pRenderer->_pFileTexture )
+        {
+            // stop wanting it, so it can be evicted
+            __builtin_printf( "Can't allocate a texture for %s, using the fractal\n", pRenderer->_textureFilePath.c_str() );
+            pRenderer->_textureAsset = AssetStreamer::kInvalidAsset;
+            return;
+        }
+        __builtin_printf( "%s: %ux%u, %u levels, %s\n", pRenderer->_textureFilePath.c_str(), file.width(), file.height(), file.levelCount(),
+                          Ktx2Format::supercompressionName( file.supercompression() ) );
+    }
+}
+
+void Renderer::evictAsset( void* pUser, uint32_t asset, void* pPayload )
+{
+    delete static_cast<Ktx2File*>( pPayload );
+}
+
+// In the private texture heap, filled by blits from the file's levels. The file stays wanted, so
+// resident, until the last of them has been uploaded. nullptr if there's no room for it
+MTL::Texture* Renderer::newFileTexture( const Ktx2File& file )
+{
+    // RGB goes up as opaque RGBA, float as sRGB
+    const PixelConvert::Layout layout = file.layout();
+    const bool srgb = layout.colorSpace == MipGen::ColorSpace::SRGB || layout.format == PixelConvert::Format::RGBA32Float;
+    MTL::PixelFormat format = srgb ? MTL::PixelFormatRGBA8Unorm_sRGB : MTL::PixelFormatRGBA8Unorm;
+    if ( layout.format == PixelConvert::Format::BGRA8 )
+    {
+        format = srgb ? MTL::PixelFormatBGRA8Unorm_sRGB : MTL::PixelFormatBGRA8Unorm;
+    }
+    MTL::TextureDescriptor* pTextureDesc = MTL::TextureDescriptor::texture2DDescriptor( format, file.width(), file.height(), true );
+    pTextureDesc->setMipmapLevelCount( file.levelCount() );
+    pTextureDesc->setUsage( MTL::ResourceUsageSample | MTL::ResourceUsageRead );
+    MTL::Texture* pTexture = _pTextureHeap->newTexture( pTextureDesc );
+    if ( !pTexture )
+    {
+        return nullptr;
+    }
+
+    for ( uint32_t level = 0; level < file.levelCount(); ++level )
+    {
+        const UploadQueue::Ticket ticket = _pTextureUploader->upload( pTexture, level, MTL::Region( 0, 0, file.width( level ), file.height( level ) ),
+                                                                      file.levelData( level ), file.rowPitch( level ), layout, textureFileUploaded, this );
+        _textureFileUploads += ticket != UploadQueue::kInvalidTicket ? 1 : 0;
+    }
+    return pTexture;
+}
+
+// Every level is in, the odd materials switch over as frames in flight allow
+void Renderer::textureFileUploaded( void* pUser, uint64_t ticket )
+{
+    Renderer* pRenderer = static_cast<Renderer*>( pUser );
+    if ( --pRenderer->_textureFileUploads == 0 )
+    {
+        for ( uint32_t m = 1; m < kNumMaterials; m += 2 )
+        {
+            pRenderer->_pBindlessTable->replace( pRenderer->_materialHandles[m], pRenderer->_pFileTexture, pRenderer->_pReleaseQueue->frame() );
+        }
+        pRenderer->_textureFileReady = true;
+    }
+}
+
+// The scene's materials in order, so the slots are the indices setInstanceColors gives instances
+void Renderer::buildMaterials()
+{
+    _pMaterialDataBuffer = checkAllocation( _pResourceHeap->newBuffer( kNumMaterials * sizeof( MaterialData ) ), "the material data" );
+    MaterialData* pMaterialData = reinterpret_cast< MaterialData* >( _pMaterialDataBuffer->contents() );
+    for ( uint32_t m = 0; m < kNumMaterials; ++m )
+    {
+        pMaterialData[ m ].tint = CubeScene::materialTint( m );
+        const BindlessTable::Handle handle = _pBindlessTable->add( _pTexture, _pMaterialDataBuffer, m * sizeof( MaterialData ) );
+        assert( _pBindlessTable->index( handle ) == m );
+        _materialHandles.push_back( handle );
+    }
+    _pBindlessTable->beginFrame( _pReleaseQueue->frame(), _pReleaseQueue->retired() );
 }
 
 void Renderer::update()
 {
-    using simd::float3;
-    using simd::float4;
-    using simd::float4x4;
-    
     // Just update stuff
     
     _frame = (_frame + 1) % Renderer::kMaxFramesInFlight;
@@ -254,59 +709,83 @@ void Renderer::update()
     
     MTL::Buffer* pInstanceDataBuffer = _pInstanceDataBuffer[ _frame ];
 
-    // update instanced data
-    const float scl = 0.2f;
+    // update instanced data - the graph writes every instance that changed since this buffer was last written
     InstanceData* pInstanceData = reinterpret_cast< InstanceData *>( pInstanceDataBuffer->contents() );
-    
-    float3 objectPosition = { 0.f, 0.f, -10.f };
-
-    // Update instance positions:
-
-    float4x4 rt = Maths::makeTranslate( objectPosition );
-    float4x4 rr1 = Maths::makeYRotate( -_angle );
-    float4x4 rr0 = Maths::makeXRotate( _angle * 0.5 );
-    float4x4 rtInv = Maths::makeTranslate( { -objectPosition.x, -objectPosition.y, -objectPosition.z } );
-    float4x4 fullObjectRot = rt * rr1 * rr0 * rtInv;
-    
-    size_t ix = 0;
-    size_t iy = 0;
-    size_t iz = 0;
-    
-    for ( size_t i = 0; i < kNumInstances; ++i )
+    CubeScene::animateGraph( *_pSceneGraph, _angle );
+    if ( _viewCount > 1 )
     {
-        if ( ix == kInstanceRows )
+        // split screen - one culling pass for every view, each instance written once for all of them
+        _pSceneGraph->update( _cpuInstances.data(), &_cpuInstanceVersion );
+        Matrix44f clipFromWorld[ MultiViewCuller::kMaxViews ];
+        for ( int v = 0; v < _viewCount; ++v )
+        {
+            const MTL::Viewport viewport = viewportFor( v, _viewCount, _viewportSize );
+            CameraData camera;
+            CubeScene::updateViewCamera( &camera, viewport.width / viewport.height, v );
+            clipFromWorld[v] = camera.perspectiveTransform * camera.worldTransform;
+        }
+        _pMultiViewCuller->setViews( clipFromWorld, _viewCount );
+        _pMultiViewCuller->cull( _cpuInstances.data(), _cpuInstances.size(), _meshBoxMin, _meshBoxMax );
+        _drawInstanceCount = _pMultiViewCuller->gather( _cpuInstances.data(), pInstanceData );
+        _instancesReordered[ _frame ] = true;
+    }
+    else if ( _occlusionCulling || _sortDraws )
+    {
+        // the graph writes the CPU copy, culling and sorting copy it over the buffer
+        _pSceneGraph->update( _cpuInstances.data(), &_cpuInstanceVersion );
+        CameraData camera;
+        CubeScene::updateCamera( &camera, _viewportSize.width / _viewportSize.height );
+        const Matrix44f clipFromWorld = camera.perspectiveTransform * camera.worldTransform;
+        const InstanceData* pSource = _cpuInstances.data();
+        size_t count = _cpuInstances.size();
+        if ( _occlusionCulling )
+        {
+            InstanceData* pVisible = _sortDraws ? _cpuVisible.data() : pInstanceData;
+            count = _pOcclusionCuller->cullInstances( clipFromWorld, _cpuInstances.data(), _cpuInstances.size(),
+                                                      _cpuVertices.data(), _cpuVertices.size(),
+                                                      _cpuIndices.data(), _cpuIndices.size(),
+                                                      kMaxOccluders, pVisible );
+            pSource = pVisible;
+        }
+        if ( _sortDraws )
         {
-            ix = 0;
-            iy += 1;
+            // one draw per instance, keyed on its centre's depth - the queue merges them back into batches
+            const uint32_t pipeline = _quantizedVertices ? 1 : 0;
+            _pDrawQueue->clear();
+            for ( size_t i = 0; i < count; ++i )
+            {
+                const Vector4f& position = pSource[i].instanceTransform.columns[3];
+                const Vector4f clip = clipFromWorld * position;
+                _pDrawQueue->submit( DrawQueue::makeKey( pipeline, 0, clip.z / clip.w, 0 ), (uint32_t)i );
+            }
+            _pDrawQueue->build();
+            _pDrawQueue->gather( pSource, pInstanceData );
         }
-        if ( iy == kInstanceRows )
+        _drawInstanceCount = count;
+        _instancesReordered[ _frame ] = true;
+    }
+    else
+    {
+        if ( _instancesReordered[ _frame ] )
         {
-            iy = 0;
-            iz += 1;
+            // compacted or sorted - colours are out of place and every transform needs writing again
+            CubeScene::setInstanceColors( pInstanceData );
+            _instanceVersion[ _frame ] = 0;
+            _instancesReordered[ _frame ] = false;
         }
-        
-        float4x4 scale = Maths::makeScale( (float3){ scl, scl, scl } );
-        float4x4 zrot = Maths::makeZRotate( _angle * sinf((float)ix) );
-        float4x4 yrot = Maths::makeYRotate( _angle * cosf((float)iy));
-        
-        float x = ((float)ix - (float)kInstanceRows/2.f) * (2.f * scl) + scl;
-        float y = ((float)iy - (float)kInstanceColumns/2.f) * (2.f * scl) + scl;
-        float z = ((float)iz - (float)kInstanceDepth/2.f) * (2.f * scl);
-        float4x4 translate = Maths::makeTranslate( Maths::add( objectPosition, { x, y, z } ) );
-        
-        pInstanceData[ i ].instanceTransform = fullObjectRot * translate * yrot * zrot * scale;
-        pInstanceData[ i ].instanceNormalTransform = Maths::discardTranslation( pInstanceData[ i ].instanceTransform );
-        
-        float iDivNumInstances = i / (float)kNumInstances;
-        float r = iDivNumInstances;
-        float g = 1.0f - r;
-        float b = sinf( M_PI * 2.0f * iDivNumInstances );
-        pInstanceData[ i ].instanceColor = (float4){ r, g, b, 1.0f };
-        
-        ix += 1;
-    }
-    NS::UInteger length = pInstanceDataBuffer->length();
-    pInstanceDataBuffer->didModifyRange( NS::Range::Make( 0, length ) );
+        _pSceneGraph->update( pInstanceData, &_instanceVersion[ _frame ] );
+        _drawInstanceCount = kNumInstances;
+    }
+}
+
+void Renderer::releaseLater( NS::Object* pObject )
+{
+    _pReleaseQueue->release( pObject );
+}
+
+void Renderer::freeLater( MTL::Resource* pResource )
+{
+    _pResourceHeap->free( pResource, _pReleaseQueue->frame() );
 }
 
 void Renderer::resize( MTK::View* pView, CGSize size )
@@ -314,6 +793,110 @@ void Renderer::resize( MTK::View* pView, CGSize size )
     _viewportSize = size;
 }
 
+// Plays packets onto one encoder - only the one mesh and texture for now, so those are bound
+// with the encoder and only pipeline and view changes reach Metal
+struct Renderer::PacketEncoder
+{
+    Renderer* pRenderer;
+    MTL::RenderCommandEncoder* pEnc;
+
+    void setPipeline( uint32_t pipeline )
+    {
+        // pipeline 1 is the quantized vertex path
+        pEnc->setRenderPipelineState( pipeline == 1 ? pRenderer->_pQuantizedPSO : pRenderer->_pPSO );
+        if ( pipeline == 1 )
+        {
+            pEnc->setVertexBuffer( pRenderer->_pQuantizedVertexBuffer, /* offset */ 0, /* index */ 0 );
+            pEnc->setVertexBuffer( pRenderer->_pMeshQuantizationBuffer, /* offset */ 0, /* index */ 3 );
+        }
+        else
+        {
+            pEnc->setVertexBuffer( pRenderer->_pVertexDataBuffer, pRenderer->_vertexDataOffset, /* index */ 0 );
+        }
+    }
+
+    void setView( uint32_t view )
+    {
+        if ( pRenderer->_viewCount > 1 )
+        {
+            pEnc->setViewport( viewportFor( view, pRenderer->_viewCount, pRenderer->_viewportSize ) );
+        }
+        pEnc->setVertexBufferOffset( view * kCameraDataStride, /* index */ 2 );
+    }
+
+    void setMesh( uint32_t mesh ) {}
+    void setTexture( uint32_t texture ) {}     // per instance, out of the material table
+
+    void draw( const DrawPacket& packet )
+    {
+        pEnc->drawIndexedPrimitives( MTL::PrimitiveType::PrimitiveTypeTriangle,
+                                    pRenderer->_indexCount, MTL::IndexType::IndexTypeUInt16,
+                                    pRenderer->_pIndexBuffer,
+                                    pRenderer->_indexDataOffset,
+                                    packet.instanceCount,
+                                    /* baseVertex */ 0,
+                                    /* baseInstance */ packet.firstInstance );
+    }
+};
+
+// This frame's draws as packets - the ranges of each view when split screen, else the sorted
+// batches or everything as one
+void Renderer::recordDraws()
+{
+    const uint32_t pipeline = _quantizedVertices ? 1u : 0u;
+    _pCommandRecorder->begin();
+    if ( _viewCount > 1 )
+    {
+        _pCommandRecorder->record( _viewCount, 1, [&]( size_t begin, size_t end, CommandList& list )
+        {
+            for ( size_t v = begin; v < end; ++v )
+            {
+                MultiViewCuller::Range ranges[ MultiViewCuller::kMaskCount / 2 ];
+                const uint32_t rangeCount = _pMultiViewCuller->viewRanges( (uint32_t)v, ranges );
+                for ( uint32_t r = 0; r < rangeCount; ++r )
+                {
+                    list.draw( { pipeline, (uint32_t)v, 0, 0, ranges[r].first, ranges[r].count } );
+                }
+            }
+        } );
+    }
+    else if ( _sortDraws )
+    {
+        const std::vector<DrawQueue::Batch>& batches = _pDrawQueue->batches();
+        _pCommandRecorder->record( batches.size(), kBatchesPerList, [&]( size_t begin, size_t end, CommandList& list )
+        {
+            for ( size_t b = begin; b < end; ++b )
+            {
+                if ( batches[b].instanceCount > 0 )
+                {
+                    list.draw( { batches[b].pipeline, 0, batches[b].mesh, batches[b].texture, batches[b].firstInstance, batches[b].instanceCount } );
+                }
+            }
+        } );
+    }
+    else if ( _drawInstanceCount > 0 )
+    {
+        _pCommandRecorder->record( 1, 1, [&]( size_t begin, size_t end, CommandList& list )
+        {
+            list.draw( { pipeline, 0, 0, 0, 0, (uint32_t)_drawInstanceCount } );
+        } );
+    }
+    _pCommandRecorder->merge();
+}
+
+// State every scene encoder starts with, parallel sub-encoders inherit none of it
+void Renderer::setupSceneEncoder( MTL::RenderCommandEncoder* pEnc, MTL::Buffer* pCameraDataBuffer )
+{
+    pEnc->setDepthStencilState( _pDepthStencilState );
+    pEnc->setVertexBuffer( _pInstanceDataBuffer[ _frame ], /* offset */ 0, /* index */ 1 );
+    pEnc->setVertexBuffer( pCameraDataBuffer, /* offset */ 0, /* index */ 2 );
+
+    _pBindlessTable->bind( pEnc );
+    
+    pEnc->setCullMode( MTL::CullModeBack );
+    pEnc->setFrontFacingWinding( MTL::Winding::WindingCounterClockwise );
+}
+
 void Renderer::draw( MTK::View* pView )
 {
     using simd::float3;
@@ -327,45 +910,105 @@ void Renderer::draw( MTK::View* pView )
     MTL::CommandBuffer* pCmd = _pCommandQueue->commandBuffer();
     dispatch_semaphore_wait( _semaphore, DISPATCH_TIME_FOREVER );
     Renderer* pRenderer = this;
+    const uint64_t releaseFrame = _pReleaseQueue->frame();
     pCmd->addCompletedHandler( ^void( MTL::CommandBuffer* pCmd ){
+        pRenderer->_pReleaseQueue->retire( releaseFrame );
         dispatch_semaphore_signal( pRenderer->_semaphore );
     });
 
-    // Camera buffer
+    // whatever finished frames were the last to use
+    _pReleaseQueue->collect();
+    _pResourceHeap->collect( _pReleaseQueue->retired() );
+    _pTextureHeap->collect( _pReleaseQueue->retired() );
+    _pBindlessTable->beginFrame( _pReleaseQueue->frame(), _pReleaseQueue->retired() );
+
+    // shaders saved since last frame, swapped in before anything is encoded with the old ones
+    if ( _pShaderReloader )
+    {
+        _pShaderReloader->apply();
+    }
+
+    // loads that finished go up with this frame's uploads. The texture file stops being wanted
+    // once it's uploaded - or has failed to load - and can then be evicted
+    if ( _textureAsset != AssetStreamer::kInvalidAsset && !_textureFileReady && _pAssetStreamer->stats().failures == 0 )
+    {
+        _pAssetStreamer->request( _textureAsset, 1.f );
+    }
+    _pAssetStreamer->update();
+
+    // Camera buffer, a camera per view
     MTL::Buffer* pCameraDataBuffer = _pCameraDataBuffer[ _frame ];
-    CameraData* pCameraData = reinterpret_cast< CameraData *>( pCameraDataBuffer->contents() );
-    float aspect = _viewportSize.width / _viewportSize.height;
-    pCameraData->perspectiveTransform = Maths::makePerspective( 45.f * M_PI / 180.f, aspect, 0.03f, 500.0f ) ;
-    pCameraData->worldTransform = Maths::makeIdentity();
-    pCameraData->worldNormalTransform = Maths::discardTranslation( pCameraData->worldTransform );
-    pCameraDataBuffer->didModifyRange( NS::Range::Make( 0, sizeof( CameraData ) ) );
+    if ( _viewCount > 1 )
+    {
+        for ( int v = 0; v < _viewCount; ++v )
+        {
+            const MTL::Viewport viewport = viewportFor( v, _viewCount, _viewportSize );
+            CameraData* pCameraData = reinterpret_cast< CameraData *>( (uint8_t*)pCameraDataBuffer->contents() + v * kCameraDataStride );
+            CubeScene::updateViewCamera( pCameraData, viewport.width / viewport.height, v );
+        }
+    }
+    else
+    {
+        CameraData* pCameraData = reinterpret_cast< CameraData *>( pCameraDataBuffer->contents() );
+        float aspect = _viewportSize.width / _viewportSize.height;
+        CubeScene::updateCamera( pCameraData, aspect );
+    }
 
     // compute
     generateMandelbrotTexture();
 
-    MTL::RenderPassDescriptor* pRpd = pView->currentRenderPassDescriptor();
-    MTL::RenderCommandEncoder* pEnc = pCmd->renderCommandEncoder( pRpd );
+    // CPU image data this frame has room for, blitted before the scene samples it
+    _pTextureUploader->encode( pCmd, _pReleaseQueue->frame(), _pReleaseQueue->retired() );
 
-    pEnc->pushDebugGroup( AAPLSTR( "3D Scene" ) );
-    pEnc->setRenderPipelineState( _pPSO );
-    pEnc->setDepthStencilState( _pDepthStencilState );
-    
-    pEnc->setVertexBuffer( _pVertexDataBuffer, /* offset */ 0, /* index */ 0 );
-    MTL::Buffer* pInstanceDataBuffer = _pInstanceDataBuffer[ _frame ];
-    pEnc->setVertexBuffer( pInstanceDataBuffer, /* offset */ 0, /* index */ 1 );
-    pEnc->setVertexBuffer( pCameraDataBuffer, /* offset */ 0, /* index */ 2 );
+    recordDraws();
+    const std::vector<DrawPacket>& packets = _pCommandRecorder->packets();
 
-    pEnc->setFragmentTexture(_pTexture, 0);
-    
-    pEnc->setCullMode( MTL::CullModeBack );
-    pEnc->setFrontFacingWinding( MTL::Winding::WindingCounterClockwise );
+    MTL::RenderPassDescriptor* pRpd = pView->currentRenderPassDescriptor();
+    MTL::ParallelRenderCommandEncoder* pParallelEnc = nullptr;
+    MTL::RenderCommandEncoder* pEnc = nullptr;
+    if ( _parallelEncoding )
+    {
+        // sub-encoders run in the order they're made, so segments made in stream order draw in
+        // stream order whichever thread finishes first
+        pParallelEnc = pCmd->parallelRenderCommandEncoder( pRpd );
+        CommandRecorder::Segment segments[ kMaxSceneEncoders ];
+        const uint32_t segmentCount = _pCommandRecorder->split( std::min( kMaxSceneEncoders, JobSystem::Instance()->numThreads() ),
+                                                                kMinPacketsPerEncoder, segments );
+        MTL::RenderCommandEncoder* pSceneEncoders[ kMaxSceneEncoders ];
+        for ( uint32_t s = 0; s < segmentCount; ++s )
+        {
+            pSceneEncoders[s] = pParallelEnc->renderCommandEncoder();
+        }
+        JobSystem::Instance()->parallelFor( segmentCount, 1, [&]( size_t begin, size_t end )
+        {
+            NS::AutoreleasePool* pJobPool = NS::AutoreleasePool::alloc()->init();
+            for ( size_t s = begin; s < end; ++s )
+            {
+                MTL::RenderCommandEncoder* pSceneEnc = pSceneEncoders[s];
+                pSceneEnc->pushDebugGroup( AAPLSTR( "3D Scene" ) );
+                setupSceneEncoder( pSceneEnc, pCameraDataBuffer );
+                PacketEncoder encoder = { this, pSceneEnc };
+                CommandRecorder::replay( packets.data() + segments[s].first, segments[s].count, encoder );
+                pSceneEnc->popDebugGroup();
+                pSceneEnc->endEncoding();
+            }
+            pJobPool->release();
+        } );
+        _encoderCount = segmentCount;
 
-    pEnc->drawIndexedPrimitives( MTL::PrimitiveType::PrimitiveTypeTriangle,
-                                6 * 6, MTL::IndexType::IndexTypeUInt16,
-                                _pIndexBuffer,
-                                0,
-                                kNumInstances );
-    pEnc->popDebugGroup();
+        // last, so the UI draws over every segment
+        pEnc = pParallelEnc->renderCommandEncoder();
+    }
+    else
+    {
+        pEnc = pCmd->renderCommandEncoder( pRpd );
+        pEnc->pushDebugGroup( AAPLSTR( "3D Scene" ) );
+        setupSceneEncoder( pEnc, pCameraDataBuffer );
+        PacketEncoder encoder = { this, pEnc };
+        CommandRecorder::replay( packets.data(), packets.size(), encoder );
+        pEnc->popDebugGroup();
+        _encoderCount = 1;
+    }
 
     // UI
     UI::Instance()->NewFrame(pRpd, pEnc);
@@ -374,12 +1017,112 @@ void Renderer::draw( MTK::View* pView )
     // 1. Show the big demo window (Most of the sample code is in ImGui::ShowDemoWindow()! You can browse its code to learn more about Dear ImGui!).
     if (show_demo_window)
         ImGui::ShowDemoWindow(&show_demo_window);
+
+    ImGui::Begin( "Mandelbrot" );
+    ImGui::Checkbox( "Deep zoom", &_deepZoomEnabled );
+    ImGui::Checkbox( "Render on CPU", &_computeOnCPU );
+    if ( _computeOnCPU )
+    {
+        ImGui::Checkbox( "Kaiser mip filter", &_kaiserMips );
+    }
+    if ( _deepZoomEnabled )
+    {
+        const DeepZoom::Stats& stats = _pDeepZoom->stats();
+        ImGui::Text( "Scale %.3g", _pDeepZoom->scale() );
+        ImGui::Text( "Orbit %u iterations, skipped %u (%.2f ms)", stats.orbitLength, stats.skipIterations, stats.orbitMs );
+        if ( _computeOnCPU )
+        {
+            ImGui::Text( "CPU render %.2f ms, %llu rebases", stats.renderMs, (unsigned long long)stats.rebases );
+        }
+    }
+    ImGui::End();
+
+    ImGui::Begin( "Scene" );
+    ImGui::Checkbox( "Quantized vertices", &_quantizedVertices );
+    ImGui::Text( "Vertex data %zu -> %zu bytes", _quantizationError.bytesBefore, _quantizationError.bytesAfter );
+    ImGui::Text( "Max error: position %.3g, normal %.3g deg, texcoord %.3g", _quantizationError.maxPositionError,
+                 _quantizationError.maxNormalErrorDegrees, _quantizationError.maxTexcoordError );
+    ImGui::Checkbox( "Occlusion culling", &_occlusionCulling );
+    if ( _occlusionCulling )
+    {
+        const OcclusionCuller::Stats& stats = _pOcclusionCuller->stats();
+        ImGui::Text( "Drawing %lu of %zu: %zu outside the frustum, %zu occluded", (unsigned long)_drawInstanceCount,
+                     stats.instances, stats.outsideFrustum, stats.occluded );
+        ImGui::Text( "%zu occluders, %zu triangles", stats.occluders, stats.occluderTriangles );
+        ImGui::Text( "CPU setup %.2f, raster %.2f, pyramid %.2f, test %.2f ms", stats.setupMs, stats.rasterMs, stats.pyramidMs, stats.testMs );
+    }
+    ImGui::SliderInt( "Split screen views", &_viewCount, 1, MultiViewCuller::kMaxViews );
+    if ( _viewCount > 1 )
+    {
+        const MultiViewCuller::Stats& stats = _pMultiViewCuller->stats();
+        ImGui::Text( "%zu instances written for %u views, cull %.2f ms, gather %.2f ms", stats.visibleAny, stats.viewCount,
+                     stats.cullMs, stats.gatherMs );
+        ImGui::Text( "Visible per view: %zu %zu %zu %zu", stats.visible[0], stats.visible[1], stats.visible[2], stats.visible[3] );
+        ImGui::Text( "Occlusion culling and the draw queue are single view only" );
+    }
+    ImGui::Checkbox( "Sorted draw queue", &_sortDraws );
+    if ( _sortDraws )
+    {
+        const DrawQueue::Stats& stats = _pDrawQueue->stats();
+        ImGui::Text( "%zu draws -> %zu batches, sort %.2f ms (%u passes), batch %.2f ms", stats.draws, stats.batches,
+                     stats.sortMs, stats.sortPasses, stats.batchMs );
+        ImGui::Text( "Binds: pipeline %zu -> %zu, texture %zu -> %zu, mesh %zu -> %zu", stats.submitted.pipelines, stats.batched.pipelines,
+                     stats.submitted.textures, stats.batched.textures, stats.submitted.meshes, stats.batched.meshes );
+    }
+    ImGui::Checkbox( "Parallel encoding", &_parallelEncoding );
+    {
+        const CommandRecorder::Stats& stats = _pCommandRecorder->stats();
+        ImGui::Text( "%zu draw packets from %zu lists on %u encoders, record %.2f ms, merge %.2f ms", stats.packets, stats.lists,
+                     _encoderCount, stats.recordMs, stats.mergeMs );
+    }
+    {
+        const ReleaseQueue::Stats stats = _pReleaseQueue->stats();
+        ImGui::Text( "Frame %llu, retired %llu, %zu releases pending, %zu released", (unsigned long long)stats.frame,
+                     (unsigned long long)stats.retired, stats.pending, stats.released );
+    }
+    {
+        const UploadQueue::Stats stats = _pTextureUploader->stats();
+        ImGui::Text( "Uploads: %zu pending, %.2f MB staged in %zu copies, %zu staging buffers, convert %.2f ms", stats.pending,
+                     stats.stagedBytes / 1048576.0, stats.copies, stats.stagingBuffers, stats.convertMs );
+    }
+    {
+        const AssetStreamer::Stats stats = _pAssetStreamer->stats();
+        ImGui::Text( "Streaming: %zu of %zu assets resident, %.1f of %.0f MB, %.1f MB in flight, hit rate %.0f%%, %llu evictions",
+                     stats.resident, stats.assets, stats.residentBytes / 1048576.0, _pAssetStreamer->budget() / 1048576.0,
+                     stats.bytesInFlight / 1048576.0, stats.hitRate() * 100.0, (unsigned long long)stats.evictions );
+    }
+    if ( _pShaderReloader )
+    {
+        const ShaderReloader::Stats stats = _pShaderReloader->stats();
+        ImGui::Text( "Shader reloads: %u, %u failed, last took %.1f ms", stats.reloads, stats.failures, stats.lastBuildMs );
+        if ( !stats.lastError.empty() )
+        {
+            ImGui::TextWrapped( "%s", stats.lastError.c_str() );
+        }
+    }
+    {
+        ImGui::Text( "Bindless: %u materials, %zu resident textures, %zu buffers", _pBindlessTable->materialCount(), _pBindlessTable->residentCount(),
+                     _pBindlessTable->residentBufferCount() );
+        for ( const ResourceHeap* pHeap : { _pResourceHeap, _pTextureHeap } )
+        {
+            const HeapAllocator::Stats stats = pHeap->stats();
+            ImGui::Text( "%s heaps: %zu blocks, %.2f of %.2f MB in %zu resources, %zu free ranges, %.0f%% fragmented",
+                         pHeap == _pResourceHeap ? "Shared" : "Private", stats.blocks, stats.used / 1048576.0, stats.capacity / 1048576.0,
+                         stats.allocations, stats.freeBlocks, stats.fragmentation * 100.0 );
+        }
+    }
+    ImGui::End();
     
     UI::Instance()->Draw(pCmd);
 
     pEnc->endEncoding();
+    if ( pParallelEnc )
+    {
+        pParallelEnc->endEncoding();
+    }
     pCmd->presentDrawable( pView->currentDrawable() );
     pCmd->commit();
+    _pReleaseQueue->endFrame();
 
     pPool->release();
 }
@@ -8,14 +8,33 @@
 #pragma once
 
 #include "Common.h"
+#include "../Scene/CubeScene.hpp"
+#include "../Mesh/VertexQuantization.hpp"
+#include "DrawQueue.hpp"
+#include "UploadQueue.hpp"
+
+#include <string>
+#include <vector>
 
-static constexpr size_t kInstanceRows = 10;
-static constexpr size_t kInstanceColumns = 10;
-static constexpr size_t kInstanceDepth = 10;
-static constexpr size_t kNumInstances = (kInstanceRows * kInstanceColumns * kInstanceDepth);
 static constexpr size_t kMaxFramesInFlight = 3;
 static constexpr uint32_t kTextureWidth = 128;
 static constexpr uint32_t kTextureHeight = 128;
+static constexpr uint32_t kDeepZoomMaxIterations = 8192;
+static constexpr uint32_t kMaxOccluders = 64;       // biggest instances on screen rasterized as occluders when culling
+
+class DeepZoom;
+class MipChain;
+class OcclusionCuller;
+class MultiViewCuller;
+class CommandRecorder;
+class ReleaseQueue;
+class ResourceHeap;
+class BindlessTable;
+class ShaderReloader;
+class TextureUploader;
+class SceneFile;
+class Ktx2File;
+class AssetStreamer;
 
 class Renderer
 {
@@ -31,24 +50,97 @@ public:
     void buildDepthStencilStates();
     void buildBuffers();
     void buildTextures();
+    MTL::Texture* newFileTexture( const Ktx2File& file );
+    void buildMaterials();
     void buildComputePipeline();
     void generateMandelbrotTexture();
+    void generateDeepZoomTexture( MTL::CommandBuffer* pCommandBuffer );
+    void encodeMipmaps( MTL::CommandBuffer* pCommandBuffer );
+    void uploadMipChain();
+    bool mipChainUploading() const;
+    void recordDraws();
+    void setupSceneEncoder( MTL::RenderCommandEncoder* pEnc, MTL::Buffer* pCameraDataBuffer );
+
+    // Releases pObject once no frame in flight can be using it - for anything replaced mid-run
+    void releaseLater( NS::Object* pObject );
+    // The same for resources from _pResourceHeap, whose memory is reused once the frame retires
+    void freeLater( MTL::Resource* pResource );
 
 private:
+    struct PacketEncoder;   // replays DrawPacket state onto a render command encoder
+
+    // AssetStreamer callbacks for MM_TEXTURE_FILE, and the UploadQueue::CompleteFn for its levels
+    static void* loadAsset( void* pUser, uint32_t asset, size_t* pSize );
+    static void assetResident( void* pUser, uint32_t asset, void* pPayload );
+    static void evictAsset( void* pUser, uint32_t asset, void* pPayload );
+    static void textureFileUploaded( void* pUser, uint64_t ticket );
+
     MTL::Device* _pDevice;
     MTL::CommandQueue* _pCommandQueue;
     MTL::Library* _pShaderLibrary;
     MTL::RenderPipelineState* _pPSO;
+    MTL::RenderPipelineState* _pQuantizedPSO;
     MTL::ComputePipelineState* _pComputePSO;
+    MTL::ComputePipelineState* _pDeepZoomPSO;
     MTL::DepthStencilState* _pDepthStencilState;
     MTL::Texture* _pTexture;
+    MTL::Texture* _pFileTexture;    // MM_TEXTURE_FILE once it's streamed in, nullptr until then
 
     MTL::Buffer* _pCameraDataBuffer[kMaxFramesInFlight];
 
     MTL::Buffer* _pVertexDataBuffer;
+    MTL::Buffer* _pQuantizedVertexBuffer;
+    MTL::Buffer* _pMeshQuantizationBuffer;
     MTL::Buffer* _pInstanceDataBuffer[kMaxFramesInFlight];
+    uint32_t _instanceVersion[kMaxFramesInFlight];     // SceneGraph version each buffer was last written at
+    bool _instancesReordered[kMaxFramesInFlight];       // culled or sorted, not one slot per instance
+    NS::UInteger _drawInstanceCount;
     MTL::Buffer* _pIndexBuffer;
+    NS::UInteger _indexCount;
+    NS::UInteger _vertexDataOffset;     // non zero when the buffers wrap a scene file
+    NS::UInteger _indexDataOffset;
     MTL::Buffer* _pTextureAnimationBuffer;
+    MTL::Buffer* _pDeepZoomOrbitBuffer[kMaxFramesInFlight];
+
+    DeepZoom* _pDeepZoom;
+    MipChain* _pMipChain;   // CPU side copy of _pTexture for the CPU compute paths
+    std::vector<UploadQueue::Ticket> _mipChainTickets;  // its levels' uploads, read from it until complete
+    SceneFile* _pSceneFile; // mapping behind _pVertexDataBuffer / _pIndexBuffer when loaded from a file
+    SceneGraph* _pSceneGraph;
+    OcclusionCuller* _pOcclusionCuller;
+    std::vector<InstanceData> _cpuInstances;    // every instance, culled into the GPU buffer
+    std::vector<InstanceData> _cpuVisible;      // culled but not yet sorted
+    DrawQueue* _pDrawQueue;
+    MultiViewCuller* _pMultiViewCuller;
+    CommandRecorder* _pCommandRecorder;
+    ReleaseQueue* _pReleaseQueue;
+    ResourceHeap* _pResourceHeap;     // CPU written buffers placed in shared heaps
+    ResourceHeap* _pTextureHeap;      // textures in private heaps - written by kernels and blits only
+    BindlessTable* _pBindlessTable;
+    ShaderReloader* _pShaderReloader;   // only with MM_SHADER_DIR set
+    TextureUploader* _pTextureUploader;
+    AssetStreamer* _pAssetStreamer;
+    std::string _textureFilePath;       // MM_TEXTURE_FILE
+    uint32_t _textureAsset;             // its AssetStreamer id, wanted until its levels are uploaded
+    uint32_t _textureFileUploads;       // still to complete
+    bool _textureFileReady;
+    std::vector<uint32_t> _materialHandles;     // BindlessTable handles, by material
+    MTL::Buffer* _pMaterialDataBuffer;          // every material's MaterialData, each slot points into it
+    float _meshBoxMin[3];                       // object space bounds of the drawn mesh
+    float _meshBoxMax[3];
+    uint32_t _cpuInstanceVersion;
+    std::vector<VertexData> _cpuVertices;       // the drawn mesh again, for occluders and bounds
+    std::vector<uint16_t> _cpuIndices;
+    bool _deepZoomEnabled;
+    bool _computeOnCPU;
+    bool _kaiserMips;
+    bool _quantizedVertices;
+    bool _occlusionCulling;
+    bool _sortDraws;
+    int _viewCount;                             // split screen, 1 to MultiViewCuller::kMaxViews
+    bool _parallelEncoding;
+    uint32_t _encoderCount;                     // scene encoders last frame
+    VertexQuantization::ErrorReport _quantizationError;
     
     float _angle;
     int _frame;
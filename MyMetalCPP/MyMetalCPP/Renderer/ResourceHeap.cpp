@@ -0,0 +1,130 @@
+//
+//  ResourceHeap.cpp
+//  MyMetalCPP
+//
+
+#include "ResourceHeap.hpp"
+
+#include <cassert>
+
+static constexpr uint64_t kHeapGranularity = 256;
+
+ResourceHeap::ResourceHeap( MTL::Device* pDevice, MTL::StorageMode storageMode, uint64_t blockSize )
+: _pDevice( pDevice->retain() )
+, _storageMode( storageMode )
+, _options( ( storageMode == MTL::StorageModePrivate ? MTL::ResourceStorageModePrivate : MTL::ResourceStorageModeShared ) |
+            MTL::ResourceHazardTrackingModeTracked )
+, _allocator( blockSize, kHeapGranularity )
+, _placementFailed( false )
+{
+    // heaps hold shared or private memory only
+    assert( storageMode == MTL::StorageModeShared || storageMode == MTL::StorageModePrivate );
+}
+
+ResourceHeap::~ResourceHeap()
+{
+    // anything still placed keeps its heap alive through its own reference
+    for ( MTL::Heap* pHeap : _heaps )
+    {
+        pHeap->release();
+    }
+    _pDevice->release();
+}
+
+MTL::Heap* ResourceHeap::heapFor( const HeapAllocator::Allocation& allocation )
+{
+    while ( _heaps.size() <= allocation.block )
+    {
+        MTL::HeapDescriptor* pDesc = MTL::HeapDescriptor::alloc()->init();
+        pDesc->setType( MTL::HeapTypePlacement );
+        pDesc->setStorageMode( _storageMode );
+        pDesc->setHazardTrackingMode( MTL::HazardTrackingModeTracked );
+        pDesc->setSize( _allocator.blockCapacity( (uint32_t)_heaps.size() ) );
+        MTL::Heap* pHeap = _pDevice->newHeap( pDesc );
+        pDesc->release();
+        if ( !pHeap )
+        {
+            __builtin_printf( "ResourceHeap: failed to create a %llu byte heap\n",
+                              (unsigned long long)_allocator.blockCapacity( (uint32_t)_heaps.size() ) );
+            return nullptr;
+        }
+        _heaps.push_back( pHeap );
+    }
+    return _heaps[ allocation.block ];
+}
+
+void ResourceHeap::placementFailed()
+{
+    __builtin_printf( "ResourceHeap: can't place %s resources, allocating them standalone\n",
+                      _storageMode == MTL::StorageModePrivate ? "private" : "shared" );
+    _placementFailed = true;
+}
+
+MTL::Buffer* ResourceHeap::newBuffer( NS::UInteger length )
+{
+    if ( !_placementFailed )
+    {
+        const MTL::SizeAndAlign sizeAndAlign = _pDevice->heapBufferSizeAndAlign( length, _options );
+        const HeapAllocator::Allocation allocation = _allocator.allocate( sizeAndAlign.size, sizeAndAlign.align );
+        MTL::Heap* pHeap = heapFor( allocation );
+        MTL::Buffer* pBuffer = pHeap ? pHeap->newBuffer( length, _options, allocation.offset ) : nullptr;
+        if ( pBuffer )
+        {
+            _allocations[ pBuffer ] = allocation;
+            return pBuffer;
+        }
+        _allocator.free( allocation, 0 );
+        placementFailed();
+    }
+    MTL::Buffer* pBuffer = _pDevice->newBuffer( length, _options );
+    if ( pBuffer )
+    {
+        _standalone.insert( pBuffer );
+    }
+    return pBuffer;
+}
+
+MTL::Texture* ResourceHeap::newTexture( MTL::TextureDescriptor* pDesc )
+{
+    pDesc->setStorageMode( _storageMode );
+    pDesc->setHazardTrackingMode( MTL::HazardTrackingModeTracked );
+    if ( !_placementFailed )
+    {
+        const MTL::SizeAndAlign sizeAndAlign = _pDevice->heapTextureSizeAndAlign( pDesc );
+        const HeapAllocator::Allocation allocation = _allocator.allocate( sizeAndAlign.size, sizeAndAlign.align );
+        MTL::Heap* pHeap = heapFor( allocation );
+        MTL::Texture* pTexture = pHeap ? pHeap->newTexture( pDesc, allocation.offset ) : nullptr;
+        if ( pTexture )
+        {
+            _allocations[ pTexture ] = allocation;
+            return pTexture;
+        }
+        _allocator.free( allocation, 0 );
+        placementFailed();
+    }
+    MTL::Texture* pTexture = _pDevice->newTexture( pDesc );
+    if ( pTexture )
+    {
+        _standalone.insert( pTexture );
+    }
+    return pTexture;
+}
+
+void ResourceHeap::free( MTL::Resource* pResource, uint64_t frame )
+{
+    if ( _standalone.erase( pResource ) )
+    {
+        pResource->release();
+        return;
+    }
+    const auto found = _allocations.find( pResource );
+    assert( found != _allocations.end() );
+    _allocator.free( found->second, frame );
+    _allocations.erase( found );
+    pResource->release();
+}
+
+void ResourceHeap::collect( uint64_t retiredFrame )
+{
+    _allocator.collect( retiredFrame );
+}
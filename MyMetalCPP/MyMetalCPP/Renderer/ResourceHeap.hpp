@@ -0,0 +1,55 @@
+//
+//  ResourceHeap.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include "Common.h"
+#include "HeapAllocator.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Buffers and textures placed in large MTL::Heap blocks rather than allocated one by one -
+// HeapAllocator picks the offsets, this backs each of its blocks with a placement heap.
+//
+// Every resource shares the heap's storage mode. Heaps are hazard tracked, so resources in them
+// synchronize like standalone ones. free() releases the Metal object straight away - command
+// buffers keep their own reference - but the memory under it stays reserved until the frame it
+// was freed in retires, so nothing placed over it later can alias what's still in flight.
+//
+// Not every device places every storage mode - Intel and AMD Macs have no shared placement heaps.
+// Once a heap can't be made or a resource can't be placed in one, resources come standalone from
+// the device with the same options instead, freed straight away and left out of stats().
+
+class ResourceHeap
+{
+public:
+    ResourceHeap( MTL::Device* pDevice, MTL::StorageMode storageMode, uint64_t blockSize );
+    ~ResourceHeap();
+
+    // nullptr if neither the heap nor the device can make it
+    MTL::Buffer* newBuffer( NS::UInteger length );
+    MTL::Texture* newTexture( MTL::TextureDescriptor* pDesc );     // sets the descriptor's storage mode
+
+    // frame as numbered by ReleaseQueue, 0 once nothing can be using it
+    void free( MTL::Resource* pResource, uint64_t frame );
+    void collect( uint64_t retiredFrame );
+
+    HeapAllocator::Stats stats() const { return _allocator.stats(); }
+
+private:
+    MTL::Heap* heapFor( const HeapAllocator::Allocation& allocation );
+    void placementFailed();
+
+    MTL::Device* _pDevice;
+    MTL::StorageMode _storageMode;
+    MTL::ResourceOptions _options;
+    HeapAllocator _allocator;
+    std::vector<MTL::Heap*> _heaps;     // one per allocator block
+    std::unordered_map<MTL::Resource*, HeapAllocator::Allocation> _allocations;
+    std::unordered_set<MTL::Resource*> _standalone;
+    bool _placementFailed;              // the device can't place this storage mode, stop trying
+};
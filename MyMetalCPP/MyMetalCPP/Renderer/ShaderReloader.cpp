@@ -0,0 +1,253 @@
+//
+//  ShaderReloader.cpp
+//  MyMetalCPP
+//
+
+#include "ShaderReloader.hpp"
+#include "ReleaseQueue.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+static constexpr uint32_t kWatchTimeoutMs = 100;    // how often the thread looks at _stop
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+ShaderReloader::ShaderReloader( MTL::Device* pDevice, ReleaseQueue* pReleaseQueue )
+: _pDevice( pDevice->retain() )
+, _pReleaseQueue( pReleaseQueue )
+, _stop( false )
+, _stats{ 0, 0, 0.0, std::string() }
+{
+}
+
+ShaderReloader::~ShaderReloader()
+{
+    _stop = true;
+    if ( _thread.joinable() )
+    {
+        _thread.join();
+    }
+    // never swapped in, so never used
+    for ( const Rebuilt& rebuilt : _rebuilt )
+    {
+        rebuilt.pState->release();
+    }
+    for ( const Pipeline& pipeline : _pipelines )
+    {
+        if ( pipeline.pDesc )
+        {
+            pipeline.pDesc->release();
+        }
+    }
+    _pDevice->release();
+}
+
+uint32_t ShaderReloader::addLibrary( const std::string& path )
+{
+    assert( !_thread.joinable() );
+    return _sources.add( path );
+}
+
+void ShaderReloader::addRenderPipeline( uint32_t library, const MTL::RenderPipelineDescriptor* pDesc, MTL::RenderPipelineState** ppState )
+{
+    assert( !_thread.joinable() );
+    Pipeline pipeline = { library, pDesc->copy(), {}, {}, {}, reinterpret_cast< NS::Object** >( ppState ) };
+    pipeline.vertexName = pDesc->vertexFunction()->name()->utf8String();
+    if ( pDesc->fragmentFunction() )
+    {
+        pipeline.fragmentName = pDesc->fragmentFunction()->name()->utf8String();
+    }
+    _pipelines.push_back( pipeline );
+}
+
+void ShaderReloader::addComputePipeline( uint32_t library, const char* pFunctionName, MTL::ComputePipelineState** ppState )
+{
+    assert( !_thread.joinable() );
+    _pipelines.push_back( { library, nullptr, {}, {}, pFunctionName, reinterpret_cast< NS::Object** >( ppState ) } );
+}
+
+bool ShaderReloader::start()
+{
+    bool watching = false;
+    for ( const std::string& directory : _sources.directories() )
+    {
+        watching |= _watcher.addDirectory( directory );
+    }
+    if ( watching )
+    {
+        _thread = std::thread( [this]() { watch(); } );
+    }
+    return watching;
+}
+
+void ShaderReloader::watch()
+{
+    while ( !_stop )
+    {
+        const std::vector<std::string> changed = _watcher.wait( kWatchTimeoutMs );
+        if ( !changed.empty() )
+        {
+            for ( uint32_t library : _sources.affected( changed ) )
+            {
+                rebuild( library );
+            }
+        }
+    }
+}
+
+void ShaderReloader::rebuild( uint32_t library )
+{
+    using NS::StringEncoding::UTF8StringEncoding;
+
+    NS::AutoreleasePool* pPool = NS::AutoreleasePool::alloc()->init();
+    const auto start = std::chrono::steady_clock::now();
+
+    // the library from source, then every pipeline of it - all or nothing
+    std::string source, error;
+    std::vector<Rebuilt> rebuilt;
+    MTL::Library* pLibrary = nullptr;
+    if ( _sources.expand( library, source, error ) )
+    {
+        NS::Error* pError = nullptr;
+        MTL::CompileOptions* pOptions = MTL::CompileOptions::alloc()->init();
+        pLibrary = _pDevice->newLibrary( NS::String::string( source.c_str(), UTF8StringEncoding ), pOptions, &pError );
+        pOptions->release();
+        if ( !pLibrary )
+        {
+            error = pError ? pError->localizedDescription()->utf8String() : "compile failed";
+        }
+    }
+
+    for ( size_t i = 0; pLibrary && i < _pipelines.size() && error.empty(); ++i )
+    {
+        const Pipeline& pipeline = _pipelines[i];
+        if ( pipeline.library != library )
+        {
+            continue;
+        }
+
+        NS::Error* pError = nullptr;
+        NS::Object* pState = nullptr;
+        if ( pipeline.pDesc )
+        {
+            MTL::RenderPipelineDescriptor* pDesc = pipeline.pDesc->copy();
+            MTL::Function* pVertexFn = pLibrary->newFunction( NS::String::string( pipeline.vertexName.c_str(), UTF8StringEncoding ) );
+            MTL::Function* pFragFn = pipeline.fragmentName.empty() ? nullptr :
+                                     pLibrary->newFunction( NS::String::string( pipeline.fragmentName.c_str(), UTF8StringEncoding ) );
+            if ( pVertexFn && ( pFragFn || pipeline.fragmentName.empty() ) )
+            {
+                pDesc->setVertexFunction( pVertexFn );
+                pDesc->setFragmentFunction( pFragFn );
+                pState = _pDevice->newRenderPipelineState( pDesc, &pError );
+            }
+            else
+            {
+                error = "no function " + ( pVertexFn ? pipeline.fragmentName : pipeline.vertexName );
+            }
+            if ( pVertexFn )
+            {
+                pVertexFn->release();
+            }
+            if ( pFragFn )
+            {
+                pFragFn->release();
+            }
+            pDesc->release();
+        }
+        else
+        {
+            MTL::Function* pFn = pLibrary->newFunction( NS::String::string( pipeline.computeName.c_str(), UTF8StringEncoding ) );
+            if ( pFn )
+            {
+                pState = _pDevice->newComputePipelineState( pFn, &pError );
+                pFn->release();
+            }
+            else
+            {
+                error = "no function " + pipeline.computeName;
+            }
+        }
+
+        if ( pState )
+        {
+            rebuilt.push_back( { pipeline.ppState, pState } );
+        }
+        else if ( error.empty() )
+        {
+            error = pError ? pError->localizedDescription()->utf8String() : "pipeline failed";
+        }
+    }
+    if ( pLibrary )
+    {
+        pLibrary->release();
+    }
+
+    const double buildMs = elapsedMs( start );
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _stats.lastBuildMs = buildMs;
+        if ( error.empty() )
+        {
+            // a state rebuilt twice before apply() was never used the first time
+            for ( const Rebuilt& state : rebuilt )
+            {
+                for ( Rebuilt& waiting : _rebuilt )
+                {
+                    if ( waiting.ppState == state.ppState )
+                    {
+                        waiting.pState->release();
+                        waiting.pState = nullptr;
+                    }
+                }
+            }
+            _rebuilt.erase( std::remove_if( _rebuilt.begin(), _rebuilt.end(), []( const Rebuilt& waiting ) { return !waiting.pState; } ), _rebuilt.end() );
+            _rebuilt.insert( _rebuilt.end(), rebuilt.begin(), rebuilt.end() );
+            _stats.reloads++;
+            _stats.lastError.clear();
+        }
+        else
+        {
+            for ( const Rebuilt& state : rebuilt )
+            {
+                state.pState->release();
+            }
+            _stats.failures++;
+            _stats.lastError = error;
+        }
+    }
+
+    if ( error.empty() )
+    {
+        __builtin_printf( "ShaderReloader: %s rebuilt in %.1f ms\n", _sources.path( library ).c_str(), buildMs );
+    }
+    else
+    {
+        __builtin_printf( "ShaderReloader: %s kept the last good pipelines\n%s\n", _sources.path( library ).c_str(), error.c_str() );
+    }
+    pPool->release();
+}
+
+uint32_t ShaderReloader::apply()
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    for ( const Rebuilt& rebuilt : _rebuilt )
+    {
+        // frames in flight may still be using the old one
+        _pReleaseQueue->release( *rebuilt.ppState );
+        *rebuilt.ppState = rebuilt.pState;
+    }
+    const uint32_t swapped = (uint32_t)_rebuilt.size();
+    _rebuilt.clear();
+    return swapped;
+}
+
+ShaderReloader::Stats ShaderReloader::stats() const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    return _stats;
+}
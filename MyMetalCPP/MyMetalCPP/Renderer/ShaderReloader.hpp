@@ -0,0 +1,96 @@
+//
+//  ShaderReloader.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include "Common.h"
+#include "FileWatcher.hpp"
+#include "ShaderSources.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class ReleaseQueue;
+
+// Rebuilds pipeline states while the app runs when their .metal source, or anything it
+// includes, is saved.
+//
+// Each library is one .metal file and owns the pipelines built from it. A thread sleeps in a
+// FileWatcher over every directory the sources read from; when files change it compiles from
+// source just the libraries that depend on them (ShaderSources), builds their pipelines, and
+// leaves the lot waiting for apply(). The renderer calls that between frames, so a frame never
+// mixes old and new states - the pipeline pointers it was given are swapped there, and the
+// states they replace go to the ReleaseQueue for frames still in flight. If the compile or any
+// of a library's pipelines fails, the error is kept for stats() and nothing of that library is
+// swapped, so a typo leaves the last good shaders running until the next save fixes it.
+//
+// Register every library and pipeline before start(). Render pipelines are rebuilt from a copy
+// of their descriptor, with its functions looked up again by name. Argument encoders made from
+// the old functions (BindlessTable) are kept, so a change to an argument buffer's layout still
+// needs a relaunch.
+
+class ShaderReloader
+{
+public:
+    struct Stats
+    {
+        uint32_t reloads;           // libraries rebuilt
+        uint32_t failures;
+        double lastBuildMs;         // compile and pipelines, the last library rebuilt
+        std::string lastError;      // empty once a rebuild succeeds
+    };
+
+    ShaderReloader( MTL::Device* pDevice, ReleaseQueue* pReleaseQueue );
+    ~ShaderReloader();
+
+    uint32_t addLibrary( const std::string& path );
+
+    // *ppState is replaced by apply(), pDesc is copied
+    void addRenderPipeline( uint32_t library, const MTL::RenderPipelineDescriptor* pDesc, MTL::RenderPipelineState** ppState );
+    void addComputePipeline( uint32_t library, const char* pFunctionName, MTL::ComputePipelineState** ppState );
+
+    // Starts watching. False if none of the directories could be
+    bool start();
+
+    // Swaps in whatever has been rebuilt. Between frames, on the thread that draws
+    uint32_t apply();
+
+    Stats stats() const;
+
+private:
+    struct Pipeline
+    {
+        uint32_t library;
+        MTL::RenderPipelineDescriptor* pDesc;       // render pipelines only
+        std::string vertexName;
+        std::string fragmentName;
+        std::string computeName;                    // compute pipelines only
+        NS::Object** ppState;
+    };
+
+    struct Rebuilt
+    {
+        NS::Object** ppState;
+        NS::Object* pState;
+    };
+
+    void watch();
+    void rebuild( uint32_t library );
+
+    MTL::Device* _pDevice;
+    ReleaseQueue* _pReleaseQueue;
+    ShaderSources _sources;
+    FileWatcher _watcher;
+    std::vector<Pipeline> _pipelines;
+    std::thread _thread;
+    std::atomic<bool> _stop;
+
+    mutable std::mutex _mutex;          // everything below
+    std::vector<Rebuilt> _rebuilt;
+    Stats _stats;
+};
@@ -0,0 +1,213 @@
+//
+//  ShaderSources.cpp
+//  MyMetalCPP
+//
+
+#include "ShaderSources.hpp"
+
+#include <algorithm>
+#include <climits>
+#include <fstream>
+#include <stdlib.h>
+
+// "name" out of #include "name", false for anything else
+static bool parseQuotedInclude( const std::string& line, std::string& name )
+{
+    size_t i = line.find_first_not_of( " \t" );
+    if ( i == std::string::npos || line[i] != '#' )
+    {
+        return false;
+    }
+    i = line.find_first_not_of( " \t", i + 1 );
+    if ( i == std::string::npos || line.compare( i, 7, "include" ) != 0 )
+    {
+        return false;
+    }
+    i = line.find_first_not_of( " \t", i + 7 );
+    if ( i == std::string::npos || line[i] != '"' )
+    {
+        return false;
+    }
+    const size_t end = line.find( '"', i + 1 );
+    if ( end == std::string::npos )
+    {
+        return false;
+    }
+    name = line.substr( i + 1, end - i - 1 );
+    return true;
+}
+
+static bool isPragmaOnce( const std::string& line )
+{
+    size_t i = line.find_first_not_of( " \t" );
+    if ( i == std::string::npos || line[i] != '#' )
+    {
+        return false;
+    }
+    i = line.find_first_not_of( " \t", i + 1 );
+    if ( i == std::string::npos || line.compare( i, 6, "pragma" ) != 0 )
+    {
+        return false;
+    }
+    i = line.find_first_not_of( " \t", i + 6 );
+    return i != std::string::npos && line.compare( i, 4, "once" ) == 0;
+}
+
+// #else, #elif or #endif - where the compiler may start reading again after skipping lines
+static bool endsBranch( const std::string& line )
+{
+    size_t i = line.find_first_not_of( " \t" );
+    if ( i == std::string::npos || line[i] != '#' )
+    {
+        return false;
+    }
+    i = line.find_first_not_of( " \t", i + 1 );
+    return i != std::string::npos && ( line.compare( i, 4, "else" ) == 0 || line.compare( i, 4, "elif" ) == 0 || line.compare( i, 5, "endif" ) == 0 );
+}
+
+static std::string directoryOf( const std::string& path )
+{
+    const size_t slash = path.rfind( '/' );
+    return slash == std::string::npos ? std::string( "." ) : path.substr( 0, slash );
+}
+
+static std::string lineMarker( size_t line, const std::string& path )
+{
+    return "#line " + std::to_string( line ) + " \"" + path + "\"\n";
+}
+
+std::string ShaderSources::canonical( const std::string& path )
+{
+    char resolved[ PATH_MAX ];
+    return realpath( path.c_str(), resolved ) ? std::string( resolved ) : path;
+}
+
+uint32_t ShaderSources::add( const std::string& path )
+{
+    _libraries.push_back( { canonical( path ), {} } );
+    const uint32_t library = (uint32_t)_libraries.size() - 1;
+    std::string source, error;
+    if ( !expand( library, source, error ) )
+    {
+        __builtin_printf( "ShaderSources: %s\n", error.c_str() );
+    }
+    return library;
+}
+
+bool ShaderSources::expand( uint32_t library, std::string& source, std::string& error )
+{
+    Expansion expansion;
+    const bool expanded = inlineFile( _libraries[ library ].path, expansion );
+
+    // a failed expansion still read what it read, which is what has to change to fix it
+    std::sort( expansion.dependencies.begin(), expansion.dependencies.end() );
+    expansion.dependencies.erase( std::unique( expansion.dependencies.begin(), expansion.dependencies.end() ), expansion.dependencies.end() );
+    _libraries[ library ].dependencies = std::move( expansion.dependencies );
+    if ( !expanded )
+    {
+        error = expansion.error;
+        return false;
+    }
+    source = std::move( expansion.source );
+    return true;
+}
+
+bool ShaderSources::inlineFile( const std::string& path, Expansion& expansion )
+{
+    if ( std::find( expansion.stack.begin(), expansion.stack.end(), path ) != expansion.stack.end() )
+    {
+        expansion.error = path + " includes itself";
+        return false;
+    }
+    std::ifstream file( path );
+    if ( !file )
+    {
+        expansion.error = "can't read " + path;
+        return false;
+    }
+    expansion.dependencies.push_back( path );
+    expansion.stack.push_back( path );
+
+    const std::string directory = directoryOf( path );
+    expansion.source += lineMarker( 1, path );
+    bool guarded = false;
+    bool inlined = false;       // after which any #line may have been in a skipped branch
+    std::string line, name;
+    for ( size_t lineNumber = 1; std::getline( file, line ); ++lineNumber )
+    {
+        if ( parseQuotedInclude( line, name ) )
+        {
+            const std::string includePath = canonical( name[0] == '/' ? name : directory + "/" + name );
+            if ( std::ifstream( includePath ).good() )
+            {
+                if ( !inlineFile( includePath, expansion ) )
+                {
+                    return false;
+                }
+                expansion.source += lineMarker( lineNumber + 1, path );
+                inlined = true;
+                continue;
+            }
+        }
+        else if ( inlined && endsBranch( line ) )
+        {
+            expansion.source += line + "\n" + lineMarker( lineNumber + 1, path );
+            continue;
+        }
+        else if ( isPragmaOnce( line ) && !guarded )
+        {
+            auto once = std::find( expansion.onceFiles.begin(), expansion.onceFiles.end(), path );
+            if ( once == expansion.onceFiles.end() )
+            {
+                once = expansion.onceFiles.insert( once, path );
+            }
+            const std::string guard = "MM_PRAGMA_ONCE_" + std::to_string( once - expansion.onceFiles.begin() );
+            expansion.source += "#ifndef " + guard + "\n#define " + guard + "\n" + lineMarker( lineNumber + 1, path );
+            guarded = true;
+            continue;
+        }
+        expansion.source += line;
+        expansion.source += '\n';
+    }
+    if ( guarded )
+    {
+        expansion.source += "#endif\n";
+    }
+
+    expansion.stack.pop_back();
+    return true;
+}
+
+std::vector<uint32_t> ShaderSources::affected( const std::vector<std::string>& paths ) const
+{
+    std::vector<uint32_t> libraries;
+    for ( uint32_t library = 0; library < count(); ++library )
+    {
+        const std::vector<std::string>& dependencies = _libraries[ library ].dependencies;
+        for ( const std::string& path : paths )
+        {
+            if ( std::binary_search( dependencies.begin(), dependencies.end(), canonical( path ) ) )
+            {
+                libraries.push_back( library );
+                break;
+            }
+        }
+    }
+    return libraries;
+}
+
+std::vector<std::string> ShaderSources::directories() const
+{
+    std::vector<std::string> directories;
+    for ( const Library& library : _libraries )
+    {
+        directories.push_back( directoryOf( library.path ) );
+        for ( const std::string& dependency : library.dependencies )
+        {
+            directories.push_back( directoryOf( dependency ) );
+        }
+    }
+    std::sort( directories.begin(), directories.end() );
+    directories.erase( std::unique( directories.begin(), directories.end() ), directories.end() );
+    return directories;
+}
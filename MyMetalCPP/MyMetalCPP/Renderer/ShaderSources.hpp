@@ -0,0 +1,71 @@
+//
+//  ShaderSources.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// The .metal files behind each shader library, flattened to the one string newLibrary() takes
+// when a library is compiled from source at runtime - it has no include paths, so every quoted
+// #include is inlined here. Angle bracket includes are the compiler's (<metal_stdlib>) and stay.
+//
+// Includes resolve against the including file's directory, like the compiler does. Conditionals
+// aren't evaluated, so a header inside a branch the compiler will skip is inlined all the same
+// and relies on its include guard, as it would in a normal build. #pragma once becomes a guard
+// of its own, since in one flat string it would only refer to the library's root file. An
+// include that can't be found is left in place for the compiler to report, if its branch is
+// live. After each inlined file a #line puts the includer back, so compile errors still name
+// the file and line that was edited - and again after the #else or #endif that follows, in
+// case the first was in a branch the compiler skipped and so never counted.
+//
+// Every file read on the way is a dependency of the library. affected() maps files that
+// changed on disk to the libraries to rebuild, so a header edit rebuilds only the libraries
+// that include it. Paths are made canonical with realpath() on the way in, so "../Maths/..."
+// and the path a FileWatcher reports compare equal. Nothing Metal in here.
+
+class ShaderSources
+{
+public:
+    // Libraries are numbered in the order they're added. Reads the file for its dependencies
+    uint32_t add( const std::string& path );
+
+    // The library flattened, refreshing its dependencies. False with error set when a file
+    // can't be read or includes itself
+    bool expand( uint32_t library, std::string& source, std::string& error );
+
+    // The libraries that read any of paths last time they were expanded
+    std::vector<uint32_t> affected( const std::vector<std::string>& paths ) const;
+
+    // Every directory a dependency of any library is in - what to watch
+    std::vector<std::string> directories() const;
+
+    uint32_t count() const { return (uint32_t)_libraries.size(); }
+    const std::string& path( uint32_t library ) const { return _libraries[ library ].path; }
+    const std::vector<std::string>& dependencies( uint32_t library ) const { return _libraries[ library ].dependencies; }
+
+    static std::string canonical( const std::string& path );
+
+private:
+    struct Library
+    {
+        std::string path;
+        std::vector<std::string> dependencies;      // sorted, the root file included
+    };
+
+    struct Expansion
+    {
+        std::string source;
+        std::vector<std::string> stack;             // the includes being inlined, for cycles
+        std::vector<std::string> dependencies;
+        std::vector<std::string> onceFiles;         // files with #pragma once, guard n for the nth
+        std::string error;
+    };
+
+    bool inlineFile( const std::string& path, Expansion& expansion );
+
+    std::vector<Library> _libraries;
+};
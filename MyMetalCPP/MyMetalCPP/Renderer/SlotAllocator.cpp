@@ -0,0 +1,97 @@
+//
+//  SlotAllocator.cpp
+//  MyMetalCPP
+//
+
+#include "SlotAllocator.hpp"
+
+#include <cassert>
+
+SlotAllocator::SlotAllocator( uint32_t capacity )
+: _capacity( capacity )
+, _next( new std::atomic<uint32_t>[ capacity ] )
+, _generations( new std::atomic<uint32_t>[ capacity ] )
+, _head( kEmpty )
+, _highWater( 0 )
+, _used( 0 )
+{
+    assert( capacity <= kMaxSlots );
+    for ( uint32_t i = 0; i < capacity; ++i )
+    {
+        _next[i].store( kEmpty, std::memory_order_relaxed );
+        _generations[i].store( 0, std::memory_order_relaxed );
+    }
+}
+
+SlotAllocator::Handle SlotAllocator::allocate()
+{
+    uint64_t head = _head.load( std::memory_order_acquire );
+    uint32_t slot = kEmpty;
+    while ( (uint32_t)head != kEmpty )
+    {
+        // the link may be stale by the time the compare runs, the change count catches that
+        const uint32_t top = (uint32_t)head;
+        const uint64_t next = ( ( head >> 32 ) + 1 ) << 32 | _next[ top ].load( std::memory_order_relaxed );
+        if ( _head.compare_exchange_weak( head, next, std::memory_order_acquire, std::memory_order_acquire ) )
+        {
+            slot = top;
+            break;
+        }
+    }
+
+    if ( slot == kEmpty )
+    {
+        // nothing freed, the next never used slot
+        uint32_t highWater = _highWater.load( std::memory_order_relaxed );
+        do
+        {
+            if ( highWater >= _capacity )
+            {
+                return kInvalidHandle;
+            }
+        }
+        while ( !_highWater.compare_exchange_weak( highWater, highWater + 1, std::memory_order_relaxed ) );
+        slot = highWater;
+    }
+
+    _used.fetch_add( 1, std::memory_order_relaxed );
+    return _generations[ slot ].load( std::memory_order_acquire ) << kIndexBits | slot;
+}
+
+bool SlotAllocator::free( Handle handle )
+{
+    const uint32_t slot = index( handle );
+    if ( handle == kInvalidHandle || slot >= _highWater.load( std::memory_order_acquire ) )
+    {
+        return false;
+    }
+
+    // only one free of this handle gets to move the generation on
+    uint32_t generation = handle >> kIndexBits;
+    const uint32_t nextGeneration = ( generation + 1 ) & ( ( 1u << kGenerationBits ) - 1 );
+    if ( !_generations[ slot ].compare_exchange_strong( generation, nextGeneration, std::memory_order_acq_rel ) )
+    {
+        return false;
+    }
+
+    uint64_t head = _head.load( std::memory_order_relaxed );
+    uint64_t next;
+    do
+    {
+        _next[ slot ].store( (uint32_t)head, std::memory_order_relaxed );
+        next = ( ( head >> 32 ) + 1 ) << 32 | slot;
+    }
+    while ( !_head.compare_exchange_weak( head, next, std::memory_order_release, std::memory_order_relaxed ) );
+    _used.fetch_sub( 1, std::memory_order_relaxed );
+    return true;
+}
+
+bool SlotAllocator::isValid( Handle handle ) const
+{
+    const uint32_t slot = index( handle );
+    if ( handle == kInvalidHandle || slot >= _highWater.load( std::memory_order_acquire ) )
+    {
+        return false;
+    }
+    return _generations[ slot ].load( std::memory_order_acquire ) == handle >> kIndexBits;
+}
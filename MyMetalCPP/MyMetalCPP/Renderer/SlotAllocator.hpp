@@ -0,0 +1,61 @@
+//
+//  SlotAllocator.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Slots of a fixed size table handed out and taken back from any thread without locks, with
+// handles that go stale when their slot is freed.
+//
+// Freed slots sit on a lock free stack threaded through the slots themselves. The head packs
+// the top slot with a count bumped on every change, so a pop that read a head some other
+// thread has since popped and pushed back fails its compare and retries instead of corrupting
+// the stack. Slots never used yet come off a high water mark first, so a new table hands out
+// 0, 1, 2... in order.
+//
+// A Handle is the slot index in the low kIndexBits and the slot's generation above. free()
+// bumps the generation, so every copy of the old handle stops passing isValid() and a second
+// free of it fails rather than putting the slot on the stack twice. Generations wrap after
+// 1 << kGenerationBits frees of the same slot.
+
+class SlotAllocator
+{
+public:
+    typedef uint32_t Handle;
+
+    static constexpr uint32_t kIndexBits = 20;
+    static constexpr uint32_t kGenerationBits = 32 - kIndexBits;
+    static constexpr uint32_t kIndexMask = ( 1u << kIndexBits ) - 1;
+    static constexpr uint32_t kMaxSlots = kIndexMask;       // the all ones index means none
+    static constexpr Handle kInvalidHandle = ~0u;
+
+    explicit SlotAllocator( uint32_t capacity );
+
+    // kInvalidHandle when every slot is taken
+    Handle allocate();
+
+    // False for a stale handle, one already freed
+    bool free( Handle handle );
+
+    bool isValid( Handle handle ) const;
+    static uint32_t index( Handle handle ) { return handle & kIndexMask; }
+
+    uint32_t capacity() const { return _capacity; }
+    uint32_t used() const { return _used.load( std::memory_order_relaxed ); }
+
+private:
+    static constexpr uint32_t kEmpty = kIndexMask;
+
+    uint32_t _capacity;
+    std::unique_ptr<std::atomic<uint32_t>[]> _next;         // free stack links
+    std::unique_ptr<std::atomic<uint32_t>[]> _generations;
+    std::atomic<uint64_t> _head;                            // change count << 32 | top slot
+    std::atomic<uint32_t> _highWater;                       // slots below have been handed out
+    std::atomic<uint32_t> _used;
+};
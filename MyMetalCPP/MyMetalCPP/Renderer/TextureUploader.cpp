@@ -0,0 +1,110 @@
+//
+//  TextureUploader.cpp
+//  MyMetalCPP
+//
+
+#include "TextureUploader.hpp"
+
+static void* newStagingBuffer( void* pUser, size_t size, uint8_t** ppMemory )
+{
+    MTL::Buffer* pBuffer = static_cast< MTL::Device* >( pUser )->newBuffer( size, MTL::ResourceStorageModeShared | MTL::ResourceCPUCacheModeWriteCombined );
+    *ppMemory = static_cast< uint8_t* >( pBuffer->contents() );
+    return pBuffer;
+}
+
+static void freeStagingBuffer( void* pUser, void* pStaging )
+{
+    static_cast< MTL::Buffer* >( pStaging )->release();
+}
+
+static bool destinationLayout( MTL::PixelFormat format, PixelConvert::Layout* pLayout )
+{
+    switch ( format )
+    {
+        case MTL::PixelFormatRGBA8Unorm:
+            *pLayout = { PixelConvert::Format::RGBA8, MipGen::ColorSpace::Linear };
+            return true;
+        case MTL::PixelFormatRGBA8Unorm_sRGB:
+            *pLayout = { PixelConvert::Format::RGBA8, MipGen::ColorSpace::SRGB };
+            return true;
+        case MTL::PixelFormatBGRA8Unorm:
+            *pLayout = { PixelConvert::Format::BGRA8, MipGen::ColorSpace::Linear };
+            return true;
+        case MTL::PixelFormatBGRA8Unorm_sRGB:
+            *pLayout = { PixelConvert::Format::BGRA8, MipGen::ColorSpace::SRGB };
+            return true;
+        default:
+            return false;
+    }
+}
+
+TextureUploader::TextureUploader( MTL::Device* pDevice, size_t stagingSize, uint64_t frameBudget, size_t maxStagingBuffers )
+: _pDevice( pDevice->retain() )
+, _queue( stagingSize, frameBudget, maxStagingBuffers, newStagingBuffer, freeStagingBuffer, pDevice )
+{
+}
+
+TextureUploader::~TextureUploader()
+{
+    // whatever never completed still holds its texture, nothing may be in flight by now
+    _completed.clear();
+    _queue.cancelAll( _completed );
+    for ( void* pTexture : _completed )
+    {
+        static_cast< MTL::Texture* >( pTexture )->release();
+    }
+    _pDevice->release();
+}
+
+UploadQueue::Ticket TextureUploader::upload( MTL::Texture* pTexture, uint32_t level, MTL::Region region, const uint8_t* pSrc, size_t srcPitch,
+                                             PixelConvert::Layout src, UploadQueue::CompleteFn completeFn, void* pUser )
+{
+    UploadQueue::Request request;
+    if ( !destinationLayout( pTexture->pixelFormat(), &request.dst ) )
+    {
+        __builtin_printf( "TextureUploader: can't upload to pixel format %lu\n", (unsigned long)pTexture->pixelFormat() );
+        return UploadQueue::kInvalidTicket;
+    }
+    request.pTarget = pTexture;
+    request.level = level;
+    request.x = (uint32_t)region.origin.x;
+    request.y = (uint32_t)region.origin.y;
+    request.width = (uint32_t)region.size.width;
+    request.height = (uint32_t)region.size.height;
+    request.pSrc = pSrc;
+    request.srcPitch = srcPitch;
+    request.src = src;
+    request.completeFn = completeFn;
+    request.pUser = pUser;
+
+    pTexture->retain();
+    const UploadQueue::Ticket ticket = _queue.submit( request );
+    if ( ticket == UploadQueue::kInvalidTicket )
+    {
+        pTexture->release();
+    }
+    return ticket;
+}
+
+void TextureUploader::encode( MTL::CommandBuffer* pCmd, uint64_t frame, uint64_t retiredFrame )
+{
+    _completed.clear();
+    _queue.plan( frame, retiredFrame, _copies, &_completed );
+    for ( void* pTexture : _completed )
+    {
+        static_cast< MTL::Texture* >( pTexture )->release();
+    }
+    if ( _copies.empty() )
+    {
+        return;
+    }
+
+    MTL::BlitCommandEncoder* pBlit = pCmd->blitCommandEncoder();
+    for ( const UploadQueue::Copy& copy : _copies )
+    {
+        pBlit->copyFromBuffer( static_cast< MTL::Buffer* >( copy.pStaging ), copy.offset, copy.rowPitch, copy.rowPitch * copy.height,
+                               MTL::Size( copy.width, copy.height, 1 ), static_cast< MTL::Texture* >( copy.pTarget ), 0, copy.level,
+                               MTL::Origin( copy.x, copy.y, 0 ) );
+    }
+    pBlit->endEncoding();
+}
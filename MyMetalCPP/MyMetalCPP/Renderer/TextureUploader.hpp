@@ -0,0 +1,42 @@
+//
+//  TextureUploader.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include "Common.h"
+#include "UploadQueue.hpp"
+
+#include <vector>
+
+// CPU image data into textures of any storage mode through shared staging buffers and blits -
+// UploadQueue does the planning, this does the Metal. encode() puts every band staged for a
+// frame into the one blit encoder, ahead of anything else in the command buffer, so the frame
+// already draws with what it uploaded.
+//
+// The destination layout comes from the texture: RGBA8Unorm, BGRA8Unorm and their _sRGB forms.
+// Textures are retained until their uploads complete.
+
+class TextureUploader
+{
+public:
+    TextureUploader( MTL::Device* pDevice, size_t stagingSize, uint64_t frameBudget, size_t maxStagingBuffers );
+    ~TextureUploader();
+
+    // A region of one mip level. UploadQueue::kInvalidTicket for a texture format it can't write
+    UploadQueue::Ticket upload( MTL::Texture* pTexture, uint32_t level, MTL::Region region, const uint8_t* pSrc, size_t srcPitch,
+                                PixelConvert::Layout src, UploadQueue::CompleteFn completeFn = nullptr, void* pUser = nullptr );
+
+    // This frame's uploads as blits into pCmd. frame and retiredFrame as the ReleaseQueue has them
+    void encode( MTL::CommandBuffer* pCmd, uint64_t frame, uint64_t retiredFrame );
+
+    bool isComplete( UploadQueue::Ticket ticket ) const { return _queue.isComplete( ticket ); }
+    UploadQueue::Stats stats() const { return _queue.stats(); }
+
+private:
+    MTL::Device* _pDevice;
+    UploadQueue _queue;
+    std::vector<UploadQueue::Copy> _copies;
+    std::vector<void*> _completed;
+};
@@ -0,0 +1,329 @@
+//
+//  TlsfAllocator.cpp
+//  MyMetalCPP
+//
+
+#include "TlsfAllocator.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+static uint32_t highestBit( uint64_t x )
+{
+    return 63 - (uint32_t)__builtin_clzll( x );
+}
+
+TlsfAllocator::TlsfAllocator( uint64_t capacity, uint64_t granularity )
+: _granularity( granularity )
+, _granularityShift( highestBit( granularity ) )
+, _used( 0 )
+, _allocations( 0 )
+, _freeBlocks( 0 )
+, _spareNodes( kNoNode )
+, _firstLevelBitmap( 0 )
+{
+    assert( granularity > 0 && ( granularity & ( granularity - 1 ) ) == 0 );
+    _capacity = capacity >> _granularityShift << _granularityShift;
+    for ( uint32_t fl = 0; fl < kFirstLevelCount; ++fl )
+    {
+        _secondLevelBitmap[ fl ] = 0;
+        for ( uint32_t sl = 0; sl < kSecondLevelCount; ++sl )
+        {
+            _heads[ fl ][ sl ] = kNoNode;
+        }
+    }
+
+    if ( _capacity > 0 )
+    {
+        const uint32_t node = newNode();
+        _nodes[ node ] = { 0, _capacity >> _granularityShift, kNoNode, kNoNode, kNoNode, kNoNode, false };
+        insertFree( node );
+    }
+}
+
+void TlsfAllocator::mapping( uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel ) const
+{
+    if ( units < kSecondLevelCount )
+    {
+        firstLevel = 0;
+        secondLevel = (uint32_t)units;
+        return;
+    }
+    const uint32_t top = highestBit( units );
+    firstLevel = top - kSecondLevelBits + 1;
+    secondLevel = (uint32_t)( units >> ( top - kSecondLevelBits ) ) - kSecondLevelCount;
+}
+
+uint32_t TlsfAllocator::findFree( uint64_t units ) const
+{
+    // up to the next size class, so every block on the list found is big enough
+    uint64_t rounded = units;
+    if ( units >= kSecondLevelCount )
+    {
+        rounded += ( 1ull << ( highestBit( units ) - kSecondLevelBits ) ) - 1;
+    }
+    uint32_t fl, sl;
+    mapping( rounded, fl, sl );
+    if ( fl < kFirstLevelCount )
+    {
+        uint32_t secondLevelMap = _secondLevelBitmap[ fl ] & ( ~0u << sl );
+        uint64_t firstLevelMap = _firstLevelBitmap & ( ~0ull << ( fl + 1 ) );
+        if ( secondLevelMap != 0 || firstLevelMap != 0 )
+        {
+            fl = secondLevelMap != 0 ? fl : (uint32_t)__builtin_ctzll( firstLevelMap );
+            secondLevelMap = secondLevelMap != 0 ? secondLevelMap : _secondLevelBitmap[ fl ];
+            return _heads[ fl ][ (uint32_t)__builtin_ctz( secondLevelMap ) ];
+        }
+    }
+
+    // nearly full - a block in the request's own class may still fit, worth a walk before failing
+    mapping( units, fl, sl );
+    if ( fl >= kFirstLevelCount )
+    {
+        return kNoNode;
+    }
+    for ( uint32_t node = _heads[ fl ][ sl ]; node != kNoNode; node = _nodes[ node ].nextFree )
+    {
+        if ( _nodes[ node ].size >= units )
+        {
+            return node;
+        }
+    }
+    return kNoNode;
+}
+
+void TlsfAllocator::insertFree( uint32_t node )
+{
+    uint32_t fl, sl;
+    mapping( _nodes[ node ].size, fl, sl );
+    assert( fl < kFirstLevelCount );
+    Node& n = _nodes[ node ];
+    n.isFree = true;
+    n.prevFree = kNoNode;
+    n.nextFree = _heads[ fl ][ sl ];
+    if ( n.nextFree != kNoNode )
+    {
+        _nodes[ n.nextFree ].prevFree = node;
+    }
+    _heads[ fl ][ sl ] = node;
+    _firstLevelBitmap |= 1ull << fl;
+    _secondLevelBitmap[ fl ] |= 1u << sl;
+    ++_freeBlocks;
+}
+
+void TlsfAllocator::removeFree( uint32_t node )
+{
+    uint32_t fl, sl;
+    mapping( _nodes[ node ].size, fl, sl );
+    Node& n = _nodes[ node ];
+    if ( n.prevFree != kNoNode )
+    {
+        _nodes[ n.prevFree ].nextFree = n.nextFree;
+    }
+    else
+    {
+        _heads[ fl ][ sl ] = n.nextFree;
+        if ( n.nextFree == kNoNode )
+        {
+            _secondLevelBitmap[ fl ] &= ~( 1u << sl );
+            if ( _secondLevelBitmap[ fl ] == 0 )
+            {
+                _firstLevelBitmap &= ~( 1ull << fl );
+            }
+        }
+    }
+    if ( n.nextFree != kNoNode )
+    {
+        _nodes[ n.nextFree ].prevFree = n.prevFree;
+    }
+    n.isFree = false;
+    --_freeBlocks;
+}
+
+uint32_t TlsfAllocator::newNode()
+{
+    if ( _spareNodes != kNoNode )
+    {
+        const uint32_t node = _spareNodes;
+        _spareNodes = _nodes[ node ].nextFree;
+        return node;
+    }
+    _nodes.push_back( Node() );
+    return (uint32_t)_nodes.size() - 1;
+}
+
+void TlsfAllocator::deleteNode( uint32_t node )
+{
+    _nodes[ node ].nextFree = _spareNodes;
+    _spareNodes = node;
+}
+
+// Cuts node after units, returns the new node for the rest - neither is on a free list
+uint32_t TlsfAllocator::split( uint32_t node, uint64_t units )
+{
+    const uint32_t rest = newNode();
+    Node& n = _nodes[ node ];
+    assert( units > 0 && units < n.size );
+    _nodes[ rest ] = { n.offset + units, n.size - units, node, n.nextPhysical, kNoNode, kNoNode, false };
+    if ( n.nextPhysical != kNoNode )
+    {
+        _nodes[ n.nextPhysical ].prevPhysical = rest;
+    }
+    n.nextPhysical = rest;
+    n.size = units;
+    return rest;
+}
+
+TlsfAllocator::Allocation TlsfAllocator::allocate( uint64_t size, uint64_t alignment )
+{
+    const uint64_t units = std::max<uint64_t>( 1, ( size + _granularity - 1 ) >> _granularityShift );
+    const uint64_t alignUnits = std::max<uint64_t>( 1, alignment >> _granularityShift );
+    assert( ( alignUnits & ( alignUnits - 1 ) ) == 0 );
+
+    uint32_t node = findFree( units + alignUnits - 1 );
+    if ( node == kNoNode )
+    {
+        return { 0, 0, kNoNode };
+    }
+    removeFree( node );
+
+    // padding up to the alignment goes back as a free block - the one before is in use, free
+    // blocks never touch
+    const uint64_t offset = _nodes[ node ].offset;
+    const uint64_t padding = ( ( offset + alignUnits - 1 ) & ~( alignUnits - 1 ) ) - offset;
+    if ( padding > 0 )
+    {
+        const uint32_t front = node;
+        node = split( front, padding );
+        insertFree( front );
+    }
+    if ( _nodes[ node ].size > units )
+    {
+        insertFree( split( node, units ) );
+    }
+
+    _used += units << _granularityShift;
+    ++_allocations;
+    return { _nodes[ node ].offset << _granularityShift, units << _granularityShift, node };
+}
+
+void TlsfAllocator::free( const Allocation& allocation )
+{
+    uint32_t node = allocation.node;
+    assert( node != kNoNode && !_nodes[ node ].isFree );
+    assert( _nodes[ node ].size << _granularityShift == allocation.size );
+    _used -= allocation.size;
+    --_allocations;
+
+    const uint32_t prev = _nodes[ node ].prevPhysical;
+    if ( prev != kNoNode && _nodes[ prev ].isFree )
+    {
+        removeFree( prev );
+        _nodes[ prev ].size += _nodes[ node ].size;
+        _nodes[ prev ].nextPhysical = _nodes[ node ].nextPhysical;
+        if ( _nodes[ node ].nextPhysical != kNoNode )
+        {
+            _nodes[ _nodes[ node ].nextPhysical ].prevPhysical = prev;
+        }
+        deleteNode( node );
+        node = prev;
+    }
+    const uint32_t next = _nodes[ node ].nextPhysical;
+    if ( next != kNoNode && _nodes[ next ].isFree )
+    {
+        removeFree( next );
+        _nodes[ node ].size += _nodes[ next ].size;
+        _nodes[ node ].nextPhysical = _nodes[ next ].nextPhysical;
+        if ( _nodes[ next ].nextPhysical != kNoNode )
+        {
+            _nodes[ _nodes[ next ].nextPhysical ].prevPhysical = node;
+        }
+        deleteNode( next );
+    }
+    insertFree( node );
+}
+
+TlsfAllocator::Stats TlsfAllocator::stats() const
+{
+    Stats stats;
+    stats.capacity = _capacity;
+    stats.used = _used;
+    stats.allocations = _allocations;
+    stats.freeBlocks = _freeBlocks;
+    stats.largestFree = 0;
+
+    // the biggest block is on the highest non empty list
+    if ( _firstLevelBitmap != 0 )
+    {
+        const uint32_t fl = highestBit( _firstLevelBitmap );
+        const uint32_t sl = 31 - (uint32_t)__builtin_clz( _secondLevelBitmap[ fl ] );
+        for ( uint32_t node = _heads[ fl ][ sl ]; node != kNoNode; node = _nodes[ node ].nextFree )
+        {
+            stats.largestFree = std::max( stats.largestFree, _nodes[ node ].size << _granularityShift );
+        }
+    }
+    const uint64_t freeBytes = _capacity - _used;
+    stats.fragmentation = freeBytes > 0 ? 1.f - (float)( (double)stats.largestFree / (double)freeBytes ) : 0.f;
+    return stats;
+}
+
+bool TlsfAllocator::validate() const
+{
+    if ( _capacity == 0 )
+    {
+        return _freeBlocks == 0 && _used == 0;
+    }
+
+    // node 0 starts the heap - merges keep the lower node, so it's never deleted
+    uint64_t end = 0, used = 0;
+    size_t freeBlocks = 0, allocations = 0;
+    uint32_t prev = kNoNode;
+    for ( uint32_t node = 0; node != kNoNode; prev = node, node = _nodes[ node ].nextPhysical )
+    {
+        const Node& n = _nodes[ node ];
+        if ( n.offset != end || n.size == 0 || n.prevPhysical != prev )
+        {
+            return false;
+        }
+        if ( n.isFree && prev != kNoNode && _nodes[ prev ].isFree )
+        {
+            return false;
+        }
+        end += n.size;
+        freeBlocks += n.isFree ? 1 : 0;
+        allocations += n.isFree ? 0 : 1;
+        used += n.isFree ? 0 : n.size;
+    }
+    if ( end << _granularityShift != _capacity || used << _granularityShift != _used ||
+         freeBlocks != _freeBlocks || allocations != _allocations )
+    {
+        return false;
+    }
+
+    size_t listed = 0;
+    for ( uint32_t fl = 0; fl < kFirstLevelCount; ++fl )
+    {
+        if ( ( ( _firstLevelBitmap >> fl ) & 1 ) != ( _secondLevelBitmap[ fl ] != 0 ? 1u : 0u ) )
+        {
+            return false;
+        }
+        for ( uint32_t sl = 0; sl < kSecondLevelCount; ++sl )
+        {
+            if ( ( ( _secondLevelBitmap[ fl ] >> sl ) & 1 ) != ( _heads[ fl ][ sl ] != kNoNode ? 1u : 0u ) )
+            {
+                return false;
+            }
+            for ( uint32_t node = _heads[ fl ][ sl ]; node != kNoNode; node = _nodes[ node ].nextFree )
+            {
+                uint32_t nodeFl, nodeSl;
+                mapping( _nodes[ node ].size, nodeFl, nodeSl );
+                if ( !_nodes[ node ].isFree || nodeFl != fl || nodeSl != sl )
+                {
+                    return false;
+                }
+                ++listed;
+            }
+        }
+    }
+    return listed == _freeBlocks;
+}
@@ -0,0 +1,98 @@
+//
+//  TlsfAllocator.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Two level segregated fit allocator over a range of offsets - it never touches the memory, so
+// it manages GPU heaps the CPU can't see and runs the same on Linux.
+//
+// Free blocks sit in lists by size class: the first level is the power of two, the second splits
+// each power into kSecondLevelCount even steps. Two bitmaps say which lists are non empty, so
+// allocate() finds a list big enough with a couple of bit scans and takes its head, and free()
+// merges with its physical neighbours and pushes the result on its list - both O(1).
+//
+// Sizes and offsets are in multiples of the granularity. allocate() rounds the size up to the
+// next size class before searching, so any block found fits without walking the list. Bigger
+// alignments search for the size plus the worst case padding, and the padding goes back as a
+// free block of its own.
+//
+// Block bookkeeping lives in a node pool on the CPU side, in granularity units. An Allocation
+// carries its node so free doesn't have to look the offset up.
+
+class TlsfAllocator
+{
+public:
+    static constexpr uint32_t kSecondLevelBits = 4;
+    static constexpr uint32_t kSecondLevelCount = 1u << kSecondLevelBits;
+    static constexpr uint32_t kFirstLevelCount = 40;
+    static constexpr uint32_t kNoNode = ~0u;
+
+    struct Allocation
+    {
+        uint64_t offset;
+        uint64_t size;      // as rounded up, what free() gives back
+        uint32_t node;      // kNoNode when allocate() failed
+    };
+
+    struct Stats
+    {
+        uint64_t capacity;
+        uint64_t used;
+        uint64_t largestFree;
+        size_t allocations;
+        size_t freeBlocks;
+        float fragmentation;    // 1 - largestFree / free bytes, 0 when all the free space is one block
+    };
+
+    // granularity a power of two
+    TlsfAllocator( uint64_t capacity, uint64_t granularity = 256 );
+
+    // alignment a power of two, anything under the granularity is the granularity
+    Allocation allocate( uint64_t size, uint64_t alignment = 0 );
+    void free( const Allocation& allocation );
+
+    uint64_t capacity() const { return _capacity; }
+    uint64_t used() const { return _used; }
+    Stats stats() const;
+
+    // Walks every block checking the physical chain, the lists and the bitmaps agree
+    bool validate() const;
+
+private:
+    struct Node
+    {
+        uint64_t offset;        // in granularity units
+        uint64_t size;
+        uint32_t prevPhysical;
+        uint32_t nextPhysical;
+        uint32_t prevFree;
+        uint32_t nextFree;
+        bool isFree;
+    };
+
+    void mapping( uint64_t units, uint32_t& firstLevel, uint32_t& secondLevel ) const;
+    uint32_t findFree( uint64_t units ) const;
+    void insertFree( uint32_t node );
+    void removeFree( uint32_t node );
+    uint32_t newNode();
+    void deleteNode( uint32_t node );
+    uint32_t split( uint32_t node, uint64_t units );
+
+    uint64_t _capacity;
+    uint64_t _granularity;
+    uint32_t _granularityShift;
+    uint64_t _used;
+    size_t _allocations;
+    size_t _freeBlocks;
+    std::vector<Node> _nodes;
+    uint32_t _spareNodes;                   // chained through nextFree
+    uint64_t _firstLevelBitmap;
+    uint32_t _secondLevelBitmap[ kFirstLevelCount ];
+    uint32_t _heads[ kFirstLevelCount ][ kSecondLevelCount ];
+};
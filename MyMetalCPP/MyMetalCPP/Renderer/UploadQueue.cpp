@@ -0,0 +1,214 @@
+//
+//  UploadQueue.cpp
+//  MyMetalCPP
+//
+
+#include "UploadQueue.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static size_t stagingPitch( uint32_t width )
+{
+    const size_t alignment = UploadQueue::kStagingAlignment;
+    return ( (size_t)width * 4 + alignment - 1 ) / alignment * alignment;
+}
+
+UploadQueue::UploadQueue( size_t stagingSize, uint64_t frameBudget, size_t maxStagingBuffers,
+                          NewStagingFn newStagingFn, FreeStagingFn freeStagingFn, void* pStagingUser )
+: _stagingSize( stagingSize )
+, _frameBudget( frameBudget )
+, _maxStagingBuffers( std::max<size_t>( maxStagingBuffers, 1 ) )
+, _newStagingFn( newStagingFn )
+, _freeStagingFn( freeStagingFn )
+, _pStagingUser( pStagingUser )
+, _nextTicket( kInvalidTicket + 1 )
+, _stats{}
+, _currentStaging( 0 )
+{
+}
+
+UploadQueue::~UploadQueue()
+{
+    for ( const Staging& staging : _staging )
+    {
+        _freeStagingFn( _pStagingUser, staging.pStaging );
+    }
+}
+
+UploadQueue::Ticket UploadQueue::submit( const Request& request )
+{
+    assert( PixelConvert::isTextureLayout( request.dst.format ) );
+    if ( request.width == 0 || request.height == 0 || stagingPitch( request.width ) > _stagingSize )
+    {
+        __builtin_printf( "UploadQueue: a %u pixel row doesn't fit a %zu byte staging buffer\n", request.width, _stagingSize );
+        return kInvalidTicket;
+    }
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    const Ticket ticket = _nextTicket++;
+    _pending.push_back( { ticket, request, 0 } );
+    _outstanding.insert( ticket );
+    _stats.submitted++;
+    _stats.pendingBytes += (uint64_t)request.width * 4 * request.height;
+    return ticket;
+}
+
+UploadQueue::Staging* UploadQueue::stagingFor( size_t rowBytes, uint64_t frame, uint64_t retiredFrame )
+{
+    // the current buffer first, then round the rest - any every frame has finished with starts over
+    for ( size_t i = 0; i < _staging.size(); ++i )
+    {
+        Staging& staging = _staging[ ( _currentStaging + i ) % _staging.size() ];
+        if ( staging.frame <= retiredFrame )
+        {
+            staging.used = 0;
+        }
+        if ( staging.used + rowBytes <= _stagingSize )
+        {
+            _currentStaging = ( _currentStaging + i ) % _staging.size();
+            return &staging;
+        }
+    }
+    if ( _staging.size() == _maxStagingBuffers )
+    {
+        return nullptr;
+    }
+    Staging staging = { nullptr, nullptr, 0, frame };
+    staging.pStaging = _newStagingFn( _pStagingUser, _stagingSize, &staging.pMemory );
+    _staging.push_back( staging );
+    _currentStaging = _staging.size() - 1;
+    return &_staging.back();
+}
+
+void UploadQueue::plan( uint64_t frame, uint64_t retiredFrame, std::vector<Copy>& copies, std::vector<void*>* pCompleted )
+{
+    copies.clear();
+
+    // blits that have run - callbacks outside the lock, so they may submit more
+    while ( !_inFlight.empty() && _inFlight.front().frame <= retiredFrame )
+    {
+        const InFlight done = _inFlight.front();
+        _inFlight.pop_front();
+        {
+            std::lock_guard<std::mutex> lock( _mutex );
+            _outstanding.erase( done.ticket );
+            _stats.completed++;
+        }
+        if ( pCompleted )
+        {
+            pCompleted->push_back( done.pTarget );
+        }
+        if ( done.completeFn )
+        {
+            done.completeFn( done.pUser, done.ticket );
+        }
+    }
+
+    struct Conversion
+    {
+        const uint8_t* pSrc;
+        size_t srcPitch;
+        PixelConvert::Layout src;
+        uint8_t* pDst;
+        size_t dstPitch;
+        PixelConvert::Layout dst;
+        uint32_t width;
+        uint32_t rows;
+    };
+    std::vector<Conversion> conversions;
+    uint64_t staged = 0;
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        while ( !_pending.empty() )
+        {
+            Pending& pending = _pending.front();
+            const Request& request = pending.request;
+            const size_t rowPitch = stagingPitch( request.width );
+
+            // what's left of the budget, or one row when the budget's smaller than a row
+            uint64_t rows = request.height - pending.rowsStaged;
+            const uint64_t budgetRows = staged < _frameBudget ? ( _frameBudget - staged ) / rowPitch : 0;
+            rows = std::min( rows, staged == 0 ? std::max<uint64_t>( budgetRows, 1 ) : budgetRows );
+            Staging* pStaging = rows > 0 ? stagingFor( rowPitch, frame, retiredFrame ) : nullptr;
+            if ( !pStaging )
+            {
+                break;
+            }
+            rows = std::min<uint64_t>( rows, ( _stagingSize - pStaging->used ) / rowPitch );
+
+            const uint32_t y = pending.rowsStaged;
+            copies.push_back( { pStaging->pStaging, pStaging->used, rowPitch, request.pTarget, request.level, request.x, request.y + y,
+                                request.width, (uint32_t)rows } );
+            conversions.push_back( { request.pSrc + y * request.srcPitch, request.srcPitch, request.src, pStaging->pMemory + pStaging->used,
+                                     rowPitch, request.dst, request.width, (uint32_t)rows } );
+            pStaging->used += rows * rowPitch;
+            pStaging->frame = frame;
+            staged += rows * rowPitch;
+            pending.rowsStaged += (uint32_t)rows;
+            _stats.pendingBytes -= rows * request.width * 4;
+            if ( pending.rowsStaged == request.height )
+            {
+                _inFlight.push_back( { frame, pending.ticket, request.pTarget, request.completeFn, request.pUser } );
+                _pending.pop_front();
+            }
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    JobSystem::Instance()->parallelFor( conversions.size(), 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t i = begin; i < end; ++i )
+        {
+            const Conversion& c = conversions[i];
+            PixelConvert::convertRows( c.pSrc, c.srcPitch, c.src, c.pDst, c.dstPitch, c.dst, c.width, c.rows );
+        }
+    } );
+    const double convertMs = elapsedMs( start );
+
+    std::lock_guard<std::mutex> lock( _mutex );
+    _stats.pending = _pending.size();
+    _stats.stagedBytes = staged;
+    _stats.maxStagedBytes = std::max( _stats.maxStagedBytes, staged );
+    _stats.copies = copies.size();
+    _stats.stagingBuffers = _staging.size();
+    _stats.convertMs = convertMs;
+}
+
+void UploadQueue::cancelAll( std::vector<void*>& targets )
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    for ( const InFlight& inFlight : _inFlight )
+    {
+        targets.push_back( inFlight.pTarget );
+    }
+    for ( const Pending& pending : _pending )
+    {
+        targets.push_back( pending.request.pTarget );
+    }
+    _inFlight.clear();
+    _pending.clear();
+    _outstanding.clear();
+    _stats.pendingBytes = 0;
+}
+
+bool UploadQueue::isComplete( Ticket ticket ) const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    return ticket != kInvalidTicket && ticket < _nextTicket && _outstanding.count( ticket ) == 0;
+}
+
+UploadQueue::Stats UploadQueue::stats() const
+{
+    std::lock_guard<std::mutex> lock( _mutex );
+    Stats stats = _stats;
+    stats.pending = _pending.size();
+    return stats;
+}
@@ -0,0 +1,146 @@
+//
+//  UploadQueue.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include "../Texture/PixelConvert.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+// Image data on its way to textures through staging memory, a frame's worth at a time.
+//
+// submit() queues a request from any thread. Once a frame, plan() takes requests in the order
+// they came until the frame's byte budget is spent, converting their rows (PixelConvert) into
+// staging memory and returning one Copy per band of rows for the caller to blit. A request
+// too big for what's left of the budget goes in bands over as many frames as it takes - at
+// least one row a frame, so a row bigger than the whole budget still gets through.
+//
+// Staging memory comes in buffers of one size from newStaging, each handed out front to back
+// and reused once every frame that wrote to it has retired. More are made as needed, up to
+// maxStagingBuffers; past that plan() stops early and the rest waits for a buffer to retire.
+//
+// A request is complete once the frame that staged its last band retires - its blits have
+// run - at which point plan() calls its CompleteFn. Frames are numbered as ReleaseQueue
+// numbers them. The source data has to stay as it is until the request is complete. Nothing
+// Metal in here - staging buffers and textures are opaque, so the whole thing runs on the CPU.
+
+class UploadQueue
+{
+public:
+    typedef uint64_t Ticket;
+    typedef void ( *CompleteFn )( void* pUser, Ticket ticket );
+    typedef void* ( *NewStagingFn )( void* pUser, size_t size, uint8_t** ppMemory );
+    typedef void ( *FreeStagingFn )( void* pUser, void* pStaging );
+
+    static constexpr Ticket kInvalidTicket = 0;
+    static constexpr size_t kStagingAlignment = 256;    // offsets and row pitches in staging
+
+    struct Request
+    {
+        void* pTarget;                  // texture, opaque here
+        uint32_t level;
+        uint32_t x, y;                  // where in the level
+        uint32_t width, height;
+        const uint8_t* pSrc;
+        size_t srcPitch;
+        PixelConvert::Layout src;
+        PixelConvert::Layout dst;       // the target's
+        CompleteFn completeFn;          // optional
+        void* pUser;
+    };
+
+    // A band of rows to blit from staging into the target
+    struct Copy
+    {
+        void* pStaging;
+        size_t offset;
+        size_t rowPitch;
+        void* pTarget;
+        uint32_t level;
+        uint32_t x, y;
+        uint32_t width, height;
+    };
+
+    struct Stats
+    {
+        size_t submitted;               // ever
+        size_t completed;               // ever
+        size_t pending;                 // not yet fully staged
+        uint64_t pendingBytes;
+        uint64_t stagedBytes;           // last frame
+        uint64_t maxStagedBytes;        // any frame
+        size_t copies;                  // last frame
+        size_t stagingBuffers;
+        double convertMs;               // last frame
+    };
+
+    UploadQueue( size_t stagingSize, uint64_t frameBudget, size_t maxStagingBuffers,
+                 NewStagingFn newStagingFn, FreeStagingFn freeStagingFn, void* pStagingUser );
+    ~UploadQueue();
+
+    // kInvalidTicket if a row wouldn't fit a staging buffer. Any thread
+    Ticket submit( const Request& request );
+
+    // Completes what retiredFrame finished, then stages this frame's bands into copies. Rows are
+    // converted over the JobSystem. The targets of requests it completes go in pCompleted, if given
+    void plan( uint64_t frame, uint64_t retiredFrame, std::vector<Copy>& copies, std::vector<void*>* pCompleted = nullptr );
+
+    // Drops every request, staged or not, without completing it - for shutting down once
+    // nothing is in flight. Their targets go in targets
+    void cancelAll( std::vector<void*>& targets );
+
+    bool isComplete( Ticket ticket ) const;
+    Stats stats() const;
+
+private:
+    struct Pending
+    {
+        Ticket ticket;
+        Request request;
+        uint32_t rowsStaged;
+    };
+
+    struct Staging
+    {
+        void* pStaging;
+        uint8_t* pMemory;
+        size_t used;
+        uint64_t frame;             // last written in
+    };
+
+    struct InFlight
+    {
+        uint64_t frame;
+        Ticket ticket;
+        void* pTarget;
+        CompleteFn completeFn;
+        void* pUser;
+    };
+
+    // Room for at least rowBytes this frame, nullptr when there's none
+    Staging* stagingFor( size_t rowBytes, uint64_t frame, uint64_t retiredFrame );
+
+    size_t _stagingSize;
+    uint64_t _frameBudget;
+    size_t _maxStagingBuffers;
+    NewStagingFn _newStagingFn;
+    FreeStagingFn _freeStagingFn;
+    void* _pStagingUser;
+
+    mutable std::mutex _mutex;                  // submit() against the rest
+    std::deque<Pending> _pending;
+    std::unordered_set<Ticket> _outstanding;    // submitted, not complete
+    Ticket _nextTicket;
+    Stats _stats;
+
+    std::vector<Staging> _staging;
+    size_t _currentStaging;
+    std::deque<InFlight> _inFlight;             // frames never decrease front to back
+};
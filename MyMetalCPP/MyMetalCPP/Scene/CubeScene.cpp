@@ -0,0 +1,199 @@
+//
+//  CubeScene.cpp
+//  MyMetalCPP
+//
+
+#include "CubeScene.hpp"
+#include "../Maths/Math.hpp"
+
+#include <math.h>
+
+namespace CubeScene
+{
+
+void buildCube( std::vector<VertexData>& vertices, std::vector<uint16_t>& indices )
+{
+    const float s = 0.5f;
+
+    vertices = {
+        //                                         Texture
+        //   Positions           Normals         Coordinates
+        { { -s, -s, +s }, {  0.f,  0.f,  1.f }, { 0.f, 1.f } },
+        { { +s, -s, +s }, {  0.f,  0.f,  1.f }, { 1.f, 1.f } },
+        { { +s, +s, +s }, {  0.f,  0.f,  1.f }, { 1.f, 0.f } },
+        { { -s, +s, +s }, {  0.f,  0.f,  1.f }, { 0.f, 0.f } },
+
+        { { +s, -s, +s }, {  1.f,  0.f,  0.f }, { 0.f, 1.f } },
+        { { +s, -s, -s }, {  1.f,  0.f,  0.f }, { 1.f, 1.f } },
+        { { +s, +s, -s }, {  1.f,  0.f,  0.f }, { 1.f, 0.f } },
+        { { +s, +s, +s }, {  1.f,  0.f,  0.f }, { 0.f, 0.f } },
+
+        { { +s, -s, -s }, {  0.f,  0.f, -1.f }, { 0.f, 1.f } },
+        { { -s, -s, -s }, {  0.f,  0.f, -1.f }, { 1.f, 1.f } },
+        { { -s, +s, -s }, {  0.f,  0.f, -1.f }, { 1.f, 0.f } },
+        { { +s, +s, -s }, {  0.f,  0.f, -1.f }, { 0.f, 0.f } },
+
+        { { -s, -s, -s }, { -1.f,  0.f,  0.f }, { 0.f, 1.f } },
+        { { -s, -s, +s }, { -1.f,  0.f,  0.f }, { 1.f, 1.f } },
+        { { -s, +s, +s }, { -1.f,  0.f,  0.f }, { 1.f, 0.f } },
+        { { -s, +s, -s }, { -1.f,  0.f,  0.f }, { 0.f, 0.f } },
+
+        { { -s, +s, +s }, {  0.f,  1.f,  0.f }, { 0.f, 1.f } },
+        { { +s, +s, +s }, {  0.f,  1.f,  0.f }, { 1.f, 1.f } },
+        { { +s, +s, -s }, {  0.f,  1.f,  0.f }, { 1.f, 0.f } },
+        { { -s, +s, -s }, {  0.f,  1.f,  0.f }, { 0.f, 0.f } },
+
+        { { -s, -s, -s }, {  0.f, -1.f,  0.f }, { 0.f, 1.f } },
+        { { +s, -s, -s }, {  0.f, -1.f,  0.f }, { 1.f, 1.f } },
+        { { +s, -s, +s }, {  0.f, -1.f,  0.f }, { 1.f, 0.f } },
+        { { -s, -s, +s }, {  0.f, -1.f,  0.f }, { 0.f, 0.f } }
+    };
+
+    indices = {
+         0,  1,  2,  2,  3,  0, /* front */
+         4,  5,  6,  6,  7,  4, /* right */
+         8,  9, 10, 10, 11,  8, /* back */
+        12, 13, 14, 14, 15, 12, /* left */
+        16, 17, 18, 18, 19, 16, /* top */
+        20, 21, 22, 22, 23, 20, /* bottom */
+    };
+}
+
+void updateInstances( InstanceData* pInstanceData, float angle )
+{
+    using simd::float3;
+    using simd::float4;
+    using simd::float4x4;
+
+    const float scl = 0.2f;
+    
+    float3 objectPosition = { 0.f, 0.f, -10.f };
+
+    // Update instance positions:
+
+    float4x4 rt = Maths::makeTranslate( objectPosition );
+    float4x4 rr1 = Maths::makeYRotate( -angle );
+    float4x4 rr0 = Maths::makeXRotate( angle * 0.5 );
+    float4x4 rtInv = Maths::makeTranslate( { -objectPosition.x, -objectPosition.y, -objectPosition.z } );
+    float4x4 fullObjectRot = rt * rr1 * rr0 * rtInv;
+    
+    size_t ix = 0;
+    size_t iy = 0;
+    size_t iz = 0;
+    
+    for ( size_t i = 0; i < kNumInstances; ++i )
+    {
+        if ( ix == kInstanceRows )
+        {
+            ix = 0;
+            iy += 1;
+        }
+        if ( iy == kInstanceRows )
+        {
+            iy = 0;
+            iz += 1;
+        }
+        
+        float4x4 scale = Maths::makeScale( (float3){ scl, scl, scl } );
+        float4x4 zrot = Maths::makeZRotate( angle * sinf((float)ix) );
+        float4x4 yrot = Maths::makeYRotate( angle * cosf((float)iy));
+        
+        float x = ((float)ix - (float)kInstanceRows/2.f) * (2.f * scl) + scl;
+        float y = ((float)iy - (float)kInstanceColumns/2.f) * (2.f * scl) + scl;
+        float z = ((float)iz - (float)kInstanceDepth/2.f) * (2.f * scl);
+        float4x4 translate = Maths::makeTranslate( Maths::add( objectPosition, { x, y, z } ) );
+        
+        pInstanceData[ i ].instanceTransform = fullObjectRot * translate * yrot * zrot * scale;
+        pInstanceData[ i ].instanceNormalTransform = Maths::discardTranslation( pInstanceData[ i ].instanceTransform );
+        
+        ix += 1;
+    }
+    setInstanceColors( pInstanceData );
+}
+
+void setInstanceColors( InstanceData* pInstanceData )
+{
+    using simd::float4;
+
+    for ( size_t i = 0; i < kNumInstances; ++i )
+    {
+        float iDivNumInstances = i / (float)kNumInstances;
+        float r = iDivNumInstances;
+        float g = 1.0f - r;
+        float b = sinf( M_PI * 2.0f * iDivNumInstances );
+        pInstanceData[ i ].instanceColor = (float4){ r, g, b, 1.0f };
+        pInstanceData[ i ].materialIndex = (uint32_t)( i * kNumMaterials / kNumInstances );
+    }
+}
+
+// Round the hue circle, pale enough that the instance colours still show
+Vector4f materialTint( uint32_t material )
+{
+    const float hue = material / (float)kNumMaterials * 2.0f * (float)M_PI;
+    return (Vector4f){ 0.75f + 0.25f * cosf( hue ), 0.75f + 0.25f * cosf( hue - 2.0944f ), 0.75f + 0.25f * cosf( hue + 2.0944f ), 1.0f };
+}
+
+// Node 0 is the pivot, nodes 1 .. kNumInstances the cubes. Same transforms as updateInstances - the
+// pivot is fullObjectRot (the translations either side fold into the children), the cubes
+// translate * yrot * zrot * scale. makeXRotate and makeZRotate turn clockwise, hence the negated angles
+void buildGraph( SceneGraph& graph )
+{
+    graph.clear();
+    graph.reserve( kNumInstances + 1 );
+    const SceneGraph::Transform identity = { { 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f, 1.f }, { 1.f, 1.f, 1.f } };
+    const SceneGraph::NodeId root = graph.addNode( SceneGraph::kNoParent, identity );
+    for ( uint32_t i = 0; i < kNumInstances; ++i )
+    {
+        graph.addNode( root, identity, i );
+    }
+    animateGraph( graph, 0.f );
+}
+
+void animateGraph( SceneGraph& graph, float angle )
+{
+    const float scl = 0.2f;
+    const Vector3f objectPosition = { 0.f, 0.f, -10.f };
+    const Vector3f xAxis = { 1.f, 0.f, 0.f };
+    const Vector3f yAxis = { 0.f, 1.f, 0.f };
+    const Vector3f zAxis = { 0.f, 0.f, 1.f };
+
+    SceneGraph::Transform pivot;
+    pivot.translation = objectPosition;
+    pivot.rotation = Maths::multiplyQuaternions( Maths::makeQuaternion( yAxis, -angle ), Maths::makeQuaternion( xAxis, -angle * 0.5f ) );
+    pivot.scale = { 1.f, 1.f, 1.f };
+    graph.setLocal( 0, pivot );
+
+    for ( size_t i = 0; i < kNumInstances; ++i )
+    {
+        const size_t ix = i % kInstanceRows;
+        const size_t iy = ( i / kInstanceRows ) % kInstanceRows;
+        const size_t iz = i / ( kInstanceRows * kInstanceRows );
+
+        SceneGraph::Transform cube;
+        cube.translation = { ( (float)ix - (float)kInstanceRows / 2.f ) * ( 2.f * scl ) + scl,
+                             ( (float)iy - (float)kInstanceColumns / 2.f ) * ( 2.f * scl ) + scl,
+                             ( (float)iz - (float)kInstanceDepth / 2.f ) * ( 2.f * scl ) };
+        cube.rotation = Maths::multiplyQuaternions( Maths::makeQuaternion( yAxis, angle * cosf( (float)iy ) ),
+                                                    Maths::makeQuaternion( zAxis, -angle * sinf( (float)ix ) ) );
+        cube.scale = { scl, scl, scl };
+        graph.setLocal( (SceneGraph::NodeId)( i + 1 ), cube );
+    }
+}
+
+void updateCamera( CameraData* pCameraData, float aspect )
+{
+    pCameraData->perspectiveTransform = Maths::makePerspective( 45.f * M_PI / 180.f, aspect, 0.03f, 500.0f ) ;
+    pCameraData->worldTransform = Maths::makeIdentity();
+    pCameraData->worldNormalTransform = Maths::discardTranslation( pCameraData->worldTransform );
+}
+
+void updateViewCamera( CameraData* pCameraData, float aspect, uint32_t view )
+{
+    // the camera stays put and the scene turns about the grid's centre
+    updateCamera( pCameraData, aspect );
+    const Matrix44f turns[4] = { Maths::makeIdentity(), Maths::makeYRotate( M_PI * 0.5f ), Maths::makeYRotate( M_PI ), Maths::makeXRotate( M_PI * 0.5f ) };
+    pCameraData->worldTransform = Maths::makeTranslate( { 0.f, 0.f, -10.f } ) * turns[ view % 4 ] * Maths::makeTranslate( { 0.f, 0.f, 10.f } );
+    pCameraData->worldNormalTransform = Maths::discardTranslation( pCameraData->worldTransform );
+}
+
+}
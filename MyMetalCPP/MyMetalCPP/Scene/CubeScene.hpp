@@ -0,0 +1,38 @@
+//
+//  CubeScene.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Shaders/ShaderStructs.h"
+#include "SceneGraph.hpp"
+
+// The instanced cube grid - kept free of Metal so the CPU renderers and tools build the same scene
+
+static constexpr size_t kInstanceRows = 10;
+static constexpr size_t kInstanceColumns = 10;
+static constexpr size_t kInstanceDepth = 10;
+static constexpr size_t kNumInstances = (kInstanceRows * kInstanceColumns * kInstanceDepth);
+static constexpr uint32_t kNumMaterials = 16;
+
+namespace CubeScene
+{
+    void buildCube( std::vector<VertexData>& vertices, std::vector<uint16_t>& indices );
+    void updateInstances( InstanceData* pInstanceData, float angle );
+    // Colours and material indices - materials 0 to kNumMaterials - 1 in layers through the grid
+    void setInstanceColors( InstanceData* pInstanceData );
+    Vector4f materialTint( uint32_t material );
+
+    // The same animation as a two level SceneGraph - a pivot and the cubes under it
+    void buildGraph( SceneGraph& graph );
+    void animateGraph( SceneGraph& graph, float angle );
+    void updateCamera( CameraData* pCameraData, float aspect );
+
+    // Split screen cameras - view 0 is updateCamera's, 1 to 3 see the grid from the side, behind and above
+    void updateViewCamera( CameraData* pCameraData, float aspect, uint32_t view );
+}
@@ -0,0 +1,340 @@
+//
+//  SceneFile.cpp
+//  MyMetalCPP
+//
+
+#include "SceneFile.hpp"
+#include "../Mesh/Meshlets.hpp"
+#include "../Shaders/ShaderStructs.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using SceneFormat::SectionEntry;
+using SceneFormat::SectionType;
+
+static size_t alignUp( size_t value, size_t alignment )
+{
+    return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+namespace SceneFormat
+{
+    uint64_t checksum( const void* pData, size_t size )
+    {
+        const uint8_t* pBytes = reinterpret_cast<const uint8_t*>( pData );
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for ( size_t i = 0; i < size; ++i )
+        {
+            hash = ( hash ^ pBytes[i] ) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+
+    size_t elementSize( SectionType type )
+    {
+        switch ( type )
+        {
+            case SectionType::Meshes:           return sizeof( MeshRecord );
+            case SectionType::Vertices:         return sizeof( VertexData );
+            case SectionType::Indices16:        return sizeof( uint16_t );
+            case SectionType::Indices32:        return sizeof( uint32_t );
+            case SectionType::Meshlets:         return sizeof( Meshlets::Meshlet );
+            case SectionType::MeshletBounds:    return sizeof( Meshlets::MeshletBounds );
+            case SectionType::MeshletVertices:  return sizeof( uint32_t );
+            case SectionType::MeshletTriangles: return sizeof( uint8_t );
+            case SectionType::Instances:        return sizeof( InstanceData );
+        }
+        return 0;
+    }
+
+    const char* sectionName( SectionType type )
+    {
+        switch ( type )
+        {
+            case SectionType::Meshes:           return "meshes";
+            case SectionType::Vertices:         return "vertices";
+            case SectionType::Indices16:        return "indices16";
+            case SectionType::Indices32:        return "indices32";
+            case SectionType::Meshlets:         return "meshlets";
+            case SectionType::MeshletBounds:    return "meshlet bounds";
+            case SectionType::MeshletVertices:  return "meshlet vertices";
+            case SectionType::MeshletTriangles: return "meshlet triangles";
+            case SectionType::Instances:        return "instances";
+        }
+        return "unknown";
+    }
+}
+
+SceneFile::SceneFile()
+: _pData( nullptr )
+, _size( 0 )
+, _mappedSize( 0 )
+{
+}
+
+SceneFile::~SceneFile()
+{
+    close();
+}
+
+bool SceneFile::fail( const char* reason )
+{
+    __builtin_printf( "SceneFile: %s\n", reason );
+    close();
+    return false;
+}
+
+bool SceneFile::open( const char* path )
+{
+    close();
+
+    const int fd = ::open( path, O_RDONLY );
+    if ( fd < 0 )
+    {
+        __builtin_printf( "SceneFile: can't open %s\n", path );
+        return false;
+    }
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 || (size_t)info.st_size < sizeof( SceneFormat::Header ) )
+    {
+        ::close( fd );
+        return fail( "too small for the header" );
+    }
+
+    // Private and writable so the pages are plain anonymous memory as far as newBuffer( bytesNoCopy )
+    // is concerned - nothing writes to them, so they stay shared with the page cache
+    _size = (size_t)info.st_size;
+    _mappedSize = alignUp( _size, (size_t)sysconf( _SC_PAGESIZE ) );
+    void* pMapping = mmap( nullptr, _mappedSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+    if ( pMapping == MAP_FAILED )
+    {
+        _size = _mappedSize = 0;
+        return fail( "mmap failed" );
+    }
+    _pData = reinterpret_cast<uint8_t*>( pMapping );
+
+    SceneFormat::Header header;
+    memcpy( &header, _pData, sizeof( header ) );
+    if ( header.magic != SceneFormat::kMagic )
+    {
+        return fail( "not a scene file" );
+    }
+    if ( header.version != SceneFormat::kVersion )
+    {
+        return fail( "unsupported version" );
+    }
+    if ( header.fileSize != _size )
+    {
+        return fail( "truncated" );
+    }
+    if ( header.tocOffset % alignof( SectionEntry ) != 0 || header.tocOffset < sizeof( header ) || header.tocOffset > _size ||
+         header.sectionCount > ( _size - header.tocOffset ) / sizeof( SectionEntry ) )
+    {
+        return fail( "table of contents out of bounds" );
+    }
+
+    const SectionEntry* pToc = reinterpret_cast<const SectionEntry*>( _pData + header.tocOffset );
+    _sections.assign( pToc, pToc + header.sectionCount );
+
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    ranges.reserve( _sections.size() );
+    for ( const SectionEntry& entry : _sections )
+    {
+        // unknown types are skipped rather than rejected, their size can't be checked
+        const size_t expectedSize = SceneFormat::elementSize( (SectionType)entry.type );
+        if ( expectedSize != 0 && entry.elementSize != expectedSize )
+        {
+            return fail( "section element size doesn't match this build" );
+        }
+        if ( entry.offset % SceneFormat::kSectionAlignment != 0 || entry.offset < sizeof( header ) )
+        {
+            return fail( "misaligned section" );
+        }
+        if ( entry.elementSize != 0 && entry.elementCount > ( header.tocOffset - std::min( entry.offset, header.tocOffset ) ) / entry.elementSize )
+        {
+            return fail( "section out of bounds" );
+        }
+        ranges.push_back( { entry.offset, entry.offset + entry.elementSize * entry.elementCount } );
+    }
+    std::sort( ranges.begin(), ranges.end() );
+    for ( size_t i = 1; i < ranges.size(); ++i )
+    {
+        if ( ranges[i].first < ranges[ i - 1 ].second )
+        {
+            return fail( "overlapping sections" );
+        }
+    }
+    return true;
+}
+
+void SceneFile::close()
+{
+    if ( _pData )
+    {
+        munmap( _pData, _mappedSize );
+    }
+    _pData = nullptr;
+    _size = 0;
+    _mappedSize = 0;
+    _sections.clear();
+}
+
+const SectionEntry* SceneFile::find( SectionType type ) const
+{
+    for ( const SectionEntry& entry : _sections )
+    {
+        if ( entry.type == (uint32_t)type )
+        {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+bool SceneFile::validate() const
+{
+    assert( isOpen() );
+    for ( const SectionEntry& entry : _sections )
+    {
+        if ( SceneFormat::checksum( _pData + entry.offset, entry.elementSize * entry.elementCount ) != entry.checksum )
+        {
+            __builtin_printf( "SceneFile: %s checksum mismatch\n", SceneFormat::sectionName( (SectionType)entry.type ) );
+            return false;
+        }
+    }
+
+    size_t meshCount, vertexCount, index16Count, index32Count, meshletCount, boundsCount, meshletVertexCount, triangleByteCount;
+    const SceneFormat::MeshRecord* pMeshes = sectionData<SceneFormat::MeshRecord>( SectionType::Meshes, &meshCount );
+    sectionData<VertexData>( SectionType::Vertices, &vertexCount );
+    const uint16_t* pIndices16 = sectionData<uint16_t>( SectionType::Indices16, &index16Count );
+    const uint32_t* pIndices32 = sectionData<uint32_t>( SectionType::Indices32, &index32Count );
+    const Meshlets::Meshlet* pMeshlets = sectionData<Meshlets::Meshlet>( SectionType::Meshlets, &meshletCount );
+    sectionData<Meshlets::MeshletBounds>( SectionType::MeshletBounds, &boundsCount );
+    const uint32_t* pMeshletVertices = sectionData<uint32_t>( SectionType::MeshletVertices, &meshletVertexCount );
+    const uint8_t* pTriangles = sectionData<uint8_t>( SectionType::MeshletTriangles, &triangleByteCount );
+
+    if ( pIndices16 && pIndices32 )
+    {
+        __builtin_printf( "SceneFile: both 16 and 32 bit indices\n" );
+        return false;
+    }
+    if ( boundsCount != meshletCount || triangleByteCount % 3 != 0 )
+    {
+        __builtin_printf( "SceneFile: meshlet sections don't match\n" );
+        return false;
+    }
+    const size_t indexCount = pIndices16 ? index16Count : index32Count;
+    const size_t meshletTriangleCount = triangleByteCount / 3;
+
+    for ( size_t m = 0; m < meshCount; ++m )
+    {
+        const SceneFormat::MeshRecord& mesh = pMeshes[m];
+        if ( (size_t)mesh.firstVertex + mesh.vertexCount > vertexCount || (size_t)mesh.firstIndex + mesh.indexCount > indexCount ||
+             (size_t)mesh.firstMeshlet + mesh.meshletCount > meshletCount || mesh.indexCount % 3 != 0 )
+        {
+            __builtin_printf( "SceneFile: mesh %zu ranges out of bounds\n", m );
+            return false;
+        }
+        for ( uint32_t i = mesh.firstIndex; i < mesh.firstIndex + mesh.indexCount; ++i )
+        {
+            const uint32_t index = pIndices16 ? pIndices16[i] : pIndices32[i];
+            if ( index >= mesh.vertexCount )
+            {
+                __builtin_printf( "SceneFile: mesh %zu index %u out of range\n", m, index );
+                return false;
+            }
+        }
+        for ( uint32_t i = mesh.firstMeshlet; i < mesh.firstMeshlet + mesh.meshletCount; ++i )
+        {
+            const Meshlets::Meshlet& meshlet = pMeshlets[i];
+            const size_t firstVertex = (size_t)mesh.firstMeshletVertex + meshlet.vertexOffset;
+            const size_t firstTriangle = (size_t)mesh.firstMeshletTriangle + meshlet.triangleOffset;
+            if ( meshlet.vertexCount > Meshlets::kMaxVertices || meshlet.triangleCount > Meshlets::kMaxTriangles ||
+                 firstVertex + meshlet.vertexCount > meshletVertexCount || firstTriangle + meshlet.triangleCount > meshletTriangleCount )
+            {
+                __builtin_printf( "SceneFile: mesh %zu meshlet %u out of bounds\n", m, i - mesh.firstMeshlet );
+                return false;
+            }
+            for ( uint32_t v = 0; v < meshlet.vertexCount; ++v )
+            {
+                if ( pMeshletVertices[ firstVertex + v ] >= mesh.vertexCount )
+                {
+                    __builtin_printf( "SceneFile: mesh %zu meshlet %u vertex out of range\n", m, i - mesh.firstMeshlet );
+                    return false;
+                }
+            }
+            for ( size_t t = firstTriangle * 3; t < ( firstTriangle + meshlet.triangleCount ) * 3; ++t )
+            {
+                if ( pTriangles[t] >= meshlet.vertexCount )
+                {
+                    __builtin_printf( "SceneFile: mesh %zu meshlet %u triangle out of range\n", m, i - mesh.firstMeshlet );
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void SceneWriter::addSection( SectionType type, const void* pData, size_t elementSize, size_t elementCount )
+{
+    assert( SceneFormat::elementSize( type ) == 0 || SceneFormat::elementSize( type ) == elementSize );
+    Section section;
+    section.type = type;
+    section.elementSize = (uint32_t)elementSize;
+    section.elementCount = elementCount;
+    const uint8_t* pBytes = reinterpret_cast<const uint8_t*>( pData );
+    section.bytes.assign( pBytes, pBytes + elementSize * elementCount );
+    _sections.push_back( std::move( section ) );
+}
+
+bool SceneWriter::write( const char* path ) const
+{
+    std::vector<SectionEntry> toc;
+    size_t offset = alignUp( sizeof( SceneFormat::Header ), SceneFormat::kSectionAlignment );
+    for ( const Section& section : _sections )
+    {
+        toc.push_back( { (uint32_t)section.type, section.elementSize, section.elementCount, offset,
+                         SceneFormat::checksum( section.bytes.data(), section.bytes.size() ) } );
+        offset = alignUp( offset + section.bytes.size(), SceneFormat::kSectionAlignment );
+    }
+
+    SceneFormat::Header header = {};
+    header.magic = SceneFormat::kMagic;
+    header.version = SceneFormat::kVersion;
+    header.sectionCount = (uint32_t)toc.size();
+    header.tocOffset = offset;
+    header.fileSize = offset + toc.size() * sizeof( SectionEntry );
+
+    FILE* pFile = fopen( path, "wb" );
+    if ( !pFile )
+    {
+        __builtin_printf( "SceneWriter: can't create %s\n", path );
+        return false;
+    }
+    static const uint8_t kPadding[ SceneFormat::kSectionAlignment ] = {};
+    bool ok = fwrite( &header, sizeof( header ), 1, pFile ) == 1;
+    size_t written = sizeof( header );
+    for ( size_t i = 0; i < _sections.size() && ok; ++i )
+    {
+        ok = fwrite( kPadding, 1, toc[i].offset - written, pFile ) == toc[i].offset - written;
+        ok = ok && fwrite( _sections[i].bytes.data(), 1, _sections[i].bytes.size(), pFile ) == _sections[i].bytes.size();
+        written = toc[i].offset + _sections[i].bytes.size();
+    }
+    ok = ok && fwrite( kPadding, 1, header.tocOffset - written, pFile ) == header.tocOffset - written;
+    ok = ok && fwrite( toc.data(), sizeof( SectionEntry ), toc.size(), pFile ) == toc.size();
+    ok = ( fclose( pFile ) == 0 ) && ok;
+    if ( !ok )
+    {
+        __builtin_printf( "SceneWriter: write to %s failed\n", path );
+    }
+    return ok;
+}
@@ -0,0 +1,159 @@
+//
+//  SceneFile.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Binary scene container that is used in place - the file is mmap'd and the sections are read
+// (or wrapped as Metal buffers, see MetalHelpers::newSceneBuffer) without parsing or copying.
+//
+//   Header         magic, version, section count, file size, offset of the table of contents
+//   sections       each starts on a kSectionAlignment boundary, arrays of fixed size elements
+//   TOC            one SectionEntry per section: type, element size and count, offset, checksum
+//
+// Section contents are the in memory structs (VertexData, InstanceData, Meshlets::Meshlet ...)
+// as the CPU and the GPU both see them, so the format is little endian and tied to those
+// layouts - kVersion goes up whenever one of them changes. MeshRecords tie the sections
+// together: each mesh is a range of vertices, indices and meshlets.
+//
+// SceneFile::open checks the header and the TOC (bounds, alignment, element sizes, overlaps)
+// and SceneFile::validate the contents (checksums, every index and range in bounds) - the
+// first is cheap enough for every load, the second touches every page and is for tools.
+
+namespace SceneFormat
+{
+    static constexpr uint32_t kMagic = 0x4353'4d4d;     // "MMSC"
+    static constexpr uint32_t kVersion = 2;     // 2: InstanceData materialIndex
+    static constexpr size_t kSectionAlignment = 64;
+
+    enum class SectionType : uint32_t
+    {
+        Meshes = 1,             // MeshRecord
+        Vertices,               // VertexData
+        Indices16,              // uint16_t
+        Indices32,              // uint32_t
+        Meshlets,               // Meshlets::Meshlet
+        MeshletBounds,          // Meshlets::MeshletBounds
+        MeshletVertices,        // uint32_t
+        MeshletTriangles,       // uint8_t
+        Instances,              // InstanceData
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t sectionCount;
+        uint32_t reserved;
+        uint64_t fileSize;
+        uint64_t tocOffset;
+    };
+
+    struct SectionEntry
+    {
+        uint32_t type;          // SectionType
+        uint32_t elementSize;
+        uint64_t elementCount;
+        uint64_t offset;        // from the start of the file
+        uint64_t checksum;      // FNV-1a 64 of the section bytes
+    };
+
+    // Ranges into the Vertices, Indices and Meshlets sections. Indices are relative to
+    // firstVertex, meshlet vertices and triangles are relative to the mesh's own ranges
+    struct MeshRecord
+    {
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        uint32_t firstMeshlet;
+        uint32_t meshletCount;
+        uint32_t firstMeshletVertex;
+        uint32_t firstMeshletTriangle;  // in triangles
+    };
+
+    uint64_t checksum( const void* pData, size_t size );
+    size_t elementSize( SectionType type );    // 0 for unknown types
+    const char* sectionName( SectionType type );
+}
+
+class SceneFile
+{
+public:
+    SceneFile();
+    ~SceneFile();
+
+    SceneFile( const SceneFile& ) = delete;
+    SceneFile& operator=( const SceneFile& ) = delete;
+
+    // Maps the file and checks the header and TOC, prints the reason and returns false if it can't be used
+    bool open( const char* path );
+    void close();
+
+    // Checksums and cross section checks - every index in its mesh's vertex range and so on
+    bool validate() const;
+
+    bool isOpen() const { return _pData != nullptr; }
+
+    // The whole mapping - page aligned, mappedSize() is size() rounded up to whole pages
+    const uint8_t* data() const { return _pData; }
+    size_t size() const { return _size; }
+    size_t mappedSize() const { return _mappedSize; }
+
+    uint32_t sectionCount() const { return (uint32_t)_sections.size(); }
+    const SceneFormat::SectionEntry& section( uint32_t index ) const { return _sections[ index ]; }
+
+    // First section of the type, nullptr if there isn't one
+    const SceneFormat::SectionEntry* find( SceneFormat::SectionType type ) const;
+
+    // Typed view of the first section of the type, nullptr (and count 0) if there isn't one
+    template<typename T>
+    const T* sectionData( SceneFormat::SectionType type, size_t* pCount = nullptr ) const
+    {
+        const SceneFormat::SectionEntry* pEntry = find( type );
+        if ( pCount )
+        {
+            *pCount = pEntry ? (size_t)pEntry->elementCount : 0;
+        }
+        return pEntry ? reinterpret_cast<const T*>( _pData + pEntry->offset ) : nullptr;
+    }
+
+private:
+    bool fail( const char* reason );
+
+    uint8_t* _pData;
+    size_t _size;
+    size_t _mappedSize;
+    std::vector<SceneFormat::SectionEntry> _sections;
+};
+
+// Collects sections in memory and writes them out with the header and TOC
+class SceneWriter
+{
+public:
+    // The data is copied, sections are written in the order they're added
+    void addSection( SceneFormat::SectionType type, const void* pData, size_t elementSize, size_t elementCount );
+
+    template<typename T>
+    void addSection( SceneFormat::SectionType type, const std::vector<T>& elements )
+    {
+        addSection( type, elements.data(), sizeof( T ), elements.size() );
+    }
+
+    bool write( const char* path ) const;
+
+private:
+    struct Section
+    {
+        SceneFormat::SectionType type;
+        uint32_t elementSize;
+        uint64_t elementCount;
+        std::vector<uint8_t> bytes;
+    };
+    std::vector<Section> _sections;
+};
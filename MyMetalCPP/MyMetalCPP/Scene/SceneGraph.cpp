@@ -0,0 +1,361 @@
+//
+//  SceneGraph.cpp
+//  MyMetalCPP
+//
+
+#include "SceneGraph.hpp"
+#include "../Jobs/JobSystem.hpp"
+#include "../Maths/Math.hpp"
+#include "../Maths/VectorExt.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+
+using Maths::Float4;
+
+static constexpr size_t kNodesPerJob = 2048;       // multiple of 4, so jobs start on a SIMD group
+
+// Lanes past count repeat the last node - computed and ignored
+static inline Float4 load4( const float* p, uint32_t count )
+{
+    Float4 v;
+    if ( count == 4 )
+    {
+        memcpy( &v, p, sizeof( v ) );
+    }
+    else
+    {
+        for ( uint32_t k = 0; k < 4; ++k )
+        {
+            v[k] = p[ std::min( k, count - 1 ) ];
+        }
+    }
+    return v;
+}
+
+SceneGraph::SceneGraph()
+: _currentVersion( 0 )
+, _unsorted( false )
+{
+}
+
+void SceneGraph::reserve( size_t nodeCount )
+{
+    _parent.reserve( nodeCount );
+    _instance.reserve( nodeCount );
+    for ( int k = 0; k < 3; ++k )
+    {
+        _translation[k].reserve( nodeCount );
+        _scale[k].reserve( nodeCount );
+    }
+    for ( int k = 0; k < 4; ++k )
+    {
+        _rotation[k].reserve( nodeCount );
+    }
+    _world.reserve( nodeCount );
+    _dirty.reserve( nodeCount );
+    _changed.reserve( nodeCount );
+    _version.reserve( nodeCount );
+    _slotOfNode.reserve( nodeCount );
+    _nodeOfSlot.reserve( nodeCount );
+}
+
+void SceneGraph::clear()
+{
+    *this = SceneGraph();
+}
+
+SceneGraph::NodeId SceneGraph::addNode( NodeId parent, const Transform& local, uint32_t instanceIndex )
+{
+    assert( parent == kNoParent || parent < _slotOfNode.size() );
+    const NodeId node = (NodeId)_slotOfNode.size();
+    const uint32_t slot = (uint32_t)_parent.size();
+    const uint32_t parentSlot = parent == kNoParent ? kNoParent : _slotOfNode[ parent ];
+
+    _parent.push_back( parentSlot );
+    _instance.push_back( instanceIndex );
+    for ( int k = 0; k < 3; ++k )
+    {
+        _translation[k].push_back( 0.f );
+        _scale[k].push_back( 1.f );
+    }
+    for ( int k = 0; k < 4; ++k )
+    {
+        _rotation[k].push_back( 0.f );
+    }
+    _world.push_back( {} );
+    _dirty.push_back( 1 );
+    _changed.push_back( 0 );
+    _version.push_back( 0 );
+    _slotOfNode.push_back( slot );
+    _nodeOfSlot.push_back( node );
+    _unsorted = true;
+
+    setLocal( node, local );
+    return node;
+}
+
+void SceneGraph::setLocal( NodeId node, const Transform& local )
+{
+    const uint32_t slot = _slotOfNode[ node ];
+    _translation[0][ slot ] = local.translation.x;
+    _translation[1][ slot ] = local.translation.y;
+    _translation[2][ slot ] = local.translation.z;
+    _rotation[0][ slot ] = local.rotation.x;
+    _rotation[1][ slot ] = local.rotation.y;
+    _rotation[2][ slot ] = local.rotation.z;
+    _rotation[3][ slot ] = local.rotation.w;
+    _scale[0][ slot ] = local.scale.x;
+    _scale[1][ slot ] = local.scale.y;
+    _scale[2][ slot ] = local.scale.z;
+    _dirty[ slot ] = 1;
+}
+
+SceneGraph::Transform SceneGraph::local( NodeId node ) const
+{
+    const uint32_t slot = _slotOfNode[ node ];
+    Transform local;
+    local.translation = { _translation[0][ slot ], _translation[1][ slot ], _translation[2][ slot ] };
+    local.rotation = { _rotation[0][ slot ], _rotation[1][ slot ], _rotation[2][ slot ], _rotation[3][ slot ] };
+    local.scale = { _scale[0][ slot ], _scale[1][ slot ], _scale[2][ slot ] };
+    return local;
+}
+
+Matrix44f SceneGraph::world( NodeId node ) const
+{
+    const uint32_t slot = _slotOfNode[ node ];
+    const float* w = _world[ slot ].m;
+    return simd_matrix( (Vector4f){ w[0], w[1], w[2], 0.f },
+                        (Vector4f){ w[3], w[4], w[5], 0.f },
+                        (Vector4f){ w[6], w[7], w[8], 0.f },
+                        (Vector4f){ w[9], w[10], w[11], 1.f } );
+}
+
+// Roots in the order they were added, then each level is the children of the one before in
+// order - siblings end up together and next to their cousins, so parent gathers mostly hit
+// the same few cache lines
+void SceneGraph::sortBreadthFirst()
+{
+    const uint32_t count = (uint32_t)_parent.size();
+    std::vector<uint32_t> firstChild( count + 1, 0 );
+    for ( uint32_t parent : _parent )
+    {
+        if ( parent != kNoParent )
+        {
+            ++firstChild[ parent + 1 ];
+        }
+    }
+    for ( uint32_t slot = 0; slot < count; ++slot )
+    {
+        firstChild[ slot + 1 ] += firstChild[ slot ];
+    }
+    std::vector<uint32_t> children( firstChild[ count ] );
+    std::vector<uint32_t> next( firstChild.begin(), firstChild.end() - 1 );
+    std::vector<uint32_t> order;
+    order.reserve( count );
+    for ( uint32_t slot = 0; slot < count; ++slot )
+    {
+        if ( _parent[ slot ] == kNoParent )
+        {
+            order.push_back( slot );
+        }
+        else
+        {
+            children[ next[ _parent[ slot ] ]++ ] = slot;
+        }
+    }
+
+    _levelStart.assign( 1, 0 );
+    for ( uint32_t levelBegin = 0; levelBegin < order.size(); )
+    {
+        const uint32_t levelEnd = (uint32_t)order.size();
+        _levelStart.push_back( levelEnd );
+        for ( uint32_t i = levelBegin; i < levelEnd; ++i )
+        {
+            order.insert( order.end(), children.begin() + firstChild[ order[i] ], children.begin() + firstChild[ order[i] + 1 ] );
+        }
+        levelBegin = levelEnd;
+    }
+    _unsorted = false;
+
+    std::vector<uint32_t> newSlot( count );
+    for ( uint32_t slot = 0; slot < count; ++slot )
+    {
+        newSlot[ order[ slot ] ] = slot;
+    }
+    auto permute = [&]( auto& values )
+    {
+        auto sorted = values;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            sorted[i] = values[ order[i] ];
+        }
+        values.swap( sorted );
+    };
+    permute( _parent );
+    for ( uint32_t& parent : _parent )
+    {
+        parent = parent == kNoParent ? kNoParent : newSlot[ parent ];
+    }
+    permute( _instance );
+    for ( int k = 0; k < 3; ++k )
+    {
+        permute( _translation[k] );
+        permute( _scale[k] );
+    }
+    for ( int k = 0; k < 4; ++k )
+    {
+        permute( _rotation[k] );
+    }
+    permute( _world );
+    permute( _dirty );
+    permute( _changed );
+    permute( _version );
+    permute( _nodeOfSlot );
+    for ( uint32_t slot = 0; slot < count; ++slot )
+    {
+        _slotOfNode[ _nodeOfSlot[ slot ] ] = slot;
+    }
+}
+
+void SceneGraph::writeInstance( uint32_t slot, InstanceData* pInstances ) const
+{
+    const float* w = _world[ slot ].m;
+    InstanceData& instance = pInstances[ _instance[ slot ] ];
+    instance.instanceTransform = simd_matrix( (Vector4f){ w[0], w[1], w[2], 0.f },
+                                              (Vector4f){ w[3], w[4], w[5], 0.f },
+                                              (Vector4f){ w[6], w[7], w[8], 0.f },
+                                              (Vector4f){ w[9], w[10], w[11], 1.f } );
+    instance.instanceNormalTransform = simd_matrix( (Vector3f){ w[0], w[1], w[2] }, (Vector3f){ w[3], w[4], w[5] },
+                                                    (Vector3f){ w[6], w[7], w[8] } );
+}
+
+SceneGraph::UpdateStats SceneGraph::update( InstanceData* pInstances, uint32_t* pVersion )
+{
+    assert( !pInstances || pVersion );
+    if ( _unsorted )
+    {
+        sortBreadthFirst();
+    }
+    ++_currentVersion;
+    const uint32_t writeSince = pInstances ? *pVersion : 0;
+
+    std::atomic<size_t> nodesUpdated( 0 );
+    std::atomic<size_t> instancesWritten( 0 );
+    for ( uint32_t level = 0; level < levelCount(); ++level )
+    {
+        const uint32_t levelBegin = _levelStart[ level ];
+        const uint32_t levelEnd = _levelStart[ level + 1 ];
+        JobSystem::Instance()->parallelFor( levelEnd - levelBegin, kNodesPerJob, [&]( size_t begin, size_t end )
+        {
+            size_t updated = 0;
+            size_t written = 0;
+            for ( uint32_t i = levelBegin + (uint32_t)begin; i < levelBegin + end; i += 4 )
+            {
+                const uint32_t count = std::min<uint32_t>( 4, levelBegin + (uint32_t)end - i );
+                bool anyDirty = false;
+                for ( uint32_t k = 0; k < count; ++k )
+                {
+                    const uint32_t parent = _parent[ i + k ];
+                    const bool dirty = _dirty[ i + k ] || ( parent != kNoParent && _changed[ parent ] );
+                    _changed[ i + k ] = dirty;
+                    anyDirty = anyDirty || dirty;
+                }
+
+                if ( anyDirty )
+                {
+                    // local matrix, 4 nodes wide
+                    const Float4 qx = load4( &_rotation[0][i], count );
+                    const Float4 qy = load4( &_rotation[1][i], count );
+                    const Float4 qz = load4( &_rotation[2][i], count );
+                    const Float4 qw = load4( &_rotation[3][i], count );
+                    const Float4 sx = load4( &_scale[0][i], count );
+                    const Float4 sy = load4( &_scale[1][i], count );
+                    const Float4 sz = load4( &_scale[2][i], count );
+                    const Float4 two = Maths::splat( 2.f );
+                    const Float4 one = Maths::splat( 1.f );
+                    const Float4 xx = qx * qx, yy = qy * qy, zz = qz * qz;
+                    const Float4 xy = qx * qy, xz = qx * qz, yz = qy * qz;
+                    const Float4 wx = qw * qx, wy = qw * qy, wz = qw * qz;
+                    const Float4 local[12] = {
+                        ( one - two * ( yy + zz ) ) * sx, two * ( xy + wz ) * sx, two * ( xz - wy ) * sx,
+                        two * ( xy - wz ) * sy, ( one - two * ( xx + zz ) ) * sy, two * ( yz + wx ) * sy,
+                        two * ( xz + wy ) * sz, two * ( yz - wx ) * sz, ( one - two * ( xx + yy ) ) * sz,
+                        load4( &_translation[0][i], count ), load4( &_translation[1][i], count ), load4( &_translation[2][i], count ),
+                    };
+
+                    Float4 world[12];
+                    if ( level == 0 )
+                    {
+                        std::copy( local, local + 12, world );
+                    }
+                    else
+                    {
+                        // gather the parents' world matrices, then world = parent * local
+                        Float4 parent[12];
+                        for ( uint32_t k = 0; k < 4; ++k )
+                        {
+                            const float* p = _world[ _parent[ i + std::min( k, count - 1 ) ] ].m;
+                            for ( int c = 0; c < 12; ++c )
+                            {
+                                parent[c][k] = p[c];
+                            }
+                        }
+                        for ( int column = 0; column < 4; ++column )
+                        {
+                            const Float4* l = &local[ column * 3 ];
+                            for ( int row = 0; row < 3; ++row )
+                            {
+                                world[ column * 3 + row ] = parent[ row ] * l[0] + parent[ 3 + row ] * l[1] + parent[ 6 + row ] * l[2];
+                            }
+                        }
+                        for ( int row = 0; row < 3; ++row )
+                        {
+                            world[ 9 + row ] += parent[ 9 + row ];
+                        }
+                    }
+                    for ( uint32_t k = 0; k < count; ++k )
+                    {
+                        float* w = _world[ i + k ].m;
+                        for ( int c = 0; c < 12; ++c )
+                        {
+                            w[c] = world[c][k];
+                        }
+                    }
+
+                    for ( uint32_t k = 0; k < count; ++k )
+                    {
+                        if ( _changed[ i + k ] )
+                        {
+                            _dirty[ i + k ] = 0;
+                            _version[ i + k ] = _currentVersion;
+                            ++updated;
+                        }
+                    }
+                }
+
+                if ( pInstances )
+                {
+                    for ( uint32_t k = 0; k < count; ++k )
+                    {
+                        if ( _instance[ i + k ] != kNoInstance && _version[ i + k ] > writeSince )
+                        {
+                            writeInstance( i + k, pInstances );
+                            ++written;
+                        }
+                    }
+                }
+            }
+            nodesUpdated += updated;
+            instancesWritten += written;
+        } );
+    }
+
+    if ( pInstances )
+    {
+        *pVersion = _currentVersion;
+    }
+    return { nodesUpdated.load(), instancesWritten.load(), levelCount() };
+}
@@ -0,0 +1,100 @@
+//
+//  SceneGraph.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Shaders/ShaderStructs.h"
+
+// Transform hierarchy stored flat - structure of arrays, one level after another.
+//
+// Every node has a parent (or none), a local translation / rotation (quaternion) / scale and
+// a world matrix, indexed by slot. The local components each get their own array so 4 nodes
+// load straight into Maths::Float4 lanes; world matrices are read back through parent indices,
+// so each is kept together (one cache line per gather). Slots are in breadth first order -
+// every level is a contiguous range, every parent is in an earlier level and siblings are
+// next to each other. update() walks the levels in order, each one in parallel on the
+// JobSystem, 4 nodes at a time: build the local matrices from TRS, gather the parents' world
+// matrices and multiply.
+//
+// Setting a local transform marks the node dirty. A node is recomputed when it is dirty or its
+// parent's world matrix changed this update, so unchanged subtrees cost one flag test per node.
+//
+// Nodes can carry an instance index; update() writes their world matrix (and normal transform)
+// straight into an InstanceData array as it goes. The writes stream when instance indices
+// follow the breadth first order - nodes added a level at a time, as a scene file would - and
+// scatter otherwise. That array is usually one of several frames in flight, so the caller
+// keeps a version per buffer and every node that changed since that version is written, not
+// just the ones that changed this update.
+
+class SceneGraph
+{
+public:
+    typedef uint32_t NodeId;
+    static constexpr NodeId kNoParent = ~0u;
+    static constexpr uint32_t kNoInstance = ~0u;
+
+    struct Transform
+    {
+        Vector3f translation;
+        Vector4f rotation;      // quaternion, see Maths::makeQuaternion
+        Vector3f scale;
+    };
+
+    struct UpdateStats
+    {
+        size_t nodesUpdated;        // world matrix recomputed
+        size_t instancesWritten;
+        uint32_t levels;
+    };
+
+    SceneGraph();
+
+    void reserve( size_t nodeCount );
+    void clear();
+
+    // The parent has to exist already. Node ids stay valid, slots move when the depth order is rebuilt
+    NodeId addNode( NodeId parent, const Transform& local, uint32_t instanceIndex = kNoInstance );
+
+    void setLocal( NodeId node, const Transform& local );
+    Transform local( NodeId node ) const;
+    Matrix44f world( NodeId node ) const;       // as of the last update()
+
+    size_t nodeCount() const { return _parent.size(); }
+    uint32_t levelCount() const { return _levelStart.empty() ? 0 : (uint32_t)_levelStart.size() - 1; }
+
+    // Propagates dirty transforms. With pInstances, every instance node whose world matrix changed
+    // after *pVersion is written to it and *pVersion is set to the current version (start at 0)
+    UpdateStats update( InstanceData* pInstances = nullptr, uint32_t* pVersion = nullptr );
+
+private:
+    struct WorldMatrix
+    {
+        float m[12];                            // affine 4x3, column major
+    };
+
+    void sortBreadthFirst();
+    void writeInstance( uint32_t slot, InstanceData* pInstances ) const;
+
+    // per slot, in breadth first order
+    std::vector<uint32_t> _parent;              // slot of the parent, kNoParent for roots
+    std::vector<uint32_t> _instance;
+    std::vector<float> _translation[3];
+    std::vector<float> _rotation[4];
+    std::vector<float> _scale[3];
+    std::vector<WorldMatrix> _world;
+    std::vector<uint8_t> _dirty;                // local transform set since the last update
+    std::vector<uint8_t> _changed;              // world recomputed this update
+    std::vector<uint32_t> _version;             // update that last changed the world matrix
+
+    std::vector<uint32_t> _slotOfNode;
+    std::vector<NodeId> _nodeOfSlot;
+    std::vector<uint32_t> _levelStart;          // first slot of each level, plus the end
+    uint32_t _currentVersion;
+    bool _unsorted;
+};
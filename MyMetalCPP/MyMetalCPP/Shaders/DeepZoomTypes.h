@@ -0,0 +1,26 @@
+//
+//  DeepZoomTypes.h
+//  MyMetalCPP
+//
+
+#ifndef DeepZoomTypes_h
+#define DeepZoomTypes_h
+
+// Shared between Mandelbrot.metal and the CPU side DeepZoom - plain types only so
+// it also compiles without simd.h
+
+struct DeepZoomParams
+{
+    float pixelStep;            // delta c between neighbouring pixels
+    float radius;               // |delta c| of the corner pixel, series coefficients are pre-scaled by it
+    float seriesA[2];           // scaled series approximation coefficients at skipIterations
+    float seriesB[2];
+    float seriesC[2];
+    unsigned int orbitLength;   // number of float2 entries in the reference orbit buffer
+    unsigned int skipIterations;
+    unsigned int maxIterations;
+    unsigned int width;
+    unsigned int height;
+};
+
+#endif /* DeepZoomTypes_h */
@@ -0,0 +1,63 @@
+//
+//  KernelShim.h
+//  MyMetalCPP
+//
+
+#ifndef KernelShim_h
+#define KernelShim_h
+
+// Lets a shader be written once and compiled both by the Metal compiler and as C++
+// (kernels for Compute/CpuDispatch.hpp, vertex/fragment stages for Raster/). Signatures use
+// these macros instead of raw attributes:
+//
+//   MM_KERNEL void my_kernel( texture2d< half, access::write > tex MM_TEXTURE(0),
+//                             uint2 index MM_THREAD_POSITION,
+//                             uint2 gridSize MM_THREADS_PER_GRID,
+//                             MM_DEVICE const uint* data MM_BUFFER(0) )
+//
+// Keep the bodies to the subset of MSL that Compute/CpuShaderTypes.hpp provides - no swizzles,
+// write float3( v.x, v.y, v.z ) instead of v.xyz.
+
+#if defined( __METAL_VERSION__ )
+
+#include <metal_stdlib>
+using namespace metal;
+
+#define MM_KERNEL               kernel
+#define MM_VERTEX               vertex
+#define MM_FRAGMENT             fragment
+#define MM_DEVICE               device
+#define MM_CONSTANT             constant
+#define MM_TEXTURE( i )         [[texture( i )]]
+#define MM_BUFFER( i )          [[buffer( i )]]
+#define MM_THREAD_POSITION      [[thread_position_in_grid]]
+#define MM_THREADS_PER_GRID     [[threads_per_grid]]
+#define MM_POSITION             [[position]]
+#define MM_STAGE_IN             [[stage_in]]
+#define MM_VERTEX_ID            [[vertex_id]]
+#define MM_INSTANCE_ID          [[instance_id]]
+#define MM_FLAT                 [[flat]]
+
+#else
+
+#include "../Compute/CpuShaderTypes.hpp"
+using namespace metal;
+
+#define MM_KERNEL               inline
+#define MM_VERTEX               inline
+#define MM_FRAGMENT             inline
+#define MM_DEVICE
+#define MM_CONSTANT
+#define MM_TEXTURE( i )
+#define MM_BUFFER( i )
+#define MM_THREAD_POSITION
+#define MM_THREADS_PER_GRID
+#define MM_POSITION
+#define MM_STAGE_IN
+#define MM_VERTEX_ID
+#define MM_INSTANCE_ID
+#define MM_FLAT
+
+#endif
+
+#endif /* KernelShim_h */
@@ -6,46 +6,63 @@
 //
 
 #include <metal_stdlib>
+#include "DeepZoomTypes.h"
+#include "MandelbrotKernel.h"
 using namespace metal;
 
-kernel void mandelbrot_set(texture2d< half, access::write > tex [[texture(0)]],
-                            uint2 index [[thread_position_in_grid]],
-                            uint2 gridSize [[threads_per_grid]],
-                            device const uint* frame [[buffer(0)]])
+// mandelbrot_set lives in MandelbrotKernel.h so the CPU backend can run it too
+
+// Deep zoom - per pixel perturbation against a reference orbit computed on the CPU (see DeepZoom.hpp)
+
+inline float2 complexMul(float2 a, float2 b)
+{
+    return float2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+kernel void mandelbrot_perturbation(texture2d< half, access::write > tex [[texture(0)]],
+                                    uint2 index [[thread_position_in_grid]],
+                                    constant DeepZoomParams& params [[buffer(0)]],
+                                    device const float2* orbit [[buffer(1)]])
 {
-     constexpr float kAnimationFrequency = 0.01;
-     constexpr float kAnimationSpeed = 4;
-     constexpr float kAnimationScaleLow = 0.62;
-     constexpr float kAnimationScale = 0.38;
-
-     constexpr float2 kMandelbrotPixelOffset = {-0.2, -0.35};
-    constexpr float2 kMandelbrotOrigin = {-1.2, -0.32};
-     constexpr float2 kMandelbrotScale = {2.2, 2.0};
-
-     // Map time to zoom value in [kAnimationScaleLow, 1]
-     float zoom = kAnimationScaleLow + kAnimationScale * cos(kAnimationFrequency * *frame);
-     // Speed up zooming
-     zoom = pow(zoom, kAnimationSpeed);
-
-     //Scale
-     float x0 = zoom * kMandelbrotScale.x * ((float)index.x / gridSize.x + kMandelbrotPixelOffset.x) + kMandelbrotOrigin.x;
-     float y0 = zoom * kMandelbrotScale.y * ((float)index.y / gridSize.y + kMandelbrotPixelOffset.y) + kMandelbrotOrigin.y;
-
-     // Implement Mandelbrot set
-     float x = 0.0;
-     float y = 0.0;
-     uint iteration = 0;
-     uint max_iteration = 1000;
-     float xtmp = 0.0;
-     while(x * x + y * y <= 4 && iteration < max_iteration)
-     {
-         xtmp = x * x - y * y + x0;
-         y = 2 * x * y + y0;
-         x = xtmp;
-         iteration += 1;
-     }
-
-     // Convert iteration result to colors
-     half color = (0.5 + 0.5 * cos(3.0 + iteration * 0.15));
-     tex.write(half4(color, color, color, 1.0), index, 0);
+    if (index.x >= params.width || index.y >= params.height)
+    {
+        return;
+    }
+
+    float2 dc = (float2(index) - 0.5 * float2(params.width, params.height) + 0.5) * params.pixelStep;
+
+    // series approximation for the first skipIterations - coefficients are scaled by radius^k
+    float2 u = dc / params.radius;
+    float2 u2 = complexMul(u, u);
+    float2 u3 = complexMul(u2, u);
+    float2 d = complexMul(float2(params.seriesA[0], params.seriesA[1]), u)
+             + complexMul(float2(params.seriesB[0], params.seriesB[1]), u2)
+             + complexMul(float2(params.seriesC[0], params.seriesC[1]), u3);
+
+    uint last = params.orbitLength - 1;
+    uint m = params.skipIterations;
+    uint iteration = params.skipIterations;
+    while (iteration < params.maxIterations)
+    {
+        float2 z = orbit[m] + d;
+        float zMag = dot(z, z);
+        if (zMag > 4)
+        {
+            break;
+        }
+
+        // glitch or end of the reference - rebase onto the start of the orbit
+        if (zMag < dot(d, d) || m == last)
+        {
+            d = z;
+            m = 0;
+        }
+
+        d = 2 * complexMul(orbit[m], d) + complexMul(d, d) + dc;
+        m += 1;
+        iteration += 1;
+    }
+
+    half color = (0.5 + 0.5 * cos(3.0 + iteration * 0.15));
+    tex.write(half4(color, color, color, 1.0), index, 0);
 }
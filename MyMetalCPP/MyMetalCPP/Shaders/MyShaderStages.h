@@ -0,0 +1,96 @@
+//
+//  MyShaderStages.h
+//  MyMetalCPP
+//
+
+#ifndef MyShaderStages_h
+#define MyShaderStages_h
+
+#include "KernelShim.h"
+#include "ShaderStructs.h"
+#include "VertexQuantization.h"
+
+// Shared by MyShader.metal and the software rasterizer (Raster/SoftwareRasterizer.cpp)
+
+// Vertex -> Fragment
+struct v2f
+{
+    float4 position MM_POSITION;
+    float3 normal;
+    half3 color;
+    float2 texcoord;
+    uint material MM_FLAT;
+};
+
+// Vertex
+inline v2f transformVertex( float3 position, float3 normal, float2 texcoord,
+                            MM_DEVICE const InstanceData& instance, MM_DEVICE const CameraData& cameraData )
+{
+    v2f o;
+    
+    float4 pos = float4( position, 1.0 );
+    pos = instance.instanceTransform * pos;
+    pos = cameraData.perspectiveTransform * cameraData.worldTransform * pos;
+    o.position = pos;
+    
+    normal = instance.instanceNormalTransform * normal;
+    normal = cameraData.worldNormalTransform * normal;
+    o.normal = normal;
+    o.texcoord = texcoord;
+    
+    float4 color = instance.instanceColor;
+    o.color = half3( color.x, color.y, color.z );
+    o.material = instance.materialIndex;
+    return o;
+}
+
+MM_VERTEX v2f vertexMain( MM_DEVICE const VertexData* vertexData MM_BUFFER(0),
+                          MM_DEVICE const InstanceData* instanceData MM_BUFFER(1),
+                          MM_DEVICE const CameraData& cameraData MM_BUFFER(2),
+                          uint vertexId MM_VERTEX_ID,
+                          uint instanceId MM_INSTANCE_ID )
+{
+    const MM_DEVICE VertexData& vd = vertexData[ vertexId ];
+    return transformVertex( vd.position, vd.normal, vd.texcoord, instanceData[ instanceId ], cameraData );
+}
+
+// Same stage reading QuantizedVertexData - a third of the vertex fetch bandwidth
+MM_VERTEX v2f vertexMainQuantized( MM_DEVICE const QuantizedVertexData* vertexData MM_BUFFER(0),
+                                   MM_DEVICE const InstanceData* instanceData MM_BUFFER(1),
+                                   MM_DEVICE const CameraData& cameraData MM_BUFFER(2),
+                                   MM_CONSTANT const MeshQuantization& quantization MM_BUFFER(3),
+                                   uint vertexId MM_VERTEX_ID,
+                                   uint instanceId MM_INSTANCE_ID )
+{
+    const MM_DEVICE QuantizedVertexData& vd = vertexData[ vertexId ];
+    float3 position = dequantizePosition( vd.position[0], vd.position[1], vd.position[2],
+                                          quantization.positionOffset, quantization.positionScale );
+    float3 normal = decodeOctahedral( vd.normal );
+    float2 texcoord = dequantizeTexcoord( vd.texcoord[0], vd.texcoord[1],
+                                          quantization.texcoordOffset, quantization.texcoordScale );
+    return transformVertex( position, normal, texcoord, instanceData[ instanceId ], cameraData );
+}
+
+// Fragment
+inline half4 shadeFragment( v2f in, half3 texel )
+{
+    // assume light coming from (front-top-right)
+    float3 l = normalize(float3( 1.0, 1.0, 0.8 ));
+    float3 n = normalize( in.normal );
+    
+    half ndotl = half( saturate( dot( n, l ) ) );
+
+    half3 illum = (in.color * texel * 0.1) + (in.color * texel * ndotl);
+    return half4( illum, 1.0 );
+}
+
+// One texture bound for the whole draw - the software rasterizer's path. Metal draws go through
+// fragmentMainBindless in MyShader.metal
+MM_FRAGMENT half4 fragmentMain( v2f in MM_STAGE_IN, texture2d< half, access::sample> tex MM_TEXTURE(0) )
+{
+    constexpr sampler s( address::repeat, filter::linear, mip_filter::linear );
+    half4 texSample = tex.sample( s, in.texcoord );
+    return shadeFragment( in, half3( texSample.x, texSample.y, texSample.z ) );
+}
+
+#endif /* MyShaderStages_h */
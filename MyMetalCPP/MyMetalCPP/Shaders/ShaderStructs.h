@@ -8,10 +8,12 @@
 #ifndef ShaderStructs_h
 #define ShaderStructs_h
 
-#include <simd/simd.h>
-
 #include "../Maths/MathsTypes.h"
 
+#if !defined( __METAL_VERSION__ )
+#include <stdint.h>
+#endif
+
 struct VertexData
 {
     Vector3f position;
@@ -19,11 +21,34 @@ struct VertexData
     Vector2f texcoord;
 };
 
-struct InstanceData // size 80 bytes
+// 16 bytes instead of 48 - Mesh/VertexQuantization.hpp encodes these, Shaders/VertexQuantization.h decodes
+struct QuantizedVertexData
+{
+    uint16_t position[4];   // xyz unorm16 within the mesh bounds, w unused
+    uint32_t normal;        // octahedral, x and y snorm16
+    uint16_t texcoord[2];   // unorm16 within the mesh texcoord bounds
+};
+
+// Per mesh constants for QuantizedVertexData - value = offset + quantized * scale
+struct MeshQuantization
+{
+    Vector3f positionOffset;
+    Vector3f positionScale;
+    Vector2f texcoordOffset;
+    Vector2f texcoordScale;
+};
+
+struct InstanceData // size 144 bytes
 {
     Matrix44f instanceTransform;
     Matrix33f instanceNormalTransform;
     Vector4f instanceColor;
+    uint32_t materialIndex;     // slot in the bindless material table
+};
+
+struct MaterialData      // what a bindless material points its buffer slot at
+{
+    Vector4f tint;
 };
 
 struct CameraData
@@ -0,0 +1,37 @@
+//
+//  VertexQuantization.h
+//  MyMetalCPP
+//
+
+#ifndef VertexQuantization_h
+#define VertexQuantization_h
+
+#include "KernelShim.h"
+
+// QuantizedVertexData decoding, shared by vertexMainQuantized and the CPU error report in
+// Mesh/VertexQuantization.cpp so the report measures exactly what the GPU sees.
+
+inline float3 dequantizePosition( uint x, uint y, uint z, float3 offset, float3 scale )
+{
+    return offset + float3( float( x ), float( y ), float( z ) ) * scale;
+}
+
+inline float2 dequantizeTexcoord( uint u, uint v, float2 offset, float2 scale )
+{
+    return offset + float2( float( u ), float( v ) ) * scale;
+}
+
+// Octahedral mapping (Cigolle et al. 2014) - the unit sphere projected onto |x|+|y|+|z| = 1,
+// the lower half folded over the diagonals into the corners of the [-1, 1] square
+inline float3 decodeOctahedral( uint packed )
+{
+    float x = max( float( short( packed & 0xffff ) ) / 32767.0f, -1.0f );
+    float y = max( float( short( packed >> 16 ) ) / 32767.0f, -1.0f );
+    float3 n = float3( x, y, 1.0f - fabs( x ) - fabs( y ) );
+    float t = saturate( -n.z );
+    n.x += ( n.x >= 0.0f ) ? -t : t;
+    n.y += ( n.y >= 0.0f ) ? -t : t;
+    return normalize( n );
+}
+
+#endif /* VertexQuantization_h */
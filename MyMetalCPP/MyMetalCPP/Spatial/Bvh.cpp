@@ -0,0 +1,884 @@
+//
+//  Bvh.cpp
+//  MyMetalCPP
+//
+
+#include "Bvh.hpp"
+#include "../Jobs/JobSystem.hpp"
+#include "../Maths/VectorExt.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <math.h>
+
+using Bvh::Aabb;
+using Bvh::BuildOptions;
+
+static constexpr size_t kParallelBinningCount = 64 * 1024;     // nodes this big bin in parallel
+static constexpr size_t kBinningGrain = 16 * 1024;
+static constexpr size_t kParallelSubtreeCount = 4 * 1024;      // and build their two halves as separate jobs
+static constexpr uint32_t kMaxBins = 32;
+static constexpr uint32_t kInvalid = ~0u;
+static constexpr uint32_t kStackSize = 512;
+static constexpr size_t kNodesPerJob = 64;
+static constexpr size_t kRaysPerJob = 256;
+
+namespace
+{
+
+// Children are tested a group of lanes at a time - all 8 of an 8 wide node at once with AVX,
+// otherwise two Float4 groups, which beats the compiler splitting Float8 itself
+template<uint32_t Width> struct Lanes
+{
+    typedef Maths::Float4 Float;
+    typedef Maths::Int4 Int;
+};
+
+#if defined( __AVX__ )
+template<> struct Lanes<8>
+{
+    typedef Maths::Float8 Float;
+    typedef Maths::Int8 Int;
+};
+#endif
+
+// vectors by reference - Float8 by value changes ABI with the target
+template<typename Float>
+inline void loadLanes( Float& v, const float* p )
+{
+    memcpy( &v, p, sizeof( v ) );
+}
+
+template<typename Float, typename Int>
+inline void maxLanes( Float& a, const Float& b )
+{
+    const Int mask = b > a;
+    a = (Float)( ( (Int)b & mask ) | ( (Int)a & ~mask ) );
+}
+
+template<typename Float, typename Int>
+inline void minLanes( Float& a, const Float& b )
+{
+    const Int mask = b < a;
+    a = (Float)( ( (Int)b & mask ) | ( (Int)a & ~mask ) );
+}
+
+Aabb emptyBox()
+{
+    return { { INFINITY, INFINITY, INFINITY }, { -INFINITY, -INFINITY, -INFINITY } };
+}
+
+void grow( Aabb& box, const Aabb& other )
+{
+    for ( int a = 0; a < 3; ++a )
+    {
+        box.min[a] = std::min( box.min[a], other.min[a] );
+        box.max[a] = std::max( box.max[a], other.max[a] );
+    }
+}
+
+void grow( Aabb& box, const float p[3] )
+{
+    for ( int a = 0; a < 3; ++a )
+    {
+        box.min[a] = std::min( box.min[a], p[a] );
+        box.max[a] = std::max( box.max[a], p[a] );
+    }
+}
+
+float area( const Aabb& box )
+{
+    const float dx = box.max[0] - box.min[0];
+    const float dy = box.max[1] - box.min[1];
+    const float dz = box.max[2] - box.min[2];
+    return dx < 0.f ? 0.f : 2.f * ( dx * dy + dy * dz + dz * dx );
+}
+
+bool outsidePlanes( const Aabb& box, const Vector4f planes[6] )
+{
+    for ( int p = 0; p < 6; ++p )
+    {
+        const Vector4f plane = planes[p];
+        const float x = plane.x >= 0.f ? box.max[0] : box.min[0];
+        const float y = plane.y >= 0.f ? box.max[1] : box.min[1];
+        const float z = plane.z >= 0.f ? box.max[2] : box.min[2];
+        if ( plane.x * x + plane.y * y + plane.z * z + plane.w < 0.f )
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct BuildNode
+{
+    Aabb box;
+    uint32_t left;          // kInvalid for leaves, the right child is left + 1
+    uint32_t first;
+    uint32_t count;
+};
+
+// Boxes in Float4 lanes for the builder, w unused
+struct Bounds
+{
+    Maths::Float4 min;
+    Maths::Float4 max;
+};
+
+Bounds emptyBounds()
+{
+    return { Maths::splat( INFINITY ), Maths::splat( -INFINITY ) };
+}
+
+void grow( Bounds& bounds, const Bounds& other )
+{
+    minLanes<Maths::Float4, Maths::Int4>( bounds.min, other.min );
+    maxLanes<Maths::Float4, Maths::Int4>( bounds.max, other.max );
+}
+
+void grow( Bounds& bounds, const Maths::Float4& p )
+{
+    minLanes<Maths::Float4, Maths::Int4>( bounds.min, p );
+    maxLanes<Maths::Float4, Maths::Int4>( bounds.max, p );
+}
+
+float area( const Bounds& bounds )
+{
+    const Maths::Float4 d = bounds.max - bounds.min;
+    return d[0] < 0.f ? 0.f : 2.f * ( d[0] * d[1] + d[1] * d[2] + d[2] * d[0] );
+}
+
+Aabb toAabb( const Bounds& bounds )
+{
+    return { { bounds.min[0], bounds.min[1], bounds.min[2] }, { bounds.max[0], bounds.max[1], bounds.max[2] } };
+}
+
+struct Bin
+{
+    Bounds box;
+    uint32_t count;
+};
+
+// Binned SAH build of a binary tree, primitives reordered so every node covers a contiguous
+// range. The primitive boxes are reordered along with the indices, so binning reads memory in order
+class BinaryBuilder
+{
+public:
+    BinaryBuilder( const Aabb* pBoxes, size_t count, const BuildOptions& options )
+    : _options( options )
+    , _nodes( std::max<size_t>( 1, count * 2 ) )
+    , _centroidBounds( _nodes.size() )
+    , _references( count )
+    , _primitives( count )
+    , _nodeCount( 1 )
+    {
+        assert( options.binCount >= 2 && options.binCount <= kMaxBins );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            const Aabb& box = pBoxes[i];
+            _references[i] = { Maths::Float4{ box.min[0], box.min[1], box.min[2], 0.f }, Maths::Float4{ box.max[0], box.max[1], box.max[2], 0.f } };
+            _primitives[i] = (uint32_t)i;
+        }
+    }
+
+    void build()
+    {
+        Bounds box = emptyBounds();
+        Bounds centroids = emptyBounds();
+        for ( const Bounds& reference : _references )
+        {
+            grow( box, reference );
+            grow( centroids, ( reference.min + reference.max ) * 0.5f );
+        }
+        _nodes[0] = { toAabb( box ), kInvalid, 0, (uint32_t)_primitives.size() };
+        _centroidBounds[0] = centroids;
+        buildNode( 0 );
+        _nodes.resize( _nodeCount );
+    }
+
+    const std::vector<BuildNode>& nodes() const { return _nodes; }
+    std::vector<uint32_t>& primitives() { return _primitives; }
+
+private:
+    // bin of the centroid along each axis
+    static Maths::Int4 binIndices( const Bounds& reference, const Maths::Float4& origin, const Maths::Float4& scale, uint32_t binCount )
+    {
+        const Maths::Float4 centroid = ( reference.min + reference.max ) * 0.5f;
+        Maths::Int4 bin = __builtin_convertvector( ( centroid - origin ) * scale, Maths::Int4 );
+        bin &= ~( bin < 0 );
+        const Maths::Int4 over = bin > (int32_t)binCount - 1;
+        return ( bin & ~over ) | ( ( (int32_t)binCount - 1 ) & over );
+    }
+
+    void binRange( uint32_t first, uint32_t count, const Maths::Float4& origin, const Maths::Float4& scale, uint32_t binCount, Bin* pBins ) const
+    {
+        for ( uint32_t b = 0; b < binCount * 3; ++b )
+        {
+            pBins[b] = { emptyBounds(), 0 };
+        }
+        for ( uint32_t i = first; i < first + count; ++i )
+        {
+            const Bounds& reference = _references[i];
+            const Maths::Int4 bin = binIndices( reference, origin, scale, binCount );
+            for ( int axis = 0; axis < 3; ++axis )
+            {
+                Bin& axisBin = pBins[ axis * binCount + bin[ axis ] ];
+                grow( axisBin.box, reference );
+                ++axisBin.count;
+            }
+        }
+    }
+
+    void buildNode( uint32_t index )
+    {
+        const BuildNode node = _nodes[ index ];
+        const Bounds& centroids = _centroidBounds[ index ];
+        if ( node.count <= 1 )
+        {
+            return;
+        }
+
+        // small nodes don't need many bins, and initializing and sweeping them is most of their cost
+        const uint32_t binCount = std::min( _options.binCount, std::max( 4u, node.count ) );
+        const Maths::Float4 origin = centroids.min;
+        Maths::Float4 scale;
+        for ( int axis = 0; axis < 4; ++axis )
+        {
+            const float extent = centroids.max[ axis ] - centroids.min[ axis ];
+            scale[ axis ] = axis < 3 && extent > 0.f ? binCount / extent : 0.f;
+        }
+
+        Bin bins[ 3 * kMaxBins ];
+        if ( node.count >= kParallelBinningCount )
+        {
+            const size_t chunkCount = ( node.count + kBinningGrain - 1 ) / kBinningGrain;
+            std::vector<Bin> chunkBins( chunkCount * 3 * binCount );
+            JobSystem::Instance()->parallelFor( node.count, kBinningGrain, [&]( size_t begin, size_t end )
+            {
+                binRange( node.first + (uint32_t)begin, (uint32_t)( end - begin ), origin, scale, binCount, &chunkBins[ begin / kBinningGrain * 3 * binCount ] );
+            } );
+            for ( uint32_t b = 0; b < binCount * 3; ++b )
+            {
+                bins[b] = chunkBins[b];
+                for ( size_t chunk = 1; chunk < chunkCount; ++chunk )
+                {
+                    const Bin& other = chunkBins[ chunk * 3 * binCount + b ];
+                    grow( bins[b].box, other.box );
+                    bins[b].count += other.count;
+                }
+            }
+        }
+        else
+        {
+            binRange( node.first, node.count, origin, scale, binCount, bins );
+        }
+
+        // sweep every axis for the cheapest split, cost relative to one primitive test
+        const float invArea = 1.f / std::max( area( node.box ), 1e-30f );
+        float bestCost = INFINITY;
+        int bestAxis = -1;
+        uint32_t bestSplit = 0;
+        for ( int axis = 0; axis < 3; ++axis )
+        {
+            if ( scale[ axis ] == 0.f )
+            {
+                continue;
+            }
+            const Bin* pAxisBins = &bins[ axis * binCount ];
+            float rightArea[ kMaxBins ];
+            uint32_t rightCount[ kMaxBins ];
+            Bounds box = emptyBounds();
+            uint32_t count = 0;
+            for ( uint32_t b = binCount - 1; b > 0; --b )
+            {
+                grow( box, pAxisBins[b].box );
+                count += pAxisBins[b].count;
+                rightArea[b] = area( box );
+                rightCount[b] = count;
+            }
+            box = emptyBounds();
+            count = 0;
+            for ( uint32_t split = 1; split < binCount; ++split )
+            {
+                grow( box, pAxisBins[ split - 1 ].box );
+                count += pAxisBins[ split - 1 ].count;
+                if ( count == 0 || rightCount[ split ] == 0 )
+                {
+                    continue;
+                }
+                const float cost = _options.traversalCost + ( area( box ) * count + rightArea[ split ] * rightCount[ split ] ) * invArea;
+                if ( cost < bestCost )
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = split;
+                }
+            }
+        }
+
+        if ( node.count <= _options.maxLeafSize && ( bestAxis < 0 || bestCost >= node.count ) )
+        {
+            return;
+        }
+
+        uint32_t leftCount;
+        Bounds leftBox = emptyBounds();
+        Bounds rightBox = emptyBounds();
+        Bounds leftCentroids = emptyBounds();
+        Bounds rightCentroids = emptyBounds();
+        if ( bestAxis >= 0 )
+        {
+            uint32_t i = node.first;
+            uint32_t j = node.first + node.count;
+            while ( i < j )
+            {
+                const Maths::Float4 centroid = ( _references[i].min + _references[i].max ) * 0.5f;
+                if ( (uint32_t)binIndices( _references[i], origin, scale, binCount )[ bestAxis ] < bestSplit )
+                {
+                    grow( leftCentroids, centroid );
+                    ++i;
+                }
+                else
+                {
+                    grow( rightCentroids, centroid );
+                    --j;
+                    std::swap( _references[i], _references[j] );
+                    std::swap( _primitives[i], _primitives[j] );
+                }
+            }
+            leftCount = i - node.first;
+            for ( uint32_t b = 0; b < binCount; ++b )
+            {
+                grow( b < bestSplit ? leftBox : rightBox, bins[ bestAxis * binCount + b ].box );
+            }
+        }
+        else
+        {
+            // every centroid in the same place - halve the range as it is
+            leftCount = node.count / 2;
+            for ( uint32_t i = node.first; i < node.first + node.count; ++i )
+            {
+                const Bounds& reference = _references[i];
+                grow( i < node.first + leftCount ? leftBox : rightBox, reference );
+                grow( i < node.first + leftCount ? leftCentroids : rightCentroids, ( reference.min + reference.max ) * 0.5f );
+            }
+        }
+
+        const uint32_t child = _nodeCount.fetch_add( 2 );
+        _nodes[ child ] = { toAabb( leftBox ), kInvalid, node.first, leftCount };
+        _nodes[ child + 1 ] = { toAabb( rightBox ), kInvalid, node.first + leftCount, node.count - leftCount };
+        _centroidBounds[ child ] = leftCentroids;
+        _centroidBounds[ child + 1 ] = rightCentroids;
+        _nodes[ index ].left = child;
+
+        if ( node.count >= kParallelSubtreeCount )
+        {
+            JobSystem::Instance()->parallelFor( 2, 1, [&]( size_t begin, size_t end )
+            {
+                for ( size_t i = begin; i < end; ++i )
+                {
+                    buildNode( child + (uint32_t)i );
+                }
+            } );
+        }
+        else
+        {
+            buildNode( child );
+            buildNode( child + 1 );
+        }
+    }
+
+    BuildOptions _options;
+    std::vector<BuildNode> _nodes;
+    std::vector<Bounds> _centroidBounds;
+    std::vector<Bounds> _references;            // primitive boxes, in the current order
+    std::vector<uint32_t> _primitives;
+    std::atomic<uint32_t> _nodeCount;
+};
+
+}
+
+namespace Bvh
+{
+
+Ray makeCameraRay( const CameraData& camera, float ndcX, float ndcY )
+{
+    // view space direction, then back through the rigid worldTransform
+    const Matrix44f& projection = camera.perspectiveTransform;
+    const float view[3] = { ndcX / projection.columns[0].x, ndcY / projection.columns[1].y, -1.f };
+    const Matrix44f& m = camera.worldTransform;
+    const Vector4f t = m.columns[3];
+
+    Ray ray;
+    for ( int a = 0; a < 3; ++a )
+    {
+        const Vector4f c = m.columns[a];
+        ray.origin[a] = -( c.x * t.x + c.y * t.y + c.z * t.z );
+        ray.direction[a] = c.x * view[0] + c.y * view[1] + c.z * view[2];
+    }
+    ray.tMax = INFINITY;
+    return ray;
+}
+
+template<uint32_t Width>
+Tree<Width>::Tree()
+{
+}
+
+template<uint32_t Width>
+BuildStats Tree<Width>::buildFromBoxes( const Aabb* pBoxes, size_t count, const BuildOptions& options )
+{
+    BuildStats stats = {};
+    _nodes.clear();
+    _levelStart.clear();
+    _primitives.clear();
+    if ( count == 0 )
+    {
+        return stats;
+    }
+
+    BinaryBuilder builder( pBoxes, count, options );
+    builder.build();
+    const std::vector<BuildNode>& binary = builder.nodes();
+    _primitives.swap( builder.primitives() );
+    stats.binaryNodes = binary.size();
+
+    // collapse breadth first - each wide node takes its binary node's children and keeps opening
+    // the largest until it has Width of them
+    std::vector<uint32_t> pending = { 0 };
+    std::vector<uint32_t> depth = { 0 };
+    const float invRootArea = 1.f / std::max( area( binary[0].box ), 1e-30f );
+    for ( size_t i = 0; i < pending.size(); ++i )
+    {
+        if ( i == 0 || depth[i] != depth[ i - 1 ] )
+        {
+            _levelStart.push_back( (uint32_t)i );
+        }
+
+        const BuildNode& source = binary[ pending[i] ];
+        uint32_t entries[ Width ];
+        uint32_t entryCount = 0;
+        if ( source.left == kInvalid )
+        {
+            entries[ entryCount++ ] = pending[i];     // the root is a leaf
+        }
+        else
+        {
+            entries[ entryCount++ ] = source.left;
+            entries[ entryCount++ ] = source.left + 1;
+            while ( entryCount < Width )
+            {
+                int largest = -1;
+                float largestArea = -1.f;
+                for ( uint32_t e = 0; e < entryCount; ++e )
+                {
+                    const BuildNode& entry = binary[ entries[e] ];
+                    if ( entry.left != kInvalid && area( entry.box ) > largestArea )
+                    {
+                        largest = (int)e;
+                        largestArea = area( entry.box );
+                    }
+                }
+                if ( largest < 0 )
+                {
+                    break;
+                }
+                const uint32_t opened = binary[ entries[ largest ] ].left;
+                entries[ largest ] = opened;
+                entries[ entryCount++ ] = opened + 1;
+            }
+        }
+
+        Node node;
+        stats.sahCost += options.traversalCost * area( source.box ) * invRootArea;
+        for ( uint32_t k = 0; k < Width; ++k )
+        {
+            for ( int a = 0; a < 3; ++a )
+            {
+                node.bounds[a][k] = INFINITY;
+                node.bounds[ 3 + a ][k] = -INFINITY;
+            }
+            node.child[k] = kEmpty;
+            node.first[k] = 0;
+            node.count[k] = 0;
+            if ( k >= entryCount )
+            {
+                continue;
+            }
+
+            const BuildNode& entry = binary[ entries[k] ];
+            for ( int a = 0; a < 3; ++a )
+            {
+                node.bounds[a][k] = entry.box.min[a];
+                node.bounds[ 3 + a ][k] = entry.box.max[a];
+            }
+            node.first[k] = entry.first;
+            node.count[k] = entry.count;
+            if ( entry.left == kInvalid )
+            {
+                node.child[k] = kLeaf;
+                stats.sahCost += area( entry.box ) * invRootArea * entry.count;
+                ++stats.leaves;
+            }
+            else
+            {
+                node.child[k] = (uint32_t)pending.size();
+                pending.push_back( entries[k] );
+                depth.push_back( depth[i] + 1 );
+            }
+        }
+        _nodes.push_back( node );
+    }
+    _levelStart.push_back( (uint32_t)_nodes.size() );
+
+    stats.nodes = _nodes.size();
+    stats.depth = (uint32_t)_levelStart.size() - 1;
+    return stats;
+}
+
+template<uint32_t Width>
+BuildStats Tree<Width>::build( const Aabb* pBoxes, size_t count, const BuildOptions& options )
+{
+    const BuildStats stats = buildFromBoxes( pBoxes, count, options );
+    _triangles.clear();
+    _boxes.resize( count );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        _boxes[i] = pBoxes[ _primitives[i] ];
+    }
+    return stats;
+}
+
+template<uint32_t Width>
+BuildStats Tree<Width>::build( const uint32_t* pIndices, size_t indexCount, const VertexData* pVertices, const BuildOptions& options )
+{
+    const size_t count = indexCount / 3;
+    std::vector<Aabb> boxes( count );
+    JobSystem::Instance()->parallelFor( count, 16 * 1024, [&]( size_t begin, size_t end )
+    {
+        for ( size_t t = begin; t < end; ++t )
+        {
+            boxes[t] = emptyBox();
+            for ( int k = 0; k < 3; ++k )
+            {
+                const Vector3f& p = pVertices[ pIndices[ t * 3 + k ] ].position;
+                const float point[3] = { p.x, p.y, p.z };
+                grow( boxes[t], point );
+            }
+        }
+    } );
+
+    const BuildStats stats = buildFromBoxes( boxes.data(), count, options );
+    _boxes.clear();
+    _triangles.resize( count * 9 );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        for ( int k = 0; k < 3; ++k )
+        {
+            const Vector3f& p = pVertices[ pIndices[ _primitives[i] * 3 + k ] ].position;
+            _triangles[ i * 9 + k * 3 + 0 ] = p.x;
+            _triangles[ i * 9 + k * 3 + 1 ] = p.y;
+            _triangles[ i * 9 + k * 3 + 2 ] = p.z;
+        }
+    }
+    return stats;
+}
+
+template<uint32_t Width>
+void Tree<Width>::refit( const Aabb* pBoxes )
+{
+    assert( _triangles.empty() && _boxes.size() == _primitives.size() );
+    JobSystem::Instance()->parallelFor( _boxes.size(), 16 * 1024, [&]( size_t begin, size_t end )
+    {
+        for ( size_t i = begin; i < end; ++i )
+        {
+            _boxes[i] = pBoxes[ _primitives[i] ];
+        }
+    } );
+
+    // deepest level first, every child node's bounds are final by the time its parent reads them
+    for ( size_t level = _levelStart.size() - 1; level-- > 0; )
+    {
+        JobSystem::Instance()->parallelFor( _levelStart[ level + 1 ] - _levelStart[ level ], kNodesPerJob, [&]( size_t begin, size_t end )
+        {
+            for ( size_t n = _levelStart[ level ] + begin; n < _levelStart[ level ] + end; ++n )
+            {
+                Node& node = _nodes[n];
+                for ( uint32_t k = 0; k < Width; ++k )
+                {
+                    if ( node.child[k] == kEmpty )
+                    {
+                        continue;
+                    }
+                    Aabb box = emptyBox();
+                    if ( node.child[k] == kLeaf )
+                    {
+                        for ( uint32_t i = node.first[k]; i < node.first[k] + node.count[k]; ++i )
+                        {
+                            grow( box, _boxes[i] );
+                        }
+                    }
+                    else
+                    {
+                        const Node& child = _nodes[ node.child[k] ];
+                        for ( uint32_t c = 0; c < Width && child.child[c] != kEmpty; ++c )
+                        {
+                            const Aabb childBox = { { child.bounds[0][c], child.bounds[1][c], child.bounds[2][c] },
+                                                    { child.bounds[3][c], child.bounds[4][c], child.bounds[5][c] } };
+                            grow( box, childBox );
+                        }
+                    }
+                    for ( int a = 0; a < 3; ++a )
+                    {
+                        node.bounds[a][k] = box.min[a];
+                        node.bounds[ 3 + a ][k] = box.max[a];
+                    }
+                }
+            }
+        } );
+    }
+}
+
+template<uint32_t Width>
+void Tree<Width>::queryFrustum( const Vector4f planes[6], std::vector<uint32_t>& primitives ) const
+{
+    typedef typename Lanes<Width>::Float Float;
+    typedef typename Lanes<Width>::Int Int;
+    constexpr uint32_t kGroup = sizeof( Float ) / sizeof( float );
+
+    primitives.clear();
+    if ( _nodes.empty() )
+    {
+        return;
+    }
+
+    uint32_t stack[ kStackSize ];
+    uint32_t stackSize = 0;
+    stack[ stackSize++ ] = 0;
+    while ( stackSize > 0 )
+    {
+        const Node& node = _nodes[ stack[ --stackSize ] ];
+        int32_t outside[ Width ];
+        int32_t inside[ Width ];
+        for ( uint32_t g = 0; g < Width; g += kGroup )
+        {
+            Int groupOutside = Int{} != Int{};      // all false
+            Int groupInside = Int{} == Int{};       // all true
+            for ( int p = 0; p < 6; ++p )
+            {
+                // distance of the box corner furthest along the plane normal, and the nearest
+                const Vector4f plane = planes[p];
+                Float farX, farY, farZ, nearX, nearY, nearZ;
+                loadLanes( farX, &node.bounds[ plane.x >= 0.f ? 3 : 0 ][g] );
+                loadLanes( farY, &node.bounds[ plane.y >= 0.f ? 4 : 1 ][g] );
+                loadLanes( farZ, &node.bounds[ plane.z >= 0.f ? 5 : 2 ][g] );
+                loadLanes( nearX, &node.bounds[ plane.x >= 0.f ? 0 : 3 ][g] );
+                loadLanes( nearY, &node.bounds[ plane.y >= 0.f ? 1 : 4 ][g] );
+                loadLanes( nearZ, &node.bounds[ plane.z >= 0.f ? 2 : 5 ][g] );
+                groupOutside |= farX * plane.x + farY * plane.y + farZ * plane.z + plane.w < 0.f;
+                groupInside &= nearX * plane.x + nearY * plane.y + nearZ * plane.z + plane.w >= 0.f;
+            }
+            memcpy( &outside[g], &groupOutside, sizeof( groupOutside ) );
+            memcpy( &inside[g], &groupInside, sizeof( groupInside ) );
+        }
+
+        for ( uint32_t k = 0; k < Width; ++k )
+        {
+            if ( node.child[k] == kEmpty || outside[k] )
+            {
+                continue;
+            }
+            if ( inside[k] )
+            {
+                primitives.insert( primitives.end(), &_primitives[ node.first[k] ], &_primitives[ node.first[k] ] + node.count[k] );
+            }
+            else if ( node.child[k] == kLeaf )
+            {
+                for ( uint32_t i = node.first[k]; i < node.first[k] + node.count[k]; ++i )
+                {
+                    if ( _boxes.empty() || !outsidePlanes( _boxes[i], planes ) )
+                    {
+                        primitives.push_back( _primitives[i] );
+                    }
+                }
+            }
+            else
+            {
+                assert( stackSize < kStackSize );
+                stack[ stackSize++ ] = node.child[k];
+            }
+        }
+    }
+}
+
+template<uint32_t Width>
+bool Tree<Width>::intersectLeaf( const Ray& ray, const float invDirection[3], uint32_t first, uint32_t count, Hit& hit ) const
+{
+    bool found = false;
+    for ( uint32_t i = first; i < first + count; ++i )
+    {
+        if ( !_triangles.empty() )
+        {
+            // Moller-Trumbore
+            const float* v = &_triangles[ i * 9 ];
+            const float e1[3] = { v[3] - v[0], v[4] - v[1], v[5] - v[2] };
+            const float e2[3] = { v[6] - v[0], v[7] - v[1], v[8] - v[2] };
+            const float* d = ray.direction;
+            const float p[3] = { d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0] };
+            const float det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+            if ( fabsf( det ) < 1e-12f )
+            {
+                continue;
+            }
+            const float invDet = 1.f / det;
+            const float s[3] = { ray.origin[0] - v[0], ray.origin[1] - v[1], ray.origin[2] - v[2] };
+            const float u = ( s[0] * p[0] + s[1] * p[1] + s[2] * p[2] ) * invDet;
+            if ( u < 0.f || u > 1.f )
+            {
+                continue;
+            }
+            const float q[3] = { s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0] };
+            const float w = ( d[0] * q[0] + d[1] * q[1] + d[2] * q[2] ) * invDet;
+            if ( w < 0.f || u + w > 1.f )
+            {
+                continue;
+            }
+            const float t = ( e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2] ) * invDet;
+            if ( t > 0.f && t < hit.t )
+            {
+                hit = { t, _primitives[i], u, w };
+                found = true;
+            }
+        }
+        else
+        {
+            const Aabb& box = _boxes[i];
+            float enter = 0.f;
+            float exit = hit.t;
+            for ( int a = 0; a < 3; ++a )
+            {
+                const float t0 = ( box.min[a] - ray.origin[a] ) * invDirection[a];
+                const float t1 = ( box.max[a] - ray.origin[a] ) * invDirection[a];
+                enter = std::max( enter, std::min( t0, t1 ) );
+                exit = std::min( exit, std::max( t0, t1 ) );
+            }
+            if ( enter <= exit && enter < hit.t )
+            {
+                hit = { enter, _primitives[i], 0.f, 0.f };
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+template<uint32_t Width>
+bool Tree<Width>::raycast( const Ray& ray, Hit& hit ) const
+{
+    typedef typename Lanes<Width>::Float Float;
+    typedef typename Lanes<Width>::Int Int;
+    constexpr uint32_t kGroup = sizeof( Float ) / sizeof( float );
+
+    hit = { ray.tMax, kNoHit, 0.f, 0.f };
+    if ( _nodes.empty() )
+    {
+        return false;
+    }
+
+    // slabs by direction sign, so the near plane is always min or always max per axis and empty
+    // children (min +inf, max -inf) never pass
+    float invDirection[3];
+    int nearRow[3];
+    for ( int a = 0; a < 3; ++a )
+    {
+        const float d = fabsf( ray.direction[a] ) > 1e-20f ? ray.direction[a] : copysignf( 1e-20f, ray.direction[a] );
+        invDirection[a] = 1.f / d;
+        nearRow[a] = d >= 0.f ? a : 3 + a;
+    }
+
+    struct Entry
+    {
+        uint32_t node;
+        float t;
+    };
+    Entry stack[ kStackSize ];
+    uint32_t stackSize = 0;
+    stack[ stackSize++ ] = { 0, 0.f };
+    bool found = false;
+    while ( stackSize > 0 )
+    {
+        const Entry entry = stack[ --stackSize ];
+        if ( entry.t > hit.t )
+        {
+            continue;
+        }
+        const Node& node = _nodes[ entry.node ];
+        float enter[ Width ];
+        int32_t hitMask[ Width ];
+        for ( uint32_t g = 0; g < Width; g += kGroup )
+        {
+            Float groupEnter = Float{};
+            Float groupExit = Float{} + hit.t;
+            for ( int a = 0; a < 3; ++a )
+            {
+                Float tNear, tFar;
+                loadLanes( tNear, &node.bounds[ nearRow[a] ][g] );
+                loadLanes( tFar, &node.bounds[ ( nearRow[a] + 3 ) % 6 ][g] );
+                maxLanes<Float, Int>( groupEnter, ( tNear - ray.origin[a] ) * invDirection[a] );
+                minLanes<Float, Int>( groupExit, ( tFar - ray.origin[a] ) * invDirection[a] );
+            }
+            const Int groupHit = groupEnter <= groupExit;
+            memcpy( &enter[g], &groupEnter, sizeof( groupEnter ) );
+            memcpy( &hitMask[g], &groupHit, sizeof( groupHit ) );
+        }
+
+        // leaves straight away, nodes onto the stack furthest first
+        Entry children[ Width ];
+        uint32_t childCount = 0;
+        for ( uint32_t k = 0; k < Width; ++k )
+        {
+            if ( !hitMask[k] || node.child[k] == kEmpty )
+            {
+                continue;
+            }
+            if ( node.child[k] == kLeaf )
+            {
+                found = intersectLeaf( ray, invDirection, node.first[k], node.count[k], hit ) || found;
+            }
+            else
+            {
+                uint32_t c = childCount++;
+                for ( ; c > 0 && children[ c - 1 ].t < enter[k]; --c )
+                {
+                    children[c] = children[ c - 1 ];
+                }
+                children[c] = { node.child[k], enter[k] };
+            }
+        }
+        assert( stackSize + childCount <= kStackSize );
+        for ( uint32_t c = 0; c < childCount; ++c )
+        {
+            stack[ stackSize++ ] = children[c];
+        }
+    }
+    return found;
+}
+
+template<uint32_t Width>
+void Tree<Width>::raycast( const Ray* pRays, Hit* pHits, size_t count ) const
+{
+    JobSystem::Instance()->parallelFor( count, kRaysPerJob, [&]( size_t begin, size_t end )
+    {
+        for ( size_t i = begin; i < end; ++i )
+        {
+            raycast( pRays[i], pHits[i] );
+        }
+    } );
+}
+
+template class Tree<4>;
+template class Tree<8>;
+
+}
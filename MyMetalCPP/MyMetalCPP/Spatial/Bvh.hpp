@@ -0,0 +1,131 @@
+//
+//  Bvh.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Shaders/ShaderStructs.h"
+
+// Bounding volume hierarchy over boxes (instances) or triangles, for frustum queries, ray
+// casts and picking on the CPU.
+//
+// The build is binned SAH (Wald 2007): each node's primitives are binned by centroid along all
+// three axes and split where the surface area heuristic is cheapest. Big nodes bin in parallel
+// and the two halves of a split build as separate jobs, so the whole thing runs on the
+// JobSystem. The binary tree is then collapsed into a Width wide one (4 or 8) by repeatedly
+// opening the largest child, and stored breadth first with each node's child boxes as arrays
+// per axis - one node tests its children 4 at a time with Maths::Float4, or all 8 at once with
+// Float8 when built for AVX. The wider tree is shallower and usually the faster of the two.
+//
+// Every primitive sits in exactly one leaf and each subtree covers a contiguous range of the
+// leaf order, so a node entirely inside the frustum adds its whole range without descending.
+//
+// refit() takes new boxes for the same primitives and recomputes the node bounds bottom up,
+// level by level in parallel - for animated instances, where rebuilding every frame would
+// cost more than the slightly looser tree.
+
+namespace Bvh
+{
+    struct Aabb
+    {
+        float min[3];
+        float max[3];
+    };
+
+    struct Ray
+    {
+        float origin[3];
+        float direction[3];     // needn't be normalized, t is in units of it
+        float tMax;
+    };
+
+    struct Hit
+    {
+        float t;
+        uint32_t primitive;     // instance or triangle index, kNoHit if nothing was hit
+        float u, v;             // barycentrics on triangle trees
+    };
+
+    static constexpr uint32_t kNoHit = ~0u;
+
+    struct BuildOptions
+    {
+        uint32_t binCount = 16;
+        uint32_t maxLeafSize = 4;
+        float traversalCost = 1.f;      // relative to one primitive test
+    };
+
+    struct BuildStats
+    {
+        size_t binaryNodes;
+        size_t nodes;
+        size_t leaves;
+        uint32_t depth;
+        float sahCost;                  // expected primitive tests per random ray through the root box
+    };
+
+    // World space ray through a point of the view, ndc x and y in [-1, 1] with y up
+    Ray makeCameraRay( const CameraData& camera, float ndcX, float ndcY );
+
+    template<uint32_t Width>
+    class Tree
+    {
+    public:
+        static_assert( Width == 4 || Width == 8, "4 or 8 wide" );
+
+        Tree();
+
+        // Box tree - rays hit the boxes themselves
+        BuildStats build( const Aabb* pBoxes, size_t count, const BuildOptions& options = BuildOptions() );
+
+        // Triangle tree over an indexed mesh, primitive i is triangle i
+        BuildStats build( const uint32_t* pIndices, size_t indexCount, const VertexData* pVertices,
+                          const BuildOptions& options = BuildOptions() );
+
+        // New boxes for the primitives of a box tree, in the order given to build
+        void refit( const Aabb* pBoxes );
+
+        // Primitives whose boxes touch the frustum (planes as Maths::extractFrustumPlanes), in no particular order
+        void queryFrustum( const Vector4f planes[6], std::vector<uint32_t>& primitives ) const;
+
+        // Closest hit within ray.tMax
+        bool raycast( const Ray& ray, Hit& hit ) const;
+
+        // One job per batch of rays
+        void raycast( const Ray* pRays, Hit* pHits, size_t count ) const;
+
+        size_t nodeCount() const { return _nodes.size(); }
+        size_t primitiveCount() const { return _primitives.size(); }
+
+    private:
+        static constexpr uint32_t kEmpty = ~0u;
+        static constexpr uint32_t kLeaf = 0x8000'0000u;
+
+        // Child k is empty (kEmpty), a leaf (kLeaf, primitives [ first, first + count ) of the
+        // leaf order) or a node, with first / count the range its subtree covers
+        struct Node
+        {
+            float bounds[6][ Width ];       // min x, y, z then max x, y, z
+            uint32_t child[ Width ];
+            uint32_t first[ Width ];
+            uint32_t count[ Width ];
+        };
+
+        BuildStats buildFromBoxes( const Aabb* pBoxes, size_t count, const BuildOptions& options );
+        bool intersectLeaf( const Ray& ray, const float invDirection[3], uint32_t first, uint32_t count, Hit& hit ) const;
+
+        std::vector<Node> _nodes;               // breadth first, the root is 0
+        std::vector<uint32_t> _levelStart;      // first node of each level, plus the end
+        std::vector<uint32_t> _primitives;      // primitive index per leaf order slot
+        std::vector<Aabb> _boxes;               // box trees, per leaf order slot
+        std::vector<float> _triangles;          // triangle trees, 9 floats per leaf order slot
+    };
+
+    typedef Tree<4> Tree4;
+    typedef Tree<8> Tree8;
+}
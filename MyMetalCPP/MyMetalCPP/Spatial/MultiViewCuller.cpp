@@ -0,0 +1,227 @@
+//
+//  MultiViewCuller.cpp
+//  MyMetalCPP
+//
+
+#include "MultiViewCuller.hpp"
+#include "../Jobs/JobSystem.hpp"
+#include "../Maths/Math.hpp"
+#include "../Maths/VectorExt.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstring>
+#include <math.h>
+
+static constexpr size_t kInstancesPerJob = 1024;
+static constexpr size_t kGatherChunkSize = 16384;
+
+using Maths::Float4;
+using Maths::Int4;
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static Float4 load4( const float* p )
+{
+    Float4 v;
+    memcpy( &v, p, sizeof( v ) );
+    return v;
+}
+
+// Binary reflected Gray code - neighbouring groups differ in one view, so each view's groups
+// come in fewer runs than in counting order
+static uint32_t groupMask( uint32_t slot )
+{
+    return slot ^ ( slot >> 1 );
+}
+
+MultiViewCuller::MultiViewCuller()
+: _viewCount( 0 )
+, _stats()
+{
+    memset( _groupFirst, 0, sizeof( _groupFirst ) );
+    memset( _groupCount, 0, sizeof( _groupCount ) );
+}
+
+void MultiViewCuller::setViews( const Matrix44f* pClipFromWorld, uint32_t viewCount )
+{
+    assert( viewCount >= 1 && viewCount <= kMaxViews );
+    _viewCount = viewCount;
+    for ( uint32_t v = 0; v < kMaxViews; ++v )
+    {
+        Vector4f planes[6];
+        if ( v < viewCount )
+        {
+            Maths::extractFrustumPlanes( pClipFromWorld[v], planes );
+        }
+        for ( int p = 0; p < 6; ++p )
+        {
+            // unused lanes get planes nothing is outside of, their bits are masked off anyway
+            _planeX[p][v] = v < viewCount ? planes[p].x : 0.f;
+            _planeY[p][v] = v < viewCount ? planes[p].y : 0.f;
+            _planeZ[p][v] = v < viewCount ? planes[p].z : 0.f;
+            _planeW[p][v] = v < viewCount ? planes[p].w : 1.f;
+        }
+    }
+}
+
+const std::vector<uint8_t>& MultiViewCuller::cull( const InstanceData* pInstances, size_t count, const float boxMin[3], const float boxMax[3] )
+{
+    assert( _viewCount > 0 );
+    const auto start = std::chrono::steady_clock::now();
+    _masks.resize( count );
+
+    Float4 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+    for ( int p = 0; p < 6; ++p )
+    {
+        planeX[p] = load4( _planeX[p] );
+        planeY[p] = load4( _planeY[p] );
+        planeZ[p] = load4( _planeZ[p] );
+        planeW[p] = load4( _planeW[p] );
+        absX[p] = Maths::abs( planeX[p] );
+        absY[p] = Maths::abs( planeY[p] );
+        absZ[p] = Maths::abs( planeZ[p] );
+    }
+    const float center[3] = { ( boxMin[0] + boxMax[0] ) * 0.5f, ( boxMin[1] + boxMax[1] ) * 0.5f, ( boxMin[2] + boxMax[2] ) * 0.5f };
+    const float half[3] = { ( boxMax[0] - boxMin[0] ) * 0.5f, ( boxMax[1] - boxMin[1] ) * 0.5f, ( boxMax[2] - boxMin[2] ) * 0.5f };
+    const uint8_t viewMask = (uint8_t)( ( 1u << _viewCount ) - 1 );
+    const Float4 zero = Maths::splat( 0.f );
+
+    std::vector<size_t> chunkVisible( ( count + kInstancesPerJob - 1 ) / kInstancesPerJob * kMaxViews, 0 );
+    JobSystem::Instance()->parallelFor( count, kInstancesPerJob, [&]( size_t begin, size_t end )
+    {
+        size_t visible[ kMaxViews ] = {};
+        for ( size_t i = begin; i < end; ++i )
+        {
+            // world box - the centre through the transform, the half extents through its absolute value
+            const Matrix44f& m = pInstances[i].instanceTransform;
+            const float* c0 = &m.columns[0].x;
+            const float* c1 = &m.columns[1].x;
+            const float* c2 = &m.columns[2].x;
+            const float* c3 = &m.columns[3].x;
+            float worldCenter[3], worldHalf[3];
+            for ( int a = 0; a < 3; ++a )
+            {
+                worldCenter[a] = c0[a] * center[0] + c1[a] * center[1] + c2[a] * center[2] + c3[a];
+                worldHalf[a] = fabsf( c0[a] ) * half[0] + fabsf( c1[a] ) * half[1] + fabsf( c2[a] ) * half[2];
+            }
+
+            Int4 outside = zero != zero;
+            for ( int p = 0; p < 6; ++p )
+            {
+                const Float4 distance = planeX[p] * worldCenter[0] + planeY[p] * worldCenter[1] + planeZ[p] * worldCenter[2] + planeW[p];
+                const Float4 radius = absX[p] * worldHalf[0] + absY[p] * worldHalf[1] + absZ[p] * worldHalf[2];
+                outside |= distance + radius < zero;
+            }
+            const uint32_t outsideBits = ( outside[0] & 1 ) | ( outside[1] & 2 ) | ( outside[2] & 4 ) | ( outside[3] & 8 );
+            _masks[i] = (uint8_t)( ~outsideBits & viewMask );
+            for ( uint32_t v = 0; v < kMaxViews; ++v )
+            {
+                visible[v] += ( _masks[i] >> v ) & 1;
+            }
+        }
+
+        // calls never overlap, so the first chunk's slot is this call's alone
+        for ( uint32_t v = 0; v < kMaxViews; ++v )
+        {
+            chunkVisible[ begin / kInstancesPerJob * kMaxViews + v ] = visible[v];
+        }
+    } );
+
+    _stats.instances = count;
+    _stats.viewCount = _viewCount;
+    for ( uint32_t v = 0; v < kMaxViews; ++v )
+    {
+        _stats.visible[v] = 0;
+    }
+    for ( size_t c = 0; c < chunkVisible.size(); ++c )
+    {
+        _stats.visible[ c % kMaxViews ] += chunkVisible[c];
+    }
+    _stats.cullMs = elapsedMs( start );
+    return _masks;
+}
+
+size_t MultiViewCuller::gather( const InstanceData* pInstances, InstanceData* pDest )
+{
+    const auto start = std::chrono::steady_clock::now();
+    const size_t count = _masks.size();
+    const size_t chunkCount = std::max<size_t>( 1, ( count + kGatherChunkSize - 1 ) / kGatherChunkSize );
+    _chunkCounts.assign( chunkCount * kMaskCount, 0 );
+
+    JobSystem* pJobs = JobSystem::Instance();
+    pJobs->parallelFor( chunkCount, 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t c = begin; c < end; ++c )
+        {
+            uint32_t* pCounts = _chunkCounts.data() + c * kMaskCount;
+            const size_t last = std::min( count, ( c + 1 ) * kGatherChunkSize );
+            for ( size_t i = c * kGatherChunkSize; i < last; ++i )
+            {
+                ++pCounts[ _masks[i] ];
+            }
+        }
+    } );
+
+    // groups in Gray code order, each split by chunk so the copies stay in instance order
+    uint32_t offset = 0;
+    for ( uint32_t slot = 1; slot < kMaskCount; ++slot )
+    {
+        const uint32_t mask = groupMask( slot );
+        _groupFirst[ mask ] = offset;
+        for ( size_t c = 0; c < chunkCount; ++c )
+        {
+            const uint32_t groupCount = _chunkCounts[ c * kMaskCount + mask ];
+            _chunkCounts[ c * kMaskCount + mask ] = offset;
+            offset += groupCount;
+        }
+        _groupCount[ mask ] = offset - _groupFirst[ mask ];
+    }
+    _groupFirst[0] = offset;
+    _groupCount[0] = 0;
+
+    pJobs->parallelFor( chunkCount, 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t c = begin; c < end; ++c )
+        {
+            uint32_t* pOffsets = _chunkCounts.data() + c * kMaskCount;
+            const size_t last = std::min( count, ( c + 1 ) * kGatherChunkSize );
+            for ( size_t i = c * kGatherChunkSize; i < last; ++i )
+            {
+                const uint8_t mask = _masks[i];
+                if ( mask != 0 )
+                {
+                    memcpy( pDest + pOffsets[ mask ]++, pInstances + i, sizeof( InstanceData ) );
+                }
+            }
+        }
+    } );
+
+    _stats.visibleAny = offset;
+    _stats.gatherMs = elapsedMs( start );
+    return offset;
+}
+
+uint32_t MultiViewCuller::viewRanges( uint32_t view, Range* pRanges ) const
+{
+    uint32_t rangeCount = 0;
+    for ( uint32_t slot = 1; slot < kMaskCount; ++slot )
+    {
+        const uint32_t mask = groupMask( slot );
+        if ( ( mask & ( 1u << view ) ) == 0 || _groupCount[ mask ] == 0 )
+        {
+            continue;
+        }
+        if ( rangeCount > 0 && pRanges[ rangeCount - 1 ].first + pRanges[ rangeCount - 1 ].count == _groupFirst[ mask ] )
+        {
+            pRanges[ rangeCount - 1 ].count += _groupCount[ mask ];
+            continue;
+        }
+        pRanges[ rangeCount++ ] = { _groupFirst[ mask ], _groupCount[ mask ] };
+    }
+    return rangeCount;
+}
@@ -0,0 +1,83 @@
+//
+//  MultiViewCuller.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Shaders/ShaderStructs.h"
+
+// Frustum culling for up to 4 views at once - split screen, or shadow cascades.
+//
+// The planes of all the views are stored plane by plane with one view per lane, so a box is
+// tested against every frustum together with Maths::Float4: the instance's world box is worked
+// out once, and each of the 6 planes is one 4 wide distance and radius against all views. Four
+// views cost about what one does. The result is a mask per instance, bit v set when the box is
+// inside or crossing view v.
+//
+// gather() then writes the instance data once for every view. Instances go out grouped by
+// mask, so every view's visible set is a handful of contiguous ranges - the groups whose mask
+// has its bit - and each view draws those ranges with baseInstance out of the one buffer. The
+// groups are laid out in Gray code order, which keeps the ranges of each view next to each
+// other more often, and viewRanges() joins the ones that touch.
+
+class MultiViewCuller
+{
+public:
+    static constexpr uint32_t kMaxViews = 4;
+    static constexpr uint32_t kMaskCount = 1u << kMaxViews;
+
+    struct Range
+    {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    struct Stats
+    {
+        size_t instances;
+        size_t visible[ kMaxViews ];
+        size_t visibleAny;              // written by gather()
+        uint32_t viewCount;
+        double cullMs;
+        double gatherMs;
+    };
+
+    MultiViewCuller();
+
+    void setViews( const Matrix44f* pClipFromWorld, uint32_t viewCount );
+    uint32_t viewCount() const { return _viewCount; }
+
+    // Tests the object space box through every instance transform, one mask per instance
+    const std::vector<uint8_t>& cull( const InstanceData* pInstances, size_t count, const float boxMin[3], const float boxMax[3] );
+    const std::vector<uint8_t>& masks() const { return _masks; }
+
+    // Copies the instances visible in any view to pDest, grouped by mask, in their original order
+    // within each group. Returns how many were copied
+    size_t gather( const InstanceData* pInstances, InstanceData* pDest );
+
+    // Ranges of the last gather()'s output that view draws, at most kMaskCount / 2 of them.
+    // Returns how many
+    uint32_t viewRanges( uint32_t view, Range* pRanges ) const;
+
+    const Stats& stats() const { return _stats; }
+
+private:
+    // plane p of view v is ( _planeX[p][v], _planeY[p][v], _planeZ[p][v], _planeW[p][v] )
+    float _planeX[6][ kMaxViews ];
+    float _planeY[6][ kMaxViews ];
+    float _planeZ[6][ kMaxViews ];
+    float _planeW[6][ kMaxViews ];
+    uint32_t _viewCount;
+
+    std::vector<uint8_t> _masks;
+    std::vector<uint32_t> _chunkCounts;     // gather scratch, kMaskCount per chunk
+    uint32_t _groupFirst[ kMaskCount ];
+    uint32_t _groupCount[ kMaskCount ];
+
+    Stats _stats;
+};
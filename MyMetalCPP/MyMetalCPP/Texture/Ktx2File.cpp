@@ -0,0 +1,512 @@
+//
+//  Ktx2File.cpp
+//  MyMetalCPP
+//
+
+#include "Ktx2File.hpp"
+#include "MipChain.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+#ifdef MM_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+using Ktx2Format::Header;
+using Ktx2Format::LevelIndex;
+using Ktx2Format::Supercompression;
+using Ktx2Format::VkFormat;
+
+static_assert( sizeof( Header ) == 80, "KTX2 header is 80 bytes" );
+static_assert( sizeof( LevelIndex ) == 24, "KTX2 level index entries are 24 bytes" );
+
+static size_t alignUp( size_t value, size_t alignment )
+{
+    return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+// Plain levels start on a multiple of the texel size and of 4, supercompressed ones anywhere
+static size_t levelAlignment( PixelConvert::Format format, Supercompression scheme )
+{
+    if ( scheme != Supercompression::None )
+    {
+        return 1;
+    }
+    const size_t texel = PixelConvert::bytesPerPixel( format );
+    return texel % 4 == 0 ? texel : texel * 4;
+}
+
+static uint32_t levelDimension( uint32_t size, uint32_t level )
+{
+    return std::max( size >> level, 1u );
+}
+
+namespace Ktx2Format
+{
+    bool layoutFor( uint32_t vkFormat, PixelConvert::Layout* pLayout )
+    {
+        using PixelConvert::Format;
+        using MipGen::ColorSpace;
+        switch ( (VkFormat)vkFormat )
+        {
+            case VkFormat::R8G8B8_UNORM:        *pLayout = { Format::RGB8, ColorSpace::Linear }; return true;
+            case VkFormat::R8G8B8_SRGB:         *pLayout = { Format::RGB8, ColorSpace::SRGB }; return true;
+            case VkFormat::R8G8B8A8_UNORM:      *pLayout = { Format::RGBA8, ColorSpace::Linear }; return true;
+            case VkFormat::R8G8B8A8_SRGB:       *pLayout = { Format::RGBA8, ColorSpace::SRGB }; return true;
+            case VkFormat::B8G8R8A8_UNORM:      *pLayout = { Format::BGRA8, ColorSpace::Linear }; return true;
+            case VkFormat::B8G8R8A8_SRGB:       *pLayout = { Format::BGRA8, ColorSpace::SRGB }; return true;
+            case VkFormat::R32G32B32A32_SFLOAT: *pLayout = { Format::RGBA32Float, ColorSpace::Linear }; return true;
+        }
+        return false;
+    }
+
+    VkFormat vkFormatFor( PixelConvert::Layout layout )
+    {
+        const bool srgb = layout.colorSpace == MipGen::ColorSpace::SRGB;
+        switch ( layout.format )
+        {
+            case PixelConvert::Format::RGB8:        return srgb ? VkFormat::R8G8B8_SRGB : VkFormat::R8G8B8_UNORM;
+            case PixelConvert::Format::RGBA8:       return srgb ? VkFormat::R8G8B8A8_SRGB : VkFormat::R8G8B8A8_UNORM;
+            case PixelConvert::Format::BGRA8:       return srgb ? VkFormat::B8G8R8A8_SRGB : VkFormat::B8G8R8A8_UNORM;
+            case PixelConvert::Format::RGBA32Float: return VkFormat::R32G32B32A32_SFLOAT;
+        }
+        return VkFormat::R8G8B8A8_UNORM;
+    }
+
+    bool supports( Supercompression scheme )
+    {
+        switch ( scheme )
+        {
+            case Supercompression::None:
+            case Supercompression::Zlib:
+                return true;
+            case Supercompression::Zstd:
+#ifdef MM_HAVE_ZSTD
+                return true;
+#else
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    const char* supercompressionName( Supercompression scheme )
+    {
+        switch ( scheme )
+        {
+            case Supercompression::None: return "none";
+            case Supercompression::Zstd: return "zstd";
+            case Supercompression::Zlib: return "zlib";
+        }
+        return "unknown";
+    }
+}
+
+// One stream into exactly dstSize bytes
+static bool inflateLevel( Supercompression scheme, const uint8_t* pSrc, size_t srcSize, uint8_t* pDst, size_t dstSize )
+{
+    if ( scheme == Supercompression::Zlib )
+    {
+        uLongf size = (uLongf)dstSize;
+        return uncompress( pDst, &size, pSrc, (uLong)srcSize ) == Z_OK && size == dstSize;
+    }
+#ifdef MM_HAVE_ZSTD
+    if ( scheme == Supercompression::Zstd )
+    {
+        const size_t size = ZSTD_decompress( pDst, dstSize, pSrc, srcSize );
+        return !ZSTD_isError( size ) && size == dstSize;
+    }
+#endif
+    return false;
+}
+
+static bool deflateLevel( Supercompression scheme, int compressionLevel, const std::vector<uint8_t>& src, std::vector<uint8_t>& dst )
+{
+    if ( scheme == Supercompression::Zlib )
+    {
+        uLongf size = compressBound( (uLong)src.size() );
+        dst.resize( size );
+        const bool ok = compress2( dst.data(), &size, src.data(), (uLong)src.size(),
+                                   compressionLevel ? compressionLevel : Z_DEFAULT_COMPRESSION ) == Z_OK;
+        dst.resize( size );
+        return ok;
+    }
+#ifdef MM_HAVE_ZSTD
+    if ( scheme == Supercompression::Zstd )
+    {
+        dst.resize( ZSTD_compressBound( src.size() ) );
+        const size_t size = ZSTD_compress( dst.data(), dst.size(), src.data(), src.size(), compressionLevel );
+        dst.resize( ZSTD_isError( size ) ? 0 : size );
+        return !ZSTD_isError( size );
+    }
+#endif
+    return false;
+}
+
+Ktx2File::Ktx2File()
+: _pData( nullptr )
+, _size( 0 )
+, _mappedSize( 0 )
+, _header{}
+, _layout{ PixelConvert::Format::RGBA8, MipGen::ColorSpace::Linear }
+, _scheme( Supercompression::None )
+{
+}
+
+Ktx2File::~Ktx2File()
+{
+    close();
+}
+
+bool Ktx2File::fail( const char* reason )
+{
+    __builtin_printf( "Ktx2File: %s\n", reason );
+    close();
+    return false;
+}
+
+void Ktx2File::close()
+{
+    if ( _pData )
+    {
+        munmap( _pData, _mappedSize );
+    }
+    _pData = nullptr;
+    _size = _mappedSize = 0;
+    _levels.clear();
+    _decodedOffsets.clear();
+    std::vector<uint8_t>().swap( _decoded );
+    _scheme = Supercompression::None;
+}
+
+bool Ktx2File::open( const char* path )
+{
+    close();
+
+    const int fd = ::open( path, O_RDONLY );
+    if ( fd < 0 )
+    {
+        __builtin_printf( "Ktx2File: can't open %s\n", path );
+        return false;
+    }
+    struct stat info;
+    if ( fstat( fd, &info ) != 0 || (size_t)info.st_size < sizeof( Header ) )
+    {
+        ::close( fd );
+        return fail( "too small for the header" );
+    }
+    _size = (size_t)info.st_size;
+    _mappedSize = alignUp( _size, (size_t)sysconf( _SC_PAGESIZE ) );
+    void* pMapping = mmap( nullptr, _mappedSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+    if ( pMapping == MAP_FAILED )
+    {
+        _size = _mappedSize = 0;
+        return fail( "mmap failed" );
+    }
+    _pData = reinterpret_cast<uint8_t*>( pMapping );
+
+    memcpy( &_header, _pData, sizeof( _header ) );
+    if ( memcmp( _header.identifier, Ktx2Format::kIdentifier, sizeof( Ktx2Format::kIdentifier ) ) != 0 )
+    {
+        return fail( "not a KTX2 file" );
+    }
+    if ( !Ktx2Format::layoutFor( _header.vkFormat, &_layout ) )
+    {
+        return fail( "unsupported format" );
+    }
+    if ( _header.typeSize != ( _layout.format == PixelConvert::Format::RGBA32Float ? 4u : 1u ) )
+    {
+        return fail( "type size doesn't match the format" );
+    }
+    if ( _header.pixelWidth == 0 || _header.pixelHeight == 0 || _header.pixelDepth != 0 || _header.layerCount > 1 || _header.faceCount != 1 )
+    {
+        return fail( "only 2D textures are supported" );
+    }
+    _scheme = (Supercompression)_header.supercompressionScheme;
+    if ( !Ktx2Format::supports( _scheme ) )
+    {
+        return fail( _scheme == Supercompression::Zstd ? "zstd supercompression needs a build with MM_HAVE_ZSTD" : "unsupported supercompression" );
+    }
+    // no levels means the loader should generate them - there's just the one here
+    const uint32_t levelCount = std::max( _header.levelCount, 1u );
+    if ( levelCount > MipChain::levelCountFor( _header.pixelWidth, _header.pixelHeight ) )
+    {
+        return fail( "more levels than the size allows" );
+    }
+    const size_t levelIndexEnd = sizeof( Header ) + levelCount * sizeof( LevelIndex );
+    if ( levelIndexEnd > _size )
+    {
+        return fail( "truncated level index" );
+    }
+
+    auto inFile = [&]( uint64_t offset, uint64_t length )
+    {
+        return offset >= levelIndexEnd && offset <= _size && length <= _size - offset;
+    };
+    uint32_t dfdTotalSize = 0;
+    if ( _header.dfdByteLength < sizeof( dfdTotalSize ) || !inFile( _header.dfdByteOffset, _header.dfdByteLength ) )
+    {
+        return fail( "bad data format descriptor" );
+    }
+    memcpy( &dfdTotalSize, _pData + _header.dfdByteOffset, sizeof( dfdTotalSize ) );
+    if ( dfdTotalSize != _header.dfdByteLength )
+    {
+        return fail( "bad data format descriptor" );
+    }
+    if ( _header.kvdByteLength > 0 && !inFile( _header.kvdByteOffset, _header.kvdByteLength ) )
+    {
+        return fail( "bad key/value data" );
+    }
+    if ( _header.sgdByteLength != 0 )
+    {
+        return fail( "unexpected supercompression global data" );
+    }
+
+    _levels.resize( levelCount );
+    memcpy( _levels.data(), _pData + sizeof( Header ), levelCount * sizeof( LevelIndex ) );
+    const size_t alignment = levelAlignment( _layout.format, _scheme );
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    for ( uint32_t level = 0; level < levelCount; ++level )
+    {
+        const LevelIndex& index = _levels[ level ];
+        const uint64_t expected = (uint64_t)width( level ) * height( level ) * PixelConvert::bytesPerPixel( _layout.format );
+        if ( index.uncompressedByteLength != expected ||
+             ( _scheme == Supercompression::None && index.byteLength != expected ) || index.byteLength == 0 )
+        {
+            return fail( "level size doesn't match its dimensions" );
+        }
+        if ( !inFile( index.byteOffset, index.byteLength ) || index.byteOffset % alignment != 0 )
+        {
+            return fail( "level outside the file or misaligned" );
+        }
+        ranges.push_back( { index.byteOffset, index.byteLength } );
+    }
+    std::sort( ranges.begin(), ranges.end() );
+    for ( size_t i = 1; i < ranges.size(); ++i )
+    {
+        if ( ranges[ i - 1 ].first + ranges[ i - 1 ].second > ranges[i].first )
+        {
+            return fail( "levels overlap" );
+        }
+    }
+
+    // the levels are about to be read front to back
+    madvise( _pData, _mappedSize, MADV_WILLNEED );
+    return true;
+}
+
+bool Ktx2File::decode()
+{
+    if ( isDecoded() )
+    {
+        return true;
+    }
+    _decodedOffsets.resize( _levels.size() );
+    size_t total = 0;
+    for ( size_t level = 0; level < _levels.size(); ++level )
+    {
+        _decodedOffsets[ level ] = total;
+        total = alignUp( total + levelSize( (uint32_t)level ), 16 );
+    }
+    std::vector<uint8_t> decoded( total );
+
+    // a level per job, level 0 - the biggest - first
+    std::atomic<bool> ok( true );
+    JobSystem::Instance()->parallelFor( _levels.size(), 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t level = begin; level < end; ++level )
+        {
+            if ( !inflateLevel( _scheme, storedData( (uint32_t)level ), storedSize( (uint32_t)level ), decoded.data() + _decodedOffsets[ level ],
+                                levelSize( (uint32_t)level ) ) )
+            {
+                ok = false;
+            }
+        }
+    } );
+    if ( !ok )
+    {
+        __builtin_printf( "Ktx2File: a level doesn't decompress to its size\n" );
+        return false;
+    }
+    _decoded.swap( decoded );
+    return true;
+}
+
+uint32_t Ktx2File::width( uint32_t level ) const
+{
+    return levelDimension( _header.pixelWidth, level );
+}
+
+uint32_t Ktx2File::height( uint32_t level ) const
+{
+    return levelDimension( _header.pixelHeight, level );
+}
+
+const uint8_t* Ktx2File::levelData( uint32_t level ) const
+{
+    if ( _scheme == Supercompression::None )
+    {
+        return _pData + _levels[ level ].byteOffset;
+    }
+    return _decoded.empty() ? nullptr : _decoded.data() + _decodedOffsets[ level ];
+}
+
+// Basic descriptor block with a sample per channel in memory order - what the format is,
+// for other readers, Ktx2File goes by vkFormat
+static std::vector<uint32_t> dataFormatDescriptor( PixelConvert::Layout layout, Supercompression scheme )
+{
+    static constexpr uint32_t kRed = 0, kGreen = 1, kBlue = 2, kAlpha = 15;
+    static constexpr uint32_t kLinear = 0x10, kSigned = 0x40, kFloat = 0x80;
+    const bool srgb = layout.colorSpace == MipGen::ColorSpace::SRGB && layout.format != PixelConvert::Format::RGBA32Float;
+    const bool isFloat = layout.format == PixelConvert::Format::RGBA32Float;
+    uint32_t channels[4] = { kRed, kGreen, kBlue, kAlpha };
+    uint32_t channelCount = 4;
+    if ( layout.format == PixelConvert::Format::BGRA8 )
+    {
+        std::swap( channels[0], channels[2] );
+    }
+    else if ( layout.format == PixelConvert::Format::RGB8 )
+    {
+        channelCount = 3;
+    }
+    const uint32_t bits = isFloat ? 32 : 8;
+    const uint32_t blockSize = 24 + 16 * channelCount;
+
+    std::vector<uint32_t> dfd;
+    dfd.push_back( 4 + blockSize );                             // dfdTotalSize
+    dfd.push_back( 0 );                                         // Khronos, basic descriptor
+    dfd.push_back( 2 | blockSize << 16 );                       // version 2
+    dfd.push_back( 1 | 1 << 8 | ( srgb ? 2 : 1 ) << 16 );       // RGBSDA, BT.709, sRGB or linear, straight alpha
+    dfd.push_back( 0 );                                         // 1x1x1 texel blocks
+    // bytes per plane, 0 when supercompressed
+    dfd.push_back( scheme == Supercompression::None ? (uint32_t)PixelConvert::bytesPerPixel( layout.format ) : 0 );
+    dfd.push_back( 0 );
+    for ( uint32_t c = 0; c < channelCount; ++c )
+    {
+        const uint32_t qualifiers = ( isFloat ? kFloat | kSigned : 0 ) | ( srgb && channels[c] == kAlpha ? kLinear : 0 );
+        dfd.push_back( c * bits | ( bits - 1 ) << 16 | ( channels[c] | qualifiers ) << 24 );
+        dfd.push_back( 0 );                                     // sample position
+        dfd.push_back( isFloat ? 0xbf800000u : 0 );             // -1.0f or 0
+        dfd.push_back( isFloat ? 0x3f800000u : 255 );           // 1.0f or 255
+    }
+    return dfd;
+}
+
+Ktx2Writer::Ktx2Writer( uint32_t width, uint32_t height, PixelConvert::Layout layout )
+: _width( width )
+, _height( height )
+, _layout( layout )
+{
+}
+
+void Ktx2Writer::addLevel( const uint8_t* pData )
+{
+    const uint32_t level = (uint32_t)_levels.size();
+    assert( level < MipChain::levelCountFor( _width, _height ) );
+    const size_t size = (size_t)levelDimension( _width, level ) * levelDimension( _height, level ) * PixelConvert::bytesPerPixel( _layout.format );
+    _levels.emplace_back( pData, pData + size );
+}
+
+bool Ktx2Writer::write( const char* path, Supercompression scheme, int compressionLevel ) const
+{
+    assert( !_levels.empty() );
+    if ( !Ktx2Format::supports( scheme ) )
+    {
+        __builtin_printf( "Ktx2Writer: this build can't write %s supercompression\n", Ktx2Format::supercompressionName( scheme ) );
+        return false;
+    }
+
+    // supercompressed a level per job
+    const size_t levelCount = _levels.size();
+    std::vector<std::vector<uint8_t>> compressed( scheme == Supercompression::None ? 0 : levelCount );
+    std::atomic<bool> ok( true );
+    JobSystem::Instance()->parallelFor( compressed.size(), 1, [&]( size_t begin, size_t end )
+    {
+        for ( size_t level = begin; level < end; ++level )
+        {
+            if ( !deflateLevel( scheme, compressionLevel, _levels[ level ], compressed[ level ] ) )
+            {
+                ok = false;
+            }
+        }
+    } );
+    if ( !ok )
+    {
+        __builtin_printf( "Ktx2Writer: %s compression failed\n", Ktx2Format::supercompressionName( scheme ) );
+        return false;
+    }
+    auto stored = [&]( size_t level ) -> const std::vector<uint8_t>&
+    {
+        return scheme == Supercompression::None ? _levels[ level ] : compressed[ level ];
+    };
+
+    const std::vector<uint32_t> dfd = dataFormatDescriptor( _layout, scheme );
+    static const char kKey[] = "KTXwriter";
+    static const char kValue[] = "MyMetalCPP mmtool";
+    const uint32_t kvLength = sizeof( kKey ) + sizeof( kValue );
+
+    Header header = {};
+    memcpy( header.identifier, Ktx2Format::kIdentifier, sizeof( header.identifier ) );
+    header.vkFormat = (uint32_t)Ktx2Format::vkFormatFor( _layout );
+    header.typeSize = _layout.format == PixelConvert::Format::RGBA32Float ? 4 : 1;
+    header.pixelWidth = _width;
+    header.pixelHeight = _height;
+    header.faceCount = 1;
+    header.levelCount = (uint32_t)levelCount;
+    header.supercompressionScheme = (uint32_t)scheme;
+    header.dfdByteOffset = (uint32_t)( sizeof( Header ) + levelCount * sizeof( LevelIndex ) );
+    header.dfdByteLength = (uint32_t)( dfd.size() * sizeof( uint32_t ) );
+    header.kvdByteOffset = header.dfdByteOffset + header.dfdByteLength;
+    header.kvdByteLength = (uint32_t)alignUp( sizeof( kvLength ) + kvLength, 4 );
+
+    // smallest level first
+    std::vector<LevelIndex> levels( levelCount );
+    const size_t alignment = levelAlignment( _layout.format, scheme );
+    size_t offset = header.kvdByteOffset + header.kvdByteLength;
+    for ( size_t level = levelCount; level-- > 0; )
+    {
+        offset = alignUp( offset, alignment );
+        levels[ level ] = { offset, stored( level ).size(), _levels[ level ].size() };
+        offset += stored( level ).size();
+    }
+
+    FILE* pFile = fopen( path, "wb" );
+    if ( !pFile )
+    {
+        __builtin_printf( "Ktx2Writer: can't create %s\n", path );
+        return false;
+    }
+    static const uint8_t kPadding[ 16 ] = {};
+    std::vector<uint8_t> kvd( header.kvdByteLength, 0 );
+    memcpy( kvd.data(), &kvLength, sizeof( kvLength ) );
+    memcpy( kvd.data() + sizeof( kvLength ), kKey, sizeof( kKey ) );
+    memcpy( kvd.data() + sizeof( kvLength ) + sizeof( kKey ), kValue, sizeof( kValue ) );
+    bool written = fwrite( &header, sizeof( header ), 1, pFile ) == 1;
+    written = written && fwrite( levels.data(), sizeof( LevelIndex ), levelCount, pFile ) == levelCount;
+    written = written && fwrite( dfd.data(), sizeof( uint32_t ), dfd.size(), pFile ) == dfd.size();
+    written = written && fwrite( kvd.data(), 1, kvd.size(), pFile ) == kvd.size();
+    size_t position = header.kvdByteOffset + header.kvdByteLength;
+    for ( size_t level = levelCount; written && level-- > 0; )
+    {
+        const size_t padding = levels[ level ].byteOffset - position;
+        written = fwrite( kPadding, 1, padding, pFile ) == padding;
+        written = written && fwrite( stored( level ).data(), 1, stored( level ).size(), pFile ) == stored( level ).size();
+        position = levels[ level ].byteOffset + stored( level ).size();
+    }
+    written = ( fclose( pFile ) == 0 ) && written;
+    if ( !written )
+    {
+        __builtin_printf( "Ktx2Writer: write to %s failed\n", path );
+    }
+    return written;
+}
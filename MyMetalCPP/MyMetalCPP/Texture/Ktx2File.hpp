@@ -0,0 +1,159 @@
+//
+//  Ktx2File.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PixelConvert.hpp"
+
+// KTX2 textures with their mip levels built offline, read in place like SceneFile - the file
+// is mmap'd, the header and level index are checked, and each level's bytes go straight from
+// the mapping to the upload path (TextureUploader) without being copied first.
+//
+//   identifier, header   format, size, level count, supercompression scheme
+//   index                where the data format descriptor and key/value data are
+//   level index          offset, length and uncompressed length of each level, level 0 first
+//   DFD, KVD             described, not needed to read the pixels
+//   levels               smallest first, so a streamed file has something to show early
+//
+// Only plain 2D textures in the formats PixelConvert reads - no arrays, cube maps, 3D or block
+// compression. Supercompressed levels (zlib, and zstd when built with MM_HAVE_ZSTD) are one
+// stream each and decode() inflates them into one allocation, a level per job - level 0 is
+// three quarters of the bytes, so it bounds how parallel that gets.
+
+namespace Ktx2Format
+{
+    static constexpr uint8_t kIdentifier[ 12 ] = { 0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n' };
+
+    // The Vulkan formats PixelConvert has a layout for
+    enum class VkFormat : uint32_t
+    {
+        R8G8B8_UNORM = 23,
+        R8G8B8_SRGB = 29,
+        R8G8B8A8_UNORM = 37,
+        R8G8B8A8_SRGB = 43,
+        B8G8R8A8_UNORM = 44,
+        B8G8R8A8_SRGB = 50,
+        R32G32B32A32_SFLOAT = 109,
+    };
+
+    enum class Supercompression : uint32_t
+    {
+        None = 0,
+        Zstd = 2,
+        Zlib = 3,
+    };
+
+    struct Header
+    {
+        uint8_t identifier[ 12 ];
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+
+    struct LevelIndex
+    {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+
+    // false for formats there's no layout for
+    bool layoutFor( uint32_t vkFormat, PixelConvert::Layout* pLayout );
+    VkFormat vkFormatFor( PixelConvert::Layout layout );
+
+    // Whether this build can decode the scheme
+    bool supports( Supercompression scheme );
+    const char* supercompressionName( Supercompression scheme );
+}
+
+class Ktx2File
+{
+public:
+    Ktx2File();
+    ~Ktx2File();
+
+    Ktx2File( const Ktx2File& ) = delete;
+    Ktx2File& operator=( const Ktx2File& ) = delete;
+
+    // Maps the file and checks the header and level index, prints the reason and returns false if it can't be used
+    bool open( const char* path );
+    void close();
+
+    // Inflates every supercompressed level over the JobSystem. Nothing to do for plain files
+    bool decode();
+
+    bool isOpen() const { return _pData != nullptr; }
+    bool isDecoded() const { return _scheme == Ktx2Format::Supercompression::None || !_decoded.empty(); }
+
+    uint32_t width( uint32_t level = 0 ) const;
+    uint32_t height( uint32_t level = 0 ) const;
+    uint32_t levelCount() const { return (uint32_t)_levels.size(); }
+    PixelConvert::Layout layout() const { return _layout; }
+    Ktx2Format::Supercompression supercompression() const { return _scheme; }
+
+    // A level's pixels, rows tightly packed - in the mapping for plain files, nullptr until
+    // decode() for supercompressed ones
+    const uint8_t* levelData( uint32_t level ) const;
+    size_t levelSize( uint32_t level ) const { return (size_t)_levels[ level ].uncompressedByteLength; }
+    size_t rowPitch( uint32_t level = 0 ) const { return width( level ) * PixelConvert::bytesPerPixel( _layout.format ); }
+
+    // The level as stored, compressed or not
+    const uint8_t* storedData( uint32_t level ) const { return _pData + _levels[ level ].byteOffset; }
+    size_t storedSize( uint32_t level ) const { return (size_t)_levels[ level ].byteLength; }
+
+    const uint8_t* data() const { return _pData; }
+    size_t size() const { return _size; }
+
+private:
+    bool fail( const char* reason );
+
+    uint8_t* _pData;
+    size_t _size;
+    size_t _mappedSize;
+    Ktx2Format::Header _header;
+    PixelConvert::Layout _layout;
+    Ktx2Format::Supercompression _scheme;
+    std::vector<Ktx2Format::LevelIndex> _levels;
+    std::vector<size_t> _decodedOffsets;
+    std::vector<uint8_t> _decoded;
+};
+
+// Collects a texture's levels in memory and writes them out, supercompressing a level per job
+class Ktx2Writer
+{
+public:
+    Ktx2Writer( uint32_t width, uint32_t height, PixelConvert::Layout layout );
+
+    // The next level down, rows tightly packed. The data is copied
+    void addLevel( const uint8_t* pData );
+
+    // compressionLevel as the codec takes it, 0 for its default
+    bool write( const char* path, Ktx2Format::Supercompression scheme, int compressionLevel = 0 ) const;
+
+    uint32_t levelCount() const { return (uint32_t)_levels.size(); }
+
+private:
+    uint32_t _width;
+    uint32_t _height;
+    PixelConvert::Layout _layout;
+    std::vector<std::vector<uint8_t>> _levels;
+};
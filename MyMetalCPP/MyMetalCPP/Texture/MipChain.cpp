@@ -0,0 +1,52 @@
+//
+//  MipChain.cpp
+//  MyMetalCPP
+//
+
+#include "MipChain.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+MipChain::MipChain()
+{
+}
+
+MipChain::MipChain( uint32_t width, uint32_t height )
+{
+    resize( width, height );
+}
+
+uint32_t MipChain::levelCountFor( uint32_t width, uint32_t height )
+{
+    uint32_t size = std::max( width, height );
+    uint32_t count = 1;
+    while ( size > 1 )
+    {
+        size >>= 1;
+        ++count;
+    }
+    return count;
+}
+
+void MipChain::resize( uint32_t width, uint32_t height )
+{
+    assert( width > 0 && height > 0 );
+    const uint32_t count = levelCountFor( width, height );
+    _levels.resize( count );
+
+    size_t offset = 0;
+    for ( uint32_t i = 0; i < count; ++i )
+    {
+        _levels[i] = { width, height, offset };
+        offset += (size_t)width * height * 4;
+        width = std::max( 1u, width / 2 );
+        height = std::max( 1u, height / 2 );
+    }
+    _data.resize( offset );
+}
+
+metal::CpuTexture MipChain::level( uint32_t level )
+{
+    return { levelData( level ), width( level ), height( level ), rowPitch( level ), metal::CpuTexture::Format::RGBA8Unorm };
+}
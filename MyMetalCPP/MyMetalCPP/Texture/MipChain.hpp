@@ -0,0 +1,51 @@
+//
+//  MipChain.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../Compute/CpuShaderTypes.hpp"
+
+// RGBA8 texture with its full mip chain in one allocation, level 0 first. Each level is
+// half the size of the one above (rounded down, never below 1) down to 1x1, the same
+// chain Metal allocates for mipmapLevelCount = levelCountFor( width, height ).
+
+class MipChain
+{
+public:
+    MipChain();
+    MipChain( uint32_t width, uint32_t height );
+
+    void resize( uint32_t width, uint32_t height );
+
+    static uint32_t levelCountFor( uint32_t width, uint32_t height );
+
+    uint32_t levelCount() const { return (uint32_t)_levels.size(); }
+    uint32_t width( uint32_t level = 0 ) const { return _levels[ level ].width; }
+    uint32_t height( uint32_t level = 0 ) const { return _levels[ level ].height; }
+    size_t rowPitch( uint32_t level = 0 ) const { return (size_t)_levels[ level ].width * 4; }
+
+    uint8_t* levelData( uint32_t level ) { return _data.data() + _levels[ level ].offset; }
+    const uint8_t* levelData( uint32_t level ) const { return _data.data() + _levels[ level ].offset; }
+
+    // View of one level for texture2d / the CPU kernels
+    metal::CpuTexture level( uint32_t level );
+
+    size_t sizeInBytes() const { return _data.size(); }
+
+private:
+    struct Level
+    {
+        uint32_t width;
+        uint32_t height;
+        size_t offset;
+    };
+
+    std::vector<Level> _levels;
+    std::vector<uint8_t> _data;
+};
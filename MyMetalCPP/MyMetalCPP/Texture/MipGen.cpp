@@ -0,0 +1,213 @@
+//
+//  MipGen.cpp
+//  MyMetalCPP
+//
+
+#include "MipGen.hpp"
+#include "../Jobs/JobSystem.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <math.h>
+#include <vector>
+
+using Maths::Float4;
+using Maths::splat;
+
+static constexpr int kKaiserTaps = 6;
+static constexpr float kKaiserAlpha = 4.f;
+static constexpr float kKaiserRadius = 1.5f;        // in destination texels, covers all 6 taps
+static constexpr size_t kRowsPerJob = 8;            // destination rows
+
+namespace MipGen
+{
+
+const float* srgbDecodeTable()
+{
+    static const std::vector<float> table = []()
+    {
+        std::vector<float> t( 256 );
+        for ( int i = 0; i < 256; ++i )
+        {
+            float c = i / 255.f;
+            t[i] = ( c <= 0.04045f ) ? c / 12.92f : powf( ( c + 0.055f ) / 1.055f, 2.4f );
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+const uint8_t* srgbEncodeTable()
+{
+    static const std::vector<uint8_t> table = []()
+    {
+        std::vector<uint8_t> t( 65536 );
+        for ( int i = 0; i < 65536; ++i )
+        {
+            float c = i / 65535.f;
+            float s = ( c <= 0.0031308f ) ? c * 12.92f : 1.055f * powf( c, 1.f / 2.4f ) - 0.055f;
+            t[i] = (uint8_t)( s * 255.f + 0.5f );
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+// zeroth order modified Bessel function of the first kind, power series
+static double besselI0( double x )
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for ( int k = 1; k < 32; ++k )
+    {
+        term *= ( x / ( 2.0 * k ) ) * ( x / ( 2.0 * k ) );
+        sum += term;
+    }
+    return sum;
+}
+
+// Tap k reads source texel 2x - 2 + k for destination texel x
+static const float* kaiserWeights()
+{
+    static const std::vector<float> weights = []()
+    {
+        std::vector<float> w( kKaiserTaps );
+        double total = 0.0;
+        for ( int k = 0; k < kKaiserTaps; ++k )
+        {
+            // distance from the destination texel center (source 2x + 1) in destination texels
+            double t = ( k - 2.5 ) * 0.5;
+            double sinc = sin( M_PI * t ) / ( M_PI * t );
+            double r = t / kKaiserRadius;
+            double window = besselI0( kKaiserAlpha * sqrt( std::max( 0.0, 1.0 - r * r ) ) ) / besselI0( kKaiserAlpha );
+            w[k] = (float)( sinc * window );
+            total += w[k];
+        }
+        for ( float& v : w )
+        {
+            v = (float)( v / total );
+        }
+        return w;
+    }();
+    return weights.data();
+}
+
+static void downsampleBox( const MipChain& chain, uint32_t level, uint8_t* pDst, const Options& options )
+{
+    const uint32_t srcW = chain.width( level - 1 );
+    const uint32_t srcH = chain.height( level - 1 );
+    const uint32_t dstW = chain.width( level );
+    const uint32_t dstH = chain.height( level );
+    const uint8_t* pSrc = chain.levelData( level - 1 );
+    const size_t srcPitch = chain.rowPitch( level - 1 );
+    const ColorSpace colorSpace = options.colorSpace;
+
+    JobSystem::Instance()->parallelFor( dstH, kRowsPerJob, [&]( size_t begin, size_t end )
+    {
+        for ( size_t y = begin; y < end; ++y )
+        {
+            const uint8_t* pRow0 = pSrc + wrapIndex( (int)y * 2, srcH, options.addressMode ) * srcPitch;
+            const uint8_t* pRow1 = pSrc + wrapIndex( (int)y * 2 + 1, srcH, options.addressMode ) * srcPitch;
+            uint8_t* pOut = pDst + y * dstW * 4;
+            for ( uint32_t x = 0; x < dstW; ++x )
+            {
+                const size_t x0 = wrapIndex( (int)x * 2, srcW, options.addressMode ) * 4;
+                const size_t x1 = wrapIndex( (int)x * 2 + 1, srcW, options.addressMode ) * 4;
+                Float4 sum = decodeTexel( pRow0 + x0, colorSpace ) + decodeTexel( pRow0 + x1, colorSpace ) +
+                             decodeTexel( pRow1 + x0, colorSpace ) + decodeTexel( pRow1 + x1, colorSpace );
+                encodeTexel( sum * 0.25f, pOut + x * 4, colorSpace );
+            }
+        }
+    } );
+}
+
+static void downsampleKaiser( const MipChain& chain, uint32_t level, uint8_t* pDst, const Options& options )
+{
+    const uint32_t srcW = chain.width( level - 1 );
+    const uint32_t srcH = chain.height( level - 1 );
+    const uint32_t dstW = chain.width( level );
+    const uint32_t dstH = chain.height( level );
+    const uint8_t* pSrc = chain.levelData( level - 1 );
+    const size_t srcPitch = chain.rowPitch( level - 1 );
+    const ColorSpace colorSpace = options.colorSpace;
+    const float* pWeights = kaiserWeights();
+
+    // source columns for every destination texel, wrapped once up front
+    std::vector<uint32_t> columns( (size_t)dstW * kKaiserTaps );
+    for ( uint32_t x = 0; x < dstW; ++x )
+    {
+        for ( int k = 0; k < kKaiserTaps; ++k )
+        {
+            columns[ x * kKaiserTaps + k ] = wrapIndex( (int)x * 2 - 2 + k, srcW, options.addressMode );
+        }
+    }
+
+    JobSystem::Instance()->parallelFor( dstH, kRowsPerJob, [&]( size_t begin, size_t end )
+    {
+        // horizontal pass over the source rows this band needs, then vertical out of those
+        const int firstRow = (int)begin * 2 - 2;
+        const size_t numRows = ( end - begin ) * 2 + kKaiserTaps - 2;
+        std::vector<Float4> decoded( srcW );
+        std::vector<Float4> filtered( numRows * dstW );
+
+        for ( size_t r = 0; r < numRows; ++r )
+        {
+            const uint8_t* pRow = pSrc + wrapIndex( firstRow + (int)r, srcH, options.addressMode ) * srcPitch;
+            for ( uint32_t x = 0; x < srcW; ++x )
+            {
+                decoded[x] = decodeTexel( pRow + x * 4, colorSpace );
+            }
+
+            Float4* pOut = filtered.data() + r * dstW;
+            for ( uint32_t x = 0; x < dstW; ++x )
+            {
+                const uint32_t* pColumns = columns.data() + x * kKaiserTaps;
+                Float4 sum = splat( 0.f );
+                for ( int k = 0; k < kKaiserTaps; ++k )
+                {
+                    sum += decoded[ pColumns[k] ] * pWeights[k];
+                }
+                pOut[x] = sum;
+            }
+        }
+
+        for ( size_t y = begin; y < end; ++y )
+        {
+            const Float4* pTaps = filtered.data() + ( y - begin ) * 2 * dstW;
+            uint8_t* pOut = pDst + y * dstW * 4;
+            for ( uint32_t x = 0; x < dstW; ++x )
+            {
+                Float4 sum = splat( 0.f );
+                for ( int k = 0; k < kKaiserTaps; ++k )
+                {
+                    sum += pTaps[ k * dstW + x ] * pWeights[k];
+                }
+                encodeTexel( sum, pOut + x * 4, colorSpace );
+            }
+        }
+    } );
+}
+
+void downsample( MipChain& chain, uint32_t level, const Options& options )
+{
+    assert( level > 0 && level < chain.levelCount() );
+    uint8_t* pDst = chain.levelData( level );
+    if ( options.filter == Filter::Kaiser )
+    {
+        downsampleKaiser( chain, level, pDst, options );
+    }
+    else
+    {
+        downsampleBox( chain, level, pDst, options );
+    }
+}
+
+void generate( MipChain& chain, const Options& options )
+{
+    for ( uint32_t level = 1; level < chain.levelCount(); ++level )
+    {
+        downsample( chain, level, options );
+    }
+}
+
+}
@@ -0,0 +1,96 @@
+//
+//  MipGen.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "MipChain.hpp"
+#include "../Maths/VectorExt.hpp"
+
+// CPU mip generation for MipChain. Every level is filtered from the one above it, a texel at
+// a time as a Float4 (one lane per channel), with the rows of each level split over the
+// JobSystem.
+//
+//   Box      2x2 average - what generateMipmaps does on most GPUs, cheapest
+//   Kaiser   6 tap separable Kaiser windowed sinc - keeps more detail in the small levels,
+//            negative lobes are clamped away after filtering
+//
+// With ColorSpace::SRGB the colour channels are decoded to linear before filtering and
+// encoded again afterwards (alpha is always linear), so the small levels don't go dark the
+// way averaging the encoded values does.
+
+namespace MipGen
+{
+    enum class Filter
+    {
+        Box,
+        Kaiser
+    };
+
+    enum class ColorSpace
+    {
+        Linear,     // RGBA8Unorm
+        SRGB        // RGBA8Unorm_sRGB
+    };
+
+    struct Options
+    {
+        Filter filter = Filter::Box;
+        ColorSpace colorSpace = ColorSpace::Linear;
+        metal::address addressMode = metal::address::repeat;   // how filter taps past the edge wrap
+    };
+
+    // Fills levels 1.. from level 0
+    void generate( MipChain& chain, const Options& options );
+
+    // Fills one level from the level above it
+    void downsample( MipChain& chain, uint32_t level, const Options& options );
+
+    inline uint32_t wrapIndex( int i, uint32_t size, metal::address mode )
+    {
+        if ( mode == metal::address::repeat )
+        {
+            i %= (int)size;
+            return (uint32_t)( i < 0 ? i + (int)size : i );
+        }
+        return (uint32_t)( i < 0 ? 0 : ( i >= (int)size ? (int)size - 1 : i ) );
+    }
+
+    // 8 bit sRGB -> linear float, and linear float quantised to 16 bits -> 8 bit sRGB
+    const float* srgbDecodeTable();
+    const uint8_t* srgbEncodeTable();
+
+    inline Maths::Float4 decodeTexel( const uint8_t* p, ColorSpace colorSpace )
+    {
+        if ( colorSpace == ColorSpace::SRGB )
+        {
+            const float* pDecode = srgbDecodeTable();
+            return Maths::Float4{ pDecode[ p[0] ], pDecode[ p[1] ], pDecode[ p[2] ], p[3] * ( 1.f / 255.f ) };
+        }
+        const Maths::Int4 texel = { p[0], p[1], p[2], p[3] };
+        return __builtin_convertvector( texel, Maths::Float4 ) * ( 1.f / 255.f );
+    }
+
+    inline void encodeTexel( Maths::Float4 v, uint8_t* p, ColorSpace colorSpace )
+    {
+        v = Maths::clamp01( v );
+        if ( colorSpace == ColorSpace::SRGB )
+        {
+            const Maths::Int4 index = __builtin_convertvector( v * 65535.f + 0.5f, Maths::Int4 );
+            const uint8_t* pEncode = srgbEncodeTable();
+            p[0] = pEncode[ index[0] ];
+            p[1] = pEncode[ index[1] ];
+            p[2] = pEncode[ index[2] ];
+            p[3] = (uint8_t)( v[3] * 255.f + 0.5f );
+            return;
+        }
+        const Maths::Int4 texel = __builtin_convertvector( v * 255.f + 0.5f, Maths::Int4 );
+        p[0] = (uint8_t)texel[0];
+        p[1] = (uint8_t)texel[1];
+        p[2] = (uint8_t)texel[2];
+        p[3] = (uint8_t)texel[3];
+    }
+}
@@ -0,0 +1,73 @@
+//
+//  MipSampler.cpp
+//  MyMetalCPP
+//
+
+#include "MipSampler.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+using Maths::Float4;
+
+MipSampler::MipSampler( const MipChain& chain, MipGen::ColorSpace colorSpace, metal::address addressMode )
+: _chain( chain )
+, _colorSpace( colorSpace )
+, _addressMode( addressMode )
+, _maxLod( (float)( chain.levelCount() - 1 ) )
+{
+}
+
+Float4 MipSampler::sampleBilinear( float u, float v, uint32_t level ) const
+{
+    const uint32_t w = _chain.width( level );
+    const uint32_t h = _chain.height( level );
+    const uint8_t* pData = _chain.levelData( level );
+    const size_t pitch = _chain.rowPitch( level );
+
+    const float fu = u * w - 0.5f;
+    const float fv = v * h - 0.5f;
+    const float x0f = floorf( fu );
+    const float y0f = floorf( fv );
+    const float tx = fu - x0f;
+    const float ty = fv - y0f;
+    const int x0 = (int)x0f;
+    const int y0 = (int)y0f;
+
+    const size_t ux0 = MipGen::wrapIndex( x0, w, _addressMode ) * 4;
+    const size_t ux1 = MipGen::wrapIndex( x0 + 1, w, _addressMode ) * 4;
+    const uint8_t* pRow0 = pData + MipGen::wrapIndex( y0, h, _addressMode ) * pitch;
+    const uint8_t* pRow1 = pData + MipGen::wrapIndex( y0 + 1, h, _addressMode ) * pitch;
+
+    const Float4 t00 = MipGen::decodeTexel( pRow0 + ux0, _colorSpace );
+    const Float4 t10 = MipGen::decodeTexel( pRow0 + ux1, _colorSpace );
+    const Float4 t01 = MipGen::decodeTexel( pRow1 + ux0, _colorSpace );
+    const Float4 t11 = MipGen::decodeTexel( pRow1 + ux1, _colorSpace );
+
+    const Float4 top = t00 + ( t10 - t00 ) * tx;
+    const Float4 bottom = t01 + ( t11 - t01 ) * tx;
+    return top + ( bottom - top ) * ty;
+}
+
+Float4 MipSampler::sampleTrilinear( float u, float v, float lod ) const
+{
+    lod = std::min( std::max( lod, 0.f ), _maxLod );
+    const uint32_t level0 = (uint32_t)lod;
+    const float t = lod - (float)level0;
+    const Float4 a = sampleBilinear( u, v, level0 );
+    if ( t == 0.f )
+    {
+        return a;
+    }
+    const Float4 b = sampleBilinear( u, v, level0 + 1 );
+    return a + ( b - a ) * t;
+}
+
+float MipSampler::computeLod( float dudx, float dvdx, float dudy, float dvdy ) const
+{
+    const float w = (float)_chain.width();
+    const float h = (float)_chain.height();
+    const float lenX = ( dudx * w ) * ( dudx * w ) + ( dvdx * h ) * ( dvdx * h );
+    const float lenY = ( dudy * w ) * ( dudy * w ) + ( dvdy * h ) * ( dvdy * h );
+    return 0.5f * log2f( std::max( std::max( lenX, lenY ), 1e-20f ) );
+}
@@ -0,0 +1,38 @@
+//
+//  MipSampler.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include "MipChain.hpp"
+#include "MipGen.hpp"
+
+// Bilinear and trilinear filtering of a MipChain for the CPU renderers and tools, following
+// the GPU conventions: texel centers at +0.5, lod = log2 of the larger screen space texel
+// footprint, and sRGB chains are decoded to linear before filtering like an _sRGB format.
+// Results are RGBA in a Float4.
+
+class MipSampler
+{
+public:
+    MipSampler( const MipChain& chain, MipGen::ColorSpace colorSpace, metal::address addressMode );
+
+    Maths::Float4 sampleBilinear( float u, float v, uint32_t level ) const;
+    Maths::Float4 sampleTrilinear( float u, float v, float lod ) const;
+
+    // texcoord derivatives per pixel (du/dx, dv/dx, du/dy, dv/dy) - what a fragment gets
+    // from dfdx/dfdy
+    float computeLod( float dudx, float dvdx, float dudy, float dvdy ) const;
+
+    Maths::Float4 sampleGrad( float u, float v, float dudx, float dvdx, float dudy, float dvdy ) const
+    {
+        return sampleTrilinear( u, v, computeLod( dudx, dvdx, dudy, dvdy ) );
+    }
+
+private:
+    const MipChain& _chain;
+    MipGen::ColorSpace _colorSpace;
+    metal::address _addressMode;
+    float _maxLod;
+};
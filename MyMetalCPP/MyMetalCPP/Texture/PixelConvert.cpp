@@ -0,0 +1,267 @@
+//
+//  PixelConvert.cpp
+//  MyMetalCPP
+//
+
+#include "PixelConvert.hpp"
+
+#include <cassert>
+#include <cstring>
+#include <math.h>
+
+using Maths::Float4;
+
+namespace PixelConvert
+{
+
+typedef uint32_t Pixel4 __attribute__(( vector_size( 16 ) ));
+
+// 8 bit value in one colour space to the other, for red, green and blue. Words, so a lane's
+// lookup is one load - a gather where the target has them
+static const uint32_t* recodeTable( MipGen::ColorSpace from )
+{
+    static const struct Tables
+    {
+        uint32_t toSRGB[ 256 ];
+        uint32_t toLinear[ 256 ];
+    } tables = []()
+    {
+        Tables t;
+        const uint8_t* pEncode = MipGen::srgbEncodeTable();
+        const float* pDecode = MipGen::srgbDecodeTable();
+        for ( int i = 0; i < 256; ++i )
+        {
+            t.toSRGB[i] = pEncode[ i * 257 ];       // i / 255 quantised to 16 bits
+            t.toLinear[i] = (uint32_t)( pDecode[i] * 255.f + 0.5f );
+        }
+        return t;
+    }();
+    return from == MipGen::ColorSpace::Linear ? tables.toSRGB : tables.toLinear;
+}
+
+size_t bytesPerPixel( Format format )
+{
+    switch ( format )
+    {
+        case Format::RGBA8:
+        case Format::BGRA8:
+            return 4;
+        case Format::RGB8:
+            return 3;
+        case Format::RGBA32Float:
+            return 16;
+    }
+    return 0;
+}
+
+// red and blue trade places with masks and shifts, which every target does well - a byte
+// shuffle without SSSE3 doesn't
+static inline Pixel4 swapRedBlue( Pixel4 v )
+{
+    return ( v & 0xff00ff00u ) | ( ( v >> 16 ) & 0xffu ) | ( ( v & 0xffu ) << 16 );
+}
+
+// each lane's 4 bytes of a table, the lookups of 4 pixels' channel at once
+static inline Pixel4 lookup( const uint32_t* pTable, Pixel4 index )
+{
+    return Pixel4{ pTable[ index[0] ], pTable[ index[1] ], pTable[ index[2] ], pTable[ index[3] ] };
+}
+
+template < bool kSwap >
+static void swizzleRow( const uint8_t* pSrc, uint8_t* pDst, uint32_t width )
+{
+    if ( !kSwap )
+    {
+        memcpy( pDst, pSrc, (size_t)width * 4 );
+        return;
+    }
+    uint32_t x = 0;
+    for ( ; x + 4 <= width; x += 4 )
+    {
+        Pixel4 v;
+        memcpy( &v, pSrc + x * 4, sizeof( v ) );
+        v = swapRedBlue( v );
+        memcpy( pDst + x * 4, &v, sizeof( v ) );
+    }
+    for ( ; x < width; ++x )
+    {
+        pDst[ x * 4 + 0 ] = pSrc[ x * 4 + 2 ];
+        pDst[ x * 4 + 1 ] = pSrc[ x * 4 + 1 ];
+        pDst[ x * 4 + 2 ] = pSrc[ x * 4 + 0 ];
+        pDst[ x * 4 + 3 ] = pSrc[ x * 4 + 3 ];
+    }
+}
+
+// 4 pixels are 3 words - each lane takes the end of one word and the start of the next, then
+// is made opaque. Little endian, as both targets are
+template < bool kSwap >
+static void expandRow( const uint8_t* pSrc, uint8_t* pDst, uint32_t width )
+{
+    const Pixel4 kLowShift = { 0, 24, 16, 8 };
+    const Pixel4 kHighShift = { 0, 8, 16, 0 };
+    uint32_t x = 0;
+    for ( ; x + 4 <= width; x += 4 )
+    {
+        uint32_t w[3];
+        memcpy( w, pSrc + x * 3, sizeof( w ) );
+        const Pixel4 low = { w[0], w[0], w[1], w[2] };
+        const Pixel4 high = { 0, w[1], w[2], 0 };
+        Pixel4 v = ( low >> kLowShift ) | ( high << kHighShift ) | 0xff000000u;
+        if ( kSwap )
+        {
+            v = swapRedBlue( v );
+        }
+        memcpy( pDst + x * 4, &v, sizeof( v ) );
+    }
+    for ( ; x < width; ++x )
+    {
+        pDst[ x * 4 + 0 ] = pSrc[ x * 3 + ( kSwap ? 2 : 0 ) ];
+        pDst[ x * 4 + 1 ] = pSrc[ x * 3 + 1 ];
+        pDst[ x * 4 + 2 ] = pSrc[ x * 3 + ( kSwap ? 0 : 2 ) ];
+        pDst[ x * 4 + 3 ] = 255;
+    }
+}
+
+// 4 pixels turned into a vector per channel, each encoded as encodeTexel does its lanes - the
+// same float operations, so the same bytes - and packed back together as words
+static inline Pixel4 encodeChannel( Float4 v, bool srgb )
+{
+    v = Maths::clamp01( v );
+    if ( srgb )
+    {
+        const Pixel4 index = (Pixel4)__builtin_convertvector( v * 65535.f + 0.5f, Maths::Int4 );
+        const uint8_t* pEncode = MipGen::srgbEncodeTable();
+        return Pixel4{ pEncode[ index[0] ], pEncode[ index[1] ], pEncode[ index[2] ], pEncode[ index[3] ] };
+    }
+    return (Pixel4)__builtin_convertvector( v * 255.f + 0.5f, Maths::Int4 );
+}
+
+static void floatRow( const uint8_t* pSrc, uint8_t* pDst, uint32_t width, MipGen::ColorSpace colorSpace, bool swap )
+{
+    const bool srgb = colorSpace == MipGen::ColorSpace::SRGB;
+    uint32_t x = 0;
+    for ( ; x + 4 <= width; x += 4 )
+    {
+        Float4 p[4];
+        memcpy( p, pSrc + x * 16, sizeof( p ) );
+        const Pixel4 r = encodeChannel( Float4{ p[0][0], p[1][0], p[2][0], p[3][0] }, srgb );
+        const Pixel4 g = encodeChannel( Float4{ p[0][1], p[1][1], p[2][1], p[3][1] }, srgb );
+        const Pixel4 b = encodeChannel( Float4{ p[0][2], p[1][2], p[2][2], p[3][2] }, srgb );
+        const Pixel4 a = encodeChannel( Float4{ p[0][3], p[1][3], p[2][3], p[3][3] }, false );
+        const Pixel4 v = ( swap ? b : r ) | ( g << 8 ) | ( ( swap ? r : b ) << 16 ) | ( a << 24 );
+        memcpy( pDst + x * 4, &v, sizeof( v ) );
+    }
+    for ( ; x < width; ++x )
+    {
+        Float4 v;
+        memcpy( &v, pSrc + x * 16, sizeof( v ) );
+        MipGen::encodeTexel( v, pDst + x * 4, colorSpace );
+        if ( swap )
+        {
+            const uint8_t r = pDst[ x * 4 ];
+            pDst[ x * 4 ] = pDst[ x * 4 + 2 ];
+            pDst[ x * 4 + 2 ] = r;
+        }
+    }
+}
+
+// red, green and blue of 4 pixels masked out into lanes, looked up and shifted back - alpha
+// stays where it is
+static void recodeRow( uint8_t* pDst, uint32_t width, const uint32_t* pTable )
+{
+    uint32_t x = 0;
+    for ( ; x + 4 <= width; x += 4 )
+    {
+        Pixel4 v;
+        memcpy( &v, pDst + x * 4, sizeof( v ) );
+        v = ( v & 0xff000000u ) | lookup( pTable, v & 0xffu ) | ( lookup( pTable, ( v >> 8 ) & 0xffu ) << 8 ) |
+            ( lookup( pTable, ( v >> 16 ) & 0xffu ) << 16 );
+        memcpy( pDst + x * 4, &v, sizeof( v ) );
+    }
+    for ( ; x < width; ++x )
+    {
+        pDst[ x * 4 + 0 ] = (uint8_t)pTable[ pDst[ x * 4 + 0 ] ];
+        pDst[ x * 4 + 1 ] = (uint8_t)pTable[ pDst[ x * 4 + 1 ] ];
+        pDst[ x * 4 + 2 ] = (uint8_t)pTable[ pDst[ x * 4 + 2 ] ];
+    }
+}
+
+void convertRows( const uint8_t* pSrc, size_t srcPitch, Layout src, uint8_t* pDst, size_t dstPitch, Layout dst,
+                  uint32_t width, uint32_t rows )
+{
+    assert( isTextureLayout( dst.format ) );
+    const bool swap = dst.format == Format::BGRA8 ? src.format != Format::BGRA8 : src.format == Format::BGRA8;
+    const bool recode = src.format != Format::RGBA32Float && src.colorSpace != dst.colorSpace;
+    for ( uint32_t y = 0; y < rows; ++y, pSrc += srcPitch, pDst += dstPitch )
+    {
+        switch ( src.format )
+        {
+            case Format::RGBA8:
+            case Format::BGRA8:
+                swap ? swizzleRow<true>( pSrc, pDst, width ) : swizzleRow<false>( pSrc, pDst, width );
+                break;
+            case Format::RGB8:
+                swap ? expandRow<true>( pSrc, pDst, width ) : expandRow<false>( pSrc, pDst, width );
+                break;
+            case Format::RGBA32Float:
+                floatRow( pSrc, pDst, width, dst.colorSpace, swap );
+                break;
+        }
+        if ( recode )
+        {
+            recodeRow( pDst, width, recodeTable( src.colorSpace ) );
+        }
+    }
+}
+
+// clamp01 and encodeTexel a lane at a time, the same float operations in the same order
+static uint8_t encodeLane( float v, bool srgb )
+{
+    v = v > 0.f ? v : 0.f;
+    v = v < 1.f ? v : 1.f;
+    return srgb ? MipGen::srgbEncodeTable()[ (int32_t)( v * 65535.f + 0.5f ) ] : (uint8_t)(int32_t)( v * 255.f + 0.5f );
+}
+
+void convertRowsReference( const uint8_t* pSrc, size_t srcPitch, Layout src, uint8_t* pDst, size_t dstPitch, Layout dst,
+                           uint32_t width, uint32_t rows )
+{
+    const size_t srcBytes = bytesPerPixel( src.format );
+    const uint32_t* pRecode = recodeTable( src.colorSpace );
+    for ( uint32_t y = 0; y < rows; ++y )
+    {
+        for ( uint32_t x = 0; x < width; ++x )
+        {
+            const uint8_t* pIn = pSrc + y * srcPitch + x * srcBytes;
+            uint8_t rgba[4];
+            if ( src.format == Format::RGBA32Float )
+            {
+                float f[4];
+                memcpy( f, pIn, sizeof( f ) );
+                for ( int c = 0; c < 4; ++c )
+                {
+                    rgba[c] = encodeLane( f[c], c < 3 && dst.colorSpace == MipGen::ColorSpace::SRGB );
+                }
+            }
+            else
+            {
+                const bool bgra = src.format == Format::BGRA8;
+                rgba[0] = pIn[ bgra ? 2 : 0 ];
+                rgba[1] = pIn[1];
+                rgba[2] = pIn[ bgra ? 0 : 2 ];
+                rgba[3] = src.format == Format::RGB8 ? 255 : pIn[3];
+                for ( int c = 0; src.colorSpace != dst.colorSpace && c < 3; ++c )
+                {
+                    rgba[c] = (uint8_t)pRecode[ rgba[c] ];
+                }
+            }
+            uint8_t* pOut = pDst + y * dstPitch + x * 4;
+            const bool bgra = dst.format == Format::BGRA8;
+            pOut[0] = rgba[ bgra ? 2 : 0 ];
+            pOut[1] = rgba[1];
+            pOut[2] = rgba[ bgra ? 0 : 2 ];
+            pOut[3] = rgba[3];
+        }
+    }
+}
+
+}
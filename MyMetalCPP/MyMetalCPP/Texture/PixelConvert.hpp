@@ -0,0 +1,61 @@
+//
+//  PixelConvert.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "MipGen.hpp"
+
+// CPU image data into the byte layout of an RGBA8 or BGRA8 texture, for uploads. Rows are
+// converted 4 pixels at a time, a pixel to a lane of a 4 x 32 bit vector, with masks and shifts
+// on whole pixels rather than byte shuffles, which x86 only has from SSSE3:
+//
+//   RGBA8 <-> BGRA8   red and blue swapped in a 4 lane vector, like Maths/VectorExt
+//   RGB8 -> either    4 pixels out of 3 words, each lane the end of one word shifted down and
+//                     the start of the next shifted up, alpha filled with 255
+//   RGBA32Float       4 pixels transposed to a Float4 per channel, encoded the way
+//                     MipGen::encodeTexel does its lanes and packed back, so floats are linear
+//                     and come out sRGB encoded when the destination is
+//
+// 8 bit sources keep their values unless the two colour spaces differ, when red, green and
+// blue go through a 256 entry table built from MipGen's sRGB tables - linear to sRGB for a
+// linear image going into an _sRGB texture, and back - each channel of 4 pixels masked into
+// lanes and looked up together. Alpha is always linear. Widths that aren't a multiple of 4
+// finish a pixel at a time.
+
+namespace PixelConvert
+{
+    enum class Format
+    {
+        RGBA8,
+        BGRA8,
+        RGB8,
+        RGBA32Float     // linear, any colour space given for it is ignored
+    };
+
+    struct Layout
+    {
+        Format format;
+        MipGen::ColorSpace colorSpace;
+    };
+
+    size_t bytesPerPixel( Format format );
+
+    // True for the destinations convertRows() writes
+    inline bool isTextureLayout( Format format )
+    {
+        return format == Format::RGBA8 || format == Format::BGRA8;
+    }
+
+    // rows of width pixels, pitches in bytes. Float sources need only be 4 byte aligned
+    void convertRows( const uint8_t* pSrc, size_t srcPitch, Layout src, uint8_t* pDst, size_t dstPitch, Layout dst,
+                      uint32_t width, uint32_t rows );
+
+    // The same a channel at a time with no vectors - what convertRows() has to match exactly
+    void convertRowsReference( const uint8_t* pSrc, size_t srcPitch, Layout src, uint8_t* pDst, size_t dstPitch, Layout dst,
+                               uint32_t width, uint32_t rows );
+}
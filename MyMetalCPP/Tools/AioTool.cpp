@@ -0,0 +1,306 @@
+//
+//  AioTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Renderer/AsyncFileIO.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static constexpr uint32_t kChunkSize = 1 << 20;
+
+static uint64_t roundUp( uint64_t size )
+{
+    return ( size + AsyncFileIO::kDirectAlignment - 1 ) & ~(uint64_t)( AsyncFileIO::kDirectAlignment - 1 );
+}
+
+// Files of one size, each read into its own part of an aligned arena and checked by summing words
+struct FileSet
+{
+    const char* name;
+    std::vector<std::string> paths;
+    uint64_t fileSize;
+    uint64_t expectedSum;
+    uint8_t* pArena;
+    uint64_t stride;
+};
+
+static uint64_t patternWord( size_t file, uint64_t word )
+{
+    return ( file + 1 ) * 0x9e3779b97f4a7c15ull ^ word * 0xd6e8feb86659fd93ull;
+}
+
+// Written once and kept - rerunning with the same sizes reuses them
+static bool createFiles( FileSet& set, const std::string& directory, const char* prefix, size_t count )
+{
+    std::vector<uint64_t> block( kChunkSize / sizeof( uint64_t ) );
+    set.expectedSum = 0;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        char name[ 64 ];
+        snprintf( name, sizeof( name ), "/%s_%05zu.bin", prefix, i );
+        set.paths.push_back( directory + name );
+        const uint64_t words = set.fileSize / sizeof( uint64_t );
+        for ( uint64_t w = 0; w < words; ++w )
+        {
+            set.expectedSum += patternWord( i, w );
+        }
+
+        struct stat info;
+        if ( stat( set.paths.back().c_str(), &info ) == 0 && (uint64_t)info.st_size == set.fileSize )
+        {
+            continue;
+        }
+        const int fd = open( set.paths.back().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+        if ( fd < 0 )
+        {
+            std::cout << "can't create " << set.paths.back() << std::endl;
+            return false;
+        }
+        bool written = true;
+        for ( uint64_t w = 0; w < words && written; w += block.size() )
+        {
+            const uint64_t n = std::min<uint64_t>( block.size(), words - w );
+            for ( uint64_t j = 0; j < n; ++j )
+            {
+                block[j] = patternWord( i, w + j );
+            }
+            written = write( fd, block.data(), n * sizeof( uint64_t ) ) == (ssize_t)( n * sizeof( uint64_t ) );
+        }
+        written = written && fsync( fd ) == 0;
+        close( fd );
+        if ( !written )
+        {
+            std::cout << "can't write " << set.paths.back() << std::endl;
+            return false;
+        }
+    }
+    set.stride = roundUp( set.fileSize );
+    set.pArena = static_cast<uint8_t*>( aligned_alloc( AsyncFileIO::kDirectAlignment, set.stride * count ) );
+    return set.pArena != nullptr;
+}
+
+// Out of the page cache, so the next read comes from storage
+static void dropCache( const FileSet& set )
+{
+    for ( const std::string& path : set.paths )
+    {
+        const int fd = open( path.c_str(), O_RDONLY );
+#if defined( POSIX_FADV_DONTNEED )
+        posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+#endif
+        close( fd );
+    }
+}
+
+static bool verify( const FileSet& set )
+{
+    uint64_t sum = 0;
+    for ( size_t i = 0; i < set.paths.size(); ++i )
+    {
+        const uint64_t* pWords = reinterpret_cast<const uint64_t*>( set.pArena + i * set.stride );
+        for ( uint64_t w = 0; w < set.fileSize / sizeof( uint64_t ); ++w )
+        {
+            sum += pWords[w];
+        }
+    }
+    return sum == set.expectedSum;
+}
+
+// Blocking reads on this thread, a file at a time, as loading does today
+static bool readWithPread( const FileSet& set, bool direct )
+{
+    const uint32_t chunk = (uint32_t)std::min<uint64_t>( kChunkSize, set.stride );
+    for ( size_t i = 0; i < set.paths.size(); ++i )
+    {
+        int fd = -1;
+#if defined( O_DIRECT )
+        fd = direct ? open( set.paths[i].c_str(), O_RDONLY | O_DIRECT ) : -1;
+#endif
+        fd = fd < 0 ? open( set.paths[i].c_str(), O_RDONLY ) : fd;
+        if ( fd < 0 )
+        {
+            return false;
+        }
+        uint8_t* pDest = set.pArena + i * set.stride;
+        for ( uint64_t offset = 0; offset < set.fileSize; offset += chunk )
+        {
+            if ( pread( fd, pDest + offset, chunk, (off_t)offset ) <= 0 )
+            {
+                close( fd );
+                return false;
+            }
+        }
+        close( fd );
+    }
+    return true;
+}
+
+// Every file opened and every chunk queued up front, submitted as one batch and collected as
+// they finish
+static bool readWithAsync( AsyncFileIO& io, const FileSet& set, bool direct )
+{
+    const uint32_t chunk = (uint32_t)std::min<uint64_t>( kChunkSize, set.stride );
+    std::vector<AsyncFileIO::File> files;
+    for ( size_t i = 0; i < set.paths.size(); ++i )
+    {
+        files.push_back( io.open( set.paths[i].c_str(), direct ) );
+        if ( files.back() == AsyncFileIO::kInvalidFile )
+        {
+            return false;
+        }
+        for ( uint64_t offset = 0; offset < set.fileSize; offset += chunk )
+        {
+            io.read( files.back(), offset, chunk, set.pArena + i * set.stride + offset, nullptr );
+        }
+    }
+    bool ok = true;
+    AsyncFileIO::Completion completions[ 256 ];
+    while ( io.outstanding() > 0 )
+    {
+        const size_t count = io.wait( completions, 256 );
+        for ( size_t c = 0; c < count; ++c )
+        {
+            ok = ok && completions[c].result > 0;
+        }
+    }
+    for ( AsyncFileIO::File file : files )
+    {
+        io.close( file );
+    }
+    return ok;
+}
+
+struct Method
+{
+    const char* name;
+    bool async;
+    AsyncFileIO::Backend backend;
+    bool direct;
+};
+
+// Best of iterations, from the page cache and with it dropped first. Direct reads skip the
+// cache either way
+static bool benchmark( const FileSet& set, const Method* pMethods, size_t methodCount, uint32_t queueDepth, unsigned int iterations )
+{
+    const uint64_t totalBytes = set.fileSize * set.paths.size();
+    std::cout << "  " << set.paths.size() << " " << set.name << " files of " << set.fileSize / 1024 << " KB, " << totalBytes / 1048576 << " MB"
+              << std::endl;
+    for ( size_t m = 0; m < methodCount; ++m )
+    {
+        const Method& method = pMethods[m];
+        double bestMs[2] = { 1e30, 1e30 };
+        size_t mismatched = 0;
+        uint64_t systemCalls = 0, reads = 0, fixedReads = 0, continued = 0;
+        bool direct = method.direct;
+        const char* pBackend = "";
+        for ( int cached = 0; cached < 2; ++cached )
+        {
+            for ( unsigned int i = 0; i < iterations; ++i )
+            {
+                memset( set.pArena, 0, set.stride * set.paths.size() );
+                if ( !cached )
+                {
+                    dropCache( set );
+                }
+                bool ok = false;
+                double ms = 0.0;
+                if ( method.async )
+                {
+                    AsyncFileIO io( queueDepth, method.backend, 4 );
+                    io.registerBuffers( { { set.pArena, set.stride * set.paths.size() } } );
+                    const auto start = std::chrono::steady_clock::now();
+                    ok = readWithAsync( io, set, method.direct );
+                    ms = elapsedMs( start );
+                    systemCalls = io.stats().systemCalls;
+                    reads = io.stats().reads;
+                    fixedReads = io.stats().fixedReads;
+                    continued = io.stats().continued;
+                    direct = method.direct && io.isDirect( 0 );
+                    pBackend = io.backendName();
+                }
+                else
+                {
+                    const auto start = std::chrono::steady_clock::now();
+                    ok = readWithPread( set, method.direct );
+                    ms = elapsedMs( start );
+                }
+                if ( !ok )
+                {
+                    std::cout << "  " << method.name << " failed reading" << std::endl;
+                    return false;
+                }
+                mismatched += verify( set ) ? 0 : 1;
+                bestMs[ cached ] = std::min( bestMs[ cached ], ms );
+            }
+        }
+        std::cout << "    " << std::left << std::setw( 16 ) << method.name << std::right << std::fixed << std::setprecision( 2 ) << std::setw( 7 )
+                  << totalBytes / ( bestMs[0] * 1e6 ) << " GB/s uncached, " << std::setw( 7 ) << totalBytes / ( bestMs[1] * 1e6 ) << " GB/s cached";
+        std::cout.unsetf( std::ios::floatfield );
+        if ( method.async )
+        {
+            std::cout << "  (" << pBackend << ", " << reads << " reads, " << fixedReads << " fixed, " << systemCalls << " submits, " << continued
+                      << " continued" << ( method.direct && !direct ? ", not direct" : "" ) << ")";
+        }
+        std::cout << ( mismatched ? "  MISMATCHED" : "" ) << std::endl;
+        if ( mismatched )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Many small files and a few large ones, read with pread() against AsyncFileIO's backends
+int aioTool( int argc, const char* argv[] )
+{
+    const size_t smallCount = argc > 0 ? (size_t)atol( argv[0] ) : 2048;
+    const uint64_t smallSize = ( argc > 1 ? (uint64_t)atol( argv[1] ) : 16 ) << 10;
+    const size_t largeCount = argc > 2 ? (size_t)atol( argv[2] ) : 4;
+    const uint64_t largeSize = ( argc > 3 ? (uint64_t)atol( argv[3] ) : 64 ) << 20;
+    const uint32_t queueDepth = argc > 4 ? (uint32_t)atoi( argv[4] ) : 64;
+    const std::string directory = argc > 5 ? argv[5] : "/tmp/mmtool_aio";
+    const unsigned int iterations = 3;
+    std::cout << "aio in " << directory << ", queue depth " << queueDepth << ", " << kChunkSize / 1024 << " KB chunks, best of " << iterations
+              << std::endl;
+
+    mkdir( directory.c_str(), 0755 );
+    FileSet small = { "small", {}, smallSize, 0, nullptr, 0 };
+    FileSet large = { "large", {}, largeSize, 0, nullptr, 0 };
+    if ( !createFiles( small, directory, "small", smallCount ) || !createFiles( large, directory, "large", largeCount ) )
+    {
+        return 1;
+    }
+
+    const Method methods[] = {
+        { "pread", false, AsyncFileIO::Backend::Threads, false },
+        { "pread direct", false, AsyncFileIO::Backend::Threads, true },
+        { "threads", true, AsyncFileIO::Backend::Threads, false },
+        { "io_uring", true, AsyncFileIO::Backend::IoUring, false },
+        { "io_uring direct", true, AsyncFileIO::Backend::IoUring, true },
+    };
+    const size_t methodCount = sizeof( methods ) / sizeof( methods[0] );
+    const bool ok = benchmark( small, methods, methodCount, queueDepth, iterations ) && benchmark( large, methods, methodCount, queueDepth, iterations );
+    free( small.pArena );
+    free( large.pArena );
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,339 @@
+//
+//  AnimTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Animation/AnimationClip.hpp"
+#include "Animation/Animator.hpp"
+#include "Animation/Skeleton.hpp"
+#include "Animation/Skinning.hpp"
+#include "Jobs/JobSystem.hpp"
+#include "Maths/Math.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <math.h>
+#include <random>
+
+using Maths::Float4;
+
+static constexpr uint32_t kChainLength = 8;
+static constexpr float kFramesPerSecond = 60.f;
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static Float4 toFloat4( Vector4f v )
+{
+    return Float4{ v.x, v.y, v.z, v.w };
+}
+
+static float maxDifference( const Matrix44f& a, const Matrix44f& b )
+{
+    float difference = 0.f;
+    for ( int c = 0; c < 4; ++c )
+    {
+        const Vector4f d = a.columns[c] - b.columns[c];
+        difference = std::max( { difference, fabsf( d.x ), fabsf( d.y ), fabsf( d.z ), fabsf( d.w ) } );
+    }
+    return difference;
+}
+
+static float distance( Vector3f a, Vector3f b )
+{
+    const Vector3f d = a - b;
+    return sqrtf( d.x * d.x + d.y * d.y + d.z * d.z );
+}
+
+// A root, a spine chain above it and chains of kChainLength hanging off random spine bones,
+// each bone a little way along from its parent and turned a little
+static void buildSkeleton( uint32_t boneCount, std::mt19937& rng, Skeleton& skeleton )
+{
+    std::uniform_real_distribution<float> unit( -1.f, 1.f );
+    for ( uint32_t bone = 0; bone < boneCount; ++bone )
+    {
+        uint32_t parent = Skeleton::kNoParent;
+        if ( bone > 0 )
+        {
+            parent = ( bone - 1 ) % kChainLength != 0 ? bone - 1 : bone == 1 ? 0 : 1 + rng() % std::min( kChainLength, bone - 1 );
+        }
+        BonePose pose;
+        pose.rotation = toFloat4( Maths::makeQuaternion( { unit( rng ), unit( rng ), unit( rng ) }, unit( rng ) * 0.3f ) );
+        pose.translation = bone == 0 ? Float4{ 0.f, 0.f, 0.f, 0.f } : Float4{ 0.02f * unit( rng ), 0.12f, 0.02f * unit( rng ), 0.f };
+        pose.scale = Maths::splat( 1.f );
+        pose.scale[3] = 0.f;
+        skeleton.addBone( parent, pose );
+    }
+}
+
+// Every bone swinging about its own axis over whole cycles of the clip, so it loops - 1 in 4
+// bones held still, as fingers and helpers mostly are - and the root bobbing up and down
+static std::vector<BonePose> buildFrames( const Skeleton& skeleton, uint32_t frameCount, float cycles, std::mt19937& rng )
+{
+    std::uniform_real_distribution<float> unit( -1.f, 1.f );
+    const uint32_t boneCount = skeleton.boneCount();
+    std::vector<BonePose> frames( (size_t)frameCount * boneCount );
+    for ( uint32_t bone = 0; bone < boneCount; ++bone )
+    {
+        const Vector3f axis = { unit( rng ), unit( rng ), unit( rng ) };
+        const float amplitude = rng() % 4 == 0 ? 0.f : 0.2f + 0.4f * fabsf( unit( rng ) );
+        const float phase = unit( rng ) * 3.14159265f;
+        const BonePose& bind = skeleton.bindPose()[ bone ];
+        const Vector4f bindRotation = { bind.rotation[0], bind.rotation[1], bind.rotation[2], bind.rotation[3] };
+        for ( uint32_t frame = 0; frame < frameCount; ++frame )
+        {
+            const float cycle = 2.f * 3.14159265f * cycles * (float)frame / (float)( frameCount - 1 );
+            BonePose& pose = frames[ (size_t)frame * boneCount + bone ];
+            pose = bind;
+            if ( amplitude > 0.f )
+            {
+                pose.rotation = toFloat4( Maths::multiplyQuaternions( bindRotation, Maths::makeQuaternion( axis, amplitude * sinf( cycle + phase ) ) ) );
+            }
+            if ( bone == 0 )
+            {
+                pose.translation[1] = 0.03f * sinf( 2.f * cycle );
+            }
+        }
+    }
+    return frames;
+}
+
+// Largest difference between the raw frames and the clip sampled at them, as the local
+// rotation angle and as where the skin matrices put the bones
+static void measureClip( const Skeleton& skeleton, const AnimationClip& clip, const std::vector<BonePose>& frames, float& rotationError, float& positionError )
+{
+    const uint32_t boneCount = skeleton.boneCount();
+    std::vector<BonePose> pose( boneCount );
+    std::vector<Matrix44f> rawSkin( boneCount );
+    std::vector<Matrix44f> sampledSkin( boneCount );
+    rotationError = 0.f;
+    positionError = 0.f;
+    for ( uint32_t frame = 0; frame < clip.frameCount(); ++frame )
+    {
+        const BonePose* pRaw = &frames[ (size_t)frame * boneCount ];
+        clip.sample( (float)frame / kFramesPerSecond, pose.data() );
+        for ( uint32_t bone = 0; bone < boneCount; ++bone )
+        {
+            // 4 asin( chord / 2 ) - acos of the dot product is all rounding this close to 1
+            const Float4 raw = pRaw[ bone ].rotation;
+            const Float4 difference = pose[ bone ].rotation - ( Pose::dot( pose[ bone ].rotation, raw ) < 0.f ? -raw : raw );
+            const float chord = sqrtf( Pose::dot( difference, difference ) );
+            rotationError = std::max( rotationError, 4.f * asinf( std::min( 1.f, chord * 0.5f ) ) );
+        }
+        const BonePose* ppPoses[2] = { pRaw, pose.data() };
+        Matrix44f* ppSkin[2] = { rawSkin.data(), sampledSkin.data() };
+        skeleton.skinMatrices( ppPoses, ppSkin, 2 );
+        for ( uint32_t bone = 0; bone < boneCount; ++bone )
+        {
+            const Vector3f bindPosition = simd_make_float3( skeleton.bindMatrix( bone ).columns[3] );
+            const Vector3f raw = simd_make_float3( rawSkin[ bone ] * (Vector4f){ bindPosition.x, bindPosition.y, bindPosition.z, 1.f } );
+            const Vector3f sampled = simd_make_float3( sampledSkin[ bone ] * (Vector4f){ bindPosition.x, bindPosition.y, bindPosition.z, 1.f } );
+            positionError = std::max( positionError, distance( raw, sampled ) );
+        }
+    }
+}
+
+// Compresses two procedural clips and measures them, checks the skin matrices and the skinning
+// kernel against scalar references, then times the animator (sample, blend, skin matrices) and
+// skinning over a crowd of characters
+int animTool( int argc, const char* argv[] )
+{
+    const uint32_t characterCount = argc > 0 ? (uint32_t)atoi( argv[0] ) : 4096;
+    const uint32_t boneCount = argc > 1 ? (uint32_t)atoi( argv[1] ) : 64;
+    const uint32_t vertexCount = argc > 2 ? (uint32_t)atoi( argv[2] ) : 4096;
+    const uint32_t updates = argc > 3 ? (uint32_t)atoi( argv[3] ) : 30;
+    if ( characterCount == 0 || boneCount == 0 || boneCount > Skeleton::kMaxBones || vertexCount == 0 || updates == 0 )
+    {
+        std::cout << "anim: need characters, 1 to " << Skeleton::kMaxBones << " bones, vertices and updates" << std::endl;
+        return 1;
+    }
+
+    std::mt19937 rng( 1234 );
+    Skeleton skeleton;
+    buildSkeleton( boneCount, rng, skeleton );
+
+    // a walk and a run, compressed
+    AnimationClip clips[2];
+    std::vector<BonePose> frames[2];
+    const char* names[2] = { "walk", "run" };
+    const uint32_t frameCounts[2] = { 121, 91 };
+    const float cycles[2] = { 2.f, 3.f };
+    const AnimationClip::Options options;
+    for ( int i = 0; i < 2; ++i )
+    {
+        frames[i] = buildFrames( skeleton, frameCounts[i], cycles[i], rng );
+        auto start = std::chrono::steady_clock::now();
+        clips[i].build( frames[i].data(), frameCounts[i], boneCount, kFramesPerSecond, options );
+        const double buildMs = elapsedMs( start );
+        const size_t rawBytes = frames[i].size() * 10 * sizeof( float );
+        float rotationError = 0.f;
+        float positionError = 0.f;
+        measureClip( skeleton, clips[i], frames[i], rotationError, positionError );
+        std::cout << "anim " << names[i] << ": " << frameCounts[i] << " frames, " << boneCount << " bones, " << clips[i].keyCount() << " keys of "
+                  << (size_t)frameCounts[i] * boneCount * 3 << ", " << rawBytes << " -> " << clips[i].sizeInBytes() << " bytes ("
+                  << (double)rawBytes / (double)clips[i].sizeInBytes() << "x) in " << buildMs << " ms" << std::endl;
+        std::cout << "  max error " << rotationError << " rad local rotation, " << positionError << " bone position" << std::endl;
+    }
+
+    // skin matrices against a scalar chain of Maths::makeTransform, 4 different poses in the lanes
+    {
+        std::vector<Matrix44f> skin( 4 * boneCount );
+        const BonePose* ppPoses[4];
+        Matrix44f* ppSkin[4];
+        for ( uint32_t k = 0; k < 4; ++k )
+        {
+            ppPoses[k] = &frames[ k & 1 ][ (size_t)( k * 17 ) * boneCount ];
+            ppSkin[k] = &skin[ k * boneCount ];
+        }
+        skeleton.skinMatrices( ppPoses, ppSkin, 4 );
+        float skinError = 0.f;
+        std::vector<Matrix44f> model( boneCount );
+        for ( uint32_t k = 0; k < 4; ++k )
+        {
+            for ( uint32_t bone = 0; bone < boneCount; ++bone )
+            {
+                const BonePose& pose = ppPoses[k][ bone ];
+                const Matrix44f local = Maths::makeTransform( { pose.translation[0], pose.translation[1], pose.translation[2] },
+                                                              { pose.rotation[0], pose.rotation[1], pose.rotation[2], pose.rotation[3] },
+                                                              { pose.scale[0], pose.scale[1], pose.scale[2] } );
+                const uint32_t parent = skeleton.parent( bone );
+                model[ bone ] = parent == Skeleton::kNoParent ? local : model[ parent ] * local;
+                skinError = std::max( skinError, maxDifference( ppSkin[k][ bone ] * skeleton.bindMatrix( bone ), model[ bone ] ) );
+            }
+        }
+        const BonePose* pBind = skeleton.bindPose();
+        skeleton.skinMatrices( &pBind, ppSkin, 1 );
+        const Matrix44f identity = simd_matrix( (Vector4f){ 1.f, 0.f, 0.f, 0.f }, (Vector4f){ 0.f, 1.f, 0.f, 0.f },
+                                                (Vector4f){ 0.f, 0.f, 1.f, 0.f }, (Vector4f){ 0.f, 0.f, 0.f, 1.f } );
+        float bindError = 0.f;
+        for ( uint32_t bone = 0; bone < boneCount; ++bone )
+        {
+            bindError = std::max( bindError, maxDifference( skin[ bone ], identity ) );
+        }
+        std::cout << "  skin matrices match the scalar reference to " << skinError << ", bind pose identity to " << bindError << std::endl;
+    }
+
+    // the crowd - everyone blending the walk into the run by their own amount, at their own times
+    Animator animator( skeleton );
+    std::uniform_real_distribution<float> unit( 0.f, 1.f );
+    for ( uint32_t i = 0; i < characterCount; ++i )
+    {
+        animator.addCharacter( { &clips[0], &clips[1], unit( rng ) * clips[0].duration(), unit( rng ) * clips[1].duration(), unit( rng ) } );
+    }
+    animator.update( 0.f );
+    auto start = std::chrono::steady_clock::now();
+    for ( uint32_t update = 0; update < updates; ++update )
+    {
+        animator.update( 1.f / 60.f );
+    }
+    const double updateMs = elapsedMs( start ) / updates;
+    const double bonesPerUpdate = (double)characterCount * boneCount;
+    std::cout << "  " << characterCount << " characters on " << JobSystem::Instance()->numThreads() << " threads: update (2 clips sampled, blended, skin matrices) "
+              << updateMs << " ms, " << bonesPerUpdate / updateMs / 1e3 << " M bones/s" << std::endl;
+
+    // the hierarchy pass alone, 4 characters a pass against 1, on this thread
+    {
+        std::vector<BonePose> poses( 4 * (size_t)boneCount );
+        for ( uint32_t k = 0; k < 4; ++k )
+        {
+            clips[ k & 1 ].sample( 0.1f * k, &poses[ k * boneCount ] );
+        }
+        std::vector<Matrix44f> skin( 4 * (size_t)boneCount );
+        const BonePose* ppPoses[4];
+        Matrix44f* ppSkin[4];
+        for ( uint32_t k = 0; k < 4; ++k )
+        {
+            ppPoses[k] = &poses[ k * boneCount ];
+            ppSkin[k] = &skin[ k * boneCount ];
+        }
+        const uint32_t passes = std::max<uint32_t>( 1, characterCount / 4 );
+        start = std::chrono::steady_clock::now();
+        for ( uint32_t pass = 0; pass < passes; ++pass )
+        {
+            skeleton.skinMatrices( ppPoses, ppSkin, 4 );
+        }
+        const double fourMs = elapsedMs( start );
+        start = std::chrono::steady_clock::now();
+        for ( uint32_t pass = 0; pass < passes * 4; ++pass )
+        {
+            skeleton.skinMatrices( &ppPoses[ pass & 3 ], &ppSkin[ pass & 3 ], 1 );
+        }
+        const double oneMs = elapsedMs( start );
+        const double bones = (double)passes * 4 * boneCount;
+        std::cout << "  skin matrices alone, 1 thread: 4 characters a pass " << bones / fourMs / 1e3 << " M bones/s, 1 a pass "
+                  << bones / oneMs / 1e3 << " M bones/s" << std::endl;
+    }
+
+    // a mesh of vertexCount vertices around the bones, each on its bone and the bone's parent
+    std::vector<VertexData> mesh( vertexCount );
+    std::vector<BoneWeights> weights( vertexCount );
+    {
+        std::uniform_real_distribution<float> offset( -0.05f, 0.05f );
+        for ( uint32_t i = 0; i < vertexCount; ++i )
+        {
+            const uint32_t bone = i % boneCount;
+            const uint32_t parent = skeleton.parent( bone ) == Skeleton::kNoParent ? bone : skeleton.parent( bone );
+            const Vector3f center = simd_make_float3( skeleton.bindMatrix( bone ).columns[3] );
+            Vector3f normal = { offset( rng ), offset( rng ), offset( rng ) + 0.01f };
+            normal = normal * ( 1.f / sqrtf( normal.x * normal.x + normal.y * normal.y + normal.z * normal.z ) );
+            mesh[i].position = center + normal * 0.05f + (Vector3f){ 0.f, offset( rng ), 0.f };
+            mesh[i].normal = normal;
+            mesh[i].texcoord = { unit( rng ), unit( rng ) };
+            const uint32_t bones[4] = { bone, parent, 0, 0 };
+            const float w = 0.5f + 0.5f * unit( rng );
+            const float vertexWeights[4] = { w, 1.f - w, 0.f, 0.f };
+            weights[i] = Skinning::makeWeights( bones, vertexWeights );
+        }
+    }
+
+    // the kernel against the reference on the first character's pose
+    {
+        std::vector<VertexData> skinned( vertexCount );
+        std::vector<VertexData> reference( vertexCount );
+        Skinning::skin( animator.skinMatrices( 0 ), mesh.data(), weights.data(), vertexCount, skinned.data() );
+        Skinning::skinReference( animator.skinMatrices( 0 ), mesh.data(), weights.data(), vertexCount, reference.data() );
+        float positionError = 0.f;
+        float normalError = 0.f;
+        for ( uint32_t i = 0; i < vertexCount; ++i )
+        {
+            positionError = std::max( positionError, distance( skinned[i].position, reference[i].position ) );
+            normalError = std::max( normalError, distance( skinned[i].normal, reference[i].normal ) );
+        }
+        std::cout << "  skinning matches the reference to " << positionError << " position, " << normalError << " normal" << std::endl;
+    }
+
+    // every character's copy of the mesh, a job per few characters each skinning into its own scratch
+    auto skinCrowd = [&]( uint32_t characters, bool reference )
+    {
+        auto skinStart = std::chrono::steady_clock::now();
+        JobSystem::Instance()->parallelFor( characters, 16, [&]( size_t begin, size_t end )
+        {
+            std::vector<VertexData> skinned( vertexCount );
+            for ( size_t character = begin; character < end; ++character )
+            {
+                const Matrix44f* pSkin = animator.skinMatrices( (Animator::CharacterId)character );
+                if ( reference )
+                {
+                    Skinning::skinReference( pSkin, mesh.data(), weights.data(), vertexCount, skinned.data() );
+                }
+                else
+                {
+                    Skinning::skin( pSkin, mesh.data(), weights.data(), vertexCount, skinned.data() );
+                }
+            }
+        } );
+        return (double)characters * vertexCount / elapsedMs( skinStart ) / 1e3;
+    };
+    skinCrowd( std::min<uint32_t>( characterCount, 64 ), false );
+    const double verticesPerSecond = skinCrowd( characterCount, false );
+    const double referencePerSecond = skinCrowd( std::min<uint32_t>( characterCount, 256 ), true );
+    std::cout << "  skinning " << characterCount << " x " << vertexCount << " vertices: " << verticesPerSecond << " M vertices/s (scalar reference "
+              << referencePerSecond << ")" << std::endl;
+    return 0;
+}
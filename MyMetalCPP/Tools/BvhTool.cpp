@@ -0,0 +1,268 @@
+//
+//  BvhTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Jobs/JobSystem.hpp"
+#include "Maths/Math.hpp"
+#include "Scene/CubeScene.hpp"
+#include "Spatial/Bvh.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <math.h>
+#include <random>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// One leaf holding everything - every query against it is a brute force loop over the primitives
+static Bvh::BuildOptions bruteForceOptions( size_t count )
+{
+    Bvh::BuildOptions options;
+    options.maxLeafSize = (uint32_t)count;
+    options.traversalCost = 1e30f;
+    return options;
+}
+
+static Bvh::Aabb instanceBox( const InstanceData& instance )
+{
+    // the unit cube through the instance transform
+    const Matrix44f& m = instance.instanceTransform;
+    Bvh::Aabb box;
+    const float center[3] = { m.columns[3].x, m.columns[3].y, m.columns[3].z };
+    for ( int a = 0; a < 3; ++a )
+    {
+        const float extent = 0.5f * ( fabsf( ( &m.columns[0].x )[a] ) + fabsf( ( &m.columns[1].x )[a] ) + fabsf( ( &m.columns[2].x )[a] ) );
+        box.min[a] = center[a] - extent;
+        box.max[a] = center[a] + extent;
+    }
+    return box;
+}
+
+template<typename TreeType>
+static void benchmarkRays( const char* name, const TreeType& tree, const std::vector<Bvh::Ray>& rays, std::vector<Bvh::Hit>& hits )
+{
+    double bestMs = 1e30;
+    for ( int i = 0; i < 3; ++i )
+    {
+        const auto start = std::chrono::steady_clock::now();
+        tree.raycast( rays.data(), hits.data(), rays.size() );
+        bestMs = std::min( bestMs, elapsedMs( start ) );
+    }
+    const size_t hitCount = std::count_if( hits.begin(), hits.end(), []( const Bvh::Hit& hit ) { return hit.primitive != Bvh::kNoHit; } );
+    std::cout << "    " << name << ": " << rays.size() << " rays " << bestMs << " ms (" << rays.size() / bestMs / 1e3 << " Mrays/s), "
+              << hitCount << " hits" << std::endl;
+}
+
+// Checks the closest hits of a subset of rays against a brute force loop, returns the number that differ
+template<typename TreeType>
+static size_t checkRays( const TreeType& tree, const Bvh::Tree4& bruteForce, const std::vector<Bvh::Ray>& rays, size_t count )
+{
+    size_t mismatches = 0;
+    for ( size_t i = 0; i < std::min( count, rays.size() ); ++i )
+    {
+        Bvh::Hit hit, expected;
+        tree.raycast( rays[i], hit );
+        bruteForce.raycast( rays[i], expected );
+        if ( hit.primitive != expected.primitive && fabsf( hit.t - expected.t ) > 1e-4f * std::max( 1.f, expected.t ) )
+        {
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+static void benchmarkBuild( const char* name, const std::function<Bvh::BuildStats()>& build )
+{
+    double bestMs = 1e30;
+    Bvh::BuildStats stats = {};
+    for ( int i = 0; i < 3; ++i )
+    {
+        const auto start = std::chrono::steady_clock::now();
+        stats = build();
+        bestMs = std::min( bestMs, elapsedMs( start ) );
+    }
+    std::cout << "    " << name << ": built in " << bestMs << " ms, " << stats.binaryNodes << " binary -> " << stats.nodes << " nodes, "
+              << stats.leaves << " leaves, depth " << stats.depth << ", SAH cost " << stats.sahCost << std::endl;
+}
+
+// Builds triangle and box BVHs 4 and 8 wide, checks ray casts, frustum queries and picking
+// against brute force, and reports build, refit and query times
+int bvhTool( int argc, const char* argv[] )
+{
+    const unsigned int segments = argc > 0 ? (unsigned int)atoi( argv[0] ) : 400;
+    const size_t boxCount = argc > 1 ? (size_t)atol( argv[1] ) : 1000000;
+    const size_t rayCount = argc > 2 ? (size_t)atol( argv[2] ) : 1000000;
+    if ( segments == 0 || boxCount == 0 || rayCount == 0 )
+    {
+        std::cout << "usage: mmtool bvh [segments > 0] [boxes > 0] [rays > 0]" << std::endl;
+        return 1;
+    }
+    std::mt19937 rng( 1234 );
+    std::uniform_real_distribution<float> unit( -1.f, 1.f );
+
+    // triangles - the shuffled sphere soup, rays from outside towards the middle
+    std::vector<VertexData> vertices;
+    std::vector<uint32_t> indices;
+    buildTestMesh( segments, 2, vertices, indices );
+    const size_t triangleCount = indices.size() / 3;
+    std::cout << "bvh " << triangleCount << " triangles on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+
+    Bvh::Tree4 triangles4;
+    Bvh::Tree8 triangles8;
+    benchmarkBuild( "4 wide", [&]() { return triangles4.build( indices.data(), indices.size(), vertices.data() ); } );
+    benchmarkBuild( "8 wide", [&]() { return triangles8.build( indices.data(), indices.size(), vertices.data() ); } );
+
+    std::vector<Bvh::Ray> rays( rayCount );
+    for ( Bvh::Ray& ray : rays )
+    {
+        float origin[3] = { unit( rng ), unit( rng ), unit( rng ) };
+        const float length = sqrtf( origin[0] * origin[0] + origin[1] * origin[1] + origin[2] * origin[2] ) + 1e-6f;
+        for ( int a = 0; a < 3; ++a )
+        {
+            ray.origin[a] = origin[a] / length * 3.f;
+            ray.direction[a] = unit( rng ) * 0.5f - ray.origin[a];
+        }
+        ray.tMax = INFINITY;
+    }
+    std::vector<Bvh::Hit> hits( rayCount );
+    benchmarkRays( "4 wide", triangles4, rays, hits );
+    benchmarkRays( "8 wide", triangles8, rays, hits );
+
+    Bvh::Tree4 triangleBruteForce;
+    triangleBruteForce.build( indices.data(), indices.size(), vertices.data(), bruteForceOptions( triangleCount ) );
+    std::cout << "    closest hits differing from brute force over 200 rays: " << checkRays( triangles4, triangleBruteForce, rays, 200 )
+              << " 4 wide, " << checkRays( triangles8, triangleBruteForce, rays, 200 ) << " 8 wide" << std::endl;
+
+    // boxes - scattered through a 200 unit cube, as instances of a big scene would be
+    std::vector<Bvh::Aabb> boxes( boxCount );
+    for ( Bvh::Aabb& box : boxes )
+    {
+        for ( int a = 0; a < 3; ++a )
+        {
+            const float center = unit( rng ) * 100.f;
+            const float extent = 0.1f + 0.4f * fabsf( unit( rng ) );
+            box.min[a] = center - extent;
+            box.max[a] = center + extent;
+        }
+    }
+    std::cout << "  " << boxCount << " boxes" << std::endl;
+    Bvh::Tree4 boxes4;
+    Bvh::Tree8 boxes8;
+    benchmarkBuild( "4 wide", [&]() { return boxes4.build( boxes.data(), boxes.size() ); } );
+    benchmarkBuild( "8 wide", [&]() { return boxes8.build( boxes.data(), boxes.size() ); } );
+
+    // everything drifts a little, refit rather than rebuild
+    for ( Bvh::Aabb& box : boxes )
+    {
+        for ( int a = 0; a < 3; ++a )
+        {
+            const float offset = unit( rng ) * 0.5f;
+            box.min[a] += offset;
+            box.max[a] += offset;
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    boxes4.refit( boxes.data() );
+    const double refit4Ms = elapsedMs( start );
+    start = std::chrono::steady_clock::now();
+    boxes8.refit( boxes.data() );
+    std::cout << "    refit after moving every box " << refit4Ms << " ms 4 wide, " << elapsedMs( start ) << " ms 8 wide" << std::endl;
+
+    // frustum from the middle of the boxes, against testing each one
+    CameraData camera;
+    CubeScene::updateCamera( &camera, 16.f / 9.f );
+    Vector4f planes[6];
+    Maths::extractFrustumPlanes( camera.perspectiveTransform * camera.worldTransform, planes );
+    std::vector<uint32_t> expected;
+    start = std::chrono::steady_clock::now();
+    for ( size_t i = 0; i < boxCount; ++i )
+    {
+        bool outside = false;
+        for ( int p = 0; p < 6 && !outside; ++p )
+        {
+            const Bvh::Aabb& box = boxes[i];
+            const float x = planes[p].x >= 0.f ? box.max[0] : box.min[0];
+            const float y = planes[p].y >= 0.f ? box.max[1] : box.min[1];
+            const float z = planes[p].z >= 0.f ? box.max[2] : box.min[2];
+            outside = planes[p].x * x + planes[p].y * y + planes[p].z * z + planes[p].w < 0.f;
+        }
+        if ( !outside )
+        {
+            expected.push_back( (uint32_t)i );
+        }
+    }
+    const double bruteForceMs = elapsedMs( start );
+
+    std::vector<uint32_t> visible4, visible8;
+    start = std::chrono::steady_clock::now();
+    boxes4.queryFrustum( planes, visible4 );
+    const double query4Ms = elapsedMs( start );
+    start = std::chrono::steady_clock::now();
+    boxes8.queryFrustum( planes, visible8 );
+    const double query8Ms = elapsedMs( start );
+    std::sort( visible4.begin(), visible4.end() );
+    std::sort( visible8.begin(), visible8.end() );
+    std::cout << "    frustum query " << visible4.size() << " visible: " << query4Ms << " ms 4 wide, " << query8Ms << " ms 8 wide, "
+              << bruteForceMs << " ms brute force, " << ( visible4 == expected && visible8 == expected ? "same set" : "DIFFERENT SETS" ) << std::endl;
+
+    for ( Bvh::Ray& ray : rays )
+    {
+        for ( int a = 0; a < 3; ++a )
+        {
+            ray.origin[a] = unit( rng ) * 100.f;
+            ray.direction[a] = unit( rng );
+        }
+        ray.tMax = INFINITY;
+    }
+    benchmarkRays( "4 wide", boxes4, rays, hits );
+    benchmarkRays( "8 wide", boxes8, rays, hits );
+    Bvh::Tree4 boxBruteForce;
+    boxBruteForce.build( boxes.data(), boxes.size(), bruteForceOptions( boxCount ) );
+    std::cout << "    closest hits differing from brute force over 200 rays: " << checkRays( boxes4, boxBruteForce, rays, 200 )
+              << " 4 wide, " << checkRays( boxes8, boxBruteForce, rays, 200 ) << " 8 wide" << std::endl;
+
+    // picking the cube scene's instances through a grid of screen positions
+    std::vector<InstanceData> instances( kNumInstances );
+    CubeScene::updateInstances( instances.data(), 0.5f );
+    std::vector<Bvh::Aabb> instanceBoxes( kNumInstances );
+    for ( size_t i = 0; i < kNumInstances; ++i )
+    {
+        instanceBoxes[i] = instanceBox( instances[i] );
+    }
+    Bvh::Tree8 picker;
+    Bvh::Tree4 pickerBruteForce;
+    start = std::chrono::steady_clock::now();
+    picker.build( instanceBoxes.data(), instanceBoxes.size() );
+    const double pickBuildMs = elapsedMs( start );
+    pickerBruteForce.build( instanceBoxes.data(), instanceBoxes.size(), bruteForceOptions( kNumInstances ) );
+
+    std::vector<Bvh::Ray> pickRays;
+    for ( int y = 0; y < 64; ++y )
+    {
+        for ( int x = 0; x < 64; ++x )
+        {
+            pickRays.push_back( Bvh::makeCameraRay( camera, ( x + 0.5f ) / 32.f - 1.f, ( y + 0.5f ) / 32.f - 1.f ) );
+        }
+    }
+    size_t picked = 0;
+    start = std::chrono::steady_clock::now();
+    for ( const Bvh::Ray& ray : pickRays )
+    {
+        Bvh::Hit hit;
+        picked += picker.raycast( ray, hit ) ? 1 : 0;
+    }
+    const double pickMs = elapsedMs( start );
+    std::cout << "  picking " << kNumInstances << " cube instances: built in " << pickBuildMs << " ms, " << pickRays.size() << " picks "
+              << pickMs * 1e3 / pickRays.size() << " us each, " << picked << " hit something, "
+              << checkRays( picker, pickerBruteForce, pickRays, pickRays.size() ) << " differ from brute force" << std::endl;
+    return 0;
+}
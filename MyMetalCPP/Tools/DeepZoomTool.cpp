@@ -0,0 +1,48 @@
+//
+//  DeepZoomTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Fractal/DeepZoom.hpp"
+#include "Jobs/JobSystem.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Zooms from scale 2 down to 1e-28 and reports CPU frame times - same path as the Renderer's CPU mode
+int deepZoomTool( int argc, const char* argv[] )
+{
+    const unsigned int width = argc > 0 ? (unsigned int)atoi( argv[0] ) : 512;
+    const unsigned int height = argc > 1 ? (unsigned int)atoi( argv[1] ) : 512;
+    const unsigned int frames = argc > 2 ? (unsigned int)atoi( argv[2] ) : 8;
+
+    DeepZoom zoom;
+    zoom.setCenter( Maths::parseDoubleDouble( DeepZoom::kDemoCenterX ), Maths::parseDoubleDouble( DeepZoom::kDemoCenterY ) );
+    zoom.setMaxIterations( 8192 );
+
+    std::vector<uint8_t> pixels( (size_t)width * height * 4 );
+
+    std::cout << "deepzoom " << width << "x" << height << " on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+    double totalMs = 0.0;
+    for ( unsigned int i = 0; i < frames; ++i )
+    {
+        double exponent = frames > 1 ? 28.0 * i / ( frames - 1 ) : 28.0;
+        zoom.setScale( 2.0 * pow( 10.0, -exponent ) );
+        zoom.prepare( width, height );
+        zoom.render( pixels.data(), width * 4 );
+
+        const DeepZoom::Stats& stats = zoom.stats();
+        double frameMs = stats.orbitMs + stats.renderMs;
+        totalMs += frameMs;
+        std::cout << "  scale 2e-" << (int)exponent
+                  << "  orbit " << stats.orbitLength << " skip " << stats.skipIterations
+                  << "  rebases " << stats.rebases
+                  << "  " << stats.iterations / ( stats.renderMs * 1000.0 ) << " Miter/s"
+                  << "  " << frameMs << " ms" << std::endl;
+    }
+    std::cout << "average " << totalMs / frames << " ms/frame" << std::endl;
+    return 0;
+}
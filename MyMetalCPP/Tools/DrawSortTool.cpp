@@ -0,0 +1,117 @@
+//
+//  DrawSortTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Jobs/JobSystem.hpp"
+#include "Jobs/RadixSort.hpp"
+#include "Renderer/DrawQueue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <utility>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static void printChanges( const char* name, size_t drawCalls, const DrawQueue::StateChanges& changes )
+{
+    std::cout << "    " << name << ": " << drawCalls << " draw calls, " << changes.pipelines << " pipeline, " << changes.textures
+              << " texture, " << changes.meshes << " mesh binds" << std::endl;
+}
+
+// Submits draws of a random scene in random order - every mesh has its own material, a pipeline
+// and a texture - then checks the radix sort against std::stable_sort, times both, and reports
+// how many draws and binds are left once the queue is sorted and batched
+int drawSortTool( int argc, const char* argv[] )
+{
+    const size_t drawCount = argc > 0 ? (size_t)atol( argv[0] ) : 1000000;
+    const unsigned int pipelines = argc > 1 ? (unsigned int)atoi( argv[1] ) : 8;
+    const unsigned int textures = argc > 2 ? (unsigned int)atoi( argv[2] ) : 256;
+    const unsigned int meshes = argc > 3 ? (unsigned int)atoi( argv[3] ) : 512;
+    const unsigned int depthLevels = argc > 4 ? (unsigned int)atoi( argv[4] ) : DrawQueue::kDefaultDepthLevels;
+    const unsigned int runs = argc > 5 ? (unsigned int)atoi( argv[5] ) : 10;
+    std::mt19937 rng( 1234 );
+
+    std::vector<uint32_t> meshPipeline( meshes ), meshTexture( meshes );
+    for ( unsigned int m = 0; m < meshes; ++m )
+    {
+        meshPipeline[m] = rng() % pipelines;
+        meshTexture[m] = rng() % textures;
+    }
+    std::vector<uint64_t> keys( drawCount );
+    std::uniform_real_distribution<float> depth( 0.f, 1.f );
+    for ( uint64_t& key : keys )
+    {
+        const uint32_t mesh = rng() % meshes;
+        key = DrawQueue::makeKey( meshPipeline[ mesh ], meshTexture[ mesh ], depth( rng ), mesh, depthLevels );
+    }
+    std::cout << "drawsort " << drawCount << " draws, " << pipelines << " pipelines, " << textures << " textures, " << meshes
+              << " meshes, " << depthLevels << " depth levels on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+
+    // the sort alone, against the standard library
+    std::vector<uint64_t> sortedKeys( drawCount ), scratchKeys( drawCount );
+    std::vector<uint32_t> values( drawCount ), scratchValues( drawCount );
+    double radixMs = 1e30;
+    uint32_t passes = 0;
+    for ( unsigned int run = 0; run < runs; ++run )
+    {
+        sortedKeys = keys;
+        for ( size_t i = 0; i < drawCount; ++i )
+        {
+            values[i] = (uint32_t)i;
+        }
+        const auto start = std::chrono::steady_clock::now();
+        passes = RadixSort::sort( sortedKeys.data(), values.data(), drawCount, scratchKeys.data(), scratchValues.data() );
+        radixMs = std::min( radixMs, elapsedMs( start ) );
+    }
+
+    std::vector<std::pair<uint64_t, uint32_t>> pairs( drawCount );
+    for ( size_t i = 0; i < drawCount; ++i )
+    {
+        pairs[i] = { keys[i], (uint32_t)i };
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::stable_sort( pairs.begin(), pairs.end(), []( const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b )
+    {
+        return a.first < b.first;
+    } );
+    const double stableSortMs = elapsedMs( start );
+    size_t mismatches = 0;
+    for ( size_t i = 0; i < drawCount; ++i )
+    {
+        mismatches += sortedKeys[i] != pairs[i].first || values[i] != pairs[i].second ? 1 : 0;
+    }
+    std::cout << "  radix sort " << radixMs << " ms (" << drawCount / radixMs / 1e3 << " Mkeys/s, " << passes << " of 8 passes), std::stable_sort "
+              << stableSortMs << " ms, " << mismatches << " differ" << std::endl;
+
+    // the whole queue
+    DrawQueue queue;
+    queue.reserve( drawCount );
+    for ( size_t i = 0; i < drawCount; ++i )
+    {
+        queue.submit( keys[i], (uint32_t)i );
+    }
+    start = std::chrono::steady_clock::now();
+    queue.build();
+    const double buildMs = elapsedMs( start );
+    const DrawQueue::Stats& stats = queue.stats();
+
+    size_t instances = 0;
+    for ( const DrawQueue::Batch& batch : queue.batches() )
+    {
+        instances += batch.instanceCount;
+    }
+    std::cout << "  queue built in " << buildMs << " ms (sort " << stats.sortMs << ", batch " << stats.batchMs << "), "
+              << instances << " instances in " << stats.batches << " batches" << std::endl;
+    printChanges( "submitted", stats.draws, stats.submitted );
+    printChanges( "batched", stats.batches, stats.batched );
+    return 0;
+}
@@ -0,0 +1,305 @@
+//
+//  HeapTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Renderer/HeapAllocator.hpp"
+#include "Renderer/TlsfAllocator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <math.h>
+#include <random>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Best fit over ordered maps, the usual allocator before reaching for TLSF - O(log n) both ways
+class MapAllocator
+{
+public:
+    MapAllocator( uint64_t capacity, uint64_t granularity )
+    : _granularity( granularity )
+    {
+        insertFree( 0, capacity / granularity * granularity );
+    }
+
+    // ~0ull when nothing fits
+    uint64_t allocate( uint64_t size, uint64_t alignment )
+    {
+        size = std::max( _granularity, ( size + _granularity - 1 ) / _granularity * _granularity );
+        alignment = std::max( alignment, _granularity );
+        auto found = _bySize.lower_bound( size + alignment - _granularity );
+        if ( found == _bySize.end() )
+        {
+            return ~0ull;
+        }
+        const uint64_t offset = found->second, blockSize = found->first;
+        eraseFree( offset, blockSize );
+        const uint64_t aligned = ( offset + alignment - 1 ) & ~( alignment - 1 );
+        if ( aligned > offset )
+        {
+            insertFree( offset, aligned - offset );
+        }
+        if ( offset + blockSize > aligned + size )
+        {
+            insertFree( aligned + size, offset + blockSize - aligned - size );
+        }
+        return aligned;
+    }
+
+    void free( uint64_t offset, uint64_t size )
+    {
+        size = std::max( _granularity, ( size + _granularity - 1 ) / _granularity * _granularity );
+        auto next = _byOffset.lower_bound( offset );
+        if ( next != _byOffset.end() && next->first == offset + size )
+        {
+            size += next->second;
+            eraseFree( next->first, next->second );
+        }
+        auto prev = _byOffset.lower_bound( offset );
+        if ( prev != _byOffset.begin() && ( --prev )->first + prev->second == offset )
+        {
+            offset = prev->first;
+            size += prev->second;
+            eraseFree( prev->first, prev->second );
+        }
+        insertFree( offset, size );
+    }
+
+private:
+    void insertFree( uint64_t offset, uint64_t size )
+    {
+        _byOffset[ offset ] = size;
+        _bySize.insert( { size, offset } );
+    }
+
+    void eraseFree( uint64_t offset, uint64_t size )
+    {
+        _byOffset.erase( offset );
+        auto range = _bySize.equal_range( size );
+        for ( auto it = range.first; it != range.second; ++it )
+        {
+            if ( it->second == offset )
+            {
+                _bySize.erase( it );
+                break;
+            }
+        }
+    }
+
+    uint64_t _granularity;
+    std::map<uint64_t, uint64_t> _byOffset;
+    std::multimap<uint64_t, uint64_t> _bySize;
+};
+
+struct ChurnOp
+{
+    bool allocate;
+    uint64_t size;
+    uint64_t alignment;
+    uint32_t victim;        // which live allocation a free picks, modulo the live count
+};
+
+// The same random mix for every allocator - sizes spread evenly over the powers of two, mostly
+// buffer alignment with some texture sized alignments, allocating a little more than freeing
+static std::vector<ChurnOp> makeChurn( size_t count, uint64_t maxSize )
+{
+    std::mt19937 rng( 1234 );
+    std::uniform_real_distribution<double> unit( 0.0, 1.0 );
+    const uint64_t alignments[] = { 0, 256, 256, 256, 4096, 65536 };
+    std::vector<ChurnOp> ops( count );
+    for ( ChurnOp& op : ops )
+    {
+        op.allocate = unit( rng ) < 0.52;
+        op.size = (uint64_t)exp2( 8.0 + unit( rng ) * ( log2( (double)maxSize ) - 8.0 ) );
+        op.alignment = alignments[ rng() % 6 ];
+        op.victim = (uint32_t)rng();
+    }
+    return ops;
+}
+
+// Random allocations and frees through a TlsfAllocator and a best fit map allocator, checking
+// every TLSF allocation is aligned and overlaps nothing live, then the same through a
+// HeapAllocator with frees deferred by frames
+int heapTool( int argc, const char* argv[] )
+{
+    const size_t opCount = argc > 0 ? (size_t)atol( argv[0] ) : 1000000;
+    const uint64_t capacity = ( argc > 1 ? (uint64_t)atol( argv[1] ) : 256 ) << 20;
+    const uint64_t maxSize = ( argc > 2 ? (uint64_t)atol( argv[2] ) : 1024 ) << 10;
+    const uint64_t framesInFlight = argc > 3 ? (uint64_t)atol( argv[3] ) : 3;
+    std::cout << "heap " << opCount << " operations in " << ( capacity >> 20 ) << " MB, up to " << ( maxSize >> 10 ) << " KB each" << std::endl;
+    const std::vector<ChurnOp> ops = makeChurn( opCount, maxSize );
+
+    // checked run - every live range in a map by offset
+    size_t overlaps = 0, misaligned = 0, failed = 0, invalid = 0;
+    double fragmentationSum = 0.0;
+    size_t samples = 0;
+    uint64_t peakUsed = 0;
+    {
+        TlsfAllocator tlsf( capacity );
+        std::vector<TlsfAllocator::Allocation> live;
+        std::map<uint64_t, uint64_t> ranges;
+        for ( size_t i = 0; i < opCount; ++i )
+        {
+            const ChurnOp& op = ops[i];
+            if ( op.allocate || live.empty() )
+            {
+                const TlsfAllocator::Allocation allocation = tlsf.allocate( op.size, op.alignment );
+                if ( allocation.node == TlsfAllocator::kNoNode )
+                {
+                    ++failed;
+                    continue;
+                }
+                misaligned += op.alignment > 0 && allocation.offset % op.alignment != 0 ? 1 : 0;
+                const auto next = ranges.lower_bound( allocation.offset );
+                bool overlap = next != ranges.end() && next->first < allocation.offset + allocation.size;
+                if ( next != ranges.begin() )
+                {
+                    const auto prev = std::prev( next );
+                    overlap |= prev->first + prev->second > allocation.offset;
+                }
+                overlaps += overlap ? 1 : 0;
+                ranges[ allocation.offset ] = allocation.size;
+                live.push_back( allocation );
+                peakUsed = std::max( peakUsed, tlsf.used() );
+            }
+            else
+            {
+                const size_t victim = op.victim % live.size();
+                ranges.erase( live[ victim ].offset );
+                tlsf.free( live[ victim ] );
+                live[ victim ] = live.back();
+                live.pop_back();
+            }
+            if ( i % 1024 == 0 )
+            {
+                invalid += tlsf.validate() ? 0 : 1;
+                fragmentationSum += tlsf.stats().fragmentation;
+                ++samples;
+            }
+        }
+        const TlsfAllocator::Stats stats = tlsf.stats();
+        std::cout << "  checked: " << overlaps << " overlaps, " << misaligned << " misaligned, " << invalid << " failed validation; "
+                  << failed << " allocations didn't fit, peak " << ( peakUsed >> 20 ) << " MB used" << std::endl;
+        std::cout << "  end: " << stats.allocations << " live, " << ( stats.used >> 20 ) << " MB used, " << stats.freeBlocks
+                  << " free ranges, largest " << ( stats.largestFree >> 10 ) << " KB, fragmentation " << stats.fragmentation * 100.f
+                  << "% (mean " << fragmentationSum / std::max<size_t>( samples, 1 ) * 100.0 << "%)" << std::endl;
+    }
+
+    // timed runs, nothing but the allocator
+    double tlsfMs = 0.0, mapMs = 0.0;
+    size_t mapFailed = 0;
+    {
+        TlsfAllocator tlsf( capacity );
+        std::vector<TlsfAllocator::Allocation> live;
+        live.reserve( opCount );
+        const auto start = std::chrono::steady_clock::now();
+        for ( const ChurnOp& op : ops )
+        {
+            if ( op.allocate || live.empty() )
+            {
+                const TlsfAllocator::Allocation allocation = tlsf.allocate( op.size, op.alignment );
+                if ( allocation.node != TlsfAllocator::kNoNode )
+                {
+                    live.push_back( allocation );
+                }
+            }
+            else
+            {
+                const size_t victim = op.victim % live.size();
+                tlsf.free( live[ victim ] );
+                live[ victim ] = live.back();
+                live.pop_back();
+            }
+        }
+        tlsfMs = elapsedMs( start );
+    }
+    {
+        MapAllocator map( capacity, 256 );
+        std::vector<std::pair<uint64_t, uint64_t>> live;
+        live.reserve( opCount );
+        const auto start = std::chrono::steady_clock::now();
+        for ( const ChurnOp& op : ops )
+        {
+            if ( op.allocate || live.empty() )
+            {
+                const uint64_t offset = map.allocate( op.size, op.alignment );
+                if ( offset != ~0ull )
+                {
+                    live.push_back( { offset, op.size } );
+                }
+                mapFailed += offset == ~0ull ? 1 : 0;
+            }
+            else
+            {
+                const size_t victim = op.victim % live.size();
+                map.free( live[ victim ].first, live[ victim ].second );
+                live[ victim ] = live.back();
+                live.pop_back();
+            }
+        }
+        mapMs = elapsedMs( start );
+    }
+    std::cout << "  TLSF " << tlsfMs * 1e6 / opCount << " ns per operation, best fit map " << mapMs * 1e6 / opCount << " ns ("
+              << mapFailed << " didn't fit)" << std::endl;
+
+    // frame deferred frees - nothing freed in a frame still in flight may be handed out again
+    {
+        HeapAllocator heap( capacity / 4 );
+        std::vector<HeapAllocator::Allocation> live;
+        std::vector<std::pair<uint64_t, HeapAllocator::Allocation>> inFlight;      // freed, frame not yet retired
+        size_t reused = 0, frames = 0;
+        uint64_t peakPending = 0;
+        const size_t opsPerFrame = 64;
+        const auto start = std::chrono::steady_clock::now();
+        for ( size_t i = 0; i < opCount; i += opsPerFrame )
+        {
+            const uint64_t frame = ++frames;
+            const uint64_t retired = frame > framesInFlight ? frame - framesInFlight : 0;
+            heap.collect( retired );
+            inFlight.erase( std::remove_if( inFlight.begin(), inFlight.end(), [&]( const std::pair<uint64_t, HeapAllocator::Allocation>& freed )
+            {
+                return freed.first <= retired;
+            } ), inFlight.end() );
+
+            for ( size_t j = i; j < std::min( opCount, i + opsPerFrame ); ++j )
+            {
+                const ChurnOp& op = ops[j];
+                if ( op.allocate || live.empty() )
+                {
+                    const HeapAllocator::Allocation allocation = heap.allocate( op.size, op.alignment );
+                    for ( const auto& freed : inFlight )
+                    {
+                        reused += freed.second.block == allocation.block && freed.second.offset < allocation.offset + allocation.size &&
+                                  allocation.offset < freed.second.offset + freed.second.size ? 1 : 0;
+                    }
+                    live.push_back( allocation );
+                }
+                else
+                {
+                    const size_t victim = op.victim % live.size();
+                    heap.free( live[ victim ], frame );
+                    inFlight.push_back( { frame, live[ victim ] } );
+                    live[ victim ] = live.back();
+                    live.pop_back();
+                }
+            }
+            peakPending = std::max( peakPending, heap.stats().pendingFree );
+        }
+        const double heapMs = elapsedMs( start );
+        heap.collect( ~0ull );
+        const HeapAllocator::Stats stats = heap.stats();
+        std::cout << "  deferred, " << framesInFlight << " frames in flight: " << frames << " frames in " << heapMs << " ms, " << stats.blocks
+                  << " blocks of " << ( capacity / 4 >> 20 ) << " MB, peak " << ( peakPending >> 10 ) << " KB waiting; " << reused
+                  << " reused while in flight, " << ( heap.validate() ? "valid" : "INVALID" ) << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+//
+//  KernelTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Compute/CpuKernels.hpp"
+#include "Jobs/JobSystem.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// Runs the shared compute kernels through the CPU backend, checks the last frame against the
+// scalar reference and optionally dumps it as a PPM
+int kernelTool( int argc, const char* argv[] )
+{
+    const unsigned int width = argc > 0 ? (unsigned int)atoi( argv[0] ) : 1024;
+    const unsigned int height = argc > 1 ? (unsigned int)atoi( argv[1] ) : 1024;
+    const unsigned int frames = argc > 2 ? (unsigned int)atoi( argv[2] ) : 10;
+    const char* pOutput = argc > 3 ? argv[3] : nullptr;
+    if ( width == 0 || height == 0 || frames == 0 )
+    {
+        std::cout << "usage: mmtool kernels [width > 0] [height > 0] [frames > 0] [output.ppm]" << std::endl;
+        return 1;
+    }
+
+    std::vector<uint8_t> pixels( (size_t)width * height * 4 );
+    metal::CpuTexture texture = { pixels.data(), width, height, width * 4, metal::CpuTexture::Format::RGBA8Unorm };
+
+    std::cout << "mandelbrot_set " << width << "x" << height << " on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+    auto start = std::chrono::steady_clock::now();
+    for ( unsigned int frame = 0; frame < frames; ++frame )
+    {
+        CpuKernels::mandelbrotSet( texture, frame * 100 );
+    }
+    double ms = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    std::cout << "  " << ms / frames << " ms/frame, " << ( (double)width * height * frames ) / ( ms * 1000.0 ) << " Mpixels/s" << std::endl;
+
+    // the last frame again through the scalar reference - the same float maths, so every pixel
+    std::vector<uint8_t> expected( pixels.size() );
+    metal::CpuTexture reference = { expected.data(), width, height, width * 4, metal::CpuTexture::Format::RGBA8Unorm };
+    CpuKernels::mandelbrotSetReference( reference, ( frames - 1 ) * 100 );
+    size_t differing = 0;
+    for ( size_t i = 0; i < pixels.size(); i += 4 )
+    {
+        differing += memcmp( &pixels[i], &expected[i], 4 ) != 0 ? 1 : 0;
+    }
+    std::cout << "  " << differing << " of " << (size_t)width * height << " pixels differ from the scalar reference" << std::endl;
+    if ( differing != 0 )
+    {
+        std::cout << "  FAILED" << std::endl;
+        return 1;
+    }
+
+    if ( pOutput )
+    {
+        FILE* pFile = fopen( pOutput, "wb" );
+        if ( !pFile )
+        {
+            std::cout << "can't write " << pOutput << std::endl;
+            return 1;
+        }
+        fprintf( pFile, "P6\n%u %u\n255\n", width, height );
+        for ( size_t i = 0; i < (size_t)width * height; ++i )
+        {
+            fwrite( &pixels[ i * 4 ], 1, 3, pFile );
+        }
+        fclose( pFile );
+    }
+    return 0;
+}
@@ -0,0 +1,274 @@
+//
+//  Ktx2Tool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Jobs/JobSystem.hpp"
+#include "Texture/Ktx2File.hpp"
+#include "Texture/MipChain.hpp"
+#include "Texture/MipGen.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <math.h>
+#include <unistd.h>
+
+using Ktx2Format::Supercompression;
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Binary PPM (P6) with 8 bit channels, as mmtool kernels and raster write them, into level 0
+static bool readPPM( const char* path, MipChain& chain )
+{
+    FILE* pFile = fopen( path, "rb" );
+    if ( !pFile )
+    {
+        std::cout << "can't open " << path << std::endl;
+        return false;
+    }
+    unsigned int width = 0, height = 0, maxValue = 0;
+    const bool header = fscanf( pFile, "P6 %u %u %u", &width, &height, &maxValue ) == 3 && fgetc( pFile ) != EOF;
+    if ( !header || width == 0 || height == 0 || maxValue != 255 )
+    {
+        std::cout << path << " isn't an 8 bit binary PPM" << std::endl;
+        fclose( pFile );
+        return false;
+    }
+    std::vector<uint8_t> rgb( (size_t)width * height * 3 );
+    const bool read = fread( rgb.data(), 1, rgb.size(), pFile ) == rgb.size();
+    fclose( pFile );
+    if ( !read )
+    {
+        std::cout << path << " is truncated" << std::endl;
+        return false;
+    }
+    chain.resize( width, height );
+    const PixelConvert::Layout layout = { PixelConvert::Format::RGB8, MipGen::ColorSpace::Linear };
+    const PixelConvert::Layout rgba = { PixelConvert::Format::RGBA8, MipGen::ColorSpace::Linear };
+    PixelConvert::convertRows( rgb.data(), (size_t)width * 3, layout, chain.levelData( 0 ), chain.rowPitch(), rgba, width, height );
+    return true;
+}
+
+// Soft gradients and rings with a little grain - compresses about as well as a photo does
+static void fillTestImage( MipChain& chain )
+{
+    const uint32_t w = chain.width();
+    const uint32_t h = chain.height();
+    uint8_t* pData = chain.levelData( 0 );
+    JobSystem::Instance()->parallelFor( h, 64, [&]( size_t begin, size_t end )
+    {
+        for ( size_t y = begin; y < end; ++y )
+        {
+            for ( uint32_t x = 0; x < w; ++x )
+            {
+                const float u = x / (float)w - 0.5f, v = y / (float)h - 0.5f;
+                const float rings = 0.5f + 0.5f * sinf( sqrtf( u * u + v * v ) * 80.f );
+                const uint32_t grain = ( x * 1103515245u ^ (uint32_t)y * 2654435761u ) >> 28;
+                uint8_t* p = pData + ( y * w + x ) * 4;
+                p[0] = (uint8_t)std::min( 255.f, ( u + 0.5f ) * 200.f + grain );
+                p[1] = (uint8_t)std::min( 255.f, rings * 180.f + grain );
+                p[2] = (uint8_t)std::min( 255.f, ( v + 0.5f ) * 220.f + grain );
+                p[3] = 255;
+            }
+        }
+    } );
+}
+
+static bool parseScheme( const char* pName, Supercompression* pScheme )
+{
+    const Supercompression schemes[] = { Supercompression::None, Supercompression::Zlib, Supercompression::Zstd };
+    for ( Supercompression scheme : schemes )
+    {
+        if ( strcmp( pName, Ktx2Format::supercompressionName( scheme ) ) == 0 )
+        {
+            *pScheme = scheme;
+            return true;
+        }
+    }
+    std::cout << "unknown supercompression " << pName << ", none, zlib or zstd" << std::endl;
+    return false;
+}
+
+// Mips with the Kaiser filter, written out, read back and compared level by level
+static int pack( const char* path, const char* pSource, Supercompression scheme, MipGen::ColorSpace colorSpace )
+{
+    MipChain chain;
+    if ( pSource && strstr( pSource, ".ppm" ) )
+    {
+        if ( !readPPM( pSource, chain ) )
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        const uint32_t size = pSource ? (uint32_t)atoi( pSource ) : 2048;
+        chain.resize( size, size );
+        fillTestImage( chain );
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MipGen::Options options;
+    options.filter = MipGen::Filter::Kaiser;
+    options.colorSpace = colorSpace;
+    MipGen::generate( chain, options );
+    const double mipMs = elapsedMs( start );
+
+    start = std::chrono::steady_clock::now();
+    const PixelConvert::Layout layout = { PixelConvert::Format::RGBA8, colorSpace };
+    Ktx2Writer writer( chain.width(), chain.height(), layout );
+    for ( uint32_t level = 0; level < chain.levelCount(); ++level )
+    {
+        writer.addLevel( chain.levelData( level ) );
+    }
+    if ( !writer.write( path, scheme ) )
+    {
+        return 1;
+    }
+    const double writeMs = elapsedMs( start );
+
+    Ktx2File file;
+    if ( !file.open( path ) || !file.decode() )
+    {
+        return 1;
+    }
+    size_t mismatched = 0;
+    for ( uint32_t level = 0; level < chain.levelCount(); ++level )
+    {
+        mismatched += memcmp( file.levelData( level ), chain.levelData( level ), file.levelSize( level ) ) != 0 ? 1 : 0;
+    }
+    std::cout << path << ": " << chain.width() << "x" << chain.height() << ", " << chain.levelCount() << " levels, "
+              << Ktx2Format::supercompressionName( scheme ) << ", " << file.size() / 1024 << " KB of " << chain.sizeInBytes() / 1024
+              << " KB; mips " << mipMs << " ms, compress and write " << writeMs << " ms; " << mismatched << " levels differ read back"
+              << std::endl;
+    return mismatched == 0 ? 0 : 1;
+}
+
+static int printInfo( const Ktx2File& file )
+{
+    std::cout << file.width() << "x" << file.height() << ", vkFormat " << (uint32_t)Ktx2Format::vkFormatFor( file.layout() ) << ", "
+              << file.levelCount() << " levels, " << Ktx2Format::supercompressionName( file.supercompression() ) << ", " << file.size()
+              << " bytes" << std::endl;
+    for ( uint32_t level = 0; level < file.levelCount(); ++level )
+    {
+        std::cout << "  level " << level << ": " << file.width( level ) << "x" << file.height( level ) << " at "
+                  << ( file.storedData( level ) - file.data() ) << ", " << file.storedSize( level ) << " of " << file.levelSize( level )
+                  << " bytes" << std::endl;
+    }
+    return 0;
+}
+
+// Loading as the renderer does - open, decode, every level's bytes read - against reading the
+// file into memory with read(). Both from the page cache after the first pass
+static int benchmark( const char* path, unsigned int iterations )
+{
+    double readMs = 1e30, openMs = 1e30, decodeMs = 1e30, touchMs = 1e30;
+    size_t fileSize = 0, pixelBytes = 0;
+    uint64_t sum = 0;
+    std::vector<uint8_t> buffer;
+    for ( unsigned int i = 0; i < iterations; ++i )
+    {
+        auto start = std::chrono::steady_clock::now();
+        const int fd = open( path, O_RDONLY );
+        if ( fd < 0 )
+        {
+            std::cout << "can't open " << path << std::endl;
+            return 1;
+        }
+        buffer.resize( (size_t)lseek( fd, 0, SEEK_END ) );
+        const bool read = pread( fd, buffer.data(), buffer.size(), 0 ) == (ssize_t)buffer.size();
+        close( fd );
+        readMs = std::min( readMs, elapsedMs( start ) );
+        if ( !read )
+        {
+            std::cout << "can't read " << path << std::endl;
+            return 1;
+        }
+
+        start = std::chrono::steady_clock::now();
+        Ktx2File file;
+        if ( !file.open( path ) )
+        {
+            return 1;
+        }
+        openMs = std::min( openMs, elapsedMs( start ) );
+        start = std::chrono::steady_clock::now();
+        if ( !file.decode() )
+        {
+            return 1;
+        }
+        decodeMs = std::min( decodeMs, elapsedMs( start ) );
+
+        // what the upload's conversion would read, a word a cache line
+        start = std::chrono::steady_clock::now();
+        pixelBytes = 0;
+        for ( uint32_t level = 0; level < file.levelCount(); ++level )
+        {
+            const uint8_t* pLevel = file.levelData( level );
+            for ( size_t offset = 0; offset < file.levelSize( level ); offset += 64 )
+            {
+                sum += pLevel[ offset ];
+            }
+            pixelBytes += file.levelSize( level );
+        }
+        touchMs = std::min( touchMs, elapsedMs( start ) );
+        fileSize = file.size();
+    }
+    const double loadMs = openMs + decodeMs + touchMs;
+    std::cout << path << ": " << fileSize / 1024 << " KB holding " << pixelBytes / 1024 << " KB of levels, best of " << iterations << std::endl;
+    std::cout << "  read()            " << readMs << " ms, " << fileSize / ( readMs * 1e6 ) << " GB/s" << std::endl;
+    std::cout << "  open              " << openMs << " ms" << std::endl;
+    std::cout << "  decode            " << decodeMs << " ms" << std::endl;
+    std::cout << "  read levels       " << touchMs << " ms" << std::endl;
+    std::cout << "  load              " << loadMs << " ms, " << fileSize / ( loadMs * 1e6 ) << " GB/s of file, " << pixelBytes / ( loadMs * 1e6 )
+              << " GB/s of pixels, " << loadMs / readMs << "x read()  (" << ( sum & 1 ) << ")" << std::endl;
+    return 0;
+}
+
+int ktx2Tool( int argc, const char* argv[] )
+{
+    if ( argc < 2 )
+    {
+        std::cout << "usage: mmtool ktx2 pack <file> [size | in.ppm] [none|zlib|zstd] [linear|srgb] | info <file> | bench <file> [iterations]"
+                  << std::endl;
+        return 1;
+    }
+
+    const char* path = argv[1];
+    if ( strcmp( argv[0], "pack" ) == 0 )
+    {
+        Supercompression scheme = Supercompression::Zlib;
+        if ( argc > 3 && !parseScheme( argv[3], &scheme ) )
+        {
+            return 1;
+        }
+        const MipGen::ColorSpace colorSpace = argc > 4 && strcmp( argv[4], "srgb" ) == 0 ? MipGen::ColorSpace::SRGB : MipGen::ColorSpace::Linear;
+        return pack( path, argc > 2 ? argv[2] : nullptr, scheme, colorSpace );
+    }
+    if ( strcmp( argv[0], "bench" ) == 0 )
+    {
+        return benchmark( path, argc > 2 ? (unsigned int)atoi( argv[2] ) : 5 );
+    }
+
+    Ktx2File file;
+    if ( !file.open( path ) )
+    {
+        return 1;
+    }
+    if ( strcmp( argv[0], "info" ) == 0 )
+    {
+        return printInfo( file );
+    }
+    std::cout << "unknown ktx2 command " << argv[0] << std::endl;
+    return 1;
+}
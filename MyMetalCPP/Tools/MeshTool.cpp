@@ -0,0 +1,329 @@
+//
+//  MeshTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Jobs/JobSystem.hpp"
+#include "Maths/Math.hpp"
+#include "Mesh/Lod.hpp"
+#include "Mesh/MeshOptimizer.hpp"
+#include "Mesh/Meshlets.hpp"
+#include "Mesh/VertexQuantization.hpp"
+#include "Scene/CubeScene.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <utility>
+
+void buildTestMesh( unsigned int segments, unsigned int spheres, std::vector<VertexData>& vertices, std::vector<uint32_t>& indices )
+{
+    std::vector<VertexData> grid( (size_t)( segments + 1 ) * ( segments + 1 ) );
+    vertices.clear();
+    vertices.reserve( (size_t)spheres * segments * segments * 6 );
+
+    for ( unsigned int s = 0; s < spheres; ++s )
+    {
+        const float radius = 1.f - 0.8f * s / (float)spheres;
+        for ( unsigned int j = 0; j <= segments; ++j )
+        {
+            const float theta = (float)M_PI * j / segments;
+            for ( unsigned int i = 0; i <= segments; ++i )
+            {
+                const float phi = 2.f * (float)M_PI * i / segments;
+                VertexData& v = grid[ j * ( segments + 1 ) + i ];
+                v.normal = { sinf( theta ) * cosf( phi ), cosf( theta ), sinf( theta ) * sinf( phi ) };
+                v.position = { v.normal.x * radius, v.normal.y * radius, v.normal.z * radius };
+                v.texcoord = { i / (float)segments, j / (float)segments };
+            }
+        }
+        for ( unsigned int j = 0; j < segments; ++j )
+        {
+            for ( unsigned int i = 0; i < segments; ++i )
+            {
+                const size_t a = j * ( segments + 1 ) + i;
+                const size_t b = a + 1;
+                const size_t c = a + segments + 1;
+                const size_t d = c + 1;
+                // counter clockwise seen from outside
+                for ( size_t index : { a, b, c, b, d, c } )
+                {
+                    vertices.push_back( grid[ index ] );
+                }
+            }
+        }
+    }
+
+    const size_t triangleCount = vertices.size() / 3;
+    std::vector<uint32_t> order( triangleCount );
+    for ( size_t t = 0; t < triangleCount; ++t )
+    {
+        order[t] = (uint32_t)t;
+    }
+    std::shuffle( order.begin(), order.end(), std::mt19937( 1234 ) );
+    indices.resize( triangleCount * 3 );
+    for ( size_t t = 0; t < triangleCount; ++t )
+    {
+        for ( int k = 0; k < 3; ++k )
+        {
+            indices[ t * 3 + k ] = order[t] * 3 + k;
+        }
+    }
+}
+
+static void printStats( const char* label, const MeshOptimizer::VertexCacheStats& cache, const MeshOptimizer::VertexFetchStats& fetch,
+                        const MeshOptimizer::OverdrawStats& overdraw, size_t vertexCount )
+{
+    std::cout << "  " << label << " " << vertexCount << " vertices, ACMR " << cache.acmr << ", ATVR " << cache.atvr
+              << ", overfetch " << fetch.overfetch << ", overdraw " << overdraw.overdraw << std::endl;
+}
+
+// A triangle by the values of its vertices, rotated to start at the smallest so the same
+// triangle compares equal whichever vertex it starts at - but not when it's wound the other way
+typedef std::array<float, 24> TriangleKey;
+
+static std::vector<TriangleKey> triangleKeys( const std::vector<VertexData>& vertices, const std::vector<uint32_t>& indices )
+{
+    std::vector<TriangleKey> keys( indices.size() / 3 );
+    for ( size_t t = 0; t < keys.size(); ++t )
+    {
+        std::array<float, 8> corner[3];
+        for ( int k = 0; k < 3; ++k )
+        {
+            const VertexData& v = vertices[ indices[ t * 3 + k ] ];
+            corner[k] = { v.position.x, v.position.y, v.position.z, v.normal.x, v.normal.y, v.normal.z, v.texcoord.x, v.texcoord.y };
+        }
+        int first = 0;
+        for ( int k = 1; k < 3; ++k )
+        {
+            first = corner[k] < corner[ first ] ? k : first;
+        }
+        for ( int k = 0; k < 3; ++k )
+        {
+            std::copy( corner[ ( first + k ) % 3 ].begin(), corner[ ( first + k ) % 3 ].end(), keys[t].begin() + k * 8 );
+        }
+    }
+    std::sort( keys.begin(), keys.end() );
+    return keys;
+}
+
+// Runs the full optimizer pipeline over a generated multi-million triangle mesh and checks the
+// result draws the same triangles, with the same winding, as the input
+int meshOptTool( int argc, const char* argv[] )
+{
+    const unsigned int segments = argc > 0 ? (unsigned int)atoi( argv[0] ) : 400;
+    const unsigned int spheres = argc > 1 ? (unsigned int)atoi( argv[1] ) : 4;
+    if ( segments == 0 || spheres == 0 )
+    {
+        std::cout << "usage: mmtool meshopt [segments > 0] [spheres > 0]" << std::endl;
+        return 1;
+    }
+
+    std::vector<VertexData> vertices;
+    std::vector<uint32_t> indices;
+    buildTestMesh( segments, spheres, vertices, indices );
+    const std::vector<TriangleKey> expected = triangleKeys( vertices, indices );
+    std::cout << "meshopt " << indices.size() / 3 << " triangles on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    const MeshOptimizer::Report report = MeshOptimizer::optimize( vertices, indices );
+    const double totalMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+    printStats( "before", report.cacheBefore, report.fetchBefore, report.overdrawBefore, report.verticesBefore );
+    printStats( "after ", report.cacheAfter, report.fetchAfter, report.overdrawAfter, report.verticesAfter );
+    std::cout << "  dedup " << report.dedupMs << " ms, vertex cache " << report.vertexCacheMs << " ms, overdraw " << report.overdrawMs
+              << " ms, vertex fetch " << report.vertexFetchMs << " ms (" << totalMs << " ms with analysis)" << std::endl;
+
+    bool inRange = true;
+    for ( uint32_t index : indices )
+    {
+        inRange = inRange && index < vertices.size();
+    }
+    if ( !inRange || triangleKeys( vertices, indices ) != expected )
+    {
+        std::cout << "  FAILED: the optimized mesh doesn't draw the same triangles with the same winding" << std::endl;
+        return 1;
+    }
+    std::cout << "  same " << expected.size() << " triangles with the same winding" << std::endl;
+    return 0;
+}
+
+// Quantizes the optimized test mesh, reports the error and the encode/decode throughput
+int quantizeTool( int argc, const char* argv[] )
+{
+    const unsigned int segments = argc > 0 ? (unsigned int)atoi( argv[0] ) : 400;
+    const unsigned int iterations = argc > 1 ? (unsigned int)atoi( argv[1] ) : 10;
+
+    std::vector<VertexData> vertices;
+    std::vector<uint32_t> indices;
+    buildTestMesh( segments, 4, vertices, indices );
+    MeshOptimizer::optimize( vertices, indices, false );
+    const size_t count = vertices.size();
+    std::cout << "quantize " << count << " vertices on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+
+    const MeshQuantization quantization = VertexQuantization::computeQuantization( vertices.data(), count );
+    std::vector<QuantizedVertexData> quantized( count );
+    std::vector<VertexData> decoded( count );
+
+    double encodeMs = 1e30;
+    double decodeMs = 1e30;
+    for ( unsigned int i = 0; i < iterations; ++i )
+    {
+        auto start = std::chrono::steady_clock::now();
+        VertexQuantization::encode( quantized.data(), vertices.data(), count, quantization );
+        encodeMs = std::min( encodeMs, std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count() );
+
+        start = std::chrono::steady_clock::now();
+        VertexQuantization::decode( decoded.data(), quantized.data(), count, quantization );
+        decodeMs = std::min( decodeMs, std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count() );
+    }
+
+    const VertexQuantization::ErrorReport error = VertexQuantization::measureError( vertices.data(), quantized.data(), count, quantization );
+    const MeshOptimizer::VertexFetchStats fetchBefore = MeshOptimizer::analyzeVertexFetch( indices.data(), indices.size(), count, sizeof( VertexData ) );
+    const MeshOptimizer::VertexFetchStats fetchAfter = MeshOptimizer::analyzeVertexFetch( indices.data(), indices.size(), count, sizeof( QuantizedVertexData ) );
+
+    std::cout << "  vertex memory " << error.bytesBefore << " -> " << error.bytesAfter << " bytes ("
+              << error.bytesBefore / (double)error.bytesAfter << "x)" << std::endl;
+    std::cout << "  vertex fetch " << fetchBefore.bytesFetched << " -> " << fetchAfter.bytesFetched << " bytes ("
+              << fetchBefore.bytesFetched / (double)fetchAfter.bytesFetched << "x)" << std::endl;
+    std::cout << "  position error max " << error.maxPositionError << " mean " << error.meanPositionError
+              << " (" << error.relativePositionError << " of the bounds)" << std::endl;
+    std::cout << "  normal error max " << error.maxNormalErrorDegrees << " mean " << error.meanNormalErrorDegrees << " degrees" << std::endl;
+    std::cout << "  texcoord error max " << error.maxTexcoordError << std::endl;
+    std::cout << "  encode " << encodeMs << " ms (" << count / encodeMs / 1e3 << " Mvertices/s), decode " << decodeMs
+              << " ms (" << count / decodeMs / 1e3 << " Mvertices/s)" << std::endl;
+    return 0;
+}
+
+// Builds meshlets for a set of optimized spheres, validates them and benchmarks building and culling
+int meshletTool( int argc, const char* argv[] )
+{
+    const unsigned int segments = argc > 0 ? (unsigned int)atoi( argv[0] ) : 400;
+    const unsigned int meshCount = argc > 1 ? (unsigned int)atoi( argv[1] ) : 8;
+    const unsigned int iterations = argc > 2 ? (unsigned int)atoi( argv[2] ) : 10;
+    if ( segments == 0 || meshCount == 0 || iterations == 0 )
+    {
+        std::cout << "usage: mmtool meshlets [segments > 0] [meshes > 0] [iterations > 0]" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::vector<VertexData>> vertices( meshCount );
+    std::vector<std::vector<uint32_t>> indices( meshCount );
+    std::vector<Meshlets::MeshInput> inputs( meshCount );
+    size_t triangleCount = 0;
+    size_t vertexCount = 0;
+    for ( unsigned int i = 0; i < meshCount; ++i )
+    {
+        buildTestMesh( segments, 1, vertices[i], indices[i] );
+        MeshOptimizer::optimize( vertices[i], indices[i], false );
+        inputs[i] = { indices[i].data(), indices[i].size(), vertices[i].data(), vertices[i].size() };
+        triangleCount += indices[i].size() / 3;
+        vertexCount += vertices[i].size();
+    }
+    std::cout << "meshlets " << meshCount << " meshes, " << triangleCount << " triangles on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    const std::vector<Meshlets::MeshletMesh> meshes = Meshlets::buildMany( inputs );
+    const double buildMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+    size_t meshletCount = 0;
+    size_t meshletVertices = 0;
+    size_t cullable = 0;
+    double radiusSum = 0.0;
+    bool valid = true;
+    for ( unsigned int i = 0; i < meshCount; ++i )
+    {
+        valid = valid && Meshlets::validate( meshes[i], inputs[i] );
+        meshletCount += meshes[i].meshlets.size();
+        meshletVertices += meshes[i].vertices.size();
+        for ( const Meshlets::MeshletBounds& bounds : meshes[i].bounds )
+        {
+            radiusSum += bounds.radius;
+            cullable += bounds.coneCutoff < 1.f;
+        }
+    }
+    std::cout << "  " << meshletCount << " meshlets, " << meshletVertices / (double)meshletCount << " vertices and "
+              << triangleCount / (double)meshletCount << " triangles each, vertex duplication " << meshletVertices / (double)vertexCount << std::endl;
+    std::cout << "  mean radius " << radiusSum / meshletCount << ", " << cullable << " with a usable normal cone, "
+              << ( valid ? "valid" : "INVALID" ) << std::endl;
+    std::cout << "  build " << buildMs << " ms (" << triangleCount / buildMs / 1e3 << " Mtriangles/s)" << std::endl;
+
+    // unit spheres at the origin, seen from close enough that the frustum clips them
+    const Matrix44f clipFromMesh = Maths::makePerspective( 45.f * (float)M_PI / 180.f, 16.f / 9.f, 0.03f, 500.f ) *
+                                   Maths::makeTranslate( { 0.3f, 0.f, -1.6f } );
+    const Meshlets::CullParams params = Meshlets::makeCullParams( clipFromMesh, { -0.3f, 0.f, 1.6f } );
+    std::vector<Meshlets::DrawRange> ranges;
+    Meshlets::CullStats stats = {};
+    size_t rangeCount = 0;
+    double cullMs = 1e30;
+    for ( unsigned int it = 0; it < iterations; ++it )
+    {
+        start = std::chrono::steady_clock::now();
+        stats = {};
+        rangeCount = 0;
+        for ( const Meshlets::MeshletMesh& mesh : meshes )
+        {
+            const Meshlets::CullStats meshStats = Meshlets::cull( mesh, params, ranges );
+            stats.frustumCulled += meshStats.frustumCulled;
+            stats.backfaceCulled += meshStats.backfaceCulled;
+            stats.visible += meshStats.visible;
+            stats.trianglesVisible += meshStats.trianglesVisible;
+            rangeCount += ranges.size();
+        }
+        cullMs = std::min( cullMs, std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count() );
+    }
+    std::cout << "  cull " << cullMs << " ms (" << meshletCount / cullMs / 1e3 << " Mmeshlets/s): " << stats.visible << " visible, "
+              << stats.frustumCulled << " frustum culled, " << stats.backfaceCulled << " backface culled" << std::endl;
+    std::cout << "  " << stats.trianglesVisible << " of " << triangleCount << " triangles drawn in " << rangeCount << " ranges" << std::endl;
+    return valid ? 0 : 1;
+}
+
+// Builds a LOD chain for a generated sphere and selects levels for the cube scene's instances
+int lodTool( int argc, const char* argv[] )
+{
+    const unsigned int segments = argc > 0 ? (unsigned int)atoi( argv[0] ) : 708;    // ~1M triangles
+    const float pixelError = argc > 1 ? (float)atof( argv[1] ) : 1.f;
+
+    std::vector<VertexData> vertices;
+    std::vector<uint32_t> indices;
+    buildTestMesh( segments, 1, vertices, indices );
+    MeshOptimizer::optimize( vertices, indices, false );
+    std::cout << "lod " << indices.size() / 3 << " triangles, " << vertices.size() << " vertices on "
+              << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    const Lod::Chain chain = Lod::buildChain( indices.data(), indices.size(), vertices.data(), vertices.size() );
+    const double buildMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+    for ( size_t l = 0; l < chain.levels.size(); ++l )
+    {
+        std::cout << "  level " << l << ": " << chain.levels[l].indexCount / 3 << " triangles, error " << chain.levels[l].error << std::endl;
+    }
+    std::cout << "  chain built in " << buildMs << " ms" << std::endl;
+
+    std::vector<InstanceData> instances( kNumInstances );
+    CameraData camera;
+    CubeScene::updateInstances( instances.data(), 0.5f );
+    CubeScene::updateCamera( &camera, 16.f / 9.f );
+
+    std::vector<uint8_t> levels( kNumInstances );
+    start = std::chrono::steady_clock::now();
+    const Lod::SelectionStats stats = Lod::selectLevels( chain, instances.data(), instances.size(), camera, 720.f, pixelError, levels.data() );
+    const double selectMs = std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+
+    std::cout << "  " << kNumInstances << " instances at 720p, " << pixelError << " pixel error: " << stats.triangles << " triangles instead of "
+              << stats.fullTriangles << " (" << stats.fullTriangles / (double)std::max<size_t>( stats.triangles, 1 ) << "x fewer), "
+              << selectMs << " ms" << std::endl;
+    std::cout << "  instances per level:";
+    for ( size_t l = 0; l < chain.levels.size(); ++l )
+    {
+        std::cout << " " << stats.instancesPerLevel[l];
+    }
+    std::cout << std::endl;
+    return 0;
+}
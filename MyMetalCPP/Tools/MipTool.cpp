@@ -0,0 +1,129 @@
+//
+//  MipTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Jobs/JobSystem.hpp"
+#include "Texture/MipChain.hpp"
+#include "Texture/MipGen.hpp"
+#include "Texture/MipSampler.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <math.h>
+#include <mutex>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Fine checkerboard over colour gradients - plenty of high frequency detail for the filters to remove
+static void fillTestImage( MipChain& chain )
+{
+    const uint32_t w = chain.width();
+    const uint32_t h = chain.height();
+    uint8_t* pData = chain.levelData( 0 );
+    JobSystem::Instance()->parallelFor( h, 64, [&]( size_t begin, size_t end )
+    {
+        for ( size_t y = begin; y < end; ++y )
+        {
+            for ( uint32_t x = 0; x < w; ++x )
+            {
+                const bool check = ( ( x >> 1 ) ^ ( y >> 1 ) ) & 1;
+                uint8_t* p = pData + ( y * w + x ) * 4;
+                p[0] = check ? (uint8_t)( x * 255 / w ) : 0;
+                p[1] = check ? (uint8_t)( y * 255 / h ) : 0;
+                p[2] = check ? 255 : 32;
+                p[3] = 255;
+            }
+        }
+    } );
+}
+
+// Mean in linear space, to check the filters conserve energy
+static Maths::Float4 meanLinear( const MipChain& chain, uint32_t level, MipGen::ColorSpace colorSpace )
+{
+    const uint8_t* pData = chain.levelData( level );
+    const size_t count = (size_t)chain.width( level ) * chain.height( level );
+    double sum[4] = { 0.0, 0.0, 0.0, 0.0 };
+    for ( size_t i = 0; i < count; ++i )
+    {
+        const Maths::Float4 texel = MipGen::decodeTexel( pData + i * 4, colorSpace );
+        for ( int c = 0; c < 4; ++c )
+        {
+            sum[c] += texel[c];
+        }
+    }
+    return Maths::Float4{ (float)( sum[0] / count ), (float)( sum[1] / count ), (float)( sum[2] / count ), (float)( sum[3] / count ) };
+}
+
+// Benchmarks mip generation for each filter and colour space, then the trilinear sampler
+int mipTool( int argc, const char* argv[] )
+{
+    const unsigned int size = argc > 0 ? (unsigned int)atoi( argv[0] ) : 4096;
+    const unsigned int iterations = argc > 1 ? (unsigned int)atoi( argv[1] ) : 3;
+
+    MipChain chain( size, size );
+    fillTestImage( chain );
+    const double level0GB = (double)size * size * 4 / 1e9;
+    std::cout << "mips " << size << "x" << size << ", " << chain.levelCount() << " levels on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+
+    struct Config
+    {
+        const char* name;
+        MipGen::Filter filter;
+        MipGen::ColorSpace colorSpace;
+    };
+    const Config configs[] = {
+        { "box    linear", MipGen::Filter::Box, MipGen::ColorSpace::Linear },
+        { "box    sRGB  ", MipGen::Filter::Box, MipGen::ColorSpace::SRGB },
+        { "kaiser linear", MipGen::Filter::Kaiser, MipGen::ColorSpace::Linear },
+        { "kaiser sRGB  ", MipGen::Filter::Kaiser, MipGen::ColorSpace::SRGB },
+    };
+
+    for ( const Config& config : configs )
+    {
+        MipGen::Options options;
+        options.filter = config.filter;
+        options.colorSpace = config.colorSpace;
+
+        auto start = std::chrono::steady_clock::now();
+        for ( unsigned int i = 0; i < iterations; ++i )
+        {
+            MipGen::generate( chain, options );
+        }
+        const double ms = elapsedMs( start ) / iterations;
+
+        const Maths::Float4 top = meanLinear( chain, 0, config.colorSpace );
+        const Maths::Float4 last = meanLinear( chain, chain.levelCount() - 1, config.colorSpace );
+        std::cout << "  " << config.name << "  " << ms << " ms/chain, " << level0GB / ( ms / 1000.0 ) << " GB/s of level 0"
+                  << ", 1x1 mean error " << fabsf( last[0] - top[0] ) << " " << fabsf( last[1] - top[1] ) << " " << fabsf( last[2] - top[2] ) << std::endl;
+    }
+
+    // trilinear sampler over the last chain, lods spread across the whole chain
+    const size_t numSamples = 1 << 22;
+    MipSampler sampler( chain, MipGen::ColorSpace::SRGB, metal::address::repeat );
+    auto start = std::chrono::steady_clock::now();
+    std::mutex mutex;
+    Maths::Float4 total = Maths::splat( 0.f );
+    JobSystem::Instance()->parallelFor( numSamples, 4096, [&]( size_t begin, size_t end )
+    {
+        Maths::Float4 sum = Maths::splat( 0.f );
+        for ( size_t i = begin; i < end; ++i )
+        {
+            const float u = ( ( i * 2654435761u ) & 0xFFFF ) / 65536.f;
+            const float v = ( ( i * 40503u ) & 0xFFFF ) / 65536.f;
+            const float lod = ( i & 0xFF ) * ( chain.levelCount() / 256.f );
+            sum += sampler.sampleTrilinear( u, v, lod );
+        }
+        std::lock_guard<std::mutex> lock( mutex );
+        total += sum;
+    } );
+    const double ms = elapsedMs( start );
+    std::cout << "  trilinear sampler " << numSamples / ( ms * 1000.0 ) << " Msamples/s, mean " << total[0] / numSamples << " " << total[1] / numSamples << " " << total[2] / numSamples << std::endl;
+    return 0;
+}
@@ -0,0 +1,129 @@
+//
+//  MultiViewTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Jobs/JobSystem.hpp"
+#include "Maths/Math.hpp"
+#include "Spatial/MultiViewCuller.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <math.h>
+#include <random>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// One view at a time, plane by plane, for checking the masks
+static bool insideView( const Vector4f planes[6], const InstanceData& instance )
+{
+    const Matrix44f& m = instance.instanceTransform;
+    const float center[3] = { m.columns[3].x, m.columns[3].y, m.columns[3].z };
+    float extent[3];
+    for ( int a = 0; a < 3; ++a )
+    {
+        extent[a] = 0.5f * ( fabsf( ( &m.columns[0].x )[a] ) + fabsf( ( &m.columns[1].x )[a] ) + fabsf( ( &m.columns[2].x )[a] ) );
+    }
+    for ( int p = 0; p < 6; ++p )
+    {
+        const float distance = planes[p].x * center[0] + planes[p].y * center[1] + planes[p].z * center[2] + planes[p].w;
+        const float radius = fabsf( planes[p].x ) * extent[0] + fabsf( planes[p].y ) * extent[1] + fabsf( planes[p].z ) * extent[2];
+        if ( distance + radius < 0.f )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Unit cubes scattered around four cameras at the origin looking along +x, -x, +z and -z.
+// Culls them for 1 to 4 views in one pass and as that many single view passes, checks the
+// masks against a plane by plane test and the gathered ranges against the visible counts
+int multiViewTool( int argc, const char* argv[] )
+{
+    const size_t instanceCount = argc > 0 ? (size_t)atol( argv[0] ) : 500000;
+    const unsigned int runs = argc > 1 ? (unsigned int)atoi( argv[1] ) : 10;
+    std::mt19937 rng( 1234 );
+    std::uniform_real_distribution<float> unit( -1.f, 1.f );
+
+    std::vector<InstanceData> instances( instanceCount );
+    for ( InstanceData& instance : instances )
+    {
+        const float scale = 0.2f + 0.8f * fabsf( unit( rng ) );
+        instance.instanceTransform = Maths::makeTranslate( { unit( rng ) * 100.f, unit( rng ) * 20.f, unit( rng ) * 100.f } ) *
+                                     Maths::makeYRotate( unit( rng ) * (float)M_PI ) * Maths::makeScale( { scale, scale, scale } );
+    }
+    const float boxMin[3] = { -0.5f, -0.5f, -0.5f };
+    const float boxMax[3] = { 0.5f, 0.5f, 0.5f };
+
+    Matrix44f clipFromWorld[ MultiViewCuller::kMaxViews ];
+    const Matrix44f perspective = Maths::makePerspective( 60.f * M_PI / 180.f, 16.f / 9.f, 0.1f, 150.f );
+    for ( uint32_t v = 0; v < MultiViewCuller::kMaxViews; ++v )
+    {
+        clipFromWorld[v] = perspective * Maths::makeYRotate( v * (float)M_PI * 0.5f );
+    }
+    std::cout << "multiview " << instanceCount << " instances on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+
+    MultiViewCuller culler;
+    std::vector<InstanceData> gathered( instanceCount );
+    for ( uint32_t viewCount = 1; viewCount <= MultiViewCuller::kMaxViews; ++viewCount )
+    {
+        double sharedMs = 1e30, separateMs = 1e30;
+        for ( unsigned int run = 0; run < runs; ++run )
+        {
+            auto start = std::chrono::steady_clock::now();
+            for ( uint32_t v = 0; v < viewCount; ++v )
+            {
+                culler.setViews( clipFromWorld + v, 1 );
+                culler.cull( instances.data(), instanceCount, boxMin, boxMax );
+            }
+            separateMs = std::min( separateMs, elapsedMs( start ) );
+
+            start = std::chrono::steady_clock::now();
+            culler.setViews( clipFromWorld, viewCount );
+            culler.cull( instances.data(), instanceCount, boxMin, boxMax );
+            sharedMs = std::min( sharedMs, elapsedMs( start ) );
+        }
+
+        size_t wrong = 0;
+        const std::vector<uint8_t>& masks = culler.masks();
+        for ( uint32_t v = 0; v < viewCount; ++v )
+        {
+            Vector4f planes[6];
+            Maths::extractFrustumPlanes( clipFromWorld[v], planes );
+            for ( size_t i = 0; i < instanceCount; ++i )
+            {
+                wrong += ( ( masks[i] >> v ) & 1 ) != ( insideView( planes, instances[i] ) ? 1 : 0 ) ? 1 : 0;
+            }
+        }
+
+        const size_t written = culler.gather( instances.data(), gathered.data() );
+        const MultiViewCuller::Stats& stats = culler.stats();
+        size_t rangeMismatches = 0;
+        uint32_t draws = 0;
+        for ( uint32_t v = 0; v < viewCount; ++v )
+        {
+            MultiViewCuller::Range ranges[ MultiViewCuller::kMaskCount / 2 ];
+            const uint32_t rangeCount = culler.viewRanges( v, ranges );
+            size_t drawn = 0;
+            for ( uint32_t r = 0; r < rangeCount; ++r )
+            {
+                drawn += ranges[r].count;
+            }
+            rangeMismatches += drawn != stats.visible[v] ? 1 : 0;
+            draws += rangeCount;
+        }
+
+        std::cout << "  " << viewCount << " view" << ( viewCount > 1 ? "s" : " " ) << ": one pass " << sharedMs << " ms, " << viewCount
+                  << " single view passes " << separateMs << " ms; " << written << " instances written once, " << draws
+                  << " draws; " << wrong << " mask bits differ, " << rangeMismatches << " views drawing the wrong count" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,131 @@
+//
+//  OcclusionTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Compute/CpuKernels.hpp"
+#include "Jobs/JobSystem.hpp"
+#include "Raster/OcclusionCuller.hpp"
+#include "Raster/SoftwareRasterizer.hpp"
+#include "Scene/CubeScene.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Culls the rotating cube grid frame by frame and reports the cull rate and CPU cost. Every few
+// frames the scene is drawn with the software rasterizer from all instances and from the
+// visible ones only - any pixel that differs is an instance culled that shouldn't have been,
+// and the time between the two is what the culled draws would have cost, set against the
+// culling. The default cubes are twice the app's, closer packed, so a few dozen of the biggest
+// on screen hide something at 256x128 - the app's are about 3 pixels across there and hide
+// next to nothing alone
+int occlusionTool( int argc, const char* argv[] )
+{
+    const unsigned int maxOccluders = argc > 0 ? (unsigned int)atoi( argv[0] ) : 64;
+    const unsigned int frames = argc > 1 ? (unsigned int)atoi( argv[1] ) : 100;
+    const unsigned int width = argc > 2 ? (unsigned int)atoi( argv[2] ) : 256;
+    const unsigned int height = argc > 3 ? (unsigned int)atoi( argv[3] ) : 128;
+    const float cubeScale = argc > 4 ? (float)atof( argv[4] ) : 2.f;
+    const unsigned int checkWidth = 640;
+    const unsigned int checkHeight = 360;
+    if ( frames == 0 || width == 0 || height == 0 || width % 4 != 0 )
+    {
+        std::cout << "usage: mmtool occlusion [occluders] [frames > 0] [width, a multiple of 4] [height > 0] [cube scale]" << std::endl;
+        return 1;
+    }
+
+    std::vector<VertexData> vertices;
+    std::vector<uint16_t> indices;
+    CubeScene::buildCube( vertices, indices );
+    CameraData camera;
+    CubeScene::updateCamera( &camera, (float)checkWidth / (float)checkHeight );
+    const Matrix44f clipFromWorld = camera.perspectiveTransform * camera.worldTransform;
+
+    const unsigned int textureSize = 128;
+    std::vector<uint8_t> texels( textureSize * textureSize * 4 );
+    metal::CpuTexture texture = { texels.data(), textureSize, textureSize, textureSize * 4, metal::CpuTexture::Format::RGBA8Unorm };
+    CpuKernels::mandelbrotSet( texture, 0 );
+
+    OcclusionCuller culler( width, height );
+    SoftwareRasterizer all( checkWidth, checkHeight );
+    SoftwareRasterizer visibleOnly( checkWidth, checkHeight );
+    std::cout << "occlusion " << width << "x" << height << " depth, up to " << maxOccluders << " occluders, " << kNumInstances
+              << " instances on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+
+    std::vector<InstanceData> instances( kNumInstances );
+    std::vector<InstanceData> visible( kNumInstances );
+    OcclusionCuller::Stats total = {};
+    size_t visibleTotal = 0;
+    size_t checkedFrames = 0;
+    size_t wrongPixels = 0;
+    double allDrawMs = 0.0, visibleDrawMs = 0.0, checkedCullMs = 0.0;
+    for ( unsigned int frame = 0; frame < frames; ++frame )
+    {
+        // a full turn over the run, so the grid is seen face on, edge on and corner on
+        CubeScene::updateInstances( instances.data(), frame * 6.2831853f / frames );
+        for ( InstanceData& instance : instances )
+        {
+            for ( int c = 0; c < 3; ++c )
+            {
+                instance.instanceTransform.columns[c] = instance.instanceTransform.columns[c] * cubeScale;
+            }
+        }
+        const size_t visibleCount = culler.cullInstances( clipFromWorld, instances.data(), instances.size(), vertices.data(), vertices.size(),
+                                                          indices.data(), indices.size(), maxOccluders, visible.data() );
+        const OcclusionCuller::Stats& stats = culler.stats();
+        total.occluders += stats.occluders;
+        total.occluderTriangles += stats.occluderTriangles;
+        total.outsideFrustum += stats.outsideFrustum;
+        total.occluded += stats.occluded;
+        total.setupMs += stats.setupMs;
+        total.rasterMs += stats.rasterMs;
+        total.pyramidMs += stats.pyramidMs;
+        total.testMs += stats.testMs;
+        visibleTotal += visibleCount;
+
+        if ( frame % 10 == 0 )
+        {
+            all.clear( metal::float4( 0.f, 0.f, 0.f, 1.f ) );
+            auto start = std::chrono::steady_clock::now();
+            all.drawIndexedInstanced( vertices.data(), vertices.size(), indices.data(), indices.size(), instances.data(), instances.size(), camera, texture );
+            allDrawMs += elapsedMs( start );
+            visibleOnly.clear( metal::float4( 0.f, 0.f, 0.f, 1.f ) );
+            start = std::chrono::steady_clock::now();
+            visibleOnly.drawIndexedInstanced( vertices.data(), vertices.size(), indices.data(), indices.size(), visible.data(), visibleCount, camera, texture );
+            visibleDrawMs += elapsedMs( start );
+            checkedCullMs += stats.setupMs + stats.rasterMs + stats.pyramidMs + stats.testMs;
+            for ( size_t p = 0; p < (size_t)checkWidth * checkHeight; ++p )
+            {
+                wrongPixels += memcmp( all.colorData() + p * 4, visibleOnly.colorData() + p * 4, 4 ) != 0 ? 1 : 0;
+            }
+            ++checkedFrames;
+        }
+    }
+
+    const double instanceCount = (double)kNumInstances * frames;
+    const double cpuMs = total.setupMs + total.rasterMs + total.pyramidMs + total.testMs;
+    std::cout << "  " << visibleTotal / frames << " of " << kNumInstances << " visible per frame - " << 100.0 * total.outsideFrustum / instanceCount
+              << "% outside the frustum, " << 100.0 * total.occluded / instanceCount << "% occluded" << std::endl;
+    std::cout << "  " << total.occluders / frames << " occluders, " << total.occluderTriangles / frames << " triangles rasterized per frame" << std::endl;
+    std::cout << "  " << cpuMs / frames << " ms/frame (setup " << total.setupMs / frames << ", raster " << total.rasterMs / frames << ", pyramid "
+              << total.pyramidMs / frames << ", test " << total.testMs / frames << ")" << std::endl;
+    const double savedMs = ( allDrawMs - visibleDrawMs ) / std::max<size_t>( checkedFrames, 1 );
+    const double cullMs = checkedCullMs / std::max<size_t>( checkedFrames, 1 );
+    std::cout << "  drawing at " << checkWidth << "x" << checkHeight << " with the software rasterizer: " << allDrawMs / std::max<size_t>( checkedFrames, 1 )
+              << " ms everything, " << visibleDrawMs / std::max<size_t>( checkedFrames, 1 ) << " ms the visible ones - culling saves " << savedMs
+              << " ms for " << cullMs << " ms, " << ( savedMs > cullMs ? "a net win" : "a net loss" ) << std::endl;
+    std::cout << "  " << wrongPixels << " pixels differ drawing only the visible instances, over " << checkedFrames << " frames at "
+              << checkWidth << "x" << checkHeight << std::endl;
+    return wrongPixels == 0 ? 0 : 1;
+}
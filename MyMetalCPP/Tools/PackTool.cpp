@@ -0,0 +1,478 @@
+//
+//  PackTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Pack/PackFile.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using PackFormat::Codec;
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static bool parseCodec( const char* pName, Codec* pCodec )
+{
+    const Codec codecs[] = { Codec::None, Codec::Lz4, Codec::Zlib, Codec::Zstd };
+    for ( Codec codec : codecs )
+    {
+        if ( strcmp( pName, PackFormat::codecName( codec ) ) == 0 )
+        {
+            *pCodec = codec;
+            return true;
+        }
+    }
+    std::cout << "unknown codec " << pName << ", none, lz4, zlib or zstd" << std::endl;
+    return false;
+}
+
+static bool readFile( const std::string& path, std::vector<uint8_t>& data )
+{
+    const int fd = open( path.c_str(), O_RDONLY );
+    struct stat info;
+    if ( fd < 0 || fstat( fd, &info ) != 0 )
+    {
+        if ( fd >= 0 )
+        {
+            close( fd );
+        }
+        return false;
+    }
+    data.resize( (size_t)info.st_size );
+    const bool read = pread( fd, data.data(), data.size(), 0 ) == (ssize_t)data.size();
+    close( fd );
+    return read;
+}
+
+// Regular files under directory, paths relative to it, sorted so packs come out the same
+static void listFiles( const std::string& directory, const std::string& prefix, std::vector<std::string>& paths )
+{
+    DIR* pDir = opendir( ( directory + prefix ).c_str() );
+    if ( !pDir )
+    {
+        return;
+    }
+    while ( dirent* pEntry = readdir( pDir ) )
+    {
+        if ( pEntry->d_name[0] == '.' )
+        {
+            continue;
+        }
+        const std::string path = prefix + pEntry->d_name;
+        struct stat info;
+        if ( stat( ( directory + path ).c_str(), &info ) != 0 )
+        {
+            continue;
+        }
+        if ( S_ISDIR( info.st_mode ) )
+        {
+            listFiles( directory, path + "/", paths );
+        }
+        else if ( S_ISREG( info.st_mode ) )
+        {
+            paths.push_back( path );
+        }
+    }
+    closedir( pDir );
+    std::sort( paths.begin(), paths.end() );
+}
+
+static int build( const char* packPath, const std::string& directory, Codec codec, uint32_t chunkSize, int compressionLevel )
+{
+    std::vector<std::string> paths;
+    listFiles( directory + "/", "", paths );
+    if ( paths.empty() )
+    {
+        std::cout << "no files in " << directory << std::endl;
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    PackWriter writer( chunkSize );
+    std::vector<uint8_t> data;
+    uint64_t bytes = 0;
+    for ( const std::string& path : paths )
+    {
+        if ( !readFile( directory + "/" + path, data ) )
+        {
+            std::cout << "can't read " << path << std::endl;
+            return 1;
+        }
+        writer.add( path, data.data(), data.size(), codec );
+        bytes += data.size();
+    }
+    const double readMs = elapsedMs( start );
+    start = std::chrono::steady_clock::now();
+    if ( !writer.write( packPath, compressionLevel ) )
+    {
+        return 1;
+    }
+    const double writeMs = elapsedMs( start );
+
+    PackFile pack;
+    if ( !pack.open( packPath ) )
+    {
+        return 1;
+    }
+    size_t mismatched = 0;
+    std::vector<uint8_t> readBack;
+    for ( const std::string& path : paths )
+    {
+        const PackFile::Entry entry = pack.find( path );
+        readFile( directory + "/" + path, data );
+        readBack.resize( data.size() );
+        const bool same = entry != PackFile::kInvalidEntry && pack.size( entry ) == data.size() && pack.read( entry, readBack.data() ) &&
+                          memcmp( readBack.data(), data.data(), data.size() ) == 0;
+        mismatched += same ? 0 : 1;
+    }
+    std::cout << packPath << ": " << paths.size() << " files, " << PackFormat::codecName( codec ) << " in " << chunkSize / 1024 << " KB chunks, "
+              << pack.fileSize() / 1024 << " KB of " << bytes / 1024 << " KB; read " << readMs << " ms, compress and write " << writeMs << " ms; "
+              << mismatched << " differ read back" << std::endl;
+    return mismatched == 0 ? 0 : 1;
+}
+
+static int list( const char* packPath )
+{
+    PackFile pack;
+    if ( !pack.open( packPath ) )
+    {
+        return 1;
+    }
+    std::cout << pack.entryCount() << " entries, " << pack.fileSize() << " bytes" << std::endl;
+    for ( PackFile::Entry entry = 0; entry < pack.entryCount(); ++entry )
+    {
+        std::cout << "  " << pack.path( entry ) << ": " << pack.size( entry ) << " bytes in " << pack.chunkCount( entry ) << " chunks, "
+                  << pack.storedSize( entry ) << " stored" << ( pack.mapped( entry ) ? ", mapped" : "" ) << std::endl;
+    }
+    return 0;
+}
+
+// Something like what a game ships: vertex data, text, images, and data that's compressed already
+static void fillAsset( size_t index, std::vector<uint8_t>& data, std::mt19937& rng )
+{
+    switch ( index % 4 )
+    {
+        case 0:     // positions, normals and uvs over a bumpy grid
+        {
+            float* pFloats = reinterpret_cast<float*>( data.data() );
+            const size_t count = data.size() / sizeof( float );
+            for ( size_t i = 0; i + 8 <= count; i += 8 )
+            {
+                const float u = ( i / 8 % 256 ) / 255.f, v = ( i / 8 / 256 ) / 255.f;
+                pFloats[i] = u;
+                pFloats[ i + 1 ] = 0.1f * sinf( u * 12.f + index ) * cosf( v * 9.f );
+                pFloats[ i + 2 ] = v;
+                pFloats[ i + 3 ] = 0.f;
+                pFloats[ i + 4 ] = 1.f;
+                pFloats[ i + 5 ] = 0.f;
+                pFloats[ i + 6 ] = u;
+                pFloats[ i + 7 ] = v;
+            }
+            break;
+        }
+        case 1:     // words
+        {
+            static const char* kWords[] = { "material", "shader", "texture", "vertex", "float", "uniform", "sampler", "mesh", "node", "transform",
+                                            "the", "of", "and", "light", "shadow", "normal", "color", "alpha", "blend", "index" };
+            size_t i = 0;
+            while ( i < data.size() )
+            {
+                const char* pWord = kWords[ rng() % 20 ];
+                for ( ; *pWord && i < data.size(); ++pWord )
+                {
+                    data[ i++ ] = (uint8_t)*pWord;
+                }
+                if ( i < data.size() )
+                {
+                    data[ i++ ] = rng() % 8 == 0 ? '\n' : ' ';
+                }
+            }
+            break;
+        }
+        case 2:     // RGBA gradients with grain
+            for ( size_t i = 0; i < data.size(); ++i )
+            {
+                data[i] = (uint8_t)( ( i / 4 % 1024 ) / 4 + ( i % 4 ) * 40 + ( rng() & 7 ) );
+            }
+            break;
+        default:    // compressed already
+            for ( size_t i = 0; i < data.size(); ++i )
+            {
+                data[i] = (uint8_t)rng();
+            }
+            break;
+    }
+}
+
+// Written once and kept - rerunning with the same count reuses them
+static bool createAssets( const std::string& directory, size_t count, std::vector<std::string>& paths )
+{
+    static const char* kFolders[] = { "meshes", "text", "textures", "audio" };
+    mkdir( directory.c_str(), 0755 );
+    std::mt19937 rng( 11 );
+    std::vector<uint8_t> data;
+    for ( size_t i = 0; i < count; ++i )
+    {
+        // log uniform, 4 KB to 2 MB
+        const size_t size = (size_t)( 4096.0 * pow( 512.0, ( rng() % 10000 ) / 10000.0 ) );
+        mkdir( ( directory + "/" + kFolders[ i % 4 ] ).c_str(), 0755 );
+        char name[ 64 ];
+        snprintf( name, sizeof( name ), "%s/asset_%05zu.bin", kFolders[ i % 4 ], i );
+        paths.push_back( name );
+        const std::string path = directory + "/" + name;
+        struct stat info;
+        if ( stat( path.c_str(), &info ) == 0 && (size_t)info.st_size == size )
+        {
+            rng.discard( size );
+            continue;
+        }
+        data.assign( size, 0 );
+        fillAsset( i, data, rng );
+        FILE* pFile = fopen( path.c_str(), "wb" );
+        const bool written = pFile && fwrite( data.data(), 1, size, pFile ) == size;
+        if ( pFile )
+        {
+            fclose( pFile );
+        }
+        if ( !written )
+        {
+            std::cout << "can't write " << path << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static void dropCache( const std::string& path )
+{
+    const int fd = open( path.c_str(), O_RDONLY );
+    if ( fd >= 0 )
+    {
+        fdatasync( fd );
+#if defined( POSIX_FADV_DONTNEED )
+        posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+#endif
+        close( fd );
+    }
+}
+
+// Loading every asset from loose files, one open and read each, against finding and reading
+// them all from packs of each codec in one batch. From storage with the page cache dropped and
+// from the cache, best of iterations, GB/s of asset bytes
+static int benchmark( size_t count, const std::string& directory, unsigned int iterations )
+{
+    const std::string looseDirectory = directory + "/loose";
+    mkdir( directory.c_str(), 0755 );
+    std::vector<std::string> paths;
+    if ( !createAssets( looseDirectory, count, paths ) )
+    {
+        return 1;
+    }
+    std::vector<uint64_t> offsets;
+    uint64_t totalBytes = 0;
+    for ( const std::string& path : paths )
+    {
+        struct stat info;
+        stat( ( looseDirectory + "/" + path ).c_str(), &info );
+        offsets.push_back( totalBytes );
+        totalBytes += ( (uint64_t)info.st_size + 63 ) & ~(uint64_t)63;
+    }
+    std::vector<uint8_t> reference( totalBytes ), arena( totalBytes );
+    std::cout << "pack bench: " << count << " assets, " << totalBytes / 1048576 << " MB, best of " << iterations << std::endl;
+
+    auto loadLoose = [&]( uint8_t* pArena )
+    {
+        for ( size_t i = 0; i < paths.size(); ++i )
+        {
+            const int fd = open( ( looseDirectory + "/" + paths[i] ).c_str(), O_RDONLY );
+            struct stat info;
+            if ( fd < 0 || fstat( fd, &info ) != 0 || pread( fd, pArena + offsets[i], (size_t)info.st_size, 0 ) != (ssize_t)info.st_size )
+            {
+                return false;
+            }
+            close( fd );
+        }
+        return true;
+    };
+    if ( !loadLoose( reference.data() ) )
+    {
+        std::cout << "can't read the loose files" << std::endl;
+        return 1;
+    }
+
+    auto report = [&]( const char* pName, const double* pBestMs, const std::string& detail )
+    {
+        std::cout << "  " << std::left << std::setw( 12 ) << pName << std::right << std::fixed << std::setprecision( 2 ) << std::setw( 7 )
+                  << totalBytes / ( pBestMs[0] * 1e6 ) << " GB/s uncached, " << std::setw( 7 ) << totalBytes / ( pBestMs[1] * 1e6 ) << " GB/s cached";
+        std::cout.unsetf( std::ios::floatfield );
+        std::cout << detail << std::endl;
+    };
+
+    double looseMs[2] = { 1e30, 1e30 };
+    for ( int cached = 0; cached < 2; ++cached )
+    {
+        for ( unsigned int i = 0; i < iterations; ++i )
+        {
+            for ( size_t f = 0; !cached && f < paths.size(); ++f )
+            {
+                dropCache( looseDirectory + "/" + paths[f] );
+            }
+            const auto start = std::chrono::steady_clock::now();
+            loadLoose( arena.data() );
+            looseMs[ cached ] = std::min( looseMs[ cached ], elapsedMs( start ) );
+        }
+    }
+    report( "loose", looseMs, "" );
+
+    std::vector<uint8_t> data;
+    const Codec codecs[] = { Codec::None, Codec::Lz4, Codec::Zlib, Codec::Zstd };
+    for ( Codec codec : codecs )
+    {
+        if ( !PackFormat::supports( codec ) )
+        {
+            std::cout << "  " << std::left << std::setw( 12 ) << PackFormat::codecName( codec ) << std::right << "not in this build" << std::endl;
+            continue;
+        }
+        const std::string packPath = directory + "/assets_" + PackFormat::codecName( codec ) + ".pack";
+        auto start = std::chrono::steady_clock::now();
+        PackWriter writer;
+        for ( size_t i = 0; i < paths.size(); ++i )
+        {
+            readFile( looseDirectory + "/" + paths[i], data );
+            writer.add( paths[i], data.data(), data.size(), codec );
+        }
+        if ( !writer.write( packPath.c_str() ) )
+        {
+            return 1;
+        }
+        const double packMs = elapsedMs( start );
+
+        double bestMs[2] = { 1e30, 1e30 }, mappedMs = 1e30, findNs = 0.0;
+        size_t mismatched = 0, mappedEntries = 0;
+        size_t packSize = 0;
+        uint64_t sum = 0;
+        std::vector<PackFile::Entry> entries( paths.size() );
+        std::vector<uint8_t*> destinations( paths.size() );
+        for ( int cached = 0; cached < 2; ++cached )
+        {
+            for ( unsigned int i = 0; i < iterations; ++i )
+            {
+                if ( !cached )
+                {
+                    dropCache( packPath );
+                }
+                memset( arena.data(), 0, arena.size() );
+                start = std::chrono::steady_clock::now();
+                PackFile pack;
+                if ( !pack.open( packPath.c_str() ) )
+                {
+                    return 1;
+                }
+                for ( size_t e = 0; e < paths.size(); ++e )
+                {
+                    entries[e] = pack.find( paths[e] );
+                    destinations[e] = arena.data() + offsets[e];
+                }
+                const bool read = pack.read( entries.data(), destinations.data(), entries.size() );
+                bestMs[ cached ] = std::min( bestMs[ cached ], elapsedMs( start ) );
+                mismatched += read && memcmp( arena.data(), reference.data(), arena.size() ) == 0 ? 0 : 1;
+                packSize = pack.fileSize();
+
+                // used in place where it's stored plain - a word a cache line
+                if ( cached && codec == Codec::None )
+                {
+                    start = std::chrono::steady_clock::now();
+                    mappedEntries = 0;
+                    for ( size_t e = 0; e < paths.size(); ++e )
+                    {
+                        const uint8_t* pData = pack.mapped( pack.find( paths[e] ) );
+                        mappedEntries += pData ? 1 : 0;
+                        for ( uint64_t offset = 0; pData && offset < pack.size( entries[e] ); offset += 64 )
+                        {
+                            sum += pData[ offset ];
+                        }
+                    }
+                    mappedMs = std::min( mappedMs, elapsedMs( start ) );
+                }
+                if ( cached && i == 0 )
+                {
+                    start = std::chrono::steady_clock::now();
+                    for ( int repeat = 0; repeat < 100; ++repeat )
+                    {
+                        for ( const std::string& path : paths )
+                        {
+                            sum += pack.find( path );
+                        }
+                    }
+                    findNs = elapsedMs( start ) * 1e6 / ( 100.0 * paths.size() );
+                }
+            }
+        }
+        std::ostringstream detail;
+        detail << "  (" << packSize * 100 / totalBytes << "% size, packed in " << (int)packMs << " ms, " << findNs << " ns a find"
+               << ( mismatched ? ", MISMATCHED" : "" ) << ")";
+        report( PackFormat::codecName( codec ), bestMs, detail.str() );
+        if ( codec == Codec::None )
+        {
+            std::ostringstream mapped;
+            mapped << "  " << mappedEntries << " of " << paths.size() << " entries in place, " << totalBytes / ( mappedMs * 1e6 )
+                   << " GB/s touched  (" << ( sum & 1 ) << ")";
+            std::cout << mapped.str() << std::endl;
+        }
+        if ( mismatched )
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int packTool( int argc, const char* argv[] )
+{
+    if ( argc < 1 )
+    {
+        std::cout << "usage: mmtool pack build <pack> <dir> [none|lz4|zlib|zstd] [chunk KB] [level] | list <pack> | bench [assets] [dir] [iterations]"
+                  << std::endl;
+        return 1;
+    }
+    if ( strcmp( argv[0], "build" ) == 0 && argc > 2 )
+    {
+        Codec codec = Codec::Lz4;
+        if ( argc > 3 && !parseCodec( argv[3], &codec ) )
+        {
+            return 1;
+        }
+        const uint32_t chunkSize = argc > 4 ? (uint32_t)atoi( argv[4] ) << 10 : PackFormat::kDefaultChunkSize;
+        return build( argv[1], argv[2], codec, std::max( chunkSize, 1024u ), argc > 5 ? atoi( argv[5] ) : 0 );
+    }
+    if ( strcmp( argv[0], "list" ) == 0 && argc > 1 )
+    {
+        return list( argv[1] );
+    }
+    if ( strcmp( argv[0], "bench" ) == 0 )
+    {
+        return benchmark( argc > 1 ? (size_t)atol( argv[1] ) : 512, argc > 2 ? argv[2] : "/tmp/mmtool_pack", argc > 3 ? (unsigned int)atoi( argv[3] ) : 3 );
+    }
+    std::cout << "unknown pack command " << argv[0] << std::endl;
+    return 1;
+}
@@ -0,0 +1,120 @@
+//
+//  RasterTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Compute/CpuKernels.hpp"
+#include "Jobs/JobSystem.hpp"
+#include "Raster/SoftwareRasterizer.hpp"
+#include "Scene/CubeScene.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+static constexpr int kReferenceTolerance = 2;      // sRGB steps a channel
+
+// Renders the instanced cube scene with the software rasterizer, reports its throughput and
+// checks the last frame against the scalar reference
+int rasterTool( int argc, const char* argv[] )
+{
+    const unsigned int width = argc > 0 ? (unsigned int)atoi( argv[0] ) : 1280;
+    const unsigned int height = argc > 1 ? (unsigned int)atoi( argv[1] ) : 720;
+    const unsigned int frames = argc > 2 ? (unsigned int)atoi( argv[2] ) : 30;
+    const char* pOutput = argc > 3 ? argv[3] : nullptr;
+    if ( width == 0 || height == 0 || frames == 0 )
+    {
+        std::cout << "usage: mmtool raster [width > 0] [height > 0] [frames > 0] [output.ppm]" << std::endl;
+        return 1;
+    }
+
+    std::vector<VertexData> vertices;
+    std::vector<uint16_t> indices;
+    CubeScene::buildCube( vertices, indices );
+
+    std::vector<InstanceData> instances( kNumInstances );
+    CameraData camera;
+    CubeScene::updateCamera( &camera, (float)width / (float)height );
+
+    // same texture the app starts with
+    const unsigned int textureSize = 128;
+    std::vector<uint8_t> texels( textureSize * textureSize * 4 );
+    metal::CpuTexture texture = { texels.data(), textureSize, textureSize, textureSize * 4, metal::CpuTexture::Format::RGBA8Unorm };
+    CpuKernels::mandelbrotSet( texture, 0 );
+
+    SoftwareRasterizer rasterizer( width, height );
+    std::cout << "raster " << width << "x" << height << ", " << kNumInstances << " instances on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+
+    double vertexMs = 0.0, binMs = 0.0, rasterMs = 0.0;
+    uint64_t trianglesIn = 0, trianglesBinned = 0, pixelsShaded = 0;
+    float angle = 0.f;
+    for ( unsigned int frame = 0; frame < frames; ++frame )
+    {
+        CubeScene::updateInstances( instances.data(), angle );
+        angle += 0.002f;
+
+        rasterizer.clear( metal::float4( 0.1f, 0.1f, 0.1f, 1.f ) );
+        rasterizer.drawIndexedInstanced( vertices.data(), vertices.size(), indices.data(), indices.size(),
+                                         instances.data(), instances.size(), camera, texture );
+
+        const SoftwareRasterizer::Stats& stats = rasterizer.stats();
+        vertexMs += stats.vertexMs;
+        binMs += stats.binMs;
+        rasterMs += stats.rasterMs;
+        trianglesIn += stats.trianglesIn;
+        trianglesBinned += stats.trianglesBinned;
+        pixelsShaded += stats.pixelsShaded;
+    }
+
+    const double totalMs = vertexMs + binMs + rasterMs;
+    std::cout << "  " << totalMs / frames << " ms/frame (vertex " << vertexMs / frames << ", bin " << binMs / frames << ", raster " << rasterMs / frames << ")" << std::endl;
+    std::cout << "  " << trianglesIn / frames << " triangles in, " << trianglesBinned / frames << " after culling, " << pixelsShaded / frames << " pixels shaded per frame" << std::endl;
+    std::cout << "  " << trianglesIn / ( totalMs * 1000.0 ) << " Mtriangles/s, " << pixelsShaded / ( rasterMs * 1000.0 ) << " Mpixels/s" << std::endl;
+
+    // the last frame again through the scalar reference. Float edge functions can land a pixel
+    // centre that sits on an edge either side where the reference's are exact, and the
+    // interpolation rounds differently - so a few pixels a frame along edges, off by a step or
+    // two otherwise, and nothing more
+    SoftwareRasterizer reference( width, height );
+    reference.clear( metal::float4( 0.1f, 0.1f, 0.1f, 1.f ) );
+    reference.drawReference( vertices.data(), indices.data(), indices.size(), instances.data(), instances.size(), camera, texture );
+    const size_t pixelCount = (size_t)width * height;
+    size_t differing = 0;
+    for ( size_t i = 0; i < pixelCount * 4; i += 4 )
+    {
+        int largest = 0;
+        for ( int c = 0; c < 4; ++c )
+        {
+            largest = std::max( largest, abs( rasterizer.colorData()[ i + c ] - reference.colorData()[ i + c ] ) );
+        }
+        differing += largest > kReferenceTolerance ? 1 : 0;
+    }
+    std::cout << "  " << differing << " of " << pixelCount << " pixels differ from the scalar reference by more than " << kReferenceTolerance << std::endl;
+    if ( differing > pixelCount / 10000 )
+    {
+        std::cout << "  FAILED: more than 1 in 10000 pixels differ" << std::endl;
+        return 1;
+    }
+
+    if ( pOutput )
+    {
+        FILE* pFile = fopen( pOutput, "wb" );
+        if ( !pFile )
+        {
+            std::cout << "can't write " << pOutput << std::endl;
+            return 1;
+        }
+        const uint8_t* pPixels = rasterizer.colorData();
+        fprintf( pFile, "P6\n%u %u\n255\n", width, height );
+        for ( size_t i = 0; i < (size_t)width * height; ++i )
+        {
+            fwrite( &pPixels[ i * 4 ], 1, 3, pFile );
+        }
+        fclose( pFile );
+    }
+    return 0;
+}
@@ -0,0 +1,178 @@
+//
+//  RecordTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Jobs/JobSystem.hpp"
+#include "Renderer/CommandRecorder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static uint32_t hash( uint32_t x )
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// Stands in for a render command encoder - writes each call into a word stream the way a driver
+// fills a command buffer, so replays can be compared and timed
+struct StreamEncoder
+{
+    std::vector<uint32_t> words;
+    size_t draws = 0;
+
+    void setPipeline( uint32_t pipeline ) { words.push_back( 1 ); words.push_back( pipeline ); }
+    void setView( uint32_t view ) { words.push_back( 2 ); words.push_back( view ); }
+    void setMesh( uint32_t mesh ) { words.push_back( 3 ); words.push_back( mesh ); }
+    void setTexture( uint32_t texture ) { words.push_back( 4 ); words.push_back( texture ); }
+    void draw( const DrawPacket& packet )
+    {
+        // a little validation work per draw, as the driver would do
+        uint32_t check = hash( packet.firstInstance ) ^ hash( packet.instanceCount + packet.mesh );
+        for ( int i = 0; i < 8; ++i )
+        {
+            check = hash( check );
+        }
+        words.push_back( 5 );
+        words.push_back( packet.firstInstance );
+        words.push_back( packet.instanceCount );
+        words.push_back( check );
+        ++draws;
+    }
+};
+
+// The per draw work of a renderer walking its scene - which pipeline, mesh and texture, which
+// view and how many instances - made up from the draw index
+static void recordDraws( size_t begin, size_t end, CommandList& list )
+{
+    for ( size_t i = begin; i < end; ++i )
+    {
+        const uint32_t h = hash( (uint32_t)i );
+        DrawPacket packet;
+        packet.pipeline = h % 8;
+        packet.view = (uint32_t)( i / 4096 ) % 4;
+        packet.mesh = ( h >> 3 ) % 512;
+        packet.texture = packet.mesh / 4;
+        packet.firstInstance = (uint32_t)i * 4;
+        packet.instanceCount = 1 + ( h >> 12 ) % 4;
+        list.draw( packet );
+    }
+}
+
+// Records draws on the JobSystem, checks the merged stream is the same as recording serially
+// and with a different split, then replays it through one encoder and through one per segment
+int recordTool( int argc, const char* argv[] )
+{
+    const size_t drawCount = argc > 0 ? (size_t)atol( argv[0] ) : 50000;
+    const size_t grainSize = argc > 1 ? (size_t)atol( argv[1] ) : 256;
+    const unsigned int runs = argc > 2 ? (unsigned int)atoi( argv[2] ) : 10;
+    JobSystem* pJobs = JobSystem::Instance();
+    std::cout << "record " << drawCount << " draws, " << grainSize << " per list, on " << pJobs->numThreads() << " threads" << std::endl;
+
+    CommandRecorder serial;
+    serial.begin();
+    serial.record( drawCount, drawCount, recordDraws );
+    const std::vector<DrawPacket> expected = serial.merge();
+
+    CommandRecorder recorder;
+    double recordMs = 1e30, mergeMs = 1e30;
+    for ( unsigned int run = 0; run < runs; ++run )
+    {
+        recorder.begin();
+        recorder.record( drawCount, grainSize, recordDraws );
+        recorder.merge();
+        recordMs = std::min( recordMs, recorder.stats().recordMs );
+        mergeMs = std::min( mergeMs, recorder.stats().mergeMs );
+    }
+    const std::vector<DrawPacket>& packets = recorder.packets();
+    const bool sameAsSerial = packets.size() == expected.size() &&
+                              memcmp( packets.data(), expected.data(), packets.size() * sizeof( DrawPacket ) ) == 0;
+
+    // the same frame recorded as two calls with an odd split
+    CommandRecorder other;
+    other.begin();
+    other.record( drawCount / 3, grainSize * 3 + 1, recordDraws );
+    other.record( drawCount - drawCount / 3, grainSize / 2 + 1, [&]( size_t begin, size_t end, CommandList& list )
+    {
+        recordDraws( begin + drawCount / 3, end + drawCount / 3, list );
+    } );
+    const std::vector<DrawPacket>& otherPackets = other.merge();
+    const bool sameSplit = otherPackets.size() == expected.size() &&
+                           memcmp( otherPackets.data(), expected.data(), otherPackets.size() * sizeof( DrawPacket ) ) == 0;
+    std::cout << "  recorded in " << recordMs << " ms into " << recorder.stats().lists << " lists, merged in " << mergeMs << " ms; "
+              << ( sameAsSerial ? "same as serial" : "DIFFERENT FROM SERIAL" ) << ", "
+              << ( sameSplit ? "same with another split" : "DIFFERENT WITH ANOTHER SPLIT" ) << std::endl;
+
+    // replay through one encoder, then through a segment per thread
+    double oneMs = 1e30;
+    size_t oneChanges = 0;
+    StreamEncoder one;
+    for ( unsigned int run = 0; run < runs; ++run )
+    {
+        one = StreamEncoder();
+        const auto start = std::chrono::steady_clock::now();
+        oneChanges = CommandRecorder::replay( packets.data(), packets.size(), one );
+        oneMs = std::min( oneMs, elapsedMs( start ) );
+    }
+
+    const uint32_t maxSegments = std::max( 4u, pJobs->numThreads() );
+    std::vector<CommandRecorder::Segment> segments( maxSegments );
+    const uint32_t segmentCount = recorder.split( maxSegments, 1024, segments.data() );
+    std::vector<StreamEncoder> encoders( segmentCount );
+    std::vector<size_t> changes( segmentCount );
+    double parallelMs = 1e30;
+    for ( unsigned int run = 0; run < runs; ++run )
+    {
+        const auto start = std::chrono::steady_clock::now();
+        pJobs->parallelFor( segmentCount, 1, [&]( size_t begin, size_t end )
+        {
+            for ( size_t s = begin; s < end; ++s )
+            {
+                encoders[s] = StreamEncoder();
+                changes[s] = CommandRecorder::replay( packets.data() + segments[s].first, segments[s].count, encoders[s] );
+            }
+        } );
+        parallelMs = std::min( parallelMs, elapsedMs( start ) );
+    }
+
+    // every draw exactly once and in order - the draw words of the segments back to back are the single encoder's
+    std::vector<uint32_t> drawWords, segmentDrawWords;
+    auto collectDraws = []( const std::vector<uint32_t>& words, std::vector<uint32_t>& out )
+    {
+        for ( size_t w = 0; w < words.size(); )
+        {
+            const size_t length = words[w] == 5 ? 4 : 2;
+            if ( words[w] == 5 )
+            {
+                out.insert( out.end(), words.begin() + w, words.begin() + w + length );
+            }
+            w += length;
+        }
+    };
+    collectDraws( one.words, drawWords );
+    size_t segmentChanges = 0;
+    for ( uint32_t s = 0; s < segmentCount; ++s )
+    {
+        collectDraws( encoders[s].words, segmentDrawWords );
+        segmentChanges += changes[s];
+    }
+    std::cout << "  replayed " << one.draws << " draws, " << oneChanges << " state changes: one encoder " << oneMs << " ms, "
+              << segmentCount << " encoders " << parallelMs << " ms with " << segmentChanges << " state changes, "
+              << ( drawWords == segmentDrawWords ? "same draws in the same order" : "DIFFERENT DRAWS" ) << std::endl;
+    return 0;
+}
@@ -0,0 +1,186 @@
+//
+//  ReleaseTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Renderer/ReleaseQueue.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// A resource's life - every frame from its first to its last draws with it
+struct SimResource
+{
+    uint64_t firstFrame;
+    uint64_t lastFrame;
+    bool replaced;
+    bool released;
+};
+
+// What the release function checks against, the simulated GPU's own record of finished frames
+struct SimState
+{
+    std::vector<SimResource> resources;
+    std::unique_ptr<std::atomic<bool>[]> finished;
+    size_t early;           // released while a frame using it was still running
+    size_t twice;
+};
+
+static SimState* s_pState = nullptr;
+
+static void releaseSimResource( void* pObject )
+{
+    SimResource& resource = s_pState->resources[ (uintptr_t)pObject - 1 ];
+    s_pState->twice += resource.released ? 1 : 0;
+    resource.released = true;
+    for ( uint64_t f = resource.firstFrame; f <= resource.lastFrame; ++f )
+    {
+        if ( !s_pState->finished[f].load() )
+        {
+            ++s_pState->early;
+            break;
+        }
+    }
+}
+
+// Frames submitted to a GPU thread that finishes them in any order after a random delay, with
+// a few resources replaced every frame and handed to the queue. The release function checks
+// every frame that used a resource had finished, the end checks nothing leaked
+int releaseTool( int argc, const char* argv[] )
+{
+    const uint64_t frameCount = argc > 0 ? (uint64_t)atoll( argv[0] ) : 2000;
+    const size_t framesInFlight = argc > 1 ? (size_t)atoi( argv[1] ) : 3;
+    const size_t replacements = argc > 2 ? (size_t)atoi( argv[2] ) : 4;
+    const size_t liveCount = 64;
+    std::cout << "release " << frameCount << " frames, " << framesInFlight << " in flight, " << replacements
+              << " resources replaced per frame" << std::endl;
+
+    SimState state = {};
+    state.finished.reset( new std::atomic<bool>[ frameCount + 2 ] );
+    for ( uint64_t f = 0; f < frameCount + 2; ++f )
+    {
+        state.finished[f] = false;
+    }
+    s_pState = &state;
+    ReleaseQueue queue( releaseSimResource );
+    std::mt19937 rng( 1234 );
+
+    std::vector<size_t> live;
+    state.resources.reserve( liveCount + frameCount * replacements );
+    for ( size_t i = 0; i < liveCount; ++i )
+    {
+        live.push_back( state.resources.size() );
+        state.resources.push_back( { 1, 1, false, false } );
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<uint64_t> inFlight;
+    bool done = false;
+    size_t outOfOrder = 0;
+    std::thread gpu( [&]()
+    {
+        std::mt19937 gpuRng( 5678 );
+        std::unique_lock<std::mutex> lock( mutex );
+        for ( ;; )
+        {
+            cv.wait( lock, [&]() { return done || !inFlight.empty(); } );
+            if ( inFlight.empty() )
+            {
+                return;
+            }
+            // any of the frames in flight, usually the oldest
+            const size_t pick = gpuRng() % 4 == 0 ? gpuRng() % inFlight.size() : 0;
+            const uint64_t frame = inFlight[ pick ];
+            inFlight.erase( inFlight.begin() + pick );
+            outOfOrder += pick != 0 ? 1 : 0;
+            lock.unlock();
+
+            std::this_thread::sleep_for( std::chrono::microseconds( gpuRng() % 200 ) );
+            state.finished[ frame ] = true;
+            queue.retire( frame );
+
+            lock.lock();
+            cv.notify_all();
+        }
+    } );
+
+    double collectMs = 0.0, waitMs = 0.0;
+    size_t released = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for ( uint64_t f = 1; f <= frameCount; ++f )
+    {
+        assert( queue.frame() == f );
+        {
+            // the semaphore wait - only for a free slot, never for the GPU to go idle
+            const auto waitStart = std::chrono::steady_clock::now();
+            std::unique_lock<std::mutex> lock( mutex );
+            cv.wait( lock, [&]() { return inFlight.size() < framesInFlight; } );
+            waitMs += elapsedMs( waitStart );
+        }
+        const auto collectStart = std::chrono::steady_clock::now();
+        released += queue.collect();
+        collectMs += elapsedMs( collectStart );
+
+        // everything live draws this frame, then a few are swapped for new ones
+        for ( size_t index : live )
+        {
+            state.resources[ index ].lastFrame = f;
+        }
+        for ( size_t r = 0; r < replacements; ++r )
+        {
+            size_t& slot = live[ rng() % live.size() ];
+            state.resources[ slot ].replaced = true;
+            queue.release( (void*)( (uintptr_t)slot + 1 ) );
+            slot = state.resources.size();
+            state.resources.push_back( { f + 1, f, false, false } );     // first drawn next frame
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( mutex );
+            inFlight.push_back( f );
+        }
+        cv.notify_all();
+        queue.endFrame();
+    }
+    const double frameMs = elapsedMs( start );
+
+    // shutdown - wait for the GPU, then the queue empties
+    {
+        std::unique_lock<std::mutex> lock( mutex );
+        cv.wait( lock, [&]() { return inFlight.empty(); } );
+        done = true;
+    }
+    cv.notify_all();
+    gpu.join();
+    released += queue.collect();
+
+    size_t leaked = 0;
+    for ( const SimResource& resource : state.resources )
+    {
+        leaked += resource.replaced && !resource.released ? 1 : 0;
+    }
+    const ReleaseQueue::Stats stats = queue.stats();
+    std::cout << "  " << frameCount << " frames in " << frameMs << " ms, " << waitMs << " ms waiting for a free frame, "
+              << collectMs << " ms collecting; " << outOfOrder << " frames finished out of order" << std::endl;
+    std::cout << "  " << stats.queued << " queued, " << released << " released, at most " << stats.maxPending << " pending; "
+              << state.early << " released early, " << state.twice << " released twice, " << leaked << " leaked" << std::endl;
+    s_pState = nullptr;
+    return state.early + state.twice + leaked == 0 ? 0 : 1;
+}
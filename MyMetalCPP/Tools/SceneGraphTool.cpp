@@ -0,0 +1,197 @@
+//
+//  SceneGraphTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Jobs/JobSystem.hpp"
+#include "Maths/Math.hpp"
+#include "Scene/CubeScene.hpp"
+#include "Scene/SceneGraph.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <math.h>
+#include <random>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static float maxDifference( const Matrix44f& a, const Matrix44f& b )
+{
+    float difference = 0.f;
+    for ( int c = 0; c < 4; ++c )
+    {
+        const Vector4f d = a.columns[c] - b.columns[c];
+        difference = std::max( { difference, fabsf( d.x ), fabsf( d.y ), fabsf( d.z ), fabsf( d.w ) } );
+    }
+    return difference;
+}
+
+static SceneGraph::Transform randomTransform( std::mt19937& rng )
+{
+    std::uniform_real_distribution<float> unit( -1.f, 1.f );
+    SceneGraph::Transform transform;
+    transform.translation = { unit( rng ), unit( rng ), unit( rng ) };
+    transform.rotation = Maths::makeQuaternion( { unit( rng ), unit( rng ), 1.f }, unit( rng ) * 3.f );
+    const float scale = 0.9f + 0.1f * unit( rng );
+    transform.scale = { scale, scale, scale };
+    return transform;
+}
+
+// Checks the graph against the cube scene's hard-coded transforms and a scalar reference, then
+// times full, partial and clean updates of a random hierarchy written into an instance array
+int sceneGraphTool( int argc, const char* argv[] )
+{
+    const size_t nodeCount = argc > 0 ? (size_t)atol( argv[0] ) : 1000000;
+    const unsigned int iterations = argc > 1 ? (unsigned int)atoi( argv[1] ) : 10;
+    const float dirtyFraction = argc > 2 ? (float)atof( argv[2] ) : 0.01f;
+    if ( nodeCount == 0 || iterations == 0 || !( dirtyFraction >= 0.f && dirtyFraction <= 1.f ) )
+    {
+        std::cout << "usage: mmtool scenegraph [nodes > 0] [iterations > 0] [dirty fraction 0-1]" << std::endl;
+        return 1;
+    }
+
+    // the cube scene both ways
+    SceneGraph cubes;
+    CubeScene::buildGraph( cubes );
+    std::vector<InstanceData> expected( kNumInstances );
+    std::vector<InstanceData> instances( kNumInstances );
+    float cubeError = 0.f;
+    uint32_t cubeVersion = 0;
+    for ( float angle : { 0.f, 0.7f, 2.5f } )
+    {
+        CubeScene::updateInstances( expected.data(), angle );
+        CubeScene::animateGraph( cubes, angle );
+        cubes.update( instances.data(), &cubeVersion );
+        for ( size_t i = 0; i < kNumInstances; ++i )
+        {
+            cubeError = std::max( cubeError, maxDifference( expected[i].instanceTransform, instances[i].instanceTransform ) );
+        }
+    }
+    std::cout << "scenegraph cube scene matches updateInstances to " << cubeError << std::endl;
+
+    // random hierarchy added out of order - each node hangs off any earlier node (or is a root,
+    // 1 in 1000), so the first update has to sort - checked against a scalar reference
+    std::mt19937 rng( 1234 );
+    {
+        const size_t count = std::min<size_t>( nodeCount, 100000 );
+        SceneGraph graph;
+        std::vector<SceneGraph::NodeId> parents( count );
+        std::vector<SceneGraph::Transform> locals( count );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            parents[i] = ( i == 0 || rng() % 1000 == 0 ) ? SceneGraph::kNoParent : (SceneGraph::NodeId)( rng() % i );
+            locals[i] = randomTransform( rng );
+            graph.addNode( parents[i], locals[i] );
+        }
+        graph.update();
+
+        float graphError = 0.f;
+        for ( size_t sample = 0; sample < 1000; ++sample )
+        {
+            size_t node = rng() % count;
+            Matrix44f reference = Maths::makeTransform( locals[ node ].translation, locals[ node ].rotation, locals[ node ].scale );
+            const Matrix44f fromGraph = graph.world( (SceneGraph::NodeId)node );
+            while ( parents[ node ] != SceneGraph::kNoParent )
+            {
+                node = parents[ node ];
+                reference = Maths::makeTransform( locals[ node ].translation, locals[ node ].rotation, locals[ node ].scale ) * reference;
+            }
+            graphError = std::max( graphError, maxDifference( reference, fromGraph ) / std::max( 1.f, fabsf( reference.columns[3].x ) ) );
+        }
+        std::cout << "  " << count << " node random hierarchy, " << graph.levelCount() << " levels, matches the scalar reference to "
+                  << graphError << " (relative)" << std::endl;
+    }
+
+    // the benchmark hierarchy is added a level at a time, as it would come out of a file: 1 in
+    // 1000 nodes are roots and each level is about 4 times the one before, children of random
+    // nodes in it. Every node is an instance, in the order added
+    const size_t rootCount = std::max<size_t>( 1, nodeCount / 1000 );
+    std::vector<SceneGraph::Transform> locals( nodeCount );
+    SceneGraph graph;
+    graph.reserve( nodeCount );
+    size_t levelBegin = 0;
+    size_t levelEnd = rootCount;
+    for ( size_t i = 0; i < rootCount; ++i )
+    {
+        locals[i] = randomTransform( rng );
+        graph.addNode( SceneGraph::kNoParent, locals[i], (uint32_t)i );
+    }
+    while ( levelEnd < nodeCount )
+    {
+        const size_t count = std::min( ( levelEnd - levelBegin ) * 4, nodeCount - levelEnd );
+        std::vector<SceneGraph::NodeId> parents( count );
+        for ( SceneGraph::NodeId& parent : parents )
+        {
+            parent = (SceneGraph::NodeId)( levelBegin + rng() % ( levelEnd - levelBegin ) );
+        }
+        std::sort( parents.begin(), parents.end() );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            const size_t node = levelEnd + i;
+            locals[ node ] = randomTransform( rng );
+            graph.addNode( parents[i], locals[ node ], (uint32_t)node );
+        }
+        levelBegin = levelEnd;
+        levelEnd += count;
+    }
+    instances.resize( nodeCount );
+    uint32_t version = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    SceneGraph::UpdateStats stats = graph.update( instances.data(), &version );
+    const double firstMs = elapsedMs( start );
+    std::cout << "  " << nodeCount << " nodes, " << stats.levels << " levels on " << JobSystem::Instance()->numThreads() << " threads" << std::endl;
+    std::cout << "  first update (sort, everything dirty) " << firstMs << " ms" << std::endl;
+
+    double fullMs = 1e30;
+    double partialMs = 1e30;
+    double cleanMs = 1e30;
+    double propagateMs = 1e30;
+    size_t partialUpdated = 0;
+    const size_t dirtyCount = std::max<size_t>( 1, (size_t)( nodeCount * dirtyFraction ) );
+    for ( unsigned int i = 0; i < iterations; ++i )
+    {
+        // propagation alone first, the instance writes below then catch up on it
+        for ( size_t n = 0; n < nodeCount; ++n )
+        {
+            graph.setLocal( (SceneGraph::NodeId)n, locals[n] );
+        }
+        start = std::chrono::steady_clock::now();
+        graph.update();
+        propagateMs = std::min( propagateMs, elapsedMs( start ) );
+
+        for ( size_t n = 0; n < nodeCount; ++n )
+        {
+            graph.setLocal( (SceneGraph::NodeId)n, locals[n] );
+        }
+        start = std::chrono::steady_clock::now();
+        graph.update( instances.data(), &version );
+        fullMs = std::min( fullMs, elapsedMs( start ) );
+
+        for ( size_t n = 0; n < dirtyCount; ++n )
+        {
+            const SceneGraph::NodeId node = (SceneGraph::NodeId)( rng() % nodeCount );
+            graph.setLocal( node, locals[ node ] );
+        }
+        start = std::chrono::steady_clock::now();
+        stats = graph.update( instances.data(), &version );
+        partialMs = std::min( partialMs, elapsedMs( start ) );
+        partialUpdated = stats.nodesUpdated;
+
+        start = std::chrono::steady_clock::now();
+        graph.update( instances.data(), &version );
+        cleanMs = std::min( cleanMs, elapsedMs( start ) );
+    }
+    std::cout << "  full update " << fullMs << " ms (" << nodeCount / fullMs / 1e3 << " Mnodes/s), "
+              << propagateMs << " ms without writing instances" << std::endl;
+    std::cout << "  " << dirtyCount << " nodes dirty -> " << partialUpdated << " updated " << partialMs << " ms" << std::endl;
+    std::cout << "  nothing dirty " << cleanMs << " ms" << std::endl;
+    return 0;
+}
@@ -0,0 +1,329 @@
+//
+//  SceneTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Mesh/MeshOptimizer.hpp"
+#include "Mesh/Meshlets.hpp"
+#include "Scene/CubeScene.hpp"
+#include "Scene/SceneFile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using SceneFormat::MeshRecord;
+using SceneFormat::SectionEntry;
+using SceneFormat::SectionType;
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// The cube followed by meshCount optimized spheres, with meshlets, and the cube scene's instances
+static int writeScene( const char* path, unsigned int segments, unsigned int meshCount )
+{
+    std::vector<std::vector<VertexData>> vertices( meshCount + 1 );
+    std::vector<std::vector<uint32_t>> indices( meshCount + 1 );
+
+    std::vector<uint16_t> cubeIndices;
+    CubeScene::buildCube( vertices[0], cubeIndices );
+    indices[0].assign( cubeIndices.begin(), cubeIndices.end() );
+    for ( unsigned int i = 1; i <= meshCount; ++i )
+    {
+        buildTestMesh( segments, 1, vertices[i], indices[i] );
+        MeshOptimizer::optimize( vertices[i], indices[i], false );
+    }
+
+    std::vector<Meshlets::MeshInput> inputs;
+    bool fitsIn16Bits = true;
+    for ( size_t i = 0; i < vertices.size(); ++i )
+    {
+        inputs.push_back( { indices[i].data(), indices[i].size(), vertices[i].data(), vertices[i].size() } );
+        fitsIn16Bits = fitsIn16Bits && vertices[i].size() <= 0x10000;
+    }
+    const std::vector<Meshlets::MeshletMesh> meshlets = Meshlets::buildMany( inputs );
+
+    std::vector<MeshRecord> meshes;
+    std::vector<VertexData> allVertices;
+    std::vector<uint32_t> allIndices;
+    std::vector<Meshlets::Meshlet> allMeshlets;
+    std::vector<Meshlets::MeshletBounds> allBounds;
+    std::vector<uint32_t> allMeshletVertices;
+    std::vector<uint8_t> allTriangles;
+    for ( size_t i = 0; i < vertices.size(); ++i )
+    {
+        meshes.push_back( { (uint32_t)allVertices.size(), (uint32_t)vertices[i].size(), (uint32_t)allIndices.size(), (uint32_t)indices[i].size(),
+                            (uint32_t)allMeshlets.size(), (uint32_t)meshlets[i].meshlets.size(),
+                            (uint32_t)allMeshletVertices.size(), (uint32_t)( allTriangles.size() / 3 ) } );
+        allVertices.insert( allVertices.end(), vertices[i].begin(), vertices[i].end() );
+        allIndices.insert( allIndices.end(), indices[i].begin(), indices[i].end() );
+        allMeshlets.insert( allMeshlets.end(), meshlets[i].meshlets.begin(), meshlets[i].meshlets.end() );
+        allBounds.insert( allBounds.end(), meshlets[i].bounds.begin(), meshlets[i].bounds.end() );
+        allMeshletVertices.insert( allMeshletVertices.end(), meshlets[i].vertices.begin(), meshlets[i].vertices.end() );
+        allTriangles.insert( allTriangles.end(), meshlets[i].triangles.begin(), meshlets[i].triangles.end() );
+    }
+
+    std::vector<InstanceData> instances( kNumInstances );
+    CubeScene::updateInstances( instances.data(), 0.f );
+
+    SceneWriter writer;
+    writer.addSection( SectionType::Meshes, meshes );
+    writer.addSection( SectionType::Vertices, allVertices );
+    if ( fitsIn16Bits )
+    {
+        writer.addSection( SectionType::Indices16, std::vector<uint16_t>( allIndices.begin(), allIndices.end() ) );
+    }
+    else
+    {
+        writer.addSection( SectionType::Indices32, allIndices );
+    }
+    writer.addSection( SectionType::Meshlets, allMeshlets );
+    writer.addSection( SectionType::MeshletBounds, allBounds );
+    writer.addSection( SectionType::MeshletVertices, allMeshletVertices );
+    writer.addSection( SectionType::MeshletTriangles, allTriangles );
+    writer.addSection( SectionType::Instances, instances );
+    if ( !writer.write( path ) )
+    {
+        return 1;
+    }
+    std::cout << "wrote " << path << ": " << meshes.size() << " meshes, " << allVertices.size() << " vertices, " << allIndices.size() / 3
+              << " triangles, " << allMeshlets.size() << " meshlets, " << instances.size() << " instances" << std::endl;
+    return 0;
+}
+
+static int printInfo( const SceneFile& file )
+{
+    std::cout << file.size() << " bytes, " << file.sectionCount() << " sections" << std::endl;
+    for ( uint32_t i = 0; i < file.sectionCount(); ++i )
+    {
+        const SectionEntry& entry = file.section( i );
+        std::cout << "  " << SceneFormat::sectionName( (SectionType)entry.type ) << ": " << entry.elementCount << " x "
+                  << entry.elementSize << " bytes at " << entry.offset << std::endl;
+    }
+    return 0;
+}
+
+// The same vertices, indices and instances as text, one element per line - what a scene
+// loader that parses has to get through
+static void writeText( const SceneFile& file, const char* path )
+{
+    FILE* pFile = fopen( path, "w" );
+    size_t count = 0;
+    const VertexData* pVertices = file.sectionData<VertexData>( SectionType::Vertices, &count );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        const VertexData& v = pVertices[i];
+        fprintf( pFile, "v %.9g %.9g %.9g %.9g %.9g %.9g %.9g %.9g\n", v.position.x, v.position.y, v.position.z,
+                 v.normal.x, v.normal.y, v.normal.z, v.texcoord.x, v.texcoord.y );
+    }
+    const uint16_t* pIndices16 = file.sectionData<uint16_t>( SectionType::Indices16, &count );
+    const uint32_t* pIndices32 = pIndices16 ? nullptr : file.sectionData<uint32_t>( SectionType::Indices32, &count );
+    for ( size_t i = 0; i + 2 < count; i += 3 )
+    {
+        fprintf( pFile, "f %u %u %u\n", pIndices16 ? pIndices16[i] : pIndices32[i], pIndices16 ? pIndices16[ i + 1 ] : pIndices32[ i + 1 ],
+                 pIndices16 ? pIndices16[ i + 2 ] : pIndices32[ i + 2 ] );
+    }
+    const float* pInstances = file.sectionData<float>( SectionType::Instances, &count );
+    for ( size_t i = 0; i < count; ++i )
+    {
+        fputc( 'i', pFile );
+        for ( size_t k = 0; k < sizeof( InstanceData ) / sizeof( float ); ++k )
+        {
+            fprintf( pFile, " %.9g", pInstances[ i * sizeof( InstanceData ) / sizeof( float ) + k ] );
+        }
+        fputc( '\n', pFile );
+    }
+    fclose( pFile );
+}
+
+static size_t parseText( const char* path, std::vector<VertexData>& vertices, std::vector<uint32_t>& indices, std::vector<InstanceData>& instances )
+{
+    FILE* pFile = fopen( path, "rb" );
+    fseek( pFile, 0, SEEK_END );
+    std::vector<char> text( (size_t)ftell( pFile ) + 1 );
+    fseek( pFile, 0, SEEK_SET );
+    const size_t size = fread( text.data(), 1, text.size() - 1, pFile );
+    text[ size ] = 0;
+    fclose( pFile );
+
+    vertices.clear();
+    indices.clear();
+    instances.clear();
+    char* p = text.data();
+    while ( *p )
+    {
+        const char type = *p++;
+        if ( type == 'v' )
+        {
+            // braced initializers are evaluated in order
+            VertexData v;
+            const float values[8] = { strtof( p, &p ), strtof( p, &p ), strtof( p, &p ), strtof( p, &p ),
+                                      strtof( p, &p ), strtof( p, &p ), strtof( p, &p ), strtof( p, &p ) };
+            v.position = { values[0], values[1], values[2] };
+            v.normal = { values[3], values[4], values[5] };
+            v.texcoord = { values[6], values[7] };
+            vertices.push_back( v );
+        }
+        else if ( type == 'f' )
+        {
+            for ( int k = 0; k < 3; ++k )
+            {
+                indices.push_back( (uint32_t)strtoul( p, &p, 10 ) );
+            }
+        }
+        else if ( type == 'i' )
+        {
+            InstanceData instance;
+            float* pOut = reinterpret_cast<float*>( &instance );
+            for ( size_t k = 0; k < sizeof( InstanceData ) / sizeof( float ); ++k )
+            {
+                pOut[k] = strtof( p, &p );
+            }
+            instances.push_back( instance );
+        }
+        while ( *p && *p++ != '\n' )
+        {
+        }
+    }
+    return size;
+}
+
+// Every byte of a section, summed 8 at a time - what the mapped and copied loads both end with
+static uint64_t sumBytes( const uint8_t* pData, size_t size )
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+    for ( ; i + 8 <= size; i += 8 )
+    {
+        uint64_t word;
+        memcpy( &word, pData + i, sizeof( word ) );
+        sum += word;
+    }
+    for ( ; i < size; ++i )
+    {
+        sum += pData[i];
+    }
+    return sum;
+}
+
+// Load time of the mapped file (open + TOC checks, then reading every section byte in place)
+// against reading it into memory, copying the sections out and reading them there, and against
+// parsing the text equivalent
+static int benchmark( const char* path, unsigned int iterations )
+{
+    SceneFile file;
+    if ( !file.open( path ) )
+    {
+        return 1;
+    }
+    const std::string textPath = std::string( path ) + ".txt";
+    writeText( file, textPath.c_str() );
+    file.close();
+
+    double mapMs = 1e30;
+    double touchMs = 1e30;
+    double copyMs = 1e30;
+    double parseMs = 1e30;
+    size_t size = 0;
+    size_t textSize = 0;
+    uint64_t sum = 0;
+    for ( unsigned int i = 0; i < iterations; ++i )
+    {
+        auto start = std::chrono::steady_clock::now();
+        SceneFile mapped;
+        mapped.open( path );
+        mapMs = std::min( mapMs, elapsedMs( start ) );
+        for ( uint32_t s = 0; s < mapped.sectionCount(); ++s )
+        {
+            const SectionEntry& entry = mapped.section( s );
+            sum += sumBytes( mapped.data() + entry.offset, entry.elementSize * entry.elementCount );
+        }
+        touchMs = std::min( touchMs, elapsedMs( start ) );
+        size = mapped.size();
+        mapped.close();
+
+        // read and copy - every section ends up in its own allocation, like buffers filled from a stream
+        start = std::chrono::steady_clock::now();
+        FILE* pFile = fopen( path, "rb" );
+        std::vector<uint8_t> bytes( size );
+        const size_t read = fread( bytes.data(), 1, size, pFile );
+        fclose( pFile );
+        SceneFormat::Header header;
+        memcpy( &header, bytes.data(), sizeof( header ) );
+        std::vector<std::vector<uint8_t>> sections( header.sectionCount );
+        for ( uint32_t s = 0; s < header.sectionCount && read == size; ++s )
+        {
+            SectionEntry entry;
+            memcpy( &entry, bytes.data() + header.tocOffset + s * sizeof( SectionEntry ), sizeof( entry ) );
+            const uint8_t* pSection = bytes.data() + entry.offset;
+            sections[s].assign( pSection, pSection + entry.elementSize * entry.elementCount );
+            sum += sumBytes( sections[s].data(), sections[s].size() );
+        }
+        copyMs = std::min( copyMs, elapsedMs( start ) );
+
+        start = std::chrono::steady_clock::now();
+        std::vector<VertexData> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<InstanceData> instances;
+        textSize = parseText( textPath.c_str(), vertices, indices, instances );
+        parseMs = std::min( parseMs, elapsedMs( start ) );
+    }
+    remove( textPath.c_str() );
+
+    std::cout << "scene load " << size << " bytes, best of " << iterations << " (checksum " << sum % 10 << ")" << std::endl;
+    std::cout << "  mmap + TOC checks " << mapMs << " ms, then reading every section byte " << touchMs << " ms ("
+              << size / touchMs / 1e6 << " GB/s)" << std::endl;
+    std::cout << "  read + copy sections + reading every section byte " << copyMs << " ms (" << size / copyMs / 1e6 << " GB/s), "
+              << copyMs / touchMs << "x slower" << std::endl;
+    std::cout << "  parse " << textSize << " bytes of text (no meshlets) " << parseMs << " ms, " << parseMs / touchMs << "x slower" << std::endl;
+    return 0;
+}
+
+// Offline converter and checks for the mmap'd scene format
+int sceneTool( int argc, const char* argv[] )
+{
+    if ( argc < 2 )
+    {
+        std::cout << "usage: mmtool scene write <file> [segments] [meshes] | info <file> | validate <file> | bench <file> [iterations]" << std::endl;
+        return 1;
+    }
+
+    const char* path = argv[1];
+    if ( strcmp( argv[0], "write" ) == 0 )
+    {
+        const unsigned int segments = argc > 2 ? (unsigned int)atoi( argv[2] ) : 250;     // 63K vertices a sphere, still 16 bit indices
+        const unsigned int meshCount = argc > 3 ? (unsigned int)atoi( argv[3] ) : 8;
+        return writeScene( path, segments, meshCount );
+    }
+    if ( strcmp( argv[0], "bench" ) == 0 )
+    {
+        return benchmark( path, argc > 2 ? (unsigned int)atoi( argv[2] ) : 5 );
+    }
+
+    SceneFile file;
+    if ( !file.open( path ) )
+    {
+        return 1;
+    }
+    if ( strcmp( argv[0], "info" ) == 0 )
+    {
+        return printInfo( file );
+    }
+    if ( strcmp( argv[0], "validate" ) == 0 )
+    {
+        auto start = std::chrono::steady_clock::now();
+        const bool valid = file.validate();
+        std::cout << path << ( valid ? " is valid" : " is NOT valid" ) << " (" << elapsedMs( start ) << " ms)" << std::endl;
+        return valid ? 0 : 1;
+    }
+    std::cout << "unknown scene command " << argv[0] << std::endl;
+    return 1;
+}
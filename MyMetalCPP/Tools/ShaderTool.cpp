@@ -0,0 +1,182 @@
+//
+//  ShaderTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Renderer/FileWatcher.hpp"
+#include "Renderer/ShaderSources.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static void writeFile( const std::string& path, const std::string& text )
+{
+    std::ofstream( path, std::ios::trunc ) << text;
+}
+
+static size_t countOf( const std::string& text, const std::string& what )
+{
+    size_t count = 0;
+    for ( size_t at = text.find( what ); at != std::string::npos; at = text.find( what, at + 1 ) )
+    {
+        ++count;
+    }
+    return count;
+}
+
+// Flattens the app's shader libraries, then edits a scratch shader tree the way an editor
+// would - in place and by renaming over - timing how long each save takes to come out of a
+// FileWatcher and checking it maps to the right libraries
+int shaderTool( int argc, const char* argv[] )
+{
+    const std::string shaderDir = argc > 0 ? argv[0] : "MyMetalCPP/Shaders";
+    const int saves = argc > 1 ? atoi( argv[1] ) : 30;
+    std::cout << "shaders from " << shaderDir << ", " << saves << " saves watched with " << FileWatcher::backend() << std::endl;
+
+    // the real libraries, what a reload compiles
+    {
+        ShaderSources sources;
+        for ( const char* pName : { "/MyShader.metal", "/Mandelbrot.metal" } )
+        {
+            sources.add( shaderDir + pName );
+        }
+        for ( uint32_t library = 0; library < sources.count(); ++library )
+        {
+            std::string source, error;
+            const auto start = std::chrono::steady_clock::now();
+            const bool expanded = sources.expand( library, source, error );
+            const double ms = elapsedMs( start );
+            if ( !expanded )
+            {
+                std::cout << "  " << error << std::endl;
+                return 1;
+            }
+            std::cout << "  " << sources.path( library ) << ": " << sources.dependencies( library ).size() << " files, " << source.size()
+                      << " bytes in " << ms << " ms, " << countOf( source, "#include \"" ) << " includes left" << std::endl;
+        }
+        std::cout << "  watching " << sources.directories().size() << " directories" << std::endl;
+    }
+
+    // scratch tree - a.metal includes a header from another directory, b.metal a #pragma once
+    // header twice, c.metal itself
+    char scratch[] = "/tmp/mmshadersXXXXXX";
+    if ( !mkdtemp( scratch ) )
+    {
+        std::cout << "  can't make a scratch directory" << std::endl;
+        return 1;
+    }
+    const std::string root = ShaderSources::canonical( scratch );
+    mkdir( ( root + "/shaders" ).c_str(), 0755 );
+    mkdir( ( root + "/shared" ).c_str(), 0755 );
+    const std::string aPath = root + "/shaders/a.metal", bPath = root + "/shaders/b.metal", cPath = root + "/shaders/c.metal";
+    const std::string commonPath = root + "/shared/common.h", bHeaderPath = root + "/shaders/b.h";
+    writeFile( commonPath, "#ifndef common_h\n#define common_h\nconstant float kScale = 1.0;\n#endif\n" );
+    writeFile( bHeaderPath, "#pragma once\nconstant float kBias = 0.5;\n" );
+    writeFile( aPath, "#include <metal_stdlib>\n#include \"../shared/common.h\"\n#include \"missing.h\"\nkernel void a() {}\n" );
+    writeFile( bPath, "#include \"b.h\"\n#include \"b.h\"\nkernel void b() {}\n" );
+    writeFile( cPath, "#include \"c.metal\"\n" );
+
+    ShaderSources sources;
+    const uint32_t a = sources.add( aPath ), b = sources.add( bPath ), c = sources.add( cPath );
+    std::string aSource, bSource, cSource, error;
+    const bool aExpanded = sources.expand( a, aSource, error );
+    const bool bExpanded = sources.expand( b, bSource, error );
+    const bool cRejected = !sources.expand( c, cSource, error );
+    const bool expandedRight = aExpanded && bExpanded && countOf( aSource, "kScale" ) == 1 && countOf( aSource, "#include \"missing.h\"" ) == 1 &&
+                               countOf( aSource, "#include <metal_stdlib>" ) == 1 && countOf( bSource, "#ifndef MM_PRAGMA_ONCE_0" ) == 2 &&
+                               countOf( bSource, "#pragma once" ) == 0 && countOf( aSource, "#line 3 \"" + aPath + "\"" ) == 1;
+    std::cout << "  expansion " << ( expandedRight ? "right" : "WRONG" ) << ", include cycle " << ( cRejected ? "rejected" : "ACCEPTED" ) << std::endl;
+
+    // saves on another thread, each after a pause the watcher sleeps through
+    struct Save
+    {
+        std::string path;
+        bool rename;
+        std::vector<uint32_t> libraries;
+    };
+    const Save kinds[] = {
+        { commonPath, false, { a } },
+        { bHeaderPath, true, { b } },
+        { aPath, false, { a } },
+        { bPath, true, { b } },
+    };
+
+    FileWatcher watcher;
+    for ( const std::string& directory : sources.directories() )
+    {
+        watcher.addDirectory( directory );
+    }
+    std::vector<double> latencies;
+    size_t wrong = 0, missed = 0;
+    for ( int i = 0; i < saves; ++i )
+    {
+        const Save& save = kinds[ i % 4 ];
+        std::chrono::steady_clock::time_point saved;
+        std::thread saver( [&]()
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 5 + i % 7 * 5 ) );
+            std::ifstream file( save.path );
+            const std::string text = std::string( std::istreambuf_iterator<char>( file ), std::istreambuf_iterator<char>() ) + "// save " + std::to_string( i ) + "\n";
+            saved = std::chrono::steady_clock::now();
+            if ( save.rename )
+            {
+                const std::string temporary = save.path.substr( 0, save.path.rfind( '/' ) + 1 ) + ".save.tmp";
+                writeFile( temporary, text );
+                rename( temporary.c_str(), save.path.c_str() );
+            }
+            else
+            {
+                writeFile( save.path, text );
+            }
+        } );
+
+        std::vector<std::string> changed;
+        const auto start = std::chrono::steady_clock::now();
+        while ( changed.empty() && elapsedMs( start ) < 2000.0 )
+        {
+            changed = watcher.wait( 100 );
+        }
+        const auto noticed = std::chrono::steady_clock::now();
+        saver.join();
+        if ( changed.empty() )
+        {
+            ++missed;
+            continue;
+        }
+        latencies.push_back( std::chrono::duration<double, std::milli>( noticed - saved ).count() );
+        wrong += sources.affected( changed ) == save.libraries ? 0 : 1;
+    }
+    std::sort( latencies.begin(), latencies.end() );
+    double meanMs = 0.0;
+    for ( double ms : latencies )
+    {
+        meanMs += ms / latencies.size();
+    }
+    std::cout << "  " << latencies.size() << " saves noticed, " << missed << " missed, " << wrong << " rebuilt the wrong libraries; save to noticed mean "
+              << meanMs << " ms, max " << ( latencies.empty() ? 0.0 : latencies.back() ) << " ms (" << FileWatcher::kSettleMs << " ms of it settling)"
+              << std::endl;
+
+    for ( const std::string& path : { aPath, bPath, cPath, commonPath, bHeaderPath } )
+    {
+        unlink( path.c_str() );
+    }
+    rmdir( ( root + "/shaders" ).c_str() );
+    rmdir( ( root + "/shared" ).c_str() );
+    rmdir( root.c_str() );
+    return 0;
+}
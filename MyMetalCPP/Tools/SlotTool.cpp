@@ -0,0 +1,186 @@
+//
+//  SlotTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Renderer/SlotAllocator.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// A free list behind a mutex, what the slot allocator replaces
+class LockedSlots
+{
+public:
+    explicit LockedSlots( uint32_t capacity )
+    {
+        _free.reserve( capacity );
+        for ( uint32_t i = capacity; i > 0; --i )
+        {
+            _free.push_back( i - 1 );
+        }
+    }
+
+    uint32_t allocate()
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        if ( _free.empty() )
+        {
+            return ~0u;
+        }
+        const uint32_t slot = _free.back();
+        _free.pop_back();
+        return slot;
+    }
+
+    void free( uint32_t slot )
+    {
+        std::lock_guard<std::mutex> lock( _mutex );
+        _free.push_back( slot );
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<uint32_t> _free;
+};
+
+// Threads allocating and freeing slots at random, each marking the slots it holds so that a slot
+// handed to two owners at once shows up, then stale handle and double free checks, then the
+// same churn timed against a mutex guarded free list
+int slotTool( int argc, const char* argv[] )
+{
+    const size_t opsPerThread = argc > 0 ? (size_t)atol( argv[0] ) : 1000000;
+    const uint32_t threadCount = argc > 1 ? (uint32_t)atoi( argv[1] ) : std::max( 4u, std::thread::hardware_concurrency() );
+    const uint32_t capacity = argc > 2 ? (uint32_t)atoi( argv[2] ) : 4096;
+    std::cout << "slots " << threadCount << " threads x " << opsPerThread << " operations on " << capacity << " slots" << std::endl;
+
+    // checked run - an owner per slot, claimed on allocate and given up before the free
+    {
+        SlotAllocator slots( capacity );
+        std::vector<std::atomic<uint32_t>> owners( capacity );
+        for ( std::atomic<uint32_t>& owner : owners )
+        {
+            owner.store( 0, std::memory_order_relaxed );
+        }
+        std::atomic<size_t> doubleOwned( 0 ), invalid( 0 ), rejectedFrees( 0 ), full( 0 );
+        std::vector<std::thread> threads;
+        for ( uint32_t t = 0; t < threadCount; ++t )
+        {
+            threads.emplace_back( [&, t]()
+            {
+                std::mt19937 rng( 1234 + t );
+                std::vector<SlotAllocator::Handle> held;
+                const size_t maxHeld = capacity / threadCount;
+                for ( size_t i = 0; i < opsPerThread; ++i )
+                {
+                    if ( held.empty() || ( held.size() < maxHeld && rng() % 2 == 0 ) )
+                    {
+                        const SlotAllocator::Handle handle = slots.allocate();
+                        if ( handle == SlotAllocator::kInvalidHandle )
+                        {
+                            full.fetch_add( 1, std::memory_order_relaxed );
+                            continue;
+                        }
+                        uint32_t none = 0;
+                        if ( !owners[ SlotAllocator::index( handle ) ].compare_exchange_strong( none, t + 1, std::memory_order_acq_rel ) )
+                        {
+                            doubleOwned.fetch_add( 1, std::memory_order_relaxed );
+                        }
+                        held.push_back( handle );
+                    }
+                    else
+                    {
+                        const size_t victim = rng() % held.size();
+                        const SlotAllocator::Handle handle = held[ victim ];
+                        held[ victim ] = held.back();
+                        held.pop_back();
+                        invalid += slots.isValid( handle ) ? 0 : 1;
+                        owners[ SlotAllocator::index( handle ) ].store( 0, std::memory_order_release );
+                        rejectedFrees += slots.free( handle ) ? 0 : 1;
+                    }
+                }
+                for ( SlotAllocator::Handle handle : held )
+                {
+                    owners[ SlotAllocator::index( handle ) ].store( 0, std::memory_order_release );
+                    rejectedFrees += slots.free( handle ) ? 0 : 1;
+                }
+            } );
+        }
+        for ( std::thread& thread : threads )
+        {
+            thread.join();
+        }
+        std::cout << "  checked: " << doubleOwned.load() << " slots owned twice, " << invalid.load() << " live handles invalid, "
+                  << rejectedFrees.load() << " live frees rejected, " << full.load() << " allocations found it full, "
+                  << slots.used() << " left in use" << std::endl;
+    }
+
+    // stale handles - after a free neither the old handle nor a second free of it may pass
+    {
+        SlotAllocator slots( capacity );
+        size_t staleValid = 0, doubleFreed = 0, reissuedSame = 0;
+        for ( uint32_t i = 0; i < capacity; ++i )
+        {
+            const SlotAllocator::Handle stale = slots.allocate();
+            slots.free( stale );
+            const SlotAllocator::Handle fresh = slots.allocate();
+            staleValid += slots.isValid( stale ) ? 1 : 0;
+            doubleFreed += slots.free( stale ) ? 1 : 0;
+            reissuedSame += fresh == stale ? 1 : 0;
+        }
+        const bool fullRejected = slots.allocate() == SlotAllocator::kInvalidHandle;
+        std::cout << "  stale: " << staleValid << " stale handles valid, " << doubleFreed << " double frees accepted, " << reissuedSame
+                  << " handles reissued, " << ( fullRejected ? "full table rejects" : "FULL TABLE ALLOCATED" ) << std::endl;
+    }
+
+    // timed, each thread taking and giving back a few slots at a time
+    auto churn = [&]( auto allocate, auto free )
+    {
+        std::vector<std::thread> threads;
+        const auto start = std::chrono::steady_clock::now();
+        for ( uint32_t t = 0; t < threadCount; ++t )
+        {
+            threads.emplace_back( [&]()
+            {
+                uint32_t held[8];
+                for ( size_t i = 0; i < opsPerThread; i += 16 )
+                {
+                    for ( uint32_t& slot : held )
+                    {
+                        slot = allocate();
+                    }
+                    for ( uint32_t slot : held )
+                    {
+                        free( slot );
+                    }
+                }
+            } );
+        }
+        for ( std::thread& thread : threads )
+        {
+            thread.join();
+        }
+        return elapsedMs( start );
+    };
+    const double operations = (double)threadCount * ( ( opsPerThread + 15 ) / 16 * 16 );
+    SlotAllocator slots( capacity );
+    const double lockFreeMs = churn( [&]() { return slots.allocate(); }, [&]( uint32_t handle ) { slots.free( handle ); } );
+    LockedSlots locked( capacity );
+    const double lockedMs = churn( [&]() { return locked.allocate(); }, [&]( uint32_t slot ) { locked.free( slot ); } );
+    std::cout << "  lock free " << lockFreeMs * 1e6 / operations << " ns per operation, mutex free list " << lockedMs * 1e6 / operations
+              << " ns" << std::endl;
+    return 0;
+}
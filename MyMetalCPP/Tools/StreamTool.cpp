@@ -0,0 +1,212 @@
+//
+//  StreamTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Renderer/AssetStreamer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <thread>
+#include <vector>
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+// Assets on a grid, a camera flying over it, and storage with a fixed latency and bandwidth
+struct World
+{
+    struct Tile
+    {
+        float x, y;
+        size_t size;
+        std::atomic<bool> failNext;     // one failed read, then it loads
+    };
+
+    std::vector<Tile> tiles;
+    double latencyMs;
+    double bytesPerMs;
+    std::thread::id mainThread;
+    std::vector<uint64_t> requestedFrame;   // by the tool, to check evictions
+    uint64_t frame;
+    size_t wrongThread;
+    size_t corrupt;
+    size_t evictedWhileWanted;
+    size_t freed;
+};
+
+static uint8_t patternByte( uint32_t asset, size_t i )
+{
+    return (uint8_t)( ( asset * 2654435761u ) >> 24 ) ^ (uint8_t)( i * 131 );
+}
+
+static void* loadTile( void* pUser, AssetStreamer::AssetId asset, size_t* pSize )
+{
+    World& world = *static_cast<World*>( pUser );
+    World::Tile& tile = world.tiles[ asset ];
+    const double ms = world.latencyMs + tile.size / world.bytesPerMs;
+    std::this_thread::sleep_for( std::chrono::microseconds( (int64_t)( ms * 1000.0 ) ) );
+    if ( tile.failNext.exchange( false ) )
+    {
+        return nullptr;
+    }
+    std::vector<uint8_t>* pData = new std::vector<uint8_t>( tile.size );
+    for ( size_t i = 0; i < tile.size; i += 4096 )
+    {
+        ( *pData )[i] = patternByte( asset, i );
+    }
+    *pSize = tile.size;
+    return pData;
+}
+
+static void tileResident( void* pUser, AssetStreamer::AssetId asset, void* pPayload )
+{
+    World& world = *static_cast<World*>( pUser );
+    const std::vector<uint8_t>& data = *static_cast<std::vector<uint8_t>*>( pPayload );
+    world.wrongThread += std::this_thread::get_id() != world.mainThread ? 1 : 0;
+    bool intact = data.size() == world.tiles[ asset ].size;
+    for ( size_t i = 0; intact && i < data.size(); i += 4096 )
+    {
+        intact = data[i] == patternByte( asset, i );
+    }
+    world.corrupt += intact ? 0 : 1;
+}
+
+static void evictTile( void* pUser, AssetStreamer::AssetId asset, void* pPayload )
+{
+    World& world = *static_cast<World*>( pUser );
+    world.wrongThread += std::this_thread::get_id() != world.mainThread ? 1 : 0;
+    world.evictedWhileWanted += world.requestedFrame[ asset ] == world.frame ? 1 : 0;
+    world.freed++;
+    delete static_cast<std::vector<uint8_t>*>( pPayload );
+}
+
+// The camera circles the grid and wants every tile within viewRadius, nearest first, and above
+// all of them one tile bigger than the whole budget. Checks the budget every frame, that nothing
+// wanted is evicted, that payloads arrive intact on the update() thread, that the oversized tile
+// never loads or holds up the rest, and how much of the nearest and farthest quarters of the
+// view is resident
+int streamTool( int argc, const char* argv[] )
+{
+    const size_t tileCount = argc > 0 ? (size_t)atol( argv[0] ) : 4096;
+    const uint64_t budget = ( argc > 1 ? (uint64_t)atol( argv[1] ) : 256 ) << 20;
+    const int frames = argc > 2 ? atoi( argv[2] ) : 600;
+    const uint32_t threads = argc > 3 ? (uint32_t)atoi( argv[3] ) : 4;
+    const double megabytesPerSecond = argc > 4 ? atof( argv[4] ) : 1000.0;
+    const double frameMs = 4.0;
+    std::cout << "stream " << tileCount << " tiles, " << ( budget >> 20 ) << " MB budget, " << frames << " frames, " << threads
+              << " threads, " << megabytesPerSecond << " MB/s storage" << std::endl;
+
+    World world;
+    world.tiles = std::vector<World::Tile>( tileCount + 1 );     // the last is the oversized one
+    world.latencyMs = 1.0;
+    world.bytesPerMs = megabytesPerSecond * 1e3;
+    world.mainThread = std::this_thread::get_id();
+    world.requestedFrame.assign( tileCount + 1, 0 );
+    world.frame = 0;
+    world.wrongThread = world.corrupt = world.evictedWhileWanted = world.freed = 0;
+
+    std::mt19937 rng( 7 );
+    const uint32_t side = (uint32_t)ceil( sqrt( (double)tileCount ) );
+    uint64_t totalBytes = 0;
+    for ( size_t i = 0; i < tileCount; ++i )
+    {
+        World::Tile& tile = world.tiles[i];
+        tile.x = (float)( i % side );
+        tile.y = (float)( i / side );
+        tile.size = ( 64 << 10 ) + rng() % ( 2 << 20 );
+        tile.failNext = rng() % 50 == 0;
+        totalBytes += tile.size;
+    }
+    const uint32_t oversized = (uint32_t)tileCount;
+    world.tiles[ oversized ].size = budget + ( 1 << 20 );
+    world.tiles[ oversized ].failNext = false;
+
+    size_t overBudget = 0, nearWanted = 0, nearResident = 0, farWanted = 0, farResident = 0;
+    uint64_t maxInFlight = 0, inFlightSum = 0;
+    size_t requests = 0;
+    size_t oversizedResident = 0;
+    {
+        AssetStreamer streamer( threads, budget, loadTile, tileResident, evictTile, &world );
+        for ( size_t i = 0; i <= tileCount; ++i )
+        {
+            streamer.add( world.tiles[i].size );
+        }
+
+        // about a third of the budget in view
+        const float viewRadius = sqrtf( (float)( budget / 3 ) / (float)( totalBytes / tileCount ) / (float)M_PI );
+        const auto start = std::chrono::steady_clock::now();
+        std::vector<std::pair<float, uint32_t>> view;
+        for ( int f = 0; f < frames; ++f )
+        {
+            world.frame = f + 1;
+            const float angle = f * 0.01f;
+            const float cx = side * ( 0.5f + 0.3f * cosf( angle ) ), cy = side * ( 0.5f + 0.3f * sinf( angle ) );
+            view.clear();
+            for ( uint32_t i = 0; i < tileCount; ++i )
+            {
+                const float d = hypotf( world.tiles[i].x - cx, world.tiles[i].y - cy );
+                if ( d < viewRadius )
+                {
+                    view.push_back( { d, i } );
+                }
+            }
+            std::sort( view.begin(), view.end() );
+            for ( size_t v = 0; v < view.size(); ++v )
+            {
+                const bool resident = streamer.request( view[v].second, 1.f / ( 1.f + view[v].first ) );
+                world.requestedFrame[ view[v].second ] = world.frame;
+                if ( v < view.size() / 4 )
+                {
+                    nearWanted++;
+                    nearResident += resident ? 1 : 0;
+                }
+                else if ( v >= view.size() * 3 / 4 )
+                {
+                    farWanted++;
+                    farResident += resident ? 1 : 0;
+                }
+            }
+            requests += view.size();
+            oversizedResident += streamer.request( oversized, 2.f ) ? 1 : 0;
+            world.requestedFrame[ oversized ] = world.frame;
+            streamer.update();
+
+            const AssetStreamer::Stats stats = streamer.stats();
+            overBudget += stats.residentBytes + stats.bytesInFlight > budget ? 1 : 0;
+            maxInFlight = std::max( maxInFlight, stats.bytesInFlight );
+            inFlightSum += stats.bytesInFlight;
+            std::this_thread::sleep_for( std::chrono::microseconds( (int64_t)( frameMs * 1000.0 ) ) );
+        }
+        const double ms = elapsedMs( start );
+
+        const AssetStreamer::Stats stats = streamer.stats();
+        std::cout << "  " << requests / frames << " tiles wanted a frame, hit rate " << stats.hitRate() * 100.0 << "%, nearest quarter "
+                  << 100.0 * nearResident / std::max<size_t>( nearWanted, 1 ) << "% resident, farthest " << 100.0 * farResident / std::max<size_t>( farWanted, 1 )
+                  << "%" << std::endl;
+        std::cout << "  " << stats.loads << " loads, " << stats.failures << " failed, " << stats.evictions << " evictions; resident "
+                  << ( stats.residentBytes >> 20 ) << " MB, peak " << ( stats.maxResidentBytes >> 20 ) << " MB; in flight peak "
+                  << ( maxInFlight >> 20 ) << " MB, mean " << ( inFlightSum / frames >> 20 ) << " MB; " << ms / frames << " ms a frame" << std::endl;
+        std::cout << "  oversized tile " << ( world.tiles[ oversized ].size >> 20 ) << " MB: " << stats.oversized << " marked, resident "
+                  << oversizedResident << " frames" << std::endl;
+        world.frame = 0;    // the rest go as the streamer does
+        if ( stats.oversized != 1 || oversizedResident )
+        {
+            std::cout << "FAILED: the oversized tile should be marked once and never load" << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "  " << overBudget << " frames over budget, " << world.evictedWhileWanted << " wanted tiles evicted, " << world.corrupt
+              << " corrupt, " << world.wrongThread << " callbacks off the update thread, " << world.freed << " payloads freed" << std::endl;
+    return 0;
+}
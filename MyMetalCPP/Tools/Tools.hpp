@@ -0,0 +1,42 @@
+//
+//  Tools.hpp
+//  MyMetalCPP
+//
+
+#pragma once
+
+#include <vector>
+
+#include "Shaders/ShaderStructs.h"
+
+// Nested UV spheres written out as a triangle soup in shuffled order - no sharing, no locality
+// and the inner spheres hidden behind the outer ones, so every optimizer step has work to do
+void buildTestMesh( unsigned int segments, unsigned int spheres, std::vector<VertexData>& vertices, std::vector<uint32_t>& indices );
+
+// mmtool subcommands - each returns the process exit code
+
+int deepZoomTool( int argc, const char* argv[] );
+int kernelTool( int argc, const char* argv[] );
+int rasterTool( int argc, const char* argv[] );
+int mipTool( int argc, const char* argv[] );
+int meshOptTool( int argc, const char* argv[] );
+int quantizeTool( int argc, const char* argv[] );
+int meshletTool( int argc, const char* argv[] );
+int lodTool( int argc, const char* argv[] );
+int sceneTool( int argc, const char* argv[] );
+int sceneGraphTool( int argc, const char* argv[] );
+int bvhTool( int argc, const char* argv[] );
+int occlusionTool( int argc, const char* argv[] );
+int drawSortTool( int argc, const char* argv[] );
+int multiViewTool( int argc, const char* argv[] );
+int recordTool( int argc, const char* argv[] );
+int releaseTool( int argc, const char* argv[] );
+int heapTool( int argc, const char* argv[] );
+int slotTool( int argc, const char* argv[] );
+int shaderTool( int argc, const char* argv[] );
+int uploadTool( int argc, const char* argv[] );
+int ktx2Tool( int argc, const char* argv[] );
+int streamTool( int argc, const char* argv[] );
+int aioTool( int argc, const char* argv[] );
+int packTool( int argc, const char* argv[] );
+int animTool( int argc, const char* argv[] );
@@ -0,0 +1,300 @@
+//
+//  UploadTool.cpp
+//  MyMetalCPP
+//
+
+#include "Tools.hpp"
+
+#include "Renderer/UploadQueue.hpp"
+#include "Texture/PixelConvert.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <math.h>
+#include <random>
+#include <vector>
+
+using PixelConvert::Format;
+using PixelConvert::Layout;
+using MipGen::ColorSpace;
+
+static double elapsedMs( std::chrono::steady_clock::time_point start )
+{
+    return std::chrono::duration<double, std::milli>( std::chrono::steady_clock::now() - start ).count();
+}
+
+static const char* formatName( Format format )
+{
+    switch ( format )
+    {
+        case Format::RGBA8: return "RGBA8";
+        case Format::BGRA8: return "BGRA8";
+        case Format::RGB8: return "RGB8";
+        case Format::RGBA32Float: return "RGBA32F";
+    }
+    return "?";
+}
+
+static const char* spaceName( ColorSpace space )
+{
+    return space == ColorSpace::SRGB ? "sRGB" : "linear";
+}
+
+// Random bytes, or for float images random values a little either side of 0..1 with some NaNs
+static std::vector<uint8_t> randomImage( Format format, uint32_t width, uint32_t height, size_t pitch, std::mt19937& rng )
+{
+    std::vector<uint8_t> image( pitch * height );
+    if ( format == Format::RGBA32Float )
+    {
+        std::uniform_real_distribution<float> value( -0.1f, 1.1f );
+        for ( uint32_t y = 0; y < height; ++y )
+        {
+            float* pRow = reinterpret_cast<float*>( image.data() + y * pitch );
+            for ( uint32_t i = 0; i < width * 4; ++i )
+            {
+                pRow[i] = rng() % 97 == 0 ? NAN : value( rng );
+            }
+        }
+    }
+    else
+    {
+        for ( uint8_t& byte : image )
+        {
+            byte = (uint8_t)rng();
+        }
+    }
+    return image;
+}
+
+struct Destination
+{
+    std::vector<uint8_t> pixels;    // RGBA8 or BGRA8, tightly packed
+    uint32_t width;
+};
+
+static void* newStaging( void* pUser, size_t size, uint8_t** ppMemory )
+{
+    std::vector<uint8_t>* pBuffer = new std::vector<uint8_t>( size );
+    *ppMemory = pBuffer->data();
+    return pBuffer;
+}
+
+static void freeStaging( void* pUser, void* pStaging )
+{
+    delete static_cast<std::vector<uint8_t>*>( pStaging );
+}
+
+struct Upload
+{
+    Layout src;
+    Layout dst;
+    uint32_t width, height;
+    std::vector<uint8_t> source;
+    std::vector<uint8_t> expected;
+    Destination* pTarget;
+    UploadQueue::Ticket ticket;
+    bool completed;
+    bool correctWhenCompleted;
+};
+
+static void uploadComplete( void* pUser, UploadQueue::Ticket ticket )
+{
+    Upload& upload = *static_cast<Upload*>( pUser );
+    upload.completed = true;
+    upload.correctWhenCompleted = upload.pTarget->pixels == upload.expected;
+}
+
+// Every conversion checked against the reference on odd sized images and timed, then uploads
+// of random sizes through an UploadQueue with a simulated GPU that runs each frame's blits when
+// the frame retires - if staging memory were reused early, or a band landed in the wrong
+// place, the images would come out wrong
+int uploadTool( int argc, const char* argv[] )
+{
+    const uint32_t width = argc > 0 ? (uint32_t)atoi( argv[0] ) : 1024;
+    const uint32_t height = argc > 1 ? (uint32_t)atoi( argv[1] ) : 1024;
+    const size_t uploadCount = argc > 2 ? (size_t)atol( argv[2] ) : 200;
+    const uint64_t frameBudget = ( argc > 3 ? (uint64_t)atol( argv[3] ) : 1024 ) << 10;
+    const uint64_t framesInFlight = argc > 4 ? (uint64_t)atol( argv[4] ) : 3;
+    std::cout << "upload " << width << "x" << height << " conversions, " << uploadCount << " uploads with " << ( frameBudget >> 10 )
+              << " KB a frame, " << framesInFlight << " frames in flight" << std::endl;
+
+    std::mt19937 rng( 1234 );
+    const Format sources[] = { Format::RGBA8, Format::BGRA8, Format::RGB8, Format::RGBA32Float };
+    const Format destinations[] = { Format::RGBA8, Format::BGRA8 };
+    const ColorSpace spaces[] = { ColorSpace::Linear, ColorSpace::SRGB };
+
+    // every pairing, odd sizes for the tails, against the reference
+    size_t pairings = 0, mismatched = 0;
+    for ( Format srcFormat : sources )
+    {
+        for ( ColorSpace srcSpace : spaces )
+        {
+            for ( Format dstFormat : destinations )
+            {
+                for ( ColorSpace dstSpace : spaces )
+                {
+                    if ( srcFormat == Format::RGBA32Float && srcSpace == ColorSpace::SRGB )
+                    {
+                        continue;
+                    }
+                    const uint32_t w = 37 + (uint32_t)( rng() % 64 ), h = 5;
+                    const size_t srcPitch = w * PixelConvert::bytesPerPixel( srcFormat ) + 12;
+                    const std::vector<uint8_t> image = randomImage( srcFormat, w, h, srcPitch, rng );
+                    std::vector<uint8_t> converted( w * 4 * h, 0 ), reference( w * 4 * h, 1 );
+                    const Layout src = { srcFormat, srcSpace }, dst = { dstFormat, dstSpace };
+                    PixelConvert::convertRows( image.data(), srcPitch, src, converted.data(), w * 4, dst, w, h );
+                    PixelConvert::convertRowsReference( image.data(), srcPitch, src, reference.data(), w * 4, dst, w, h );
+                    ++pairings;
+                    if ( converted != reference )
+                    {
+                        ++mismatched;
+                        std::cout << "  MISMATCH " << formatName( srcFormat ) << " " << spaceName( srcSpace ) << " -> " << formatName( dstFormat )
+                                  << " " << spaceName( dstSpace ) << std::endl;
+                    }
+                }
+            }
+        }
+    }
+
+    // float -> sRGB through the 16 bit table against the exact curve
+    int worstSRGB = 0;
+    for ( int i = 0; i <= 65536; ++i )
+    {
+        const float linear[4] = { i / 65536.f, 0.f, 0.f, 1.f };
+        uint8_t texel[4];
+        PixelConvert::convertRows( reinterpret_cast<const uint8_t*>( linear ), 16, { Format::RGBA32Float, ColorSpace::Linear }, texel, 4,
+                                   { Format::RGBA8, ColorSpace::SRGB }, 1, 1 );
+        const double c = i / 65536.0;
+        const double exact = ( c <= 0.0031308 ? c * 12.92 : 1.055 * pow( c, 1.0 / 2.4 ) - 0.055 ) * 255.0;
+        worstSRGB = std::max( worstSRGB, abs( texel[0] - (int)lround( exact ) ) );
+    }
+    std::cout << "  " << pairings << " conversions, " << mismatched << " differ from the reference; float to sRGB at most " << worstSRGB
+              << " off the exact curve" << std::endl;
+
+    // throughput, bytes written per second
+    struct Timed
+    {
+        Layout src;
+        Layout dst;
+    };
+    const Timed timed[] = {
+        { { Format::RGBA8, ColorSpace::Linear }, { Format::BGRA8, ColorSpace::Linear } },
+        { { Format::RGB8, ColorSpace::SRGB }, { Format::RGBA8, ColorSpace::SRGB } },
+        { { Format::RGB8, ColorSpace::SRGB }, { Format::BGRA8, ColorSpace::SRGB } },
+        { { Format::RGBA8, ColorSpace::Linear }, { Format::RGBA8, ColorSpace::SRGB } },
+        { { Format::RGBA32Float, ColorSpace::Linear }, { Format::RGBA8, ColorSpace::SRGB } },
+    };
+    std::vector<uint8_t> converted( (size_t)width * 4 * height );
+    for ( const Timed& t : timed )
+    {
+        const size_t srcPitch = width * PixelConvert::bytesPerPixel( t.src.format );
+        const std::vector<uint8_t> image = randomImage( t.src.format, width, height, srcPitch, rng );
+        auto best = [&]( auto convert )
+        {
+            double bestMs = 1e30;
+            for ( int run = 0; run < 5; ++run )
+            {
+                const auto start = std::chrono::steady_clock::now();
+                convert( image.data(), srcPitch, t.src, converted.data(), (size_t)width * 4, t.dst, width, height );
+                bestMs = std::min( bestMs, elapsedMs( start ) );
+            }
+            return bestMs;
+        };
+        const double vectorMs = best( PixelConvert::convertRows );
+        const double scalarMs = best( PixelConvert::convertRowsReference );
+        const double gb = converted.size() / 1e9;
+        std::cout << "  " << formatName( t.src.format ) << " " << spaceName( t.src.colorSpace ) << " -> " << formatName( t.dst.format ) << " "
+                  << spaceName( t.dst.colorSpace ) << ": " << gb / ( vectorMs / 1e3 ) << " GB/s, reference " << gb / ( scalarMs / 1e3 ) << " GB/s"
+                  << std::endl;
+    }
+
+    // budgeted uploads - sizes from a few rows to more than a frame's budget
+    std::vector<Upload> uploads( uploadCount );
+    std::vector<Destination> targets( uploadCount );
+    for ( size_t i = 0; i < uploadCount; ++i )
+    {
+        Upload& upload = uploads[i];
+        upload.src = { sources[ rng() % 4 ], rng() % 2 ? ColorSpace::SRGB : ColorSpace::Linear };
+        upload.src.colorSpace = upload.src.format == Format::RGBA32Float ? ColorSpace::Linear : upload.src.colorSpace;
+        upload.dst = { destinations[ rng() % 2 ], rng() % 2 ? ColorSpace::SRGB : ColorSpace::Linear };
+        upload.width = 1 + (uint32_t)exp2( ( rng() % 1000 ) / 100.0 );
+        upload.height = 1 + (uint32_t)exp2( ( rng() % 1000 ) / 100.0 );
+        const size_t srcPitch = upload.width * PixelConvert::bytesPerPixel( upload.src.format );
+        upload.source = randomImage( upload.src.format, upload.width, upload.height, srcPitch, rng );
+        upload.expected.resize( (size_t)upload.width * 4 * upload.height );
+        PixelConvert::convertRowsReference( upload.source.data(), srcPitch, upload.src, upload.expected.data(), upload.width * 4, upload.dst,
+                                            upload.width, upload.height );
+        targets[i].pixels.assign( upload.expected.size(), 0 );
+        targets[i].width = upload.width;
+        upload.pTarget = &targets[i];
+        upload.completed = false;
+        upload.correctWhenCompleted = false;
+    }
+
+    size_t overBudget = 0, frames = 0;
+    uint64_t stagedBytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        UploadQueue queue( 4 << 20, frameBudget, 8, newStaging, freeStaging, nullptr );
+        std::vector<std::pair<uint64_t, std::vector<UploadQueue::Copy>>> inFlight;
+        size_t submitted = 0;
+        std::vector<UploadQueue::Copy> copies;
+        for ( uint64_t frame = 1; frame < 100000; ++frame )
+        {
+            // a few new uploads a frame
+            for ( int n = 0; n < 4 && submitted < uploadCount; ++n, ++submitted )
+            {
+                Upload& upload = uploads[ submitted ];
+                const size_t srcPitch = upload.width * PixelConvert::bytesPerPixel( upload.src.format );
+                upload.ticket = queue.submit( { upload.pTarget, 0, 0, 0, upload.width, upload.height, upload.source.data(), srcPitch,
+                                                upload.src, upload.dst, uploadComplete, &upload } );
+            }
+
+            // the GPU finishes frames framesInFlight behind, running their blits as it does
+            const uint64_t retired = frame > framesInFlight ? frame - framesInFlight : 0;
+            while ( !inFlight.empty() && inFlight.front().first <= retired )
+            {
+                for ( const UploadQueue::Copy& copy : inFlight.front().second )
+                {
+                    Destination& target = *static_cast<Destination*>( copy.pTarget );
+                    const uint8_t* pStaging = static_cast<std::vector<uint8_t>*>( copy.pStaging )->data() + copy.offset;
+                    for ( uint32_t row = 0; row < copy.height; ++row )
+                    {
+                        memcpy( target.pixels.data() + ( (size_t)( copy.y + row ) * target.width + copy.x ) * 4, pStaging + row * copy.rowPitch,
+                                (size_t)copy.width * 4 );
+                    }
+                }
+                inFlight.erase( inFlight.begin() );
+            }
+
+            queue.plan( frame, retired, copies );
+            const UploadQueue::Stats stats = queue.stats();
+            // one row over is allowed when that row is all the frame staged
+            overBudget += stats.stagedBytes > frameBudget && stats.copies > 1 ? 1 : 0;
+            stagedBytes += stats.stagedBytes;
+            inFlight.push_back( { frame, copies } );
+            frames = frame;
+            if ( stats.completed == uploadCount )
+            {
+                break;
+            }
+        }
+        const UploadQueue::Stats stats = queue.stats();
+        const double ms = elapsedMs( start );
+        size_t completed = 0, correct = 0, ticketsComplete = 0;
+        for ( const Upload& upload : uploads )
+        {
+            completed += upload.completed ? 1 : 0;
+            correct += upload.correctWhenCompleted ? 1 : 0;
+            ticketsComplete += queue.isComplete( upload.ticket ) ? 1 : 0;
+        }
+        std::cout << "  " << completed << " of " << uploadCount << " completed, " << correct << " correct when they did, " << ticketsComplete
+                  << " tickets complete; " << frames << " frames, " << overBudget << " over budget, peak " << ( stats.maxStagedBytes >> 10 )
+                  << " KB, mean " << ( stagedBytes / std::max<size_t>( frames, 1 ) >> 10 ) << " KB a frame, " << stats.stagingBuffers
+                  << " staging buffers, " << ms << " ms" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,76 @@
+//
+//  mmtool.cpp
+//  MyMetalCPP
+//
+//  Command line front end for the CPU side systems - benchmarks and offline converters.
+//
+
+#include "Tools.hpp"
+
+#include <cstring>
+#include <iostream>
+
+struct Command
+{
+    const char* name;
+    const char* help;
+    int (*fn)( int argc, const char* argv[] );
+};
+
+static const Command kCommands[] = {
+    { "deepzoom", "[width] [height] [frames]   benchmark the perturbation Mandelbrot renderer", deepZoomTool },
+    { "kernels", "[width] [height] [frames] [out.ppm]   run the shared compute kernels on the CPU backend", kernelTool },
+    { "raster", "[width] [height] [frames] [out.ppm]   render the cube scene with the software rasterizer", rasterTool },
+    { "mips", "[size] [iterations]   benchmark mip chain generation and the trilinear sampler", mipTool },
+    { "meshopt", "[segments] [spheres]   optimize a generated triangle soup and report ACMR/ATVR, overfetch and overdraw", meshOptTool },
+    { "quantize", "[segments] [iterations]   quantize the optimized test mesh to 16 byte vertices, report error and throughput", quantizeTool },
+    { "meshlets", "[segments] [meshes] [iterations]   build, validate and cull meshlets for a set of generated meshes", meshletTool },
+    { "lod", "[segments] [pixel error]   simplify a generated sphere into a LOD chain and select levels for the cube scene", lodTool },
+    { "scene", "write|info|validate|bench <file> [args]   convert, check and benchmark the mmap'd binary scene format", sceneTool },
+    { "scenegraph", "[nodes] [iterations] [dirty fraction]   check and benchmark transform propagation through the SoA scene graph", sceneGraphTool },
+    { "bvh", "[segments] [boxes] [rays]   build 4 and 8 wide BVHs over triangles and boxes, check and time ray casts, frustum queries and picking", bvhTool },
+    { "occlusion", "[occluders] [frames] [width] [height] [cube scale]   occlusion cull the rotating cube grid, check it against the software rasterizer", occlusionTool },
+    { "drawsort", "[draws] [pipelines] [textures] [meshes] [depth levels] [runs]   radix sort draw keys, check against std::stable_sort and report batches and state changes", drawSortTool },
+    { "multiview", "[instances] [runs]   cull scattered instances for 1 to 4 views in one pass, check the masks and per view ranges", multiViewTool },
+    { "record", "[draws] [draws per list] [runs]   record draw packets on every thread, check the merge is deterministic and time replaying them", recordTool },
+    { "release", "[frames] [frames in flight] [replaced per frame]   release resources behind simulated out of order GPU frames and check none goes early", releaseTool },
+    { "heap", "[operations] [heap MB] [max KB] [frames in flight]   TLSF allocation churn against a best fit map, checked for overlaps, then frees deferred by frames", heapTool },
+    { "slots", "[operations per thread] [threads] [capacity]   hammer the lock free slot allocator from every thread, check ownership and stale handles, time it against a mutex free list", slotTool },
+    { "shaders", "[shader dir] [saves]   flatten the shader libraries for runtime compiles, time saves through the file watcher and check which libraries they rebuild", shaderTool },
+    { "upload", "[width] [height] [uploads] [budget KB] [frames in flight]   check the pixel conversions against the scalar ones, time them and run budgeted uploads through a simulated GPU", uploadTool },
+    { "ktx2", "pack|info|bench <file> [args]   build mipped KTX2 textures (zlib or zstd supercompressed), inspect them and time loads against read()", ktx2Tool },
+    { "stream", "[tiles] [budget MB] [frames] [threads] [storage MB/s]   fly over a grid of assets streamed by priority under a memory budget from simulated storage", streamTool },
+    { "aio", "[small files] [small KB] [large files] [large MB] [queue depth] [dir]   read many small and a few large files with pread, threads and io_uring", aioTool },
+    { "pack", "build <pack> <dir> [none|lz4|zlib|zstd] [chunk KB] [level] | list <pack> | bench [assets] [dir] [iterations]   chunked compressed asset packs", packTool },
+    { "anim", "[characters] [bones] [vertices] [updates]   skeletal animation: clip compression, skin matrices and CPU skinning", animTool },
+};
+
+static void PrintUsage()
+{
+    std::cout << "usage: mmtool <command> [args]" << std::endl;
+    for ( const Command& command : kCommands )
+    {
+        std::cout << "  " << command.name << " " << command.help << std::endl;
+    }
+}
+
+int main( int argc, const char* argv[] )
+{
+    if ( argc < 2 )
+    {
+        PrintUsage();
+        return 1;
+    }
+
+    for ( const Command& command : kCommands )
+    {
+        if ( strcmp( argv[1], command.name ) == 0 )
+        {
+            return command.fn( argc - 2, argv + 2 );
+        }
+    }
+
+    std::cout << "unknown command " << argv[1] << std::endl;
+    PrintUsage();
+    return 1;
+}